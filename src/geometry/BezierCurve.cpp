@@ -1,5 +1,10 @@
 #include "geometry/BezierCurve.h"
 
+#include <algorithm>
+#include <cassert>
+
+#include "math/function.h"
+
 using namespace pea;
 
 BezierCurve::BezierCurve(int32_t subdivision):
@@ -29,3 +34,85 @@ int32_t BezierCurve::getSubdivision() const
 {
 	return _bernstein0.size() - 1;
 }
+
+vec3f BezierCurve::getPosition(const vec3f points[4], float t)
+{
+	const float s = 1 - t;
+	return (s * s * s) * points[0] + (3 * t * s * s) * points[1] + (3 * t * t * s) * points[2] + (t * t * t) * points[3];
+}
+
+vec3f BezierCurve::getDerivative(const vec3f points[4], float t)
+{
+	const float s = 1 - t;
+	return (3 * s * s) * (points[1] - points[0]) + (6 * t * s) * (points[2] - points[1]) + (3 * t * t) * (points[3] - points[2]);
+}
+
+void BezierCurve::measure(const vec3f points[4], float* lengths) const
+{
+	assert(lengths != nullptr);
+	auto speed = [points](float t) { return getDerivative(points, t).length(); };
+	const int32_t subdivision = getSubdivision();
+	const float delta = 1.0F / subdivision;
+	lengths[0] = 0;
+	for(int32_t n = 0; n < subdivision; ++n)
+		lengths[n + 1] = lengths[n] + integrateGaussLegendre(speed, n * delta, (n + 1) * delta);
+}
+
+/**
+ * @param[in] n step where distance lies, lengths[n] <= distance <= lengths[n + 1].
+ */
+static float getParameter(const vec3f points[4], const float* lengths, int32_t n, float delta, float distance)
+{
+	const float t0 = n * delta, t1 = t0 + delta;
+	const float length = lengths[n + 1] - lengths[n];
+	if(!(length > 0))
+		return t0;
+	
+	const float target = std::clamp(distance - lengths[n], 0.0F, length);
+	float t = t0 + delta * (target / length);
+	auto speed = [points](float t) { return BezierCurve::getDerivative(points, t).length(); };
+	for(int32_t i = 0; i < 2; ++i)
+	{
+		float velocity = speed(t);
+		if(!(velocity > 0))
+			break;
+		t -= (integrateGaussLegendre(speed, t0, t) - target) / velocity;
+		t = std::clamp(t, t0, t1);
+	}
+	return t;
+}
+
+float BezierCurve::getParameter(const vec3f points[4], const float* lengths, float distance) const
+{
+	assert(lengths != nullptr);
+	const int32_t subdivision = getSubdivision();
+	const float* it = std::upper_bound(lengths + 1, lengths + subdivision, distance);
+	return ::getParameter(points, lengths, static_cast<int32_t>(it - lengths) - 1, 1.0F / subdivision, distance);
+}
+
+void BezierCurve::sample(const vec3f points[4], const float* lengths, const float* distances, size_t count,
+		vec3f* positions, vec3f* tangents) const
+{
+	assert(lengths != nullptr && distances != nullptr && positions != nullptr);
+	const int32_t subdivision = getSubdivision();
+	const float delta = 1.0F / subdivision;
+	int32_t n = 0;
+	for(size_t i = 0; i < count; ++i)
+	{
+		const float distance = distances[i];
+		if(n > 0 && distance < lengths[n])  // going back, search again
+			n = static_cast<int32_t>(std::upper_bound(lengths + 1, lengths + n, distance) - lengths) - 1;
+		else
+			while(n + 1 < subdivision && lengths[n + 1] <= distance)
+				++n;
+		
+		const float t = ::getParameter(points, lengths, n, delta, distance);
+		positions[i] = getPosition(points, t);
+		if(tangents != nullptr)
+		{
+			vec3f tangent = getDerivative(points, t);
+			float length = tangent.length();
+			tangents[i] = length > 0? tangent / length: vec3f(0, 0, 0);
+		}
+	}
+}
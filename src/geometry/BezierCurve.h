@@ -1,8 +1,10 @@
 #ifndef PEA_GEOMETRY_BEZIER_CURVE_H_
 #define PEA_GEOMETRY_BEZIER_CURVE_H_
 
+#include <cstddef>
 #include <vector>
 
+#include "math/vec3.h"
 #include "math/vec4.h"
 
 namespace pea {
@@ -28,6 +30,14 @@ namespace pea {
  * v(t) = 3*A*t^2 + 2*B*t + C
  * and again for the acceleration.
  * a(t) = 6*A*t + 2*B
+ *
+ * Parameter t doesn't go along the curve evenly. To place points at equal distances, measure the
+ * curve once into cumulative lengths at the subdivision steps, then map distances to parameters.
+ * @code
+ *   std::vector<float> lengths(curve.getSubdivision() + 1);
+ *   curve.measure(points, lengths.data());
+ *   curve.sample(points, lengths.data(), distances, count, positions, tangents);
+ * @endcode
  */
 class BezierCurve
 {
@@ -57,6 +67,41 @@ public:
 	 * @return coefficient of k-th point's derivative.
 	 */
 	const vec4f& bernstein1(int32_t k) const;
+	
+	/**
+	 * @return position of cubic curve of control points at parameter t.
+	 */
+	static vec3f getPosition(const vec3f points[4], float t);
+	
+	/**
+	 * @return 1st derivative of cubic curve of control points at parameter t.
+	 */
+	static vec3f getDerivative(const vec3f points[4], float t);
+	
+	/**
+	 * Measure the curve by Gauss-Legendre quadrature of its speed between subdivision steps.
+	 * @param[in]  points  four control points.
+	 * @param[out] lengths subdivision + 1 cumulative lengths, from 0 at t = 0 to the curve length.
+	 */
+	void measure(const vec3f points[4], float* lengths) const;
+	
+	/**
+	 * Look up the step containing distance in O(log(subdivision)), then refine the parameter by
+	 * Newton's method.
+	 * @param[in] lengths  table filled by measure().
+	 * @param[in] distance arc length from the start point, clamped to the curve.
+	 * @return parameter t of the point at distance.
+	 */
+	float getParameter(const vec3f points[4], const float* lengths, float distance) const;
+	
+	/**
+	 * Batch of getParameter(), with positions and unit tangents of the points. Ascending distances
+	 * walk the table forward instead of searching it.
+	 * @param[out] positions positions of count points.
+	 * @param[out] tangents  unit tangents of count points, zero where the curve stops, can be nullptr.
+	 */
+	void sample(const vec3f points[4], const float* lengths, const float* distances, size_t count,
+			vec3f* positions, vec3f* tangents) const;
 };
 
 inline const vec4f& BezierCurve::bernstein0(int32_t k) const { return _bernstein0[k]; }
@@ -0,0 +1,1288 @@
+#include "geometry/BoundingVolumeHierarchy.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "pea/config.h"
+#if OpenMP_CXX_FOUND
+#include <omp.h>
+#endif
+
+#include "util/compiler.h"
+#include "util/cpu.h"
+
+// AVX2 kernels are built on any x86 compiler, and chosen at runtime if the CPU has AVX2. They
+// don't use FMA, so that packets hit what single rays hit, with the same u and v.
+#if PEA_ARCH_X86
+#include <immintrin.h>
+#define BVH_AVX 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define BVH_SSE 1
+#endif
+
+using namespace pea;
+
+namespace {
+
+constexpr uint32_t BIN_COUNT = 32;           ///< at most, small nodes take fewer
+constexpr uint32_t MAX_LEAF_SIZE = 16;       ///< SAH can't make leaves larger than this
+constexpr uint32_t SUBTREE_SIZE = 1U << 14;  ///< nodes smaller than this are built by one thread
+constexpr uint32_t CHUNK_SIZE = 1U << 14;    ///< triangles binned by one thread
+constexpr float TRAVERSAL_COST = 1.0F;       ///< relative to intersecting a triangle
+constexpr uint32_t EMPTY = std::numeric_limits<uint32_t>::max();  ///< source of empty slot of wide node
+
+struct Bounds
+{
+	vec3f lower, upper;
+
+	void reset()
+	{
+		constexpr float INF = std::numeric_limits<float>::infinity();
+		lower = vec3f(+INF, +INF, +INF);
+		upper = vec3f(-INF, -INF, -INF);
+	}
+
+	void add(const vec3f& point)
+	{
+		for(int32_t i = 0; i < 3; ++i)
+		{
+			lower[i] = std::min(lower[i], point[i]);
+			upper[i] = std::max(upper[i], point[i]);
+		}
+	}
+
+	void add(const Bounds& other)
+	{
+		for(int32_t i = 0; i < 3; ++i)
+		{
+			lower[i] = std::min(lower[i], other.lower[i]);
+			upper[i] = std::max(upper[i], other.upper[i]);
+		}
+	}
+
+	float getHalfArea() const
+	{
+		vec3f size = upper - lower;
+		return size.x * size.y + size.y * size.z + size.z * size.x;
+	}
+};
+
+/**
+ * Triangle to be built, centroid is taken as lower + upper, i.e. doubled.
+ */
+struct Reference
+{
+	vec3f lower;
+	uint32_t id;
+	vec3f upper;
+};
+
+struct Bin
+{
+	Bounds bounds;
+	uint32_t count;
+
+	void reset()
+	{
+		bounds.reset();
+		count = 0;
+	}
+};
+
+struct Bins
+{
+	Bin axes[3][BIN_COUNT];
+};
+
+struct Task
+{
+	uint32_t node;
+	uint32_t begin, end;  ///< range of references
+	uint32_t depth;
+	Bounds bounds;
+	Bounds centroids;
+};
+
+/**
+ * Maps centroids to bins of each axis.
+ */
+struct Binning
+{
+	uint32_t count;  ///< of bins
+	vec3f offset;
+	vec3f scale;  ///< 0 for axis of no extent
+
+	Binning(const Bounds& centroids, uint32_t referenceCount)
+	{
+		// bins more than a few times references barely find better splits.
+		count = std::min(BIN_COUNT, 4 + referenceCount / 4);
+		offset = centroids.lower;
+		for(int32_t i = 0; i < 3; ++i)
+		{
+			float extent = centroids.upper[i] - centroids.lower[i];
+			scale[i] = extent > 0? count * (1 - 1E-6F) / extent: 0;
+		}
+	}
+
+	uint32_t getBin(const vec3f& centroid, int32_t axis) const
+	{
+		int32_t bin = static_cast<int32_t>((centroid[axis] - offset[axis]) * scale[axis]);
+		return static_cast<uint32_t>(std::clamp<int32_t>(bin, 0, count - 1));
+	}
+};
+
+inline vec3f getCentroid(const Reference& reference)
+{
+	return reference.lower + reference.upper;
+}
+
+inline vec3f getInverse(const vec3f& direction)
+{
+	return vec3f(1 / direction.x, 1 / direction.y, 1 / direction.z);
+}
+
+/**
+ * Rays are cut short to finite length, or they would enter empty slots of wide nodes, which are
+ * boxes at infinity.
+ */
+inline float getFinite(float distance)
+{
+	return std::min(distance, std::numeric_limits<float>::max());
+}
+
+/*
+ * Rays of a packet are traced Lanes::COUNT at a time, in AVX or SSE registers, or one by one.
+ * Masks of comparisons are combined with & and |, and picked by select(). Groups of lanes are
+ * skipped if none of their rays is active, i.e. (lanes >> i & Lanes::MASK) == 0 for group at lane
+ * i. Packet kernels are templates of Lanes, AVX functions are inlined into a TARGET_AVX2_NO_FMA caller.
+ */
+constexpr uint32_t MAX_LANE_COUNT = 8;
+
+#if BVH_AVX
+namespace avx {
+
+struct Mask  { __m256 value; };
+struct Lanes
+{
+	static constexpr uint32_t COUNT = 8;
+	static constexpr uint32_t MASK = 0xFF;
+	__m256 value;
+
+	TARGET_AVX2_NO_FMA static Lanes load(const float* data) { return Lanes{_mm256_load_ps(data)}; }
+	TARGET_AVX2_NO_FMA static Lanes broadcast(float value)  { return Lanes{_mm256_set1_ps(value)}; }
+};
+
+TARGET_AVX2_NO_FMA inline void  store(float* data, Lanes a)       { _mm256_store_ps(data, a.value); }
+TARGET_AVX2_NO_FMA inline Lanes operator +(Lanes a, Lanes b)      { return Lanes{_mm256_add_ps(a.value, b.value)}; }
+TARGET_AVX2_NO_FMA inline Lanes operator -(Lanes a, Lanes b)      { return Lanes{_mm256_sub_ps(a.value, b.value)}; }
+TARGET_AVX2_NO_FMA inline Lanes operator *(Lanes a, Lanes b)      { return Lanes{_mm256_mul_ps(a.value, b.value)}; }
+TARGET_AVX2_NO_FMA inline Lanes operator /(Lanes a, Lanes b)      { return Lanes{_mm256_div_ps(a.value, b.value)}; }
+TARGET_AVX2_NO_FMA inline Lanes min(Lanes a, Lanes b)             { return Lanes{_mm256_min_ps(a.value, b.value)}; }
+TARGET_AVX2_NO_FMA inline Lanes max(Lanes a, Lanes b)             { return Lanes{_mm256_max_ps(a.value, b.value)}; }
+TARGET_AVX2_NO_FMA inline Mask  operator <(Lanes a, Lanes b)      { return Mask{_mm256_cmp_ps(a.value, b.value, _CMP_LT_OQ)}; }
+TARGET_AVX2_NO_FMA inline Mask  operator <=(Lanes a, Lanes b)     { return Mask{_mm256_cmp_ps(a.value, b.value, _CMP_LE_OQ)}; }
+TARGET_AVX2_NO_FMA inline Mask  operator &(Mask a, Mask b)        { return Mask{_mm256_and_ps(a.value, b.value)}; }
+TARGET_AVX2_NO_FMA inline Mask  operator |(Mask a, Mask b)        { return Mask{_mm256_or_ps(a.value, b.value)};  }
+TARGET_AVX2_NO_FMA inline uint32_t getBits(Mask mask)             { return _mm256_movemask_ps(mask.value); }
+TARGET_AVX2_NO_FMA inline Lanes select(Mask mask, Lanes a, Lanes b) { return Lanes{_mm256_blendv_ps(b.value, a.value, mask.value)}; }
+
+}  // namespace avx
+#endif
+
+#if BVH_SSE
+namespace sse {
+
+struct Mask  { __m128 value; };
+struct Lanes
+{
+	static constexpr uint32_t COUNT = 4;
+	static constexpr uint32_t MASK = 0xF;
+	__m128 value;
+
+	static Lanes load(const float* data) { return Lanes{_mm_load_ps(data)}; }
+	static Lanes broadcast(float value)  { return Lanes{_mm_set1_ps(value)}; }
+};
+
+inline void  store(float* data, Lanes a)       { _mm_store_ps(data, a.value); }
+inline Lanes operator +(Lanes a, Lanes b)      { return Lanes{_mm_add_ps(a.value, b.value)}; }
+inline Lanes operator -(Lanes a, Lanes b)      { return Lanes{_mm_sub_ps(a.value, b.value)}; }
+inline Lanes operator *(Lanes a, Lanes b)      { return Lanes{_mm_mul_ps(a.value, b.value)}; }
+inline Lanes operator /(Lanes a, Lanes b)      { return Lanes{_mm_div_ps(a.value, b.value)}; }
+inline Lanes min(Lanes a, Lanes b)             { return Lanes{_mm_min_ps(a.value, b.value)}; }
+inline Lanes max(Lanes a, Lanes b)             { return Lanes{_mm_max_ps(a.value, b.value)}; }
+inline Mask  operator <(Lanes a, Lanes b)      { return Mask{_mm_cmplt_ps(a.value, b.value)}; }
+inline Mask  operator <=(Lanes a, Lanes b)     { return Mask{_mm_cmple_ps(a.value, b.value)}; }
+inline Mask  operator &(Mask a, Mask b)        { return Mask{_mm_and_ps(a.value, b.value)}; }
+inline Mask  operator |(Mask a, Mask b)        { return Mask{_mm_or_ps(a.value, b.value)};  }
+inline uint32_t getBits(Mask mask)             { return _mm_movemask_ps(mask.value); }
+inline Lanes select(Mask mask, Lanes a, Lanes b)
+{
+	return Lanes{_mm_or_ps(_mm_and_ps(mask.value, a.value), _mm_andnot_ps(mask.value, b.value))};
+}
+
+}  // namespace sse
+#else
+namespace scalar {
+
+struct Mask  { bool value; };
+struct Lanes
+{
+	static constexpr uint32_t COUNT = 1;
+	static constexpr uint32_t MASK = 0x1;
+	float value;
+
+	static Lanes load(const float* data) { return Lanes{*data}; }
+	static Lanes broadcast(float value)  { return Lanes{value}; }
+};
+
+// min and max take the second one if either is NaN, as SSE does.
+inline void  store(float* data, Lanes a)       { *data = a.value; }
+inline Lanes operator +(Lanes a, Lanes b)      { return Lanes{a.value + b.value}; }
+inline Lanes operator -(Lanes a, Lanes b)      { return Lanes{a.value - b.value}; }
+inline Lanes operator *(Lanes a, Lanes b)      { return Lanes{a.value * b.value}; }
+inline Lanes operator /(Lanes a, Lanes b)      { return Lanes{a.value / b.value}; }
+inline Lanes min(Lanes a, Lanes b)             { return Lanes{a.value < b.value? a.value: b.value}; }
+inline Lanes max(Lanes a, Lanes b)             { return Lanes{a.value > b.value? a.value: b.value}; }
+inline Mask  operator <(Lanes a, Lanes b)      { return Mask{a.value < b.value};  }
+inline Mask  operator <=(Lanes a, Lanes b)     { return Mask{a.value <= b.value}; }
+inline Mask  operator &(Mask a, Mask b)        { return Mask{a.value && b.value}; }
+inline Mask  operator |(Mask a, Mask b)        { return Mask{a.value || b.value}; }
+inline uint32_t getBits(Mask mask)             { return mask.value; }
+inline Lanes select(Mask mask, Lanes a, Lanes b) { return mask.value? a: b; }
+
+}  // namespace scalar
+#endif
+
+#if BVH_SSE
+using DefaultLanes = sse::Lanes;
+#else
+using DefaultLanes = scalar::Lanes;
+#endif
+
+bool hasAVX()
+{
+#if BVH_AVX
+	return getCpuFeature().avx2;
+#else
+	return false;
+#endif
+}
+
+}  // namespace
+
+class BoundingVolumeHierarchy::Builder
+{
+private:
+	Reference* references;
+	uint32_t maxLeafSize;
+
+private:
+	void bin(const Task& task, const Binning& binning, bool parallel, Bins& bins) const;
+
+	/**
+	 * Bounds of references from begin to end, with their centroids.
+	 */
+	void getBounds(uint32_t begin, uint32_t end, Bounds& bounds, Bounds& centroids) const;
+
+public:
+	Builder(Reference* references, uint32_t maxLeafSize);
+
+	/**
+	 * @param[in]  parallel bin task's references in parallel.
+	 * @param[out] children tasks of two halves, node of them is left for caller to assign.
+	 * @return false if task should be a leaf.
+	 */
+	bool split(const Task& task, bool parallel, Task children[2]) const;
+
+	/**
+	 * Build subtree of task on this thread, task.node indexes nodes.
+	 */
+	void build(const Task& task, std::vector<Node>& nodes) const;
+};
+
+BoundingVolumeHierarchy::Builder::Builder(Reference* references, uint32_t maxLeafSize):
+		references(references),
+		maxLeafSize(std::max<uint32_t>(maxLeafSize, 1))
+{
+}
+
+void BoundingVolumeHierarchy::Builder::bin(const Task& task, const Binning& binning, bool parallel, Bins& bins) const
+{
+	auto binRange = [this, &binning](uint32_t begin, uint32_t end, Bins& bins)
+	{
+		for(int32_t axis = 0; axis < 3; ++axis)
+			for(uint32_t i = 0; i < binning.count; ++i)
+				bins.axes[axis][i].reset();
+
+		for(uint32_t i = begin; i < end; ++i)
+		{
+			const Reference& reference = references[i];
+			const Bounds bounds{reference.lower, reference.upper};
+			const vec3f centroid = getCentroid(reference);
+			for(int32_t axis = 0; axis < 3; ++axis)
+			{
+				Bin& bin = bins.axes[axis][binning.getBin(centroid, axis)];
+				bin.bounds.add(bounds);
+				++bin.count;
+			}
+		}
+	};
+
+	const uint32_t count = task.end - task.begin;
+	const uint32_t chunkCount = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	if(!parallel || chunkCount <= 1)
+	{
+		binRange(task.begin, task.end, bins);
+		return;
+	}
+
+	// bins of chunks are merged in order, min and max don't round, so the result is the same.
+	std::vector<Bins> chunks(chunkCount);
+#pragma omp parallel for schedule(dynamic)
+	for(int32_t chunk = 0; chunk < static_cast<int32_t>(chunkCount); ++chunk)
+	{
+		uint32_t begin = task.begin + chunk * CHUNK_SIZE;
+		binRange(begin, std::min(begin + CHUNK_SIZE, task.end), chunks[chunk]);
+	}
+
+	for(int32_t axis = 0; axis < 3; ++axis)
+		for(uint32_t i = 0; i < binning.count; ++i)
+		{
+			Bin& bin = bins.axes[axis][i];
+			bin = chunks[0].axes[axis][i];
+			for(uint32_t chunk = 1; chunk < chunkCount; ++chunk)
+			{
+				const Bin& other = chunks[chunk].axes[axis][i];
+				bin.bounds.add(other.bounds);
+				bin.count += other.count;
+			}
+		}
+}
+
+void BoundingVolumeHierarchy::Builder::getBounds(uint32_t begin, uint32_t end, Bounds& bounds, Bounds& centroids) const
+{
+	bounds.reset();
+	centroids.reset();
+	for(uint32_t i = begin; i < end; ++i)
+	{
+		bounds.add(Bounds{references[i].lower, references[i].upper});
+		centroids.add(getCentroid(references[i]));
+	}
+}
+
+bool BoundingVolumeHierarchy::Builder::split(const Task& task, bool parallel, Task children[2]) const
+{
+	const uint32_t count = task.end - task.begin;
+	if(count <= maxLeafSize || task.depth + 1 >= MAX_DEPTH)
+		return false;
+
+	for(int32_t i = 0; i < 2; ++i)
+	{
+		children[i].depth = task.depth + 1;
+		children[i].node = 0;
+	}
+
+	const Binning binning(task.centroids, count);
+	if(binning.scale.x == 0 && binning.scale.y == 0 && binning.scale.z == 0)
+	{
+		// centroids coincide, split in the middle if it's too many for a leaf.
+		if(count <= MAX_LEAF_SIZE)
+			return false;
+
+		const uint32_t middle = task.begin + count / 2;
+		children[0].begin = task.begin;
+		children[0].end = children[1].begin = middle;
+		children[1].end = task.end;
+		for(int32_t i = 0; i < 2; ++i)
+			getBounds(children[i].begin, children[i].end, children[i].bounds, children[i].centroids);
+		return true;
+	}
+
+	Bins bins;
+	bin(task, binning, parallel, bins);
+
+	// sweep from right to left for areas and counts of right halves, then from left to right.
+	float bestCost = std::numeric_limits<float>::infinity();
+	int32_t bestAxis = -1;
+	uint32_t bestBin = 0;
+	for(int32_t axis = 0; axis < 3; ++axis)
+	{
+		if(binning.scale[axis] == 0)
+			continue;
+
+		float rightCosts[BIN_COUNT];
+		Bounds bounds;
+		bounds.reset();
+		uint32_t rightCount = 0;
+		for(uint32_t i = binning.count - 1; i > 0; --i)
+		{
+			const Bin& bin = bins.axes[axis][i];
+			bounds.add(bin.bounds);
+			rightCount += bin.count;
+			rightCosts[i] = rightCount > 0? bounds.getHalfArea() * rightCount: 0;
+		}
+
+		bounds.reset();
+		uint32_t leftCount = 0;
+		for(uint32_t i = 1; i < binning.count; ++i)
+		{
+			const Bin& bin = bins.axes[axis][i - 1];
+			bounds.add(bin.bounds);
+			leftCount += bin.count;
+			if(leftCount == 0 || leftCount == count)
+				continue;
+
+			float cost = bounds.getHalfArea() * leftCount + rightCosts[i];
+			if(cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestBin = i;
+			}
+		}
+	}
+
+	const float area = task.bounds.getHalfArea();
+	const float leafCost = static_cast<float>(count);
+	if(bestAxis < 0 || (count <= MAX_LEAF_SIZE && area > 0 && TRAVERSAL_COST + bestCost / area >= leafCost))
+		return false;
+
+	for(int32_t i = 0; i < 2; ++i)
+	{
+		children[i].bounds.reset();
+		children[i].centroids.reset();
+	}
+	for(uint32_t i = 0; i < binning.count; ++i)
+		children[i < bestBin? 0: 1].bounds.add(bins.axes[bestAxis][i].bounds);
+
+	// partition, and take centroid bounds of both sides on the way.
+	Reference* left = references + task.begin;
+	Reference* right = references + task.end;
+	for(;;)
+	{
+		for(; left < right && binning.getBin(getCentroid(*left), bestAxis) < bestBin; ++left)
+			children[0].centroids.add(getCentroid(*left));
+		for(; left < right && binning.getBin(getCentroid(right[-1]), bestAxis) >= bestBin; --right)
+			children[1].centroids.add(getCentroid(right[-1]));
+		if(left == right)
+			break;
+		std::swap(*left, right[-1]);
+	}
+	children[0].begin = task.begin;
+	children[0].end = children[1].begin = static_cast<uint32_t>(left - references);
+	children[1].end = task.end;
+	return true;
+}
+
+void BoundingVolumeHierarchy::Builder::build(const Task& task, std::vector<Node>& nodes) const
+{
+	Task children[2];
+	if(!split(task, false, children))
+	{
+		nodes[task.node] = Node{task.bounds.lower, task.begin, task.bounds.upper, task.end - task.begin};
+		return;
+	}
+
+	const uint32_t offset = static_cast<uint32_t>(nodes.size());
+	nodes.resize(offset + 2);
+	nodes[task.node] = Node{task.bounds.lower, offset, task.bounds.upper, 0};
+	for(uint32_t i = 0; i < 2; ++i)
+	{
+		children[i].node = offset + i;
+		build(children[i], nodes);
+	}
+}
+
+void BoundingVolumeHierarchy::setTriangles(const vec3f* positions, const uint32_t* indices)
+{
+	const int32_t size = static_cast<int32_t>(ids.size());
+	triangles.resize(size);
+#pragma omp parallel for
+	for(int32_t i = 0; i < size; ++i)
+	{
+		const uint32_t* index = indices + ids[i] * 3;
+		const vec3f& vertex = positions[index[0]];
+		triangles[i] = Triangle{vertex, positions[index[1]] - vertex, positions[index[2]] - vertex};
+	}
+}
+
+void BoundingVolumeHierarchy::build(const vec3f* positions, const uint32_t* indices, size_t triangleCount,
+		uint32_t maxLeafSize/* = 4 */)
+{
+	clear();
+	if(triangleCount == 0)
+		return;
+	assert(triangleCount <= std::numeric_limits<int32_t>::max());
+
+	const int32_t count = static_cast<int32_t>(triangleCount);
+	std::vector<Reference> references(count);
+	const int32_t chunkCount = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	std::vector<Bounds> chunkBounds(chunkCount * 2);
+#pragma omp parallel for schedule(dynamic)
+	for(int32_t chunk = 0; chunk < chunkCount; ++chunk)
+	{
+		Bounds& bounds = chunkBounds[chunk * 2];
+		Bounds& centroids = chunkBounds[chunk * 2 + 1];
+		bounds.reset();
+		centroids.reset();
+		for(int32_t i = chunk * CHUNK_SIZE, end = std::min<int32_t>(i + CHUNK_SIZE, count); i < end; ++i)
+		{
+			const uint32_t* index = indices + static_cast<size_t>(i) * 3;
+			Bounds triangle;
+			triangle.reset();
+			for(int32_t j = 0; j < 3; ++j)
+				triangle.add(positions[index[j]]);
+			references[i] = Reference{triangle.lower, static_cast<uint32_t>(i), triangle.upper};
+			bounds.add(triangle);
+			centroids.add(getCentroid(references[i]));
+		}
+	}
+
+	Task root{0, 0, static_cast<uint32_t>(count), 0, chunkBounds[0], chunkBounds[1]};
+	for(int32_t chunk = 1; chunk < chunkCount; ++chunk)
+	{
+		root.bounds.add(chunkBounds[chunk * 2]);
+		root.centroids.add(chunkBounds[chunk * 2 + 1]);
+	}
+
+	// split top levels one level after another, with large nodes binned in parallel, and
+	// many nodes split in parallel.
+	const Builder builder(references.data(), maxLeafSize);
+#if OpenMP_CXX_FOUND
+	const size_t threadCount = omp_get_max_threads();
+#else
+	const size_t threadCount = 1;
+#endif
+	nodes.resize(1);
+	std::vector<Task> level, subtrees;
+	(count > static_cast<int32_t>(SUBTREE_SIZE)? level: subtrees).push_back(root);
+	while(!level.empty())
+	{
+		const int32_t size = static_cast<int32_t>(level.size());
+		std::vector<Task> children(size * 2);
+		std::vector<uint8_t> inner(size);
+		const bool parallel = static_cast<size_t>(size) >= threadCount;
+		if(parallel)
+		{
+#pragma omp parallel for schedule(dynamic)
+			for(int32_t i = 0; i < size; ++i)
+				inner[i] = builder.split(level[i], false, &children[i * 2]);
+		}
+		else
+			for(int32_t i = 0; i < size; ++i)
+				inner[i] = builder.split(level[i], true, &children[i * 2]);
+
+		std::vector<Task> next;
+		for(int32_t i = 0; i < size; ++i)
+		{
+			const Task& task = level[i];
+			if(!inner[i])
+			{
+				nodes[task.node] = Node{task.bounds.lower, task.begin, task.bounds.upper, task.end - task.begin};
+				continue;
+			}
+
+			const uint32_t offset = static_cast<uint32_t>(nodes.size());
+			nodes.resize(offset + 2);
+			nodes[task.node] = Node{task.bounds.lower, offset, task.bounds.upper, 0};
+			for(uint32_t j = 0; j < 2; ++j)
+			{
+				Task& child = children[i * 2 + j];
+				child.node = offset + j;
+				(child.end - child.begin > SUBTREE_SIZE? next: subtrees).push_back(child);
+			}
+		}
+		level.swap(next);
+	}
+
+	// subtrees are built into their own nodes, whose root takes the place given above, and the rest
+	// are appended in order.
+	const int32_t subtreeCount = static_cast<int32_t>(subtrees.size());
+	std::vector<std::vector<Node>> locals(subtreeCount);
+#pragma omp parallel for schedule(dynamic)
+	for(int32_t i = 0; i < subtreeCount; ++i)
+	{
+		Task task = subtrees[i];
+		task.node = 0;
+		locals[i].resize(1);
+		builder.build(task, locals[i]);
+	}
+
+	std::vector<uint32_t> offsets(subtreeCount);
+	size_t nodeCount = nodes.size();
+	for(int32_t i = 0; i < subtreeCount; ++i)
+	{
+		offsets[i] = static_cast<uint32_t>(nodeCount);
+		nodeCount += locals[i].size() - 1;
+	}
+	nodes.resize(nodeCount);
+#pragma omp parallel for schedule(dynamic)
+	for(int32_t i = 0; i < subtreeCount; ++i)
+	{
+		const std::vector<Node>& local = locals[i];
+		const uint32_t offset = offsets[i] - 1;  // local node 0 isn't appended
+		for(size_t j = 0; j < local.size(); ++j)
+		{
+			Node node = local[j];
+			if(node.count == 0)
+				node.offset += offset;
+			nodes[j == 0? subtrees[i].node: offset + j] = node;
+		}
+	}
+
+	ids.resize(count);
+	for(int32_t i = 0; i < count; ++i)
+		ids[i] = references[i].id;
+	setTriangles(positions, indices);
+
+	wideNodes.reserve(nodes.size() / 2 + 1);
+	collapse(0);
+	setWideBounds();
+}
+
+void BoundingVolumeHierarchy::refit(const vec3f* positions, const uint32_t* indices)
+{
+	setTriangles(positions, indices);
+
+	// leaves first, then inner nodes from the last, since children are stored after parents.
+	const int32_t size = static_cast<int32_t>(nodes.size());
+#pragma omp parallel for schedule(dynamic, 1024)
+	for(int32_t i = 0; i < size; ++i)
+	{
+		Node& node = nodes[i];
+		if(node.count == 0)
+			continue;
+
+		Bounds bounds;
+		bounds.reset();
+		for(uint32_t j = node.offset, end = node.offset + node.count; j < end; ++j)
+		{
+			const Triangle& triangle = triangles[j];
+			bounds.add(triangle.vertex);
+			bounds.add(triangle.vertex + triangle.edge1);
+			bounds.add(triangle.vertex + triangle.edge2);
+		}
+		node.lower = bounds.lower;
+		node.upper = bounds.upper;
+	}
+
+	for(int32_t i = size - 1; i >= 0; --i)
+	{
+		Node& node = nodes[i];
+		if(node.count != 0)
+			continue;
+
+		const Node& left = nodes[node.offset];
+		const Node& right = nodes[node.offset + 1];
+		Bounds bounds{left.lower, left.upper};
+		bounds.add(Bounds{right.lower, right.upper});
+		node.lower = bounds.lower;
+		node.upper = bounds.upper;
+	}
+
+	setWideBounds();
+}
+
+uint32_t BoundingVolumeHierarchy::collapse(uint32_t node)
+{
+	// a leaf is collapsed only if it's the root, into a wide node of one child.
+	uint32_t children[WIDTH] = {node};
+	uint32_t childCount = 1;
+	while(childCount < WIDTH)
+	{
+		int32_t largest = -1;
+		float largestArea = -1;
+		for(uint32_t i = 0; i < childCount; ++i)
+		{
+			const Node& child = nodes[children[i]];
+			float area = Bounds{child.lower, child.upper}.getHalfArea();
+			if(child.count == 0 && area > largestArea)
+			{
+				largest = i;
+				largestArea = area;
+			}
+		}
+		if(largest < 0)
+			break;
+
+		const uint32_t offset = nodes[children[largest]].offset;
+		children[largest] = offset;
+		children[childCount++] = offset + 1;
+	}
+
+	// wide nodes are taken in preorder, and may be reallocated by recursion.
+	const uint32_t index = static_cast<uint32_t>(wideNodes.size());
+	wideNodes.emplace_back();
+	sources.resize(sources.size() + WIDTH, EMPTY);
+	for(uint32_t i = 0; i < childCount; ++i)
+	{
+		const Node& child = nodes[children[i]];
+		const uint32_t offset = child.count == 0? collapse(children[i]): child.offset;
+		WideNode& wideNode = wideNodes[index];
+		wideNode.offset[i] = offset;
+		wideNode.count[i] = child.count;
+		sources[index * WIDTH + i] = children[i];
+	}
+	for(uint32_t i = childCount; i < WIDTH; ++i)
+	{
+		wideNodes[index].offset[i] = 0;
+		wideNodes[index].count[i] = 0;
+	}
+	return index;
+}
+
+void BoundingVolumeHierarchy::setWideBounds()
+{
+	constexpr float INF = std::numeric_limits<float>::infinity();
+	const int32_t size = static_cast<int32_t>(wideNodes.size());
+#pragma omp parallel for
+	for(int32_t i = 0; i < size; ++i)
+	{
+		WideNode& wideNode = wideNodes[i];
+		for(uint32_t j = 0; j < WIDTH; ++j)
+		{
+			const uint32_t source = sources[i * WIDTH + j];
+			for(int32_t k = 0; k < 3; ++k)
+			{
+				wideNode.lower[k][j] = source != EMPTY? nodes[source].lower[k]: INF;
+				wideNode.upper[k][j] = source != EMPTY? nodes[source].upper[k]: INF;
+			}
+		}
+	}
+}
+
+void BoundingVolumeHierarchy::clear()
+{
+	nodes.clear();
+	triangles.clear();
+	ids.clear();
+	wideNodes.clear();
+	sources.clear();
+}
+
+/**
+ * Slab test of box, tNear is where ray enters it.
+ */
+static inline bool intersect(const vec3f& lower, const vec3f& upper, const vec3f& origin, const vec3f& inverse,
+		float maxDistance, float& tNear)
+{
+	float tMin = 0, tMax = maxDistance;
+	for(int32_t i = 0; i < 3; ++i)
+	{
+		float t0 = (lower[i] - origin[i]) * inverse[i];
+		float t1 = (upper[i] - origin[i]) * inverse[i];
+		tMin = std::max(tMin, std::min(t0, t1));
+		tMax = std::min(tMax, std::max(t0, t1));
+	}
+	tNear = tMin;
+	return tMin <= tMax;
+}
+
+/**
+ * Moller-Trumbore ray triangle intersection.
+ */
+static inline bool intersect(const vec3f& vertex, const vec3f& edge1, const vec3f& edge2, const vec3f& origin,
+		const vec3f& direction, float maxDistance, float& distance, float& u, float& v)
+{
+	const vec3f p = cross(direction, edge2);
+	const float determinant = dot(edge1, p);
+	if(determinant == 0)  // parallel
+		return false;
+
+	const float inverse = 1 / determinant;
+	const vec3f s = origin - vertex;
+	u = dot(s, p) * inverse;
+	if(!(u >= 0 && u <= 1))
+		return false;
+
+	const vec3f q = cross(s, edge1);
+	v = dot(direction, q) * inverse;
+	if(!(v >= 0 && u + v <= 1))
+		return false;
+
+	distance = dot(edge2, q) * inverse;
+	return distance > 0 && distance < maxDistance;
+}
+
+uint32_t BoundingVolumeHierarchy::WideNode::intersect(const vec3f& origin, const vec3f& inverse, float maxDistance,
+		float distances[WIDTH]) const
+{
+#if BVH_SSE
+	__m128 tMin = _mm_setzero_ps(), tMax = _mm_set1_ps(maxDistance);
+	for(int32_t i = 0; i < 3; ++i)
+	{
+		const __m128 start = _mm_set1_ps(origin[i]), scale = _mm_set1_ps(inverse[i]);
+		const __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(lower[i]), start), scale);
+		const __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(upper[i]), start), scale);
+		tMin = _mm_max_ps(_mm_min_ps(t0, t1), tMin);
+		tMax = _mm_min_ps(_mm_max_ps(t0, t1), tMax);
+	}
+	_mm_storeu_ps(distances, tMin);
+	return _mm_movemask_ps(_mm_cmple_ps(tMin, tMax));
+#else
+	uint32_t mask = 0;
+	for(uint32_t i = 0; i < WIDTH; ++i)
+	{
+		const vec3f lower(this->lower[0][i], this->lower[1][i], this->lower[2][i]);
+		const vec3f upper(this->upper[0][i], this->upper[1][i], this->upper[2][i]);
+		if(::intersect(lower, upper, origin, inverse, maxDistance, distances[i]))
+			mask |= 1U << i;
+	}
+	return mask;
+#endif
+}
+
+BoundingVolumeHierarchy::Entry BoundingVolumeHierarchy::WideNode::visit(uint32_t mask, const float distances[WIDTH],
+		const uint32_t* lanes, Entry* stack, uint32_t& size) const
+{
+	// insertion sort of a few children, nearest first
+	Entry children[WIDTH];
+	uint32_t hitCount = 0;
+	for(uint32_t i = 0; i < WIDTH; ++i)
+	{
+		if((mask & (1U << i)) == 0)
+			continue;
+
+		uint32_t j = hitCount++;
+		for(; j > 0 && children[j - 1].distance > distances[i]; --j)
+			children[j] = children[j - 1];
+		children[j] = Entry{offset[i], count[i], distances[i], lanes? lanes[i]: 0};
+	}
+
+	assert(hitCount > 0 && size + hitCount - 1 <= MAX_DEPTH * (WIDTH - 1));
+	for(uint32_t i = hitCount - 1; i > 0; --i)
+		stack[size++] = children[i];
+	return children[0];
+}
+
+/**
+ * Rays of a packet in SoA layout, padded to a multiple of MAX_LANE_COUNT with lanes that hit nothing.
+ */
+struct alignas(32) BoundingVolumeHierarchy::Packet
+{
+	float origin[3][PACKET_SIZE];
+	float direction[3][PACKET_SIZE];
+	float inverse[3][PACKET_SIZE];
+	float nearest[PACKET_SIZE];  ///< far end of each ray, negative for lanes that are done or padded
+	float u[PACKET_SIZE], v[PACKET_SIZE];
+	uint32_t triangle[PACKET_SIZE];
+	uint32_t size;   ///< of lanes, rounded up to MAX_LANE_COUNT
+	uint32_t lanes;  ///< bit mask of rays, padded lanes excluded
+
+	void set(const Ray* rays, uint32_t count, float maxDistance);
+
+	/**
+	 * @return far end of the farthest ray, negative if all rays are done.
+	 */
+	float getFarthest() const;
+
+	/**
+	 * Slab test of children of node against active rays, which hit node.
+	 * @param[out] distances where the nearest ray enters each child.
+	 * @param[out] hits      active rays that hit each child.
+	 * @return bit mask of children hit by any active ray.
+	 */
+	template<typename Lanes>
+	ALWAYS_INLINE uint32_t intersect(const WideNode& node, uint32_t active, float distances[WIDTH], uint32_t hits[WIDTH]) const;
+
+	/**
+	 * Moller-Trumbore test of triangles against active rays. Other rays in the same group of
+	 * lanes are tested too, which is harmless, since what they hit is a hit.
+	 * @param[in] any rays stop at the first hit, and their lanes are done.
+	 * @return true if any ray hits.
+	 */
+	template<typename Lanes>
+	ALWAYS_INLINE bool intersect(const Triangle* triangles, uint32_t begin, uint32_t end, uint32_t active, bool any);
+
+	/**
+	 * Traces rays through the wide nodes of bvh, with Lanes::COUNT rays at a time.
+	 */
+	template<typename Lanes>
+	ALWAYS_INLINE void traverse(const BoundingVolumeHierarchy& bvh, bool any);
+
+#if BVH_AVX
+	TARGET_AVX2_NO_FMA void traverseAVX(const BoundingVolumeHierarchy& bvh, bool any) { traverse<avx::Lanes>(bvh, any); }
+#endif
+};
+
+static_assert(BoundingVolumeHierarchy::PACKET_SIZE % MAX_LANE_COUNT == 0, "lanes of packet are loaded in groups");
+
+void BoundingVolumeHierarchy::Packet::set(const Ray* rays, uint32_t count, float maxDistance)
+{
+	assert(0 < count && count <= PACKET_SIZE);
+	size = (count + MAX_LANE_COUNT - 1) / MAX_LANE_COUNT * MAX_LANE_COUNT;
+	lanes = (1U << count) - 1;
+	for(uint32_t i = 0; i < size; ++i)
+	{
+		const Ray& ray = rays[std::min(i, count - 1)];
+		const vec3f& origin = ray.getOrigin();
+		const vec3f& direction = ray.getDirection();
+		const vec3f inverse = getInverse(direction);
+		for(int32_t j = 0; j < 3; ++j)
+		{
+			this->origin[j][i] = origin[j];
+			this->direction[j][i] = direction[j];
+			this->inverse[j][i] = inverse[j];
+		}
+		nearest[i] = i < count? getFinite(maxDistance): -std::numeric_limits<float>::infinity();
+		u[i] = v[i] = 0;
+		triangle[i] = MISS;
+	}
+}
+
+float BoundingVolumeHierarchy::Packet::getFarthest() const
+{
+	return *std::max_element(nearest, nearest + size);
+}
+
+template<typename Lanes>
+ALWAYS_INLINE uint32_t BoundingVolumeHierarchy::Packet::intersect(const WideNode& node, uint32_t active,
+		float distances[WIDTH], uint32_t hits[WIDTH]) const
+{
+	const Lanes zero = Lanes::broadcast(0), infinity = Lanes::broadcast(std::numeric_limits<float>::infinity());
+	Lanes tEnter[WIDTH];
+	for(uint32_t k = 0; k < WIDTH; ++k)
+	{
+		tEnter[k] = infinity;
+		hits[k] = 0;
+	}
+
+	// rays are loaded once for all children
+	for(uint32_t i = 0; i < size; i += Lanes::COUNT)
+	{
+		if((active >> i & Lanes::MASK) == 0)
+			continue;
+
+		const Lanes start[3] = {Lanes::load(origin[0] + i), Lanes::load(origin[1] + i), Lanes::load(origin[2] + i)};
+		const Lanes scale[3] = {Lanes::load(inverse[0] + i), Lanes::load(inverse[1] + i), Lanes::load(inverse[2] + i)};
+		const Lanes tFar = Lanes::load(nearest + i);
+		for(uint32_t k = 0; k < WIDTH; ++k)
+		{
+			Lanes tMin = zero, tMax = tFar;
+			for(int32_t j = 0; j < 3; ++j)
+			{
+				const Lanes t0 = (Lanes::broadcast(node.lower[j][k]) - start[j]) * scale[j];
+				const Lanes t1 = (Lanes::broadcast(node.upper[j][k]) - start[j]) * scale[j];
+				tMin = max(min(t0, t1), tMin);
+				tMax = min(max(t0, t1), tMax);
+			}
+			const auto mask = tMin <= tMax;
+			hits[k] |= getBits(mask) << i;
+			tEnter[k] = min(select(mask, tMin, infinity), tEnter[k]);
+		}
+	}
+
+	// distances may be taken from inactive rays in the same groups, which is nearer, never farther.
+	uint32_t mask = 0;
+	for(uint32_t k = 0; k < WIDTH; ++k)
+	{
+		hits[k] &= active;
+		if(hits[k] == 0)
+			continue;
+
+		alignas(32) float entries[Lanes::COUNT];
+		store(entries, tEnter[k]);
+		distances[k] = *std::min_element(entries, entries + Lanes::COUNT);
+		mask |= 1U << k;
+	}
+	return mask;
+}
+
+template<typename Lanes>
+ALWAYS_INLINE bool BoundingVolumeHierarchy::Packet::intersect(const Triangle* triangles, uint32_t begin, uint32_t end,
+		uint32_t active, bool any)
+{
+	const Lanes zero = Lanes::broadcast(0), one = Lanes::broadcast(1);
+	const Lanes done = Lanes::broadcast(-std::numeric_limits<float>::infinity());
+	bool found = false;
+	for(uint32_t j = begin; j < end; ++j)
+	{
+		const Triangle& triangle = triangles[j];
+		const Lanes vertex[3] = {Lanes::broadcast(triangle.vertex.x), Lanes::broadcast(triangle.vertex.y), Lanes::broadcast(triangle.vertex.z)};
+		const Lanes edge1[3] = {Lanes::broadcast(triangle.edge1.x), Lanes::broadcast(triangle.edge1.y), Lanes::broadcast(triangle.edge1.z)};
+		const Lanes edge2[3] = {Lanes::broadcast(triangle.edge2.x), Lanes::broadcast(triangle.edge2.y), Lanes::broadcast(triangle.edge2.z)};
+		for(uint32_t i = 0; i < size; i += Lanes::COUNT)
+		{
+			if((active >> i & Lanes::MASK) == 0)
+				continue;
+
+			const Lanes dx = Lanes::load(direction[0] + i), dy = Lanes::load(direction[1] + i), dz = Lanes::load(direction[2] + i);
+			const Lanes px = dy * edge2[2] - dz * edge2[1];
+			const Lanes py = dz * edge2[0] - dx * edge2[2];
+			const Lanes pz = dx * edge2[1] - dy * edge2[0];
+			// parallel rays divide by 0, and fail tests below with infinity or NaN.
+			const Lanes reciprocal = one / (edge1[0] * px + edge1[1] * py + edge1[2] * pz);
+
+			const Lanes sx = Lanes::load(origin[0] + i) - vertex[0];
+			const Lanes sy = Lanes::load(origin[1] + i) - vertex[1];
+			const Lanes sz = Lanes::load(origin[2] + i) - vertex[2];
+			const Lanes u = (sx * px + sy * py + sz * pz) * reciprocal;
+
+			const Lanes qx = sy * edge1[2] - sz * edge1[1];
+			const Lanes qy = sz * edge1[0] - sx * edge1[2];
+			const Lanes qz = sx * edge1[1] - sy * edge1[0];
+			const Lanes v = (dx * qx + dy * qy + dz * qz) * reciprocal;
+			const Lanes t = (edge2[0] * qx + edge2[1] * qy + edge2[2] * qz) * reciprocal;
+
+			const Lanes tMax = Lanes::load(nearest + i);
+			const auto mask = (zero <= u) & (zero <= v) & (u + v <= one) & (zero < t) & (t < tMax);
+			const uint32_t bits = getBits(mask);
+			if(bits == 0)
+				continue;
+
+			found = true;
+			store(nearest + i, select(mask, any? done: t, tMax));
+			store(this->u + i, select(mask, u, Lanes::load(this->u + i)));
+			store(this->v + i, select(mask, v, Lanes::load(this->v + i)));
+			for(uint32_t k = 0; k < Lanes::COUNT; ++k)
+				if(bits & (1U << k))
+					this->triangle[i + k] = j;
+		}
+	}
+	return found;
+}
+
+template<typename Lanes>
+ALWAYS_INLINE void BoundingVolumeHierarchy::Packet::traverse(const BoundingVolumeHierarchy& bvh, bool any)
+{
+	Entry stack[MAX_DEPTH * (WIDTH - 1)];
+	uint32_t size = 0;
+	float farthest = getFarthest();
+	Entry entry{0, 0, 0, lanes};
+	for(;;)
+	{
+		if(entry.count == 0)
+		{
+			const WideNode& node = bvh.wideNodes[entry.offset];
+			float distances[WIDTH];
+			uint32_t hits[WIDTH];
+			const uint32_t mask = intersect<Lanes>(node, entry.lanes, distances, hits);
+			if(mask != 0)
+			{
+				entry = node.visit(mask, distances, hits, stack, size);
+				continue;
+			}
+		}
+		else if(intersect<Lanes>(bvh.triangles.data(), entry.offset, entry.offset + entry.count, entry.lanes, any))
+			farthest = getFarthest();
+
+		// skip nodes behind all rays, or all nodes once every ray is done.
+		while(size > 0 && stack[size - 1].distance > farthest)
+			--size;
+		if(size == 0)
+			break;
+		entry = stack[--size];
+	}
+}
+
+void BoundingVolumeHierarchy::traverse(Packet& packet, bool any) const
+{
+#if BVH_AVX
+	if(hasAVX())
+	{
+		packet.traverseAVX(*this, any);
+		return;
+	}
+#endif
+	packet.traverse<DefaultLanes>(*this, any);
+}
+
+void BoundingVolumeHierarchy::getHit(uint32_t index, float distance, float u, float v, Hit& hit) const
+{
+	const Triangle& triangle = triangles[index];
+	hit.distance = distance;
+	hit.triangle = ids[index];
+	hit.u = u;
+	hit.v = v;
+	hit.normal = normalize(cross(triangle.edge1, triangle.edge2));
+}
+
+bool BoundingVolumeHierarchy::intersect(const Ray& ray, Hit& hit, float maxDistance/* = INF */) const
+{
+	if(wideNodes.empty())
+		return false;
+
+	const vec3f& origin = ray.getOrigin();
+	const vec3f& direction = ray.getDirection();
+	const vec3f inverse = getInverse(direction);
+	maxDistance = getFinite(maxDistance);
+	Entry stack[MAX_DEPTH * (WIDTH - 1)];
+	uint32_t size = 0;
+
+	float nearest = maxDistance, nearestU = 0, nearestV = 0;
+	uint32_t found = MISS;
+	Entry entry{0, 0, 0, 0};
+	for(;;)
+	{
+		if(entry.count == 0)
+		{
+			const WideNode& node = wideNodes[entry.offset];
+			alignas(16) float distances[WIDTH];
+			const uint32_t mask = node.intersect(origin, inverse, nearest, distances);
+			if(mask != 0)
+			{
+				entry = node.visit(mask, distances, nullptr, stack, size);
+				continue;
+			}
+		}
+		else
+			for(uint32_t i = entry.offset, end = entry.offset + entry.count; i < end; ++i)
+			{
+				const Triangle& triangle = triangles[i];
+				float distance, u, v;
+				if(::intersect(triangle.vertex, triangle.edge1, triangle.edge2, origin, direction, nearest, distance, u, v))
+				{
+					nearest = distance;
+					nearestU = u;
+					nearestV = v;
+					found = i;
+				}
+			}
+
+		// skip nodes behind the nearest hit
+		while(size > 0 && stack[size - 1].distance > nearest)
+			--size;
+		if(size == 0)
+			break;
+		entry = stack[--size];
+	}
+
+	if(found == MISS)
+		return false;
+
+	getHit(found, nearest, nearestU, nearestV, hit);
+	return true;
+}
+
+bool BoundingVolumeHierarchy::occluded(const Ray& ray, float maxDistance/* = INF */) const
+{
+	if(wideNodes.empty())
+		return false;
+
+	const vec3f& origin = ray.getOrigin();
+	const vec3f& direction = ray.getDirection();
+	const vec3f inverse = getInverse(direction);
+	maxDistance = getFinite(maxDistance);
+	Entry stack[MAX_DEPTH * (WIDTH - 1)];
+	uint32_t size = 0;
+	Entry entry{0, 0, 0, 0};
+	for(;;)
+	{
+		if(entry.count == 0)
+		{
+			const WideNode& node = wideNodes[entry.offset];
+			alignas(16) float distances[WIDTH];
+			const uint32_t mask = node.intersect(origin, inverse, maxDistance, distances);
+			if(mask != 0)
+			{
+				entry = node.visit(mask, distances, nullptr, stack, size);
+				continue;
+			}
+		}
+		else
+			for(uint32_t i = entry.offset, end = entry.offset + entry.count; i < end; ++i)
+			{
+				const Triangle& triangle = triangles[i];
+				float distance, u, v;
+				if(::intersect(triangle.vertex, triangle.edge1, triangle.edge2, origin, direction, maxDistance, distance, u, v))
+					return true;
+			}
+
+		if(size == 0)
+			return false;
+		entry = stack[--size];
+	}
+}
+
+size_t BoundingVolumeHierarchy::intersect(const Ray* rays, size_t count, Hit* hits,
+		float maxDistance/* = INF */) const
+{
+	constexpr float INF = std::numeric_limits<float>::infinity();
+	size_t hitCount = 0;
+	Packet packet;
+	for(size_t begin = 0; begin < count; begin += PACKET_SIZE)
+	{
+		const uint32_t size = static_cast<uint32_t>(std::min<size_t>(count - begin, PACKET_SIZE));
+		packet.set(rays + begin, size, maxDistance);
+		if(!wideNodes.empty())
+			traverse(packet, false);
+
+		for(uint32_t i = 0; i < size; ++i)
+		{
+			Hit& hit = hits[begin + i];
+			if(packet.triangle[i] == MISS)
+				hit = Hit{INF, MISS, 0, 0, vec3f(0, 0, 0)};
+			else
+			{
+				getHit(packet.triangle[i], packet.nearest[i], packet.u[i], packet.v[i], hit);
+				++hitCount;
+			}
+		}
+	}
+	return hitCount;
+}
+
+size_t BoundingVolumeHierarchy::occluded(const Ray* rays, size_t count, uint8_t* occluded,
+		float maxDistance/* = INF */) const
+{
+	size_t hitCount = 0;
+	Packet packet;
+	for(size_t begin = 0; begin < count; begin += PACKET_SIZE)
+	{
+		const uint32_t size = static_cast<uint32_t>(std::min<size_t>(count - begin, PACKET_SIZE));
+		packet.set(rays + begin, size, maxDistance);
+		if(!wideNodes.empty())
+			traverse(packet, true);
+
+		for(uint32_t i = 0; i < size; ++i)
+		{
+			occluded[begin + i] = packet.triangle[i] != MISS;
+			hitCount += occluded[begin + i];
+		}
+	}
+	return hitCount;
+}
+
+BoundingBox BoundingVolumeHierarchy::getBoundingBox() const
+{
+	if(nodes.empty())
+		return BoundingBox();
+	return BoundingBox(nodes[0].lower, nodes[0].upper);
+}
+
+uint32_t BoundingVolumeHierarchy::getDepth() const
+{
+	if(nodes.empty())
+		return 0;
+
+	uint32_t depth = 0;
+	std::vector<std::pair<uint32_t, uint32_t>> stack{{0, 1}};  // node and its depth
+	while(!stack.empty())
+	{
+		auto [index, level] = stack.back();
+		stack.pop_back();
+		const Node& node = nodes[index];
+		if(node.count != 0)
+			depth = std::max(depth, level);
+		else
+		{
+			stack.emplace_back(node.offset, level + 1);
+			stack.emplace_back(node.offset + 1, level + 1);
+		}
+	}
+	return depth;
+}
+
+const char* BoundingVolumeHierarchy::getInstructionSet()
+{
+	if(hasAVX())
+		return "AVX2";
+#if BVH_SSE
+	return "SSE2";
+#else
+	return "scalar";
+#endif
+}
@@ -0,0 +1,219 @@
+#ifndef PEA_GEOMETRY_BOUNDING_VOLUME_HIERARCHY_H_
+#define PEA_GEOMETRY_BOUNDING_VOLUME_HIERARCHY_H_
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "geometry/BoundingBox.h"
+#include "geometry/Ray.h"
+#include "math/vec3.h"
+
+namespace pea {
+
+/**
+ * @class BoundingVolumeHierarchy
+ * A binary tree of axis-aligned boxes over triangles, for ray casting against meshes of millions
+ * of triangles, e.g. picking, shadows and baking.
+ *
+ * It's built top down with binned SAH (surface area heuristic): triangles are binned by centroid
+ * into a few slabs on each axis, and split at the slab boundary that costs the least to traverse.
+ * The top levels bin in parallel, then subtrees are built in parallel, and the result doesn't
+ * depend on thread count.
+ *
+ * For traversal, the binary tree is collapsed into a 4-wide one, whose nodes keep bounds of their
+ * children in SoA (structure of arrays) layout, so that a ray tests 4 boxes with one SSE slab
+ * test. Rays traverse it with a short stack, nearer children first. Bulk queries, e.g. ambient
+ * occlusion baking or visibility, can trace coherent rays in packets, which share traversal and
+ * test a box or triangle against 8 rays with AVX2 if the CPU has it, or 4 with SSE.
+ *
+ * For deforming meshes, refit() moves the boxes with vertices and keeps the tree, which is faster
+ * than a rebuild and fine as long as triangles don't travel far.
+ *
+ * @code
+ *   BoundingVolumeHierarchy bvh;
+ *   bvh.build(mesh.getPositions().data(), mesh.getIndices().data(), mesh.getIndexSize() / 3);
+ *   BoundingVolumeHierarchy::Hit hit;
+ *   if(bvh.intersect(ray, hit))
+ *       pick(hit.triangle, ray.at(hit.distance));
+ * @endcode
+ */
+class BoundingVolumeHierarchy
+{
+public:
+	struct Hit
+	{
+		float distance;     ///< along the ray
+		uint32_t triangle;  ///< index of triangle in indices
+		float u, v;         ///< barycentric coordinates of vertex 1 and 2
+		vec3f normal;       ///< normalized, by winding of the triangle
+	};
+
+	static constexpr uint32_t PACKET_SIZE = 16;  ///< rays traced together at most
+	static constexpr uint32_t MISS = std::numeric_limits<uint32_t>::max();  ///< triangle of rays that miss
+
+private:
+	static constexpr uint32_t MAX_DEPTH = 64;  ///< of tree, so traversal stacks don't overflow
+	static constexpr uint32_t WIDTH = 4;       ///< children of wide nodes
+
+	/**
+	 * 32 bytes. Children of an inner node are adjacent, and stored after it.
+	 */
+	struct Node
+	{
+		vec3f lower;
+		uint32_t offset;  ///< first child of inner node, or first triangle of leaf
+		vec3f upper;
+		uint32_t count;   ///< triangles of leaf, 0 for inner node
+	};
+
+	/**
+	 * Vertex and edges of triangle, for Moller-Trumbore intersection.
+	 */
+	struct Triangle
+	{
+		vec3f vertex;
+		vec3f edge1, edge2;
+	};
+
+	/**
+	 * Node or leaf to visit, and where ray enters it.
+	 */
+	struct Entry
+	{
+		uint32_t offset;  ///< wide node, or first triangle of leaf
+		uint32_t count;   ///< triangles of leaf, 0 for wide node
+		float distance;
+		uint32_t lanes;   ///< bit mask of rays of packet that hit it
+	};
+
+	/**
+	 * 128 bytes, bounds of children are stored axis by axis. Empty slots have bounds at infinity,
+	 * which no ray hits.
+	 */
+	struct alignas(16) WideNode
+	{
+		float lower[3][WIDTH];
+		float upper[3][WIDTH];
+		uint32_t offset[WIDTH];  ///< wide node of inner child, or first triangle of leaf
+		uint32_t count[WIDTH];   ///< triangles of leaf, 0 for inner child
+
+		/**
+		 * Slab test of all children.
+		 * @param[out] distances where ray enters each child.
+		 * @return bit mask of children hit within [0, maxDistance].
+		 */
+		uint32_t intersect(const vec3f& origin, const vec3f& inverse, float maxDistance, float distances[WIDTH]) const;
+
+		/**
+		 * Push children hit onto stack, farther ones first, so that they're popped nearer first.
+		 * @param[in] mask  at least one child is hit.
+		 * @param[in] lanes rays of packet that hit each child, or nullptr for a single ray.
+		 * @return the nearest child, which is visited next.
+		 */
+		Entry visit(uint32_t mask, const float distances[WIDTH], const uint32_t* lanes, Entry* stack, uint32_t& size) const;
+	};
+
+	std::vector<Node> nodes;
+	std::vector<Triangle> triangles;  ///< in leaf order
+	std::vector<uint32_t> ids;        ///< triangle index of each one in triangles
+
+	std::vector<WideNode> wideNodes;
+	std::vector<uint32_t> sources;    ///< node of each child of wide nodes, for refit
+
+	class Builder;
+	struct Packet;
+
+private:
+	void setTriangles(const vec3f* positions, const uint32_t* indices);
+
+	/**
+	 * Collapse subtree into wide nodes, by opening the largest inner child until there are
+	 * WIDTH children.
+	 * @return index of wide node.
+	 */
+	uint32_t collapse(uint32_t node);
+
+	/**
+	 * Copy bounds of nodes to children of wide nodes.
+	 */
+	void setWideBounds();
+
+	void traverse(Packet& packet, bool any) const;
+	void getHit(uint32_t index, float distance, float u, float v, Hit& hit) const;
+
+public:
+	BoundingVolumeHierarchy() = default;
+
+	/**
+	 * @param[in] positions   vertices of mesh.
+	 * @param[in] indices     3 vertex indices of each triangle, e.g. Model::getTriangulatedIndex().
+	 * @param[in] maxLeafSize leaves take up to this many triangles, or more where they can't be
+	 *                        split or SAH prefers not to.
+	 */
+	void build(const vec3f* positions, const uint32_t* indices, size_t triangleCount, uint32_t maxLeafSize = 4);
+
+	/**
+	 * Update boxes to moved vertices, triangles stay where they're in the tree.
+	 * @param[in] positions vertices of mesh, which has the same triangles as it's built with.
+	 * @param[in] indices   the same indices as it's built with.
+	 */
+	void refit(const vec3f* positions, const uint32_t* indices);
+
+	void clear();
+
+	/**
+	 * Find the nearest hit.
+	 * @param[out] hit         written only if there's a hit.
+	 * @param[in]  maxDistance triangles farther away are ignored.
+	 * @return true if ray hits a triangle within (0, maxDistance).
+	 */
+	bool intersect(const Ray& ray, Hit& hit, float maxDistance = std::numeric_limits<float>::infinity()) const;
+
+	/**
+	 * Find any hit, e.g. for shadow rays, which stops at the first triangle found.
+	 * @return true if ray hits a triangle within (0, maxDistance).
+	 */
+	bool occluded(const Ray& ray, float maxDistance = std::numeric_limits<float>::infinity()) const;
+
+	/**
+	 * Find the nearest hit of each ray. Rays are traced in packets of PACKET_SIZE in order, which
+	 * pays off if rays of a packet are coherent, e.g. from a 4x4 tile of pixels, or from nearby
+	 * points on a surface, and costs more than tracing them one by one otherwise.
+	 * @param[in]  rays        to trace, any count.
+	 * @param[out] hits        of each ray, whose distance is infinity and triangle is MISS if it
+	 *                         misses.
+	 * @param[in]  maxDistance triangles farther away are ignored.
+	 * @return number of rays that hit.
+	 */
+	size_t intersect(const Ray* rays, size_t count, Hit* hits,
+			float maxDistance = std::numeric_limits<float>::infinity()) const;
+
+	/**
+	 * Find any hit of each ray, in packets like above.
+	 * @param[out] occluded 1 if ray hits a triangle within (0, maxDistance), 0 otherwise.
+	 * @return number of rays that hit.
+	 */
+	size_t occluded(const Ray* rays, size_t count, uint8_t* occluded,
+			float maxDistance = std::numeric_limits<float>::infinity()) const;
+
+	BoundingBox getBoundingBox() const;
+	size_t getNodeCount() const;  ///< of binary tree
+	size_t getTriangleCount() const;
+
+	/**
+	 * @return depth of the deepest leaf, 1 for a single leaf, 0 if it's empty.
+	 */
+	uint32_t getDepth() const;
+
+	/**
+	 * @return "AVX2", "SSE2" or "scalar", which packets are traced with on this CPU.
+	 */
+	static const char* getInstructionSet();
+};
+
+inline size_t BoundingVolumeHierarchy::getNodeCount() const     { return nodes.size();     }
+inline size_t BoundingVolumeHierarchy::getTriangleCount() const { return triangles.size(); }
+
+}  // namespace pea
+#endif  // PEA_GEOMETRY_BOUNDING_VOLUME_HIERARCHY_H_
@@ -351,4 +351,16 @@ bool castRay(const Ray& ray, const vec3f vertices[3], HitInfo& hitInfo)
 	return test > 0;
 }
 
+bool castRay(const Ray& ray, const BoundingVolumeHierarchy& bvh, HitInfo& hitInfo)
+{
+	BoundingVolumeHierarchy::Hit hit;
+	if(!bvh.intersect(ray, hit))
+		return false;
+
+	hitInfo.coordinate = hit.distance;
+	hitInfo.inside = dot(hit.normal, ray.getDirection()) > 0;
+	hitInfo.normal = hitInfo.inside? -hit.normal: hit.normal;
+	return true;
+}
+
 }  // namespace pea
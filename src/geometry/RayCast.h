@@ -2,6 +2,7 @@
 #define PEA_GEOMETRY_RAY_CAST_H_
 
 #include "geometry/BoundingBox.h"
+#include "geometry/BoundingVolumeHierarchy.h"
 #include "geometry/Cylinder.h"
 #include "geometry/Plane.h"
 #include "geometry/Ray.h"
@@ -79,6 +80,12 @@ bool castRay(const Ray& ray, const BoundingBox& box, HitInfo& hitInfo);
 
 bool castRay(const Ray& ray, const vec3f vertices[3], HitInfo& hitInfo);
 
+/**
+ * Find the nearest triangle of mesh that ray hits, inside is true if it hits the back face.
+ * @see BoundingVolumeHierarchy::intersect() for which triangle it is.
+ */
+bool castRay(const Ray& ray, const BoundingVolumeHierarchy& bvh, HitInfo& hitInfo);
+
 /**
  * @param[in] quadric 
  *
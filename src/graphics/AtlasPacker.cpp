@@ -0,0 +1,430 @@
+#include "graphics/AtlasPacker.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <limits>
+#include <numeric>
+
+#include "graphics/Image_PNG.h"
+#include "util/Log.h"
+
+
+static const char* TAG = "AtlasPacker";
+
+using namespace pea;
+
+using Method = AtlasPacker::Method;
+
+/**
+ * Free space of a page, rectangles here are cells, padding included.
+ */
+class AtlasPacker::Page
+{
+private:
+	struct Node
+	{
+		int32_t x, y, width;  // a horizontal segment of skyline
+	};
+
+	const int32_t width, height;
+	const Method method;
+	std::vector<Node> skyline;
+	std::vector<Rect<int32_t>> freeRects;  // maximal free rectangles, they may overlap.
+
+	uint64_t usedArea;
+	vec2u extent;
+
+private:
+	bool fitSkyline(size_t index, int32_t w, int32_t h, int32_t& y) const;
+	bool insertSkyline(int32_t w, int32_t h, vec2i& position);
+	bool insertMaxRects(int32_t w, int32_t h, vec2i& position);
+	void splitFreeRects(const Rect<int32_t>& used);
+
+public:
+	Page(int32_t width, int32_t height, Method method);
+
+	bool insert(int32_t w, int32_t h, vec2i& position);
+
+	uint64_t getUsedArea() const { return usedArea; }
+	const vec2u& getExtent() const { return extent; }
+};
+
+AtlasPacker::Page::Page(int32_t width, int32_t height, Method method):
+		width(width),
+		height(height),
+		method(method),
+		usedArea(0),
+		extent(0, 0)
+{
+	if(method == Method::SKYLINE)
+		skyline.push_back(Node{0, 0, width});
+	else
+		freeRects.emplace_back(0, 0, width, height);
+}
+
+bool AtlasPacker::Page::insert(int32_t w, int32_t h, vec2i& position)
+{
+	bool inserted = method == Method::SKYLINE? insertSkyline(w, h, position): insertMaxRects(w, h, position);
+	if(!inserted)
+		return false;
+
+	usedArea += static_cast<uint64_t>(w) * h;
+	extent.x = std::max<uint32_t>(extent.x, position.x + w);
+	extent.y = std::max<uint32_t>(extent.y, position.y + h);
+	return true;
+}
+
+/**
+ * A cell put at the left of skyline node index rests on the highest node it spans.
+ * @param[out] y top of the cell.
+ */
+bool AtlasPacker::Page::fitSkyline(size_t index, int32_t w, int32_t h, int32_t& y) const
+{
+	if(skyline[index].x + w > width)
+		return false;
+
+	y = 0;
+	for(int32_t remain = w; remain > 0; remain -= skyline[index++].width)
+	{
+		assert(index < skyline.size());
+		y = std::max(y, skyline[index].y);
+		if(y + h > height)
+			return false;
+	}
+	return true;
+}
+
+bool AtlasPacker::Page::insertSkyline(int32_t w, int32_t h, vec2i& position)
+{
+	// bottom-left rule, the lowest bottom wins, then the narrowest node, which wastes less.
+	size_t best = skyline.size();
+	int32_t bestBottom = std::numeric_limits<int32_t>::max();
+	int32_t bestWidth = std::numeric_limits<int32_t>::max();
+	for(size_t i = 0; i < skyline.size(); ++i)
+	{
+		int32_t y;
+		if(!fitSkyline(i, w, h, y))
+			continue;
+		if(y + h < bestBottom || (y + h == bestBottom && skyline[i].width < bestWidth))
+		{
+			best = i;
+			bestBottom = y + h;
+			bestWidth = skyline[i].width;
+		}
+	}
+	if(best == skyline.size())
+		return false;
+
+	const Node node{skyline[best].x, bestBottom, w};
+	position = vec2i(node.x, bestBottom - h);
+	skyline.insert(skyline.begin() + best, node);
+
+	// nodes under the new one are shortened or removed.
+	const int32_t right = node.x + node.width;
+	size_t i = best + 1;
+	while(i < skyline.size() && skyline[i].x < right)
+	{
+		const int32_t shrink = right - skyline[i].x;
+		if(skyline[i].width > shrink)
+		{
+			skyline[i].x += shrink;
+			skyline[i].width -= shrink;
+			break;
+		}
+		skyline.erase(skyline.begin() + i);
+	}
+
+	// merge neighbours of the same height.
+	for(size_t j = (best > 0? best - 1: 0); j + 1 < skyline.size() && j <= best + 1;)
+	{
+		if(skyline[j].y == skyline[j + 1].y)
+		{
+			skyline[j].width += skyline[j + 1].width;
+			skyline.erase(skyline.begin() + j + 1);
+		}
+		else
+			++j;
+	}
+	return true;
+}
+
+bool AtlasPacker::Page::insertMaxRects(int32_t w, int32_t h, vec2i& position)
+{
+	// best short side fit, then best long side fit.
+	const Rect<int32_t>* best = nullptr;
+	int32_t bestShort = std::numeric_limits<int32_t>::max();
+	int32_t bestLong = std::numeric_limits<int32_t>::max();
+	for(const Rect<int32_t>& rect: freeRects)
+	{
+		const int32_t dx = rect.getWidth() - w, dy = rect.getHeight() - h;
+		if(dx < 0 || dy < 0)
+			continue;
+		const int32_t shortSide = std::min(dx, dy), longSide = std::max(dx, dy);
+		if(shortSide < bestShort || (shortSide == bestShort && longSide < bestLong))
+		{
+			best = &rect;
+			bestShort = shortSide;
+			bestLong = longSide;
+		}
+	}
+	if(best == nullptr)
+		return false;
+
+	position = vec2i(best->left, best->top);
+	splitFreeRects(Rect<int32_t>(position.x, position.y, position.x + w, position.y + h));
+	return true;
+}
+
+void AtlasPacker::Page::splitFreeRects(const Rect<int32_t>& used)
+{
+	std::vector<Rect<int32_t>> splits;
+	size_t kept = 0;
+	for(size_t i = 0; i < freeRects.size(); ++i)
+	{
+		const Rect<int32_t> rect = freeRects[i];
+		if(used.left >= rect.right || used.right <= rect.left || used.top >= rect.bottom || used.bottom <= rect.top)
+		{
+			freeRects[kept++] = rect;
+			continue;
+		}
+
+		// up to four maximal rectangles are left around the used one.
+		if(used.left > rect.left)
+			splits.emplace_back(rect.left, rect.top, used.left, rect.bottom);
+		if(used.right < rect.right)
+			splits.emplace_back(used.right, rect.top, rect.right, rect.bottom);
+		if(used.top > rect.top)
+			splits.emplace_back(rect.left, rect.top, rect.right, used.top);
+		if(used.bottom < rect.bottom)
+			splits.emplace_back(rect.left, used.bottom, rect.right, rect.bottom);
+	}
+	freeRects.resize(kept);
+
+	/*
+	 * A split lies in a maximal rectangle, which no other free rectangle is contained in, so only
+	 * splits need to be tested, against the kept ones and against each other.
+	 */
+	auto inside = [](const Rect<int32_t>& a, const Rect<int32_t>& b)
+	{
+		return b.left <= a.left && a.right <= b.right && b.top <= a.top && a.bottom <= b.bottom;
+	};
+	for(size_t i = 0; i < splits.size(); ++i)
+	{
+		bool contained = false;
+		for(size_t j = 0; j < kept && !contained; ++j)
+			contained = inside(splits[i], freeRects[j]);
+		for(size_t j = 0; j < splits.size() && !contained; ++j)
+			contained = j != i && !splits[j].isEmpty() && inside(splits[i], splits[j]) &&
+					(splits[i] != splits[j] || j < i);  // keep one of duplicates
+		if(!contained)
+			freeRects.push_back(splits[i]);
+		else
+			splits[i].setEmpty();
+	}
+}
+
+AtlasPacker::AtlasPacker(uint32_t width, uint32_t height, uint32_t padding/* = 1 */,
+		Method method/* = Method::SKYLINE */, uint32_t maxPageCount/* = 0 */):
+		width(width),
+		height(height),
+		padding(padding),
+		method(method),
+		maxPageCount(maxPageCount)
+{
+	assert(width > 0 && height > 0);
+}
+
+AtlasPacker::~AtlasPacker() = default;
+
+bool AtlasPacker::insert(uint32_t width, uint32_t height, Region& region)
+{
+	return insert(width, height, 0, region);
+}
+
+bool AtlasPacker::insert(uint32_t width, uint32_t height, uint32_t firstPage, Region& region)
+{
+	region.page = 0;
+	region.rect.setEmpty();
+	if(width == 0 || height == 0)  // e.g. glyph of space, takes no room.
+		return true;
+
+	const uint64_t cellWidth = width + 2ULL * padding, cellHeight = height + 2ULL * padding;
+	if(cellWidth > this->width || cellHeight > this->height)
+	{
+		slog.w(TAG, "%ux%u doesn't fit in a %ux%u page", width, height, this->width, this->height);
+		return false;
+	}
+
+	vec2i position;
+	uint32_t page = firstPage;
+	for(; page < pages.size(); ++page)
+		if(pages[page]->insert(cellWidth, cellHeight, position))
+			break;
+
+	if(page == pages.size())
+	{
+		if(maxPageCount != 0 && pages.size() >= maxPageCount)
+			return false;
+
+		pages.push_back(std::make_unique<Page>(this->width, this->height, method));
+		if(!pages.back()->insert(cellWidth, cellHeight, position))
+		{
+			assert(false);
+			return false;
+		}
+	}
+
+	const int32_t left = position.x + padding, top = position.y + padding;
+	region.page = page;
+	region.rect = Rect<int32_t>(left, top, left + width, top + height);
+	return true;
+}
+
+bool AtlasPacker::pack(const vec2u* sizes, size_t count, Region* regions)
+{
+	return pack(sizes, count, regions, 0);
+}
+
+bool AtlasPacker::pack(const vec2u* sizes, size_t count, Region* regions, uint32_t firstPage)
+{
+	// tall ones first, a skyline stays flat when heights decrease.
+	std::vector<uint32_t> order(count);
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [sizes](uint32_t a, uint32_t b)
+	{
+		const vec2u& sa = sizes[a];
+		const vec2u& sb = sizes[b];
+		return sa.y != sb.y? sa.y > sb.y: sa.x > sb.x;
+	});
+
+	// pages to restore if a rectangle is left out.
+	const uint32_t pageCount = getPageCount();
+	std::vector<Page> saved;
+	saved.reserve(pageCount - firstPage);
+	for(uint32_t page = firstPage; page < pageCount; ++page)
+		saved.push_back(*pages[page]);
+
+	bool packed = true;
+	for(size_t i = 0; i < order.size() && packed; ++i)
+		packed = insert(sizes[order[i]].x, sizes[order[i]].y, firstPage, regions[order[i]]);
+	if(packed)
+		return true;
+
+	pages.resize(pageCount);
+	for(uint32_t page = firstPage; page < pageCount; ++page)
+		pages[page] = std::make_unique<Page>(std::move(saved[page - firstPage]));
+	for(size_t i = 0; i < count; ++i)
+	{
+		regions[i].page = 0;
+		regions[i].rect.setEmpty();
+	}
+	return false;
+}
+
+std::vector<std::shared_ptr<Image>> AtlasPacker::pack(const std::vector<const Image*>& images, std::vector<Region>& regions)
+{
+	std::vector<std::shared_ptr<Image>> result;
+	if(images.empty())
+		return result;
+
+	const Color::Format format = images.front()->getColorFormat();
+	std::vector<vec2u> sizes(images.size());
+	for(size_t i = 0; i < images.size(); ++i)
+	{
+		const Image& image = *images[i];
+		if(image.getColorFormat() != format)
+		{
+			slog.w(TAG, "image %zu's color format %#x differs from %#x", i, image.getColorFormat(), format);
+			return result;
+		}
+		sizes[i] = vec2u(image.getWidth(), image.getHeight());
+	}
+
+	regions.resize(images.size());
+	const uint32_t firstPage = getPageCount();
+	if(!pack(sizes.data(), sizes.size(), regions.data(), firstPage))
+		return result;
+
+	const size_t pageSize = static_cast<size_t>(width) * height * Color::size(format);
+	for(uint32_t page = firstPage; page < getPageCount(); ++page)
+	{
+		auto image = std::make_shared<Image_PNG>(width, height, format);
+		std::memset(image->getData(), 0, pageSize);
+		result.push_back(image);
+	}
+
+	for(size_t i = 0; i < images.size(); ++i)
+	{
+		const Region& region = regions[i];
+		if(!region.rect.isEmpty())
+			copy(*images[i], *result[region.page - firstPage], region.rect, padding);
+	}
+	return result;
+}
+
+void AtlasPacker::clear()
+{
+	pages.clear();
+}
+
+vec2u AtlasPacker::getExtent(uint32_t page) const
+{
+	assert(page < pages.size());
+	return pages[page]->getExtent();
+}
+
+float AtlasPacker::getOccupancy(uint32_t page) const
+{
+	assert(page < pages.size());
+	return static_cast<float>(static_cast<double>(pages[page]->getUsedArea()) / (static_cast<double>(width) * height));
+}
+
+Rect<float> AtlasPacker::getTextureRect(const Region& region) const
+{
+	const float sx = 1.0F / width, sy = 1.0F / height;
+	const Rect<int32_t>& rect = region.rect;
+	return Rect<float>(rect.left * sx, rect.top * sy, rect.right * sx, rect.bottom * sy);
+}
+
+bool AtlasPacker::copy(const Image& image, Image& page, const Rect<int32_t>& rect, uint32_t bleed)
+{
+	const Color::Format format = image.getColorFormat();
+	if(format != page.getColorFormat() || !image.isValid() || !page.isValid() ||
+			rect.getWidth() != image.getWidth() || rect.getHeight() != image.getHeight() ||
+			rect.left < 0 || rect.top < 0 || rect.right > page.getWidth() || rect.bottom > page.getHeight())
+	{
+		slog.w(TAG, "can't copy a %dx%d image to %s", image.getWidth(), image.getHeight(), rect.toString().c_str());
+		return false;
+	}
+
+	const size_t pixelSize = Color::size(format);
+	const size_t srcStride = image.getWidth() * pixelSize;
+	const size_t dstStride = page.getWidth() * pixelSize;
+	const uint8_t* src = image.getData();
+	uint8_t* dst = page.getData();
+
+	// bleed area, clipped by page
+	const int32_t b = static_cast<int32_t>(bleed);
+	const int32_t left = std::max(rect.left - b, 0), right = std::min(rect.right + b, page.getWidth());
+	const int32_t top = std::max(rect.top - b, 0), bottom = std::min(rect.bottom + b, page.getHeight());
+
+	for(int32_t y = rect.top; y < rect.bottom; ++y)
+	{
+		uint8_t* row = dst + y * dstStride;
+		std::memcpy(row + rect.left * pixelSize, src + (y - rect.top) * srcStride, srcStride);
+		for(int32_t x = left; x < rect.left; ++x)
+			std::memcpy(row + x * pixelSize, row + rect.left * pixelSize, pixelSize);
+		for(int32_t x = rect.right; x < right; ++x)
+			std::memcpy(row + x * pixelSize, row + (rect.right - 1) * pixelSize, pixelSize);
+	}
+
+	const size_t length = (right - left) * pixelSize;
+	const uint8_t* first = dst + rect.top * dstStride + left * pixelSize;
+	const uint8_t* last = dst + (rect.bottom - 1) * dstStride + left * pixelSize;
+	for(int32_t y = top; y < rect.top; ++y)
+		std::memcpy(dst + y * dstStride + left * pixelSize, first, length);
+	for(int32_t y = rect.bottom; y < bottom; ++y)
+		std::memcpy(dst + y * dstStride + left * pixelSize, last, length);
+	return true;
+}
@@ -0,0 +1,135 @@
+#ifndef PEA_GRAPHICS_ATLAS_PACKER_H_
+#define PEA_GRAPHICS_ATLAS_PACKER_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "graphics/Image.h"
+#include "graphics/Rect.h"
+#include "math/vec2.h"
+
+namespace pea {
+
+/**
+ * @class AtlasPacker
+ * Pack rectangles, such as sprites, glyphs or small textures, into one or more atlas pages of fixed
+ * size. Pages are opened on demand, a rectangle goes to the first page it fits in.
+ *
+ * Rectangles can be inserted one by one as they come, e.g. glyphs of a dynamic atlas, or packed
+ * in a batch, which sorts them first for a tighter result. Rows go top down, like Image.
+ */
+class AtlasPacker
+{
+public:
+	enum class Method: uint8_t
+	{
+		SKYLINE,    ///< bottom-left skyline, linear in the skyline length, suits many and dynamic rectangles.
+		MAX_RECTS,  ///< maximal rectangles with best short side fit, tighter but quadratic in free rectangles.
+	};
+
+	struct Region
+	{
+		uint32_t page;
+		Rect<int32_t> rect;  ///< pixels of the rectangle on page, padding excluded.
+	};
+
+private:
+	class Page;
+
+	uint32_t width, height;
+	uint32_t padding;
+	Method method;
+	uint32_t maxPageCount;
+	std::vector<std::unique_ptr<Page>> pages;
+
+private:
+	bool insert(uint32_t width, uint32_t height, uint32_t firstPage, Region& region);
+
+	/**
+	 * Pack rectangles into pages from firstPage on, or into none of them.
+	 */
+	bool pack(const vec2u* sizes, size_t count, Region* regions, uint32_t firstPage);
+
+public:
+	/**
+	 * @param[in] width        page width.
+	 * @param[in] height       page height.
+	 * @param[in] padding      pixels kept on each side of a rectangle, so that filtering it
+	 *                         doesn't sample its neighbours. Neighbours are 2 * padding apart.
+	 * @param[in] method       packing method.
+	 * @param[in] maxPageCount page count limit, 0 means no limit.
+	 */
+	AtlasPacker(uint32_t width, uint32_t height, uint32_t padding = 1, Method method = Method::SKYLINE,
+			uint32_t maxPageCount = 0);
+	~AtlasPacker();
+
+	AtlasPacker(const AtlasPacker& other) = delete;
+	AtlasPacker& operator =(const AtlasPacker& other) = delete;
+
+	/**
+	 * Insert a rectangle, existing rectangles don't move.
+	 * @param[out] region where the rectangle lands.
+	 * @return false if the rectangle is larger than a page, or all pages are full.
+	 */
+	bool insert(uint32_t width, uint32_t height, Region& region);
+
+	/**
+	 * Insert rectangles, the largest first, all or none of them.
+	 * @param[in]  sizes   width and height of each rectangle.
+	 * @param[out] regions where each rectangle lands.
+	 * @return false if any rectangle is left out. The packer is left as it was then, and all
+	 *         regions are empty.
+	 */
+	bool pack(const vec2u* sizes, size_t count, Region* regions);
+
+	/**
+	 * Pack images into new pages, and copy them there in their color format, edge pixels extended
+	 * into padding. Pages opened before are left alone, since their pixels aren't kept here.
+	 * @param[in]  images  images of the same uncompressed color format.
+	 * @param[out] regions where each image lands, pages are counted from the first page of the
+	 *                     packer, not of the result.
+	 * @return pages created, empty if any image is left out, and the packer is left as it was.
+	 */
+	std::vector<std::shared_ptr<Image>> pack(const std::vector<const Image*>& images, std::vector<Region>& regions);
+
+	/**
+	 * Remove all rectangles and pages.
+	 */
+	void clear();
+
+	uint32_t getWidth() const;
+	uint32_t getHeight() const;
+	uint32_t getPadding() const;
+	uint32_t getPageCount() const;
+
+	/**
+	 * @return width and height that cover all rectangles of page, padding included.
+	 */
+	vec2u getExtent(uint32_t page) const;
+
+	/**
+	 * @return fraction of page area used by rectangles, padding included.
+	 */
+	float getOccupancy(uint32_t page) const;
+
+	/**
+	 * @return texture coordinates of region, within [0, 1].
+	 */
+	Rect<float> getTextureRect(const Region& region) const;
+
+	/**
+	 * Copy image to region of page, and repeat its edge pixels bleed pixels outside.
+	 * @param[in] bleed at most padding of the packer, so that neighbours are left alone.
+	 * @return false if color formats differ, or sizes don't match.
+	 */
+	static bool copy(const Image& image, Image& page, const Rect<int32_t>& rect, uint32_t bleed);
+};
+
+inline uint32_t AtlasPacker::getWidth() const { return width; }
+inline uint32_t AtlasPacker::getHeight() const { return height; }
+inline uint32_t AtlasPacker::getPadding() const { return padding; }
+inline uint32_t AtlasPacker::getPageCount() const { return static_cast<uint32_t>(pages.size()); }
+
+}  // namespace pea
+#endif  // PEA_GRAPHICS_ATLAS_PACKER_H_
@@ -1,8 +1,36 @@
 #include "graphics/Canvas.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "graphics/DisplayList.h"
 #include "graphics/Image.h"
+#include "graphics/Paint.h"
+#include "graphics/Path.h"
+#include "graphics/Typeface.h"
+#include "util/Log.h"
+#include "util/unicode.h"
+
+static const char* TAG = "Canvas";
 
 using namespace pea;
 
+static constexpr float TOLERANCE = 1.0F / 16;  // in device pixels, so that coverage is off by 1/16 at most
+
+Canvas::Canvas(std::unique_ptr<Image> bitmap):
+		bitmap(std::move(bitmap)),
+		transform(1.0F),
+		clip(0, 0, 0, 0),
+		recorder(nullptr)
+{
+	assert(this->bitmap);
+	int32_t width = this->bitmap->getWidth();
+	int32_t height = this->bitmap->getHeight();
+	assert(width <= MAXMIMUM_BITMAP_SIZE && height <= MAXMIMUM_BITMAP_SIZE);
+	clip = Rect<int32_t>(0, 0, std::min(width, MAXMIMUM_BITMAP_SIZE), std::min(height, MAXMIMUM_BITMAP_SIZE));
+	rasterizer.reset(clip);
+}
 
 vec2i Canvas::getSize() const
 {
@@ -55,23 +83,328 @@ const mat3f& Canvas::getTransform() const
 	return transform;
 }
 
+vec2f Canvas::map(const vec2f& point) const
+{
+	const float* a = transform.a;
+	return vec2f(a[0] * point.x + a[3] * point.y + a[6], a[1] * point.x + a[4] * point.y + a[7]);
+}
+
+float Canvas::getTolerance() const
+{
+	const float* a = transform.a;
+	float scale = std::max(std::hypot(a[0], a[1]), std::hypot(a[3], a[4]));
+	return scale > 0? TOLERANCE / scale: TOLERANCE;
+}
+
+Paint Canvas::getStrokePaint(const Paint& paint) const
+{
+	Paint strokePaint(paint);
+	if(!(paint.getStrokeWidth() > 0))
+		strokePaint.setStrokeWidth(getTolerance() / TOLERANCE);
+	return strokePaint;
+}
+
+void Canvas::addEllipse(const vec2f& center, const vec2f& radius, float startAngle, float sweepAngle)
+{
+	const uint32_t count = Path::getArcSegmentCount(std::max(radius.x, radius.y), sweepAngle, getTolerance());
+	for(uint32_t i = 0; i <= count; ++i)
+	{
+		float angle = startAngle + sweepAngle * i / count;
+		polyline.points.push_back(center + vec2f(radius.x * std::cos(angle), radius.y * std::sin(angle)));
+	}
+}
+
+void Canvas::fill(const Path::Polyline& polyline)
+{
+	for(size_t contour = 0; contour < polyline.contours.size(); ++contour)
+	{
+		buffer.clear();
+		for(uint32_t i = polyline.getBegin(contour), end = polyline.contours[contour].end; i < end; ++i)
+			buffer.push_back(map(polyline.points[i]));
+		rasterizer.addPolygon(buffer.data(), buffer.size());
+	}
+}
+
+void Canvas::render(const Paint& paint)
+{
+	rasterizer.render(*bitmap, paint.getColor(), paint.getBlendMode(), Rasterizer::FillRule::NON_ZERO, paint.isAntiAlias());
+}
+
+void Canvas::draw(const Path::Polyline& polyline, const Paint& paint)
+{
+	Paint::Style style = paint.getStyle();
+	if(style == Paint::Style::FILL || style == Paint::Style::FILL_AND_STROKE)
+	{
+		fill(polyline);
+		render(paint);
+	}
+
+	if(style == Paint::Style::STROKE || style == Paint::Style::FILL_AND_STROKE)
+	{
+		Paint strokePaint = getStrokePaint(paint);
+		outline.clear();
+		Path::stroke(polyline, strokePaint.getStrokeWidth(), paint.getStrokeCap(), paint.getStrokeJoin(),
+				paint.getStrokeMiter(), getTolerance(), outline);
+		fill(outline);
+		render(paint);
+	}
+}
+
 void Canvas::clipRect(const Rect<int32_t>& region)
 {
+	vec2f corners[4] =
+	{
+		map(vec2f(region.left,  region.top)),
+		map(vec2f(region.right, region.top)),
+		map(vec2f(region.right, region.bottom)),
+		map(vec2f(region.left,  region.bottom)),
+	};
+
+	float left = corners[0].x, top = corners[0].y, right = left, bottom = top;
+	for(const vec2f& corner: corners)
+	{
+		left   = std::min(left,   corner.x);
+		top    = std::min(top,    corner.y);
+		right  = std::max(right,  corner.x);
+		bottom = std::max(bottom, corner.y);
+	}
+
+	clip.left   = std::max(clip.left,   static_cast<int32_t>(std::floor(left)));
+	clip.top    = std::max(clip.top,    static_cast<int32_t>(std::floor(top)));
+	clip.right  = std::min(clip.right,  static_cast<int32_t>(std::ceil(right)));
+	clip.bottom = std::min(clip.bottom, static_cast<int32_t>(std::ceil(bottom)));
+	if(clip.isEmpty())
+		clip = Rect<int32_t>(0, 0, 0, 0);
+	rasterizer.reset(clip);
+}
+
+void Canvas::setClip(const Rect<int32_t>& clip)
+{
+	const vec2i size = getSize();
+	this->clip.left   = std::max(clip.left,   0);
+	this->clip.top    = std::max(clip.top,    0);
+	this->clip.right  = std::min(clip.right,  std::min(size.x, MAXMIMUM_BITMAP_SIZE));
+	this->clip.bottom = std::min(clip.bottom, std::min(size.y, MAXMIMUM_BITMAP_SIZE));
+	if(this->clip.isEmpty())
+		this->clip = Rect<int32_t>(0, 0, 0, 0);
+	rasterizer.reset(this->clip);
+}
+
+void Canvas::beginRecording(DisplayList& list)
+{
+	assert(!recorder);
+	list.clear();
+	recorder = &list;
+}
+
+void Canvas::endRecording()
+{
+	recorder = nullptr;
+}
+
+void Canvas::drawColor(const vec4f& color)
+{
+	if(recorder)
+	{
+		recorder->drawColor(*this, color);
+		return;
+	}
+
+	if(clip.isEmpty())
+		return;
+
+	vec2f corners[4] =
+	{
+		vec2f(clip.left,  clip.top),
+		vec2f(clip.right, clip.top),
+		vec2f(clip.right, clip.bottom),
+		vec2f(clip.left,  clip.bottom),
+	};
+	rasterizer.addPolygon(corners, 4);
+	rasterizer.render(*bitmap, color, Paint::BlendMode::SRC_OVER, Rasterizer::FillRule::NON_ZERO, false);
+}
+
+void Canvas::drawPoint(const vec2f& point, const Paint& paint)
+{
+	drawPoint(&point, 1, paint);
+}
+
+void Canvas::drawPoint(const vec2f* point, size_t count, const Paint& paint)
+{
+	if(recorder)
+	{
+		recorder->drawPoint(*this, point, count, paint);
+		return;
+	}
+
+	// a square of stroke width centered at point
+	const float halfWidth = getStrokePaint(paint).getStrokeWidth() * 0.5F;
+	for(size_t i = 0; i < count; ++i)
+	{
+		const vec2f& p = point[i];
+		vec2f square[4] =
+		{
+			map(vec2f(p.x - halfWidth, p.y - halfWidth)),
+			map(vec2f(p.x + halfWidth, p.y - halfWidth)),
+			map(vec2f(p.x + halfWidth, p.y + halfWidth)),
+			map(vec2f(p.x - halfWidth, p.y + halfWidth)),
+		};
+		rasterizer.addPolygon(square, 4);
+	}
+	render(paint);
+}
+
+void Canvas::drawLine(const vec2f& p0, const vec2f& p1, const Paint& paint)
+{
+	if(recorder)
+	{
+		recorder->drawLine(*this, p0, p1, paint);
+		return;
+	}
+
+	// lines are always stroked, no matter what the style is.
+	polyline.clear();
+	polyline.points.push_back(p0);
+	polyline.points.push_back(p1);
+	polyline.endContour(false);
+	Paint strokePaint = getStrokePaint(paint);
+	strokePaint.setStyle(Paint::Style::STROKE);
+	draw(polyline, strokePaint);
 }
 
 void Canvas::drawRect(const Rect<int32_t>& rect, const Paint& paint)
 {
+	drawRect(Rect<float>(rect.left, rect.top, rect.right, rect.bottom), paint);
 }
 
 void Canvas::drawRect(const Rect<float>& rect, const Paint& paint)
 {
+	if(recorder)
+	{
+		recorder->drawRect(*this, rect, paint);
+		return;
+	}
+
+	polyline.clear();
+	polyline.points.push_back(vec2f(rect.left,  rect.top));
+	polyline.points.push_back(vec2f(rect.right, rect.top));
+	polyline.points.push_back(vec2f(rect.right, rect.bottom));
+	polyline.points.push_back(vec2f(rect.left,  rect.bottom));
+	polyline.endContour(true);
+	draw(polyline, paint);
+}
+
+void Canvas::drawRoundRect(const Rect<float>& rect, float radius, const Paint& paint)
+{
+	drawRoundRect(rect, radius, radius, paint);
+}
+
+void Canvas::drawRoundRect(const Rect<float>& rect, float rx, float ry, const Paint& paint)
+{
+	if(recorder)
+	{
+		recorder->drawRoundRect(*this, rect, rx, ry, paint);
+		return;
+	}
+
+	rx = std::min(rx, std::abs(rect.getWidth()) * 0.5F);
+	ry = std::min(ry, std::abs(rect.getHeight()) * 0.5F);
+	if(!(rx > 0 && ry > 0))
+	{
+		drawRect(rect, paint);
+		return;
+	}
+
+	constexpr float HALF_PI = static_cast<float>(M_PI_2);
+	const vec2f radius(rx, ry);
+	polyline.clear();
+	addEllipse(vec2f(rect.right - rx, rect.top    + ry), radius, -HALF_PI,     HALF_PI);
+	addEllipse(vec2f(rect.right - rx, rect.bottom - ry), radius, 0,            HALF_PI);
+	addEllipse(vec2f(rect.left  + rx, rect.bottom - ry), radius, HALF_PI,      HALF_PI);
+	addEllipse(vec2f(rect.left  + rx, rect.top    + ry), radius, 2 * HALF_PI,  HALF_PI);
+	polyline.endContour(true);
+	draw(polyline, paint);
 }
 
 void Canvas::drawCircle(float x, float y, float radius, const Paint& paint)
 {
+	if(recorder)
+	{
+		recorder->drawCircle(*this, x, y, radius, paint);
+		return;
+	}
+
+	if(!(radius > 0))
+		return;
+
+	polyline.clear();
+	addEllipse(vec2f(x, y), vec2f(radius, radius), 0, static_cast<float>(2 * M_PI));
+	polyline.points.pop_back();  // same as the first point
+	polyline.endContour(true);
+	draw(polyline, paint);
+}
+
+void Canvas::drawPath(const Path& path, const Paint& paint)
+{
+	if(recorder)
+	{
+		recorder->drawPath(*this, path, paint);
+		return;
+	}
+
+	// flattened and stroked geometry is cached by path, for the same scale and paint.
+	const float tolerance = getTolerance();
+	Paint::Style style = paint.getStyle();
+	if(style == Paint::Style::FILL || style == Paint::Style::FILL_AND_STROKE)
+	{
+		fill(path.flatten(tolerance));
+		render(paint);
+	}
+
+	if(style == Paint::Style::STROKE || style == Paint::Style::FILL_AND_STROKE)
+	{
+		fill(path.getStrokeOutline(getStrokePaint(paint), tolerance));
+		render(paint);
+	}
 }
 
 void Canvas::drawText(const char* text, size_t count, const vec2f& position, const Paint& paint)
 {
+	if(recorder)
+	{
+		recorder->drawText(*this, text, count, position, paint);
+		return;
+	}
+
+	Path path;
+	if(!getTextPath(text, count, position, paint, path))
+	{
+		slog.w(TAG, "no typeface to draw text");
+		return;
+	}
+
+	// glyphs are filled whatever the style is.
+	fill(path.flatten(getTolerance()));
+	render(paint);
 }
 
+bool Canvas::getTextPath(const char* text, size_t count, const vec2f& position, const Paint& paint, Path& path)
+{
+	Typeface* typeface = paint.getTypeface();
+	if(!typeface)
+		return false;
+
+	const float size = paint.getTextSize();
+	const float scaleX = paint.getTextScaleX();
+	vec2f origin = position;
+	char32_t previous = 0;
+	for(const char *p = text, *end = text + count; p < end;)
+	{
+		char32_t codepoint = decodeUtf8(p, end);
+		if(previous != 0)
+			origin.x += typeface->getKerning(previous, codepoint, size) * scaleX;
+		origin.x += typeface->getGlyphPath(codepoint, size, scaleX, origin, path);
+		previous = codepoint;
+	}
+	return true;
+}
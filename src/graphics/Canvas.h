@@ -3,35 +3,79 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "math/mat3.h"
 #include "math/vec4.h"
+#include "graphics/Paint.h"
+#include "graphics/Path.h"
+#include "graphics/Rasterizer.h"
 #include "graphics/Rect.h"
 
 namespace pea {
 
+class DisplayList;
 class Image;
-class Paint;
 
 /**
  * The Canvas class holds the "draw" calls. To draw something, you need 4 basic components: A Bitmap
  * to hold the pixels, a Canvas to host the draw calls (writing into the bitmap), a drawing
  * primitive (e.g. Rect, Path, text, Bitmap), and a paint (to describe the colors and styles for the
  * drawing).
+ *
+ * Drawing is done in software. Geometries are flattened into polygons in local coordinates, within
+ * a tolerance of 1/16 device pixel, and strokes are outlined by Path. Polygons are mapped by the
+ * current matrix, then scan converted by a Rasterizer with exact area coverage, and blended into
+ * the bitmap within the clip. Text is drawn as glyph outlines of the paint's typeface.
  */
 class Canvas
 {
+	friend class DisplayList;
+
 private:
 	static constexpr int32_t MAXMIMUM_BITMAP_SIZE = 32766;  // 2^15 = 32768
 
 	std::unique_ptr<Image> bitmap;
 	mat3f transform;
+	Rect<int32_t> clip;  ///< in device pixels
+	
+	Rasterizer rasterizer;
+	Path::Polyline polyline;  ///< contours of shapes in local coordinates
+	Path::Polyline outline;   ///< stroke of polyline
+	std::vector<vec2f> buffer;
+	
+	DisplayList* recorder;  ///< where draw calls go while recording
+
+private:
+	vec2f map(const vec2f& point) const;
+	
+	/**
+	 * @return flattening tolerance in local coordinates.
+	 */
+	float getTolerance() const;
+	
+	/**
+	 * @return paint of at least 1 pixel stroke width, as a hairline is drawn with stroke width 0.
+	 */
+	Paint getStrokePaint(const Paint& paint) const;
+	
+	void addEllipse(const vec2f& center, const vec2f& radius, float startAngle, float sweepAngle);
+	void fill(const Path::Polyline& polyline);
 	
+	/**
+	 * Fill, stroke or do both to polyline with the paint's style, and blend them into bitmap.
+	 */
+	void draw(const Path::Polyline& polyline, const Paint& paint);
+	void render(const Paint& paint);
+
 public:
-	Canvas(std::unique_ptr<Image> bitmap);
+	explicit Canvas(std::unique_ptr<Image> bitmap);
 	
 	vec2i getSize() const;
 	
+	const Image& getBitmap() const;
+	      Image& getBitmap();
+	
 	/**
 	 * Preconcat the current matrix with the specified translation
 	 *
@@ -101,8 +145,30 @@ public:
 	const mat3f& getTransform() const;
 	
 	// draw methods
+	/**
+	 * Intersect the current clip with the bounds of region, mapped by the current matrix.
+	 */
 	void clipRect(const Rect<int32_t>& region);
 	
+	/**
+	 * @return the current clip in device pixels.
+	 */
+	const Rect<int32_t>& getClip() const;
+	
+	/**
+	 * Replace the current clip, limited to the bitmap.
+	 * @param[in] clip in device pixels.
+	 */
+	void setClip(const Rect<int32_t>& clip);
+	
+	/**
+	 * Record the following draw calls into list instead of drawing them, until endRecording().
+	 * @param[in] list cleared first, which outlives the recording.
+	 */
+	void beginRecording(DisplayList& list);
+	void endRecording();
+	bool isRecording() const;
+	
 
 	/**
 	 * Fill the entire canvas' bitmap (restricted to the current clip) with the specified color,
@@ -135,11 +201,30 @@ public:
 	
 	void drawCircle(float x, float y, float radius, const Paint& paint);
 	
+	/**
+	 * Draw the path with the paint's style, filled with non-zero winding rule.
+	 */
+	void drawPath(const Path& path, const Paint& paint);
+	
+	/**
+	 * Draw the text, with origin at position of baseline's start. Glyphs are filled with the
+	 * paint's typeface, size and horizontal scale, nothing is drawn without a typeface.
+	 */
 	void drawText(const char* text, size_t count, const vec2f& position, const Paint& paint);
 	void drawText(const std::string& text, const vec2f& position, const Paint& paint);
 	
+	/**
+	 * Append glyph outlines of text to path, as drawText() fills them.
+	 * @return false if paint has no typeface.
+	 */
+	static bool getTextPath(const char* text, size_t count, const vec2f& position, const Paint& paint, Path& path);
 };
 
+inline const Image& Canvas::getBitmap() const { return *bitmap; }
+inline       Image& Canvas::getBitmap()       { return *bitmap; }
+inline const Rect<int32_t>& Canvas::getClip() const { return clip; }
+inline bool Canvas::isRecording() const { return recorder != nullptr; }
+
 inline void Canvas::drawText(const std::string& text, const vec2f& position, const Paint& paint)
 {
 	drawText(text.data(), text.size(), position, paint);
@@ -1,7 +1,14 @@
 #include "graphics/Color.h"
 
+#include <algorithm>
+#include <cmath>
 #include <cstring>
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define COLOR_SSE 1
+#endif
+
 #include "math/scalar.h" // for clamp
 
 namespace pea {
@@ -46,6 +53,267 @@ vec3f hsv2rgb(const vec3f& hsv)
 	return color;
 }
 
+vec3f rgb2hsv(const vec3f& rgb)
+{
+	const float &r = rgb.r, &g = rgb.g, &b = rgb.b;
+	const float max = std::max(r, std::max(g, b));
+	const float min = std::min(r, std::min(g, b));
+	const float delta = max - min;
+	
+	float h = 0.0f;
+	if(delta > 0.0f)
+	{
+		if(max == r)
+			h = (g - b) / delta;
+		else if(max == g)
+			h = (b - r) / delta + 2.0f;
+		else
+			h = (r - g) / delta + 4.0f;
+		
+		if(h < 0.0f)
+			h += 6.0f;
+		h /= 6.0f;
+	}
+	
+	float s = max > 0.0f? delta / max: 0.0f;
+	return vec3f(h, s, max);
+}
+
+float srgb2linear(float c)
+{
+	return c <= 0.04045f? c / 12.92f: std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+float linear2srgb(float c)
+{
+	return c <= 0.0031308f? c * 12.92f: 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+}
+
+/*
+ * SIMD kernels do the same IEEE operations in the same order as the scalar functions, division
+ * isn't replaced by multiplication with reciprocal, and min/max take operands in the order that
+ * picks the same one of equal values (+0 and -0) as std::min/std::max and clamp do.
+ */
+#if COLOR_SSE
+static inline void load(const vec3f* v, __m128& x, __m128& y, __m128& z)
+{
+	x = _mm_setr_ps(v[0].x, v[1].x, v[2].x, v[3].x);
+	y = _mm_setr_ps(v[0].y, v[1].y, v[2].y, v[3].y);
+	z = _mm_setr_ps(v[0].z, v[1].z, v[2].z, v[3].z);
+}
+
+static inline void store(vec3f* v, const __m128& x, const __m128& y, const __m128& z)
+{
+	alignas(16) float a[3][4];
+	_mm_store_ps(a[0], x);
+	_mm_store_ps(a[1], y);
+	_mm_store_ps(a[2], z);
+	for(uint8_t i = 0; i < 4; ++i)
+		v[i] = vec3f(a[0][i], a[1][i], a[2][i]);
+}
+
+static inline __m128 select(const __m128& mask, const __m128& a, const __m128& b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+#endif
+
+void color_cast(const vec4f* colors, uint32_t* packed, size_t count)
+{
+	size_t i = 0;
+#if COLOR_SSE
+	// truncation of cvtt is the one of static_cast, channels are within [0, 255] and fit in bytes.
+	const __m128 s = _mm_set1_ps(255.999f);
+	for(; i + 4 <= count; i += 4)
+	{
+		__m128i c0 = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(&colors[i + 0].r), s));
+		__m128i c1 = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(&colors[i + 1].r), s));
+		__m128i c2 = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(&colors[i + 2].r), s));
+		__m128i c3 = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(&colors[i + 3].r), s));
+		__m128i c = _mm_packus_epi16(_mm_packs_epi32(c0, c1), _mm_packs_epi32(c2, c3));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(packed + i), c);
+	}
+#endif
+	for(; i < count; ++i)
+		packed[i] = color_cast(colors[i]);
+}
+
+void color_cast(const uint32_t* packed, vec4f* colors, size_t count)
+{
+	size_t i = 0;
+#if COLOR_SSE
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 d = _mm_set1_ps(255.0f);
+	for(; i + 4 <= count; i += 4)
+	{
+		__m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(packed + i));
+		__m128i lo = _mm_unpacklo_epi8(c, zero), hi = _mm_unpackhi_epi8(c, zero);
+		__m128i c0 = _mm_unpacklo_epi16(lo, zero), c1 = _mm_unpackhi_epi16(lo, zero);
+		__m128i c2 = _mm_unpacklo_epi16(hi, zero), c3 = _mm_unpackhi_epi16(hi, zero);
+		_mm_storeu_ps(&colors[i + 0].r, _mm_div_ps(_mm_cvtepi32_ps(c0), d));
+		_mm_storeu_ps(&colors[i + 1].r, _mm_div_ps(_mm_cvtepi32_ps(c1), d));
+		_mm_storeu_ps(&colors[i + 2].r, _mm_div_ps(_mm_cvtepi32_ps(c2), d));
+		_mm_storeu_ps(&colors[i + 3].r, _mm_div_ps(_mm_cvtepi32_ps(c3), d));
+	}
+#endif
+	for(; i < count; ++i)
+		colors[i] = color_cast(packed[i]);
+}
+
+void hsv2rgb(const vec3f* hsv, vec3f* rgb, size_t count)
+{
+	size_t i = 0;
+#if COLOR_SSE
+	const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f);
+	const __m128 three = _mm_set1_ps(3.0f), four = _mm_set1_ps(4.0f), six = _mm_set1_ps(6.0f);
+	const __m128 abs = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	for(; i + 4 <= count; i += 4)
+	{
+		__m128 h, s, v;
+		load(hsv + i, h, s, v);
+		__m128 h6 = _mm_mul_ps(h, six);
+		__m128 c[3] =
+		{
+			_mm_sub_ps(_mm_and_ps(_mm_sub_ps(h6, three), abs), one),
+			_mm_sub_ps(two, _mm_and_ps(_mm_sub_ps(h6, two), abs)),
+			_mm_sub_ps(two, _mm_and_ps(_mm_sub_ps(h6, four), abs)),
+		};
+		for(__m128& x: c)
+		{
+			x = _mm_min_ps(one, _mm_max_ps(zero, x));  // clamp(x, 0, 1)
+			x = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(x, one), s), one), v);
+		}
+		store(rgb + i, c[0], c[1], c[2]);
+	}
+#endif
+	for(; i < count; ++i)
+		rgb[i] = hsv2rgb(hsv[i]);
+}
+
+void rgb2hsv(const vec3f* rgb, vec3f* hsv, size_t count)
+{
+	size_t i = 0;
+#if COLOR_SSE
+	const __m128 zero = _mm_setzero_ps(), two = _mm_set1_ps(2.0f);
+	const __m128 four = _mm_set1_ps(4.0f), six = _mm_set1_ps(6.0f);
+	for(; i + 4 <= count; i += 4)
+	{
+		__m128 r, g, b;
+		load(rgb + i, r, g, b);
+		__m128 max = _mm_max_ps(_mm_max_ps(b, g), r);
+		__m128 min = _mm_min_ps(_mm_min_ps(b, g), r);
+		__m128 delta = _mm_sub_ps(max, min);
+		
+		// all three sectors are computed, lanes of delta 0 are dropped at last.
+		__m128 hr = _mm_div_ps(_mm_sub_ps(g, b), delta);
+		__m128 hg = _mm_add_ps(_mm_div_ps(_mm_sub_ps(b, r), delta), two);
+		__m128 hb = _mm_add_ps(_mm_div_ps(_mm_sub_ps(r, g), delta), four);
+		__m128 h = select(_mm_cmpeq_ps(max, r), hr, select(_mm_cmpeq_ps(max, g), hg, hb));
+		h = select(_mm_cmplt_ps(h, zero), _mm_add_ps(h, six), h);
+		h = select(_mm_cmpgt_ps(delta, zero), _mm_div_ps(h, six), zero);
+		__m128 s = select(_mm_cmpgt_ps(max, zero), _mm_div_ps(delta, max), zero);
+		store(hsv + i, h, s, max);
+	}
+#endif
+	for(; i < count; ++i)
+		hsv[i] = rgb2hsv(rgb[i]);
+}
+
+namespace {
+
+struct SrgbTable
+{
+	static constexpr uint32_t BUCKET_COUNT = 0x3F80 + 1;  // high 16 bits of floats in [0, 1]
+	
+	float linear[256];      ///< srgb2linear(i / 255.0f)
+	float thresholds[256];  ///< least linear value quantized to i, thresholds[0] is unused.
+	uint8_t buckets[BUCKET_COUNT];  ///< quantization of the least float of the same high 16 bits
+	
+	SrgbTable();
+};
+
+}  // namespace
+
+static uint8_t quantize(float c)
+{
+	return static_cast<uint8_t>(linear2srgb(c) * 255.999f);
+}
+
+SrgbTable::SrgbTable()
+{
+	for(uint32_t i = 0; i < 256; ++i)
+		linear[i] = srgb2linear(i / 255.0f);
+	
+	// linear2srgb() is monotonic, so is its quantization. Bisect on bit patterns, which are in the
+	// same order as non-negative floats.
+	uint32_t lo, hi;
+	const float one = 1.0f;
+	thresholds[0] = 0.0f;
+	for(uint32_t i = 1; i < 256; ++i)
+	{
+		lo = 0;
+		std::memcpy(&hi, &one, sizeof(hi));
+		while(lo < hi)
+		{
+			uint32_t middle = lo + (hi - lo) / 2;
+			float c;
+			std::memcpy(&c, &middle, sizeof(c));
+			if(quantize(c) >= i)
+				hi = middle;
+			else
+				lo = middle + 1;
+		}
+		std::memcpy(&thresholds[i], &lo, sizeof(lo));
+	}
+	
+	// a bucket spans 2 quantization steps at most, lookups start from here and move once at most.
+	for(uint32_t i = 0; i < BUCKET_COUNT; ++i)
+	{
+		uint32_t bits = i << 16;
+		float c;
+		std::memcpy(&c, &bits, sizeof(c));
+		buckets[i] = quantize(c);
+	}
+}
+
+static const SrgbTable& getSrgbTable()
+{
+	static const SrgbTable table;
+	return table;
+}
+
+void srgb2linear(const uint8_t* srgb, float* linear, size_t count)
+{
+	const SrgbTable& table = getSrgbTable();
+	for(size_t i = 0; i < count; ++i)
+		linear[i] = table.linear[srgb[i]];
+}
+
+void linear2srgb(const float* linear, uint8_t* srgb, size_t count)
+{
+	const SrgbTable& table = getSrgbTable();
+	for(size_t i = 0; i < count; ++i)
+	{
+		const float c = linear[i];
+		if(!(c > 0.0f))  // NaN too
+		{
+			srgb[i] = 0;
+			continue;
+		}
+		if(c >= 1.0f)
+		{
+			srgb[i] = 255;
+			continue;
+		}
+		
+		uint32_t bits;
+		std::memcpy(&bits, &c, sizeof(bits));
+		uint32_t index = table.buckets[bits >> 16];
+		index += index < 255 && c >= table.thresholds[index + 1];
+		srgb[i] = static_cast<uint8_t>(index);
+	}
+}
+
 }  // namespace pea
 
 using namespace pea;
@@ -2,6 +2,7 @@
 #define PEA_GRAPHICS_COLOR_H_
 
 #include <cassert>
+#include <cstddef>
 #include <cstdint>
 #include <string>
 
@@ -22,6 +23,33 @@ uint32_t color_cast(const vec4f& color);
 vec4f    color_cast(uint32_t color);
 
 vec3f hsv2rgb(const vec3f& hsv);
+vec3f rgb2hsv(const vec3f& rgb);
+
+/**
+ * sRGB transfer function of a single color channel, alpha is always linear.
+ * @param[in] c channel value in [0, 1].
+ */
+float srgb2linear(float c);
+float linear2srgb(float c);
+
+/*
+ * Span versions of the conversions above, for images and generators that convert every pixel.
+ * Results are bitwise identical to converting elements one by one. Input and output of the same
+ * type may be the same span.
+ */
+void color_cast(const vec4f* colors, uint32_t* packed, size_t count);
+void color_cast(const uint32_t* packed, vec4f* colors, size_t count);
+void hsv2rgb(const vec3f* hsv, vec3f* rgb, size_t count);
+void rgb2hsv(const vec3f* rgb, vec3f* hsv, size_t count);
+
+/**
+ * sRGB transfer of 8 bit channels by tables.
+ * srgb2linear() gives srgb2linear(srgb[i] / 255.0F).
+ * linear2srgb() gives linear2srgb(linear[i]) quantized as color_cast() does, inputs out of [0, 1]
+ * are clamped.
+ */
+void srgb2linear(const uint8_t* srgb, float* linear, size_t count);
+void linear2srgb(const float* linear, uint8_t* srgb, size_t count);
 
 /**
  * a 32 bit RGBA color.
@@ -182,33 +210,42 @@ constexpr uint32_t Color::size(Format format)
 {
 	switch(format)
 	{
-	case C1_U8:
-		return 1;
-	
-	case C2_U8:
-	case C1_F16:
 	case RGBA5551_U16:
 	case RGBA4444_U16:
 	case RGB565_U16:
 		return 2;
 	
-	case C3_U8:
+	case BGR888_U24:
 		return 3;
 	
-	case C4_U8:
-	case C2_U16:
-	case C2_I16:
-	case C1_U32:
-	case C1_I32:
-	case C1_F32:
+	case BGRA8888_U32:
 	case RGBA1010102_U32:
 		return 4;
 	
-	case C3_U16:
-		return 3 * 2;
+	default:
+		break;
+	}
+	
+	switch(getType(format))
+	{
+	case U8:
+	case I8:
+		return sizeofChannel(format);
+	
+	case U16:
+	case I16:
+	case F16:
+		return sizeofChannel(format) * 2;
+	
+	case U32:
+	case I32:
+	case F32:
+		return sizeofChannel(format) * 4;
 	
-	case C4_F32:
-		return 4 * 4;
+	case U64:
+	case I64:
+	case F64:
+		return sizeofChannel(format) * 8;
 	
 	default:
 		assert(false);
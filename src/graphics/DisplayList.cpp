@@ -0,0 +1,476 @@
+#include "graphics/DisplayList.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <string_view>
+#include <unordered_map>
+
+#include "graphics/Canvas.h"
+
+using namespace pea;
+
+static constexpr float TOLERANCE = 1.0F / 16;  // of flattening for bounds, in device pixels
+
+static uint64_t combine(uint64_t h, uint64_t value)
+{
+	// like boost::hash_combine
+	return h ^ (value + 0x9E3779B97F4A7C15ULL + (h << 6) + (h >> 2));
+}
+
+static uint64_t hashBytes(const void* data, size_t size)
+{
+	return std::hash<std::string_view>()(std::string_view(static_cast<const char*>(data), size));
+}
+
+static Rect<int32_t> intersect(const Rect<int32_t>& a, const Rect<int32_t>& b)
+{
+	Rect<int32_t> rect(std::max(a.left, b.left), std::max(a.top, b.top), std::min(a.right, b.right), std::min(a.bottom, b.bottom));
+	if(rect.isEmpty())
+		rect.setEmpty();
+	return rect;
+}
+
+static bool intersects(const Rect<int32_t>& a, const Rect<int32_t>& b)
+{
+	return a.left < b.right && b.left < a.right && a.top < b.bottom && b.top < a.bottom;
+}
+
+static int64_t getArea(const Rect<int32_t>& rect)
+{
+	return static_cast<int64_t>(rect.getWidth()) * rect.getHeight();
+}
+
+static float getScale(const mat3f& transform)
+{
+	const float* a = transform.a;
+	return std::max(std::hypot(a[0], a[1]), std::hypot(a[3], a[4]));
+}
+
+/**
+ * Union overlapping rectangles until they're disjoint, then the pairs adding the least area until
+ * there are no more than maxRectCount.
+ */
+static void merge(std::vector<Rect<int32_t>>& rects, size_t maxRectCount)
+{
+	maxRectCount = std::max<size_t>(maxRectCount, 1);
+	for(bool merged = true; merged;)
+	{
+		merged = false;
+		for(size_t i = 0; i < rects.size(); ++i)
+			for(size_t j = i + 1; j < rects.size();)
+				if(intersects(rects[i], rects[j]))
+				{
+					rects[i].union_(rects[j]);
+					rects[j] = rects.back();
+					rects.pop_back();
+					merged = true;
+				}
+				else
+					++j;
+
+		if(!merged && rects.size() > maxRectCount)
+		{
+			size_t best0 = 0, best1 = 1;
+			int64_t bestCost = std::numeric_limits<int64_t>::max();
+			for(size_t i = 0; i < rects.size(); ++i)
+				for(size_t j = i + 1; j < rects.size(); ++j)
+				{
+					Rect<int32_t> rect = rects[i];
+					rect.union_(rects[j]);
+					int64_t cost = getArea(rect) - getArea(rects[i]) - getArea(rects[j]);
+					if(cost < bestCost)
+					{
+						bestCost = cost;
+						best0 = i;
+						best1 = j;
+					}
+				}
+			rects[best0].union_(rects[best1]);
+			rects[best1] = rects.back();
+			rects.pop_back();
+			merged = true;
+		}
+	}
+}
+
+DisplayList::DisplayList():
+		polylineCount(0)
+{
+}
+
+void DisplayList::clear()
+{
+	commands.clear();
+	points.clear();
+	texts.clear();
+	polylineCount = 0;
+}
+
+DisplayList::Command& DisplayList::add(Op op, const Canvas& canvas, const Paint& paint, const vec4f& values)
+{
+	commands.push_back(Command{op, canvas.getTransform(), canvas.getClip(), paint, values, 0, 0, 0, Rect<int32_t>(), false});
+	return commands.back();
+}
+
+void DisplayList::hash(Command& command) const
+{
+	const Paint& paint = command.paint;
+	const vec4f& color = paint.getColor();
+	const float* a = command.transform.a;
+	const float floats[] =
+	{
+		a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8],
+		command.values.x, command.values.y, command.values.z, command.values.w,
+		color.r, color.g, color.b, color.a,
+		paint.getStrokeWidth(), paint.getStrokeMiter(), paint.getTextSize(), paint.getTextScaleX(),
+	};
+	const int32_t ints[] =
+	{
+		static_cast<int32_t>(command.op),
+		command.clip.left, command.clip.top, command.clip.right, command.clip.bottom,
+		static_cast<int32_t>(paint.getStyle()), static_cast<int32_t>(paint.getStrokeCap()),
+		static_cast<int32_t>(paint.getStrokeJoin()), static_cast<int32_t>(paint.getBlendMode()),
+		paint.isAntiAlias(),
+	};
+
+	uint64_t h = hashBytes(floats, sizeof(floats));
+	h = combine(h, hashBytes(ints, sizeof(ints)));
+	h = combine(h, reinterpret_cast<uintptr_t>(paint.getTypeface()));
+	switch(command.op)
+	{
+	case Op::POINTS:
+	case Op::LINE:
+	case Op::ROUND_RECT:
+		h = combine(h, hashBytes(points.data() + command.begin, (command.end - command.begin) * sizeof(vec2f)));
+		break;
+	case Op::PATH:
+		for(uint32_t i = command.begin; i < command.end; ++i)
+		{
+			const Path::Polyline& polyline = polylines[i];
+			h = combine(h, hashBytes(polyline.points.data(), polyline.points.size() * sizeof(vec2f)));
+			for(const Path::Contour& contour: polyline.contours)
+				h = combine(h, contour.end << 1 | contour.closed);
+		}
+		break;
+	case Op::TEXT:
+		h = combine(h, hashBytes(texts.data() + command.begin, command.end - command.begin));
+		break;
+	default:
+		break;
+	}
+	command.hash = h;
+}
+
+void DisplayList::drawColor(const Canvas& canvas, const vec4f& color)
+{
+	hash(add(Op::COLOR, canvas, Paint(), color));
+}
+
+void DisplayList::drawPoint(const Canvas& canvas, const vec2f* point, size_t count, const Paint& paint)
+{
+	Command& command = add(Op::POINTS, canvas, paint, vec4f(0, 0, 0, 0));
+	command.begin = static_cast<uint32_t>(points.size());
+	points.insert(points.end(), point, point + count);
+	command.end = static_cast<uint32_t>(points.size());
+	hash(command);
+}
+
+void DisplayList::drawLine(const Canvas& canvas, const vec2f& p0, const vec2f& p1, const Paint& paint)
+{
+	Command& command = add(Op::LINE, canvas, paint, vec4f(0, 0, 0, 0));
+	command.begin = static_cast<uint32_t>(points.size());
+	points.push_back(p0);
+	points.push_back(p1);
+	command.end = static_cast<uint32_t>(points.size());
+	hash(command);
+}
+
+void DisplayList::drawRect(const Canvas& canvas, const Rect<float>& rect, const Paint& paint)
+{
+	hash(add(Op::RECT, canvas, paint, vec4f(rect.left, rect.top, rect.right, rect.bottom)));
+}
+
+void DisplayList::drawRoundRect(const Canvas& canvas, const Rect<float>& rect, float rx, float ry, const Paint& paint)
+{
+	Command& command = add(Op::ROUND_RECT, canvas, paint, vec4f(rect.left, rect.top, rect.right, rect.bottom));
+	command.begin = static_cast<uint32_t>(points.size());
+	points.push_back(vec2f(rx, ry));
+	command.end = static_cast<uint32_t>(points.size());
+	hash(command);
+}
+
+void DisplayList::drawCircle(const Canvas& canvas, float x, float y, float radius, const Paint& paint)
+{
+	hash(add(Op::CIRCLE, canvas, paint, vec4f(x, y, radius, 0)));
+}
+
+void DisplayList::addPolyline(const Path::Polyline& polyline)
+{
+	if(polylineCount == polylines.size())
+		polylines.emplace_back();
+	Path::Polyline& copy = polylines[polylineCount++];
+	copy.points.assign(polyline.points.begin(), polyline.points.end());
+	copy.contours.assign(polyline.contours.begin(), polyline.contours.end());
+}
+
+void DisplayList::drawPath(const Canvas& canvas, const Path& path, const Paint& paint)
+{
+	// polylines are kept as Canvas::drawPath() fills them, flattened and stroked by the path's cache.
+	Command& command = add(Op::PATH, canvas, paint, vec4f(0, 0, 0, 0));
+	command.begin = polylineCount;
+	const float tolerance = canvas.getTolerance();
+	const Paint::Style style = paint.getStyle();
+	if(style == Paint::Style::FILL || style == Paint::Style::FILL_AND_STROKE)
+		addPolyline(path.flatten(tolerance));
+	if(style == Paint::Style::STROKE || style == Paint::Style::FILL_AND_STROKE)
+		addPolyline(path.getStrokeOutline(canvas.getStrokePaint(paint), tolerance));
+	command.end = polylineCount;
+	hash(command);
+}
+
+void DisplayList::drawText(const Canvas& canvas, const char* text, size_t count, const vec2f& position, const Paint& paint)
+{
+	Command& command = add(Op::TEXT, canvas, paint, vec4f(position.x, position.y, 0, 0));
+	command.begin = static_cast<uint32_t>(texts.size());
+	texts.append(text, count);
+	command.end = static_cast<uint32_t>(texts.size());
+	hash(command);
+}
+
+const Rect<int32_t>& DisplayList::getBounds(const Command& command) const
+{
+	if(command.bounded)
+		return command.bounds;
+
+	command.bounded = true;
+	if(command.op == Op::COLOR)
+	{
+		command.bounds = command.clip;
+		return command.bounds;
+	}
+
+	const Paint& paint = command.paint;
+	const float scale = getScale(command.transform);
+	const float tolerance = scale > 0? TOLERANCE / scale: TOLERANCE;
+	// a hairline is 1 device pixel wide, see Canvas::getStrokePaint().
+	const float halfWidth = (paint.getStrokeWidth() > 0? paint.getStrokeWidth(): tolerance / TOLERANCE) * 0.5F;
+	// miter joins reach out at most miter times half width, square caps sqrt(2) times.
+	const float strokeOutset = halfWidth * (paint.getStrokeJoin() == Paint::Join::MITER?
+			std::max(paint.getStrokeMiter(), static_cast<float>(M_SQRT2)): static_cast<float>(M_SQRT2));
+	const bool stroked = paint.getStyle() != Paint::Style::FILL;
+
+	constexpr float INF = std::numeric_limits<float>::infinity();
+	float left = INF, top = INF, right = -INF, bottom = -INF;
+	auto extend = [&left, &top, &right, &bottom](const vec2f& point)
+	{
+		left   = std::min(left,   point.x);
+		top    = std::min(top,    point.y);
+		right  = std::max(right,  point.x);
+		bottom = std::max(bottom, point.y);
+	};
+
+	float outset = stroked? strokeOutset: 0;
+	const vec4f& values = command.values;
+	switch(command.op)
+	{
+	case Op::POINTS:
+		outset = halfWidth;
+		std::for_each(points.begin() + command.begin, points.begin() + command.end, extend);
+		break;
+	case Op::LINE:
+		outset = strokeOutset;
+		std::for_each(points.begin() + command.begin, points.begin() + command.end, extend);
+		break;
+	case Op::RECT:
+	case Op::ROUND_RECT:
+		extend(vec2f(values.x, values.y));
+		extend(vec2f(values.z, values.w));
+		break;
+	case Op::CIRCLE:
+		if(values.z > 0)
+		{
+			extend(vec2f(values.x - values.z, values.y - values.z));
+			extend(vec2f(values.x + values.z, values.y + values.z));
+		}
+		break;
+	case Op::PATH:
+		// strokes are outlined already.
+		outset = 0;
+		for(uint32_t i = command.begin; i < command.end; ++i)
+			std::for_each(polylines[i].points.begin(), polylines[i].points.end(), extend);
+		break;
+	case Op::TEXT:
+	{
+		// glyphs are filled whatever the style is.
+		outset = 0;
+		Path path;
+		if(Canvas::getTextPath(texts.data() + command.begin, command.end - command.begin,
+				vec2f(values.x, values.y), paint, path))
+		{
+			const std::vector<vec2f>& polyline = path.flatten(tolerance).points;
+			std::for_each(polyline.begin(), polyline.end(), extend);
+		}
+		break;
+	}
+	default:
+		assert(false);
+		break;
+	}
+
+	if(!(left <= right && top <= bottom))
+	{
+		command.bounds.setEmpty();
+		return command.bounds;
+	}
+
+	left -= outset;
+	top -= outset;
+	right += outset;
+	bottom += outset;
+	const vec2f corners[4] = { vec2f(left, top), vec2f(right, top), vec2f(right, bottom), vec2f(left, bottom) };
+	const float* a = command.transform.a;
+	left = top = INF;
+	right = bottom = -INF;
+	for(const vec2f& corner: corners)
+		extend(vec2f(a[0] * corner.x + a[3] * corner.y + a[6], a[1] * corner.x + a[4] * corner.y + a[7]));
+
+	// 1 more pixel for antialiasing and rounding errors
+	constexpr float LIMIT = 1 << 30;
+	Rect<int32_t> bounds(
+			static_cast<int32_t>(std::floor(std::max(left,   -LIMIT))) - 1,
+			static_cast<int32_t>(std::floor(std::max(top,    -LIMIT))) - 1,
+			static_cast<int32_t>(std::ceil (std::min(right,  +LIMIT))) + 1,
+			static_cast<int32_t>(std::ceil (std::min(bottom, +LIMIT))) + 1);
+	command.bounds = intersect(bounds, command.clip);
+	return command.bounds;
+}
+
+std::vector<Rect<int32_t>> DisplayList::diff(const DisplayList& previous, size_t maxRectCount/* = 8 */) const
+{
+	// indices of old commands by hash, in ascending order
+	std::unordered_map<uint64_t, std::vector<uint32_t>> indices;
+	indices.reserve(previous.commands.size());
+	for(uint32_t i = 0; i < previous.commands.size(); ++i)
+		indices[previous.commands[i].hash].push_back(i);
+
+	// match each command to the first old one of the same hash after the last match, so that the
+	// matched ones keep their order.
+	std::vector<bool> matched(previous.commands.size(), false);
+	std::vector<Rect<int32_t>> rects;
+	int64_t last = -1;
+	for(const Command& command: commands)
+	{
+		auto it = indices.find(command.hash);
+		if(it != indices.end())
+		{
+			const std::vector<uint32_t>& list = it->second;
+			auto index = std::upper_bound(list.begin(), list.end(), last);
+			if(index != list.end())
+			{
+				last = *index;
+				matched[last] = true;
+				const Command& old = previous.commands[last];
+				if(old.bounded)
+				{
+					command.bounds = old.bounds;
+					command.bounded = true;
+				}
+				continue;
+			}
+		}
+
+		const Rect<int32_t>& bounds = getBounds(command);
+		if(!bounds.isEmpty())
+			rects.push_back(bounds);
+	}
+
+	for(size_t i = 0; i < previous.commands.size(); ++i)
+		if(!matched[i])
+		{
+			const Rect<int32_t>& bounds = previous.getBounds(previous.commands[i]);
+			if(!bounds.isEmpty())
+				rects.push_back(bounds);
+		}
+
+	merge(rects, maxRectCount);
+	return rects;
+}
+
+void DisplayList::execute(Canvas& canvas, const Command& command) const
+{
+	const Paint& paint = command.paint;
+	const vec4f& values = command.values;
+	const Rect<float> rect(values.x, values.y, values.z, values.w);
+	switch(command.op)
+	{
+	case Op::COLOR:
+		canvas.drawColor(values);
+		break;
+	case Op::POINTS:
+		canvas.drawPoint(points.data() + command.begin, command.end - command.begin, paint);
+		break;
+	case Op::LINE:
+		canvas.drawLine(points[command.begin], points[command.begin + 1], paint);
+		break;
+	case Op::RECT:
+		canvas.drawRect(rect, paint);
+		break;
+	case Op::ROUND_RECT:
+		canvas.drawRoundRect(rect, points[command.begin].x, points[command.begin].y, paint);
+		break;
+	case Op::CIRCLE:
+		canvas.drawCircle(values.x, values.y, values.z, paint);
+		break;
+	case Op::PATH:
+		for(uint32_t i = command.begin; i < command.end; ++i)
+		{
+			canvas.fill(polylines[i]);
+			canvas.render(paint);
+		}
+		break;
+	case Op::TEXT:
+		canvas.drawText(texts.data() + command.begin, command.end - command.begin, vec2f(values.x, values.y), paint);
+		break;
+	default:
+		assert(false);
+		break;
+	}
+}
+
+void DisplayList::replay(Canvas& canvas, const Rect<int32_t>& region) const
+{
+	assert(!canvas.isRecording());
+	const mat3f transform = canvas.getTransform();
+	const Rect<int32_t> clip = canvas.getClip();
+	for(const Command& command: commands)
+	{
+		if(!intersects(getBounds(command), region))
+			continue;
+
+		canvas.setTransform(command.transform);
+		canvas.setClip(intersect(command.clip, region));
+		execute(canvas, command);
+	}
+
+	canvas.setTransform(transform);
+	canvas.setClip(clip);
+}
+
+std::vector<Rect<int32_t>> DisplayList::replay(Canvas& canvas, const DisplayList* previous) const
+{
+	std::vector<Rect<int32_t>> rects;
+	if(previous)
+		rects = diff(*previous);
+	else
+	{
+		const vec2i size = canvas.getSize();
+		rects.push_back(Rect<int32_t>(0, 0, size.x, size.y));
+	}
+
+	for(const Rect<int32_t>& rect: rects)
+		replay(canvas, rect);
+	return rects;
+}
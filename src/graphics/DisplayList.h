@@ -0,0 +1,129 @@
+#ifndef PEA_GRAPHICS_DISPLAY_LIST_H_
+#define PEA_GRAPHICS_DISPLAY_LIST_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "math/mat3.h"
+#include "math/vec2.h"
+#include "math/vec4.h"
+#include "graphics/Paint.h"
+#include "graphics/Path.h"
+#include "graphics/Rect.h"
+
+namespace pea {
+
+class Canvas;
+
+/**
+ * @class DisplayList
+ * Draw calls of a Canvas recorded in a frame, to be replayed later. Each command keeps its matrix,
+ * clip and paint, and a hash of them all. Diffing a frame against the previous one tells which
+ * commands are added, removed or changed, and the device pixels they cover are the dirty
+ * rectangles, which is all that needs to be drawn again. In a mostly static UI, these are a few
+ * small rectangles, and commands out of them are skipped in replay.
+ *
+ * Pixels out of dirty rectangles are left as the previous frame drew them, so a frame is expected
+ * to paint its background with opaque commands, like an immediate mode frame that is drawn over
+ * the last one.
+ *
+ * @code
+ *   canvas.beginRecording(lists[frame & 1]);
+ *   drawFrame(canvas);
+ *   canvas.endRecording();
+ *   std::vector<Rect<int32_t>> rects = lists[frame & 1].replay(canvas, frame > 0? &lists[~frame & 1]: nullptr);
+ *   // upload or present rects of canvas.getBitmap(), or scissor GL drawing with them.
+ * @endcode
+ */
+class DisplayList
+{
+	friend class Canvas;
+
+private:
+	enum class Op: uint8_t
+	{
+		COLOR,
+		POINTS,
+		LINE,
+		RECT,
+		ROUND_RECT,
+		CIRCLE,
+		PATH,
+		TEXT,
+	};
+
+	struct Command
+	{
+		Op op;
+		mat3f transform;
+		Rect<int32_t> clip;  ///< in device pixels
+		Paint paint;
+		vec4f values;  ///< color, rect, or circle (x, y, radius, 0)
+		uint32_t begin, end;  ///< range of points, text or polylines
+		uint64_t hash;
+
+		mutable Rect<int32_t> bounds;  ///< device pixels covered, within clip
+		mutable bool bounded;          ///< bounds are computed
+	};
+
+	std::vector<Command> commands;
+	std::vector<vec2f> points;  ///< of POINTS and LINE, and radii of ROUND_RECT
+	std::string texts;
+
+	/**
+	 * Fill polylines and stroke outlines of paths, flattened as they're recorded. Only the first
+	 * polylineCount are recorded, the others keep their storage for the next frame.
+	 */
+	std::vector<Path::Polyline> polylines;
+	uint32_t polylineCount;
+
+private:
+	Command& add(Op op, const Canvas& canvas, const Paint& paint, const vec4f& values);
+	void hash(Command& command) const;
+	void execute(Canvas& canvas, const Command& command) const;
+	const Rect<int32_t>& getBounds(const Command& command) const;
+	void addPolyline(const Path::Polyline& polyline);
+
+	// recorded by Canvas in place of drawing
+	void drawColor(const Canvas& canvas, const vec4f& color);
+	void drawPoint(const Canvas& canvas, const vec2f* point, size_t count, const Paint& paint);
+	void drawLine(const Canvas& canvas, const vec2f& p0, const vec2f& p1, const Paint& paint);
+	void drawRect(const Canvas& canvas, const Rect<float>& rect, const Paint& paint);
+	void drawRoundRect(const Canvas& canvas, const Rect<float>& rect, float rx, float ry, const Paint& paint);
+	void drawCircle(const Canvas& canvas, float x, float y, float radius, const Paint& paint);
+	void drawPath(const Canvas& canvas, const Path& path, const Paint& paint);
+	void drawText(const Canvas& canvas, const char* text, size_t count, const vec2f& position, const Paint& paint);
+
+public:
+	DisplayList();
+
+	void clear();
+	size_t getCommandCount() const;
+
+	/**
+	 * Commands are matched in order by hash, those left unmatched in either list are changed.
+	 * @param[in] previous     list of the last frame, drawn into the same canvas.
+	 * @param[in] maxRectCount nearest rectangles are merged until there are no more than this.
+	 * @return disjoint device rectangles covered by changed commands, empty if nothing changed.
+	 */
+	std::vector<Rect<int32_t>> diff(const DisplayList& previous, size_t maxRectCount = 8) const;
+
+	/**
+	 * Draw commands that cover region, clipped to it. Matrix and clip of canvas are kept.
+	 * @param[in] region device pixels to draw.
+	 */
+	void replay(Canvas& canvas, const Rect<int32_t>& region) const;
+
+	/**
+	 * Diff against the previous frame, and replay within dirty rectangles.
+	 * @param[in] previous list of the last frame, or nullptr to draw the whole canvas.
+	 * @return dirty rectangles drawn.
+	 */
+	std::vector<Rect<int32_t>> replay(Canvas& canvas, const DisplayList* previous) const;
+};
+
+inline size_t DisplayList::getCommandCount() const { return commands.size(); }
+
+}  // namespace pea
+#endif  // PEA_GRAPHICS_DISPLAY_LIST_H_
@@ -0,0 +1,596 @@
+#include "graphics/DistanceField.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+#include "pea/config.h"
+#if OpenMP_CXX_FOUND
+#include <omp.h>
+#endif
+
+#include "graphics/Image_PNG.h"
+
+using namespace pea;
+
+namespace {
+
+// channels an edge contributes to, as bits of R, G and B.
+enum EdgeColor: uint8_t
+{
+	BLACK   = 0,
+	RED     = 1,
+	GREEN   = 2,
+	YELLOW  = 3,
+	BLUE    = 4,
+	MAGENTA = 5,
+	CYAN    = 6,
+	WHITE   = 7,
+};
+
+/**
+ * Bezier curve of the outline between two points of a contour, lines are of degree 1.
+ */
+struct Edge
+{
+	vec2f points[4];
+	uint32_t degree;
+	uint8_t color;
+};
+
+/**
+ * Line segment of a flattened edge, edge ends are extended in pseudo-distances.
+ */
+struct Segment
+{
+	vec2f a, b;
+	vec2f min, max;  ///< bounding box
+	uint8_t color;
+	bool first;      ///< a is the start of its edge
+	bool last;       ///< b is the end of its edge
+};
+
+struct Candidate
+{
+	float distance;
+	float dot;       ///< |cos| between the segment and the direction to the point, 0 for points in the middle
+	float t;         ///< unclamped parameter of the nearest point
+	const Segment* segment;
+};
+
+struct Crossing
+{
+	float x;
+	int32_t winding;
+};
+
+// edges meeting at a larger angle than (PI - 3) are apart by a corner, same as msdfgen.
+static const float CROSS_THRESHOLD = std::sin(3.0F);
+static constexpr float FLATTEN_TOLERANCE = 1.0F / 32;
+static constexpr uint32_t MAXIMUM_SEGMENT_COUNT = 64;
+
+}  // namespace
+
+static vec2f getPosition(const Edge& edge, float t)
+{
+	// de Casteljau
+	vec2f points[4];
+	std::copy(edge.points, edge.points + edge.degree + 1, points);
+	for(uint32_t n = edge.degree; n > 0; --n)
+		for(uint32_t i = 0; i < n; ++i)
+			points[i] = points[i] + (points[i + 1] - points[i]) * t;
+	return points[0];
+}
+
+static void split(const Edge& edge, Edge& first, Edge& second)
+{
+	// de Casteljau at t = 0.5, control points of halves are the sides of the triangle.
+	vec2f points[4];
+	std::copy(edge.points, edge.points + edge.degree + 1, points);
+	first = second = edge;
+	first.points[0] = points[0];
+	second.points[edge.degree] = points[edge.degree];
+	for(uint32_t n = edge.degree; n > 0; --n)
+	{
+		for(uint32_t i = 0; i < n; ++i)
+			points[i] = (points[i] + points[i + 1]) * 0.5F;
+		first.points[edge.degree - n + 1] = points[0];
+		second.points[n - 1] = points[n - 1];
+	}
+}
+
+/**
+ * @return direction of the edge at its start or end, zero for degenerate edges.
+ */
+static vec2f getDirection(const Edge& edge, bool end)
+{
+	const vec2f* p = edge.points;
+	const uint32_t n = edge.degree;
+	for(uint32_t i = 1; i <= n; ++i)
+	{
+		vec2f direction = end? p[n] - p[n - i]: p[i] - p[0];
+		if(direction.x != 0 || direction.y != 0)
+			return direction.normalize();
+	}
+	return vec2f(0, 0);
+}
+
+static uint8_t switchColor(uint8_t color, uint8_t banned = BLACK)
+{
+	const uint8_t combined = color & banned;
+	if(combined == RED || combined == GREEN || combined == BLUE)
+		return combined ^ WHITE;
+	// CYAN -> MAGENTA -> YELLOW -> CYAN
+	return ((color << 1) | (color >> 2)) & WHITE;
+}
+
+/**
+ * Color edges of a closed contour so that edges meeting at a corner share only one channel, and
+ * the median of channels keeps the corner sharp.
+ */
+static void colorEdges(std::vector<Edge>& edges)
+{
+	std::vector<size_t> corners;
+	for(size_t i = 0; i < edges.size(); ++i)
+	{
+		vec2f a = getDirection(edges[(i + edges.size() - 1) % edges.size()], true);
+		vec2f b = getDirection(edges[i], false);
+		if(dot(a, b) <= 0 || std::abs(cross(a, b)) > CROSS_THRESHOLD)
+			corners.push_back(i);
+	}
+
+	if(corners.empty())  // smooth contour
+	{
+		for(Edge& edge: edges)
+			edge.color = WHITE;
+	}
+	else if(corners.size() == 1)  // teardrop, the corner is split in three colors
+	{
+		std::rotate(edges.begin(), edges.begin() + corners[0], edges.end());
+		while(edges.size() < 3)
+		{
+			std::vector<Edge> halves(edges.size() * 2);
+			for(size_t i = 0; i < edges.size(); ++i)
+				split(edges[i], halves[2 * i], halves[2 * i + 1]);
+			edges.swap(halves);
+		}
+
+		const uint8_t colors[3] = { MAGENTA, WHITE, YELLOW };
+		for(size_t i = 0; i < edges.size(); ++i)
+			edges[i].color = colors[3 * i / edges.size()];
+	}
+	else
+	{
+		// splines between corners take turns, the last one differs from the first one too.
+		size_t spline = 0;
+		uint8_t color = CYAN;
+		const uint8_t initialColor = color;
+		for(size_t i = 0; i < edges.size(); ++i)
+		{
+			const size_t index = (corners[0] + i) % edges.size();
+			if(spline + 1 < corners.size() && corners[spline + 1] == index)
+			{
+				++spline;
+				color = switchColor(color, spline == corners.size() - 1? initialColor: static_cast<uint8_t>(BLACK));
+			}
+			edges[index].color = color;
+		}
+	}
+}
+
+/**
+ * @return closed contours of edges, open contours are closed with lines.
+ */
+static std::vector<std::vector<Edge>> getContours(const Path& path)
+{
+	using Verb = Path::Verb;
+	const std::vector<vec2f>& points = path.getPoints();
+	std::vector<std::vector<Edge>> contours;
+	vec2f start(0, 0), last(0, 0);
+	size_t index = 0;
+	bool open = false;  // a contour takes edges
+	auto add = [&contours, &open](const Edge& edge)
+	{
+		// drawing on after close starts a new contour from the same point.
+		if(!open)
+			contours.emplace_back();
+		open = true;
+		contours.back().push_back(edge);
+	};
+	auto close = [&]()
+	{
+		if(open && last != start)
+			contours.back().push_back(Edge{{last, start}, 1, WHITE});
+		open = false;
+		last = start;
+	};
+
+	for(Verb verb: path.getVerbs())
+	{
+		switch(verb)
+		{
+		case Verb::MOVE:
+			close();
+			start = last = points[index++];
+			break;
+
+		case Verb::LINE:
+			add(Edge{{last, points[index]}, 1, WHITE});
+			last = points[index++];
+			break;
+
+		case Verb::QUAD:
+			add(Edge{{last, points[index], points[index + 1]}, 2, WHITE});
+			last = points[index + 1];
+			index += 2;
+			break;
+
+		case Verb::CUBIC:
+			add(Edge{{last, points[index], points[index + 1], points[index + 2]}, 3, WHITE});
+			last = points[index + 2];
+			index += 3;
+			break;
+
+		case Verb::ARC:
+		{
+			// cubic curves of a quarter circle at most, with control arms of 4/3 * tan(theta / 4).
+			const vec2f& center = points[index];
+			const float angle = points[index + 1].x;
+			const uint32_t count = std::max(static_cast<uint32_t>(std::ceil(std::abs(angle) / M_PI_2)), 1U);
+			const float theta = angle / count, k = 4.0F / 3.0F * std::tan(theta / 4);
+			const float cos_a = std::cos(theta), sin_a = std::sin(theta);
+			vec2f from = last - center;
+			for(uint32_t i = 0; i < count; ++i)
+			{
+				vec2f to(from.x * cos_a - from.y * sin_a, from.x * sin_a + from.y * cos_a);
+				add(Edge{{center + from, center + from + k * vec2f(-from.y, from.x),
+						center + to - k * vec2f(-to.y, to.x), center + to}, 3, WHITE});
+				from = to;
+			}
+			last = center + from;
+			index += 2;
+			break;
+		}
+
+		case Verb::CLOSE:
+			close();
+			break;
+
+		default:
+			break;
+		}
+	}
+	close();
+	return contours;
+}
+
+static void flatten(const Edge& edge, std::vector<Segment>& segments)
+{
+	// Wang's formula, the same as Path does.
+	const vec2f* p = edge.points;
+	uint32_t count = 1;
+	if(edge.degree > 1)
+	{
+		float M = (p[0] - 2.0F * p[1] + p[2]).length();
+		if(edge.degree == 3)
+			M = std::max(M, (p[1] - 2.0F * p[2] + p[3]).length());
+		const float factor = edge.degree == 2? 0.25F: 0.75F;
+		count = static_cast<uint32_t>(std::ceil(std::sqrt(factor * M / FLATTEN_TOLERANCE)));
+		count = std::clamp(count, 1U, MAXIMUM_SEGMENT_COUNT);
+	}
+
+	const size_t begin = segments.size();
+	vec2f a = p[0];
+	for(uint32_t i = 1; i <= count; ++i)
+	{
+		vec2f b = i == count? p[edge.degree]: getPosition(edge, static_cast<float>(i) / count);
+		if(b == a)
+			continue;
+
+		Segment segment;
+		segment.a = a;
+		segment.b = b;
+		segment.min = vec2f(std::min(a.x, b.x), std::min(a.y, b.y));
+		segment.max = vec2f(std::max(a.x, b.x), std::max(a.y, b.y));
+		segment.color = edge.color;
+		segment.first = segments.size() == begin;
+		segment.last = false;
+		segments.push_back(segment);
+		a = b;
+	}
+	if(segments.size() > begin)
+		segments.back().last = true;
+}
+
+static void evaluate(const Segment& segment, const vec2f& p, Candidate& candidate)
+{
+	const vec2f ab = segment.b - segment.a;
+	const float t = dot(p - segment.a, ab) / ab.length2();
+	const vec2f q = segment.a + ab * std::clamp(t, 0.0F, 1.0F);
+	const vec2f qp = p - q;
+	candidate.distance = qp.length();
+	candidate.dot = (t > 0 && t < 1) || candidate.distance == 0? 0:
+			std::abs(dot(ab, qp)) / (ab.length() * candidate.distance);
+	candidate.t = t;
+	candidate.segment = &segment;
+}
+
+static bool isCloser(const Candidate& a, const Candidate& b)
+{
+	// of points equally far away, the one seeing the segment more perpendicularly decides the side.
+	return a.distance < b.distance || (a.distance == b.distance && a.dot < b.dot);
+}
+
+/**
+ * @return distance to the segment of candidate, extended past edge ends, positive inside.
+ */
+static float getPseudoDistance(const Candidate& candidate, const vec2f& p, float orientation)
+{
+	const Segment& segment = *candidate.segment;
+	const vec2f ab = segment.b - segment.a;
+	const float side = cross(ab, p - segment.a) * orientation;
+	float distance = candidate.distance;
+	if((segment.first && candidate.t < 0) || (segment.last && candidate.t > 1))
+		distance = std::min(distance, std::abs(side) / ab.length());
+	return side >= 0? distance: -distance;
+}
+
+static uint8_t encode(float distance, float range)
+{
+	float value = (distance / range + 0.5F) * 255.0F + 0.5F;
+	return static_cast<uint8_t>(std::clamp(value, 0.0F, 255.0F));
+}
+
+/**
+ * Winding numbers of pixel centers of a row, by crossings of segments with the scanline.
+ */
+static void getWindings(const std::vector<Segment>& segments, float y, uint32_t width,
+		std::vector<Crossing>& crossings, int32_t* windings)
+{
+	crossings.clear();
+	for(const Segment& segment: segments)
+	{
+		const vec2f& a = segment.a;
+		const vec2f& b = segment.b;
+		if((a.y <= y) == (b.y <= y))
+			continue;
+		float x = a.x + (y - a.y) * (b.x - a.x) / (b.y - a.y);
+		crossings.push_back(Crossing{x, a.y < b.y? 1: -1});
+	}
+	std::sort(crossings.begin(), crossings.end(), [](const Crossing& a, const Crossing& b) { return a.x < b.x; });
+
+	int32_t winding = 0;
+	size_t i = 0;
+	for(uint32_t x = 0; x < width; ++x)
+	{
+		const float center = x + 0.5F;
+		for(; i < crossings.size() && crossings[i].x < center; ++i)
+			winding += crossings[i].winding;
+		windings[x] = winding;
+	}
+}
+
+void DistanceField::generate(const Path& path, Method method, float range, uint32_t width, uint32_t height, uint8_t* field)
+{
+	assert(range > 0 && field != nullptr);
+	std::vector<std::vector<Edge>> contours = getContours(path);
+	std::vector<Segment> segments;
+	for(std::vector<Edge>& edges: contours)
+	{
+		if(method == Method::MULTICHANNEL)
+			colorEdges(edges);
+		for(const Edge& edge: edges)
+			flatten(edge, segments);
+	}
+
+	// inside is on the left of segments if the outline goes counterclockwise as a whole.
+	float area = 0;
+	for(const Segment& segment: segments)
+		area += cross(segment.a, segment.b);
+	const float orientation = area >= 0? 1.0F: -1.0F;
+
+	std::vector<Crossing> crossings;
+	std::vector<int32_t> windings(width);
+	if(method == Method::SSEDT)
+	{
+		std::vector<uint8_t> coverage(static_cast<size_t>(width) * height);
+		for(uint32_t y = 0; y < height; ++y)
+		{
+			getWindings(segments, y + 0.5F, width, crossings, windings.data());
+			for(uint32_t x = 0; x < width; ++x)
+				coverage[y * width + x] = windings[x] != 0? 255: 0;
+		}
+		transform(coverage.data(), width, height, range, field);
+		return;
+	}
+
+	const uint32_t channelCount = getChannelCount(method);
+	constexpr float INF = std::numeric_limits<float>::infinity();
+	for(uint32_t y = 0; y < height; ++y)
+	{
+		getWindings(segments, y + 0.5F, width, crossings, windings.data());
+		for(uint32_t x = 0; x < width; ++x)
+		{
+			const vec2f p(x + 0.5F, y + 0.5F);
+			Candidate nearest{INF, 0, 0, nullptr};
+			Candidate channels[3] = {nearest, nearest, nearest};
+			for(const Segment& segment: segments)
+			{
+				// skip segments whose bounding box is farther than every candidate they could replace.
+				float dx = std::max({segment.min.x - p.x, p.x - segment.max.x, 0.0F});
+				float dy = std::max({segment.min.y - p.y, p.y - segment.max.y, 0.0F});
+				float bound = nearest.distance;
+				if(method == Method::MULTICHANNEL)
+					for(uint32_t c = 0; c < 3; ++c)
+						if(segment.color & (1 << c))
+							bound = std::max(bound, channels[c].distance);
+				if(dx * dx + dy * dy > bound * bound)
+					continue;
+
+				Candidate candidate;
+				evaluate(segment, p, candidate);
+				if(candidate.distance < nearest.distance)
+					nearest = candidate;
+				if(method == Method::MULTICHANNEL)
+					for(uint32_t c = 0; c < 3; ++c)
+						if((segment.color & (1 << c)) && isCloser(candidate, channels[c]))
+							channels[c] = candidate;
+			}
+
+			// the sign comes from the fill rule, which holds for overlapping contours too.
+			const float distance = windings[x] != 0? nearest.distance: -nearest.distance;
+			uint8_t* pixel = field + (static_cast<size_t>(y) * width + x) * channelCount;
+			if(method == Method::EXACT)
+			{
+				pixel[0] = encode(distance, range);
+				continue;
+			}
+
+			float values[3];
+			for(uint32_t c = 0; c < 3; ++c)
+				values[c] = channels[c].segment? getPseudoDistance(channels[c], p, orientation): distance;
+			float median = std::max(std::min(values[0], values[1]), std::min(std::max(values[0], values[1]), values[2]));
+			// channels clash where edges of other contours are near, fall back to the true distance.
+			if((median >= 0) != (distance >= 0))
+				values[0] = values[1] = values[2] = distance;
+			for(uint32_t c = 0; c < 3; ++c)
+				pixel[c] = encode(values[c], range);
+		}
+	}
+}
+
+namespace {
+
+/**
+ * Offset from a pixel to its nearest seed pixel.
+ */
+struct Offset
+{
+	int32_t dx, dy;
+
+	int32_t length2() const { return dx * dx + dy * dy; }
+};
+
+}  // namespace
+
+static void compare(std::vector<Offset>& grid, int32_t width, int32_t height, const Offset& border,
+		Offset& offset, int32_t x, int32_t y, int32_t ox, int32_t oy)
+{
+	x += ox;
+	y += oy;
+	Offset other = (0 <= x && x < width && 0 <= y && y < height)? grid[y * width + x]: border;
+	other.dx += ox;
+	other.dy += oy;
+	if(other.length2() < offset.length2())
+		offset = other;
+}
+
+/**
+ * 8SSEDT, two passes of 8 neighbours, each scans rows forward and backward.
+ */
+static void propagate(std::vector<Offset>& grid, int32_t width, int32_t height, const Offset& border)
+{
+	for(int32_t y = 0; y < height; ++y)
+	{
+		for(int32_t x = 0; x < width; ++x)
+		{
+			Offset& offset = grid[y * width + x];
+			compare(grid, width, height, border, offset, x, y, -1,  0);
+			compare(grid, width, height, border, offset, x, y,  0, -1);
+			compare(grid, width, height, border, offset, x, y, -1, -1);
+			compare(grid, width, height, border, offset, x, y,  1, -1);
+		}
+		for(int32_t x = width - 1; x >= 0; --x)
+			compare(grid, width, height, border, grid[y * width + x], x, y, 1, 0);
+	}
+
+	for(int32_t y = height - 1; y >= 0; --y)
+	{
+		for(int32_t x = width - 1; x >= 0; --x)
+		{
+			Offset& offset = grid[y * width + x];
+			compare(grid, width, height, border, offset, x, y,  1,  0);
+			compare(grid, width, height, border, offset, x, y,  0,  1);
+			compare(grid, width, height, border, offset, x, y, -1,  1);
+			compare(grid, width, height, border, offset, x, y,  1,  1);
+		}
+		for(int32_t x = 0; x < width; ++x)
+			compare(grid, width, height, border, grid[y * width + x], x, y, -1, 0);
+	}
+}
+
+void DistanceField::transform(const uint8_t* coverage, uint32_t width, uint32_t height, float range, uint8_t* field)
+{
+	assert(coverage != nullptr && field != nullptr && range > 0);
+	const size_t size = static_cast<size_t>(width) * height;
+	constexpr Offset ZERO{0, 0}, FAR{1 << 14, 1 << 14};
+
+	// offsets to the nearest inside pixel, and to the nearest outside pixel, beyond borders is outside.
+	std::vector<Offset> inside(size), outside(size);
+	for(size_t i = 0; i < size; ++i)
+	{
+		const bool in = coverage[i] >= 128;
+		inside[i] = in? ZERO: FAR;
+		outside[i] = in? FAR: ZERO;
+	}
+	propagate(inside, width, height, FAR);
+	propagate(outside, width, height, ZERO);
+
+	// the outline lies half way between pixel centers of both sides.
+	for(size_t i = 0; i < size; ++i)
+	{
+		float distance = coverage[i] >= 128?
+				std::sqrt(static_cast<float>(outside[i].length2())) - 0.5F:
+				0.5F - std::sqrt(static_cast<float>(inside[i].length2()));
+		field[i] = encode(distance, range);
+	}
+}
+
+std::vector<DistanceField::Glyph> DistanceField::generate(Typeface& typeface, const std::vector<char32_t>& codepoints,
+		float size, float range, Method method)
+{
+	const Color::Format format = method == Method::MULTICHANNEL? Color::Format::C3_U8: Color::Format::C1_U8;
+	const int32_t padding = static_cast<int32_t>(std::ceil(range / 2));
+
+	// FreeType faces aren't shared across threads, outlines are read here.
+	std::vector<Glyph> glyphs(codepoints.size());
+	std::vector<Path> paths(codepoints.size());
+	for(size_t i = 0; i < codepoints.size(); ++i)
+	{
+		Glyph& glyph = glyphs[i];
+		glyph.codepoint = codepoints[i];
+		glyph.bearing = vec2i(0, 0);
+		Path outline;
+		glyph.advance = typeface.getGlyphPath(codepoints[i], size, 1.0F, vec2f(0, 0), outline);
+		std::vector<std::vector<Edge>> contours = getContours(outline);
+		if(contours.empty())
+			continue;
+
+		// control points bound the curves.
+		vec2f min = contours[0][0].points[0], max = min;
+		for(const std::vector<Edge>& edges: contours)
+			for(const Edge& edge: edges)
+				for(uint32_t j = 0; j <= edge.degree; ++j)
+				{
+					const vec2f& point = edge.points[j];
+					min = vec2f(std::min(min.x, point.x), std::min(min.y, point.y));
+					max = vec2f(std::max(max.x, point.x), std::max(max.y, point.y));
+				}
+		const vec2i origin(padding - static_cast<int32_t>(std::floor(min.x)), padding - static_cast<int32_t>(std::floor(min.y)));
+		const uint32_t width  = static_cast<int32_t>(std::ceil(max.x)) + origin.x + padding;
+		const uint32_t height = static_cast<int32_t>(std::ceil(max.y)) + origin.y + padding;
+		typeface.getGlyphPath(codepoints[i], size, 1.0F, vec2f(origin.x, origin.y), paths[i]);
+		glyph.bearing = vec2i(-origin.x, origin.y);  // y axis of outlines goes down
+		glyph.image.reset(new Image_PNG(width, height, format));
+	}
+
+	#pragma omp parallel for schedule(dynamic)
+	for(int64_t i = 0; i < static_cast<int64_t>(glyphs.size()); ++i)
+	{
+		Image* image = glyphs[i].image.get();
+		if(image)
+			generate(paths[i], method, range, image->getWidth(), image->getHeight(), image->getData());
+	}
+	return glyphs;
+}
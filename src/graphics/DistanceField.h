@@ -0,0 +1,91 @@
+#ifndef PEA_GRAPHICS_DISTANCE_FIELD_H_
+#define PEA_GRAPHICS_DISTANCE_FIELD_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "graphics/Image.h"
+#include "graphics/Path.h"
+#include "graphics/Typeface.h"
+#include "math/vec2.h"
+
+namespace pea {
+
+/**
+ * @class DistanceField
+ * Signed distance fields of shapes, for glyphs and icons that are drawn crisp at any scale from one
+ * small texture. A field stores the distance of each pixel center to the outline, positive inside,
+ * encoded as 0.5 + distance / range in [0, 1], so the outline is where the field crosses 0.5.
+ *
+ * Multichannel fields (MSDF) color edges of the outline apart at corners, each channel keeps the
+ * distance to edges of its color. The median of three channels restores sharp corners that a
+ * single channel rounds off.
+ *
+ * Fields of glyphs are generated in parallel, outlines are read from FreeType on the calling thread.
+ *
+ * @code
+ *   std::vector<DistanceField::Glyph> glyphs = DistanceField::generate(typeface, codepoints, 32, 4,
+ *           DistanceField::Method::MULTICHANNEL);
+ *   atlasPacker.pack(images of glyphs, regions);  // then draw with ShaderFactory::FRAG_TEXTURE_FONT_SDF
+ * @endcode
+ */
+class DistanceField
+{
+public:
+	enum class Method: uint8_t
+	{
+		EXACT,         ///< distance to the outline, one channel.
+		SSEDT,         ///< 8-point sequential Euclidean distance transform of the shape sampled at pixel centers, one channel.
+		MULTICHANNEL,  ///< pseudo-distances to edges of three colors, three channels.
+	};
+
+	struct Glyph
+	{
+		char32_t codepoint;
+		float advance;                 ///< horizontal advance in pixels
+		vec2i bearing;                 ///< offset from origin to left, and from baseline up to top of image
+		std::unique_ptr<Image> image;  ///< C1_U8 or C3_U8 field, nullptr for blank glyphs like space
+	};
+
+public:
+	/**
+	 * @return 3 for MULTICHANNEL, or 1.
+	 */
+	static uint32_t getChannelCount(Method method);
+
+	/**
+	 * Generate a field of path, which is filled with the nonzero rule.
+	 * @param[in]  path   shape in pixel coordinates of the field, rows go top down.
+	 * @param[in]  method algorithm of distances.
+	 * @param[in]  range  distance in pixels between field values 0 and 1.
+	 * @param[out] field  width * height * getChannelCount(method) bytes.
+	 */
+	static void generate(const Path& path, Method method, float range, uint32_t width, uint32_t height, uint8_t* field);
+
+	/**
+	 * 8SSEDT of a coverage bitmap, e.g. icons rasterized at a larger size, pixels not less than 128
+	 * are inside.
+	 * @param[in]  coverage width * height bytes.
+	 * @param[in]  range    distance in pixels between field values 0 and 1.
+	 * @param[out] field    width * height bytes.
+	 */
+	static void transform(const uint8_t* coverage, uint32_t width, uint32_t height, float range, uint8_t* field);
+
+	/**
+	 * Generate fields of glyphs from their unhinted outlines, glyphs are generated in parallel.
+	 * @param[in] size  text size in pixels the fields are sampled at.
+	 * @param[in] range distance in pixels between field values 0 and 1, a field is padded by half of
+	 *                  it on each side.
+	 */
+	static std::vector<Glyph> generate(Typeface& typeface, const std::vector<char32_t>& codepoints,
+			float size, float range, Method method);
+};
+
+inline uint32_t DistanceField::getChannelCount(Method method)
+{
+	return method == Method::MULTICHANNEL? 3: 1;
+}
+
+}  // namespace pea
+#endif  // PEA_GRAPHICS_DISTANCE_FIELD_H_
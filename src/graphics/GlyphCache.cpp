@@ -0,0 +1,392 @@
+#include "graphics/GlyphCache.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "util/Log.h"
+
+using namespace pea;
+
+static const char* TAG = "GlyphCache";
+
+// empty column and row on the right and bottom of a glyph, so that linear filtering doesn't sample
+// its neighbours.
+static constexpr int32_t PADDING = 1;
+
+// shelf heights are rounded up to a multiple of it, so that glyphs of close sizes share shelves.
+static constexpr int32_t SHELF_GRANULARITY = 4;
+
+GlyphCache::Page::Page(uint32_t size):
+		image(size, size, Color::C1_U8),
+		bottom(0)
+{
+	std::memset(image.getData(), 0, size * size);
+}
+
+GlyphCache::Key GlyphCache::makeKey(char32_t codepoint, uint32_t size, Typeface::Style style)
+{
+	assert(size < (1U << 16));
+	return static_cast<Key>(codepoint) | static_cast<Key>(size) << 32 | static_cast<Key>(style) << 48;
+}
+
+GlyphCache::GlyphCache(const std::string& fontPath, uint32_t pageSize/* = 1024 */, uint32_t maxPageCount/* = 4 */):
+		pageSize(pageSize),
+		maxPageCount(std::max(maxPageCount, 1U)),
+		frame(0),
+		statistics{0, 0, 0, 0},
+		metrics(Typeface::createFromFile(fontPath)),
+		rasterizer(Typeface::createFromFile(fontPath)),
+		busy(0),
+		stop(false)
+{
+	assert(pageSize > 0);
+	if(!isValid())
+	{
+		slog.e(TAG, "failed to read font %s", fontPath.c_str());
+		return;
+	}
+
+	worker = std::thread(&GlyphCache::rasterize, this);
+}
+
+GlyphCache::~GlyphCache()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	condition.notify_all();
+	if(worker.joinable())
+		worker.join();
+}
+
+void GlyphCache::rasterize()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while(true)
+	{
+		condition.wait(lock, [this] { return stop || !requests.empty(); });
+		if(stop)
+			return;
+
+		Result result;
+		result.key = requests.front();
+		requests.pop_front();
+		++busy;
+		lock.unlock();
+
+		char32_t codepoint = static_cast<char32_t>(result.key & 0xFFFFFFFF);
+		uint32_t size = static_cast<uint32_t>(result.key >> 32) & 0xFFFF;
+		Typeface::Style style = static_cast<Typeface::Style>(result.key >> 48);
+		result.success = rasterizer->getGlyphBitmap(codepoint, size, style, result.bitmap);
+
+		lock.lock();
+		results.push_back(std::move(result));
+		--busy;
+		condition.notify_all();  // for finish()
+	}
+}
+
+const GlyphCache::Glyph* GlyphCache::find(char32_t codepoint, uint32_t size, Typeface::Style style)
+{
+	if(!isValid())
+		return nullptr;
+
+	const Key key = makeKey(codepoint, size, style);
+	auto it = entries.find(key);
+	if(it == entries.end())
+	{
+		Entry& entry = entries[key];
+		entry.state = State::PENDING;
+		entry.shelf = -1;
+		entry.frame = frame;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			requests.push_back(key);
+		}
+		condition.notify_all();
+		++statistics.misses;
+		return nullptr;
+	}
+
+	Entry& entry = it->second;
+	entry.frame = frame;
+	if(entry.state == State::PENDING)
+		return nullptr;
+
+	++statistics.hits;
+	if(entry.shelf >= 0)
+		lru.splice(lru.begin(), lru, entry.lru);
+	return &entry;
+}
+
+void GlyphCache::touch(const Glyph* glyph)
+{
+	// glyphs returned are all entries.
+	Entry& entry = *static_cast<Entry*>(const_cast<Glyph*>(glyph));
+	entry.frame = frame;
+	++statistics.hits;
+	if(entry.shelf >= 0)
+		lru.splice(lru.begin(), lru, entry.lru);
+}
+
+float GlyphCache::getAdvance(char32_t codepoint, uint32_t size)
+{
+	if(!isValid())
+		return 0;
+
+	const Key key = makeKey(codepoint, size, Typeface::NORMAL);
+	auto it = advances.find(key);
+	if(it != advances.end())
+		return it->second;
+
+	float advance = metrics->getAdvance(codepoint, static_cast<float>(size));
+	advances.emplace(key, advance);
+	return advance;
+}
+
+float GlyphCache::getKerning(char32_t left, char32_t right, uint32_t size) const
+{
+	return isValid()? metrics->getKerning(left, right, static_cast<float>(size)): 0;
+}
+
+void GlyphCache::update(bool nextFrame/* = true */)
+{
+	std::vector<Result> ready;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		ready.swap(results);
+	}
+	insert(ready);
+	if(nextFrame)
+		++frame;
+}
+
+void GlyphCache::finish()
+{
+	std::vector<Result> ready;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		condition.wait(lock, [this] { return requests.empty() && busy == 0; });
+		ready.swap(results);
+	}
+	insert(ready);
+}
+
+void GlyphCache::insert(std::vector<Result>& results)
+{
+	size_t failureCount = 0;
+	for(Result& result: results)
+	{
+		auto it = entries.find(result.key);
+		assert(it != entries.end() && it->second.state == State::PENDING);
+		Entry& entry = it->second;
+		const Typeface::Bitmap& bitmap = result.bitmap;
+		Glyph& glyph = entry;
+		glyph.page = 0;
+		glyph.rect.setEmpty();
+		glyph.bearing = vec2i(bitmap.left, bitmap.top);
+		glyph.advance = bitmap.advance;
+		entry.state = State::READY;
+		if(!result.success || bitmap.width == 0 || bitmap.height == 0)
+		{
+			if(!result.success)
+				slog.w(TAG, "failed to render glyph U+%04X", static_cast<uint32_t>(result.key & 0xFFFFFFFF));
+			continue;  // blank
+		}
+
+		if(bitmap.width + PADDING > pageSize || bitmap.height + PADDING > pageSize)
+		{
+			slog.w(TAG, "glyph U+%04X of %ux%u is larger than page", static_cast<uint32_t>(result.key & 0xFFFFFFFF),
+					bitmap.width, bitmap.height);
+			continue;
+		}
+
+		bool placed = allocate(bitmap.width, bitmap.height, glyph.page, entry.shelf, glyph.rect);
+		while(!placed && evict())
+			placed = allocate(bitmap.width, bitmap.height, glyph.page, entry.shelf, glyph.rect);
+		if(!placed)
+		{
+			// every page is full of glyphs in use, try it again when it's used next time.
+			++failureCount;
+			entries.erase(it);
+			continue;
+		}
+
+		copy(bitmap, glyph.page, glyph.rect);
+		lru.push_front(result.key);
+		entry.lru = lru.begin();
+	}
+
+	if(failureCount > 0)
+		slog.w(TAG, "%zu glyphs are dropped since pages are full of glyphs in use", failureCount);
+	statistics.failures += failureCount;
+}
+
+bool GlyphCache::allocate(uint32_t width, uint32_t height, uint32_t& page, int32_t& shelf, Rect<int32_t>& rect)
+{
+	for(page = 0; page < pages.size(); ++page)
+		if(allocateOnPage(page, width, height, shelf, rect))
+			return true;
+
+	if(pages.size() >= maxPageCount)
+		return false;
+
+	pages.push_back(std::make_unique<Page>(pageSize));
+	page = static_cast<uint32_t>(pages.size() - 1);
+	return allocateOnPage(page, width, height, shelf, rect);
+}
+
+bool GlyphCache::allocateOnPage(uint32_t page, uint32_t width, uint32_t height, int32_t& shelf, Rect<int32_t>& rect)
+{
+	Page& p = *pages[page];
+	const int32_t cellWidth = static_cast<int32_t>(width) + PADDING;
+	const int32_t cellHeight = static_cast<int32_t>(height) + PADDING;
+	const int32_t bucket = (cellHeight + SHELF_GRANULARITY - 1) / SHELF_GRANULARITY * SHELF_GRANULARITY;
+	const int32_t size = static_cast<int32_t>(pageSize);
+
+	auto place = [&](int32_t index, int32_t x)
+	{
+		const Shelf& s = p.shelves[index];
+		shelf = index;
+		rect = Rect<int32_t>(x, s.y, x + static_cast<int32_t>(width), s.y + static_cast<int32_t>(height));
+		return true;
+	};
+
+	// first fit in holes of shelves of the same height, then at their ends.
+	const int32_t shelfCount = static_cast<int32_t>(p.shelves.size());
+	for(int32_t i = 0; i < shelfCount; ++i)
+	{
+		Shelf& s = p.shelves[i];
+		if(s.bucket != bucket)
+			continue;
+
+		for(auto hole = s.holes.begin(); hole != s.holes.end(); ++hole)
+			if(hole->width >= cellWidth)
+			{
+				int32_t x = hole->x;
+				hole->x += cellWidth;
+				hole->width -= cellWidth;
+				if(hole->width == 0)
+					s.holes.erase(hole);
+				return place(i, x);
+			}
+
+		if(size - s.end >= cellWidth)
+		{
+			int32_t x = s.end;
+			s.end += cellWidth;
+			return place(i, x);
+		}
+	}
+
+	// empty shelves take glyphs of another height, as long as they're not higher.
+	for(int32_t i = 0; i < shelfCount; ++i)
+	{
+		Shelf& s = p.shelves[i];
+		if(s.end == 0 && s.height >= bucket && cellWidth <= size)
+		{
+			s.bucket = bucket;
+			s.end = cellWidth;
+			return place(i, 0);
+		}
+	}
+
+	if(size - p.bottom >= bucket && cellWidth <= size)
+	{
+		p.shelves.push_back(Shelf{p.bottom, bucket, bucket, cellWidth, {}});
+		p.bottom += bucket;
+		return place(shelfCount, 0);
+	}
+
+	return false;
+}
+
+void GlyphCache::release(uint32_t page, int32_t shelf, const Rect<int32_t>& rect)
+{
+	Page& p = *pages[page];
+	Shelf& s = p.shelves[shelf];
+	Span span{rect.left, rect.getWidth() + PADDING};
+
+	// merge with the holes next to it, or give it back to the end of shelf.
+	auto next = std::lower_bound(s.holes.begin(), s.holes.end(), span.x,
+			[](const Span& hole, int32_t x) { return hole.x < x; });
+	if(next != s.holes.end() && span.x + span.width == next->x)
+	{
+		span.width += next->width;
+		next = s.holes.erase(next);
+	}
+	if(next != s.holes.begin() && (next - 1)->x + (next - 1)->width == span.x)
+	{
+		--next;
+		span.x = next->x;
+		span.width += next->width;
+		next = s.holes.erase(next);
+	}
+
+	if(span.x + span.width == s.end)
+		s.end = span.x;
+	else
+		s.holes.insert(next, span);
+
+	// drop empty shelves at the bottom of page, so that their room takes any height.
+	while(!p.shelves.empty() && p.shelves.back().end == 0)
+	{
+		p.bottom = p.shelves.back().y;
+		p.shelves.pop_back();
+	}
+}
+
+bool GlyphCache::evict()
+{
+	if(lru.empty())
+		return false;
+
+	const Key key = lru.back();
+	auto it = entries.find(key);
+	assert(it != entries.end());
+	const Entry& entry = it->second;
+	if(entry.frame >= frame)
+		return false;  // the least recently used one is in use, so are all others.
+
+	release(entry.page, entry.shelf, entry.rect);
+	lru.pop_back();
+	entries.erase(it);
+	++statistics.evictions;
+	return true;
+}
+
+void GlyphCache::copy(const Typeface::Bitmap& bitmap, uint32_t page, const Rect<int32_t>& rect)
+{
+	Page& p = *pages[page];
+	const int32_t size = static_cast<int32_t>(pageSize);
+	Rect<int32_t> cell(rect.left, rect.top, std::min(rect.right + PADDING, size), std::min(rect.bottom + PADDING, size));
+
+	// clear the padding left by an evicted glyph, then copy rows.
+	uint8_t* pixels = p.image.getData();
+	for(int32_t y = cell.top; y < cell.bottom; ++y)
+		std::memset(pixels + y * size + cell.left, 0, cell.getWidth());
+	for(uint32_t r = 0; r < bitmap.height; ++r)
+		std::memcpy(pixels + (rect.top + r) * size + rect.left, bitmap.pixels.data() + r * bitmap.width, bitmap.width);
+
+	// glyphs placed one after another in a shelf make one rectangle to upload.
+	std::vector<Rect<int32_t>>& dirtyRects = p.dirtyRects;
+	if(!dirtyRects.empty())
+	{
+		Rect<int32_t>& last = dirtyRects.back();
+		if(last.top == cell.top && last.bottom == cell.bottom && last.right == cell.left)
+		{
+			last.right = cell.right;
+			return;
+		}
+	}
+	dirtyRects.push_back(cell);
+}
+
+std::vector<Rect<int32_t>> GlyphCache::takeDirtyRects(uint32_t page)
+{
+	std::vector<Rect<int32_t>> dirtyRects;
+	dirtyRects.swap(pages[page]->dirtyRects);
+	return dirtyRects;
+}
@@ -0,0 +1,222 @@
+#ifndef PEA_GRAPHICS_GLYPH_CACHE_H_
+#define PEA_GRAPHICS_GLYPH_CACHE_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "graphics/Image_PNG.h"
+#include "graphics/Rect.h"
+#include "graphics/Typeface.h"
+#include "math/vec2.h"
+
+namespace pea {
+
+/**
+ * @class GlyphCache
+ * Glyphs rendered on demand into 8 bit atlas pages, keyed by (codepoint, size, style), for texts
+ * of any script drawn with textures.
+ *
+ * A glyph that's not in the cache is queued to a worker thread, which renders it by FreeType with
+ * its own face, so that drawing never waits for rasterization; the glyph shows up once update()
+ * has copied it into a page. Pages are divided into shelves of similar heights, glyphs are placed
+ * side by side in shelves. When pages are full, glyphs least recently used are evicted and their
+ * places are reused. Glyphs used since the last update() are never evicted.
+ *
+ * Pages stay in memory, and rectangles changed since the last call of takeDirtyRects() are kept,
+ * so that textures only upload those sub-rectangles.
+ *
+ * @code
+ *   cache.update();  // once per frame, or before each batch of glyphs
+ *   for(page...) upload(cache.getPage(page), cache.takeDirtyRects(page));
+ *   if(const GlyphCache::Glyph* glyph = cache.find(codepoint, size, style)) draw(glyph);
+ * @endcode
+ */
+class GlyphCache
+{
+public:
+	struct Glyph
+	{
+		uint32_t page;
+		Rect<int32_t> rect;  ///< pixels on page, empty for blank glyphs
+		vec2i bearing;       ///< offset from origin to left, and from baseline up to top of rect
+		float advance;       ///< hinted advance in pixels
+	};
+
+	struct Statistics
+	{
+		size_t hits;
+		size_t misses;     ///< glyphs queued for rasterization
+		size_t evictions;
+		size_t failures;   ///< glyphs rasterized but not placed, since pages are full of glyphs in use
+	};
+
+private:
+	using Key = uint64_t;
+
+	static Key makeKey(char32_t codepoint, uint32_t size, Typeface::Style style);
+
+	enum class State: uint8_t
+	{
+		PENDING,  ///< queued to worker
+		READY,
+	};
+
+	struct Entry: public Glyph
+	{
+		State state;
+		int32_t shelf;     ///< index of shelf on page, -1 if the glyph takes no room
+		uint64_t frame;    ///< update count when it was used last time
+		std::list<Key>::iterator lru;
+	};
+
+	struct Span
+	{
+		int32_t x;
+		int32_t width;
+	};
+
+	struct Shelf
+	{
+		int32_t y;
+		int32_t height;
+		int32_t bucket;           ///< height of glyphs it holds, up to height, changeable once it's empty
+		int32_t end;              ///< x where unused room starts
+		std::vector<Span> holes;  ///< places of evicted glyphs, sorted by x
+	};
+
+	struct Page
+	{
+		Image_PNG image;  ///< C1_U8 coverage, can be saved to inspect
+		std::vector<Shelf> shelves;
+		int32_t bottom;           ///< y where unused room starts
+		std::vector<Rect<int32_t>> dirtyRects;
+
+		explicit Page(uint32_t size);
+	};
+
+	struct Result
+	{
+		Key key;
+		bool success;
+		Typeface::Bitmap bitmap;
+	};
+
+	uint32_t pageSize;
+	uint32_t maxPageCount;
+	std::vector<std::unique_ptr<Page>> pages;
+
+	std::unordered_map<Key, Entry> entries;
+	std::list<Key> lru;  ///< ready glyphs taking room, most recently used first
+	uint64_t frame;
+	Statistics statistics;
+
+	std::unique_ptr<Typeface> metrics;  ///< for layout on the calling thread
+	std::unordered_map<Key, float> advances;
+
+	std::unique_ptr<Typeface> rasterizer;  ///< for the worker thread only
+	std::thread worker;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::deque<Key> requests;
+	std::vector<Result> results;
+	size_t busy;  ///< requests taken by worker and not in results yet
+	bool stop;
+
+private:
+	void rasterize();
+	void insert(std::vector<Result>& results);
+	bool allocate(uint32_t width, uint32_t height, uint32_t& page, int32_t& shelf, Rect<int32_t>& rect);
+	bool allocateOnPage(uint32_t page, uint32_t width, uint32_t height, int32_t& shelf, Rect<int32_t>& rect);
+	void release(uint32_t page, int32_t shelf, const Rect<int32_t>& rect);
+	bool evict();
+	void copy(const Typeface::Bitmap& bitmap, uint32_t page, const Rect<int32_t>& rect);
+
+public:
+	/**
+	 * @param[in] fontPath     font file for both rasterization and metrics.
+	 * @param[in] pageSize     width and height of a page, glyphs larger than it aren't drawn.
+	 * @param[in] maxPageCount page count limit, at least 1.
+	 */
+	explicit GlyphCache(const std::string& fontPath, uint32_t pageSize = 1024, uint32_t maxPageCount = 4);
+	~GlyphCache();
+
+	GlyphCache(const GlyphCache& other) = delete;
+	GlyphCache& operator =(const GlyphCache& other) = delete;
+
+	/**
+	 * @return false if the font can't be read.
+	 */
+	bool isValid() const;
+
+	/**
+	 * Look a glyph up and mark it used, queue it for rasterization if it's not cached.
+	 * @return nullptr if the glyph isn't ready yet. Glyphs that can't be rendered are blank.
+	 */
+	const Glyph* find(char32_t codepoint, uint32_t size, Typeface::Style style);
+
+	/**
+	 * Mark a glyph returned by find() used again, without looking it up. The pointer is valid until
+	 * the generation changes.
+	 */
+	void touch(const Glyph* glyph);
+
+	/**
+	 * @return a number that changes whenever glyphs are evicted, so that pointers to glyphs kept
+	 *         from an older generation must be found again.
+	 */
+	size_t getGeneration() const;
+
+	/**
+	 * Advances of the font's outlines, without hinting. They're known before glyphs are rendered,
+	 * so that layout doesn't change when glyphs show up.
+	 */
+	float getAdvance(char32_t codepoint, uint32_t size);
+	float getKerning(char32_t left, char32_t right, uint32_t size) const;
+
+	/**
+	 * Copy glyphs rasterized so far into pages, without waiting for others.
+	 * @param[in] nextFrame glyphs used before this call can be evicted after it. Pass false to
+	 *                      keep them, e.g. when a frame is drawn in several passes.
+	 */
+	void update(bool nextFrame = true);
+
+	/**
+	 * Wait for all queued glyphs and copy them into pages, glyphs used since the last update() are
+	 * kept.
+	 */
+	void finish();
+
+	uint32_t getPageSize() const;
+	uint32_t getPageCount() const;
+	const Image& getPage(uint32_t page) const;
+
+	/**
+	 * @return rectangles of page changed since the last call, and forget them.
+	 */
+	std::vector<Rect<int32_t>> takeDirtyRects(uint32_t page);
+
+	/**
+	 * @return count of glyphs that take room in pages.
+	 */
+	size_t getGlyphCount() const;
+	const Statistics& getStatistics() const;
+};
+
+inline bool GlyphCache::isValid() const { return metrics && rasterizer; }
+inline uint32_t GlyphCache::getPageSize() const { return pageSize; }
+inline uint32_t GlyphCache::getPageCount() const { return static_cast<uint32_t>(pages.size()); }
+inline const Image& GlyphCache::getPage(uint32_t page) const { return pages[page]->image; }
+inline size_t GlyphCache::getGeneration() const { return statistics.evictions; }
+inline size_t GlyphCache::getGlyphCount() const { return lru.size(); }
+inline const GlyphCache::Statistics& GlyphCache::getStatistics() const { return statistics; }
+
+}  // namespace pea
+#endif  // PEA_GRAPHICS_GLYPH_CACHE_H_
@@ -1,8 +1,14 @@
 #include "graphics/Image.h"
 
+#include <algorithm>
+#include <cassert>
 #include <vector>
 #include <cstring>  // for std::memcpy
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
 #include "pea/config.h"
 #if OpenMP_CXX_FOUND
 #include <omp.h>
@@ -11,6 +17,7 @@
 #include "graphics/Image_BMP.h"
 #include "graphics/Image_JPG.h"
 #include "graphics/Image_PNG.h"
+#include "graphics/PixelConverter.h"
 #include "util/Log.h"
 
 
@@ -21,75 +28,27 @@ using namespace pea;
 
 void Image::convert_RGBX5551_to_RGB888(const uint8_t* src, uint8_t* dst, size_t count)
 {
-	const uint16_t* s = reinterpret_cast<const uint16_t*>(src);
-	
-	#pragma omp parallel for
-	for(size_t i = 0; i < count; ++i)
-	{
-		*dst = (*s & 0x001F) << 3;  ++dst;
-		*dst = (*s & 0x03E0) << 3;  ++dst;
-		*dst = (*s & 0x7C00) << 3;  ++dst;
-		++s;
-	}
+	PixelConverter::convert(Color::RGBA5551_U16, src, Color::C3_U8, dst, count);
 }
 
 void Image::convert_RGB565_to_RGB888(const uint8_t* src, uint8_t* dst, size_t count)
 {
-	const uint16_t* s = reinterpret_cast<const uint16_t*>(src);
-	
-	#pragma omp parallel for
-	for(size_t i = 0; i < count; ++i)
-	{
-		*dst = (*s & 0x001F) << 3;  ++dst;
-		*dst = (*s & 0x07E0) << 2;  ++dst;
-		*dst = (*s & 0xF800) << 3;  ++dst;
-		++s;
-	}
+	PixelConverter::convert(Color::RGB565_U16, src, Color::C3_U8, dst, count);
 }
 
 void Image::convert_RGB565_to_RGBA8888(const uint8_t* src, uint8_t* dst, size_t count)
 {
-	const uint16_t* s = reinterpret_cast<const uint16_t*>(src);
-	uint32_t* d = reinterpret_cast<uint32_t*>(dst);
-	
-	#pragma omp parallel for
-	for(size_t i = 0; i < count; ++i)
-	{
-//		*d = Color::from_RGB565(*s);
-		*d = ((*s & 0x001F) << 3) | ((*s & 0x07E0) << 5) | (*s & 0xF800) << 8 | 0xFF000000;
-		++s;
-		++d;
-	}
+	PixelConverter::convert(Color::RGB565_U16, src, Color::C4_U8, dst, count);
 }
 
 void Image::convert_RGBA5551_to_RGBA8888(const uint8_t* src, uint8_t* dst, size_t count)
 {
-	const uint16_t* s = reinterpret_cast<const uint16_t*>(src);
-	uint32_t* d = reinterpret_cast<uint32_t*>(dst);
-	
-	#pragma omp parallel for
-	for(size_t i = 0; i < count; ++i)
-	{
-//		*d = Color::fromRGBA_5551(*s);
-		*dst = (*s & 0x001F) << 3;  ++dst;
-		*dst = (*s & 0x03E0) << 3;  ++dst;
-		*dst = (*s & 0x7C00) << 3;  ++dst;
-		++s;
-		++d;
-	}
+	PixelConverter::convert(Color::RGBA5551_U16, src, Color::C4_U8, dst, count);
 }
 
 void Image::convert_RGB888_to_RGBA8888(const uint8_t* src, uint8_t* dst, size_t count)
 {
-	uint32_t* d = reinterpret_cast<uint32_t*>(dst);
-	
-	#pragma omp parallel for
-	for(size_t i = 0; i < count; ++i)
-	{
-		*d = src[0] | (src[1] << 8) | (src[2] << 16) | 0xFF000000;
-		src += 3;
-		++d;
-	}
+	PixelConverter::convert(Color::C3_U8, src, Color::C4_U8, dst, count);
 }
 
 Image::Image():
@@ -97,7 +56,8 @@ Image::Image():
 		height(0),
 		colorFormat(Color::C4_U8),
 		data(nullptr),
-		move(false)
+		move(false),
+		bottomUp(false)
 {
 }
 
@@ -106,7 +66,8 @@ Image::Image(uint32_t width, uint32_t height, Color::Format format) noexcept(fal
 		height(height),
 		colorFormat(format),
 		data(new uint8_t[width * height * Color::size(format)]),
-		move(true)
+		move(true),
+		bottomUp(false)
 {
 	if(data == nullptr)  // std::bad_alloc
 		width = height = 0;
@@ -117,7 +78,8 @@ Image::Image(uint32_t width, uint32_t height, Color::Format format, uint8_t* dat
 		height(height),
 		colorFormat(format),
 		data(data),
-		move(move)
+		move(move),
+		bottomUp(false)
 {
 }
 
@@ -222,24 +184,26 @@ uint32_t Image::getPixel(uint32_t x, uint32_t y) const
 
 void Image::fillColor(uint32_t color)
 {
-	for(uint32_t y = 0; y < height; ++y)
-		for(uint32_t x = 0; x < width; ++x)
-			setPixel(x, y, color);
+	PixelConverter::fill(colorFormat, data, static_cast<size_t>(width) * height, color);
 }
 
 void Image::fillCheckerboard(uint32_t size, uint32_t color1/* = 0xFF000000 */, uint32_t color2/* = 0xFFFFFFFF */)
 {
 	assert(size > 0u);
-	for(uint32_t y = 0; y < height; ++y)
+	// two row patterns, rows of even blocks start with color2, odd ones with color1.
+	const size_t pixelSize = Color::size(colorFormat);
+	const size_t rowStride = width * pixelSize;
+	std::vector<uint8_t> rows(rowStride * 2);
+	for(uint32_t x = 0; x < width; x += size)
 	{
-		uint32_t block_r = y / size;
-		for(uint32_t x = 0; x < width; ++x)
-		{
-			uint32_t block_c = x / size;
-			const uint32_t& color = (block_r + block_c) % 2 != 0 ? color1 : color2;
-			setPixel(x, y, color);
-		}
+		uint32_t length = std::min(size, width - x);
+		bool odd = (x / size) % 2 != 0;
+		PixelConverter::fill(colorFormat, rows.data() + x * pixelSize, length, odd? color1: color2);
+		PixelConverter::fill(colorFormat, rows.data() + rowStride + x * pixelSize, length, odd? color2: color1);
 	}
+
+	for(uint32_t y = 0; y < height; ++y)
+		std::memcpy(data + y * rowStride, rows.data() + (y / size) % 2 * rowStride, rowStride);
 }
 
 #if 0
@@ -277,36 +241,292 @@ Image Image::crop(const Rect& rect, uint32_t backgroundColor/* = 0*/) const
 	return image;
 }
 #endif
-void Image::flipHorizontal()
+// pixels of sizes without an integer type, only copied around.
+template<size_t N>
+struct Pixel
+{
+	uint8_t byte[N];
+};
+
+static constexpr uint32_t TILE_SIZE = 32;
+
+/**
+ * Call function with a value of the type matching pixel size.
+ * @return false if no type matches.
+ */
+template<typename Function>
+static bool dispatch(size_t pixelSize, Function&& function)
+{
+	switch(pixelSize)
+	{
+	case  1: function(uint8_t());   return true;
+	case  2: function(uint16_t());  return true;
+	case  3: function(Pixel<3>());  return true;
+	case  4: function(uint32_t());  return true;
+	case  6: function(Pixel<6>());  return true;
+	case  8: function(uint64_t());  return true;
+	case 12: function(Pixel<12>()); return true;
+	case 16: function(Pixel<16>()); return true;
+	default: return false;
+	}
+}
+
+/**
+ * Rows stay rows, they are copied in order or reversed.
+ */
+template<typename T>
+static void flip(const T* src, uint32_t width, uint32_t height, T* dst, bool flipX, bool flipY)
 {
-	for(uint32_t h = 0; h < height; ++h)
+	const int32_t rowCount = static_cast<int32_t>(height);
+	#pragma omp parallel for
+	for(int32_t y = 0; y < rowCount; ++y)
 	{
-		for(uint32_t w1 = 0, w2 = width - 1; w1 < w2; ++w1, --w2)
+		const T* s = src + static_cast<size_t>(y) * width;
+		T* d = dst + static_cast<size_t>(flipY? height - 1 - y: y) * width;
+		if(flipX)
+			std::reverse_copy(s, s + width, d);
+		else
+			std::memcpy(d, s, width * sizeof(T));
+	}
+}
+
+template<typename T>
+static void flip(T* data, uint32_t width, uint32_t height, bool flipX, bool flipY)
+{
+	if(!flipY)
+	{
+		if(!flipX)
+			return;
+
+		const int32_t rowCount = static_cast<int32_t>(height);
+		#pragma omp parallel for
+		for(int32_t y = 0; y < rowCount; ++y)
+			std::reverse(data + static_cast<size_t>(y) * width, data + static_cast<size_t>(y + 1) * width);
+		return;
+	}
+
+	// swap pairs of rows, the middle row of odd height only needs reversing.
+	const int32_t pairCount = static_cast<int32_t>(height / 2);
+	#pragma omp parallel for
+	for(int32_t y = 0; y < pairCount; ++y)
+	{
+		T* a = data + static_cast<size_t>(y) * width;
+		T* b = data + static_cast<size_t>(height - 1 - y) * width;
+		if(flipX)
+			for(uint32_t x = 0; x < width; ++x)
+				std::swap(a[x], b[width - 1 - x]);
+		else
+			std::swap_ranges(a, a + width, b);
+	}
+
+	if(flipX && height % 2 != 0)
+	{
+		T* middle = data + static_cast<size_t>(height / 2) * width;
+		std::reverse(middle, middle + width);
+	}
+}
+
+/**
+ * Source pixel (x, y) goes to destination row x or width - 1 - x, column y or height - 1 - y.
+ * Destination is height wide. Only the tile [x0, x1) x [y0, y1) is done.
+ */
+template<typename T>
+static void transposeTile(const T* src, uint32_t width, uint32_t height, T* dst, bool flipRow, bool flipColumn,
+		uint32_t x0, uint32_t x1, uint32_t y0, uint32_t y1)
+{
+	for(uint32_t x = x0; x < x1; ++x)
+	{
+		T* d = dst + static_cast<size_t>(flipRow? width - 1 - x: x) * height;
+		const T* s = src + x;
+		if(flipColumn)
+			for(uint32_t y = y0; y < y1; ++y)
+				d[height - 1 - y] = s[static_cast<size_t>(y) * width];
+		else
+			for(uint32_t y = y0; y < y1; ++y)
+				d[y] = s[static_cast<size_t>(y) * width];
+	}
+}
+
+#if defined(__SSE2__) || defined(_M_X64)
+// 4x4 blocks of 32 bit pixels are transposed in registers, the edges are left to the scalar loop.
+static void transposeTile(const uint32_t* src, uint32_t width, uint32_t height, uint32_t* dst, bool flipRow, bool flipColumn,
+		uint32_t x0, uint32_t x1, uint32_t y0, uint32_t y1)
+{
+	const uint32_t x4 = x0 + (x1 - x0) / 4 * 4;
+	const uint32_t y4 = y0 + (y1 - y0) / 4 * 4;
+	for(uint32_t y = y0; y < y4; y += 4)
+	{
+		const uint32_t column = flipColumn? height - 4 - y: y;
+		for(uint32_t x = x0; x < x4; x += 4)
 		{
-			uint32_t c1 = getPixel(w1, h);
-			uint32_t c2 = getPixel(w2, h);
-			setPixel(w1, h, c2);
-			setPixel(w2, h, c1);
+			const uint32_t* s = src + static_cast<size_t>(y) * width + x;
+			__m128i r0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+			__m128i r1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + width));
+			__m128i r2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + width * 2));
+			__m128i r3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + width * 3));
+			__m128i t0 = _mm_unpacklo_epi32(r0, r1);  // a0 b0 a1 b1
+			__m128i t1 = _mm_unpacklo_epi32(r2, r3);  // c0 d0 c1 d1
+			__m128i t2 = _mm_unpackhi_epi32(r0, r1);  // a2 b2 a3 b3
+			__m128i t3 = _mm_unpackhi_epi32(r2, r3);  // c2 d2 c3 d3
+			__m128i c[4] =
+			{
+				_mm_unpacklo_epi64(t0, t1),
+				_mm_unpackhi_epi64(t0, t1),
+				_mm_unpacklo_epi64(t2, t3),
+				_mm_unpackhi_epi64(t2, t3),
+			};
+			for(uint32_t i = 0; i < 4; ++i)
+			{
+				__m128i v = flipColumn? _mm_shuffle_epi32(c[i], _MM_SHUFFLE(0, 1, 2, 3)): c[i];
+				uint32_t row = flipRow? width - 1 - (x + i): x + i;
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + static_cast<size_t>(row) * height + column), v);
+			}
 		}
 	}
+
+	transposeTile<uint32_t>(src, width, height, dst, flipRow, flipColumn, x4, x1, y0, y1);
+	transposeTile<uint32_t>(src, width, height, dst, flipRow, flipColumn, x0, x4, y4, y1);
 }
+#endif
 
-void Image::flipVertical()
+template<typename T>
+static void transpose(const T* src, uint32_t width, uint32_t height, T* dst, bool flipRow, bool flipColumn)
 {
-	size_t rowStride = width * Color::size(colorFormat);
-	std::vector<uint8_t> line(rowStride);
-	
-	uint8_t* src = getData();
-	uint8_t* dst = getData() + (height - 1) * rowStride;
-	uint8_t* tmp = line.data();
-	for(uint32_t i = 0; i < height / 2; ++i)
+	const int32_t tileRowCount = static_cast<int32_t>((height + TILE_SIZE - 1) / TILE_SIZE);
+	#pragma omp parallel for
+	for(int32_t i = 0; i < tileRowCount; ++i)
 	{
-		std::memcpy(tmp, src, rowStride);
-		std::memcpy(src, dst, rowStride);
-		std::memcpy(dst, tmp, rowStride);
-		
-		src += rowStride;
-		dst -= rowStride;
+		const uint32_t y0 = i * TILE_SIZE, y1 = std::min(y0 + TILE_SIZE, height);
+		for(uint32_t x0 = 0; x0 < width; x0 += TILE_SIZE)
+			transposeTile(src, width, height, dst, flipRow, flipColumn, x0, std::min(x0 + TILE_SIZE, width), y0, y1);
+	}
+}
+
+/**
+ * Swap tile (i, j) with tile (j, i) of a size x size square. Tile row i owns tiles j >= i and their
+ * mirrors, so tile rows can run in parallel.
+ */
+template<typename T>
+static void transpose(T* data, uint32_t size)
+{
+	const int32_t tileCount = static_cast<int32_t>((size + TILE_SIZE - 1) / TILE_SIZE);
+	#pragma omp parallel for schedule(dynamic)
+	for(int32_t i = 0; i < tileCount; ++i)
+	{
+		const uint32_t y0 = i * TILE_SIZE, y1 = std::min(y0 + TILE_SIZE, size);
+		for(int32_t j = i; j < tileCount; ++j)
+		{
+			const uint32_t x0 = j * TILE_SIZE, x1 = std::min(x0 + TILE_SIZE, size);
+			for(uint32_t y = y0; y < y1; ++y)
+				for(uint32_t x = (i == j? y + 1: x0); x < x1; ++x)
+					std::swap(data[static_cast<size_t>(y) * size + x], data[static_cast<size_t>(x) * size + y]);
+		}
+	}
+}
+
+bool Image::swapAxes(Transform transform)
+{
+	switch(transform)
+	{
+	case Transform::TRANSPOSE:
+	case Transform::TRANSVERSE:
+	case Transform::ROTATE_90:
+	case Transform::ROTATE_270:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+	In source coordinates, transforms that keep axes move (x, y) to (x or W-1-x, y or H-1-y), the
+	other ones move (x, y) to row x or W-1-x, column y or H-1-y.
+	                flipX/flipRow  flipY/flipColumn
+	FLIP_H              1              0
+	FLIP_V              0              1
+	ROTATE_180          1              1
+	TRANSPOSE           0              0
+	ROTATE_90           1              0
+	ROTATE_270          0              1
+	TRANSVERSE          1              1
+*/
+static void getFlip(Image::Transform transform, bool& flip0, bool& flip1)
+{
+	using Transform = Image::Transform;
+	flip0 = transform == Transform::FLIP_H || transform == Transform::ROTATE_180 ||
+			transform == Transform::ROTATE_90 || transform == Transform::TRANSVERSE;
+	flip1 = transform == Transform::FLIP_V || transform == Transform::ROTATE_180 ||
+			transform == Transform::ROTATE_270 || transform == Transform::TRANSVERSE;
+}
+
+bool Image::transform(Transform transform, Color::Format format, const uint8_t* src,
+		uint32_t width, uint32_t height, uint8_t* dst)
+{
+	assert(src != nullptr && dst != nullptr && src != dst);
+	bool flip0, flip1;
+	getFlip(transform, flip0, flip1);
+	const bool swap = swapAxes(transform);
+	bool done = dispatch(Color::size(format), [=](auto pixel)
+	{
+		using T = decltype(pixel);
+		const T* s = reinterpret_cast<const T*>(src);
+		T* d = reinterpret_cast<T*>(dst);
+		if(swap)
+			transpose(s, width, height, d, flip0, flip1);
+		else
+			flip(s, width, height, d, flip0, flip1);
+	});
+
+	if(!done)
+		slog.w(TAG, "can't transform color format %d", static_cast<int>(format));
+	return done;
+}
+
+void Image::transform(Transform transform)
+{
+	if(transform == Transform::NONE || !isValid())
+		return;
+
+	const size_t pixelSize = Color::size(colorFormat);
+	if(swapAxes(transform) && width != height)
+	{
+		std::vector<uint8_t> buffer(static_cast<size_t>(width) * height * pixelSize);
+		if(Image::transform(transform, colorFormat, data, width, height, buffer.data()))
+		{
+			std::memcpy(data, buffer.data(), buffer.size());
+			std::swap(width, height);
+		}
+		return;
 	}
+
+	// a square transposes in place, then flips as its transposed rows.
+	bool flip0, flip1;
+	getFlip(transform, flip0, flip1);
+	const bool swap = swapAxes(transform);
+	bool done = dispatch(pixelSize, [&](auto pixel)
+	{
+		using T = decltype(pixel);
+		T* pixels = reinterpret_cast<T*>(data);
+		if(swap)
+		{
+			transpose(pixels, width);
+			flip(pixels, width, height, flip1, flip0);
+		}
+		else
+			flip(pixels, width, height, flip0, flip1);
+	});
+
+	if(!done)
+		slog.w(TAG, "can't transform color format %d", static_cast<int>(colorFormat));
+}
+
+void Image::flipHorizontal()
+{
+	transform(Transform::FLIP_H);
+}
+
+void Image::flipVertical()
+{
+	transform(Transform::FLIP_V);
 }
 
@@ -27,6 +27,7 @@ public:
 		JPG,
 		BMP,
 		TIFF,
+		DDS,
 
 		COUNT,  // internal use
 	};
@@ -48,13 +49,36 @@ public:
 		ROTATE_270,  // 270 degrees counter clockwise rotation
 	};
 
+	/**
+	 * @return true if transform exchanges width and height.
+	 */
+	static bool swapAxes(Transform transform);
+
+	/**
+	 * Transform pixels of any uncompressed color format. Transposing transforms are done in 32x32
+	 * tiles, so that both source and destination tiles stay in cache. Rows or tiles are processed
+	 * in parallel.
+	 * @param[in]  transform how to transform.
+	 * @param[in]  format    color format of both src and dst.
+	 * @param[in]  src       width x height pixels, rows without padding.
+	 * @param[in]  width     source width.
+	 * @param[in]  height    source height.
+	 * @param[out] dst       transformed pixels, height x width if transform swaps axes. It must not
+	 *                       overlap src.
+	 * @return false if format has no pixel size.
+	 */
+	static bool transform(Transform transform, Color::Format format, const uint8_t* src,
+			uint32_t width, uint32_t height, uint8_t* dst);
+
 protected:
 	uint32_t  width;
 	uint32_t  height;
 	Color::Format colorFormat;
 	uint8_t* data;
 	bool move;
+	bool bottomUp;
 public:
+	// shortcuts of PixelConverter::convert()
 	static void convert_RGBX5551_to_RGB888(const uint8_t* src, uint8_t* dst, size_t count);
 	static void convert_RGB565_to_RGB888(const uint8_t* src, uint8_t* dst, size_t count);
 	static void convert_RGB565_to_RGBA8888(const uint8_t* src, uint8_t* dst, size_t count);
@@ -104,6 +128,13 @@ public:
 	void setColorFormat(const Color::Format& format) { this->colorFormat = format; }
 	Color::Format getColorFormat() const { return colorFormat; }
 
+	/**
+	 * Rows are stored from top to bottom, except for views of bottom-up files, which keep the row
+	 * order of the file rather than flip a copy. OpenGL takes bottom-up rows as they are.
+	 * Pixel accessors and transforms index rows as stored.
+	 */
+	bool isBottomUp() const { return bottomUp; }
+
 	/**
 	 * set or modify a pixel in the image.
 	 *
@@ -133,6 +164,13 @@ public:
 	 */
 //	Image crop(const Rect& rect, uint32_t backgroundColor = 0) const;
 
+	/**
+	 * Transform this image in place, width and height are exchanged if transform swaps axes.
+	 * Flips, 180 degrees rotation and transforms of square images need no extra memory, the other
+	 * ones go through a temporary copy.
+	 */
+	void transform(Transform transform);
+
 	void flipHorizontal();
 	void flipVertical();
 };
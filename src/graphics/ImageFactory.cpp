@@ -2,6 +2,7 @@
 
 #include "pea/config.h"
 #include "graphics/Image_BMP.h"
+#include "graphics/Image_DXT.h"
 #ifdef JPEG_FOUND
 #include "graphics/Image_JPG.h"
 #endif
@@ -30,6 +31,8 @@ Image::Format ImageFactory::probe(const uint8_t* data, size_t length)
 #endif
 	if(Image_BMP::probe(data, length))
 		return Image::Format::BMP;
+	if(Image_DXT::probe(data, length))
+		return Image::Format::DDS;
 	if(Image_TGA::probe(data, length))
 		return Image::Format::TGA;
 
@@ -56,6 +59,8 @@ Image::Format ImageFactory::probe(const std::string& path)
 			format = Image::Format::BMP;
 		else if(!strcmp(pos, "tiff") || !strcmp(pos, "tif"))
 			format = Image::Format::TIFF;
+		else if(!strcmp(pos, "dds"))
+			format = Image::Format::DDS;
 	}
 	else
 		slog.v(TAG, "path [%s] has no suffix.", str);
@@ -97,11 +102,18 @@ Image::Format ImageFactory::probe(const std::string& path)
 */
 }
 
-std::shared_ptr<Image> ImageFactory::decodeFile(const std::string& path)
+std::shared_ptr<Image> ImageFactory::decodeFile(const std::string& path, bool map/* = false */)
 {
 	std::shared_ptr<Image> image;
 	
 	Image::Format imageFormat = probe(path);
+	if(map && imageFormat == Image::Format::TGA)
+		image = Image_TGA::mapFile(path);
+	else if(map && imageFormat == Image::Format::BMP)
+		image = Image_BMP::mapFile(path);
+	if(image)
+		return image;
+	
 	switch(imageFormat)
 	{
 	case Image::Format::PNG:
@@ -118,6 +130,9 @@ std::shared_ptr<Image> ImageFactory::decodeFile(const std::string& path)
 	case Image::Format::TGA:
 		image = Image_TGA::decodeFile(path);
 		break;
+	case Image::Format::DDS:
+		image = Image_DXT::decodeFile(path);
+		break;
 	default:
 		assert(false);
 		break;
@@ -147,6 +162,9 @@ std::shared_ptr<Image> ImageFactory::decodeByteArray(const uint8_t* data, size_t
 	case Image::Format::TGA:
 		image = Image_TGA::decodeByteArray(data, length);
 		break;
+	case Image::Format::DDS:
+		image = Image_DXT::decodeByteArray(data, length);
+		break;
 	default:
 		assert(false);
 		break;
@@ -172,6 +190,8 @@ Image::Format ImageFactory::probeFileName(const std::string& path)
 #endif
 	else if(format == "bmp")
 		return Image::Format::BMP;
+	else if(format == "dds")
+		return Image::Format::DDS;
 //	else if(format == "xxx")
 //		image = new (std::nothrow) Image_XXX;
 	else
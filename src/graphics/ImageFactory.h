@@ -24,7 +24,12 @@ public:
 	static Image::Format probe(const std::string& path);
 	static Image::Format probeFileName(const std::string& filename);
 
-	static std::shared_ptr<Image> decodeFile(const std::string& path);
+	/**
+	 * @param[in] path image file path.
+	 * @param[in] map  view pixels of uncompressed TGA and BMP files in place instead of decoding a
+	 *                 copy, other files are decoded as usual. @see MappedImage
+	 */
+	static std::shared_ptr<Image> decodeFile(const std::string& path, bool map = false);
 	static std::shared_ptr<Image> decodeByteArray(const uint8_t* data, size_t length);
 //	static int32_t runLengthEncoding()
 
@@ -2,11 +2,14 @@
 
 #include <cassert>
 #include <cstdlib>
+#include <cstring>
 #include <fstream>
 
 #define __STDC_FORMAT_MACROS
 #include <cinttypes>  // print format int64_t type
 
+#include "graphics/MappedImage.h"
+#include "io/MappedFile.h"
 #include "util/Log.h"
 #include "util/utility.h"
 
@@ -395,6 +398,63 @@ bool Image_BMP::load(const void* data, DataType type, long width, long height)
 	return true;
 }
 */
+std::shared_ptr<Image> Image_BMP::mapFile(const std::string& path)
+{
+	MappedFile file;
+	if(!file.open(path) || !probe(file.getData(), file.getSize()))
+		return nullptr;
+
+	const uint8_t* data = file.getData();
+	BITMAP_FILE_HEADER fileHeader;
+	BITMAP_INFO_HEADER infoHeader;
+	std::memcpy(&fileHeader, data, sizeof(fileHeader));
+	std::memcpy(&infoHeader, data + sizeof(fileHeader), sizeof(infoHeader));
+	if(infoHeader.size < sizeof(BITMAP_INFO_HEADER) || infoHeader.planes != 1 ||
+			infoHeader.width <= 0 || infoHeader.height == 0)
+		return nullptr;
+
+	Color::Format colorFormat = Color::UNKNOWN;
+	if(infoHeader.compression == COMPRESSION_RGB)
+	{
+		if(infoHeader.bitCount == 24)
+			colorFormat = Color::BGR888_U24;
+		else if(infoHeader.bitCount == 32)
+			colorFormat = Color::BGRA8888_U32;
+	}
+	else if(infoHeader.compression == COMPRESSION_BITFIELDS && infoHeader.bitCount == 32)
+	{
+		// masks follow the info header, and are part of V4 and V5 headers, with alpha mask.
+		BITMAP_COLOR_MASK colorMask = {0, 0, 0, 0};
+		const size_t offset = sizeof(BITMAP_FILE_HEADER) + sizeof(BITMAP_INFO_HEADER);
+		const size_t length = infoHeader.size > sizeof(BITMAP_INFO_HEADER)? sizeof(colorMask): sizeof(uint32_t) * 3;
+		if(offset + length <= file.getSize())
+			std::memcpy(&colorMask, data + offset, length);
+
+		if(colorMask.redMask == 0x00FF0000 && colorMask.greenMask == 0x0000FF00 && colorMask.blueMask == 0x000000FF)
+			colorFormat = Color::BGRA8888_U32;
+		else if(colorMask.redMask == 0x000000FF && colorMask.greenMask == 0x0000FF00 && colorMask.blueMask == 0x00FF0000)
+			colorFormat = Color::C4_U8;
+	}
+
+	if(colorFormat == Color::UNKNOWN)
+	{
+		slog.d(TAG, "can't map BMP of %" PRIu16 " bits, compression %" PRIu32, infoHeader.bitCount, infoHeader.compression);
+		return nullptr;
+	}
+
+	// rows are padded to 4 bytes, a view can't skip padding.
+	const uint32_t width = infoHeader.width;
+	const uint32_t height = std::abs(infoHeader.height);
+	const size_t rowStride = width * Color::size(colorFormat);
+	const size_t offset = fileHeader.offBits;
+	if(rowStride % 4 != 0 || offset + rowStride * height > file.getSize())
+		return nullptr;
+
+	// If height is positive, the bitmap is a bottom-up DIB.
+	const bool bottomUp = infoHeader.height > 0;
+	return std::make_shared<MappedImage>(std::move(file), Format::BMP, width, height, colorFormat, offset, bottomUp);
+}
+
 bool Image_BMP::save(const std::string& path) const
 {
 	std::ofstream file(path, std::ios::out | std::ios::binary);
@@ -405,7 +465,10 @@ bool Image_BMP::save(const std::string& path) const
 	}
 
 	// TODO: BMP format removes alpha channel?
-	uint32_t pitch = width * sizeof(Color);  // sizeof(Color) are 4 bytes aligned already.
+	const uint32_t pixelSize = Color::size(colorFormat);
+	assert(pixelSize == 3 || pixelSize == 4);
+	const uint32_t rowStride = width * pixelSize;
+	const uint32_t pitch = (rowStride + 3) & ~3;  // rows are 4 bytes aligned
 	uint32_t dataSize = pitch * height;
 
 	const uint32_t headerSize = sizeof(BITMAP_FILE_HEADER) + sizeof(BITMAP_INFO_HEADER);
@@ -424,7 +487,7 @@ bool Image_BMP::save(const std::string& path) const
 		static_cast<int32_t>(width),// width
 		-static_cast<int32_t>(height),// height, negative makes top-to-down
 		1,                          // planes
-		32,                         // bitCount
+		static_cast<uint16_t>(pixelSize * 8),  // bitCount
 		COMPRESSION_RGB,            // compression = 0, an uncompressed format.
 		dataSize,                   // sizeImage in bytes (including padding)
 		0,                          // xPixelsPerMeter
@@ -433,10 +496,20 @@ bool Image_BMP::save(const std::string& path) const
 		0                           // colorImportant
 	};
 
-	// write 32 bit RGBA color mode, no palette
+	// write 24 or 32 bit color mode, no palette
 	file.write(reinterpret_cast<char*>(&fileHeader), sizeof(fileHeader));
 	file.write(reinterpret_cast<char*>(&infoHeader), sizeof(infoHeader));
-	file.write(reinterpret_cast<const char*>(getData()), dataSize);
+	if(pitch == rowStride)
+		file.write(reinterpret_cast<const char*>(getData()), dataSize);
+	else
+	{
+		const char padding[3] = {0, 0, 0};
+		for(uint32_t y = 0; y < height; ++y)
+		{
+			file.write(reinterpret_cast<const char*>(getData()) + y * rowStride, rowStride);
+			file.write(padding, pitch - rowStride);
+		}
+	}
 	file.close();
 
 	return true;
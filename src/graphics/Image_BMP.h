@@ -112,6 +112,13 @@ public:
 	
 	static std::shared_ptr<Image_BMP> decodeByteArray(const uint8_t* data, size_t length);
 	static std::shared_ptr<Image_BMP> decodeFile(const std::string& path);
+
+	/**
+	 * View pixels of a 24 or 32 bits uncompressed file in place, rows can't be padded.
+	 * @return nullptr if the file can't be viewed as is, decodeFile() it then.
+	 * @see MappedImage
+	 */
+	static std::shared_ptr<Image> mapFile(const std::string& path);
 	
 	virtual bool save(const std::string& path) const override;
 
@@ -1,20 +1,24 @@
 #include "graphics/Image_DXT.h"
 
-#include "math/scalar.h" // for clamp
-#include "util/utility.h"
-#include "util/Log.h"
-
-#include <cstdio>
+#include <algorithm>
+#include <cassert>
 #include <cstring>
 #include <fstream>
+#include <limits>
 
-/*
-	set this =1 if you want to use the covarince matrix method...
-	which is better than my method of using standard deviations
-	overall, except on the infintesimal chance that the power
-	method fails for finding the largest eigenvector
-*/
-#define USE_COV_MAT 1
+#include "pea/config.h"
+#if OpenMP_CXX_FOUND
+#include <omp.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define DXT_SSE2 1
+#endif
+
+#include "math/scalar.h" // for clamp
+#include "util/utility.h"
+#include "util/Log.h"
 
 static const char* TAG = "Image_DXT";
 
@@ -22,317 +26,451 @@ using namespace pea;
 
 const unsigned char Image_DXT::MAGIC[4] = {'D', 'D', 'S', ' '};
 
+static constexpr uint32_t FOURCC_DXT1 = makeFourCC('D', 'X', 'T', '1');
+static constexpr uint32_t FOURCC_DXT5 = makeFourCC('D', 'X', 'T', '5');
+
+/*
+ * A block is 16 pixels in RGBA order, 64 bytes, row by row.
+ */
+static constexpr int32_t BLOCK_SIZE = 4;
+
 /********* Helper Functions *********/
-int convert_bit_range(int c, int from_bits, int to_bits)
+static inline int32_t convert_bit_range(int32_t c, int32_t from_bits, int32_t to_bits)
 {
-	int b = (1 << (from_bits - 1)) + c * ((1 << to_bits) - 1);
+	int32_t b = (1 << (from_bits - 1)) + c * ((1 << to_bits) - 1);
 	return (b + (b >> from_bits)) >> from_bits;
 }
 
-int rgb_to_565(int r, int g, int b)
+static inline uint16_t rgb_to_565(int32_t r, int32_t g, int32_t b)
 {
 	return
-		(convert_bit_range( r, 8, 5 ) << 11) |
-		(convert_bit_range( g, 8, 6 ) << 05) |
-		(convert_bit_range( b, 8, 5 ) << 00);
+		(convert_bit_range(r, 8, 5) << 11) |
+		(convert_bit_range(g, 8, 6) << 05) |
+		(convert_bit_range(b, 8, 5) << 00);
+}
+
+/**
+ * Expand with bit replication, like the GPU does.
+ */
+static inline void rgb_888_from_565(uint32_t c, int32_t rgb[3])
+{
+	int32_t r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+	rgb[0] = (r << 3) | (r >> 2);
+	rgb[1] = (g << 2) | (g >> 4);
+	rgb[2] = (b << 3) | (b >> 2);
 }
 
-void rgb_888_from_565(unsigned int c, int *r, int *g, int *b)
+static inline uint16_t pack565(const float color[3])
 {
-	*r = convert_bit_range( (c >> 11) & 31, 5, 8 );
-	*g = convert_bit_range( (c >> 05) & 63, 6, 8 );
-	*b = convert_bit_range( (c >> 00) & 31, 5, 8 );
+	int32_t c[3];
+	for(int32_t i = 0; i < 3; ++i)
+		c[i] = clamp(static_cast<int32_t>(color[i] + 0.5F), 0, 255);
+	return rgb_to_565(c[0], c[1], c[2]);
 }
 
-void compute_color_line_STDEV(const uint8_t *const uncompressed, int channels, float point[3], float direction[3])
+/**
+ * Copy the 4x4 block at (x0, y0) to RGBA, partial blocks on the right and bottom edges replicate
+ * the edge pixels. 1 and 2 channel images are gray, with alpha in the second channel.
+ */
+static void extractBlock(const uint8_t* pixels, int32_t width, int32_t height, int32_t channels,
+		int32_t x0, int32_t y0, uint8_t block[64])
 {
-	const float inv_16 = 1/16.0f;
-
-	float sum_r = 0.0f, sum_g = 0.0f, sum_b = 0.0f;
-	float sum_rr = 0.0f, sum_gg = 0.0f, sum_bb = 0.0f;
-	float sum_rg = 0.0f, sum_rb = 0.0f, sum_gb = 0.0f;
-	/*	calculate all data needed for the covariance matrix
-		( to compare with _rygdxt code)	*/
-	for(int i = 0; i < 16*channels; i += channels)
+#if DXT_SSE2
+	if(channels == 4 && x0 + BLOCK_SIZE <= width && y0 + BLOCK_SIZE <= height)
 	{
-		sum_r += uncompressed[i+0];
-		sum_rr += uncompressed[i+0] * uncompressed[i+0];
-		sum_g += uncompressed[i+1];
-		sum_gg += uncompressed[i+1] * uncompressed[i+1];
-		sum_b += uncompressed[i+2];
-		sum_bb += uncompressed[i+2] * uncompressed[i+2];
-		sum_rg += uncompressed[i+0] * uncompressed[i+1];
-		sum_rb += uncompressed[i+0] * uncompressed[i+2];
-		sum_gb += uncompressed[i+1] * uncompressed[i+2];
+		const size_t stride = static_cast<size_t>(width) * 4;
+		const uint8_t* row = pixels + y0 * stride + x0 * 4;
+		for(int32_t y = 0; y < BLOCK_SIZE; ++y, row += stride)
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(block + y * 16),
+					_mm_loadu_si128(reinterpret_cast<const __m128i*>(row)));
+		return;
 	}
-	/*	convert the sums to averages	*/
-	sum_r *= inv_16;
-	sum_g *= inv_16;
-	sum_b *= inv_16;
-	/*	and convert the squares to the squares of the value - avg_value	*/
-	sum_rr -= 16.0f * sum_r * sum_r;
-	sum_gg -= 16.0f * sum_g * sum_g;
-	sum_bb -= 16.0f * sum_b * sum_b;
-	sum_rg -= 16.0f * sum_r * sum_g;
-	sum_rb -= 16.0f * sum_r * sum_b;
-	sum_gb -= 16.0f * sum_g * sum_b;
-	/*	the point on the color line is the average	*/
-	point[0] = sum_r;
-	point[1] = sum_g;
-	point[2] = sum_b;
-#if USE_COV_MAT
-	/*
-		The following idea was from ryg.
-		(https://mollyrocket.com/forums/viewtopic.php?t=392)
-		The method worked great (less RMSE than mine) most of
-		the time, but had some issues handling some simple
-		boundary cases, like full green next to full red,
-		which would generate a covariance matrix like this:
-
-		| 1  -1  0 |
-		| -1  1  0 |
-		| 0   0  0 |
-
-		For a given starting vector, the power method can
-		generate all zeros!  So no starting with {1,1,1}
-		as I was doing!  This kind of error is still a
-		slight posibility, but will be very rare.
-	*/
-	/*	use the covariance matrix directly
-		(1st iteration, don't use all 1.0 values!)	*/
-	sum_r = 1.0f;
-	sum_g = 2.718281828f;
-	sum_b = 3.141592654f;
-	direction[0] = sum_r*sum_rr + sum_g*sum_rg + sum_b*sum_rb;
-	direction[1] = sum_r*sum_rg + sum_g*sum_gg + sum_b*sum_gb;
-	direction[2] = sum_r*sum_rb + sum_g*sum_gb + sum_b*sum_bb;
-	/*	2nd iteration, use results from the 1st guy	*/
-	sum_r = direction[0];
-	sum_g = direction[1];
-	sum_b = direction[2];
-	direction[0] = sum_r*sum_rr + sum_g*sum_rg + sum_b*sum_rb;
-	direction[1] = sum_r*sum_rg + sum_g*sum_gg + sum_b*sum_gb;
-	direction[2] = sum_r*sum_rb + sum_g*sum_gb + sum_b*sum_bb;
-	/*	3rd iteration, use results from the 2nd guy	*/
-	sum_r = direction[0];
-	sum_g = direction[1];
-	sum_b = direction[2];
-	direction[0] = sum_r*sum_rr + sum_g*sum_rg + sum_b*sum_rb;
-	direction[1] = sum_r*sum_rg + sum_g*sum_gg + sum_b*sum_gb;
-	direction[2] = sum_r*sum_rb + sum_g*sum_gb + sum_b*sum_bb;
-#else
-	/*	use my standard deviation method
-		(very robust, a tiny bit slower and less accurate)	*/
-	direction[0] = std::sqrt( sum_rr );
-	direction[1] = std::sqrt( sum_gg );
-	direction[2] = std::sqrt( sum_bb );
-	/*	which has a greater component	*/
-	if( sum_gg > sum_rr )
+#endif
+	for(int32_t y = 0; y < BLOCK_SIZE; ++y)
+	for(int32_t x = 0; x < BLOCK_SIZE; ++x)
 	{
-		/*	green has greater component, so base the other signs off of green	*/
-		if( sum_rg < 0.0f )
+		const size_t sx = std::min(x0 + x, width - 1), sy = std::min(y0 + y, height - 1);
+		const uint8_t* p = pixels + (sy * width + sx) * channels;
+		uint8_t* q = block + (y * BLOCK_SIZE + x) * 4;
+		switch(channels)
 		{
-			direction[0] = -direction[0];
-		}
-		if( sum_gb < 0.0f )
-		{
-			direction[2] = -direction[2];
+		case 1:  q[0] = q[1] = q[2] = p[0]; q[3] = 255;  break;
+		case 2:  q[0] = q[1] = q[2] = p[0]; q[3] = p[1]; break;
+		case 3:  q[0] = p[0]; q[1] = p[1]; q[2] = p[2]; q[3] = 255;  break;
+		default: q[0] = p[0]; q[1] = p[1]; q[2] = p[2]; q[3] = p[3]; break;
 		}
 	}
-	else
+}
+
+/**
+ * Mean and principal axis of the block's colors. The axis is the dominant eigenvector of the
+ * covariance matrix found by power iteration, it's not normalized and can be zero for a flat block.
+ */
+static void computeColorLine(const uint8_t block[64], float mean[3], float axis[3])
+{
+	float sum[3] = {0, 0, 0};
+	for(int32_t i = 0; i < 16; ++i)
+		for(int32_t c = 0; c < 3; ++c)
+			sum[c] += block[i * 4 + c];
+	for(int32_t c = 0; c < 3; ++c)
+		mean[c] = sum[c] / 16;
+
+	float rr = 0, gg = 0, bb = 0, rg = 0, rb = 0, gb = 0;
+	for(int32_t i = 0; i < 16; ++i)
 	{
-		/*	red has a greater component	*/
-		if( sum_rg < 0.0f )
+		float r = block[i * 4 + 0] - mean[0];
+		float g = block[i * 4 + 1] - mean[1];
+		float b = block[i * 4 + 2] - mean[2];
+		rr += r * r; gg += g * g; bb += b * b;
+		rg += r * g; rb += r * b; gb += g * b;
+	}
+
+	/*
+		The following idea was from ryg, don't start with all 1.0 values,
+		a covariance matrix like | 1 -1 0 | of full green next to full red
+		                         |-1  1 0 |
+		                         | 0  0 0 |
+		maps {1, 1, 1} to zero.
+	*/
+	float v[3] = { 1.0F, 2.718281828F, 3.141592654F };
+	for(int32_t iteration = 0; iteration < 8; ++iteration)
+	{
+		float x = v[0] * rr + v[1] * rg + v[2] * rb;
+		float y = v[0] * rg + v[1] * gg + v[2] * gb;
+		float z = v[0] * rb + v[1] * gb + v[2] * bb;
+		float m = std::max(std::abs(x), std::max(std::abs(y), std::abs(z)));
+		if(m <= 0)
 		{
-			direction[1] = -direction[1];
+			v[0] = v[1] = v[2] = 0;
+			break;
 		}
-		if( sum_rb < 0.0f )
+		v[0] = x / m; v[1] = y / m; v[2] = z / m;
+	}
+
+	axis[0] = v[0];
+	axis[1] = v[1];
+	axis[2] = v[2];
+}
+
+/**
+ * Pick the nearest of the 4 palette colors for each pixel.
+ * @return squared error of the block.
+ */
+static int32_t selectIndices(const uint8_t block[64], uint16_t c0, uint16_t c1, uint32_t& indices)
+{
+	int32_t palette[4][3];
+	rgb_888_from_565(c0, palette[0]);
+	rgb_888_from_565(c1, palette[1]);
+	for(int32_t c = 0; c < 3; ++c)
+	{
+		palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+		palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+	}
+
+	int32_t error = 0;
+	indices = 0;
+	for(int32_t i = 0; i < 16; ++i)
+	{
+		const uint8_t* p = block + i * 4;
+		int32_t best = std::numeric_limits<int32_t>::max(), index = 0;
+		for(int32_t k = 0; k < 4; ++k)
 		{
-			direction[2] = -direction[2];
+			int32_t dr = p[0] - palette[k][0], dg = p[1] - palette[k][1], db = p[2] - palette[k][2];
+			int32_t distance = dr * dr + dg * dg + db * db;
+			if(distance < best)
+			{
+				best = distance;
+				index = k;
+			}
 		}
+		error += best;
+		indices |= index << (i * 2);
 	}
-#endif
+	return error;
 }
 
-void LSE_master_colors_max_min(int *cmax, int *cmin, int channels, const uint8_t* const uncompressed)
+/**
+ * Encode the block with endpoints a and b in 4 color mode, which needs color0 > color1.
+ * @return squared error of the block.
+ */
+static int32_t writeColorBlock(const uint8_t block[64], uint16_t a, uint16_t b, uint8_t out[8])
 {
-	/*	the master colors	*/
-	int c0[3], c1[3];
-	/*	used for fitting the line	*/
-	float sum_x[] = { 0.0f, 0.0f, 0.0f };
-	float sum_x2[] = { 0.0f, 0.0f, 0.0f };
-	float dot_max = 1.0f, dot_min = -1.0f;
-	float vec_len2 = 0.0f;
+	if(a < b)
+		std::swap(a, b);
 
-	/*	error check	*/
-	if((channels < 3) || (channels > 4))
+	uint32_t indices = 0;
+	int32_t error = 0;
+	if(a != b)
+		error = selectIndices(block, a, b, indices);
+	else
+	{
+		int32_t rgb[3];
+		rgb_888_from_565(a, rgb);
+		for(int32_t i = 0; i < 16; ++i)
+			for(int32_t c = 0; c < 3; ++c)
+			{
+				int32_t d = block[i * 4 + c] - rgb[c];
+				error += d * d;
+			}
+	}
+
+	out[0] = a & 0xFF; out[1] = a >> 8;
+	out[2] = b & 0xFF; out[3] = b >> 8;
+	for(int32_t i = 0; i < 4; ++i)
+		out[4 + i] = (indices >> (i * 8)) & 0xFF;
+	return error;
+}
+
+static void fitRange(const uint8_t block[64], const float mean[3], const float axis[3], uint16_t& c0, uint16_t& c1)
+{
+	float length2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+	if(length2 <= 0)
+	{
+		c0 = c1 = pack565(mean);
 		return;
-	
-	compute_color_line_STDEV( uncompressed, channels, sum_x, sum_x2 );
-	vec_len2 = 1.0f / ( 0.00001f + sum_x2[0]*sum_x2[0] + sum_x2[1]*sum_x2[1] + sum_x2[2]*sum_x2[2] );
-	/*	finding the max and min vector values	*/
-	dot_max =
-				sum_x2[0] * uncompressed[0] +
-				sum_x2[1] * uncompressed[1] +
-				sum_x2[2] * uncompressed[2];
-	dot_min = dot_max;
-	for(int i = 1; i < 16; ++i)
+	}
+
+	float minimum = std::numeric_limits<float>::max(), maximum = -minimum;
+	for(int32_t i = 0; i < 16; ++i)
 	{
-		float dot =
-				sum_x2[0] * uncompressed[i*channels+0] +
-				sum_x2[1] * uncompressed[i*channels+1] +
-				sum_x2[2] * uncompressed[i*channels+2];
-		if(dot < dot_min)
-			dot_min = dot;
-		else if(dot > dot_max)
-			dot_max = dot;
+		const uint8_t* p = block + i * 4;
+		float t = (p[0] - mean[0]) * axis[0] + (p[1] - mean[1]) * axis[1] + (p[2] - mean[2]) * axis[2];
+		minimum = std::min(minimum, t);
+		maximum = std::max(maximum, t);
 	}
-	/*	and the offset (from the average location)	*/
-	float dot = sum_x2[0]*sum_x[0] + sum_x2[1]*sum_x[1] + sum_x2[2]*sum_x[2];
-	dot_min -= dot;
-	dot_max -= dot;
-	/*	post multiply by the scaling factor	*/
-	dot_min *= vec_len2;
-	dot_max *= vec_len2;
-	/*	OK, build the master colors	*/
-	for(int i = 0; i < 3; ++i)
+
+	float start[3], end[3];
+	for(int32_t c = 0; c < 3; ++c)
 	{
-		/*	color 0	*/
-		c0[i] = static_cast<int>(0.5f + sum_x[i] + dot_max * sum_x2[i]);
-		c0[i] = clamp(c0[i], 0, 255);
+		start[c] = mean[c] + minimum / length2 * axis[c];
+		end[c]   = mean[c] + maximum / length2 * axis[c];
+	}
+	c0 = pack565(end);
+	c1 = pack565(start);
+}
 
-		/*	color 1	*/
-		c1[i] = static_cast<int>(0.5f + sum_x[i] + dot_min * sum_x2[i]);
-		c1[i] = clamp(c1[i], 0, 255);
+/**
+ * Order the pixels along the principal axis, and try every way to split them into 4 consecutive
+ * clusters, with weights 1, 2/3, 1/3, 0 of the first endpoint. The endpoints minimizing the squared
+ * error of each split have a closed form solution, they are snapped to RGB565 grid before the
+ * error is measured.
+ */
+static bool fitCluster(const uint8_t block[64], const float mean[3], const float axis[3], uint16_t& c0, uint16_t& c1)
+{
+	float t[16];
+	int32_t order[16];
+	for(int32_t i = 0; i < 16; ++i)
+	{
+		const uint8_t* p = block + i * 4;
+		t[i] = (p[0] - mean[0]) * axis[0] + (p[1] - mean[1]) * axis[1] + (p[2] - mean[2]) * axis[2];
+		order[i] = i;
 	}
-	/*	down_sample (with rounding?)	*/
-	int i = rgb_to_565( c0[0], c0[1], c0[2] );
-	int j = rgb_to_565( c1[0], c1[1], c1[2] );
+	std::sort(order, order + 16, [&t](int32_t a, int32_t b) { return t[a] > t[b]; });
+
+	// prefix sums of the ordered colors
+	float sum[17][3];
+	sum[0][0] = sum[0][1] = sum[0][2] = 0;
+	for(int32_t i = 0; i < 16; ++i)
+		for(int32_t c = 0; c < 3; ++c)
+			sum[i + 1][c] = sum[i][c] + block[order[i] * 4 + c];
 
-	if( i > j )
+	constexpr float ONE_NINTH = 1.0F / 9, TWO_THIRDS = 2.0F / 3, ONE_THIRD = 1.0F / 3;
+	float bestError = std::numeric_limits<float>::max();
+	bool found = false;
+	for(int32_t i = 0; i <= 16; ++i)
+	for(int32_t j = i; j <= 16; ++j)
+	for(int32_t k = j; k <= 16; ++k)
 	{
-		*cmax = i;
-		*cmin = j;
+		const float n0 = i, n1 = j - i, n2 = k - j, n3 = 16 - k;
+		const float alpha2 = n0 + (4 * n1 + n2) * ONE_NINTH;
+		const float beta2 = n3 + (n1 + 4 * n2) * ONE_NINTH;
+		const float alphaBeta = 2 * (n1 + n2) * ONE_NINTH;
+		const float determinant = alpha2 * beta2 - alphaBeta * alphaBeta;
+		if(determinant < 1E-4F)
+			continue;
+
+		float a[3], b[3], error = 0;
+		for(int32_t c = 0; c < 3; ++c)
+		{
+			const float alphaX = sum[i][c] + TWO_THIRDS * (sum[j][c] - sum[i][c]) + ONE_THIRD * (sum[k][c] - sum[j][c]);
+			const float betaX = sum[16][c] - alphaX;
+			float x = (alphaX * beta2 - betaX * alphaBeta) / determinant;
+			float y = (betaX * alpha2 - alphaX * alphaBeta) / determinant;
+
+			// snap to 565 grid
+			const int32_t bits = c == 1? 6: 5, levels = (1 << bits) - 1;
+			x = std::round(clamp(x, 0.0F, 255.0F) * levels / 255) * 255 / levels;
+			y = std::round(clamp(y, 0.0F, 255.0F) * levels / 255) * 255 / levels;
+			a[c] = x;
+			b[c] = y;
+			error += x * x * alpha2 + y * y * beta2 + 2 * (x * y * alphaBeta - x * alphaX - y * betaX);
+		}
+
+		if(error < bestError)
+		{
+			bestError = error;
+			c0 = pack565(a);
+			c1 = pack565(b);
+			found = true;
+		}
 	}
-	else
+	return found;
+}
+
+static void compressColorBlock(const uint8_t block[64], Image_DXT::Quality quality, uint8_t out[8])
+{
+	float mean[3], axis[3];
+	computeColorLine(block, mean, axis);
+
+	uint16_t c0, c1;
+	fitRange(block, mean, axis, c0, c1);
+	int32_t error = writeColorBlock(block, c0, c1, out);
+	if(quality != Image_DXT::Quality::CLUSTER_FIT || error == 0)
+		return;
+
+	if(fitCluster(block, mean, axis, c0, c1))
 	{
-		*cmax = j;
-		*cmin = i;
+		uint8_t candidate[8];
+		if(writeColorBlock(block, c0, c1, candidate) < error)
+			std::memcpy(out, candidate, sizeof(candidate));
 	}
 }
 
-/*
- * Takes a 4x4 block of pixels and compresses it into 8 bytes in DXT1 format
- * (color only, no alpha).  Speed is valued over prettyness, at least for now.
-*/
-static void compress_DDS_color_block(int channels, const uint8_t *const uncompressed, uint8_t compressed[8])
+/**
+ * Alpha endpoints are the extremes, with 6 interpolated values in between.
+ */
+static void compressAlphaBlock(const uint8_t block[64], uint8_t out[8])
 {
-	int enc_c0, enc_c1;
-	int c0[4], c1[4];
-	float color_line[] = { 0.0f, 0.0f, 0.0f, 0.0f };
-	float vec_len2 = 0.0f, dot_offset = 0.0f;
-	/*	stupid order	*/
-	int swizzle4[] = { 0, 2, 3, 1 };
-	/*	get the master colors	*/
-	LSE_master_colors_max_min( &enc_c0, &enc_c1, channels, uncompressed );
-	/*	store the 565 color 0 and color 1	*/
-	compressed[0] = (enc_c0 >> 0) & 255;
-	compressed[1] = (enc_c0 >> 8) & 255;
-	compressed[2] = (enc_c1 >> 0) & 255;
-	compressed[3] = (enc_c1 >> 8) & 255;
-	/*	zero out the compressed data	*/
-	compressed[4] = 0;
-	compressed[5] = 0;
-	compressed[6] = 0;
-	compressed[7] = 0;
-	/*	reconstitute the master color vectors	*/
-	rgb_888_from_565( enc_c0, &c0[0], &c0[1], &c0[2] );
-	rgb_888_from_565( enc_c1, &c1[0], &c1[1], &c1[2] );
-	/*	the new vector	*/
-	vec_len2 = 0.0f;
-	for(int i = 0; i < 3; ++i)
+	int32_t a0 = block[3], a1 = block[3];
+	for(int32_t i = 1; i < 16; ++i)
 	{
-		color_line[i] = (float)(c1[i] - c0[i]);
-		vec_len2 += color_line[i] * color_line[i];
+		a0 = std::max<int32_t>(a0, block[i * 4 + 3]);
+		a1 = std::min<int32_t>(a1, block[i * 4 + 3]);
 	}
-	if( vec_len2 > 0.0f )
+
+	out[0] = a0;
+	out[1] = a1;
+	uint64_t indices = 0;
+	if(a0 != a1)
 	{
-		vec_len2 = 1.0f / vec_len2;
+		int32_t palette[8] = { a0, a1 };
+		for(int32_t k = 2; k < 8; ++k)
+			palette[k] = ((8 - k) * a0 + (k - 1) * a1) / 7;
+
+		for(int32_t i = 0; i < 16; ++i)
+		{
+			const int32_t alpha = block[i * 4 + 3];
+			int32_t best = 256, index = 0;
+			for(int32_t k = 0; k < 8; ++k)
+			{
+				int32_t distance = std::abs(alpha - palette[k]);
+				if(distance < best)
+				{
+					best = distance;
+					index = k;
+				}
+			}
+			indices |= static_cast<uint64_t>(index) << (i * 3);
+		}
 	}
-	/*	pre-proform the scaling	*/
-	color_line[0] *= vec_len2;
-	color_line[1] *= vec_len2;
-	color_line[2] *= vec_len2;
-	/*	compute the offset (constant) portion of the dot product	*/
-	dot_offset = color_line[0]*c0[0] + color_line[1]*c0[1] + color_line[2]*c0[2];
-	/*	store the rest of the bits	*/
-	int next_bit = 8*4;
-	for(int i = 0; i < 16; ++i)
+
+	for(int32_t i = 0; i < 6; ++i)
+		out[2 + i] = (indices >> (i * 8)) & 0xFF;
+}
+
+static void decompressColorBlock(const uint8_t in[8], bool dxt1, uint8_t block[64])
+{
+	const uint16_t c0 = in[0] | (in[1] << 8);
+	const uint16_t c1 = in[2] | (in[3] << 8);
+	int32_t palette[4][4];
+	rgb_888_from_565(c0, palette[0]);
+	rgb_888_from_565(c1, palette[1]);
+	palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+	if(c0 > c1 || !dxt1)
+		for(int32_t c = 0; c < 3; ++c)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+	else
+	{
+		for(int32_t c = 0; c < 3; ++c)
+		{
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			palette[3][c] = 0;
+		}
+		palette[3][3] = 0;  // transparent black
+	}
+
+	const uint32_t indices = in[4] | (in[5] << 8) | (in[6] << 16) | (static_cast<uint32_t>(in[7]) << 24);
+	for(int32_t i = 0; i < 16; ++i)
 	{
-		/*	find the dot product of this color, to place it on the line
-			(should be [-1,1])	*/
-		float dot_product =
-			color_line[0] * uncompressed[i*channels+0] +
-			color_line[1] * uncompressed[i*channels+1] +
-			color_line[2] * uncompressed[i*channels+2] -
-			dot_offset;
-
-		/*	map to [0,3]	*/
-		int next_value = (int)( dot_product * 3.0f + 0.5f );
-		next_value = clamp(next_value, 0, 3);
-
-		/*	OK, store this value	*/
-		compressed[next_bit >> 3] |= swizzle4[ next_value ] << (next_bit & 7);
-		next_bit += 2;
+		const int32_t* color = palette[(indices >> (i * 2)) & 3];
+		for(int32_t c = 0; c < 4; ++c)
+			block[i * 4 + c] = color[c];
 	}
-	/*	done compressing to DXT1	*/
 }
 
-/*
- * Takes a 4x4 block of pixels and compresses the alpha component it into 8 bytes
- * for use in DXT5 DDS files. Speed is valued over prettyness, at least for now.
-*/
-static void compress_DDS_alpha_block(const uint8_t *const uncompressed, uint8_t compressed[8])
+static void decompressAlphaBlock(const uint8_t in[8], uint8_t block[64])
 {
-	/*	stupid order	*/
-	int swizzle8[] = { 1, 7, 6, 5, 4, 3, 2, 0 };
-	/*	get the alpha limits (a0 > a1)	*/
-	int a0 = uncompressed[3], a1 = a0;
-	for(int i = 4+3; i < 16*4; i += 4)
+	const int32_t a0 = in[0], a1 = in[1];
+	int32_t palette[8] = { a0, a1 };
+	if(a0 > a1)
+		for(int32_t k = 2; k < 8; ++k)
+			palette[k] = ((8 - k) * a0 + (k - 1) * a1) / 7;
+	else
 	{
-		if( uncompressed[i] > a0 )
-			a0 = uncompressed[i];
-		else if( uncompressed[i] < a1 )
-			a1 = uncompressed[i];
+		for(int32_t k = 2; k < 6; ++k)
+			palette[k] = ((6 - k) * a0 + (k - 1) * a1) / 5;
+		palette[6] = 0;
+		palette[7] = 255;
 	}
-	/*	store those limits, and zero the rest of the compressed dataset	*/
-	compressed[0] = a0;
-	compressed[1] = a1;
-	/*	zero out the compressed data	*/
-	compressed[2] = 0;
-	compressed[3] = 0;
-	compressed[4] = 0;
-	compressed[5] = 0;
-	compressed[6] = 0;
-	compressed[7] = 0;
-
-	/*	store the all of the alpha values	*/
-	int next_bit = 8*2;
-	float scale_me = 7.9999f / (a0 - a1);
-	for(int i = 3; i < 16*4; i += 4)
+
+	uint64_t indices = 0;
+	for(int32_t i = 0; i < 6; ++i)
+		indices |= static_cast<uint64_t>(in[2 + i]) << (i * 8);
+	for(int32_t i = 0; i < 16; ++i)
+		block[i * 4 + 3] = palette[(indices >> (i * 3)) & 7];
+}
+
+/**
+ * Write the visible part of a decoded block to RGBA pixels.
+ */
+static void storeBlock(const uint8_t block[64], int32_t width, int32_t height, int32_t x0, int32_t y0, uint8_t* rgba)
+{
+	const int32_t w = std::min(BLOCK_SIZE, width - x0), h = std::min(BLOCK_SIZE, height - y0);
+	const size_t stride = static_cast<size_t>(width) * 4;
+	uint8_t* row = rgba + y0 * stride + x0 * 4;
+	for(int32_t y = 0; y < h; ++y, row += stride)
 	{
-		int value = (int)((uncompressed[i] - a1) * scale_me);
-		int svalue = swizzle8[value & 7];  // convert this alpha value to a 3 bit number
-		/*	OK, store this value, start with the 1st byte	*/
-		compressed[next_bit >> 3] |= svalue << (next_bit & 7);
-		if((next_bit & 7) > 5)
+#if DXT_SSE2
+		if(w == BLOCK_SIZE)
 		{
-			/*	spans 2 bytes, fill in the start of the 2nd byte	*/
-			compressed[1 + (next_bit >> 3)] |= svalue >> (8 - (next_bit & 7) );
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(row),
+					_mm_loadu_si128(reinterpret_cast<const __m128i*>(block + y * 16)));
+			continue;
 		}
-		next_bit += 3;
+#endif
+		std::memcpy(row, block + y * 16, w * 4);
 	}
-	/*	done compressing to DXT1	*/
+}
+
+Image_DXT::Image_DXT():
+		Image(),
+		quality(Quality::RANGE_FIT)
+{
+}
+
+Image_DXT::Image_DXT(uint32_t width, uint32_t height, Color::Format format):
+		Image(width, height, format),
+		quality(Quality::RANGE_FIT)
+{
+}
+
+Image_DXT::Image_DXT(uint32_t width, uint32_t height, Color::Format format, uint8_t* data, bool move):
+		Image(width, height, format, data, move),
+		quality(Quality::RANGE_FIT)
+{
 }
 
 bool Image_DXT::save(const std::string& path) const
@@ -342,17 +480,17 @@ bool Image_DXT::save(const std::string& path) const
 	if((path.empty()) ||
 			(width < 1) || (height < 1) ||
 			(channel < 1U) || (channel > 4U) ||
+			Color::size(colorFormat) != channel ||  // 8 bits per channel
 			(data == nullptr))
 		return false;
 
 	/*	Convert the image	*/
-	uint8_t *DDS_data;
-	int DDS_size;
+	std::vector<uint8_t> DDS_data;
 	const bool hasAlpha = (channel & 1U) != 1U;
 	if(hasAlpha)  // has alpha, so use DXT5
-		DDS_data = convertImageToDXT5(getData(), width, height, channel, &DDS_size);
+		DDS_data = convertImageToDXT5(getData(), width, height, channel, quality);
 	else  // no alpha, just use DXT1
-		DDS_data = convertImageToDXT1(getData(), width, height, channel, &DDS_size);
+		DDS_data = convertImageToDXT1(getData(), width, height, channel, quality);
 
 	/*	save it	*/
 	DDS_header header;
@@ -362,10 +500,10 @@ bool Image_DXT::save(const std::string& path) const
 	header.dwFlags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_LINEARSIZE;
 	header.dwWidth = width;
 	header.dwHeight = height;
-	header.dwPitchOrLinearSize = DDS_size;
+	header.dwPitchOrLinearSize = DDS_data.size();
 	header.sPixelFormat.dwSize = 32;
 	header.sPixelFormat.dwFlags = DDPF_FOURCC;
-	header.sPixelFormat.dwFourCC = hasAlpha? makeFourCC('D', 'X', 'T', '5'): makeFourCC('D', 'X', 'T', '1');
+	header.sPixelFormat.dwFourCC = hasAlpha? FOURCC_DXT5: FOURCC_DXT1;
 	header.sCaps.dwCaps1 = DDSCAPS_TEXTURE;
 
 	/*	write it out	*/
@@ -376,175 +514,135 @@ bool Image_DXT::save(const std::string& path) const
 		return false;
 	}
 
-	file.write(reinterpret_cast<char*>(&header), sizeof(header));
-	file.write(reinterpret_cast<char*>(&DDS_data), DDS_size);
-	file.close();
-
-	/*	done	*/
-	free(DDS_data);
-	return true;
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(DDS_data.data()), DDS_data.size());
+	return file.good();
 }
 
-uint8_t* Image_DXT::convertImageToDXT1(const uint8_t* const uncompressed, int width, int height, int channels, int* out_size)
+static std::vector<uint8_t> compress(const uint8_t* uncompressed, int32_t width, int32_t height,
+		int32_t channels, Image_DXT::Quality quality, bool dxt5)
 {
-	uint8_t *compressed;
-	int i, j, x, y;
-	uint8_t ublock[16*3];
-	uint8_t cblock[8];
-	int index = 0, chan_step = 1;
-	int block_count = 0;
-	/*	error check	*/
-	*out_size = 0;
-	if( (width < 1) || (height < 1) ||
-		(NULL == uncompressed) ||
-		(channels < 1) || (channels > 4) )
-	{
-		return NULL;
-	}
-	/*	for channels == 1 or 2, I do not step forward for R,G,B values	*/
-	if( channels < 3 )
-	{
-		chan_step = 0;
-	}
-	/*	get the RAM for the compressed image
-		(8 bytes per 4x4 pixel block)	*/
-	*out_size = ((width+3) >> 2) * ((height+3) >> 2) * 8;
-	compressed = (uint8_t*)malloc( *out_size );
-	/*	go through each block	*/
-	for( j = 0; j < height; j += 4 )
+	assert(uncompressed != nullptr);
+	assert(width > 0 && height > 0);
+	assert(1 <= channels && channels <= 4);
+
+	const int32_t blockWidth = (width + 3) / 4, blockHeight = (height + 3) / 4;
+	const size_t blockSize = dxt5? 16: 8;
+	std::vector<uint8_t> compressed(static_cast<size_t>(blockWidth) * blockHeight * blockSize);
+
+	#pragma omp parallel for schedule(dynamic)
+	for(int32_t by = 0; by < blockHeight; ++by)
 	{
-		for( i = 0; i < width; i += 4 )
+		uint8_t block[64];
+		uint8_t* out = compressed.data() + static_cast<size_t>(by) * blockWidth * blockSize;
+		for(int32_t bx = 0; bx < blockWidth; ++bx, out += blockSize)
 		{
-			/*	copy this block into a new one	*/
-			int idx = 0;
-			int mx = 4, my = 4;
-			if( j+4 >= height )
-			{
-				my = height - j;
-			}
-			if( i+4 >= width )
+			extractBlock(uncompressed, width, height, channels, bx * BLOCK_SIZE, by * BLOCK_SIZE, block);
+			if(dxt5)
 			{
-				mx = width - i;
-			}
-			for( y = 0; y < my; ++y)
-			{
-				for( x = 0; x < mx; ++x)
-				{
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels];
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels+chan_step];
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels+chan_step+chan_step];
-				}
-				for( x = mx; x < 4; ++x)
-				{
-					ublock[idx++] = ublock[0];
-					ublock[idx++] = ublock[1];
-					ublock[idx++] = ublock[2];
-				}
-			}
-			for( y = my; y < 4; ++y)
-			{
-				for( x = 0; x < 4; ++x)
-				{
-					ublock[idx++] = ublock[0];
-					ublock[idx++] = ublock[1];
-					ublock[idx++] = ublock[2];
-				}
-			}
-			/*	compress the block	*/
-			++block_count;
-			compress_DDS_color_block( 3, ublock, cblock );
-			/*	copy the data from the block into the main block	*/
-			for( x = 0; x < 8; ++x)
-			{
-				compressed[index++] = cblock[x];
+				compressAlphaBlock(block, out);
+				compressColorBlock(block, quality, out + 8);
 			}
+			else
+				compressColorBlock(block, quality, out);
 		}
 	}
 	return compressed;
 }
 
-uint8_t* Image_DXT::convertImageToDXT5(const uint8_t* const uncompressed, int width, int height, int channels, int* out_size)
+std::vector<uint8_t> Image_DXT::convertImageToDXT1(const uint8_t* uncompressed, int32_t width, int32_t height,
+		int32_t channels, Quality quality/* = Quality::RANGE_FIT */)
 {
-	uint8_t ublock[16*4];
-	uint8_t cblock[8];
-	int index = 0, chan_step = 1;
-	int block_count = 0;
-	/*	error check	*/
-	*out_size = 0;
-	assert(uncompressed != nullptr);
-	assert(width > 0 && height > 0);
-	assert(1 <= channels && channels <= 4);
+	return compress(uncompressed, width, height, channels, quality, false);
+}
 
-	/*	for channels == 1 or 2, I do not step forward for R,G,B vales	*/
-	if( channels < 3 )
-	{
-		chan_step = 0;
-	}
-	/*	# channels = 1 or 3 have no alpha, 2 & 4 do have alpha	*/
-	const bool has_alpha = (channels & 1) == 0;
-	/*	get the RAM for the compressed image
-		(16 bytes per 4x4 pixel block)	*/
-	*out_size = ((width+3) >> 2) * ((height+3) >> 2) * 16;
-	uint8_t * compressed = (uint8_t*)malloc( *out_size );
-	/*	go through each block	*/
-	for(int j = 0; j < height; j += 4)
+std::vector<uint8_t> Image_DXT::convertImageToDXT5(const uint8_t* uncompressed, int32_t width, int32_t height,
+		int32_t channels, Quality quality/* = Quality::RANGE_FIT */)
+{
+	return compress(uncompressed, width, height, channels, quality, true);
+}
+
+static void decompress(const uint8_t* compressed, int32_t width, int32_t height, bool dxt5, uint8_t* rgba)
+{
+	assert(compressed != nullptr && rgba != nullptr);
+	const int32_t blockWidth = (width + 3) / 4, blockHeight = (height + 3) / 4;
+	const size_t blockSize = dxt5? 16: 8;
+
+	#pragma omp parallel for
+	for(int32_t by = 0; by < blockHeight; ++by)
 	{
-		for(int i = 0; i < width; i += 4)
+		uint8_t block[64];
+		const uint8_t* in = compressed + static_cast<size_t>(by) * blockWidth * blockSize;
+		for(int32_t bx = 0; bx < blockWidth; ++bx, in += blockSize)
 		{
-			/*	local variables, and my block counter	*/
-			int idx = 0;
-			int mx = 4, my = 4;
-			if( j+4 >= height )
+			if(dxt5)
 			{
-				my = height - j;
-			}
-			if( i+4 >= width )
-			{
-				mx = width - i;
-			}
-			for(int y = 0; y < my; ++y)
-			{
-				for(int x = 0; x < mx; ++x)
-				{
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels];
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels+chan_step];
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels+chan_step+chan_step];
-					ublock[idx++] = has_alpha ? uncompressed[(j+y)*width*channels+(i+x)*channels+channels-1]:255;
-				}
-				for(int x = mx; x < 4; ++x)
-				{
-					ublock[idx++] = ublock[0];
-					ublock[idx++] = ublock[1];
-					ublock[idx++] = ublock[2];
-					ublock[idx++] = ublock[3];
-				}
-			}
-			for(int y = my; y < 4; ++y)
-			{
-				for(int x = 0; x < 4; ++x)
-				{
-					ublock[idx++] = ublock[0];
-					ublock[idx++] = ublock[1];
-					ublock[idx++] = ublock[2];
-					ublock[idx++] = ublock[3];
-				}
-			}
-			/*	now compress the alpha block	*/
-			compress_DDS_alpha_block( ublock, cblock );
-			/*	copy the data from the compressed alpha block into the main buffer	*/
-			for(int x = 0; x < 8; ++x)
-			{
-				compressed[index++] = cblock[x];
-			}
-			/*	then compress the color block	*/
-			++block_count;
-			compress_DDS_color_block( 4, ublock, cblock );
-			/*	copy the data from the compressed color block into the main buffer	*/
-			for(int x = 0; x < 8; ++x)
-			{
-				compressed[index++] = cblock[x];
+				decompressColorBlock(in + 8, false, block);
+				decompressAlphaBlock(in, block);
 			}
+			else
+				decompressColorBlock(in, true, block);
+			storeBlock(block, width, height, bx * BLOCK_SIZE, by * BLOCK_SIZE, rgba);
 		}
 	}
-	return compressed;
+}
+
+void Image_DXT::convertDXT1ToImage(const uint8_t* compressed, int32_t width, int32_t height, uint8_t* rgba)
+{
+	decompress(compressed, width, height, false, rgba);
+}
+
+void Image_DXT::convertDXT5ToImage(const uint8_t* compressed, int32_t width, int32_t height, uint8_t* rgba)
+{
+	decompress(compressed, width, height, true, rgba);
+}
+
+bool Image_DXT::probe(const uint8_t* data, size_t length)
+{
+	return length >= sizeof(DDS_header) && std::memcmp(data, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+std::shared_ptr<Image_DXT> Image_DXT::decodeByteArray(const uint8_t* data, size_t length)
+{
+	std::shared_ptr<Image_DXT> image;
+	if(!probe(data, length))
+	{
+		slog.d(TAG, "not a DDS file!");
+		return image;
+	}
+
+	DDS_header header;
+	std::memcpy(&header, data, sizeof(header));
+	const uint32_t fourCC = header.sPixelFormat.dwFourCC;
+	const bool dxt5 = fourCC == FOURCC_DXT5;
+	if((header.sPixelFormat.dwFlags & DDPF_FOURCC) == 0 || (fourCC != FOURCC_DXT1 && !dxt5))
+	{
+		slog.w(TAG, "only DXT1 and DXT5 are supported");
+		return image;
+	}
+
+	const int32_t width = header.dwWidth, height = header.dwHeight;
+	const size_t blockCount = static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4);
+	if(width <= 0 || height <= 0 || length - sizeof(header) < blockCount * (dxt5? 16: 8))
+	{
+		slog.w(TAG, "bad DDS size %dx%d", width, height);
+		return image;
+	}
+
+	image = std::make_shared<Image_DXT>(width, height, Color::C4_U8);
+	decompress(data + sizeof(header), width, height, dxt5, image->getData());
+	return image;
+}
+
+std::shared_ptr<Image_DXT> Image_DXT::decodeFile(const std::string& path)
+{
+	std::ifstream file(path, std::ios::in | std::ios::binary);
+	if(!file.is_open())
+	{
+		slog.w(TAG, "invalid path: %s", path.c_str());
+		return std::shared_ptr<Image_DXT>();
+	}
+
+	std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	return decodeByteArray(bytes.data(), bytes.size());
 }
@@ -1,13 +1,42 @@
 #ifndef PEA_GRAPHICS_IMAGE_DXT_H_
 #define PEA_GRAPHICS_IMAGE_DXT_H_
 
+#include <memory>
+#include <vector>
+
 #include "graphics/Image.h"
 
 namespace pea {
 
+/**
+ * DXT1 (BC1) and DXT5 (BC3) block compression, stored in DirectDraw Surface (.dds) files.
+ *
+ * Pixels are compressed in 4x4 blocks. DXT1 stores a block in 8 bytes, two RGB565 endpoints and a
+ * 2 bit index per pixel into the 4 colors interpolated between them. DXT5 prepends 8 bytes of
+ * alpha, two 8 bit endpoints and a 3 bit index per pixel. Blocks are independent, so both the
+ * encoder and the decoder work on block rows in parallel.
+ *
+ * @see https://docs.microsoft.com/en-us/windows/win32/direct3d10/d3d10-graphics-programming-guide-resources-block-compression
+ * @see Simon Brown, squish, http://sjbrown.co.uk/2006/01/19/dxt-compression-techniques/
+ */
 class Image_DXT: public Image
 {
+public:
+	enum class Quality: uint8_t
+	{
+		/**
+		 * Endpoints are the extremes of the pixels projected on the principal axis.
+		 */
+		RANGE_FIT,
+		
+		/**
+		 * Try every ordered partition of the pixels into the 4 palette entries along the principal
+		 * axis, and solve the endpoints by least squares. Two orders of magnitude slower than range fit.
+		 */
+		CLUSTER_FIT,
+	};
 
+private:
 	//	A bunch of DirectDraw Surface structures and flags
 	struct DDS_header
 	{
@@ -47,23 +76,58 @@ class Image_DXT: public Image
 		uint32_t dwReserved2;
 	};
 
+	Quality quality;
+
 public:
 	static const uint8_t MAGIC[4];
 
 public:
+	Image_DXT();
+	Image_DXT(uint32_t width, uint32_t height, Color::Format format);
+	Image_DXT(uint32_t width, uint32_t height, Color::Format format, uint8_t* data, bool move);
+	virtual ~Image_DXT() = default;
 	
-//	Format getImageFormat() const override { return Format::DXT; }
+	Format getImageFormat() const override { return Format::DDS; }
+	
+	void setQuality(Quality quality);
+	Quality getQuality() const;
 	
 	/**
-	 * take an image and convert it to DXT1 (no alpha)
+	 * Compress an image to DXT1, alpha is ignored.
+	 * @param[in] uncompressed 8 bit pixels, tightly packed.
+	 * @param[in] channels     1 (gray), 2 (gray, alpha), 3 (RGB) or 4 (RGBA).
+	 * @return 8 bytes per block, blocks in row major order.
 	 */
-	static uint8_t* convertImageToDXT1(const uint8_t* const uncompressed, int width, int height, int channels, int* out_size);
+	static std::vector<uint8_t> convertImageToDXT1(const uint8_t* uncompressed, int32_t width, int32_t height,
+			int32_t channels, Quality quality = Quality::RANGE_FIT);
 
 	/**
-	 * take an image and convert it to DXT5 (with alpha)
+	 * Compress an image to DXT5, channel 1 and 3 are taken as opaque.
+	 * @return 16 bytes per block, blocks in row major order.
 	 */
-	static uint8_t* convertImageToDXT5(const uint8_t* const uncompressed, int width, int height, int channels, int* out_size);
+	static std::vector<uint8_t> convertImageToDXT5(const uint8_t* uncompressed, int32_t width, int32_t height,
+			int32_t channels, Quality quality = Quality::RANGE_FIT);
 
+	/**
+	 * Decompress DXT1 blocks to RGBA pixels.
+	 * @param[out] rgba width * height * 4 bytes.
+	 */
+	static void convertDXT1ToImage(const uint8_t* compressed, int32_t width, int32_t height, uint8_t* rgba);
+	
+	/**
+	 * Decompress DXT5 blocks to RGBA pixels.
+	 * @param[out] rgba width * height * 4 bytes.
+	 */
+	static void convertDXT5ToImage(const uint8_t* compressed, int32_t width, int32_t height, uint8_t* rgba);
+	
+	static bool probe(const uint8_t* data, size_t length);
+	
+	/**
+	 * Decode a DXT1 or DXT5 .dds file, only the top mip level is read. Pixels are C4_U8.
+	 */
+	static std::shared_ptr<Image_DXT> decodeByteArray(const uint8_t* data, size_t length);
+	static std::shared_ptr<Image_DXT> decodeFile(const std::string& path);
+	
 	/**
 	 * Converts an image from an array of unsigned chars (RGB or RGBA) to
 	 * DXT1 or DXT5, then saves the converted image to disk.
@@ -72,6 +136,9 @@ public:
 	virtual bool save(const std::string& path) const override;
 };
 
+inline void Image_DXT::setQuality(Quality quality) { this->quality = quality; }
+inline Image_DXT::Quality Image_DXT::getQuality() const { return quality; }
+
 
 
 /*	the following constants were copied directly off the MSDN website	*/
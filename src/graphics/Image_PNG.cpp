@@ -1,10 +1,20 @@
 #include "graphics/Image_PNG.h"
 
-#include <fstream>
+#include <algorithm>
+#include <cassert>
+#include <cinttypes>
+#include <cstdlib>
 #include <cstring>
+#include <fstream>
 #include <vector>
 
 #include <png.h>
+#include <zlib.h>
+
+#include "pea/config.h"
+#if OpenMP_CXX_FOUND
+#include <omp.h>
+#endif
 
 #include "util/Log.h"
 #include "util/utility.h"
@@ -56,408 +66,538 @@ bool Image_PNG::probe(const uint8_t* data, size_t length)
 	return std::memcmp(data, MAGIC, sizeof(MAGIC)) == 0;
 }
 
-std::shared_ptr<Image_PNG> Image_PNG::decodeByteArray(const uint8_t* data, size_t length)
+Image_PNG::Decoder::Decoder():
+		png(nullptr),
+		info(nullptr),
+		file(nullptr),
+		source(nullptr),
+		sourceLength(0),
+		sourceOffset(0),
+		width(0),
+		height(0),
+		colorFormat(Color::UNKNOWN),
+		rowStride(0),
+		row(0),
+		interlaced(false)
 {
-	uint32_t width = 0, height =0;
-	Color::Format colorFormat = Color::C4_U8;
-	uint8_t* imageData = nullptr;
-	
-	assert(probe(data, length));
-	data += sizeofArray(MAGIC);
+}
 
-	png_struct* png_ptr   = nullptr;
-	png_info*   info_ptr  = nullptr;
+Image_PNG::Decoder::~Decoder()
+{
+	close();
+}
 
-	do
-	{
-		// png_create_read_struct(user_png_ver, error_ptr, error_fn, warn_fn))
-		png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
-		if(!png_ptr)
-			break;
+void Image_PNG::Decoder::readData(png_struct* png, png_byte* data, size_t length)
+{
+	Decoder* decoder = reinterpret_cast<Decoder*>(png_get_io_ptr(png));
+	if(decoder->sourceLength - decoder->sourceOffset < length)
+		png_error(png, "read beyond the end of data");
 
-		info_ptr = png_create_info_struct(png_ptr);
-		if(!info_ptr)
-			break;
+	std::memcpy(data, decoder->source + decoder->sourceOffset, length);
+	decoder->sourceOffset += length;
+}
 
-		if(setjmp(png_jmpbuf(png_ptr)))
-		{
-			png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
-			break;
-		}
+bool Image_PNG::Decoder::open(const uint8_t* data, size_t length)
+{
+	close();
+	if(!probe(data, length))
+	{
+		slog.w(TAG, "not a PNG");
+		return false;
+	}
+
+	source = data;
+	sourceLength = length;
+	sourceOffset = 0;
+	png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+	if(png == nullptr)
+		return false;
 
-		png_set_read_fn(png_ptr, nullptr, nullptr);
-//		png_set_read_fn(png_ptr, &image_source, pngReadFunction);
-		png_read_info(png_ptr, info_ptr);
+	png_set_read_fn(png, this, readData);
+	return begin();
+}
 
-		int bit_depth, color_type, interlace_type;
-		png_get_IHDR(png_ptr, info_ptr, &width, &height, &bit_depth, &color_type, &interlace_type, nullptr, nullptr);
+bool Image_PNG::Decoder::open(const std::string& path)
+{
+	close();
+	file = fopen(path.c_str(), "rb");
+	if(!file)
+	{
+		slog.w(TAG, "can't open file %s for reading", path.c_str());
+		return false;
+	}
 
-		// strip 16 bits color files down to 8 bits color.
-		// Use accurate scaling if it's available, otherwise just chop off the low byte.
-		if(bit_depth == 16)
-#ifdef PNG_READ_SCALE_16_TO_8_SUPPORTED
-			png_set_scale_16(png_ptr);
-#else
-			png_set_strip_16(png_ptr);
-#endif
+	png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+	if(png == nullptr)
+	{
+		close();
+		return false;
+	}
 
-		// Extract multiple pixels with bit depths of 1, 2, and 4 from a single
-		// byte into separate bytes (useful for paletted and grayscale images).
-		if(bit_depth < 8)
-			png_set_packing(png_ptr);
+	png_init_io(png, file);
+	return begin();
+}
 
-		// Expand paletted colors into true RGB triplets
-		if(color_type == PNG_COLOR_TYPE_PALETTE)
-			png_set_palette_to_rgb(png_ptr);
+bool Image_PNG::Decoder::begin()
+{
+	info = png_create_info_struct(png);
+	if(!info || setjmp(png_jmpbuf(png)))
+	{
+		slog.e(TAG, "failed to read PNG header");
+		close();
+		return false;
+	}
 
-		// low-bit-depth grayscale images are to be expanded to 8 bits
-		if(color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8)
-			png_set_expand_gray_1_2_4_to_8(png_ptr);
+	png_read_info(png, info);
 
-		// Expand paletted or RGB images with transparency to full alpha channels
-		// so the data will be available as RGBA quartets.
-		if(png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS) != 0)
-			png_set_tRNS_to_alpha(png_ptr);
+	int bit_depth, color_type, interlace_type;
+	png_get_IHDR(png, info, &width, &height, &bit_depth, &color_type, &interlace_type, nullptr, nullptr);
 
-		// Optional call to gamma correct and add the background to the palette
-		// and update info structure.  REQUIRED if you are expecting libpng to
-		// update the palette for you (ie you selected such a transform above).
-		png_read_update_info(png_ptr, info_ptr);
+	// strip 16 bits color files down to 8 bits color.
+	// Use accurate scaling if it's available, otherwise just chop off the low byte.
+	if(bit_depth == 16)
+#ifdef PNG_READ_SCALE_16_TO_8_SUPPORTED
+		png_set_scale_16(png);
+#else
+		png_set_strip_16(png);
+#endif
 
-		bit_depth = png_get_bit_depth(png_ptr, info_ptr);
-		color_type = png_get_color_type(png_ptr, info_ptr);
+	// Extract multiple pixels with bit depths of 1, 2, and 4 from a single
+	// byte into separate bytes (useful for paletted and grayscale images).
+	if(bit_depth < 8)
+		png_set_packing(png);
 
-		switch(color_type)
-		{
-		case PNG_COLOR_TYPE_GRAY:
-			colorFormat = Color::Format::C1_U8;
-			break;
-		case PNG_COLOR_TYPE_GRAY_ALPHA:
-			colorFormat = Color::Format::C2_U8;
-			break;
-		case PNG_COLOR_TYPE_RGB:
-			colorFormat = Color::Format::C3_U8;
-			break;
-		case PNG_COLOR_TYPE_RGB_ALPHA:
-			colorFormat = Color::Format::C4_U8;
-			break;
-		default:
-			colorFormat = Color::Format::UNKNOWN;
-			slog.e(TAG, "unknown color type (%d)", color_type);
-//			assert(false);
-			break;
-		}
+	// Expand paletted colors into true RGB triplets
+	if(color_type == PNG_COLOR_TYPE_PALETTE)
+		png_set_palette_to_rgb(png);
 
-		// read png data
-		png_size_t row_bytes = png_get_rowbytes(png_ptr, info_ptr);
-		const png_byte** row_pointers = new const png_byte* [height];
-		if(!row_pointers)
-			break;
+	// low-bit-depth grayscale images are to be expanded to 8 bits
+	if(color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8)
+		png_set_expand_gray_1_2_4_to_8(png);
 
-		for(png_uint_32 i = 0; i < height; ++i)
-			row_pointers[i] = data + i*row_bytes;
+	// Expand paletted or RGB images with transparency to full alpha channels
+	// so the data will be available as RGBA quartets.
+	if(png_get_valid(png, info, PNG_INFO_tRNS) != 0)
+		png_set_tRNS_to_alpha(png);
 
-		imageData = new (std::nothrow) uint8_t[height * row_bytes];
-		if(!imageData)
-		{
-			delete[] row_pointers;
-			break;
-		}
+	interlaced = png_set_interlace_handling(png) > 1;
 
-		png_read_image(png_ptr, const_cast<png_byte**>(row_pointers));
-		png_read_end(png_ptr, nullptr);
+	// Optional call to gamma correct and add the background to the palette
+	// and update info structure.  REQUIRED if you are expecting libpng to
+	// update the palette for you (ie you selected such a transform above).
+	png_read_update_info(png, info);
 
-		// pre-multiplied alpha for RGBA8888
-//		if(color_type == PNG_COLOR_TYPE_RGB_ALPHA)
-//			premultipliedAlpha();
-//		else
-//			_hasPremultipliedAlpha = false;
+	color_type = png_get_color_type(png, info);
+	switch(color_type)
+	{
+	case PNG_COLOR_TYPE_GRAY:       colorFormat = Color::C1_U8; break;
+	case PNG_COLOR_TYPE_GRAY_ALPHA: colorFormat = Color::C2_U8; break;
+	case PNG_COLOR_TYPE_RGB:        colorFormat = Color::C3_U8; break;
+	case PNG_COLOR_TYPE_RGB_ALPHA:  colorFormat = Color::C4_U8; break;
+	default:
+		slog.e(TAG, "unknown color type (%d)", color_type);
+		close();
+		return false;
+	}
 
-		delete[] row_pointers;
-	} while(false);
+	rowStride = png_get_rowbytes(png, info);
+	row = 0;
+	return true;
+}
 
-	return std::make_shared<Image_PNG>(width, height, colorFormat, imageData, true);
+void Image_PNG::Decoder::close()
+{
+	if(png != nullptr)
+		png_destroy_read_struct(&png, info != nullptr? &info: nullptr, nullptr);
+	png = nullptr;
+	info = nullptr;
+
+	if(file != nullptr)
+		fclose(file);
+	file = nullptr;
+
+	source = nullptr;
+	sourceLength = sourceOffset = 0;
+	width = height = 0;
+	colorFormat = Color::UNKNOWN;
+	rowStride = 0;
+	row = 0;
+	interlaced = false;
+	std::vector<uint8_t>().swap(image);
 }
 
-std::shared_ptr<Image_PNG> Image_PNG::decodeFile(const std::string& path)
+uint32_t Image_PNG::Decoder::read(uint8_t* buffer, size_t stride, uint32_t rowCount)
 {
-	uint32_t width = 0, height = 0, rowStride = 0;
-	Color::Format colorFormat = Color::C4_U8;
-	uint8_t* data = nullptr;
-#if 0
-	png_image image;  // The control structure used by libpng
-	std::memset(&image, 0, (sizeof image));
-	image.version = PNG_IMAGE_VERSION;
-
-	if(png_image_begin_read_from_file(&image, path.c_str()) != 0)
+	assert(buffer != nullptr && stride >= rowStride);
+	if(png == nullptr)
+		return 0;
+
+	// parameters assigned before setjmp() may be clobbered by longjmp().
+	const uint32_t count = std::min(rowCount, height - row);
+	const uint32_t first = row;
+	if(setjmp(png_jmpbuf(png)))
 	{
-		image.format = PNG_FORMAT_RGBA;
-		data = new (std::nothrow) uint8_t[PNG_IMAGE_SIZE(image)];
-/*
-	'background' is not necessary when reading the image, because the alpha channel is preserved; 
-	if it were to be removed, for example if we requested PNG_FORMAT_RGB, then either a solid 
-	background color would have to be supplied, or the output buffer would have to be initialized to
-	the actual background of the image.
-	
-	'row_stride' is the number of components allocated for the image in each row. It has to be 
-	at least as big as the value returned by PNG_IMAGE_ROW_STRIDE, but if you just allocate space 
-	for the default, minimum size, using PNG_IMAGE_SIZE as above, you can pass zero.
-	
-	'colormap' have exactly the same format as a row of image pixels (so you choose what format 
-	to make the colormap by setting image.format). A colormap is only returned if
-	PNG_FORMAT_FLAG_COLORMAP is also set in image.format, so in this case NULL is passed as the 
-	final argument. If you do want to force all images into an index/color-mapped format, then you 
-	can use PNG_IMAGE_COLORMAP_SIZE(image) to find the maximum size of the colormap in bytes.
-*/
-		png_const_color* background = nullptr;
-		void* colormap = nullptr;
-		if(data != nullptr)
-		{
-//			rowStride = PNG_IMAGE_ROW_STRIDE(image);
-			if(png_image_finish_read(&image, background, data, rowStride, colormap) != 0)
-				return make_shared<Image_PNG>(image.width, image.height, colorFormat, data);
-		}
-		else
+		slog.e(TAG, "failed to decode row %" PRIu32, row);
+		const uint32_t done = row - first;
+		close();
+		return done;
+	}
+
+	if(interlaced)
+	{
+		// rows of all passes are needed before any row is complete.
+		if(image.empty())
 		{
-			png_image_free(&image);
+			image.resize(rowStride * height);
+			std::vector<png_byte*> rows(height);
+			for(uint32_t y = 0; y < height; ++y)
+				rows[y] = image.data() + rowStride * y;
+			png_read_image(png, rows.data());
 		}
+
+		for(uint32_t i = 0; i < count; ++i, ++row)
+			std::memcpy(buffer + stride * i, image.data() + rowStride * row, rowStride);
 	}
 	else
 	{
-/*
-	Something went wrong reading or writing the image.
-	libpng stores a textual message in the 'png_image' structure:
-*/
-		slog.e(TAG, "pngtopng: error: %s\n", image.message);
+		for(uint32_t i = 0; i < count; ++i, ++row)
+			png_read_row(png, buffer + stride * i, nullptr);
 	}
-	
-#endif
-	
-	FILE *file = fopen(path.c_str(), "rb");
-	if(!file)
+
+	if(row == height && count > 0)
+		png_read_end(png, nullptr);
+
+	return count;
+}
+
+static std::shared_ptr<Image_PNG> decode(Image_PNG::Decoder& decoder)
+{
+	const uint32_t width = decoder.getWidth(), height = decoder.getHeight();
+	const size_t rowStride = decoder.getRowStride();
+	uint8_t* data = new (std::nothrow) uint8_t[rowStride * height];
+	if(data == nullptr)
 	{
-		slog.w(TAG, "can't open file %s for reading", path.c_str());
+		slog.e(TAG, "allocation of %" PRIu32 "x%" PRIu32 " image failed", width, height);
 		return std::make_shared<Image_PNG>();
 	}
 
-	png_struct* png_ptr = nullptr;
-	png_info* info_ptr = nullptr;
-	
-	png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING,
-			nullptr,  // user_error_ptr
-			nullptr,  // user_error_fn
-			nullptr); // user_warning_fn
-	if(!png_ptr)
+	if(decoder.read(data, rowStride, height) != height)
 	{
-		slog.e(TAG, "png_create_read_struct returned 0.");
-		goto bail;
+		delete[] data;
+		return std::make_shared<Image_PNG>();
 	}
 
-	info_ptr = png_create_info_struct(png_ptr);
-	if(!info_ptr || setjmp(png_jmpbuf(png_ptr)))
-	{
-		slog.e(TAG, "png_create_read_struct returned 0 or set error handling failed.");
-		png_destroy_write_struct(&png_ptr, (info_ptr == nullptr)? nullptr:&info_ptr);
-		goto bail;
-	}
+	return std::make_shared<Image_PNG>(width, height, decoder.getColorFormat(), data, true);
+}
 
-	png_init_io(png_ptr, file);
-	png_read_info(png_ptr, info_ptr);
+std::shared_ptr<Image_PNG> Image_PNG::decodeByteArray(const uint8_t* data, size_t length)
+{
+	Decoder decoder;
+	if(!decoder.open(data, length))
+		return std::make_shared<Image_PNG>();
 
-	int bit_depth, color_type, interlace_type;
-	png_get_IHDR(png_ptr, info_ptr, &width, &height, &bit_depth, &color_type, &interlace_type, nullptr, nullptr);
+	return decode(decoder);
+}
 
-//	png_set_strip_alpha(png_ptr);  // Strip alpha bytes
-//	png_set_packing(png_ptr);  // pack 1, 2, and 4 BPP into bytes, useful for paletted and grayscale images
-	switch(color_type)
+std::shared_ptr<Image_PNG> Image_PNG::decodeFile(const std::string& path)
+{
+	Decoder decoder;
+	if(!decoder.open(path))
+		return std::make_shared<Image_PNG>();
+
+	return decode(decoder);
+}
+
+Image_PNG::Parameter::Parameter():
+		level(6),
+		filter(Filter::ADAPTIVE),
+		stripeSize(256 * 1024)
+{
+}
+
+namespace {
+
+constexpr size_t WINDOW_SIZE = 32768;  // deflate window, the dictionary a stripe inherits
+
+struct Stripe
+{
+	uint32_t begin, end;  // rows
+	std::vector<uint8_t> chunk;  // IDAT chunk, length and CRC excluded
+	uint32_t adler;
+	size_t length;  // byte size of filtered rows
+	bool ok;
+};
+
+inline uint8_t paeth(uint8_t a, uint8_t b, uint8_t c)
+{
+	int32_t p = a + b - c;
+	int32_t pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+	if(pa <= pb && pa <= pc)
+		return a;
+	return pb <= pc? b: c;
+}
+
+/**
+ * Filter a row, out[0] is filter type, followed by length filtered bytes.
+ * @param[in] prior previous row, or zeros for the first row.
+ */
+void filterRow(uint8_t type, const uint8_t* row, const uint8_t* prior, size_t length, uint32_t bpp, uint8_t* out)
+{
+	out[0] = type;
+	++out;
+	switch(static_cast<Image_PNG::Filter>(type))
 	{
-	case PNG_COLOR_TYPE_GRAY:
-		if(bit_depth < 8)  // Expand grayscale images to the full 8 bits from 1, 2, or 4 BPP
-			png_set_expand_gray_1_2_4_to_8(png_ptr);
-		colorFormat = Color::C1_U8;
+	case Image_PNG::Filter::NONE:
+		std::memcpy(out, row, length);
 		break;
-	case PNG_COLOR_TYPE_PALETTE:  // Expand paletted colors into true RGB triplets
-		png_set_palette_to_rgb(png_ptr);
-		colorFormat = Color::C1_U8;  //FIXME does palette have alpha?
+	case Image_PNG::Filter::SUB:
+		std::memcpy(out, row, bpp);
+		for(size_t i = bpp; i < length; ++i)
+			out[i] = row[i] - row[i - bpp];
 		break;
-	case PNG_COLOR_TYPE_GRAY_ALPHA:
-		colorFormat = Color::C2_U8;
+	case Image_PNG::Filter::UP:
+		for(size_t i = 0; i < length; ++i)
+			out[i] = row[i] - prior[i];
 		break;
-	case PNG_COLOR_TYPE_RGB:
-		colorFormat = Color::C3_U8;
+	case Image_PNG::Filter::AVERAGE:
+		for(size_t i = 0; i < bpp; ++i)
+			out[i] = row[i] - (prior[i] >> 1);
+		for(size_t i = bpp; i < length; ++i)
+			out[i] = row[i] - ((row[i - bpp] + prior[i]) >> 1);
 		break;
-	case PNG_COLOR_TYPE_RGBA:
-		colorFormat = Color::C4_U8;
+	case Image_PNG::Filter::PAETH:
+		for(size_t i = 0; i < bpp; ++i)
+			out[i] = row[i] - prior[i];  // paeth(0, b, 0) == b
+		for(size_t i = bpp; i < length; ++i)
+			out[i] = row[i] - paeth(row[i - bpp], prior[i], prior[i - bpp]);
 		break;
-
 	default:
-		colorFormat = Color::UNKNOWN;
-		slog.d(TAG, "unknown color type: %d", color_type);
+		assert(false);
 		break;
 	}
+}
 
-	// We use png_read_image and rely on that for interlace handling, but we also
-	// call png_read_update_info therefore must turn on interlace handling now:
-	(void)png_set_interlace_handling(png_ptr);
-
-	// Optional call to gamma correct and add the background to the palette
-	// and update info structure.  REQUIRED if you are expecting libpng to
-	// update the palette for you (i.e., you selected such a transform above).
-	png_read_update_info(png_ptr, info_ptr);
-
-	png_free_data(png_ptr, info_ptr, PNG_FREE_ROWS, 0);
+/**
+ * Score of a filtered row, sum of bytes taken as signed, smaller deflates better in general.
+ */
+uint32_t score(const uint8_t* out, size_t length)
+{
+	uint32_t sum = 0;
+	for(size_t i = 0; i < length; ++i)
+		sum += std::abs(static_cast<int8_t>(out[i]));
+	return sum;
+}
 
-	rowStride = width * Color::size(colorFormat);  // FIXME enum class
-	data = new (std::nothrow) uint8_t[height * rowStride];
-	if(data)
-	{
-		png_byte** row_pointers = reinterpret_cast<png_byte**>(png_malloc(png_ptr, height * sizeof(png_byte*)));
-		for(png_uint_32 row = 0; row < height; ++row)
-			row_pointers[row] = data + rowStride * row;
-#ifdef PNG_INFO_IMAGE_SUPPORTED
-		png_set_rows(png_ptr, info_ptr, row_pointers);
-#endif
+inline void write32(uint8_t* out, uint32_t value)
+{
+	out[0] = static_cast<uint8_t>(value >> 24);
+	out[1] = static_cast<uint8_t>(value >> 16);
+	out[2] = static_cast<uint8_t>(value >> 8);
+	out[3] = static_cast<uint8_t>(value);
+}
 
-		png_read_image(png_ptr, row_pointers);
+bool writeChunk(FILE* file, const char* type, const uint8_t* data, size_t length)
+{
+	uint8_t header[8];
+	write32(header, static_cast<uint32_t>(length));
+	std::memcpy(header + 4, type, 4);
+	uLong crc = crc32(0, header + 4, 4);
+	if(length > 0)
+		crc = crc32(crc, data, static_cast<uInt>(length));  // crc32() returns 0 for null data
+	uint8_t footer[4];
+	write32(footer, static_cast<uint32_t>(crc));
+	return fwrite(header, sizeof(header), 1, file) == 1 &&
+			(length == 0 || fwrite(data, length, 1, file) == 1) &&
+			fwrite(footer, sizeof(footer), 1, file) == 1;
+}
 
-		// Read rest of file, and get additional chunks in info_ptr
-		png_read_end(png_ptr, info_ptr);
-	}
-	else
-		slog.e(TAG, "line (%d) allocation failed", __LINE__);
+}  // namespace
 
-bail:
-	fclose(file);
-	return std::make_shared<Image_PNG>(width, height, colorFormat, data, true);
+bool Image_PNG::save(const std::string& path) const
+{
+	return save(path, Parameter());
 }
 
-bool Image_PNG::save(const std::string& path) const
+bool Image_PNG::save(const std::string& path, const Parameter& parameter) const
 {
-	bool flag = false;
-	FILE* file = fopen(path.c_str(), "wb");
-	
-	do
+	uint8_t colorType;
+	uint32_t channelSize = 1;
+	switch(colorFormat)
 	{
-		if(!file)
-		{
-			slog.w(TAG, "can't open file %s for writing", path.c_str());
-			break;
-		}
+	case Color::C1_U16: channelSize = 2; [[fallthrough]];
+	case Color::C1_U8:  colorType = PNG_COLOR_TYPE_GRAY;       break;
+	case Color::C2_U16: channelSize = 2; [[fallthrough]];
+	case Color::C2_U8:  colorType = PNG_COLOR_TYPE_GRAY_ALPHA; break;
+	case Color::C3_U16: channelSize = 2; [[fallthrough]];
+	case Color::C3_U8:  colorType = PNG_COLOR_TYPE_RGB;        break;
+	case Color::C4_U16: channelSize = 2; [[fallthrough]];
+	case Color::C4_U8:  colorType = PNG_COLOR_TYPE_RGBA;       break;
+	default:
+		slog.w(TAG, "can't save color format 0x%X as PNG", colorFormat);
+		return false;
+	}
 
-/*
-	Create and initialize the png_struct with the desired error handler functions.
-	If you want to use the default stderr and longjump method,
-	you can supply NULL for the last three parameters.  We also check that
-	the library version is compatible with the one used at compile time,
-	in case we are using dynamically linked libraries.  REQUIRED.
-*/
-		png_voidp error_ptr = nullptr;
-		png_error_ptr error_fn = nullptr;
-		png_error_ptr warn_fn = nullptr;
-		png_struct* png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, error_ptr, error_fn, warn_fn);
-		if(!png_ptr)
-		{
-			slog.e(TAG, "png_create_write_struct returned 0.");
-			break;
-		}
+	if(!isValid())
+		return false;
+
+	const uint32_t bpp = Color::size(colorFormat);
+	const size_t rowSize = static_cast<size_t>(width) * bpp;
+	const size_t filteredRowSize = rowSize + 1;
+	const uint32_t stripeRowCount = std::max<uint32_t>(1, static_cast<uint32_t>(
+			std::min<size_t>(height, std::max<size_t>(parameter.stripeSize, 1) / filteredRowSize)));
+	const uint32_t dictionaryRowCount = static_cast<uint32_t>((WINDOW_SIZE + filteredRowSize - 1) / filteredRowSize);
+	const int32_t level = std::clamp(parameter.level, 0, 9);
+
+	std::vector<Stripe> stripes((height + stripeRowCount - 1) / stripeRowCount);
+	for(size_t i = 0; i < stripes.size(); ++i)
+	{
+		stripes[i].begin = static_cast<uint32_t>(i * stripeRowCount);
+		stripes[i].end = std::min(height, stripes[i].begin + stripeRowCount);
+	}
 
-		// Allocate/initialize the image information data.  REQUIRED.
-		png_info* info_ptr = png_create_info_struct(png_ptr);
-		if(!info_ptr || setjmp(png_jmpbuf(png_ptr)))
+	// PNG rows go top down, 16 bit channels are big-endian.
+	const uint8_t* pixels = getData();
+	auto getRow = [=](uint32_t y, uint8_t* buffer) -> const uint8_t*
+	{
+		const uint8_t* row = pixels + rowSize * (bottomUp? height - 1 - y: y);
+		if(channelSize == 1)
+			return row;
+		for(size_t i = 0; i < rowSize; i += 2)
 		{
-			slog.e(TAG, "png_create_read_struct returned 0 or set error handling failed.");
-			png_destroy_write_struct(&png_ptr, (info_ptr == nullptr)? nullptr : &info_ptr);
-			break;
+			buffer[i] = row[i + 1];
+			buffer[i + 1] = row[i];
 		}
+		return buffer;
+	};
 
-		png_init_io(png_ptr, file);
-		
-		int color_type;
-		switch(colorFormat)
+	auto encode = [&](Stripe& stripe, bool last)
+	{
+		stripe.ok = false;
+		// filter the tail of the previous stripe again, as dictionary.
+		const uint32_t begin = stripe.begin > dictionaryRowCount? stripe.begin - dictionaryRowCount: 0;
+		std::vector<uint8_t> filtered(filteredRowSize * (stripe.end - begin));
+		std::vector<uint8_t> buffer(rowSize * 2);
+		std::vector<uint8_t> candidates(parameter.filter == Filter::ADAPTIVE? filteredRowSize * 5: 0);
+		const std::vector<uint8_t> zeros(begin == 0? rowSize: 0);
+
+		uint8_t* current = buffer.data();
+		uint8_t* spare = buffer.data() + rowSize;
+		const uint8_t* prior = begin == 0? zeros.data(): getRow(begin - 1, spare);
+		for(uint32_t y = begin; y < stripe.end; ++y)
 		{
-		case Color::C1_U8:
-			color_type = PNG_COLOR_TYPE_GRAY;
-			break;
-/*
-		case PNG_COLOR_TYPE_PALETTE:  // Expand paletted colors into true RGB triplets
-			png_set_palette_to_rgb(png_ptr);
-			colorFormat = Color::G_8;  //FIXME does palette have alpha?
-			break;
-*/
-		case Color::C2_U8:
-			color_type = PNG_COLOR_TYPE_GRAY_ALPHA;
-			break;
-		case Color::C3_U8:
-			color_type = PNG_COLOR_TYPE_RGB;
-			break;
-
-		default:
-			slog.d(TAG, "unknown color format: %d", colorFormat);
-			assert(false);
-			[[fallthrough]];
-		case Color::C4_U8:
-			color_type = PNG_COLOR_TYPE_RGBA;
-			break;
+			const uint8_t* row = getRow(y, current);
+			uint8_t* out = filtered.data() + filteredRowSize * (y - begin);
+			if(parameter.filter != Filter::ADAPTIVE)
+				filterRow(static_cast<uint8_t>(parameter.filter), row, prior, rowSize, bpp, out);
+			else
+			{
+				uint32_t best = 0, minimum = UINT32_MAX;
+				for(uint32_t type = 0; type < 5; ++type)
+				{
+					uint8_t* candidate = candidates.data() + filteredRowSize * type;
+					filterRow(static_cast<uint8_t>(type), row, prior, rowSize, bpp, candidate);
+					uint32_t value = score(candidate + 1, rowSize);
+					if(value < minimum)
+					{
+						minimum = value;
+						best = type;
+					}
+				}
+				std::memcpy(out, candidates.data() + filteredRowSize * best, filteredRowSize);
+			}
+			prior = row;
+			std::swap(current, spare);
 		}
 
-		/* Set the image information here. Width and height are up to 2^31,
-		 * bit_depth is one of 1, 2, 4, 8, or 16, but valid values also depend on
-		 * the color_type selected. color_type is one of PNG_COLOR_TYPE_GRAY,
-		 * PNG_COLOR_TYPE_GRAY_ALPHA, PNG_COLOR_TYPE_PALETTE, PNG_COLOR_TYPE_RGB,
-		 * or PNG_COLOR_TYPE_RGB_ALPHA.  interlace is either PNG_INTERLACE_NONE or
-		 * PNG_INTERLACE_ADAM7, and the compression_type and filter_type MUST
-		 * currently be PNG_COMPRESSION_TYPE_BASE and PNG_FILTER_TYPE_BASE. REQUIRED
-		 */
-		const int bit_depth = 8;
-		png_set_IHDR(png_ptr, info_ptr, this->width, this->height, bit_depth, color_type,
-				PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
-/*
-		// Optional significant bit (sBIT) chunk
-		png_color_8 sig_bit;  //FIXME all the color format
-		sig_bit.red = bit_depth;
-		sig_bit.green = bit_depth;
-		sig_bit.blue = bit_depth;
-		sig_bit.alpha = bit_depth; // no alpha channel
-		png_set_sBIT(png_ptr, info_ptr, &sig_bit);
-*/
-		// Optionally write comments into the image
-		png_text text;
-		text.key = const_cast<char*>("Description");  // cast to char*, or -Wno-write-strings to silent warning: deprecated
-		text.text = const_cast<char*>("made in Pea"); // conversion from string constant to ‘png_charp {aka char*}’.
-		text.compression = PNG_TEXT_COMPRESSION_NONE;
-#ifdef PNG_iTXt_SUPPORTED
-		text.itxt_length = 0;
-		text.lang = nullptr;
-		text.lang_key = nullptr;
-#endif
-		png_set_text(png_ptr, info_ptr, &text, 1);
-
-		// Write the file header information.
-		png_write_info(png_ptr, info_ptr);
-
-		if((png_uint_32)this->height > PNG_UINT_32_MAX / (sizeof(png_byte*)))
+		const uint8_t* input = filtered.data() + filteredRowSize * (stripe.begin - begin);
+		stripe.length = filteredRowSize * (stripe.end - stripe.begin);
+		stripe.adler = static_cast<uint32_t>(adler32(adler32(0, nullptr, 0), input, static_cast<uInt>(stripe.length)));
+
+		z_stream stream;
+		std::memset(&stream, 0, sizeof(stream));
+		if(deflateInit2(&stream, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)  // raw deflate
+			return;
+
+		const size_t dictionaryLength = std::min(WINDOW_SIZE, static_cast<size_t>(input - filtered.data()));
+		if(dictionaryLength > 0)
+			deflateSetDictionary(&stream, input - dictionaryLength, static_cast<uInt>(dictionaryLength));
+
+		std::vector<uint8_t>& chunk = stripe.chunk;
+		size_t offset = chunk.size();
+		chunk.resize(offset + deflateBound(&stream, static_cast<uLong>(stripe.length)) + 16);
+		stream.next_in = const_cast<uint8_t*>(input);
+		stream.avail_in = static_cast<uInt>(stripe.length);
+		const int32_t flush = last? Z_FINISH: Z_SYNC_FLUSH;
+		int32_t result;
+		do
 		{
-			slog.e(TAG, "Image is too tall to process in memory");
-			break;
-		}
-		
-		std::vector<png_byte*> row_pointers(height);
-		uint32_t row_stride = width * Color::size(colorFormat);
-		const uint8_t* row_pointer = this->getData();
-//		slog.i(TAG, "width=%d, height=%d, row_stride=%d", width, height, row_stride);
-		for(uint32_t k = 0; k < height; ++k)
+			if(offset == chunk.size())
+				chunk.resize(chunk.size() * 2);
+			stream.next_out = chunk.data() + offset;
+			stream.avail_out = static_cast<uInt>(chunk.size() - offset);
+			result = deflate(&stream, flush);
+			offset = chunk.size() - stream.avail_out;
+		} while(result == Z_OK && (last || stream.avail_out == 0));
+		deflateEnd(&stream);
+
+		chunk.resize(offset);
+		stripe.ok = last? result == Z_STREAM_END: result == Z_OK || result == Z_BUF_ERROR;
+	};
+
+	// zlib header, CINFO is 32K window, FLEVEL tells compression level
+	const uint8_t cmf = 0x78;
+	uint8_t flg = static_cast<uint8_t>((level < 2? 0: level < 6? 1: level == 6? 2: 3) << 6);
+	flg += 31 - (cmf * 256 + flg) % 31;
+	stripes.front().chunk = { cmf, flg };
+
+	const int32_t stripeCount = static_cast<int32_t>(stripes.size());
+#pragma omp parallel for schedule(dynamic)
+	for(int32_t i = 0; i < stripeCount; ++i)
+		encode(stripes[i], i + 1 == stripeCount);
+
+	uLong adler = adler32(0, nullptr, 0);
+	for(const Stripe& stripe: stripes)
+	{
+		if(!stripe.ok)
 		{
-			row_pointers[k] = const_cast<png_byte*>(row_pointer);
-			row_pointer += row_stride;
+			slog.e(TAG, "deflate failed at rows [%" PRIu32 ", %" PRIu32 ")", stripe.begin, stripe.end);
+			return false;
 		}
-		
-		png_write_image(png_ptr, row_pointers.data());
-		png_write_end(png_ptr, info_ptr);
+		adler = adler32_combine(adler, stripe.adler, static_cast<z_off_t>(stripe.length));
+	}
+	uint8_t trailer[4];
+	write32(trailer, static_cast<uint32_t>(adler));
+	stripes.back().chunk.insert(stripes.back().chunk.end(), trailer, trailer + 4);
 
-		png_destroy_write_struct(&png_ptr, &info_ptr);
-		flag = true;
-	} while(false);
-	
-	fclose(file);
-	return flag;
+	FILE* file = fopen(path.c_str(), "wb");
+	if(!file)
+	{
+		slog.w(TAG, "can't open file %s for writing", path.c_str());
+		return false;
+	}
+
+	uint8_t header[13];
+	write32(header, width);
+	write32(header + 4, height);
+	header[8] = static_cast<uint8_t>(channelSize * 8);  // bit depth
+	header[9] = colorType;
+	header[10] = PNG_COMPRESSION_TYPE_BASE;
+	header[11] = PNG_FILTER_TYPE_BASE;
+	header[12] = PNG_INTERLACE_NONE;
+	const char text[] = "Description\0made in Pea";
+
+	bool flag = fwrite(MAGIC, sizeof(MAGIC), 1, file) == 1 &&
+			writeChunk(file, "IHDR", header, sizeof(header)) &&
+			writeChunk(file, "tEXt", reinterpret_cast<const uint8_t*>(text), sizeof(text) - 1);
+	// one IDAT chunk per stripe, decoders see them as one stream.
+	for(size_t i = 0; flag && i < stripes.size(); ++i)
+		flag = writeChunk(file, "IDAT", stripes[i].chunk.data(), stripes[i].chunk.size());
+	flag = flag && writeChunk(file, "IEND", nullptr, 0);
+
+	if(fclose(file) != 0 || !flag)
+	{
+		slog.w(TAG, "failed to write file %s", path.c_str());
+		return false;
+	}
+	return true;
 }
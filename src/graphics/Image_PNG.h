@@ -1,14 +1,49 @@
 #ifndef PEA_GRAPHICS_IMAGE_PNG_H_
 #define PEA_GRAPHICS_IMAGE_PNG_H_
 
+#include <cstdio>
 #include <memory>
+#include <vector>
 
 #include "graphics/Image.h"
 
+struct png_struct_def;
+struct png_info_def;
+
 namespace pea {
 
 class Image_PNG: public Image
 {
+public:
+	/**
+	 * Filter applied to each row before deflate, @see https://www.w3.org/TR/png/#9Filter-types
+	 */
+	enum class Filter: uint8_t
+	{
+		NONE,
+		SUB,
+		UP,
+		AVERAGE,
+		PAETH,
+		ADAPTIVE,  ///< per row, the filter of minimum sum of absolute differences
+	};
+
+	/**
+	 * Encoder settings of save(), trading speed for size.
+	 *
+	 * Rows are cut into stripes which are filtered and deflated in parallel, each stripe primed
+	 * with the last 32KB of the previous one as dictionary, and ends on a byte boundary with a
+	 * sync flush, so that the stripes concatenate into one zlib stream, as pigz does.
+	 */
+	struct Parameter
+	{
+		int32_t level;        ///< zlib level, 0 (stored) to 9 (smallest), 6 by default.
+		Filter filter;        ///< ADAPTIVE by default, NONE is the fastest.
+		uint32_t stripeSize;  ///< byte size of filtered rows a thread deflates at a time, 256KB by default.
+
+		Parameter();
+	};
+
 private:
 //	std::map<const std::string, std::string> comments;
 //	http://zarb.org/~gc/html/libpng.html
@@ -25,9 +60,113 @@ public:
 	static std::shared_ptr<Image_PNG> decodeByteArray(const uint8_t* data, size_t length);
 	static std::shared_ptr<Image_PNG> decodeFile(const std::string& path);
 
+	class Decoder;
+
 	bool save(const std::string& path) const override;
 
+	/**
+	 * Save 8 or 16 bit gray, gray alpha, RGB or RGBA image, stripes of rows are deflated on all
+	 * threads.
+	 * @return false if the color format has no PNG counterpart, or file can't be written.
+	 */
+	bool save(const std::string& path, const Parameter& parameter) const;
 };
 
+/**
+ * @class Image_PNG::Decoder
+ * Decode a PNG image progressively, a block of rows at a time, into buffers the caller owns.
+ * So a consumer like a mapped pixel buffer or a downsampler needn't wait for, nor hold, the
+ * full resolution image. Memory used is about one row plus zlib window, except for interlaced
+ * images, whose Adam7 passes are merged into a whole image before the first row comes out.
+ *
+ * 16 bit channels are scaled to 8 bits, palette and low bit depth gray are expanded, tRNS chunk
+ * becomes an alpha channel.
+ *
+ * @code
+ *   Image_PNG::Decoder decoder;
+ *   if(decoder.open(path))
+ *       while(decoder.getRow() < decoder.getHeight())
+ *           consume(block, decoder.read(block, stride, 64));
+ * @endcode
+ */
+class Image_PNG::Decoder
+{
+private:
+	png_struct_def* png;
+	png_info_def* info;
+	FILE* file;
+
+	const uint8_t* source;  ///< PNG in memory, owned by caller
+	size_t sourceLength;
+	size_t sourceOffset;
+
+	uint32_t width;
+	uint32_t height;
+	Color::Format colorFormat;
+	size_t rowStride;
+	uint32_t row;   ///< next row to read
+	bool interlaced;
+	std::vector<uint8_t> image;  ///< interlaced image only
+
+private:
+	static void readData(png_struct_def* png, uint8_t* data, size_t length);
+
+	bool begin();
+
+public:
+	Decoder();
+	~Decoder();
+
+	Decoder(const Decoder& other) = delete;
+	Decoder& operator =(const Decoder& other) = delete;
+
+	/**
+	 * Read the header of a PNG in memory.
+	 * @param[in] data   PNG file content, it must stay alive until the decoder is closed.
+	 * @param[in] length byte size of data.
+	 * @return false if data isn't a valid PNG.
+	 */
+	bool open(const uint8_t* data, size_t length);
+
+	/**
+	 * Read the header of a PNG file.
+	 */
+	bool open(const std::string& path);
+
+	void close();
+
+	uint32_t getWidth() const;
+	uint32_t getHeight() const;
+	Color::Format getColorFormat() const;
+
+	/**
+	 * @return byte size of a decoded row, without padding.
+	 */
+	size_t getRowStride() const;
+
+	/**
+	 * @return index of the next row read() gives.
+	 */
+	uint32_t getRow() const;
+
+	bool isInterlaced() const;
+
+	/**
+	 * Decode next rows, top down.
+	 * @param[out] buffer   where rows are stored, at least rowCount rows.
+	 * @param[in]  stride   byte offset between rows in buffer, at least getRowStride().
+	 * @param[in]  rowCount maximum row count to decode.
+	 * @return row count decoded, less than rowCount at the end of image or on error.
+	 */
+	uint32_t read(uint8_t* buffer, size_t stride, uint32_t rowCount);
+};
+
+inline uint32_t Image_PNG::Decoder::getWidth() const  { return width;  }
+inline uint32_t Image_PNG::Decoder::getHeight() const { return height; }
+inline Color::Format Image_PNG::Decoder::getColorFormat() const { return colorFormat; }
+inline size_t Image_PNG::Decoder::getRowStride() const { return rowStride; }
+inline uint32_t Image_PNG::Decoder::getRow() const { return row; }
+inline bool Image_PNG::Decoder::isInterlaced() const { return interlaced; }
+
 }  // namespace pea
 #endif  // PEA_GRAPHICS_IMAGE_PNG_H_
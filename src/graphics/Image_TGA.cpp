@@ -1,10 +1,31 @@
 #include "graphics/Image_TGA.h"
 
+#include <algorithm>
+#include <cassert>
+#include <cinttypes>
 #include <cstring>
 #include <ctime>
 #include <fstream>
+#include <type_traits>
 #include <vector>
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TGA_SSE2 1
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "pea/config.h"
+#if OpenMP_CXX_FOUND
+#include <omp.h>
+#endif
+
+#include "graphics/MappedImage.h"
+#include "graphics/PixelConverter.h"
+#include "io/MappedFile.h"
 #include "util/Log.h"
 #include "util/platform.h"
 
@@ -37,31 +58,213 @@ Image_TGA::~Image_TGA()
 
 }
 
-/*
-	size_t length = rle(nullptr, src, n);
-	uint8_t* dst = new uint8_t[length];
-	if(dst)
-		rle(dst, src, n);
-*/
-static size_t rle(uint8_t* dst, const uint8_t* src, size_t n)
+static inline uint32_t countTrailingZeros(uint32_t x)
 {
-	assert(n%2 == 0);  // one char followed by it's length
-	size_t length = 0;
-	for(size_t i = 1; i < n; i += 2)
-		length += src[i];
+	assert(x != 0);
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward(&index, x);
+	return index;
+#else
+	return __builtin_ctz(x);
+#endif
+}
 
-	if(dst)
+/**
+ * @return bit i set if pixel i equals pixel i + 1, for i in [0, 16). 17 pixels are read.
+ */
+template <uint32_t N>
+static uint32_t getRepeatMask(const uint8_t* p)
+{
+	uint32_t mask = 0;
+#if TGA_SSE2
+	if constexpr(N == 1)
 	{
-		for(size_t i = 0; i < n; )
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 1));
+		mask = _mm_movemask_epi8(_mm_cmpeq_epi8(a, b));
+	}
+	else if constexpr(N == 2)
+	{
+		__m128i e[2];
+		for(int32_t k = 0; k < 2; ++k)
 		{
-			char ch = src[i++];
-			uint8_t repeat = src[i++];
-			while(repeat > 0)
-				*dst++ = ch;
+			__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * k));
+			__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * k + 2));
+			e[k] = _mm_cmpeq_epi16(a, b);
 		}
+		mask = _mm_movemask_epi8(_mm_packs_epi16(e[0], e[1]));
+	}
+	else if constexpr(N == 3)
+	{
+		// pixel i repeats if bytes 3i, 3i+1 and 3i+2 all do.
+		uint64_t bytes = 0;
+		for(int32_t k = 0; k < 3; ++k)
+		{
+			__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * k));
+			__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * k + 3));
+			bytes |= static_cast<uint64_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(a, b))) << (16 * k);
+		}
+		bytes &= (bytes >> 1) & (bytes >> 2);
+		for(uint32_t i = 0; i < 16; ++i)
+			mask |= static_cast<uint32_t>((bytes >> (3 * i)) & 1) << i;
+	}
+	else
+	{
+		for(int32_t k = 0; k < 4; ++k)
+		{
+			__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * k));
+			__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * k + 4));
+			mask |= _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(a, b))) << (4 * k);
+		}
+	}
+#else
+	for(uint32_t i = 0; i < 16; ++i)
+		mask |= static_cast<uint32_t>(std::memcmp(p + i * N, p + i * N + N, N) == 0) << i;
+#endif
+	return mask;
+}
+
+/**
+ * @return count of consecutive pixels from i on that equal (or differ from) their next pixel.
+ */
+template <uint32_t N>
+static size_t scan(const uint8_t* pixels, size_t count, size_t i, bool repeat, size_t limit)
+{
+	size_t n = 0;
+	while(n < limit && i + n + 1 < count)
+	{
+		const size_t j = i + n;
+		if(j + 17 <= count)
+		{
+			uint32_t mask = getRepeatMask<N>(pixels + j * N);
+			if(!repeat)
+				mask = ~mask & 0xFFFF;
+			uint32_t ones = countTrailingZeros(~mask);
+			n += ones;
+			if(ones < 16)
+				break;
+		}
+		else if((std::memcmp(pixels + j * N, pixels + j * N + N, N) == 0) == repeat)
+			++n;
+		else
+			break;
+	}
+	return std::min(n, limit);
+}
+
+template <uint32_t N>
+static size_t encodeRow(const uint8_t* pixels, size_t count, uint8_t* packet)
+{
+	uint8_t* begin = packet;
+	for(size_t i = 0; i < count;)
+	{
+		size_t repeat = scan<N>(pixels, count, i, true, 127);
+		if(repeat > 0)  // run packet of repeat + 1 pixels
+		{
+			*packet++ = static_cast<uint8_t>(0x80 | repeat);
+			std::memcpy(packet, pixels + i * N, N);
+			packet += N;
+			i += repeat + 1;
+			continue;
+		}
+
+		// raw packet, up to the pixel that starts a run, the last pixel has nothing to repeat.
+		size_t n = scan<N>(pixels, count, i, false, 128);
+		if(i + n + 1 == count)
+			++n;
+		n = std::min<size_t>(std::max<size_t>(n, 1), 128);
+		*packet++ = static_cast<uint8_t>(n - 1);
+		std::memcpy(packet, pixels + i * N, n * N);
+		packet += n * N;
+		i += n;
+	}
+	return packet - begin;
+}
+
+template <uint32_t N>
+static void fill(uint8_t* pixels, const uint8_t* pixel, size_t count)
+{
+	if constexpr(N == 1)
+		std::memset(pixels, pixel[0], count);
+	else if constexpr(N == 3)
+	{
+		// double the filled part
+		std::memcpy(pixels, pixel, N);
+		for(size_t done = 1; done < count;)
+		{
+			size_t n = std::min(done, count - done);
+			std::memcpy(pixels + done * N, pixels, n * N);
+			done += n;
+		}
+	}
+	else
+	{
+		using T = std::conditional_t<N == 2, uint16_t, uint32_t>;
+		T value;
+		std::memcpy(&value, pixel, N);
+		T* p = reinterpret_cast<T*>(pixels);
+		for(size_t i = 0; i < count; ++i)
+			std::memcpy(p + i, &value, N);
+	}
+}
+
+template <uint32_t N>
+static size_t decodeRow(const uint8_t* data, size_t length, uint8_t* pixels, size_t count)
+{
+	const uint8_t* p = data;
+	const uint8_t* const end = data + length;
+	for(size_t i = 0; i < count;)
+	{
+		if(p >= end)
+			return 0;
+
+		const uint8_t header = *p++;
+		const size_t n = (header & 0x7F) + 1;
+		if(i + n > count)
+			return 0;
+
+		const size_t size = (header & 0x80)? N: n * N;
+		if(static_cast<size_t>(end - p) < size)
+			return 0;
+
+		if(header & 0x80)
+			fill<N>(pixels + i * N, p, n);
+		else
+			std::memcpy(pixels + i * N, p, size);
+		p += size;
+		i += n;
 	}
+	return p - data;
+}
 
-	return length;
+size_t Image_TGA::encodeRLE(const uint8_t* pixels, size_t count, uint32_t bytes, uint8_t* packet)
+{
+	switch(bytes)
+	{
+	case 1: return encodeRow<1>(pixels, count, packet);
+	case 2: return encodeRow<2>(pixels, count, packet);
+	case 3: return encodeRow<3>(pixels, count, packet);
+	case 4: return encodeRow<4>(pixels, count, packet);
+	default: assert(false); return 0;
+	}
+}
+
+size_t Image_TGA::getRLEBound(size_t count, uint32_t bytes)
+{
+	return count * bytes + (count + 127) / 128;  // all raw packets
+}
+
+size_t Image_TGA::decodeRLE(const uint8_t* data, size_t length, uint32_t bytes, uint8_t* pixels, size_t count)
+{
+	switch(bytes)
+	{
+	case 1: return decodeRow<1>(data, length, pixels, count);
+	case 2: return decodeRow<2>(data, length, pixels, count);
+	case 3: return decodeRow<3>(data, length, pixels, count);
+	case 4: return decodeRow<4>(data, length, pixels, count);
+	default: assert(false); return 0;
+	}
 }
 
 bool Image_TGA::probe(const uint8_t* data, size_t length)
@@ -75,218 +278,154 @@ bool Image_TGA::probe(const uint8_t* data, size_t length)
 
 std::shared_ptr<Image_TGA> Image_TGA::decodeByteArray(const uint8_t* data, size_t length)
 {
-	uint32_t width = 0, height = 0;
-	Color::Format colorFormat = Color::C4_U8;
-	uint8_t* imageData = nullptr;
-	
 	if(length < sizeof(Header))
 		return nullptr;
 
-	const Header* header = reinterpret_cast<const Header*>(data);
-	width = header->width;
-	height = header->height;
-//	uint16_t xOrigin = header->xOrigin;
-//	uint16_t yOrigin = header->yOrigin;
-
-	// TODO big endian with BYTE2SWAP
-	assert(false);
-	std::shared_ptr<Image_TGA> image = std::make_shared<Image_TGA>(width, height, colorFormat, imageData, true);
-	image->setOrigin(header->xOrigin, header->yOrigin);
-	return image;
-}
-
-std::shared_ptr<Image_TGA> Image_TGA::decodeFile(const std::string& path)
-{
-	uint32_t width = 0, height = 0;
-	Color::Format colorFormat = Color::C4_U8;
-	uint8_t* data = nullptr;
-	
-	uint8_t bytes;
-	size_t length;
-	std::vector<uint32_t> colorMap;
-	uint16_t xOrigin = 0, yOrigin = 0;
-	Descriptor descriptor = static_cast<Descriptor>(0);
-	
-//	std::fstream file(path);
-	FILE* file = fopen(path.c_str(), "rb");
-	if(!file)
-	{
-		slog.w(TAG, "file [%s] not found", path.c_str());
-		goto bail;
-	}
-
 	Header header;
-	fread(&header, sizeof(header), 1, file);
-
+	std::memcpy(&header, data, sizeof(header));
 #if __BIG_ENDIAN__
 	byte2swap(header.colorMapStart);
 	byte2swap(header.colorMapLength);
 	byte2swap(header.xOrigin);
-	byte2swap(header.xOrigin);
+	byte2swap(header.yOrigin);
 	byte2swap(header.width);
 	byte2swap(header.height);
 #endif
 
-	if(header.colorMapBits != 15 && header.colorMapBits != 16 &&
-			header.colorMapBits != 24 && header.colorMapBits != 32)
-	{
-		slog.e(TAG, "invalid colorMapBits value(%d)", static_cast<int>(header.colorMapBits));
-		goto bail;
-	}
-
-	// skip image identifier field
-	if(header.idLength)
-		(void)fseek(file, header.idLength, SEEK_SET);
-
-	if(header.colorMapType == 1)  // indicates that a color-map is included with this image.
-	{
-		colorMap.reserve(header.colorMapLength);
-		const size_t colorMapBytes = (header.colorMapBits + 7)/8;  // ceiling, make 15 return 2.
-		size_t paletteSize = header.colorMapLength * colorMapBytes;
-		std::vector<uint8_t> palette(paletteSize);
-		fread(palette.data(), paletteSize, 1, file);
-
-		// convert to 32 bits palette
-		uint32_t* d = static_cast<uint32_t*>(colorMap.data());
-		const uint8_t* s = static_cast<const uint8_t*>(palette.data());
-		for(size_t i = 0; i < header.colorMapLength; ++i, ++d)
-		{
-			switch(header.colorMapBits)
-			{
-			case 15:
-				*d = Color::from_RGBX5551(*reinterpret_cast<const uint16_t*>(s));
-				s += 2;
-				break;
-			
-			case 16:
-				*d = Color::from_RGBA5551(*reinterpret_cast<const uint16_t*>(s));
-				s += 2;
-				break;
-			
-			case 24:
-				*d = (s[0] | (s[1] << 8) | (s[2] << 16) | 0xFF000000);
-				s += 3;
-				break;
-			
-			case 32:
-				*d = *reinterpret_cast<const uint32_t*>(s);
-				s += 4;
-				break;
-			}
-		}
-	}
-
-	bytes = header.depth / 8;
-	switch(bytes)
-	{
-	case 1: colorFormat = Color::Format::C1_U8; break;
-	case 2: colorFormat = Color::Format::C2_U8; break;
-	case 3: colorFormat = Color::Format::C3_U8; break;
-	case 4: colorFormat = Color::Format::C4_U8; break;
-	default: assert(false); goto bail;          break;
-	}
-
-	width = header.width;
-	height = header.height;
-	length = header.width * header.height * bytes;
-	data = new (std::nothrow) uint8_t[length];
-	if(!data)
-		goto bail;
-	
+	Color::Format colorFormat = Color::UNKNOWN;
 	switch(header.imageType)
 	{
-	case TGA_NONE:
-		break;
-	case TGA_INDEXED:
-	case TGA_INDEXED_RLE:
-		break;
 	case TGA_RGB:
 	case TGA_RGB_RLE:
-		colorFormat = (bytes == 3) ? Color::Format::C3_U8 : Color::Format::C4_U8;
+		colorFormat = header.depth == 16? Color::RGBA5551_U16: header.depth == 24? Color::C3_U8:
+				header.depth == 32? Color::C4_U8: Color::UNKNOWN;
 		break;
 	case TGA_GRAYSCALE:
 	case TGA_GRAYSCALE_RLE:
-		colorFormat = Color::Format::C1_U8;
+		colorFormat = header.depth == 8? Color::C1_U8: header.depth == 16? Color::C2_U8: Color::UNKNOWN;
+		break;
+	default:  // TODO TGA_INDEXED, TGA_INDEXED_RLE
 		break;
 	}
 
-	// TODO
-	if(header.imageType == TGA_NONE)
-		slog.d(TAG, "TGA_NONE is unimplemented yet.");
-	if(header.imageType == TGA_INDEXED)
-		slog.d(TAG, "TGA_INDEXED is unimplemented yet.");
-	else if(header.imageType == TGA_RGB)
+	if(colorFormat == Color::UNKNOWN)
 	{
-		colorFormat = Color::Format::C3_U8;
-		fread(data, length, 1, file);
+		slog.w(TAG, "unsupported TGA type %d of %d bits", static_cast<int>(header.imageType), header.depth);
+		return nullptr;
 	}
-	else if(header.imageType == TGA_GRAYSCALE)
+
+	// 24 and 32 bit pixels are stored in BGR(A) order, and swizzled to RGB(A) once decoded.
+	const Color::Format fileFormat = colorFormat == Color::C3_U8? Color::BGR888_U24:
+			colorFormat == Color::C4_U8? Color::BGRA8888_U32: colorFormat;
+
+	size_t offset = sizeof(Header) + header.idLength;
+	if(header.colorMapType == 1)
+		offset += header.colorMapLength * ((header.colorMapBits + 7) / 8);  // ceiling, make 15 return 2.
+
+	const uint32_t width = header.width, height = header.height;
+	const uint32_t bytes = header.depth / 8;
+	const size_t count = static_cast<size_t>(width) * height;
+	std::unique_ptr<uint8_t[]> pixels(new (std::nothrow) uint8_t[count * bytes]);
+	if(!pixels || offset > length)
+		return nullptr;
+
+	const bool rle = header.imageType == TGA_RGB_RLE || header.imageType == TGA_GRAYSCALE_RLE;
+	if(rle)
 	{
-		colorFormat = Color::Format::C1_U8;
-		fread(data, length, 1, file);
+		if(decodeRLE(data + offset, length - offset, bytes, pixels.get(), count) == 0 && count > 0)
+		{
+			slog.w(TAG, "RLE packets are truncated or corrupted");
+			return nullptr;
+		}
 	}
-	else if(TGA_INDEXED_RLE <= header.imageType && header.imageType <= TGA_GRAYSCALE_RLE)  // RLE compressed pixels
+	else
 	{
-		for(size_t i = 0; i < length;)
+		if(length - offset < count * bytes)
 		{
-			uint8_t ch = fgetc(file);
-			if(ch >= 128)  // RLE data
-			{
-				uint8_t r = fgetc(file), g = fgetc(file), b = fgetc(file);
-				uint8_t a = (bytes == 4)?fgetc(file):255;
-//				uint32_t color = Color::rgba(r, g, b, a);
-
-				for(uint8_t j = ch - 127; j > 0; --j)
-				{
-					data[i++] = r;
-					data[i++] = g;
-					data[i++] = b;
-					if(bytes == 4)
-						data[i++] = a;
-				}
-			}
-			else  // non RLE pixels
-			{
-				uint32_t stride = ch + 1;
-				fread(data + i, stride, 1, file);
-				i += stride;
-			}
+			slog.w(TAG, "not enough data for a %" PRIu32 "x%" PRIu32 " image", width, height);
+			return nullptr;
 		}
+		std::memcpy(pixels.get(), data + offset, count * bytes);
 	}
+	if(fileFormat != colorFormat)
+		PixelConverter::convert(fileFormat, pixels.get(), colorFormat, pixels.get(), count);
 
-	// post processing
-/*
-	if(header.descriptor & DESC_LEFT_TO_RIGHT)
-		slog.v(TAG, "left to right");
-	else
-		slog.v(TAG, "right to left");
-	if(header.descriptor & DESC_TOP_TO_BOTTOM)
-		slog.v(TAG, "top to bottom");
-	else
-		slog.v(TAG, "bottom to top");
-*/
-	descriptor = header.descriptor;
+	uint8_t* imageData = pixels.release();
+	std::shared_ptr<Image_TGA> image = std::make_shared<Image_TGA>(width, height, colorFormat, imageData, true);
+	image->setOrigin(header.xOrigin, header.yOrigin);
+	image->descriptor = header.descriptor;
 
-bail:
-	fclose(file);
-	
-	std::shared_ptr<Image_TGA> image = std::make_shared<Image_TGA>(width, height, colorFormat, data, true);
-//	slog.d(TAG, "width=%u, height=%u, format=%d, data=%p", width, height, colorFormat, data);
-	image->setOrigin(xOrigin, yOrigin);
-	image->descriptor = descriptor;
-	
-	if((descriptor & DESC_TOP_TO_BOTTOM) != DESC_TOP_TO_BOTTOM)
+	if((header.descriptor & DESC_TOP_TO_BOTTOM) != DESC_TOP_TO_BOTTOM)
 	{
 		slog.i(TAG, "image goes from bottom to top, flip vertically!");
 		image->flipVertical();
-		descriptor |= DESC_TOP_TO_BOTTOM;
-		yOrigin = height - yOrigin;
+		image->descriptor |= DESC_TOP_TO_BOTTOM;
+		image->yOrigin = height - header.yOrigin;
 	}
-	
+
 	return image;
 }
 
+std::shared_ptr<Image_TGA> Image_TGA::decodeFile(const std::string& path)
+{
+	MappedFile file;
+	if(!file.open(path))
+	{
+		slog.w(TAG, "file [%s] not found", path.c_str());
+		return nullptr;
+	}
+
+	return decodeByteArray(file.getData(), file.getSize());
+}
+
+std::shared_ptr<Image> Image_TGA::mapFile(const std::string& path)
+{
+	MappedFile file;
+	if(!file.open(path) || file.getSize() < sizeof(Header))
+		return nullptr;
+
+	Header header;
+	std::memcpy(&header, file.getData(), sizeof(header));
+#if __BIG_ENDIAN__
+	byte2swap(header.colorMapLength);
+	byte2swap(header.width);
+	byte2swap(header.height);
+#endif
+
+	Color::Format colorFormat = Color::UNKNOWN;
+	if(header.imageType == TGA_GRAYSCALE)
+		colorFormat = header.depth == 8? Color::C1_U8: header.depth == 16? Color::C2_U8: Color::UNKNOWN;
+	else if(header.imageType == TGA_RGB)
+		colorFormat = header.depth == 24? Color::BGR888_U24: header.depth == 32? Color::BGRA8888_U32: Color::UNKNOWN;
+
+	// bit 4 of descriptor set means pixels go from right to left.
+	if(colorFormat == Color::UNKNOWN || (header.descriptor & DESC_LEFT_TO_RIGHT) != 0)
+	{
+		slog.d(TAG, "can't map TGA type %d of %d bits", static_cast<int>(header.imageType), header.depth);
+		return nullptr;
+	}
+
+	size_t offset = sizeof(Header) + header.idLength;
+	if(header.colorMapType == 1)
+		offset += header.colorMapLength * ((header.colorMapBits + 7) / 8);
+	const uint32_t width = header.width, height = header.height;
+	const size_t size = static_cast<size_t>(width) * height * Color::size(colorFormat);
+	if(size == 0 || offset + size > file.getSize())
+	{
+		slog.d(TAG, "not enough data for a %" PRIu32 "x%" PRIu32 " image", width, height);
+		return nullptr;
+	}
+
+	const bool bottomUp = (header.descriptor & DESC_TOP_TO_BOTTOM) == 0;
+	return std::make_shared<MappedImage>(std::move(file), Format::TGA, width, height, colorFormat, offset, bottomUp);
+}
+
 bool Image_TGA::save(const std::string& path) const
+{
+	return save(path, false);
+}
+
+bool Image_TGA::save(const std::string& path, bool rle) const
 {
 	std::ofstream file(path, std::ios::out | std::ios::binary);
 	if(!file.is_open())
@@ -297,7 +436,10 @@ bool Image_TGA::save(const std::string& path) const
 
 	Type type = TGA_NONE;
 	uint8_t depth = 8;
-	Descriptor descriptor = this->descriptor;  // DESC_LEFT_TO_RIGHT | DESC_TOP_TO_BOTTOM;
+	// rows are written in memory order, RGB(A) pixels are swizzled to BGR(A) on the way.
+	Descriptor descriptor = static_cast<Descriptor>(isBottomUp()? this->descriptor & ~DESC_TOP_TO_BOTTOM:
+			this->descriptor | DESC_TOP_TO_BOTTOM);
+	Color::Format fileFormat = colorFormat;
 	switch(colorFormat)
 	{
 	case Color::Format::C1_U8:
@@ -306,7 +448,7 @@ bool Image_TGA::save(const std::string& path) const
 		break;
 	case Color::Format::C2_U8:
 		type = TGA_GRAYSCALE;
-		depth = 8;
+		depth = 16;
 		descriptor |= DESC_ALPHA_BIT3;
 		break;
 	case Color::Format::RGB565_U16:
@@ -319,10 +461,16 @@ bool Image_TGA::save(const std::string& path) const
 		descriptor |= DESC_ALPHA_BIT0;
 		break;
 	case Color::Format::C3_U8:
+		fileFormat = Color::Format::BGR888_U24;
+		[[fallthrough]];
+	case Color::Format::BGR888_U24:
 		type = TGA_RGB;
 		depth = 24;
 		break;
 	case Color::Format::C4_U8:
+		fileFormat = Color::Format::BGRA8888_U32;
+		[[fallthrough]];
+	case Color::Format::BGRA8888_U32:
 		type = TGA_RGB;
 		depth = 32;
 		descriptor |= DESC_ALPHA_BIT3;
@@ -332,6 +480,9 @@ bool Image_TGA::save(const std::string& path) const
 		break;
 	}
 
+	if(rle)
+		type = static_cast<Type>(type + (TGA_RGB_RLE - TGA_RGB));
+
 	Header header =
 	{
 		0,  // idLength, leave it empty
@@ -391,15 +542,58 @@ bool Image_TGA::save(const std::string& path) const
 
 	// write 32 bit RGBA color mode, no palette
 	// 1. TGA File Header; 2. Image/ColorMap Data; 3. Developer Area; 4. Extension Area; 5. TGA File Footer.
-	const size_t length = header.width * header.height * (header.depth / 8);
+	const uint32_t bytes = depth / 8;
+	const size_t rowSize = static_cast<size_t>(width) * bytes;
+	const bool swizzle = fileFormat != colorFormat;
+	const uint8_t* pixels = getData();
 	file.write(reinterpret_cast<char*>(&header), sizeof(header));
-	file.write(reinterpret_cast<const char*>(getData()), length);
+	if(!rle && !swizzle)
+		file.write(reinterpret_cast<const char*>(pixels), rowSize * height);
+	else if(!rle)
+	{
+		std::vector<uint8_t> row(rowSize);
+		for(uint32_t y = 0; y < height; ++y)
+		{
+			PixelConverter::convert(colorFormat, pixels + rowSize * y, fileFormat, row.data(), width);
+			file.write(reinterpret_cast<const char*>(row.data()), rowSize);
+		}
+	}
+	else
+	{
+		// rows are encoded on their own, blocks of rows go to threads, then are written in order.
+		const uint32_t blockHeight = std::max<uint32_t>(1, static_cast<uint32_t>((256 * 1024) / std::max<size_t>(rowSize, 1)));
+		const int32_t blockCount = static_cast<int32_t>((height + blockHeight - 1) / blockHeight);
+		std::vector<std::vector<uint8_t>> blocks(blockCount);
+#pragma omp parallel for schedule(dynamic)
+		for(int32_t i = 0; i < blockCount; ++i)
+		{
+			const uint32_t begin = i * blockHeight, end = std::min(height, begin + blockHeight);
+			std::vector<uint8_t>& block = blocks[i];
+			std::vector<uint8_t> row(swizzle? rowSize: 0);
+			block.resize(getRLEBound(width, bytes) * (end - begin));
+			size_t size = 0;
+			for(uint32_t y = begin; y < end; ++y)
+			{
+				const uint8_t* src = pixels + rowSize * y;
+				if(swizzle)
+				{
+					PixelConverter::convert(colorFormat, src, fileFormat, row.data(), width);
+					src = row.data();
+				}
+				size += encodeRLE(src, width, bytes, block.data() + size);
+			}
+			block.resize(size);
+		}
+
+		for(const std::vector<uint8_t>& block: blocks)
+			file.write(reinterpret_cast<const char*>(block.data()), block.size());
+	}
 //	file.write(reinterpret_cast<char*>(&developer), sizeof(developer));  // omit this part
 	file.write(reinterpret_cast<char*>(&extension), sizeof(extension));
 	file.write(reinterpret_cast<char*>(&footer), sizeof(footer));
 
 	file.close();
-	return true;
+	return !file.fail();
 }
 
 void Image_TGA::setOrigin(uint16_t x, uint16_t y)
@@ -117,9 +117,37 @@ public:
 
 	static std::shared_ptr<Image_TGA> decodeByteArray(const uint8_t* data, size_t length);
 	static std::shared_ptr<Image_TGA> decodeFile(const std::string& path);
+
+	/**
+	 * View pixels of an uncompressed true color or grayscale file in place.
+	 * @return nullptr if the file can't be viewed as is, decodeFile() it then.
+	 * @see MappedImage
+	 */
+	static std::shared_ptr<Image> mapFile(const std::string& path);
 	
 	virtual bool save(const std::string& path) const override;
 
+	/**
+	 * @param[in] rle run-length encode pixels. Packets stay within a row, so blocks of rows are
+	 *                encoded on all threads.
+	 */
+	bool save(const std::string& path, bool rle) const;
+
+	/**
+	 * Run-length encode a row of pixels into TGA packets, runs are searched 16 pixels at a time.
+	 * @param[in]  bytes  byte size of a pixel, 1 to 4.
+	 * @param[out] packet at least getRLEBound(count, bytes) bytes.
+	 * @return byte size of packets.
+	 */
+	static size_t encodeRLE(const uint8_t* pixels, size_t count, uint32_t bytes, uint8_t* packet);
+	static size_t getRLEBound(size_t count, uint32_t bytes);
+
+	/**
+	 * Expand TGA packets into count pixels, packets may cross rows.
+	 * @return byte size of packets consumed, 0 if data runs out or a packet overflows pixels.
+	 */
+	static size_t decodeRLE(const uint8_t* data, size_t length, uint32_t bytes, uint8_t* pixels, size_t count);
+
 	void setOrigin(uint16_t x, uint16_t y);
 };
 
@@ -0,0 +1,807 @@
+#include "graphics/KTX.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+
+#include "graphics/Image_PNG.h"
+#include "graphics/PixelConverter.h"
+#include "util/Log.h"
+
+
+static const char* TAG = "KTX";
+
+using namespace pea;
+
+using Compression = KTX::Compression;
+
+const uint8_t KTX::MAGIC_KTX1[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+const uint8_t KTX::MAGIC_KTX2[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+static constexpr uint32_t KTX1_HEADER_SIZE = 64;
+static constexpr uint32_t KTX2_HEADER_SIZE = 80;
+static constexpr uint32_t KTX1_LITTLE_ENDIAN = 0x04030201;
+static constexpr uint32_t KTX1_BIG_ENDIAN    = 0x01020304;
+static constexpr char ORIENTATION_KEY[] = "KTXorientation";
+
+// OpenGL enums, graphics doesn't depend on OpenGL headers.
+enum: uint32_t
+{
+	GL_UNSIGNED_BYTE  = 0x1401,
+	GL_UNSIGNED_SHORT = 0x1403,
+	GL_FLOAT          = 0x1406,
+	GL_HALF_FLOAT     = 0x140B,
+
+	GL_RED  = 0x1903,
+	GL_RG   = 0x8227,
+	GL_RGB  = 0x1907,
+	GL_RGBA = 0x1908,
+	GL_BGR  = 0x80E0,
+	GL_BGRA = 0x80E1,
+
+	GL_R8 = 0x8229, GL_RG8 = 0x822B, GL_RGB8 = 0x8051, GL_RGBA8 = 0x8058,
+	GL_SRGB8 = 0x8C41, GL_SRGB8_ALPHA8 = 0x8C43,
+	GL_R16 = 0x822A, GL_RG16 = 0x822C, GL_RGB16 = 0x8054, GL_RGBA16 = 0x805B,
+	GL_R16F = 0x822D, GL_RG16F = 0x822F, GL_RGB16F = 0x881B, GL_RGBA16F = 0x881A,
+	GL_R32F = 0x822E, GL_RG32F = 0x8230, GL_RGB32F = 0x8815, GL_RGBA32F = 0x8814,
+
+	GL_COMPRESSED_RGB_S3TC_DXT1_EXT        = 0x83F0,
+	GL_COMPRESSED_RGBA_S3TC_DXT1_EXT       = 0x83F1,
+	GL_COMPRESSED_RGBA_S3TC_DXT5_EXT       = 0x83F3,
+	GL_COMPRESSED_SRGB_S3TC_DXT1_EXT       = 0x8C4C,
+	GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT = 0x8C4D,
+	GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT = 0x8C4F,
+};
+
+struct FormatInfo
+{
+	Color::Format colorFormat;
+	Compression compression;
+	bool srgb;
+	uint32_t vkFormat;
+	uint32_t glInternalFormat;
+	uint32_t glFormat;
+	uint32_t glType;
+	uint32_t typeSize;
+};
+
+static const FormatInfo FORMATS[] =
+{
+	{ Color::C1_U8,  Compression::NONE, false,   9, GL_R8,     GL_RED,  GL_UNSIGNED_BYTE, 1 },
+	{ Color::C2_U8,  Compression::NONE, false,  16, GL_RG8,    GL_RG,   GL_UNSIGNED_BYTE, 1 },
+	{ Color::C3_U8,  Compression::NONE, false,  23, GL_RGB8,   GL_RGB,  GL_UNSIGNED_BYTE, 1 },
+	{ Color::C3_U8,  Compression::NONE, true,   29, GL_SRGB8,  GL_RGB,  GL_UNSIGNED_BYTE, 1 },
+	{ Color::C4_U8,  Compression::NONE, false,  37, GL_RGBA8,  GL_RGBA, GL_UNSIGNED_BYTE, 1 },
+	{ Color::C4_U8,  Compression::NONE, true,   43, GL_SRGB8_ALPHA8, GL_RGBA, GL_UNSIGNED_BYTE, 1 },
+	{ Color::BGR888_U24,   Compression::NONE, false, 30, GL_RGB8,  GL_BGR,  GL_UNSIGNED_BYTE, 1 },
+	{ Color::BGR888_U24,   Compression::NONE, true,  36, GL_SRGB8, GL_BGR,  GL_UNSIGNED_BYTE, 1 },
+	{ Color::BGRA8888_U32, Compression::NONE, false, 44, GL_RGBA8, GL_BGRA, GL_UNSIGNED_BYTE, 1 },
+	{ Color::BGRA8888_U32, Compression::NONE, true,  50, GL_SRGB8_ALPHA8, GL_BGRA, GL_UNSIGNED_BYTE, 1 },
+
+	{ Color::C1_U16, Compression::NONE, false,  70, GL_R16,    GL_RED,  GL_UNSIGNED_SHORT, 2 },
+	{ Color::C2_U16, Compression::NONE, false,  77, GL_RG16,   GL_RG,   GL_UNSIGNED_SHORT, 2 },
+	{ Color::C3_U16, Compression::NONE, false,  84, GL_RGB16,  GL_RGB,  GL_UNSIGNED_SHORT, 2 },
+	{ Color::C4_U16, Compression::NONE, false,  91, GL_RGBA16, GL_RGBA, GL_UNSIGNED_SHORT, 2 },
+	{ Color::C1_F16, Compression::NONE, false,  76, GL_R16F,   GL_RED,  GL_HALF_FLOAT, 2 },
+	{ Color::C2_F16, Compression::NONE, false,  83, GL_RG16F,  GL_RG,   GL_HALF_FLOAT, 2 },
+	{ Color::C3_F16, Compression::NONE, false,  90, GL_RGB16F, GL_RGB,  GL_HALF_FLOAT, 2 },
+	{ Color::C4_F16, Compression::NONE, false,  97, GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT, 2 },
+	{ Color::C1_F32, Compression::NONE, false, 100, GL_R32F,   GL_RED,  GL_FLOAT, 4 },
+	{ Color::C2_F32, Compression::NONE, false, 103, GL_RG32F,  GL_RG,   GL_FLOAT, 4 },
+	{ Color::C3_F32, Compression::NONE, false, 106, GL_RGB32F, GL_RGB,  GL_FLOAT, 4 },
+	{ Color::C4_F32, Compression::NONE, false, 109, GL_RGBA32F, GL_RGBA, GL_FLOAT, 4 },
+
+	// compressed formats have neither format nor type, base internal format is taken as format.
+	{ Color::C3_U8,  Compression::BC1,  false, 131, GL_COMPRESSED_RGB_S3TC_DXT1_EXT,        GL_RGB,  0, 1 },
+	{ Color::C3_U8,  Compression::BC1,  true,  132, GL_COMPRESSED_SRGB_S3TC_DXT1_EXT,       GL_RGB,  0, 1 },
+	{ Color::C4_U8,  Compression::BC1,  false, 133, GL_COMPRESSED_RGBA_S3TC_DXT1_EXT,       GL_RGBA, 0, 1 },
+	{ Color::C4_U8,  Compression::BC1,  true,  134, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT, GL_RGBA, 0, 1 },
+	{ Color::C4_U8,  Compression::BC3,  false, 137, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,       GL_RGBA, 0, 1 },
+	{ Color::C4_U8,  Compression::BC3,  true,  138, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT, GL_RGBA, 0, 1 },
+};
+
+static const FormatInfo* findFormat(Color::Format colorFormat, Compression compression, bool srgb)
+{
+	for(const FormatInfo& info: FORMATS)
+		if(info.colorFormat == colorFormat && info.compression == compression && info.srgb == srgb)
+			return &info;
+	return nullptr;
+}
+
+static const FormatInfo* findVkFormat(uint32_t vkFormat)
+{
+	for(const FormatInfo& info: FORMATS)
+		if(info.vkFormat == vkFormat)
+			return &info;
+	return nullptr;
+}
+
+static const FormatInfo* findGLFormat(uint32_t glInternalFormat, uint32_t glFormat, uint32_t glType)
+{
+	for(const FormatInfo& info: FORMATS)
+		if(info.glInternalFormat == glInternalFormat && (glType == 0) == (info.glType == 0) &&
+				(glType == 0 || info.glFormat == glFormat))
+			return &info;
+
+	// unsized internal format, e.g. GL_RGBA
+	for(const FormatInfo& info: FORMATS)
+		if(glType != 0 && !info.srgb && info.glFormat == glFormat && info.glType == glType)
+			return &info;
+	return nullptr;
+}
+
+static uint32_t swap32(uint32_t value)
+{
+	return value >> 24 | (value >> 8 & 0xFF00) | (value << 8 & 0xFF0000) | value << 24;
+}
+
+// length of a string that may not be terminated within size bytes
+static size_t lengthOf(const char* s, size_t size)
+{
+	const void* end = std::memchr(s, '\0', size);
+	return end != nullptr? static_cast<const char*>(end) - s: size;
+}
+
+static size_t alignUp(size_t value, size_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+static uint32_t getBlockSize(Compression compression)
+{
+	return compression == Compression::BC1? 8: 16;
+}
+
+static size_t getRowSize(Color::Format colorFormat, Compression compression, uint32_t width)
+{
+	if(compression != Compression::NONE)
+		return (width + 3) / 4 * getBlockSize(compression);
+	return static_cast<size_t>(width) * Color::size(colorFormat);
+}
+
+// row count, in blocks for compressed formats
+static uint32_t getRowCount(Compression compression, uint32_t height)
+{
+	return compression != Compression::NONE? (height + 3) / 4: height;
+}
+
+/**
+ * Build levels of a texture with images packed as rowAlignment tells, slices of a 3D image and
+ * images of a level follow each other and levels start at 4 byte boundaries.
+ * @return byte size of all levels.
+ */
+static size_t layout(std::vector<KTX::Level>& levels, Color::Format colorFormat, Compression compression,
+		uint32_t width, uint32_t height, uint32_t depth, uint32_t levelCount, uint32_t imageCount, uint32_t rowAlignment)
+{
+	levels.resize(levelCount);
+	size_t offset = 0;
+	for(KTX::Level& level: levels)
+	{
+		level.width = width;
+		level.height = height;
+		level.depth = depth;
+		level.offset = offset;
+		level.imageSize = alignUp(getRowSize(colorFormat, compression, width), rowAlignment) *
+				getRowCount(compression, height) * depth;
+		level.imageStride = alignUp(level.imageSize, 4);
+		offset = alignUp(offset + level.imageStride * imageCount, 4);
+
+		width = std::max(width >> 1, 1U);
+		height = std::max(height >> 1, 1U);
+		depth = std::max(depth >> 1, 1U);
+	}
+	return offset;
+}
+
+/**
+ * Header sizes of a file, height is 0 for 1D textures and depth is 0 unless it's a 3D texture.
+ * There're no cube maps of other than square faces, nor arrays of 3D textures.
+ */
+static bool isValidSize(uint32_t width, uint32_t height, uint32_t depth, uint32_t layerCount, uint32_t faceCount,
+		uint32_t levelCount)
+{
+	return width != 0 && (height != 0 || depth == 0) && (depth == 0 || layerCount == 0) &&
+			(faceCount == 1 || (faceCount == 6 && width == height && depth == 0)) &&
+			levelCount <= Mipmap::getLevelCount(width, std::max(height, depth));
+}
+
+/**
+ * Look up KTXorientation in key/value data, KTX1 and KTX2 have the same entries.
+ * @return true if T is up (KTX1) or the second letter is u (KTX2), defaultValue if no such key.
+ */
+static bool findBottomUp(const uint8_t* data, size_t size, bool swap, bool defaultValue)
+{
+	size_t offset = 0;
+	while(offset + 4 <= size)
+	{
+		uint32_t length;
+		std::memcpy(&length, data + offset, 4);
+		if(swap)
+			length = swap32(length);
+		offset += 4;
+		if(length > size - offset)
+			break;
+
+		const char* key = reinterpret_cast<const char*>(data + offset);
+		const size_t keyLength = lengthOf(key, length);
+		if(keyLength + 1 < length && std::strcmp(key, ORIENTATION_KEY) == 0)
+		{
+			const std::string value(key + keyLength + 1, lengthOf(key + keyLength + 1, length - keyLength - 1));
+			const size_t t = value.find("T=");
+			if(t != std::string::npos && t + 2 < value.size())
+				return value[t + 2] == 'u';
+			if(value.size() >= 2)
+				return value[1] == 'u';
+			return defaultValue;
+		}
+		offset = alignUp(offset + length, 4);
+	}
+	return defaultValue;
+}
+
+static void appendKeyValue(std::vector<uint8_t>& data, const char* key, const char* value)
+{
+	const uint32_t length = static_cast<uint32_t>(std::strlen(key) + 1 + std::strlen(value) + 1);
+	const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&length);
+	data.insert(data.end(), bytes, bytes + 4);
+	data.insert(data.end(), key, key + std::strlen(key) + 1);
+	data.insert(data.end(), value, value + std::strlen(value) + 1);
+	data.resize(alignUp(data.size(), 4), 0);
+}
+
+KTX::KTX():
+		colorFormat(Color::UNKNOWN),
+		compression(Compression::NONE),
+		srgb(false),
+		bottomUp(false),
+		depth(0),
+		layerCount(0),
+		faceCount(1),
+		rowAlignment(1),
+		data(nullptr),
+		size(0)
+{
+}
+
+bool KTX::probe(const uint8_t* data, size_t length)
+{
+	return length >= sizeof(MAGIC_KTX1) && (std::memcmp(data, MAGIC_KTX1, sizeof(MAGIC_KTX1)) == 0 ||
+			std::memcmp(data, MAGIC_KTX2, sizeof(MAGIC_KTX2)) == 0);
+}
+
+bool KTX::open(const std::string& path)
+{
+	MappedFile mapped;
+	if(!mapped.open(path))
+		return false;
+
+	if(!parse(mapped.getData(), mapped.getSize()))
+	{
+		slog.w(TAG, "can't read %s", path.c_str());
+		return false;
+	}
+	file = std::move(mapped);
+	buffer.clear();
+	return true;
+}
+
+bool KTX::decodeByteArray(const uint8_t* data, size_t length)
+{
+	std::vector<uint8_t> bytes(data, data + length);
+	if(!parse(bytes.data(), bytes.size()))
+		return false;
+	buffer = std::move(bytes);  // storage moves along, data still points into it.
+	file.close();
+	return true;
+}
+
+bool KTX::parse(uint8_t* data, size_t size)
+{
+	levels.clear();
+	bool parsed = false;
+	if(size >= KTX1_HEADER_SIZE && std::memcmp(data, MAGIC_KTX1, sizeof(MAGIC_KTX1)) == 0)
+		parsed = parseKTX1(data, size);
+	else if(size >= KTX2_HEADER_SIZE && std::memcmp(data, MAGIC_KTX2, sizeof(MAGIC_KTX2)) == 0)
+		parsed = parseKTX2(data, size);
+
+	if(!parsed)
+	{
+		levels.clear();
+		return false;
+	}
+	this->data = data;
+	this->size = size;
+	return true;
+}
+
+bool KTX::parseKTX1(const uint8_t* data, size_t size)
+{
+	uint32_t header[13];
+	std::memcpy(header, data + sizeof(MAGIC_KTX1), sizeof(header));
+	const bool swap = header[0] == KTX1_BIG_ENDIAN;
+	if(!swap && header[0] != KTX1_LITTLE_ENDIAN)
+	{
+		slog.w(TAG, "unknown endianness %08X", header[0]);
+		return false;
+	}
+	if(swap)
+		for(uint32_t& word: header)
+			word = swap32(word);
+
+	const uint32_t glType = header[1], glTypeSize = header[2], glFormat = header[3], glInternalFormat = header[4];
+	const uint32_t width = header[6], height = header[7], depth = header[8];
+	const uint32_t arrayCount = header[9], faces = header[10], keyValueSize = header[12];
+	const uint32_t levelCount = std::max(header[11], 1U);
+
+	const FormatInfo* info = findGLFormat(glInternalFormat, glFormat, glType);
+	if(info == nullptr || (swap && glTypeSize != 1))  // bytes of pixels are left as they are.
+	{
+		slog.w(TAG, "unsupported format %#x, type %#x", glInternalFormat, glType);
+		return false;
+	}
+	if(!isValidSize(width, height, depth, arrayCount, faces, levelCount) || keyValueSize > size - KTX1_HEADER_SIZE)
+	{
+		slog.w(TAG, "unsupported %ux%ux%u texture of %u faces and %u levels", width, height, depth, faces, levelCount);
+		return false;
+	}
+
+	colorFormat = info->colorFormat;
+	compression = info->compression;
+	srgb = info->srgb;
+	this->depth = depth;
+	layerCount = arrayCount;
+	faceCount = faces;
+	rowAlignment = 4;
+	bottomUp = findBottomUp(data + KTX1_HEADER_SIZE, keyValueSize, swap, true);  // (0, 0) is at first texel
+
+	// imageSize, then images of the level, then padding
+	const uint32_t imageCount = std::max(layerCount, 1U) * faceCount;
+	layout(levels, colorFormat, compression, width, std::max(height, 1U), std::max(depth, 1U),
+			levelCount, imageCount, rowAlignment);
+	size_t offset = KTX1_HEADER_SIZE + keyValueSize;
+	for(Level& level: levels)
+	{
+		if(offset + 4 > size)
+			return false;
+		uint32_t imageSize;
+		std::memcpy(&imageSize, data + offset, 4);
+		if(swap)
+			imageSize = swap32(imageSize);
+		offset += 4;
+
+		const size_t expected = layerCount == 0 && faceCount == 6? level.imageSize: level.imageStride * imageCount;
+		if(imageSize < expected || level.imageStride * imageCount > size - offset)
+		{
+			slog.w(TAG, "level %ux%u is truncated", level.width, level.height);
+			return false;
+		}
+		level.offset = offset;
+		offset = alignUp(offset + level.imageStride * imageCount, 4);
+	}
+	return true;
+}
+
+bool KTX::parseKTX2(const uint8_t* data, size_t size)
+{
+	uint32_t header[9];
+	std::memcpy(header, data + sizeof(MAGIC_KTX2), sizeof(header));
+	const uint32_t vkFormat = header[0], width = header[2], height = header[3], depth = header[4];
+	const uint32_t layers = header[5], faces = header[6], supercompression = header[8];
+	const uint32_t levelCount = std::max(header[7], 1U);
+
+	uint32_t index[4];  // dfdByteOffset, dfdByteLength, kvdByteOffset, kvdByteLength
+	std::memcpy(index, data + 48, sizeof(index));
+
+	const FormatInfo* info = findVkFormat(vkFormat);
+	if(info == nullptr || supercompression != 0)
+	{
+		slog.w(TAG, "unsupported format %u, supercompression %u", vkFormat, supercompression);
+		return false;
+	}
+	if(!isValidSize(width, height, depth, layers, faces, levelCount) ||
+			KTX2_HEADER_SIZE + levelCount * 24ULL > size || index[2] > size || index[3] > size - index[2])
+	{
+		slog.w(TAG, "unsupported %ux%ux%u texture of %u faces and %u levels", width, height, depth, faces, levelCount);
+		return false;
+	}
+
+	colorFormat = info->colorFormat;
+	compression = info->compression;
+	srgb = info->srgb;
+	this->depth = depth;
+	layerCount = layers;
+	faceCount = faces;
+	rowAlignment = 1;
+	bottomUp = findBottomUp(data + index[2], index[3], false, false);  // "rd" by default
+
+	const uint32_t imageCount = std::max(layerCount, 1U) * faceCount;
+	layout(levels, colorFormat, compression, width, std::max(height, 1U), std::max(depth, 1U),
+			levelCount, imageCount, rowAlignment);
+	for(uint32_t i = 0; i < levelCount; ++i)
+	{
+		uint64_t entry[3];  // byteOffset, byteLength, uncompressedByteLength
+		std::memcpy(entry, data + KTX2_HEADER_SIZE + i * sizeof(entry), sizeof(entry));
+		Level& level = levels[i];
+		level.imageStride = level.imageSize;  // images are tightly packed
+		if(entry[1] < level.imageSize * imageCount || entry[0] > size || entry[1] > size - entry[0])
+		{
+			slog.w(TAG, "level %ux%u is truncated", level.width, level.height);
+			return false;
+		}
+		level.offset = entry[0];
+	}
+	return true;
+}
+
+bool KTX::create(Color::Format colorFormat, Compression compression, uint32_t width, uint32_t height,
+		uint32_t levelCount/* = 1 */, uint32_t layerCount/* = 0 */, uint32_t faceCount/* = 1 */, bool srgb/* = false */)
+{
+	const FormatInfo* info = findFormat(colorFormat, compression, srgb);
+	if(info == nullptr || width == 0 || height == 0 || levelCount == 0 ||
+			levelCount > Mipmap::getLevelCount(width, height) ||
+			(faceCount != 1 && faceCount != 6) || (faceCount == 6 && width != height))
+	{
+		slog.w(TAG, "can't create %ux%u texture of format %#x, %u levels, %u faces", width, height,
+				colorFormat, levelCount, faceCount);
+		return false;
+	}
+
+	this->colorFormat = colorFormat;
+	this->compression = compression;
+	this->srgb = srgb;
+	depth = 0;
+	this->layerCount = layerCount;
+	this->faceCount = faceCount;
+	rowAlignment = 1;
+
+	const uint32_t imageCount = std::max(layerCount, 1U) * faceCount;
+	const size_t total = layout(levels, colorFormat, compression, width, height, 1, levelCount, imageCount, rowAlignment);
+	file.close();
+	buffer.assign(total, 0);
+	data = buffer.data();
+	size = buffer.size();
+	return true;
+}
+
+const uint8_t* KTX::getData(uint32_t level, uint32_t layer/* = 0 */, uint32_t face/* = 0 */) const
+{
+	assert(level < levels.size() && layer < std::max(layerCount, 1U) && face < faceCount);
+	const Level& l = levels[level];
+	return data + l.offset + (static_cast<size_t>(layer) * faceCount + face) * l.imageStride;
+}
+
+uint8_t* KTX::getData(uint32_t level, uint32_t layer/* = 0 */, uint32_t face/* = 0 */)
+{
+	return const_cast<uint8_t*>(const_cast<const KTX*>(this)->getData(level, layer, face));
+}
+
+bool KTX::setPixels(const uint8_t* pixels, Color::Format format, bool flip,
+		uint32_t level, uint32_t layer, uint32_t face, Image_DXT::Quality quality)
+{
+	if(level >= levels.size() || layer >= std::max(layerCount, 1U) || face >= faceCount || depth != 0)
+	{
+		slog.w(TAG, "no 2D level %u, layer %u, face %u", level, layer, face);
+		return false;
+	}
+
+	const Level& l = levels[level];
+	const size_t srcStride = static_cast<size_t>(l.width) * Color::size(format);
+	auto convertRows = [&](uint8_t* dst, size_t dstStride)
+	{
+		for(uint32_t y = 0; y < l.height; ++y)
+		{
+			const uint8_t* src = pixels + (flip? l.height - 1 - y: y) * srcStride;
+			if(!PixelConverter::convert(format, src, colorFormat, dst + y * dstStride, l.width))
+				return false;
+		}
+		return true;
+	};
+
+	uint8_t* dst = getData(level, layer, face);
+	if(compression == Compression::NONE)
+		return convertRows(dst, alignUp(getRowSize(colorFormat, compression, l.width), rowAlignment));
+
+	const size_t stride = static_cast<size_t>(l.width) * Color::size(colorFormat);
+	std::vector<uint8_t> uncompressed(stride * l.height);
+	if(!convertRows(uncompressed.data(), stride))
+		return false;
+
+	const int32_t channels = Color::sizeofChannel(colorFormat);
+	std::vector<uint8_t> blocks = compression == Compression::BC1?
+			Image_DXT::convertImageToDXT1(uncompressed.data(), l.width, l.height, channels, quality):
+			Image_DXT::convertImageToDXT5(uncompressed.data(), l.width, l.height, channels, quality);
+	assert(blocks.size() == l.imageSize);
+	std::memcpy(dst, blocks.data(), std::min(blocks.size(), l.imageSize));
+	return true;
+}
+
+bool KTX::setImage(const Image& image, uint32_t level/* = 0 */, uint32_t layer/* = 0 */, uint32_t face/* = 0 */,
+		Image_DXT::Quality quality/* = Image_DXT::Quality::RANGE_FIT */)
+{
+	if(!image.isValid() || level >= levels.size() ||
+			static_cast<uint32_t>(image.getWidth()) != levels[level].width ||
+			static_cast<uint32_t>(image.getHeight()) != levels[level].height)
+	{
+		slog.w(TAG, "image size %dx%d doesn't match level %u", image.getWidth(), image.getHeight(), level);
+		return false;
+	}
+	return setPixels(image.getData(), image.getColorFormat(), image.isBottomUp() != bottomUp,
+			level, layer, face, quality);
+}
+
+bool KTX::setMipmap(const Mipmap& mipmap, uint32_t layer/* = 0 */, uint32_t face/* = 0 */,
+		Image_DXT::Quality quality/* = Image_DXT::Quality::RANGE_FIT */)
+{
+	if(mipmap.getLevelCount() == 0 || mipmap.getWidth() != getWidth() || mipmap.getHeight() != getHeight())
+	{
+		slog.w(TAG, "mipmap size %ux%u doesn't match %ux%u", mipmap.getWidth(), mipmap.getHeight(), getWidth(), getHeight());
+		return false;
+	}
+
+	const uint32_t levelCount = std::min(mipmap.getLevelCount(), getLevelCount());
+	for(uint32_t level = 0; level < levelCount; ++level)
+		if(!setPixels(mipmap.getData(level), mipmap.getColorFormat(), bottomUp, level, layer, face, quality))
+			return false;
+	return true;
+}
+
+/**
+ * Write an image with rows realigned, compressed images are written as they are.
+ */
+static void writeImage(std::ofstream& stream, const uint8_t* image, size_t rowSize, uint32_t rowCount,
+		size_t srcStride, size_t dstStride)
+{
+	if(srcStride == dstStride)
+	{
+		stream.write(reinterpret_cast<const char*>(image), srcStride * rowCount);
+		return;
+	}
+
+	std::vector<char> row(dstStride, 0);
+	for(uint32_t y = 0; y < rowCount; ++y)
+	{
+		std::memcpy(row.data(), image + y * srcStride, rowSize);
+		stream.write(row.data(), row.size());
+	}
+}
+
+/**
+ * Basic data format descriptor of KTX2, for formats of the table only.
+ * @see https://registry.khronos.org/DataFormat/specs/1.3/dataformat.1.3.html
+ */
+static std::vector<uint32_t> describe(const FormatInfo& info)
+{
+	constexpr uint32_t MODEL_RGBSDA = 1, MODEL_BC1A = 128, MODEL_BC3 = 130;
+	constexpr uint32_t PRIMARIES_BT709 = 1, TRANSFER_LINEAR = 1, TRANSFER_SRGB = 2;
+	constexpr uint32_t QUALIFIER_LINEAR = 0x10, QUALIFIER_SIGNED = 0x40, QUALIFIER_FLOAT = 0x80;
+	constexpr uint32_t CHANNEL_ALPHA = 15;
+
+	struct Sample
+	{
+		uint32_t bitOffset, bitLength, channel, lower, upper;
+	};
+	std::vector<Sample> samples;
+	uint32_t model = MODEL_RGBSDA, blockDimension = 0, bytes;
+	if(info.compression == Compression::BC1)
+	{
+		model = MODEL_BC1A;
+		blockDimension = 3 | 3 << 8;
+		bytes = 8;
+		const uint32_t channel = Color::sizeofChannel(info.colorFormat) == 4? 1: 0;  // alpha present or color
+		samples.push_back(Sample{0, 64, channel, 0, 0xFFFFFFFF});
+	}
+	else if(info.compression == Compression::BC3)
+	{
+		model = MODEL_BC3;
+		blockDimension = 3 | 3 << 8;
+		bytes = 16;
+		samples.push_back(Sample{0, 64, CHANNEL_ALPHA, 0, 0xFFFFFFFF});
+		samples.push_back(Sample{64, 64, 0, 0, 0xFFFFFFFF});
+	}
+	else
+	{
+		const uint32_t channelCount = Color::sizeofChannel(info.colorFormat);
+		const uint32_t bits = info.typeSize * 8;
+		bytes = Color::size(info.colorFormat);
+		const bool bgr = info.glFormat == GL_BGR || info.glFormat == GL_BGRA;
+		const bool isFloat = Color::isFloatType(info.colorFormat);
+		const uint32_t upper = isFloat? 0x3F800000: (bits == 8? 0xFF: 0xFFFF);  // 1.0F or max value
+		const uint32_t lower = isFloat? 0xBF800000: 0;  // -1.0F
+		for(uint32_t c = 0; c < channelCount; ++c)
+		{
+			uint32_t channel = c == 3? CHANNEL_ALPHA: (bgr && c < 3? 2 - c: c);
+			if(isFloat)
+				channel |= QUALIFIER_FLOAT | QUALIFIER_SIGNED;
+			if(info.srgb && c == 3)
+				channel |= QUALIFIER_LINEAR;
+			samples.push_back(Sample{c * bits, bits, channel, lower, upper});
+		}
+	}
+
+	const uint32_t blockSize = 24 + 16 * static_cast<uint32_t>(samples.size());
+	std::vector<uint32_t> words =
+	{
+		4 + blockSize,  // dfdTotalSize
+		0,              // vendorId KHR, descriptorType basic
+		2 | blockSize << 16,  // versionNumber 1.3
+		model | PRIMARIES_BT709 << 8 | (info.srgb? TRANSFER_SRGB: TRANSFER_LINEAR) << 16,
+		blockDimension,
+		bytes,
+		0,
+	};
+	for(const Sample& sample: samples)
+	{
+		words.push_back(sample.bitOffset | (sample.bitLength - 1) << 16 | sample.channel << 24);
+		words.push_back(0);  // sample position
+		words.push_back(sample.lower);
+		words.push_back(sample.upper);
+	}
+	return words;
+}
+
+bool KTX::save(const std::string& path, Version version/* = Version::KTX2 */) const
+{
+	const FormatInfo* info = findFormat(colorFormat, compression, srgb);
+	if(!isValid() || info == nullptr)
+	{
+		slog.w(TAG, "nothing to save");
+		return false;
+	}
+
+	std::ofstream stream(path, std::ios::out | std::ios::binary);
+	if(!stream.is_open())
+	{
+		slog.w(TAG, "can't open file %s for writing", path.c_str());
+		return false;
+	}
+
+	const uint32_t levelCount = getLevelCount();
+	const uint32_t imageCount = std::max(layerCount, 1U) * faceCount;
+	const uint32_t rowAlignment = version == Version::KTX1? 4: 1;
+	std::vector<Level> fileLevels;
+	layout(fileLevels, colorFormat, compression, getWidth(), getHeight(), std::max(depth, 1U),
+			levelCount, imageCount, rowAlignment);
+
+	auto write = [&stream](const void* data, size_t size) { stream.write(static_cast<const char*>(data), size); };
+	auto pad = [&stream](size_t alignment)
+	{
+		const size_t position = static_cast<size_t>(stream.tellp());
+		static const char zeros[16] = {};
+		stream.write(zeros, alignUp(position, alignment) - position);
+	};
+	auto writeLevel = [&](uint32_t level)
+	{
+		const Level& src = levels[level];
+		const Level& dst = fileLevels[level];
+		const size_t rowSize = getRowSize(colorFormat, compression, src.width);
+		const uint32_t rowCount = getRowCount(compression, src.height) * src.depth;
+		for(uint32_t layer = 0; layer < std::max(layerCount, 1U); ++layer)
+			for(uint32_t face = 0; face < faceCount; ++face)
+			{
+				writeImage(stream, getData(level, layer, face), rowSize, rowCount,
+						src.imageSize / rowCount, dst.imageSize / rowCount);
+				if(version == Version::KTX1)
+					pad(4);  // cube padding
+			}
+	};
+
+	std::vector<uint8_t> keyValues;
+	if(version == Version::KTX1)
+	{
+		appendKeyValue(keyValues, ORIENTATION_KEY, bottomUp? "S=r,T=u": "S=r,T=d");
+		const uint32_t header[13] =
+		{
+			KTX1_LITTLE_ENDIAN, info->glType, info->typeSize, info->glType != 0? info->glFormat: 0,
+			info->glInternalFormat, info->glFormat == GL_BGR? GL_RGB: info->glFormat == GL_BGRA? GL_RGBA: info->glFormat,
+			getWidth(), getHeight(), depth,
+			layerCount, faceCount, levelCount, static_cast<uint32_t>(keyValues.size()),
+		};
+		write(MAGIC_KTX1, sizeof(MAGIC_KTX1));
+		write(header, sizeof(header));
+		write(keyValues.data(), keyValues.size());
+		for(uint32_t level = 0; level < levelCount; ++level)
+		{
+			const Level& l = fileLevels[level];
+			const uint32_t imageSize = static_cast<uint32_t>(layerCount == 0 && faceCount == 6? l.imageSize: l.imageStride * imageCount);
+			write(&imageSize, sizeof(imageSize));
+			writeLevel(level);
+			pad(4);  // mip padding
+		}
+		return stream.good();
+	}
+
+	appendKeyValue(keyValues, ORIENTATION_KEY, bottomUp? "ru": "rd");
+	appendKeyValue(keyValues, "KTXwriter", "pea");
+	const std::vector<uint32_t> descriptor = describe(*info);
+
+	// levels are stored from the smallest one, each aligned to lcm(texel block size, 4).
+	const size_t texelBlockSize = compression != Compression::NONE? getBlockSize(compression): Color::size(colorFormat);
+	const size_t alignment = texelBlockSize % 4 == 0? texelBlockSize: (texelBlockSize % 2 == 0? texelBlockSize * 2: texelBlockSize * 4);
+	const uint32_t dfdOffset = KTX2_HEADER_SIZE + levelCount * 24;
+	const uint32_t dfdSize = static_cast<uint32_t>(descriptor.size() * 4);
+	const uint32_t kvdOffset = dfdOffset + dfdSize;
+	const uint32_t kvdSize = static_cast<uint32_t>(keyValues.size());
+	std::vector<uint64_t> levelIndex(levelCount * 3);
+	size_t offset = kvdOffset + kvdSize;
+	for(uint32_t level = levelCount; level-- > 0;)
+	{
+		offset = alignUp(offset, alignment);
+		const uint64_t length = fileLevels[level].imageSize * imageCount;
+		levelIndex[level * 3 + 0] = offset;
+		levelIndex[level * 3 + 1] = length;
+		levelIndex[level * 3 + 2] = length;
+		offset += length;
+	}
+
+	const uint32_t header[9] =
+	{
+		info->vkFormat, info->typeSize, getWidth(), getHeight(), depth, layerCount, faceCount, levelCount, 0,
+	};
+	const uint32_t index[4] = { dfdOffset, dfdSize, kvdOffset, kvdSize };
+	const uint64_t supercompressionIndex[2] = { 0, 0 };
+	write(MAGIC_KTX2, sizeof(MAGIC_KTX2));
+	write(header, sizeof(header));
+	write(index, sizeof(index));
+	write(supercompressionIndex, sizeof(supercompressionIndex));
+	write(levelIndex.data(), levelIndex.size() * sizeof(uint64_t));
+	write(descriptor.data(), dfdSize);
+	write(keyValues.data(), kvdSize);
+	for(uint32_t level = levelCount; level-- > 0;)
+	{
+		pad(alignment);
+		writeLevel(level);
+	}
+	return stream.good();
+}
+
+std::shared_ptr<Image> KTX::decode(uint32_t level/* = 0 */, uint32_t layer/* = 0 */, uint32_t face/* = 0 */) const
+{
+	if(level >= levels.size() || layer >= std::max(layerCount, 1U) || face >= faceCount || depth != 0)
+		return nullptr;
+
+	const Level& l = levels[level];
+	auto image = std::make_shared<Image_PNG>(l.width, l.height, colorFormat);
+	const size_t dstStride = static_cast<size_t>(l.width) * Color::size(colorFormat);
+	const uint8_t* src = getData(level, layer, face);
+	size_t srcStride = l.imageSize / l.height;
+
+	std::vector<uint8_t> rgba;
+	if(compression != Compression::NONE)
+	{
+		rgba.resize(static_cast<size_t>(l.width) * l.height * 4);
+		if(compression == Compression::BC1)
+			Image_DXT::convertDXT1ToImage(src, l.width, l.height, rgba.data());
+		else
+			Image_DXT::convertDXT5ToImage(src, l.width, l.height, rgba.data());
+		src = rgba.data();
+		srcStride = static_cast<size_t>(l.width) * 4;
+	}
+
+	const Color::Format srcFormat = compression != Compression::NONE? Color::C4_U8: colorFormat;
+	uint8_t* dst = image->getData();
+	for(uint32_t y = 0; y < l.height; ++y)
+	{
+		const uint8_t* row = src + (bottomUp? l.height - 1 - y: y) * srcStride;
+		PixelConverter::convert(srcFormat, row, colorFormat, dst + y * dstStride, l.width);
+	}
+	return image;
+}
+
+uint32_t KTX::getGLInternalFormat() const
+{
+	const FormatInfo* info = findFormat(colorFormat, compression, srgb);
+	return info != nullptr? info->glInternalFormat: 0;
+}
+
+uint32_t KTX::getGLFormat() const
+{
+	const FormatInfo* info = findFormat(colorFormat, compression, srgb);
+	return info != nullptr && info->glType != 0? info->glFormat: 0;
+}
+
+uint32_t KTX::getGLType() const
+{
+	const FormatInfo* info = findFormat(colorFormat, compression, srgb);
+	return info != nullptr? info->glType: 0;
+}
@@ -0,0 +1,210 @@
+#ifndef PEA_GRAPHICS_KTX_H_
+#define PEA_GRAPHICS_KTX_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "graphics/Color.h"
+#include "graphics/Image.h"
+#include "graphics/Image_DXT.h"
+#include "graphics/Mipmap.h"
+#include "io/MappedFile.h"
+
+namespace pea {
+
+/**
+ * @class KTX
+ * Khronos texture container, version 1 and 2, holding the mip chain of a 1D, 2D or 3D texture, a
+ * cube map or an array of them, in a layout that GPU uploads take as is. 1D textures are read with
+ * a height of 1.
+ *
+ * Files are memory mapped, images point into the mapped pages, so that textures are uploaded with
+ * no decode step nor copy. Textures are built in memory level by level from images or mipmaps,
+ * compressed to BC1/BC3 blocks by Image_DXT if asked, then saved in either version.
+ *
+ * Uncompressed 8, 16 bit normalized and 16, 32 bit float channels, BGR(A) 8 bit pixels and BC1/BC3
+ * blocks are handled, supercompressed KTX2 files are not. Rows are tightly packed in KTX2, and
+ * padded to 4 bytes in KTX1, @see getRowAlignment().
+ *
+ * @see https://registry.khronos.org/KTX/specs/1.0/ktxspec.v1.html
+ * @see https://registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html
+ */
+class KTX
+{
+public:
+	enum class Version: uint8_t
+	{
+		KTX1,
+		KTX2,
+	};
+
+	enum class Compression: uint8_t
+	{
+		NONE,
+		BC1,  ///< DXT1, 8 bytes per 4x4 block, 1 bit alpha
+		BC3,  ///< DXT5, 16 bytes per 4x4 block
+	};
+
+	struct Level
+	{
+		uint32_t width;
+		uint32_t height;
+		uint32_t depth;     ///< 1 unless it's a 3D texture
+		size_t offset;      ///< byte offset of the first image of this level in data
+		size_t imageSize;   ///< byte size of one image, i.e. one face of one layer, or all slices of a 3D texture
+		size_t imageStride; ///< byte offset between images, imageSize rounded up to alignment
+	};
+
+	static const uint8_t MAGIC_KTX1[12];
+	static const uint8_t MAGIC_KTX2[12];
+
+private:
+	Color::Format colorFormat;  ///< pixel format, or format of decompressed blocks
+	Compression compression;
+	bool srgb;
+	bool bottomUp;
+	uint32_t depth;         ///< 0 if it's not a 3D texture
+	uint32_t layerCount;    ///< 0 if it's not an array texture
+	uint32_t faceCount;     ///< 1, or 6 for cube map
+	uint32_t rowAlignment;
+	std::vector<Level> levels;
+
+	MappedFile file;
+	std::vector<uint8_t> buffer;
+	uint8_t* data;
+	size_t size;
+
+private:
+	bool parse(uint8_t* data, size_t size);
+	bool parseKTX1(const uint8_t* data, size_t size);
+	bool parseKTX2(const uint8_t* data, size_t size);
+	bool setPixels(const uint8_t* pixels, Color::Format format, bool flip,
+			uint32_t level, uint32_t layer, uint32_t face, Image_DXT::Quality quality);
+
+public:
+	KTX();
+	~KTX() = default;
+
+	KTX(const KTX& other) = delete;
+	KTX& operator =(const KTX& other) = delete;
+
+	KTX(KTX&& other) = default;
+	KTX& operator =(KTX&& other) = default;
+
+	static bool probe(const uint8_t* data, size_t length);
+
+	/**
+	 * Map a .ktx or .ktx2 file, images are views of the mapped pages.
+	 */
+	bool open(const std::string& path);
+
+	/**
+	 * Read a .ktx or .ktx2 file in memory, data is copied.
+	 */
+	bool decodeByteArray(const uint8_t* data, size_t length);
+
+	/**
+	 * Allocate an empty texture to be filled by setImage() or setMipmap().
+	 * @param[in] colorFormat pixel format, or format of decompressed blocks, C3_U8 or C4_U8.
+	 * @param[in] levelCount  at most Mipmap::getLevelCount(width, height).
+	 * @param[in] layerCount  0 for a texture that's not an array.
+	 * @param[in] faceCount   1, or 6 for a cube map.
+	 * @param[in] srgb        8 bit color channels are sRGB encoded.
+	 * @return false if format or sizes aren't supported.
+	 */
+	bool create(Color::Format colorFormat, Compression compression, uint32_t width, uint32_t height,
+			uint32_t levelCount = 1, uint32_t layerCount = 0, uint32_t faceCount = 1, bool srgb = false);
+
+	/**
+	 * Copy an image into level, layer and face, converting its pixels to the color format of this
+	 * texture, and compressing them if this texture is block compressed. Rows are flipped if image
+	 * and texture orientations differ. Cube faces are in +X, -X, +Y, -Y, +Z, -Z order.
+	 * @param[in] image   of the level's size, any color format PixelConverter supports.
+	 * @param[in] quality compression quality.
+	 */
+	bool setImage(const Image& image, uint32_t level = 0, uint32_t layer = 0, uint32_t face = 0,
+			Image_DXT::Quality quality = Image_DXT::Quality::RANGE_FIT);
+
+	/**
+	 * Copy levels of a mipmap into the same levels of layer and face, extra levels are left out.
+	 * @see setImage
+	 */
+	bool setMipmap(const Mipmap& mipmap, uint32_t layer = 0, uint32_t face = 0,
+			Image_DXT::Quality quality = Image_DXT::Quality::RANGE_FIT);
+
+	/**
+	 * @param[in] path    file to write.
+	 * @param[in] version container version, KTX2 by default.
+	 */
+	bool save(const std::string& path, Version version = Version::KTX2) const;
+
+	/**
+	 * Decode an image to its color format, top-down.
+	 * @return nullptr for 3D textures, whose slices are left to GPU uploads.
+	 */
+	std::shared_ptr<Image> decode(uint32_t level = 0, uint32_t layer = 0, uint32_t face = 0) const;
+
+	bool isValid() const;
+	Color::Format getColorFormat() const;
+	Compression getCompression() const;
+	bool isCompressed() const;
+	bool isSrgb() const;
+	uint32_t getWidth() const;
+	uint32_t getHeight() const;
+	uint32_t getDepth() const;
+	uint32_t getLevelCount() const;
+	uint32_t getLayerCount() const;
+	uint32_t getFaceCount() const;
+	bool isArray() const;
+	bool isCube() const;
+	bool is3D() const;
+
+	/**
+	 * Rows are stored as the file tells, bottom row first if true. Setting it before setImage()
+	 * decides the order images are stored. OpenGL takes 2D textures bottom-up, and cube faces
+	 * top-down.
+	 */
+	void setBottomUp(bool bottomUp);
+	bool isBottomUp() const;
+
+	/**
+	 * @return byte alignment of rows, 1 or 4, which is GL_UNPACK_ALIGNMENT of uploads.
+	 */
+	uint32_t getRowAlignment() const;
+
+	const Level& getLevel(uint32_t level) const;
+	const uint8_t* getData(uint32_t level, uint32_t layer = 0, uint32_t face = 0) const;
+	      uint8_t* getData(uint32_t level, uint32_t layer = 0, uint32_t face = 0);
+
+	/**
+	 * OpenGL enums of the format, e.g. GL_RGBA8 or GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, GL_RGBA and
+	 * GL_UNSIGNED_BYTE, type and format are 0 for compressed formats.
+	 */
+	uint32_t getGLInternalFormat() const;
+	uint32_t getGLFormat() const;
+	uint32_t getGLType() const;
+};
+
+inline bool KTX::isValid() const { return !levels.empty(); }
+inline Color::Format KTX::getColorFormat() const { return colorFormat; }
+inline KTX::Compression KTX::getCompression() const { return compression; }
+inline bool KTX::isCompressed() const { return compression != Compression::NONE; }
+inline bool KTX::isSrgb() const { return srgb; }
+inline uint32_t KTX::getWidth() const  { return levels.empty()? 0: levels[0].width; }
+inline uint32_t KTX::getHeight() const { return levels.empty()? 0: levels[0].height; }
+inline uint32_t KTX::getDepth() const { return depth; }
+inline uint32_t KTX::getLevelCount() const { return static_cast<uint32_t>(levels.size()); }
+inline uint32_t KTX::getLayerCount() const { return layerCount; }
+inline uint32_t KTX::getFaceCount() const { return faceCount; }
+inline bool KTX::isArray() const { return layerCount != 0; }
+inline bool KTX::isCube() const { return faceCount == 6; }
+inline bool KTX::is3D() const { return depth != 0; }
+inline void KTX::setBottomUp(bool bottomUp) { this->bottomUp = bottomUp; }
+inline bool KTX::isBottomUp() const { return bottomUp; }
+inline uint32_t KTX::getRowAlignment() const { return rowAlignment; }
+inline const KTX::Level& KTX::getLevel(uint32_t level) const { return levels[level]; }
+
+}  // namespace pea
+#endif  // PEA_GRAPHICS_KTX_H_
@@ -0,0 +1,59 @@
+#include "graphics/MappedImage.h"
+
+#include <cassert>
+#include <memory>
+
+#include "graphics/ImageFactory.h"
+#include "graphics/Image_BMP.h"
+#include "graphics/Image_PNG.h"
+#include "graphics/Image_TGA.h"
+#include "graphics/PixelConverter.h"
+#include "util/Log.h"
+
+
+static const char* TAG = "MappedImage";
+
+using namespace pea;
+
+MappedImage::MappedImage(MappedFile&& file, Format format, uint32_t width, uint32_t height,
+		Color::Format colorFormat, size_t offset, bool bottomUp):
+		Image(width, height, colorFormat, file.getData() + offset, false),
+		file(std::move(file)),
+		format(format)
+{
+	assert(offset + static_cast<size_t>(width) * height * Color::size(colorFormat) <= this->file.getSize());
+	this->bottomUp = bottomUp;
+}
+
+bool MappedImage::save(const std::string& path) const
+{
+	Color::Format format = colorFormat;
+	if(format == Color::BGR888_U24)
+		format = Color::C3_U8;
+	else if(format == Color::BGRA8888_U32)
+		format = Color::C4_U8;
+
+	std::shared_ptr<Image> image;
+	switch(ImageFactory::probeFileName(path))
+	{
+	case Format::PNG:
+		image = std::make_shared<Image_PNG>(width, height, format);
+		break;
+	case Format::BMP:
+		image = std::make_shared<Image_BMP>(width, height, format);
+		break;
+	case Format::TGA:
+		image = std::make_shared<Image_TGA>(width, height, format,
+				new uint8_t[static_cast<size_t>(width) * height * Color::size(format)], true);
+		break;
+	default:
+		slog.w(TAG, "can't save image as %s", path.c_str());
+		return false;
+	}
+
+	PixelConverter::blit(colorFormat, data, width * Color::size(colorFormat),
+			format, image->getData(), width * Color::size(format), width, height);
+	if(bottomUp)
+		image->flipVertical();
+	return image->save(path);
+}
@@ -0,0 +1,46 @@
+#ifndef PEA_GRAPHICS_MAPPED_IMAGE_H_
+#define PEA_GRAPHICS_MAPPED_IMAGE_H_
+
+#include "graphics/Image.h"
+#include "io/MappedFile.h"
+
+namespace pea {
+
+/**
+ * @class MappedImage
+ * An image whose pixels are the ones of a mapped file, without decoding nor copying. Only files
+ * storing pixels uncompressed, in a layout Color::Format describes and rows without padding, can
+ * be viewed, e.g. true color TGA, and 24/32 bits BMP of suitable width.
+ *
+ * Color format is the one of the file, BMP and TGA store BGR(A). Rows keep the order of the file,
+ * @see Image::isBottomUp(). Writing pixels is allowed, it only changes private copies of the
+ * pages touched.
+ */
+class MappedImage: public Image
+{
+private:
+	MappedFile file;
+	Format format;
+
+public:
+	/**
+	 * @param[in] file        mapped file, owned by this image afterwards.
+	 * @param[in] format      file format.
+	 * @param[in] colorFormat color format of pixels in the file.
+	 * @param[in] offset      byte offset of the first row in file.
+	 * @param[in] bottomUp    true if the first row is the bottom one.
+	 */
+	MappedImage(MappedFile&& file, Format format, uint32_t width, uint32_t height,
+			Color::Format colorFormat, size_t offset, bool bottomUp);
+	virtual ~MappedImage() = default;
+
+	Format getImageFormat() const override { return format; }
+
+	/**
+	 * Save a top-down RGB(A) copy, in the format the extension of path tells.
+	 */
+	bool save(const std::string& path) const override;
+};
+
+}  // namespace pea
+#endif  // PEA_GRAPHICS_MAPPED_IMAGE_H_
@@ -0,0 +1,153 @@
+#include "graphics/Mipmap.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#include "graphics/PixelConverter.h"
+#include "graphics/Resampler.h"
+#include "util/Log.h"
+
+
+static const char* TAG = "Mipmap";
+
+using namespace pea;
+
+static constexpr int32_t COVERAGE_ITERATION = 16;
+
+static Resampler::Filter getFilter(Mipmap::Filter filter)
+{
+	switch(filter)
+	{
+	case Mipmap::Filter::BOX:     return Resampler::Filter::BOX;
+	case Mipmap::Filter::KAISER:  return Resampler::Filter::KAISER;
+	case Mipmap::Filter::LANCZOS: return Resampler::Filter::LANCZOS3;
+	default: assert(false); return Resampler::Filter::BOX;
+	}
+}
+
+static float computeCoverage(const float* rgba, size_t count, float cutoff, float scale)
+{
+	size_t n = 0;
+	for(size_t i = 0; i < count; ++i)
+		if(rgba[i * 4 + 3] * scale > cutoff)
+			++n;
+	return static_cast<float>(n) / count;
+}
+
+/**
+ * Binary search the alpha scale that keeps coverage, coverage grows with the scale.
+ */
+static float findCoverageScale(const float* rgba, size_t count, float cutoff, float coverage)
+{
+	float low = 0.0f, high = 1.0f / cutoff;  // all pass at high, unless alpha is 0
+	for(int32_t i = 0; i < COVERAGE_ITERATION; ++i)
+	{
+		float middle = (low + high) * 0.5f;
+		if(computeCoverage(rgba, count, cutoff, middle) < coverage)
+			low = middle;
+		else
+			high = middle;
+	}
+	return high;
+}
+
+Mipmap::Parameter::Parameter():
+		filter(Filter::KAISER),
+		srgb(true),
+		alphaCutoff(0.0f),
+		maxLevelCount(0)
+{
+}
+
+Mipmap::Mipmap():
+		colorFormat(Color::UNKNOWN)
+{
+}
+
+uint32_t Mipmap::getLevelCount(uint32_t width, uint32_t height)
+{
+	uint32_t count = 1;
+	while(width > 1 || height > 1)
+	{
+		width = std::max(width >> 1, 1U);
+		height = std::max(height >> 1, 1U);
+		++count;
+	}
+	return count;
+}
+
+bool Mipmap::generate(const Image& image, const Parameter& parameter/* = Parameter() */)
+{
+	levels.clear();
+	data.clear();
+	if(!image.isValid())
+	{
+		slog.w(TAG, "invalid image");
+		return false;
+	}
+
+	colorFormat = image.getColorFormat();
+	const size_t pixelSize = Color::size(colorFormat);
+	uint32_t width = image.getWidth(), height = image.getHeight();
+	uint32_t levelCount = getLevelCount(width, height);
+	if(parameter.maxLevelCount > 0)
+		levelCount = std::min(levelCount, parameter.maxLevelCount);
+
+	size_t offset = 0;
+	for(uint32_t i = 0; i < levelCount; ++i)
+	{
+		size_t size = static_cast<size_t>(width) * height * pixelSize;
+		levels.push_back(Level{width, height, offset, size});
+		offset += size;
+		width = std::max(width >> 1, 1U);
+		height = std::max(height >> 1, 1U);
+	}
+	data.resize(offset);
+	std::memcpy(data.data(), image.getData(), levels[0].size);
+
+	const uint32_t srgb = parameter.srgb? PixelConverter::SRGB_TO_LINEAR: PixelConverter::NONE;
+	const uint32_t inverse = parameter.srgb? PixelConverter::LINEAR_TO_SRGB: PixelConverter::NONE;
+	const bool coverage = parameter.alphaCutoff > 0.0f && parameter.alphaCutoff < 1.0f;
+	const Level& base = levels[0];
+	std::vector<float> current(static_cast<size_t>(base.width) * base.height * 4), next, straight;
+	PixelConverter::blit(colorFormat, data.data(), base.width * pixelSize,
+			Color::C4_F32, current.data(), base.width * 4 * sizeof(float),
+			base.width, base.height, srgb | PixelConverter::PREMULTIPLY);
+	const float baseCoverage = coverage?
+			computeCoverage(current.data(), current.size() / 4, parameter.alphaCutoff, 1.0f): 0.0f;
+
+	for(uint32_t i = 1; i < levelCount; ++i)
+	{
+		const Level& source = levels[i - 1];
+		const Level& level = levels[i];
+		next.resize(static_cast<size_t>(level.width) * level.height * 4);
+		Resampler::resample(current.data(), source.width, source.height,
+				next.data(), level.width, level.height, 4, getFilter(parameter.filter));
+
+		const size_t srcStride = level.width * 4 * sizeof(float);
+		const size_t dstStride = level.width * pixelSize;
+		uint8_t* dst = data.data() + level.offset;
+		if(!coverage)
+			PixelConverter::blit(Color::C4_F32, next.data(), srcStride, colorFormat, dst, dstStride,
+					level.width, level.height, PixelConverter::UNPREMULTIPLY | inverse);
+		else
+		{
+			// next level is filtered from unscaled alpha, only stored alpha is scaled.
+			const size_t count = next.size() / 4;
+			straight.resize(next.size());
+			PixelConverter::convert(Color::C4_F32, next.data(), Color::C4_F32, straight.data(), count,
+					PixelConverter::UNPREMULTIPLY);
+			float scale = findCoverageScale(straight.data(), count, parameter.alphaCutoff, baseCoverage);
+			for(size_t j = 0; j < count; ++j)
+				straight[j * 4 + 3] = std::min(straight[j * 4 + 3] * scale, 1.0f);
+			PixelConverter::blit(Color::C4_F32, straight.data(), srcStride, colorFormat, dst, dstStride,
+					level.width, level.height, inverse);
+		}
+
+		current.swap(next);
+	}
+
+	return true;
+}
@@ -0,0 +1,104 @@
+#ifndef PEA_GRAPHICS_MIPMAP_H_
+#define PEA_GRAPHICS_MIPMAP_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "graphics/Color.h"
+#include "graphics/Image.h"
+
+namespace pea {
+
+/**
+ * @class Mipmap
+ * A mipmap chain generated on CPU, so that it can be computed once and cached, instead of calling
+ * glGenerateMipmap at every load, which filters sRGB values as if they were linear.
+ *
+ * Each level halves the previous one, rounding down, until 1x1. Levels are filtered from the
+ * previous level in linear space with premultiplied alpha, then stored in the color format of the
+ * source image. All levels are packed in one buffer, level 0 first and rows without padding,
+ * which is the layout Texture::loadLevel() expects.
+ *
+ * Cutout textures lose alpha tested coverage in smaller levels, since averaged alpha falls below
+ * the reference value. With alpha coverage on, alpha of each level is scaled so that the same
+ * fraction of pixels passes the test as in level 0.
+ *
+ * @see Ignacio Castaño, Computing Alpha Mipmaps, 2010.
+ */
+class Mipmap
+{
+public:
+	enum class Filter: uint8_t
+	{
+		BOX,      ///< average of the pixels covered, fast but blurry and aliased
+		KAISER,   ///< Kaiser windowed sinc, radius 3, sharp with little ringing
+		LANCZOS,  ///< Lanczos3, sharpest, with some ringing
+	};
+
+	struct Parameter
+	{
+		Filter filter;
+		bool srgb;           ///< color channels are sRGB encoded, alpha is always linear
+		float alphaCutoff;   ///< alpha test reference value in (0, 1), 0 to leave alpha as filtered
+		uint32_t maxLevelCount;  ///< 0 for a complete chain
+
+		Parameter();
+	};
+
+	struct Level
+	{
+		uint32_t width;
+		uint32_t height;
+		size_t offset;  ///< byte offset in data
+		size_t size;    ///< byte size
+	};
+
+private:
+	Color::Format colorFormat;
+	std::vector<Level> levels;
+	std::vector<uint8_t> data;
+
+public:
+	Mipmap();
+	~Mipmap() = default;
+
+	/**
+	 * @param[in] width  level 0 width
+	 * @param[in] height level 0 height
+	 * @return level count of a complete chain.
+	 */
+	static uint32_t getLevelCount(uint32_t width, uint32_t height);
+
+	/**
+	 * Generate all levels of an image, each filtered from the previous one by Resampler.
+	 * @param[in] image     level 0, any color format PixelConverter supports.
+	 * @param[in] parameter filter and alpha options.
+	 * @return false if image is invalid.
+	 */
+	bool generate(const Image& image, const Parameter& parameter = Parameter());
+
+	Color::Format getColorFormat() const;
+	uint32_t getLevelCount() const;
+	const Level& getLevel(uint32_t level) const;
+	uint32_t getWidth() const;
+	uint32_t getHeight() const;
+
+	/**
+	 * @return all levels packed, level 0 first.
+	 */
+	const uint8_t* getData() const;
+	const uint8_t* getData(uint32_t level) const;
+	size_t getSize() const;
+};
+
+inline Color::Format Mipmap::getColorFormat() const { return colorFormat; }
+inline uint32_t Mipmap::getLevelCount() const { return static_cast<uint32_t>(levels.size()); }
+inline const Mipmap::Level& Mipmap::getLevel(uint32_t level) const { return levels[level]; }
+inline uint32_t Mipmap::getWidth() const  { return levels.empty()? 0: levels[0].width; }
+inline uint32_t Mipmap::getHeight() const { return levels.empty()? 0: levels[0].height; }
+inline const uint8_t* Mipmap::getData() const { return data.data(); }
+inline const uint8_t* Mipmap::getData(uint32_t level) const { return data.data() + levels[level].offset; }
+inline size_t Mipmap::getSize() const { return data.size(); }
+
+}  // namespace pea
+#endif  // PEA_GRAPHICS_MIPMAP_H_
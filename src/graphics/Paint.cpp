@@ -19,6 +19,7 @@ Paint::Paint(uint32_t flags):
 		textSize(12),
 		textScaleX(1.0F),
 		strokeWidth(5),
+		strokeMiter(4),
 		alignment(Alignment::LEFT),
 		typeface(nullptr)
 {
@@ -39,6 +40,13 @@ void Paint::setTextScaleX(float scale)
 		this->textScaleX = scale;
 }
 
+void Paint::setStrokeMiter(float miter)
+{
+	assert(miter >= 1);
+	if(miter >= 1)
+		this->strokeMiter = miter;
+}
+
 float Paint::measureText(const char32_t* text, size_t count) const
 {
 	TextureFont* font = FontManager::getInstance().getDefaultFont();
@@ -48,6 +48,39 @@ public:
 		FILL_AND_STROKE = 2,
 	};
 	
+	/**
+	 * The Cap specifies the treatment for the beginning and ending of stroked lines and paths.
+	 */
+	enum class Cap: uint8_t
+	{
+		BUTT = 0,  ///< The stroke ends with the path, and does not project beyond it.
+		ROUND,     ///< The stroke projects out as a semicircle, with the center at the end of the path.
+		SQUARE,    ///< The stroke projects out as a square, with the center at the end of the path.
+	};
+	
+	/**
+	 * The Join specifies the treatment where lines and curve segments join on a stroked path.
+	 */
+	enum class Join: uint8_t
+	{
+		MITER = 0,  ///< The outer edges of a join meet at a sharp angle, or bevel beyond miter limit.
+		ROUND,      ///< The outer edges of a join meet in a circular arc.
+		BEVEL,      ///< The outer edges of a join meet with a straight line.
+	};
+	
+	/**
+	 * How source pixels combine with destination pixels, named after Porter-Duff operators. Pixels
+	 * with alpha are taken as premultiplied. Coverage of anti-aliased edges scales the effect.
+	 */
+	enum class BlendMode: uint8_t
+	{
+		SRC_OVER = 0,  ///< S + D * (1 - Sa), the default.
+		SRC,           ///< S
+		CLEAR,         ///< 0
+		PLUS,          ///< min(S + D, 1)
+		MODULATE,      ///< S * D
+	};
+
 	/**
 	 * Paint flag that enables antialiasing when drawing.
 	 *
@@ -86,6 +119,7 @@ private:
 	float textSize;
 	float textScaleX;
 	float strokeWidth;
+	float strokeMiter;
 	Alignment alignment;
 	Typeface* typeface;
 	
@@ -129,11 +163,15 @@ public:
 	bool isStrikeThroughText() const { return bitfields.strikeThroughText; }
 	bool isOverlineText() const      { return bitfields.overlineText;      }
 	Style getStyle() const           { return bitfields.style;             }
+	bool isAntiAlias() const         { return bitfields.antiAlias;         }
+	BlendMode getBlendMode() const   { return static_cast<BlendMode>(bitfields.blendMode); }
 	
 	void setUnderlineText(bool underlineText)         { bitfields.underlineText     = underlineText;     }
 	void setStrikeThroughText(bool strikeThroughText) { bitfields.strikeThroughText = strikeThroughText; }
 	void setOverlineText(bool overlineText)           { bitfields.overlineText      = overlineText;      }
 	void setStyle(Style style)                        { bitfields.style             = style;             }
+	void setAntiAlias(bool antiAlias)                 { bitfields.antiAlias         = antiAlias;         }
+	void setBlendMode(BlendMode mode)                 { bitfields.blendMode = static_cast<uint32_t>(mode); }
 	
 	/**
 	 * Set the paint's horizontal scale factor for text. The default value is 1.0. Values > 1.0 will
@@ -156,6 +194,21 @@ public:
 	const vec4f& getColor() const;
 	float getStrokeWidth() const;
 	
+	Cap getStrokeCap() const;
+	void setStrokeCap(Cap cap);
+	
+	Join getStrokeJoin() const;
+	void setStrokeJoin(Join join);
+	
+	/**
+	 * Set the paint's stroke miter value. This is used to control the behavior of miter joins when
+	 * the joins angle is sharp. Miter joins longer than miter times half stroke width are beveled.
+	 *
+	 * @param[in] miter set the miter limit on the paint, >= 1, 4 by default.
+	 */
+	void setStrokeMiter(float miter);
+	float getStrokeMiter() const;
+	
 	/**
 	 * Return the width of the text.
 	 *
@@ -178,9 +231,15 @@ inline const vec4f& Paint::getColor() const                { return color;
 
 inline void Paint::setStrokeWidth(float width) { this->strokeWidth = width; }
 
+inline Paint::Cap  Paint::getStrokeCap() const  { return static_cast<Cap>(bitfields.capType);   }
+inline Paint::Join Paint::getStrokeJoin() const { return static_cast<Join>(bitfields.joinType); }
+inline void Paint::setStrokeCap(Cap cap)    { bitfields.capType  = static_cast<uint32_t>(cap);  }
+inline void Paint::setStrokeJoin(Join join) { bitfields.joinType = static_cast<uint32_t>(join); }
+
 inline float    Paint::getTextSize() const    { return textSize;    }
 inline float    Paint::getStrokeWidth() const { return strokeWidth; }
 inline float    Paint::getTextScaleX() const  { return textScaleX;  }
+inline float    Paint::getStrokeMiter() const { return strokeMiter; }
 
 }  // namespace pea
 #endif  // PEA_GRAPHICS_PAINT_H_
@@ -1,9 +1,12 @@
 #include "graphics/Path.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <limits>
 #include <sstream>
 
+#include "math/function.h"
 #include "util/Log.h"
 
 using namespace pea;
@@ -15,11 +18,22 @@ Path::Path()
 {
 	verbs.push_back(Verb::MOVE);
 	points.push_back(vec2f(0, 0));
+	invalidate();
+}
+
+void Path::invalidate()
+{
+	cache.tolerance = 0;
+	cache.fillValid = false;
+	cache.strokeWidth = -1;
+	cache.strokeValid = false;
+	measure.valid = false;
 }
 
 Path& Path::moveTo(const vec2f& point0)
 {
 	assert(!verbs.empty());
+	invalidate();
 	if(verbs[verbs.size() - 1] == Verb::MOVE)  // replace last point
 		points[points.size() - 1] = point0;
 	else  // append new point
@@ -33,6 +47,7 @@ Path& Path::moveTo(const vec2f& point0)
 
 Path& Path::lineTo(const vec2f& point1)
 {
+	invalidate();
 //	assert(!verbs.empty() && verbs[verbs.size - 1] == Verb::MOVE);
 	verbs.push_back(Verb::LINE);
 	points.push_back(point1);
@@ -42,6 +57,7 @@ Path& Path::lineTo(const vec2f& point1)
 
 Path& Path::quadTo(const vec2f& point1, const vec2f& point2)
 {
+	invalidate();
 	verbs.push_back(Verb::QUAD);
 	points.push_back(point1);
 	points.push_back(point2);
@@ -51,6 +67,7 @@ Path& Path::quadTo(const vec2f& point1, const vec2f& point2)
 
 Path& Path::cubicTo(const vec2f& point1, const vec2f& point2, const vec2f& point3)
 {
+	invalidate();
 	verbs.push_back(Verb::CUBIC);
 	points.push_back(point1);
 	points.push_back(point2);
@@ -86,6 +103,7 @@ Path& Path::addRect(const Rect<float>& rect, Path::Direction direction, int32_t
 
 Path& Path::arcTo(const vec2f& center, float sweepAngle)
 {
+	invalidate();
 	verbs.push_back(Verb::ARC);
 	points.push_back(center);
 	points.push_back(vec2f(sweepAngle, 0));
@@ -100,6 +118,7 @@ Path& Path::addOval(const Rect<float>& oval, Direction direction, int32_t startI
 
 Path& Path::close()
 {
+	invalidate();
 #if 1
 	verbs.push_back(Verb::CLOSE);
 #else
@@ -118,6 +137,7 @@ static constexpr int32_t advance(Path::Verb verb)
 	case Verb::LINE:  return 1;
 	case Verb::ARC:   return 2;  // center + radius
 	case Verb::QUAD:  return 2;
+	case Verb::CUBIC: return 3;
 	case Verb::CLOSE: return 0;
 	default:  assert(false);  return 0;
 	}
@@ -158,102 +178,763 @@ std::string Path::toString() const
 vec4f Path::lineSpace(const float* intervals, vec4f* transforms, size_t length, float& offset) const
 {
 	assert(intervals != nullptr && transforms != nullptr && length > 0);
-	if(verbs.empty())
-		return vec4f(0, 0, 1, 0);  // at the origin along positive X axis.
-	
-	size_t verbIndex = 0, pointIndex = 0, index = 0;
-	vec2f lastPoint, direction;
-	while(index < length)
+	std::vector<float> distances(length);
+	for(size_t i = 0; i < length; ++i)
+	{
+		assert(intervals[i] > 0);
+		distances[i] = offset;
+		offset += intervals[i];
+	}
+
+	getTransforms(distances.data(), transforms, length);
+	return transforms[length - 1];
+}
+
+static constexpr uint32_t CURVE_INTERVAL_COUNT = 16;
+
+static vec2f getPoint(const vec2f* p, Path::Verb verb, float t)
+{
+	const float s = 1 - t;
+	switch(verb)
+	{
+	case Path::Verb::LINE:  return s * p[0] + t * p[1];
+	case Path::Verb::QUAD:  return s * s * p[0] + 2 * s * t * p[1] + t * t * p[2];
+	case Path::Verb::CUBIC: return s * s * s * p[0] + 3 * s * s * t * p[1] + 3 * s * t * t * p[2] + t * t * t * p[3];
+	case Path::Verb::ARC:
+	{
+		const vec2f vector = p[0] - p[1];
+		const float angle = p[2].x * t;
+		const float cos_a = std::cos(angle), sin_a = std::sin(angle);
+		return p[1] + vec2f(vector.x * cos_a - vector.y * sin_a, vector.x * sin_a + vector.y * cos_a);
+	}
+	default:
+		assert(false);
+		return p[0];
+	}
+}
+
+static vec2f getDerivative(const vec2f* p, Path::Verb verb, float t)
+{
+	const float s = 1 - t;
+	switch(verb)
+	{
+	case Path::Verb::LINE:  return p[1] - p[0];
+	case Path::Verb::QUAD:  return 2 * s * (p[1] - p[0]) + 2 * t * (p[2] - p[1]);
+	case Path::Verb::CUBIC: return 3 * s * s * (p[1] - p[0]) + 6 * s * t * (p[2] - p[1]) + 3 * t * t * (p[3] - p[2]);
+	case Path::Verb::ARC:
+	{
+		// rotate by 90 degrees more, scaled by sweep angle.
+		const vec2f vector = getPoint(p, verb, t) - p[1];
+		return p[2].x * vec2f(-vector.y, vector.x);
+	}
+	default:
+		assert(false);
+		return p[1] - p[0];
+	}
+}
+
+void Path::updateMeasure() const
+{
+	if(measure.valid)
+		return;
+
+	measure.valid = true;
+	measure.length = 0;
+	measure.segments.clear();
+	measure.intervals.clear();
+
+	vec2f start(0, 0), last(0, 0);
+	size_t pointIndex = 0;
+	for(Verb verb: verbs)
 	{
-		assert(intervals[index] > 0);
-		const Verb& verb = verbs[verbIndex];
+		Segment segment;
+		segment.verb = verb;
+		segment.points[0] = last;
 		switch(verb)
 		{
 		case Verb::MOVE:
-//			slog.d(TAG, "move pointIndex=%d, size=%d", pointIndex, points.size());
-			assert(pointIndex < points.size());
-			lastPoint = points[pointIndex];
-			++verbIndex;
-			pointIndex += advance(verb);
+			start = last = points[pointIndex];
 			break;
 		case Verb::LINE:
+		case Verb::QUAD:
+		case Verb::CUBIC:
+			for(int32_t i = 0; i < advance(verb); ++i)
+				segment.points[i + 1] = points[pointIndex + i];
+			last = points[pointIndex + advance(verb) - 1];
+			break;
+		case Verb::ARC:
+			segment.points[1] = points[pointIndex];
+			segment.points[2] = points[pointIndex + 1];
+			last = getPoint(segment.points, verb, 1);
+			break;
+		case Verb::CLOSE:
+			segment.verb = Verb::LINE;
+			segment.points[1] = start;
+			last = start;
+			break;
+		default:
+			assert(false);
+			break;
+		}
+		pointIndex += advance(verb);
+		if(verb == Verb::MOVE)
+			continue;
+
+		// lines and arcs have constant speed, curves are split into intervals of parameter.
+		const uint32_t segmentIndex = static_cast<uint32_t>(measure.segments.size());
+		const Segment& s = measure.segments.emplace_back(segment);
+		const uint32_t count = segment.verb == Verb::QUAD || segment.verb == Verb::CUBIC? CURVE_INTERVAL_COUNT: 1;
+		auto speed = [&s](float t) { return getDerivative(s.points, s.verb, t).length(); };
+		for(uint32_t i = 0; i < count; ++i)
 		{
-			assert(pointIndex < points.size());
-			vec2 vector = points[pointIndex] - lastPoint;
-			float length = vector.length();
-			direction = vector / length;
-			if(offset <= length)
+			Interval interval;
+			interval.distance = measure.length;
+			interval.t0 = static_cast<float>(i) / count;
+			interval.t1 = static_cast<float>(i + 1) / count;
+			interval.length = count == 1? speed(0): integrateGaussLegendre(speed, interval.t0, interval.t1);
+			interval.segment = segmentIndex;
+			if(interval.length > 0 && std::isfinite(interval.length))
 			{
-				vec2 point = lastPoint + offset * direction;
-				//float angle = std::atan2(vector.y, vector.x);
-//				slog.i(TAG, "%d position(%f, %f), angle=%f tangent(%f, %f)", index, point.x, point.y, direction.x, direction.y);
-				transforms[index] = vec4f(point.x, point.y, direction.x, direction.y);
-				offset += intervals[index];
-				++index;
+				measure.intervals.push_back(interval);
+				measure.length += interval.length;
 			}
-			else
+		}
+	}
+}
+
+float Path::getLength() const
+{
+	updateMeasure();
+	return measure.length;
+}
+
+vec4f Path::getTransform(const Interval& interval, float distance) const
+{
+	const Segment& segment = measure.segments[interval.segment];
+	const vec2f* p = segment.points;
+	const float dt = interval.t1 - interval.t0;
+	const float target = std::clamp(distance - interval.distance, 0.0F, interval.length);
+	float t = interval.t0 + dt * (target / interval.length);
+	if(segment.verb == Verb::QUAD || segment.verb == Verb::CUBIC)
+	{
+		// Newton's method on length(t0, t) - target, whose derivative is speed.
+		auto speed = [p, &segment](float t) { return getDerivative(p, segment.verb, t).length(); };
+		for(int32_t i = 0; i < 2; ++i)
+		{
+			float velocity = speed(t);
+			if(!(velocity > 0))
+				break;
+			t -= (integrateGaussLegendre(speed, interval.t0, t) - target) / velocity;
+			t = std::clamp(t, interval.t0, interval.t1);
+		}
+	}
+
+	vec2f point = getPoint(p, segment.verb, t);
+	vec2f tangent = getDerivative(p, segment.verb, t);
+	float length = tangent.length();
+	tangent = length > 0? tangent / length: vec2f(1, 0);
+	return vec4f(point.x, point.y, tangent.x, tangent.y);
+}
+
+vec4f Path::getTransform(float distance) const
+{
+	updateMeasure();
+	const std::vector<Interval>& intervals = measure.intervals;
+	if(intervals.empty())
+		return vec4f(0, 0, 1, 0);  // at the origin along positive X axis.
+
+	auto it = std::upper_bound(intervals.begin(), intervals.end(), distance,
+			[](float distance, const Interval& interval) { return distance < interval.distance; });
+	return getTransform(it == intervals.begin()? intervals.front(): *(it - 1), distance);
+}
+
+void Path::getTransforms(const float* distances, vec4f* transforms, size_t count) const
+{
+	updateMeasure();
+	const std::vector<Interval>& intervals = measure.intervals;
+	if(intervals.empty())
+	{
+		std::fill(transforms, transforms + count, vec4f(0, 0, 1, 0));
+		return;
+	}
+
+	size_t index = 0;
+	for(size_t i = 0; i < count; ++i)
+	{
+		const float distance = distances[i];
+		if(distance < intervals[index].distance)  // going back, search again
+		{
+			auto it = std::upper_bound(intervals.begin(), intervals.begin() + index, distance,
+					[](float distance, const Interval& interval) { return distance < interval.distance; });
+			index = it == intervals.begin()? 0: it - intervals.begin() - 1;
+		}
+		else  // walk forward, few intervals are passed between close distances.
+			while(index + 1 < intervals.size() && intervals[index + 1].distance <= distance)
+				++index;
+
+		transforms[i] = getTransform(intervals[index], distance);
+	}
+}
+
+void Path::Polyline::endContour(bool closed)
+{
+	const uint32_t begin = contours.empty()? 0: contours.back().end;
+	if(points.size() >= begin + 2)
+		contours.push_back(Contour{static_cast<uint32_t>(points.size()), closed});
+	else
+		points.resize(begin);
+}
+
+static constexpr uint32_t MAXIMUM_SEGMENT_COUNT = 1024;
+
+static uint32_t clampSegmentCount(float count)
+{
+	return static_cast<uint32_t>(std::clamp(count, 1.0F, static_cast<float>(MAXIMUM_SEGMENT_COUNT)));
+}
+
+uint32_t Path::getArcSegmentCount(float radius, float angle, float tolerance)
+{
+	// chord of angle step is within tolerance of arc, cos(step / 2) = 1 - tolerance / radius
+	float step = radius > tolerance? 2 * std::acos(1 - tolerance / radius): static_cast<float>(M_PI_2);
+	return clampSegmentCount(std::ceil(std::abs(angle) / step));
+}
+
+/**
+ * Append an arc rotating vector from center + from by angle, the first point excluded.
+ */
+static void addArc(std::vector<vec2f>& points, const vec2f& center, const vec2f& from, float angle, float tolerance)
+{
+	const uint32_t count = Path::getArcSegmentCount(from.length(), angle, tolerance);
+	for(uint32_t i = 1; i <= count; ++i)
+	{
+		float theta = angle * i / count;
+		float cos_a = std::cos(theta), sin_a = std::sin(theta);
+		points.push_back(center + vec2f(from.x * cos_a - from.y * sin_a, from.x * sin_a + from.y * cos_a));
+	}
+}
+
+static void flatten(const std::vector<Path::Verb>& verbs, const std::vector<vec2f>& points, float tolerance,
+		Path::Polyline& polyline)
+{
+	using Verb = Path::Verb;
+	std::vector<vec2f>& output = polyline.points;
+	vec2f start(0, 0), last(0, 0);
+	size_t pointIndex = 0;
+	bool open = false;  // a contour is being flattened
+	auto begin = [&]()
+	{
+		if(!open)
+		{
+			output.push_back(start);
+			open = true;
+		}
+	};
+
+	for(Verb verb: verbs)
+	{
+		switch(verb)
+		{
+		case Verb::MOVE:
+			polyline.endContour(false);
+			start = last = points[pointIndex++];
+			output.push_back(start);
+			open = true;
+			break;
+
+		case Verb::LINE:
+			begin();
+			last = points[pointIndex++];
+			output.push_back(last);
+			break;
+
+		case Verb::QUAD:
+		{
+			// Wang's formula, segments of a degree n curve are within tolerance of the curve with
+			// sqrt(n * (n - 1) / 8 * M / tolerance) segments, where M bounds the second differences.
+			begin();
+			const vec2f& p0 = last;
+			const vec2f& p1 = points[pointIndex];
+			const vec2f& p2 = points[pointIndex + 1];
+			float M = (p0 - 2.0F * p1 + p2).length();
+			uint32_t count = clampSegmentCount(std::ceil(std::sqrt(0.25F * M / tolerance)));
+			for(uint32_t i = 1; i < count; ++i)
 			{
-				offset -= length;
-				lastPoint = points[pointIndex];
-				++verbIndex;
-				pointIndex += advance(verb);
+				float t = static_cast<float>(i) / count, s = 1 - t;
+				output.push_back(s * s * p0 + 2 * s * t * p1 + t * t * p2);
 			}
+			output.push_back(p2);
+			last = p2;
+			pointIndex += 2;
+			break;
+		}
 
+		case Verb::CUBIC:
+		{
+			begin();
+			const vec2f& p0 = last;
+			const vec2f& p1 = points[pointIndex];
+			const vec2f& p2 = points[pointIndex + 1];
+			const vec2f& p3 = points[pointIndex + 2];
+			float M = std::max((p0 - 2.0F * p1 + p2).length(), (p1 - 2.0F * p2 + p3).length());
+			uint32_t count = clampSegmentCount(std::ceil(std::sqrt(0.75F * M / tolerance)));
+			for(uint32_t i = 1; i < count; ++i)
+			{
+				float t = static_cast<float>(i) / count, s = 1 - t;
+				output.push_back(s * s * s * p0 + 3 * s * s * t * p1 + 3 * s * t * t * p2 + t * t * t * p3);
+			}
+			output.push_back(p3);
+			last = p3;
+			pointIndex += 3;
 			break;
 		}
+
 		case Verb::ARC:
+			// rotate last point around center, the same way as lineSpace() does.
+			begin();
+			addArc(output, points[pointIndex], last - points[pointIndex], points[pointIndex + 1].x, tolerance);
+			last = output.back();
+			pointIndex += 2;
+			break;
+
+		case Verb::CLOSE:
+			if(open)
+				polyline.endContour(true);
+			open = false;
+			last = start;
+			break;
+
+		default:
+			assert(false);
+			break;
+		}
+	}
+
+	if(open)
+		polyline.endContour(false);
+}
+
+void Path::update(float tolerance, const Paint* paint) const
+{
+	assert(tolerance > 0);
+	if(cache.tolerance != tolerance)
+	{
+		cache.tolerance = tolerance;
+		cache.polyline.clear();
+		cache.fillValid = false;
+		cache.strokeWidth = -1;
+		::flatten(verbs, points, tolerance, cache.polyline);
+	}
+
+	if(!paint)
+		return;
+
+	const float width = paint->getStrokeWidth();
+	if(cache.strokeWidth != width || cache.cap != paint->getStrokeCap() ||
+			cache.join != paint->getStrokeJoin() || cache.miter != paint->getStrokeMiter())
+	{
+		cache.strokeWidth = width;
+		cache.cap = paint->getStrokeCap();
+		cache.join = paint->getStrokeJoin();
+		cache.miter = paint->getStrokeMiter();
+		cache.outline.clear();
+		cache.strokeValid = false;
+		stroke(cache.polyline, width, cache.cap, cache.join, cache.miter, tolerance, cache.outline);
+	}
+}
+
+const Path::Polyline& Path::flatten(float tolerance) const
+{
+	update(tolerance, nullptr);
+	return cache.polyline;
+}
+
+const std::vector<vec2f>& Path::getFillTriangles(float tolerance) const
+{
+	update(tolerance, nullptr);
+	if(!cache.fillValid)
+	{
+		cache.fill.clear();
+		triangulate(cache.polyline, cache.fill);
+		cache.fillValid = true;
+	}
+	return cache.fill;
+}
+
+const Path::Polyline& Path::getStrokeOutline(const Paint& paint, float tolerance) const
+{
+	update(tolerance, &paint);
+	return cache.outline;
+}
+
+const std::vector<vec2f>& Path::getStrokeTriangles(const Paint& paint, float tolerance) const
+{
+	update(tolerance, &paint);
+	if(!cache.strokeValid)
+	{
+		cache.stroke.clear();
+		triangulate(cache.outline, cache.stroke);
+		cache.strokeValid = true;
+	}
+	return cache.stroke;
+}
+
+namespace {
+
+inline vec2f getLeftNormal(const vec2f& direction)
+{
+	return vec2f(-direction.y, direction.x);
+}
+
+/**
+ * Offset polylines to the left by half width, and connect them with joins and caps.
+ */
+struct Stroker
+{
+	float halfWidth;
+	Paint::Cap cap;
+	Paint::Join join;
+	float miter;
+	float tolerance;
+	Path::Polyline& outline;
+	uint32_t begin;  ///< first point of the contour being outlined
+
+	void push(const vec2f& point)
+	{
+		if(outline.points.size() == begin || outline.points.back() != point)
+			outline.points.push_back(point);
+	}
+
+	void endContour()
+	{
+		if(outline.points.size() > begin + 1 && outline.points.back() == outline.points[begin])
+			outline.points.pop_back();
+		outline.endContour(true);
+		begin = static_cast<uint32_t>(outline.points.size());
+	}
+
+	/**
+	 * Join on the left side at vertex, from direction a to direction b.
+	 */
+	void addJoin(const vec2f& vertex, const vec2f& a, const vec2f& b)
+	{
+		const vec2f na = getLeftNormal(a) * halfWidth;
+		const vec2f nb = getLeftNormal(b) * halfWidth;
+		const float sine = cross(a, b), cosine = dot(a, b);
+		push(vertex + na);
+		if(sine > 0 || cosine > 0.9999F)  // inner side, or almost straight
+		{
+			if(sine > 0)
+				push(vertex);
+			push(vertex + nb);
+			return;
+		}
+
+		switch(join)
+		{
+		case Paint::Join::MITER:
+			// miter length is half width / cos(theta / 2), where theta is the angle between normals.
+			if(std::sqrt((1 + cosine) * 0.5F) * miter >= 1)
+				push(vertex + (na + nb) / (1 + cosine));
+			break;
+
+		case Paint::Join::ROUND:
+		{
+			// rotate clockwise, bulging forward.
+			float angle = std::atan2(sine, cosine);
+			if(angle > 0)
+				angle = -static_cast<float>(M_PI);
+			addArc(outline.points, vertex, na, angle, tolerance);
+			break;
+		}
+
+		case Paint::Join::BEVEL:
+			break;
+		}
+		push(vertex + nb);
+	}
+
+	/**
+	 * Cap at end of direction, from the left side to the right side.
+	 */
+	void addCap(const vec2f& end, const vec2f& direction)
+	{
+		const vec2f normal = getLeftNormal(direction) * halfWidth;
+		switch(cap)
+		{
+		case Paint::Cap::BUTT:
+			break;
+
+		case Paint::Cap::ROUND:
+			push(end + normal);
+			addArc(outline.points, end, normal, -static_cast<float>(M_PI), tolerance);
+			break;
+
+		case Paint::Cap::SQUARE:
+		{
+			const vec2f extension = direction * halfWidth;
+			push(end + normal + extension);
+			push(end - normal + extension);
+			break;
+		}
+		}
+		push(end - normal);
+	}
+
+	void addSide(const vec2f* points, const vec2f* directions, size_t count, bool closed)
+	{
+		if(closed)
 		{
-			const vec2f& center = points[pointIndex];
-			float sweepAngle = points[pointIndex + 1].x;
-			
-			vec2 vector = lastPoint - center;
-			float radius = vector.length();
-			float arcLength = radius * std::abs(sweepAngle);
-//			slog.i(TAG, "offset=%f, arcLength=%f, center(%f, %f), lastPoint(%f, %f)", offset, arcLength, center.x, center.y, lastPoint.x, lastPoint.y);
-			if(offset <= arcLength)
+			for(size_t i = 0; i < count; ++i)
+				addJoin(points[i], directions[i == 0? count - 1: i - 1], directions[i]);
+			return;
+		}
+
+		push(points[0] + getLeftNormal(directions[0]) * halfWidth);
+		for(size_t i = 1; i + 1 < count; ++i)
+			addJoin(points[i], directions[i - 1], directions[i]);
+		push(points[count - 1] + getLeftNormal(directions[count - 2]) * halfWidth);
+	}
+
+	void addDot(const vec2f& center)
+	{
+		if(cap == Paint::Cap::ROUND)
+		{
+			const vec2f from(halfWidth, 0);
+			push(center + from);
+			addArc(outline.points, center, from, static_cast<float>(2 * M_PI), tolerance);
+		}
+		else if(cap == Paint::Cap::SQUARE)
+		{
+			push(center + vec2f(-halfWidth, -halfWidth));
+			push(center + vec2f( halfWidth, -halfWidth));
+			push(center + vec2f( halfWidth,  halfWidth));
+			push(center + vec2f(-halfWidth,  halfWidth));
+		}
+		endContour();
+	}
+};
+
+}  // namespace
+
+void Path::stroke(const Polyline& polyline, float width, Paint::Cap cap, Paint::Join join,
+		float miter, float tolerance, Polyline& outline)
+{
+	assert(tolerance > 0);
+	if(!(width > 0))
+		return;
+
+	Stroker stroker = { width * 0.5F, cap, join, miter, tolerance, outline, static_cast<uint32_t>(outline.points.size()) };
+	std::vector<vec2f> points, directions;
+	for(size_t contour = 0; contour < polyline.contours.size(); ++contour)
+	{
+		// drop repeated points, which have no direction.
+		points.clear();
+		for(uint32_t i = polyline.getBegin(contour), end = polyline.contours[contour].end; i < end; ++i)
+			if(points.empty() || points.back() != polyline.points[i])
+				points.push_back(polyline.points[i]);
+
+		bool closed = polyline.contours[contour].closed;
+		if(closed && points.size() > 1 && points.back() == points.front())
+			points.pop_back();
+		const size_t count = points.size();
+		if(count == 1)
+		{
+			stroker.addDot(points[0]);
+			continue;
+		}
+
+		directions.resize(count);
+		for(size_t i = 0; i + 1 < count; ++i)
+			directions[i] = (points[i + 1] - points[i]).normalize();
+		directions[count - 1] = closed? (points[0] - points[count - 1]).normalize(): directions[count - 2];
+
+		stroker.addSide(points.data(), directions.data(), count, closed);
+		if(!closed)
+			stroker.addCap(points[count - 1], directions[count - 2]);
+		else
+			stroker.endContour();
+
+		// the other side is the left side of the reversed polyline.
+		std::reverse(points.begin(), points.end());
+		// reversed direction i is of segment count - 1 - i to count - 2 - i, rotate by one.
+		std::rotate(directions.begin(), directions.end() - 1, directions.end());
+		std::reverse(directions.begin(), directions.end());
+		for(vec2f& direction: directions)
+			direction = -direction;
+
+		stroker.addSide(points.data(), directions.data(), count, closed);
+		if(!closed)
+			stroker.addCap(points[count - 1], directions[count - 2]);
+		stroker.endContour();
+	}
+}
+
+namespace {
+
+struct Edge
+{
+	vec2f top;
+	vec2f bottom;
+	float slope;      ///< dx / dy
+	int32_t winding;  ///< +1 if edge goes down, -1 if it goes up
+
+	// trapezoid of which this edge is the left side, kept open while bands have the same sides.
+	Edge* right;
+	float from, to;
+	uint32_t band;
+
+	float getX(float y) const { return y == bottom.y? bottom.x: top.x + (y - top.y) * slope; }
+};
+
+/**
+ * Sort edges by x at y, they are almost in order from band to band, so insertion sort does it in
+ * linear time mostly.
+ */
+void sort(std::vector<Edge*>& edges, float y)
+{
+	for(size_t i = 1; i < edges.size(); ++i)
+	{
+		Edge* edge = edges[i];
+		const float x = edge->getX(y);
+		size_t j = i;
+		for(; j > 0 && edges[j - 1]->getX(y) > x; --j)
+			edges[j] = edges[j - 1];
+		edges[j] = edge;
+	}
+}
+
+void addTrapezoid(const Edge& left, std::vector<vec2f>& triangles)
+{
+	// degenerate triangles are left out.
+	const Edge& right = *left.right;
+	vec2f a(left.getX(left.from), left.from), b(right.getX(left.from), left.from);
+	vec2f c(right.getX(left.to), left.to), d(left.getX(left.to), left.to);
+	if(a.x < b.x)
+		triangles.insert(triangles.end(), {a, b, c});
+	if(d.x < c.x)
+		triangles.insert(triangles.end(), {a, c, d});
+}
+
+}  // namespace
+
+void Path::triangulate(const Polyline& polyline, std::vector<vec2f>& triangles)
+{
+	std::vector<Edge> edges;
+	std::vector<float> ys;
+	edges.reserve(polyline.points.size());
+	ys.reserve(polyline.points.size());
+	for(size_t contour = 0; contour < polyline.contours.size(); ++contour)
+	{
+		const uint32_t begin = polyline.getBegin(contour), end = polyline.contours[contour].end;
+		for(uint32_t i = begin; i < end; ++i)
+		{
+			const vec2f& p0 = polyline.points[i];
+			const vec2f& p1 = polyline.points[i + 1 < end? i + 1: begin];
+			if(!std::isfinite(p0.x) || !std::isfinite(p0.y) || !std::isfinite(p1.x) || !std::isfinite(p1.y))
+				continue;
+
+			ys.push_back(p0.y);
+			if(p0.y == p1.y)
+				continue;
+
+			Edge edge;
+			edge.winding = p0.y < p1.y? +1: -1;
+			edge.top    = p0.y < p1.y? p0: p1;
+			edge.bottom = p0.y < p1.y? p1: p0;
+			edge.slope = (edge.bottom.x - edge.top.x) / (edge.bottom.y - edge.top.y);
+			edge.right = nullptr;
+			edge.band = 0;
+			edges.push_back(edge);
+		}
+	}
+
+	std::sort(ys.begin(), ys.end());
+	ys.erase(std::unique(ys.begin(), ys.end()), ys.end());
+	std::sort(edges.begin(), edges.end(), [](const Edge& lhs, const Edge& rhs) { return lhs.top.y < rhs.top.y; });
+
+	std::vector<Edge*> active, opened, next;
+	std::vector<float> splits, minimums;
+	uint32_t band = 0;
+	size_t edgeIndex = 0;
+	for(size_t i = 0; i + 1 < ys.size(); ++i)
+	{
+		const float y0 = ys[i], y1 = ys[i + 1];
+		active.erase(std::remove_if(active.begin(), active.end(), [y0](const Edge* edge) { return edge->bottom.y <= y0; }), active.end());
+		for(; edgeIndex < edges.size() && edges[edgeIndex].top.y <= y0; ++edgeIndex)
+			if(edges[edgeIndex].bottom.y > y0)
+				active.push_back(&edges[edgeIndex]);
+
+		// split the band where edges cross, so that edges keep their order in each part. Edges
+		// sorted by x at y0 cross the ones after them that are on their left at y1, none is left
+		// once the minimum x at y1 of the rest isn't.
+		splits.clear();
+		splits.push_back(y0);
+		sort(active, y0);
+		minimums.resize(active.size() + 1);
+		minimums[active.size()] = std::numeric_limits<float>::infinity();
+		for(size_t j = active.size(); j > 0; --j)
+			minimums[j - 1] = std::min(minimums[j], active[j - 1]->getX(y1));
+		for(size_t j = 0; j < active.size(); ++j)
+		{
+			const float x0 = active[j]->getX(y0), x1 = active[j]->getX(y1);
+			for(size_t k = j + 1; k < active.size() && minimums[k] < x1; ++k)
 			{
-				float angle = std::copysign(offset / radius, sweepAngle);
-				float cos_a = std::cos(angle);
-				float sin_a = std::sin(angle);
-				
-				// (x, y) * (cos_a, sin_a) = (x * cos_a - y * sin_a, x * sin_a + y * cos_a);
-				direction = vector / radius;
-				vec2f rotation(direction.x * cos_a - direction.y * sin_a, direction.x * sin_a + direction.y * cos_a);
-				vec2f point = center + radius * rotation;
-				
-				//angle += std::atan2(vector.y, vector.x);
-				// positive, ccw (x, y)( cw 90,  cw ccw
-				// rotate direction(x, y) 90 degrees, that's (-y, x) for positive sweepAngle
-				// (y, -x) for negative sweepAngle.
-				if(sweepAngle >= 0)
-					direction = vec2f(-rotation.y, rotation.x);
-				else
-					direction = vec2f(rotation.y, -rotation.x);
-//			slog.i(TAG, "%d position(%f, %f), angle=%f, tanget=(%f, %f)", index, point.x, point.y, angle, direction.x, direction.y);
-				transforms[index] = vec4f(point.x, point.y, direction.x, direction.y);
-				offset += intervals[index];
-				++index;
+				float d0 = x0 - active[k]->getX(y0);
+				float d1 = x1 - active[k]->getX(y1);
+				if(d0 < 0 && d1 > 0)
+				{
+					float y = y0 + (y1 - y0) * d0 / (d0 - d1);
+					if(y0 < y && y < y1)
+						splits.push_back(y);
+				}
 			}
-			else
+		}
+		std::sort(splits.begin(), splits.end());
+		splits.erase(std::unique(splits.begin(), splits.end()), splits.end());
+		splits.push_back(y1);
+
+		for(size_t k = 0; k + 1 < splits.size(); ++k)
+		{
+			const float top = splits[k], bottom = splits[k + 1];
+			sort(active, (top + bottom) * 0.5F);  // edges from the same vertex are ordered too
+
+			// spans of non-zero winding number, continue trapezoids of the same sides.
+			++band;
+			int32_t winding = 0;
+			Edge* left = nullptr;
+			for(Edge* edge: active)
 			{
-				offset -= arcLength;
-//				slog.i(TAG, "offset=%f", offset);
-				float cos_a = std::cos(sweepAngle);
-				float sin_a = std::sin(sweepAngle);
-				vec2f rotation(vector.x * cos_a - vector.y * sin_a, vector.x * sin_a + vector.y * cos_a);
-				lastPoint = center + rotation;
-				
-				++verbIndex;
-				pointIndex += advance(verb);
+				const int32_t previous = winding;
+				winding += edge->winding;
+				if(previous == 0 && winding != 0)
+					left = edge;
+				else if(previous != 0 && winding == 0)
+				{
+					if(left->right != edge)
+					{
+						if(left->right)
+							addTrapezoid(*left, triangles);
+						left->right = edge;
+						left->from = top;
+					}
+					left->to = bottom;
+					left->band = band;
+					next.push_back(left);
+				}
 			}
-			break;
-		}
-		
-		case Verb::QUAD:
-			break;
+
+			for(Edge* edge: opened)
+				if(edge->band != band && edge->right)
+				{
+					addTrapezoid(*edge, triangles);
+					edge->right = nullptr;
+				}
+			opened.swap(next);
+			next.clear();
 		}
-		
 	}
-	
-	return vec4f(lastPoint.x, lastPoint.y, direction.x, direction.y);
+
+	for(Edge* edge: opened)
+		if(edge->right)
+			addTrapezoid(*edge, triangles);
 }
@@ -7,12 +7,20 @@
 
 #include "math/vec2.h"
 #include "math/vec4.h"
+#include "graphics/Paint.h"
 #include "graphics/Rect.h"
 
 namespace pea {
 
 /**
  * https://www.w3.org/TR/SVG/paths.html
+ *
+ * Besides the verbs, a path keeps its geometry derived for drawing: curves flattened into line
+ * segments, outlines of strokes, and triangles of fills and strokes. They are built on first use for
+ * a tolerance and a stroke style, kept until the path changes, so that a path drawn every frame is
+ * only tessellated once. Triangles are built only when asked for, apart from the polylines they
+ * come from. The cache is mutated by const methods, which makes concurrent use of one
+ * path unsafe.
  */
 class Path
 {
@@ -35,11 +43,99 @@ public:
 		CW,
 	};
 
+	struct Contour
+	{
+		uint32_t end;  ///< index past the last point of the contour
+		bool closed;
+	};
+	
+	/**
+	 * Contours of line segments, points of contour i are [contours[i - 1].end, contours[i].end).
+	 * Closed contours have an implied segment from the last point back to the first one.
+	 */
+	struct Polyline
+	{
+		std::vector<vec2f> points;
+		std::vector<Contour> contours;
+		
+		void clear();
+		
+		/**
+		 * End the contour of points added since the last one, which is dropped if it has less
+		 * than 2 points.
+		 */
+		void endContour(bool closed);
+		
+		uint32_t getBegin(size_t contour) const;
+	};
+
 private:
 	std::vector<Verb> verbs;
 	std::vector<vec2f> points;
 //	vec2f startPoint;
 
+	struct Cache
+	{
+		float tolerance;  ///< 0 if nothing is cached
+		Polyline polyline;
+		std::vector<vec2f> fill;
+		bool fillValid;  ///< fill is triangulated from polyline
+		
+		float strokeWidth;  ///< negative if stroke isn't cached
+		Paint::Cap cap;
+		Paint::Join join;
+		float miter;
+		Polyline outline;
+		std::vector<vec2f> stroke;
+		bool strokeValid;  ///< stroke is triangulated from outline
+	};
+	mutable Cache cache;
+	
+	/**
+	 * Segments are parameterized by t in [0, 1], ARC keeps start, center and (sweepAngle, 0).
+	 */
+	struct Segment
+	{
+		Verb verb;
+		vec2f points[4];
+	};
+	
+	/**
+	 * Part of a segment in arc length table, from parameter t0 to t1.
+	 */
+	struct Interval
+	{
+		float distance;  ///< from the path start to the interval start
+		float length;
+		float t0, t1;
+		uint32_t segment;
+	};
+	
+	struct Measure
+	{
+		bool valid;
+		float length;
+		std::vector<Segment> segments;
+		std::vector<Interval> intervals;
+	};
+	mutable Measure measure;
+
+private:
+	void invalidate();
+	
+	/**
+	 * Make cache hold polyline of tolerance, and outline of paint if paint is given. Triangles are
+	 * marked invalid when their polyline changes, and left for getters to build.
+	 */
+	void update(float tolerance, const Paint* paint) const;
+	
+	/**
+	 * Build the arc length table, if it's not built since the path changed.
+	 */
+	void updateMeasure() const;
+	
+	vec4f getTransform(const Interval& interval, float distance) const;
+
 public:
 	Path();
 	
@@ -83,15 +179,112 @@ public:
 	std::string toString() const;
 	
 	/**
-	 * @param[in] internal
+	 * Verbs and their points, MOVE and LINE take 1 point, QUAD takes 2, CUBIC takes 3, ARC takes
+	 * center and (sweepAngle, 0), CLOSE takes none.
+	 */
+	const std::vector<Verb>& getVerbs() const;
+	const std::vector<vec2f>& getPoints() const;
+	
+	/**
+	 * Place vertices along the path one interval after another, @see getTransforms().
+	 * @param[in] intervals distances between vertices.
 	 * @param[out] transforms vertex's position and rotation, vec4(x, y, cos_a, sin_a),  where (x, y) is
 	 *             position and (cos_a, sin_a) is tangent vector.
-	 * @param[in] length length of the interval.
-	 * @param[in] offset offset to the first point.
+	 * @param[in] length count of vertices.
+	 * @param[in,out] offset distance of the first vertex, then distance after the last interval.
 	 * @return last vertex's position and rotation
 	 */
 	vec4f lineSpace(const float* interval, vec4f* transforms, size_t length, float& offset) const;
+	
+	/**
+	 * @return length of the path. Contours are measured one after another, closing lines included,
+	 *         moves between them take no distance.
+	 */
+	float getLength() const;
+	
+	/**
+	 * Position and tangent at a distance along the path. Segments are measured once into a table of
+	 * cumulative lengths of parameter intervals, integrated by Gauss-Legendre quadrature, then a
+	 * distance is found by binary search, and its curve parameter refined by Newton's method.
+	 * @param[in] distance clamped to [0, getLength()].
+	 * @return vec4f(x, y, cos_a, sin_a), where (cos_a, sin_a) is the unit tangent.
+	 */
+	vec4f getTransform(float distance) const;
+	
+	/**
+	 * Batch version of getTransform(), runs of ascending distances are walked through the table
+	 * without searching.
+	 */
+	void getTransforms(const float* distances, vec4f* transforms, size_t count) const;
+	
+	/**
+	 * Flatten curves and arcs into line segments, none of which is further than tolerance away
+	 * from the curve. Segment counts are given by the bound of second differences of curves, or by
+	 * the radius of arcs, so that no recursion is involved.
+	 * @param[in] tolerance maximum distance in path's unit, > 0.
+	 * @return the cached polyline, valid until the path changes or is flattened with another
+	 *         tolerance.
+	 */
+	const Polyline& flatten(float tolerance) const;
+	
+	/**
+	 * @return triangles filling the path with non-zero winding rule, 3 vertices each, which don't
+	 *         overlap.
+	 * @see flatten(float tolerance)
+	 */
+	const std::vector<vec2f>& getFillTriangles(float tolerance) const;
+	
+	/**
+	 * @return closed contours outlining the stroke of the path with paint's stroke width, cap, join
+	 *         and miter. It's to be filled with non-zero winding rule.
+	 * @see flatten(float tolerance)
+	 */
+	const Polyline& getStrokeOutline(const Paint& paint, float tolerance) const;
+	
+	/**
+	 * @return triangles filling the stroke of the path, 3 vertices each, which don't overlap, so
+	 *         that a translucent stroke is blended once per pixel.
+	 */
+	const std::vector<vec2f>& getStrokeTriangles(const Paint& paint, float tolerance) const;
+	
+	/**
+	 * @return segment count of an arc, whose chords are within tolerance of the arc.
+	 */
+	static uint32_t getArcSegmentCount(float radius, float angle, float tolerance);
+	
+	/**
+	 * Outline the stroke of polyline with closed contours. An open contour is outlined by its
+	 * left side, end cap, right side and start cap; a closed contour by its left side and its right
+	 * side in reverse. Inner sides of joins pass through the vertex, so that short segments leave
+	 * no gaps.
+	 * @param[in]  width     stroke width, nothing is outlined if it's not positive.
+	 * @param[out] outline   closed contours, which are appended.
+	 */
+	static void stroke(const Polyline& polyline, float width, Paint::Cap cap, Paint::Join join,
+			float miter, float tolerance, Polyline& outline);
+	
+	/**
+	 * Triangulate the region of polyline with non-zero winding rule, all contours are taken as
+	 * closed. Edges are swept by scanline into trapezoids between consecutive ys of vertices and
+	 * of edge crossings, so self intersecting and overlapping contours are handled.
+	 * @param[out] triangles 3 vertices each, which are appended.
+	 */
+	static void triangulate(const Polyline& polyline, std::vector<vec2f>& triangles);
 };
 
+inline void Path::Polyline::clear()
+{
+	points.clear();
+	contours.clear();
+}
+
+inline uint32_t Path::Polyline::getBegin(size_t contour) const
+{
+	return contour == 0? 0: contours[contour - 1].end;
+}
+
+inline const std::vector<Path::Verb>& Path::getVerbs() const { return verbs; }
+inline const std::vector<vec2f>& Path::getPoints() const { return points; }
+
 }  // namespace pea
 #endif  // PEA_GRAPHICS_PATH_H_
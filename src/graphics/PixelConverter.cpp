@@ -0,0 +1,1305 @@
+#include "graphics/PixelConverter.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#include "pea/config.h"
+#if OpenMP_CXX_FOUND
+#include <omp.h>
+#endif
+
+#include "util/cpu.h"
+#include "util/Log.h"
+
+#if PEA_ARCH_X86
+#include <immintrin.h>
+#endif
+
+
+static const char* TAG = "PixelConverter";
+
+using namespace pea;
+
+using Format = Color::Format;
+using InstructionSet = PixelConverter::InstructionSet;
+
+static constexpr size_t CHUNK_SIZE = 256;  // pixels converted through an intermediate buffer at once
+static constexpr size_t FILL_BLOCK_SIZE = 4096;  // bytes, a fill pattern stays in L1 cache
+static constexpr size_t PARALLEL_PIXEL_COUNT = 64 * 1024;
+
+/**
+ * Kernels take pixel count, except the ones between U8 and F32 channels which take channel count.
+ * Kernels of the same size formats work in place.
+ */
+using Kernel = void (*)(const uint8_t* src, uint8_t* dst, size_t count);
+
+struct KernelSet
+{
+	Kernel rgbToRgba;      ///< RGB888 to RGBA8888 with opaque alpha, BGR888 to BGRA8888 as well
+	Kernel rgbaToRgb;      ///< drop alpha
+	Kernel swapRB3;        ///< RGB888 <-> BGR888
+	Kernel swapRB4;        ///< RGBA8888 <-> BGRA8888
+	Kernel rgb565ToRgba;
+	Kernel premultiply;    ///< RGBA8888 or BGRA8888
+	Kernel unpremultiply;
+	Kernel u8ToF32;        ///< c / 255
+	Kernel f32ToU8;        ///< round(clamp(c, 0, 1) * 255)
+	Kernel srgb8ToLinear;  ///< RGBA8888 in sRGB to linear RGBA float
+};
+
+struct Tables
+{
+	alignas(32) float srgbToLinear[512];  // color channels, then alpha channel
+	uint8_t srgbToLinear8[256];
+	uint8_t linearToSrgb8[256];
+
+	Tables()
+	{
+		for(int32_t i = 0; i < 256; ++i)
+		{
+			float c = i * (1.0f / 255);
+			srgbToLinear[i] = srgb2linear(c);
+			srgbToLinear[i + 256] = c;
+			srgbToLinear8[i] = static_cast<uint8_t>(std::lrint(srgb2linear(c) * 255.0f));
+			linearToSrgb8[i] = static_cast<uint8_t>(std::lrint(linear2srgb(c) * 255.0f));
+		}
+	}
+};
+
+static const Tables& getTables()
+{
+	static const Tables tables;
+	return tables;
+}
+
+static inline uint8_t expand5(uint32_t x) { return static_cast<uint8_t>((x << 3) | (x >> 2)); }
+static inline uint8_t expand6(uint32_t x) { return static_cast<uint8_t>((x << 2) | (x >> 4)); }
+static inline uint8_t expand4(uint32_t x) { return static_cast<uint8_t>(x * 17); }
+
+// round(c * max / 255), the fraction part is never 0.5 since 255 is odd.
+static inline uint32_t narrow(uint32_t c, uint32_t max) { return (c * max + 127) / 255; }
+
+// round(c * a / 255) without division
+static inline uint8_t multiply(uint32_t c, uint32_t a)
+{
+	uint32_t t = c * a + 128;
+	return static_cast<uint8_t>((t + (t >> 8)) >> 8);
+}
+
+static inline uint8_t divide(uint32_t c, uint32_t a)
+{
+	return a == 0? 0: static_cast<uint8_t>(std::min<uint32_t>((c * 255 + (a >> 1)) / a, 255));
+}
+
+// NaN goes to 0 as well. Written as max then min, so they compile to maxss and minss.
+static inline float saturate(float v)
+{
+	float x = v > 0.0f? v: 0.0f;
+	return x < 1.0f? x: 1.0f;
+}
+
+static inline float clampSigned(float v)
+{
+	float x = v > -1.0f? v: -1.0f;
+	return x < 1.0f? x: 1.0f;
+}
+
+// Round half away from zero. It's inlined, unlike std::lrint without -fno-math-errno, which is
+// kept where results have to match the vector kernels.
+template<typename T, typename F>
+static inline T roundTo(F v) { return static_cast<T>(v + std::copysign(F(0.5), v)); }
+
+static void rgbToRgbaScalar(const uint8_t* src, uint8_t* dst, size_t count)
+{
+	for(size_t i = 0; i < count; ++i, src += 3, dst += 4)
+	{
+		dst[0] = src[0];
+		dst[1] = src[1];
+		dst[2] = src[2];
+		dst[3] = 0xFF;
+	}
+}
+
+static void rgbaToRgbScalar(const uint8_t* src, uint8_t* dst, size_t count)
+{
+	for(size_t i = 0; i < count; ++i, src += 4, dst += 3)
+	{
+		dst[0] = src[0];
+		dst[1] = src[1];
+		dst[2] = src[2];
+	}
+}
+
+static void swapRB3Scalar(const uint8_t* src, uint8_t* dst, size_t count)
+{
+	for(size_t i = 0; i < count; ++i, src += 3, dst += 3)
+	{
+		uint8_t r = src[0];
+		dst[1] = src[1];
+		dst[0] = src[2];
+		dst[2] = r;
+	}
+}
+
+static void swapRB4Scalar(const uint8_t* src, uint8_t* dst, size_t count)
+{
+	for(size_t i = 0; i < count; ++i, src += 4, dst += 4)
+	{
+		uint8_t r = src[0];
+		dst[0] = src[2];
+		dst[1] = src[1];
+		dst[2] = r;
+		dst[3] = src[3];
+	}
+}
+
+static void rgb565ToRgbaScalar(const uint8_t* src, uint8_t* dst, size_t count)
+{
+	for(size_t i = 0; i < count; ++i, src += 2, dst += 4)
+	{
+		uint32_t x = src[0] | (src[1] << 8);
+		dst[0] = expand5(x & 0x1F);
+		dst[1] = expand6((x >> 5) & 0x3F);
+		dst[2] = expand5(x >> 11);
+		dst[3] = 0xFF;
+	}
+}
+
+static void premultiplyScalar(const uint8_t* src, uint8_t* dst, size_t count)
+{
+	for(size_t i = 0; i < count; ++i, src += 4, dst += 4)
+	{
+		uint32_t a = src[3];
+		dst[0] = multiply(src[0], a);
+		dst[1] = multiply(src[1], a);
+		dst[2] = multiply(src[2], a);
+		dst[3] = static_cast<uint8_t>(a);
+	}
+}
+
+static void unpremultiplyScalar(const uint8_t* src, uint8_t* dst, size_t count)
+{
+	for(size_t i = 0; i < count; ++i, src += 4, dst += 4)
+	{
+		uint32_t a = src[3];
+		dst[0] = divide(src[0], a);
+		dst[1] = divide(src[1], a);
+		dst[2] = divide(src[2], a);
+		dst[3] = static_cast<uint8_t>(a);
+	}
+}
+
+static void u8ToF32Scalar(const uint8_t* src, uint8_t* dst, size_t count)
+{
+	float* d = reinterpret_cast<float*>(dst);
+	for(size_t i = 0; i < count; ++i)
+		d[i] = src[i] * (1.0f / 255);
+}
+
+static void f32ToU8Scalar(const uint8_t* src, uint8_t* dst, size_t count)
+{
+	const float* s = reinterpret_cast<const float*>(src);
+	for(size_t i = 0; i < count; ++i)
+		dst[i] = static_cast<uint8_t>(std::lrint(saturate(s[i]) * 255.0f));
+}
+
+static void srgb8ToLinearScalar(const uint8_t* src, uint8_t* dst, size_t count)
+{
+	const float* table = getTables().srgbToLinear;
+	float* d = reinterpret_cast<float*>(dst);
+	for(size_t i = 0; i < count; ++i, src += 4, d += 4)
+	{
+		d[0] = table[src[0]];
+		d[1] = table[src[1]];
+		d[2] = table[src[2]];
+		d[3] = table[src[3] + 256];
+	}
+}
+
+static const KernelSet SCALAR_KERNELS =
+{
+	rgbToRgbaScalar,
+	rgbaToRgbScalar,
+	swapRB3Scalar,
+	swapRB4Scalar,
+	rgb565ToRgbaScalar,
+	premultiplyScalar,
+	unpremultiplyScalar,
+	u8ToF32Scalar,
+	f32ToU8Scalar,
+	srgb8ToLinearScalar,
+};
+
+#if PEA_ARCH_X86
+
+// Kernels below read and write 16 bytes at a time, loops stop early enough to stay in bounds,
+// and leave the rest to the scalar ones.
+
+TARGET_SSE4_1 static void rgbToRgbaSSE(const uint8_t* src, uint8_t* dst, size_t count)
+{
+	const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m128i alpha = _mm_set1_epi32(0xFF000000);
+	size_t i = 0;
+	for(; i + 6 <= count; i += 4)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3));
+		v = _mm_or_si128(_mm_shuffle_epi8(v, shuffle), alpha);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), v);
+	}
+	rgbToRgbaScalar(src + i * 3, dst + i * 4, count - i);
+}
+
+TARGET_SSE4_1 static void rgbaToRgbSSE(const uint8_t* src, uint8_t* dst, size_t count)
+{
+	const __m128i shuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	size_t i = 0;
+	for(; i + 6 <= count; i += 4)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 3), _mm_shuffle_epi8(v, shuffle));
+	}
+	rgbaToRgbScalar(src + i * 4, dst + i * 3, count - i);
+}
+
+TARGET_SSE4_1 static void swapRB3SSE(const uint8_t* src, uint8_t* dst, size_t count)
+{
+	// the last 4 bytes are stored unchanged, then overwritten by the next 4 pixels.
+	const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 12, 13, 14, 15);
+	size_t i = 0;
+	for(; i + 6 <= count; i += 4)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 3), _mm_shuffle_epi8(v, shuffle));
+	}
+	swapRB3Scalar(src + i * 3, dst + i * 3, count - i);
+}
+
+TARGET_SSE4_1 static void swapRB4SSE(const uint8_t* src, uint8_t* dst, size_t count)
+{
+	const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+	size_t i = 0;
+	for(; i + 4 <= count; i += 4)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_shuffle_epi8(v, shuffle));
+	}
+	swapRB4Scalar(src + i * 4, dst + i * 4, count - i);
+}
+
+TARGET_SSE4_1 static void rgb565ToRgbaSSE(const uint8_t* src, uint8_t* dst, size_t count)
+{
+	const __m128i mask5 = _mm_set1_epi16(0x1F);
+	const __m128i mask6 = _mm_set1_epi16(0x3F);
+	const __m128i alpha = _mm_set1_epi16(static_cast<int16_t>(0xFF00));
+	size_t i = 0;
+	for(; i + 8 <= count; i += 8)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2));
+		__m128i r = _mm_and_si128(v, mask5);
+		__m128i g = _mm_and_si128(_mm_srli_epi16(v, 5), mask6);
+		__m128i b = _mm_srli_epi16(v, 11);
+		r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+		g = _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4));
+		b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+		__m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+		__m128i ba = _mm_or_si128(b, alpha);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_unpacklo_epi16(rg, ba));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4 + 16), _mm_unpackhi_epi16(rg, ba));
+	}
+	rgb565ToRgbaScalar(src + i * 2, dst + i * 4, count - i);
+}
+
+TARGET_SSE4_1 static inline __m128i multiplySSE(__m128i c, __m128i a)
+{
+	__m128i t = _mm_add_epi16(_mm_mullo_epi16(c, a), _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+TARGET_SSE4_1 static void premultiplySSE(const uint8_t* src, uint8_t* dst, size_t count)
+{
+	// alpha of each pixel in 16 bit lanes, alpha itself is multiplied by 255.
+	const __m128i shuffle = _mm_setr_epi8(6, 7, 6, 7, 6, 7, 6, 7, 14, 15, 14, 15, 14, 15, 14, 15);
+	const __m128i opaque = _mm_set1_epi16(255);
+	const __m128i zero = _mm_setzero_si128();
+	size_t i = 0;
+	for(; i + 4 <= count; i += 4)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+		__m128i lo = _mm_unpacklo_epi8(v, zero);
+		__m128i hi = _mm_unpackhi_epi8(v, zero);
+		__m128i alo = _mm_blend_epi16(_mm_shuffle_epi8(lo, shuffle), opaque, 0x88);
+		__m128i ahi = _mm_blend_epi16(_mm_shuffle_epi8(hi, shuffle), opaque, 0x88);
+		v = _mm_packus_epi16(multiplySSE(lo, alo), multiplySSE(hi, ahi));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), v);
+	}
+	premultiplyScalar(src + i * 4, dst + i * 4, count - i);
+}
+
+// one pixel in 32 bit lanes, quotient is exact after floor since numerator < 2^24.
+TARGET_SSE4_1 static inline __m128i divideSSE(__m128i c)
+{
+	__m128i a = _mm_shuffle_epi32(c, 0xFF);
+	__m128 af = _mm_cvtepi32_ps(a);
+	__m128 n = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(c), _mm_set1_ps(255.0f)),
+			_mm_cvtepi32_ps(_mm_srli_epi32(a, 1)));
+	__m128 q = _mm_floor_ps(_mm_div_ps(n, af));
+	q = _mm_and_ps(q, _mm_cmpneq_ps(af, _mm_setzero_ps()));
+	q = _mm_min_ps(q, _mm_set1_ps(255.0f));
+	return _mm_blend_epi16(_mm_cvttps_epi32(q), c, 0xC0);
+}
+
+TARGET_SSE4_1 static void unpremultiplySSE(const uint8_t* src, uint8_t* dst, size_t count)
+{
+	size_t i = 0;
+	for(; i + 4 <= count; i += 4)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+		__m128i p0 = divideSSE(_mm_cvtepu8_epi32(v));
+		__m128i p1 = divideSSE(_mm_cvtepu8_epi32(_mm_srli_si128(v, 4)));
+		__m128i p2 = divideSSE(_mm_cvtepu8_epi32(_mm_srli_si128(v, 8)));
+		__m128i p3 = divideSSE(_mm_cvtepu8_epi32(_mm_srli_si128(v, 12)));
+		v = _mm_packus_epi16(_mm_packus_epi32(p0, p1), _mm_packus_epi32(p2, p3));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), v);
+	}
+	unpremultiplyScalar(src + i * 4, dst + i * 4, count - i);
+}
+
+TARGET_SSE4_1 static void u8ToF32SSE(const uint8_t* src, uint8_t* dst, size_t count)
+{
+	const __m128 scale = _mm_set1_ps(1.0f / 255);
+	float* d = reinterpret_cast<float*>(dst);
+	size_t i = 0;
+	for(; i + 16 <= count; i += 16)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+		_mm_storeu_ps(d + i +  0, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(v)), scale));
+		_mm_storeu_ps(d + i +  4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(v, 4))), scale));
+		_mm_storeu_ps(d + i +  8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(v, 8))), scale));
+		_mm_storeu_ps(d + i + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(v, 12))), scale));
+	}
+	u8ToF32Scalar(src + i, dst + i * 4, count - i);
+}
+
+TARGET_SSE4_1 static inline __m128i unorm8SSE(const float* src)
+{
+	// max(NaN, 0) is 0 like saturate(), cvtps rounds to nearest even like lrint.
+	__m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src), _mm_setzero_ps()), _mm_set1_ps(1.0f));
+	return _mm_cvtps_epi32(_mm_mul_ps(v, _mm_set1_ps(255.0f)));
+}
+
+TARGET_SSE4_1 static void f32ToU8SSE(const uint8_t* src, uint8_t* dst, size_t count)
+{
+	const float* s = reinterpret_cast<const float*>(src);
+	size_t i = 0;
+	for(; i + 16 <= count; i += 16)
+	{
+		__m128i lo = _mm_packs_epi32(unorm8SSE(s + i), unorm8SSE(s + i + 4));
+		__m128i hi = _mm_packs_epi32(unorm8SSE(s + i + 8), unorm8SSE(s + i + 12));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(lo, hi));
+	}
+	f32ToU8Scalar(src + i * 4, dst + i, count - i);
+}
+
+static const KernelSet SSE4_1_KERNELS =
+{
+	rgbToRgbaSSE,
+	rgbaToRgbSSE,
+	swapRB3SSE,
+	swapRB4SSE,
+	rgb565ToRgbaSSE,
+	premultiplySSE,
+	unpremultiplySSE,
+	u8ToF32SSE,
+	f32ToU8SSE,
+	srgb8ToLinearScalar,  // no gather before AVX2
+};
+
+// Shuffles don't cross 128 bit lanes, 3 byte pixels are loaded into each lane separately.
+
+TARGET_AVX2 static inline __m256i loadRgb8AVX2(const uint8_t* src)
+{
+	__m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+	__m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 12));
+	return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+}
+
+TARGET_AVX2 static inline void storeRgb8AVX2(uint8_t* dst, __m256i v)
+{
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm256_castsi256_si128(v));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 12), _mm256_extracti128_si256(v, 1));
+}
+
+TARGET_AVX2 static void rgbToRgbaAVX2(const uint8_t* src, uint8_t* dst, size_t count)
+{
+	const __m256i shuffle = _mm256_setr_epi8(
+			0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+			0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m256i alpha = _mm256_set1_epi32(0xFF000000);
+	size_t i = 0;
+	for(; i + 10 <= count; i += 8)
+	{
+		__m256i v = _mm256_or_si256(_mm256_shuffle_epi8(loadRgb8AVX2(src + i * 3), shuffle), alpha);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), v);
+	}
+	rgbToRgbaSSE(src + i * 3, dst + i * 4, count - i);
+}
+
+TARGET_AVX2 static void rgbaToRgbAVX2(const uint8_t* src, uint8_t* dst, size_t count)
+{
+	const __m256i shuffle = _mm256_setr_epi8(
+			0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+			0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	size_t i = 0;
+	for(; i + 10 <= count; i += 8)
+	{
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+		storeRgb8AVX2(dst + i * 3, _mm256_shuffle_epi8(v, shuffle));
+	}
+	rgbaToRgbSSE(src + i * 4, dst + i * 3, count - i);
+}
+
+TARGET_AVX2 static void swapRB3AVX2(const uint8_t* src, uint8_t* dst, size_t count)
+{
+	const __m256i shuffle = _mm256_setr_epi8(
+			2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 12, 13, 14, 15,
+			2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 12, 13, 14, 15);
+	size_t i = 0;
+	for(; i + 10 <= count; i += 8)
+		storeRgb8AVX2(dst + i * 3, _mm256_shuffle_epi8(loadRgb8AVX2(src + i * 3), shuffle));
+	swapRB3SSE(src + i * 3, dst + i * 3, count - i);
+}
+
+TARGET_AVX2 static void swapRB4AVX2(const uint8_t* src, uint8_t* dst, size_t count)
+{
+	const __m256i shuffle = _mm256_setr_epi8(
+			2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+			2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+	size_t i = 0;
+	for(; i + 8 <= count; i += 8)
+	{
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), _mm256_shuffle_epi8(v, shuffle));
+	}
+	swapRB4Scalar(src + i * 4, dst + i * 4, count - i);
+}
+
+TARGET_AVX2 static void rgb565ToRgbaAVX2(const uint8_t* src, uint8_t* dst, size_t count)
+{
+	const __m256i mask5 = _mm256_set1_epi16(0x1F);
+	const __m256i mask6 = _mm256_set1_epi16(0x3F);
+	const __m256i alpha = _mm256_set1_epi16(static_cast<int16_t>(0xFF00));
+	size_t i = 0;
+	for(; i + 16 <= count; i += 16)
+	{
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 2));
+		__m256i r = _mm256_and_si256(v, mask5);
+		__m256i g = _mm256_and_si256(_mm256_srli_epi16(v, 5), mask6);
+		__m256i b = _mm256_srli_epi16(v, 11);
+		r = _mm256_or_si256(_mm256_slli_epi16(r, 3), _mm256_srli_epi16(r, 2));
+		g = _mm256_or_si256(_mm256_slli_epi16(g, 2), _mm256_srli_epi16(g, 4));
+		b = _mm256_or_si256(_mm256_slli_epi16(b, 3), _mm256_srli_epi16(b, 2));
+		__m256i rg = _mm256_or_si256(r, _mm256_slli_epi16(g, 8));
+		__m256i ba = _mm256_or_si256(b, alpha);
+		__m256i lo = _mm256_unpacklo_epi16(rg, ba);  // pixel 0~3, 8~11
+		__m256i hi = _mm256_unpackhi_epi16(rg, ba);  // pixel 4~7, 12~15
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), _mm256_permute2x128_si256(lo, hi, 0x20));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4 + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+	}
+	rgb565ToRgbaSSE(src + i * 2, dst + i * 4, count - i);
+}
+
+TARGET_AVX2 static inline __m256i multiplyAVX2(__m256i c, __m256i a)
+{
+	__m256i t = _mm256_add_epi16(_mm256_mullo_epi16(c, a), _mm256_set1_epi16(128));
+	return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+TARGET_AVX2 static void premultiplyAVX2(const uint8_t* src, uint8_t* dst, size_t count)
+{
+	const __m256i shuffle = _mm256_setr_epi8(
+			6, 7, 6, 7, 6, 7, 6, 7, 14, 15, 14, 15, 14, 15, 14, 15,
+			6, 7, 6, 7, 6, 7, 6, 7, 14, 15, 14, 15, 14, 15, 14, 15);
+	const __m256i opaque = _mm256_set1_epi16(255);
+	const __m256i zero = _mm256_setzero_si256();
+	size_t i = 0;
+	for(; i + 8 <= count; i += 8)
+	{
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+		__m256i lo = _mm256_unpacklo_epi8(v, zero);
+		__m256i hi = _mm256_unpackhi_epi8(v, zero);
+		__m256i alo = _mm256_blend_epi16(_mm256_shuffle_epi8(lo, shuffle), opaque, 0x88);
+		__m256i ahi = _mm256_blend_epi16(_mm256_shuffle_epi8(hi, shuffle), opaque, 0x88);
+		v = _mm256_packus_epi16(multiplyAVX2(lo, alo), multiplyAVX2(hi, ahi));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), v);
+	}
+	premultiplySSE(src + i * 4, dst + i * 4, count - i);
+}
+
+// two pixels in 32 bit lanes
+TARGET_AVX2 static inline __m256i divideAVX2(__m256i c)
+{
+	__m256i a = _mm256_shuffle_epi32(c, 0xFF);
+	__m256 af = _mm256_cvtepi32_ps(a);
+	__m256 n = _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(c), _mm256_set1_ps(255.0f)),
+			_mm256_cvtepi32_ps(_mm256_srli_epi32(a, 1)));
+	__m256 q = _mm256_floor_ps(_mm256_div_ps(n, af));
+	q = _mm256_and_ps(q, _mm256_cmp_ps(af, _mm256_setzero_ps(), _CMP_NEQ_UQ));
+	q = _mm256_min_ps(q, _mm256_set1_ps(255.0f));
+	return _mm256_blend_epi32(_mm256_cvttps_epi32(q), c, 0x88);
+}
+
+// packs 8 pixels of 32 bit lanes back to bytes in order.
+TARGET_AVX2 static inline __m256i pack8AVX2(__m256i p0, __m256i p1, __m256i p2, __m256i p3)
+{
+	__m256i v = _mm256_packus_epi16(_mm256_packus_epi32(p0, p1), _mm256_packus_epi32(p2, p3));
+	return _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+}
+
+TARGET_AVX2 static void unpremultiplyAVX2(const uint8_t* src, uint8_t* dst, size_t count)
+{
+	size_t i = 0;
+	for(; i + 8 <= count; i += 8)
+	{
+		const uint8_t* s = src + i * 4;
+		__m256i p0 = divideAVX2(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(s))));
+		__m256i p1 = divideAVX2(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(s + 8))));
+		__m256i p2 = divideAVX2(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(s + 16))));
+		__m256i p3 = divideAVX2(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(s + 24))));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), pack8AVX2(p0, p1, p2, p3));
+	}
+	unpremultiplySSE(src + i * 4, dst + i * 4, count - i);
+}
+
+TARGET_AVX2 static void u8ToF32AVX2(const uint8_t* src, uint8_t* dst, size_t count)
+{
+	const __m256 scale = _mm256_set1_ps(1.0f / 255);
+	float* d = reinterpret_cast<float*>(dst);
+	size_t i = 0;
+	for(; i + 32 <= count; i += 32)
+		for(size_t j = 0; j < 32; j += 8)
+		{
+			__m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i + j)));
+			_mm256_storeu_ps(d + i + j, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+		}
+	u8ToF32SSE(src + i, dst + i * 4, count - i);
+}
+
+TARGET_AVX2 static inline __m256i unorm8AVX2(const float* src)
+{
+	__m256 v = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src), _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+	return _mm256_cvtps_epi32(_mm256_mul_ps(v, _mm256_set1_ps(255.0f)));
+}
+
+TARGET_AVX2 static void f32ToU8AVX2(const uint8_t* src, uint8_t* dst, size_t count)
+{
+	const float* s = reinterpret_cast<const float*>(src);
+	size_t i = 0;
+	for(; i + 32 <= count; i += 32)
+	{
+		__m256i v = pack8AVX2(unorm8AVX2(s + i), unorm8AVX2(s + i + 8), unorm8AVX2(s + i + 16), unorm8AVX2(s + i + 24));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), v);
+	}
+	f32ToU8SSE(src + i * 4, dst + i, count - i);
+}
+
+TARGET_AVX2 static void srgb8ToLinearAVX2(const uint8_t* src, uint8_t* dst, size_t count)
+{
+	const float* table = getTables().srgbToLinear;
+	const __m256i offset = _mm256_setr_epi32(0, 0, 0, 256, 0, 0, 0, 256);  // alpha is linear
+	float* d = reinterpret_cast<float*>(dst);
+	size_t i = 0;
+	for(; i + 2 <= count; i += 2)
+	{
+		__m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i * 4)));
+		index = _mm256_add_epi32(index, offset);
+		_mm256_storeu_ps(d + i * 4, _mm256_i32gather_ps(table, index, 4));
+	}
+	srgb8ToLinearScalar(src + i * 4, dst + i * 16, count - i);
+}
+
+static const KernelSet AVX2_KERNELS =
+{
+	rgbToRgbaAVX2,
+	rgbaToRgbAVX2,
+	swapRB3AVX2,
+	swapRB4AVX2,
+	rgb565ToRgbaAVX2,
+	premultiplyAVX2,
+	unpremultiplyAVX2,
+	u8ToF32AVX2,
+	f32ToU8AVX2,
+	srgb8ToLinearAVX2,
+};
+
+#endif  // PEA_ARCH_X86
+
+static InstructionSet getBestInstructionSet()
+{
+	const CpuFeature& cpu = getCpuFeature();
+	if(cpu.avx2)
+		return InstructionSet::AVX2;
+	if(cpu.sse4_1)
+		return InstructionSet::SSE4_1;
+	return InstructionSet::SCALAR;
+}
+
+static InstructionSet& getCurrentInstructionSet()
+{
+	static InstructionSet instructionSet = getBestInstructionSet();
+	return instructionSet;
+}
+
+static const KernelSet& getKernels()
+{
+	switch(getCurrentInstructionSet())
+	{
+#if PEA_ARCH_X86
+	case InstructionSet::AVX2:   return AVX2_KERNELS;
+	case InstructionSet::SSE4_1: return SSE4_1_KERNELS;
+#endif
+	default:                     return SCALAR_KERNELS;
+	}
+}
+
+static bool isByteFormat(Format format)
+{
+	switch(format)
+	{
+	case Color::C1_U8:
+	case Color::C2_U8:
+	case Color::C3_U8:
+	case Color::C4_U8:
+	case Color::BGR888_U24:
+	case Color::BGRA8888_U32:
+	case Color::RGB565_U16:
+	case Color::RGBA5551_U16:
+	case Color::RGBA4444_U16:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/**
+ * @param[out] scale kernel count per pixel.
+ * @return a kernel doing the conversion in one pass, or nullptr.
+ */
+static Kernel findKernel(const KernelSet& kernels, Format srcFormat, Format dstFormat, uint32_t options, size_t& scale)
+{
+	scale = 1;
+	const bool rgba = srcFormat == Color::C4_U8 || srcFormat == Color::BGRA8888_U32;
+	if(options == PixelConverter::PREMULTIPLY && rgba && srcFormat == dstFormat)
+		return kernels.premultiply;
+	if(options == PixelConverter::UNPREMULTIPLY && rgba && srcFormat == dstFormat)
+		return kernels.unpremultiply;
+	if(options == PixelConverter::SRGB_TO_LINEAR && srcFormat == Color::C4_U8 && dstFormat == Color::C4_F32)
+		return kernels.srgb8ToLinear;
+	if(options != PixelConverter::NONE)
+		return nullptr;
+
+	if((srcFormat == Color::C3_U8 && dstFormat == Color::C4_U8) ||
+			(srcFormat == Color::BGR888_U24 && dstFormat == Color::BGRA8888_U32))
+		return kernels.rgbToRgba;
+	if((srcFormat == Color::C4_U8 && dstFormat == Color::C3_U8) ||
+			(srcFormat == Color::BGRA8888_U32 && dstFormat == Color::BGR888_U24))
+		return kernels.rgbaToRgb;
+	if((srcFormat == Color::C3_U8 && dstFormat == Color::BGR888_U24) ||
+			(srcFormat == Color::BGR888_U24 && dstFormat == Color::C3_U8))
+		return kernels.swapRB3;
+	if((srcFormat == Color::C4_U8 && dstFormat == Color::BGRA8888_U32) ||
+			(srcFormat == Color::BGRA8888_U32 && dstFormat == Color::C4_U8))
+		return kernels.swapRB4;
+	if(srcFormat == Color::RGB565_U16 && dstFormat == Color::C4_U8)
+		return kernels.rgb565ToRgba;
+
+	const Format u8[] = { Color::C1_U8, Color::C2_U8, Color::C3_U8, Color::C4_U8 };
+	const Format f32[] = { Color::C1_F32, Color::C2_F32, Color::C3_F32, Color::C4_F32 };
+	for(size_t i = 0; i < 4; ++i)
+	{
+		scale = i + 1;
+		if(srcFormat == u8[i] && dstFormat == f32[i])
+			return kernels.u8ToF32;
+		if(srcFormat == f32[i] && dstFormat == u8[i])
+			return kernels.f32ToU8;
+	}
+
+	scale = 1;
+	return nullptr;
+}
+
+/**
+ * Decode byte formats to RGBA8888.
+ */
+static void decodeBytes(const KernelSet& kernels, Format format, const uint8_t* src, uint8_t* rgba, size_t count)
+{
+	switch(format)
+	{
+	case Color::C1_U8:
+		for(size_t i = 0; i < count; ++i, rgba += 4)
+		{
+			rgba[0] = rgba[1] = rgba[2] = src[i];
+			rgba[3] = 0xFF;
+		}
+		break;
+
+	case Color::C2_U8:
+		for(size_t i = 0; i < count; ++i, src += 2, rgba += 4)
+		{
+			rgba[0] = rgba[1] = rgba[2] = src[0];
+			rgba[3] = src[1];
+		}
+		break;
+
+	case Color::C3_U8:
+		kernels.rgbToRgba(src, rgba, count);
+		break;
+
+	case Color::C4_U8:
+		std::memcpy(rgba, src, count * 4);
+		break;
+
+	case Color::BGR888_U24:
+		kernels.rgbToRgba(src, rgba, count);
+		kernels.swapRB4(rgba, rgba, count);
+		break;
+
+	case Color::BGRA8888_U32:
+		kernels.swapRB4(src, rgba, count);
+		break;
+
+	case Color::RGB565_U16:
+		kernels.rgb565ToRgba(src, rgba, count);
+		break;
+
+	case Color::RGBA5551_U16:
+		for(size_t i = 0; i < count; ++i, src += 2, rgba += 4)
+		{
+			uint32_t x = src[0] | (src[1] << 8);
+			rgba[0] = expand5(x & 0x1F);
+			rgba[1] = expand5((x >> 5) & 0x1F);
+			rgba[2] = expand5((x >> 10) & 0x1F);
+			rgba[3] = (x & 0x8000) != 0? 0xFF: 0x00;
+		}
+		break;
+
+	case Color::RGBA4444_U16:
+		for(size_t i = 0; i < count; ++i, src += 2, rgba += 4)
+		{
+			rgba[0] = expand4(src[0] & 0x0F);
+			rgba[1] = expand4(src[0] >> 4);
+			rgba[2] = expand4(src[1] & 0x0F);
+			rgba[3] = expand4(src[1] >> 4);
+		}
+		break;
+
+	default:
+		assert(false);
+		break;
+	}
+}
+
+/**
+ * Encode RGBA8888 to byte formats, rgba may be modified.
+ */
+static void encodeBytes(const KernelSet& kernels, Format format, uint8_t* rgba, uint8_t* dst, size_t count)
+{
+	switch(format)
+	{
+	case Color::C1_U8:
+		for(size_t i = 0; i < count; ++i, rgba += 4)
+			dst[i] = static_cast<uint8_t>((rgba[0] + rgba[1] + rgba[2] + 1) / 3);  // as Color::to_G8
+		break;
+
+	case Color::C2_U8:
+		for(size_t i = 0; i < count; ++i, rgba += 4, dst += 2)
+		{
+			dst[0] = static_cast<uint8_t>((rgba[0] + rgba[1] + rgba[2] + 1) / 3);
+			dst[1] = rgba[3];
+		}
+		break;
+
+	case Color::C3_U8:
+		kernels.rgbaToRgb(rgba, dst, count);
+		break;
+
+	case Color::C4_U8:
+		std::memcpy(dst, rgba, count * 4);
+		break;
+
+	case Color::BGR888_U24:
+		kernels.swapRB4(rgba, rgba, count);
+		kernels.rgbaToRgb(rgba, dst, count);
+		break;
+
+	case Color::BGRA8888_U32:
+		kernels.swapRB4(rgba, dst, count);
+		break;
+
+	case Color::RGB565_U16:
+		for(size_t i = 0; i < count; ++i, rgba += 4, dst += 2)
+		{
+			uint32_t x = narrow(rgba[0], 31) | narrow(rgba[1], 63) << 5 | narrow(rgba[2], 31) << 11;
+			dst[0] = static_cast<uint8_t>(x);
+			dst[1] = static_cast<uint8_t>(x >> 8);
+		}
+		break;
+
+	case Color::RGBA5551_U16:
+		for(size_t i = 0; i < count; ++i, rgba += 4, dst += 2)
+		{
+			uint32_t x = narrow(rgba[0], 31) | narrow(rgba[1], 31) << 5 | narrow(rgba[2], 31) << 10 |
+					(rgba[3] & 0x80) << 8;
+			dst[0] = static_cast<uint8_t>(x);
+			dst[1] = static_cast<uint8_t>(x >> 8);
+		}
+		break;
+
+	case Color::RGBA4444_U16:
+		for(size_t i = 0; i < count; ++i, rgba += 4, dst += 2)
+		{
+			dst[0] = static_cast<uint8_t>(narrow(rgba[0], 15) | narrow(rgba[1], 15) << 4);
+			dst[1] = static_cast<uint8_t>(narrow(rgba[2], 15) | narrow(rgba[3], 15) << 4);
+		}
+		break;
+
+	default:
+		assert(false);
+		break;
+	}
+}
+
+struct Half
+{
+	uint16_t bits;
+};
+
+static float halfToFloat(uint16_t h)
+{
+	uint32_t sign = (h & 0x8000) << 16;
+	uint32_t exponent = (h >> 10) & 0x1F;
+	uint32_t mantissa = h & 0x3FF;
+	uint32_t bits;
+	if(exponent == 0)
+	{
+		float f = mantissa * (1.0f / 16777216);  // subnormal, 2^-24
+		std::memcpy(&bits, &f, sizeof(bits));
+		bits |= sign;
+	}
+	else if(exponent == 31)
+		bits = sign | 0x7F800000 | (mantissa << 13);
+	else
+		bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+
+	float f;
+	std::memcpy(&f, &bits, sizeof(f));
+	return f;
+}
+
+static uint16_t floatToHalf(float f)
+{
+	uint32_t x;
+	std::memcpy(&x, &f, sizeof(x));
+	uint16_t sign = static_cast<uint16_t>((x >> 16) & 0x8000);
+	x &= 0x7FFFFFFF;
+	if(x >= 0x7F800000)  // Inf or NaN
+		return sign | 0x7C00 | (x > 0x7F800000? 0x200: 0);
+	if(x >= 0x477FF000)  // rounds to Inf
+		return sign | 0x7C00;
+	if(x < 0x38800000)  // subnormal
+	{
+		float a;
+		std::memcpy(&a, &x, sizeof(a));
+		return sign | roundTo<uint16_t>(a * 16777216.0f);
+	}
+
+	// rebias exponent from 127 to 15, and round to nearest even.
+	x += 0xC8000FFF + ((x >> 13) & 1);
+	return sign | static_cast<uint16_t>(x >> 13);
+}
+
+template<typename T>
+struct Normalized;
+
+template<>
+struct Normalized<uint16_t>
+{
+	static float decode(uint16_t x) { return x * (1.0f / 65535); }
+	static uint16_t encode(float v) { return roundTo<uint16_t>(saturate(v) * 65535.0f); }
+};
+
+template<>
+struct Normalized<int16_t>
+{
+	static float decode(int16_t x) { return std::max(x * (1.0f / 32767), -1.0f); }
+	static int16_t encode(float v) { return roundTo<int16_t>(clampSigned(v) * 32767.0f); }
+};
+
+template<>
+struct Normalized<uint32_t>
+{
+	static float decode(uint32_t x) { return static_cast<float>(x / 4294967295.0); }
+	static uint32_t encode(float v) { return roundTo<uint32_t>(saturate(v) * 4294967295.0); }
+};
+
+template<>
+struct Normalized<int32_t>
+{
+	static float decode(int32_t x) { return std::max(static_cast<float>(x / 2147483647.0), -1.0f); }
+	static int32_t encode(float v) { return roundTo<int32_t>(clampSigned(v) * 2147483647.0); }
+};
+
+template<>
+struct Normalized<Half>
+{
+	static float decode(Half x) { return halfToFloat(x.bits); }
+	static Half encode(float v) { return Half{floatToHalf(v)}; }
+};
+
+template<>
+struct Normalized<float>
+{
+	static float decode(float x) { return x; }
+	static float encode(float v) { return v; }
+};
+
+template<typename T, int N>
+static void decodeChannels(const uint8_t* src, float* rgba, size_t count)
+{
+	for(size_t i = 0; i < count; ++i, src += sizeof(T) * N, rgba += 4)
+	{
+		T x[N];
+		std::memcpy(x, src, sizeof(x));
+		float c[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+		for(int j = 0; j < N; ++j)
+			c[j] = Normalized<T>::decode(x[j]);
+
+		if(N <= 2)  // gray
+		{
+			c[3] = N == 2? c[1]: 1.0f;
+			c[1] = c[2] = c[0];
+		}
+		std::memcpy(rgba, c, sizeof(c));
+	}
+}
+
+template<typename T, int N>
+static void encodeChannels(const float* rgba, uint8_t* dst, size_t count)
+{
+	for(size_t i = 0; i < count; ++i, rgba += 4, dst += sizeof(T) * N)
+	{
+		float c[4] = { rgba[0], rgba[1], rgba[2], rgba[3] };
+		if(N <= 2)
+		{
+			c[0] = (c[0] + c[1] + c[2]) * (1.0f / 3);
+			c[1] = c[3];
+		}
+
+		// channel by channel, a single copy of small stores stalls store forwarding.
+		for(int j = 0; j < N; ++j)
+		{
+			T x = Normalized<T>::encode(c[j]);
+			std::memcpy(dst + j * sizeof(T), &x, sizeof(T));
+		}
+	}
+}
+
+static void decodeRGBA1010102(const uint8_t* src, float* rgba, size_t count)
+{
+	for(size_t i = 0; i < count; ++i, src += 4, rgba += 4)
+	{
+		uint32_t x;
+		std::memcpy(&x, src, sizeof(x));
+		rgba[0] = (x & 0x3FF) * (1.0f / 1023);
+		rgba[1] = ((x >> 10) & 0x3FF) * (1.0f / 1023);
+		rgba[2] = ((x >> 20) & 0x3FF) * (1.0f / 1023);
+		rgba[3] = (x >> 30) * (1.0f / 3);
+	}
+}
+
+static void encodeRGBA1010102(const float* rgba, uint8_t* dst, size_t count)
+{
+	for(size_t i = 0; i < count; ++i, rgba += 4, dst += 4)
+	{
+		uint32_t r = roundTo<uint32_t>(saturate(rgba[0]) * 1023.0f);
+		uint32_t g = roundTo<uint32_t>(saturate(rgba[1]) * 1023.0f);
+		uint32_t b = roundTo<uint32_t>(saturate(rgba[2]) * 1023.0f);
+		uint32_t a = roundTo<uint32_t>(saturate(rgba[3]) * 3.0f);
+		uint32_t x = r | g << 10 | b << 20 | a << 30;
+		std::memcpy(dst, &x, sizeof(x));
+	}
+}
+
+using FloatDecoder = void (*)(const uint8_t* src, float* rgba, size_t count);
+using FloatEncoder = void (*)(const float* rgba, uint8_t* dst, size_t count);
+
+#define CHANNEL_CASES(function, C) \
+	case Color::C##_I16: return function<int16_t, N_##C>;  \
+	case Color::C##_U16: return function<uint16_t, N_##C>; \
+	case Color::C##_F16: return function<Half, N_##C>;     \
+	case Color::C##_I32: return function<int32_t, N_##C>;  \
+	case Color::C##_U32: return function<uint32_t, N_##C>; \
+	case Color::C##_F32: return function<float, N_##C>;
+
+static constexpr int N_C1 = 1, N_C2 = 2, N_C3 = 3, N_C4 = 4;
+
+static FloatDecoder getFloatDecoder(Format format)
+{
+	switch(format)
+	{
+	CHANNEL_CASES(decodeChannels, C1)
+	CHANNEL_CASES(decodeChannels, C2)
+	CHANNEL_CASES(decodeChannels, C3)
+	CHANNEL_CASES(decodeChannels, C4)
+	case Color::RGBA1010102_U32: return decodeRGBA1010102;
+	default: return nullptr;
+	}
+}
+
+static FloatEncoder getFloatEncoder(Format format)
+{
+	switch(format)
+	{
+	CHANNEL_CASES(encodeChannels, C1)
+	CHANNEL_CASES(encodeChannels, C2)
+	CHANNEL_CASES(encodeChannels, C3)
+	CHANNEL_CASES(encodeChannels, C4)
+	case Color::RGBA1010102_U32: return encodeRGBA1010102;
+	default: return nullptr;
+	}
+}
+
+#undef CHANNEL_CASES
+
+static bool isSupported(Format format)
+{
+	return isByteFormat(format) || getFloatDecoder(format) != nullptr;
+}
+
+static void applyOptions(const KernelSet& kernels, uint8_t* rgba, size_t count, uint32_t options)
+{
+	if((options & PixelConverter::UNPREMULTIPLY) != 0)
+		kernels.unpremultiply(rgba, rgba, count);
+
+	const Tables& tables = getTables();
+	for(const uint32_t option: { PixelConverter::SRGB_TO_LINEAR, PixelConverter::LINEAR_TO_SRGB })
+	{
+		if((options & option) == 0)
+			continue;
+		const uint8_t* table = option == PixelConverter::SRGB_TO_LINEAR? tables.srgbToLinear8: tables.linearToSrgb8;
+		for(size_t i = 0; i < count * 4; i += 4)
+		{
+			rgba[i + 0] = table[rgba[i + 0]];
+			rgba[i + 1] = table[rgba[i + 1]];
+			rgba[i + 2] = table[rgba[i + 2]];
+		}
+	}
+
+	if((options & PixelConverter::PREMULTIPLY) != 0)
+		kernels.premultiply(rgba, rgba, count);
+}
+
+static void applyOptions(float* rgba, size_t count, uint32_t options)
+{
+	for(size_t i = 0; i < count * 4; i += 4)
+	{
+		float* c = rgba + i;
+		if((options & PixelConverter::UNPREMULTIPLY) != 0)
+		{
+			float s = c[3] > 0? 1.0f / c[3]: 0.0f;
+			c[0] *= s;
+			c[1] *= s;
+			c[2] *= s;
+		}
+		if((options & PixelConverter::SRGB_TO_LINEAR) != 0)
+			for(int32_t j = 0; j < 3; ++j)
+				c[j] = srgb2linear(c[j]);
+		if((options & PixelConverter::LINEAR_TO_SRGB) != 0)
+			for(int32_t j = 0; j < 3; ++j)
+				c[j] = linear2srgb(c[j]);
+		if((options & PixelConverter::PREMULTIPLY) != 0)
+		{
+			c[0] *= c[3];
+			c[1] *= c[3];
+			c[2] *= c[3];
+		}
+	}
+}
+
+bool PixelConverter::convert(Format srcFormat, const void* src, Format dstFormat, void* dst,
+		size_t count, uint32_t options/* = NONE */)
+{
+	if(!isSupported(srcFormat) || !isSupported(dstFormat))
+	{
+		slog.e(TAG, "unsupported conversion from %#x to %#x", srcFormat, dstFormat);
+		return false;
+	}
+
+	const uint8_t* s = static_cast<const uint8_t*>(src);
+	uint8_t* d = static_cast<uint8_t*>(dst);
+	const size_t srcSize = Color::size(srcFormat);
+	const size_t dstSize = Color::size(dstFormat);
+	if(options == NONE && srcFormat == dstFormat)
+	{
+		if(s != d)
+			std::memmove(d, s, count * srcSize);
+		return true;
+	}
+
+	const KernelSet& kernels = getKernels();
+	size_t scale;
+	if(Kernel kernel = findKernel(kernels, srcFormat, dstFormat, options, scale))
+	{
+		kernel(s, d, count * scale);
+		return true;
+	}
+
+	alignas(32) uint8_t bytes[CHUNK_SIZE * 4];
+	if(isByteFormat(srcFormat) && isByteFormat(dstFormat))
+	{
+		for(size_t i = 0; i < count; i += CHUNK_SIZE)
+		{
+			size_t n = std::min(CHUNK_SIZE, count - i);
+			decodeBytes(kernels, srcFormat, s + i * srcSize, bytes, n);
+			applyOptions(kernels, bytes, n, options);
+			encodeBytes(kernels, dstFormat, bytes, d + i * dstSize, n);
+		}
+		return true;
+	}
+
+	// The sRGB curve of 8 bit channels is looked up rather than computed.
+	const FloatDecoder decode = getFloatDecoder(srcFormat);
+	const FloatEncoder encode = getFloatEncoder(dstFormat);
+	const bool srgbTable = !decode && (options & (SRGB_TO_LINEAR | UNPREMULTIPLY)) == SRGB_TO_LINEAR;
+	const uint32_t floatOptions = srgbTable? options & ~SRGB_TO_LINEAR: options;
+	alignas(32) float floats[CHUNK_SIZE * 4];
+	for(size_t i = 0; i < count; i += CHUNK_SIZE)
+	{
+		size_t n = std::min(CHUNK_SIZE, count - i);
+		if(decode)
+			decode(s + i * srcSize, floats, n);
+		else
+		{
+			decodeBytes(kernels, srcFormat, s + i * srcSize, bytes, n);
+			if(srgbTable)
+				kernels.srgb8ToLinear(bytes, reinterpret_cast<uint8_t*>(floats), n);
+			else
+				kernels.u8ToF32(bytes, reinterpret_cast<uint8_t*>(floats), n * 4);
+		}
+
+		applyOptions(floats, n, floatOptions);
+
+		if(encode)
+			encode(floats, d + i * dstSize, n);
+		else
+		{
+			kernels.f32ToU8(reinterpret_cast<const uint8_t*>(floats), bytes, n * 4);
+			encodeBytes(kernels, dstFormat, bytes, d + i * dstSize, n);
+		}
+	}
+	return true;
+}
+
+bool PixelConverter::blit(Format srcFormat, const void* src, size_t srcStride,
+		Format dstFormat, void* dst, size_t dstStride,
+		uint32_t width, uint32_t height, uint32_t options/* = NONE */)
+{
+	if(!isSupported(srcFormat) || !isSupported(dstFormat))
+	{
+		slog.e(TAG, "unsupported conversion from %#x to %#x", srcFormat, dstFormat);
+		return false;
+	}
+
+	const uint8_t* s = static_cast<const uint8_t*>(src);
+	uint8_t* d = static_cast<uint8_t*>(dst);
+	const int32_t rowCount = static_cast<int32_t>(height);
+	#pragma omp parallel for if(static_cast<size_t>(width) * height >= PARALLEL_PIXEL_COUNT)
+	for(int32_t y = 0; y < rowCount; ++y)
+		convert(srcFormat, s + y * srcStride, dstFormat, d + y * dstStride, width, options);
+	return true;
+}
+
+/**
+ * Repeat a pixel, doubling the filled part until it's a block, then copying the block.
+ */
+static void fillPattern(uint8_t* dst, size_t count, const uint8_t* pixel, size_t size)
+{
+	const size_t length = count * size;
+	if(std::all_of(pixel + 1, pixel + size, [pixel](uint8_t byte) { return byte == pixel[0]; }))
+	{
+		std::memset(dst, pixel[0], length);
+		return;
+	}
+
+	if(count == 0)
+		return;
+
+	std::memcpy(dst, pixel, size);
+	size_t block = size;
+	while(block < FILL_BLOCK_SIZE && block < length)
+	{
+		size_t n = std::min(block, length - block);
+		std::memcpy(dst + block, dst, n);
+		block += n;
+	}
+
+	for(size_t offset = block; offset < length; offset += block)
+		std::memcpy(dst + offset, dst, std::min(block, length - offset));
+}
+
+void PixelConverter::fill(Format format, void* dst, size_t count, uint32_t color)
+{
+	uint8_t pixel[16];
+	if(convert(Color::C4_U8, &color, format, pixel, 1))
+		fillPattern(static_cast<uint8_t*>(dst), count, pixel, Color::size(format));
+}
+
+void PixelConverter::fill(Format format, void* dst, size_t count, const vec4f& color)
+{
+	const float rgba[4] = { color.r, color.g, color.b, color.a };
+	uint8_t pixel[16];
+	if(convert(Color::C4_F32, rgba, format, pixel, 1))
+		fillPattern(static_cast<uint8_t*>(dst), count, pixel, Color::size(format));
+}
+
+void PixelConverter::fill(Format format, void* dst, size_t stride, uint32_t width, uint32_t height,
+		uint32_t color)
+{
+	if(width == 0 || height == 0)
+		return;
+
+	uint8_t* d = static_cast<uint8_t*>(dst);
+	const size_t rowLength = width * Color::size(format);
+	if(stride == rowLength)
+	{
+		fill(format, d, static_cast<size_t>(width) * height, color);
+		return;
+	}
+
+	fill(format, d, width, color);
+	const int32_t rowCount = static_cast<int32_t>(height);
+	#pragma omp parallel for if(static_cast<size_t>(width) * height >= PARALLEL_PIXEL_COUNT)
+	for(int32_t y = 1; y < rowCount; ++y)
+		std::memcpy(d + y * stride, d, rowLength);
+}
+
+InstructionSet PixelConverter::getInstructionSet()
+{
+	return getCurrentInstructionSet();
+}
+
+void PixelConverter::setInstructionSet(InstructionSet instructionSet)
+{
+	getCurrentInstructionSet() = std::min(instructionSet, getBestInstructionSet());
+}
+
+const char* PixelConverter::getName(InstructionSet instructionSet)
+{
+	switch(instructionSet)
+	{
+	case InstructionSet::AVX2:   return "AVX2";
+	case InstructionSet::SSE4_1: return "SSE4.1";
+	default:                     return "scalar";
+	}
+}
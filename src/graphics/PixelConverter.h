@@ -0,0 +1,102 @@
+#ifndef PEA_GRAPHICS_PIXEL_CONVERTER_H_
+#define PEA_GRAPHICS_PIXEL_CONVERTER_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "graphics/Color.h"
+#include "math/vec4.h"
+
+namespace pea {
+
+/**
+ * @class PixelConverter
+ * Convert pixels between any two Color::Format, with optional alpha premultiplication and sRGB
+ * transfer on the way.
+ *
+ * Formats with 8 bits per channel (C*_U8, BGR888, BGRA8888 and the 16 bit packed ones) convert
+ * through RGBA8888, so that 8 bit results are exact. Other formats convert through RGBA float,
+ * integer channels are normalized, signed ones to [-1, 1]. One channel is gray, two channels are
+ * gray and alpha, missing alpha is opaque. Packed 16 bit channels are expanded by replicating
+ * their high bits, so that white stays white.
+ *
+ * Frequent conversions have SSE4.1 and AVX2 kernels. They are picked at runtime according to what
+ * the CPU supports, so the library needn't be compiled for a newer instruction set than the one it
+ * ships for. Kernels give the same bits as their scalar versions.
+ */
+class PixelConverter
+{
+public:
+	enum Option: uint32_t
+	{
+		NONE           = 0,
+		PREMULTIPLY    = 1 << 0,  ///< multiply color by alpha, after the other options.
+		UNPREMULTIPLY  = 1 << 1,  ///< divide color by alpha, before the other options.
+		SRGB_TO_LINEAR = 1 << 2,  ///< decode sRGB color channels.
+		LINEAR_TO_SRGB = 1 << 3,  ///< encode color channels to sRGB.
+	};
+
+	enum class InstructionSet: uint8_t
+	{
+		SCALAR,
+		SSE4_1,
+		AVX2,
+	};
+
+public:
+	/**
+	 * Convert a span of pixels.
+	 * @param[in]  srcFormat source color format.
+	 * @param[in]  src       source pixels.
+	 * @param[in]  dstFormat destination color format.
+	 * @param[out] dst       destination pixels. It can be src when both formats have the same size.
+	 * @param[in]  count     pixel count.
+	 * @param[in]  options   bitwise or of Option.
+	 * @return false if either format is unknown.
+	 */
+	static bool convert(Color::Format srcFormat, const void* src, Color::Format dstFormat, void* dst,
+			size_t count, uint32_t options = NONE);
+
+	/**
+	 * Convert a rectangle of pixels, rows are converted in parallel.
+	 * @param[in] srcStride byte offset between source rows.
+	 * @param[in] dstStride byte offset between destination rows.
+	 * @see convert()
+	 */
+	static bool blit(Color::Format srcFormat, const void* src, size_t srcStride,
+			Color::Format dstFormat, void* dst, size_t dstStride,
+			uint32_t width, uint32_t height, uint32_t options = NONE);
+
+	/**
+	 * Fill a span of pixels with the same color.
+	 * @param[in]  format color format of dst.
+	 * @param[out] dst    pixels to fill.
+	 * @param[in]  count  pixel count.
+	 * @param[in]  color  0xAABBGGRR, or RGBA in [0, 1] for formats with more precision.
+	 */
+	static void fill(Color::Format format, void* dst, size_t count, uint32_t color);
+	static void fill(Color::Format format, void* dst, size_t count, const vec4f& color);
+
+	/**
+	 * Fill a rectangle of pixels with the same color.
+	 * @param[in] stride byte offset between rows.
+	 */
+	static void fill(Color::Format format, void* dst, size_t stride, uint32_t width, uint32_t height,
+			uint32_t color);
+
+	/**
+	 * @return the best instruction set the CPU supports, unless limited by setInstructionSet().
+	 */
+	static InstructionSet getInstructionSet();
+
+	/**
+	 * Limit kernels to an instruction set, to compare them or measure their speed.
+	 * It's clamped to what the CPU supports. Not thread safe with conversions in flight.
+	 */
+	static void setInstructionSet(InstructionSet instructionSet);
+
+	static const char* getName(InstructionSet instructionSet);
+};
+
+}  // namespace pea
+#endif  // PEA_GRAPHICS_PIXEL_CONVERTER_H_
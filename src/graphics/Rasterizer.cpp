@@ -0,0 +1,578 @@
+#include "graphics/Rasterizer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#include "pea/config.h"
+#if OpenMP_CXX_FOUND
+#include <omp.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define RASTERIZER_SSE2 1
+#endif
+
+#include "graphics/Image.h"
+#include "util/Log.h"
+
+static const char* TAG = "Rasterizer";
+
+using namespace pea;
+
+static constexpr int32_t SUBPIXEL_SHIFT = 8;
+static constexpr int32_t SUBPIXEL_SCALE = 1 << SUBPIXEL_SHIFT;  // 256
+static constexpr int32_t SUBPIXEL_MASK  = SUBPIXEL_SCALE - 1;
+
+Rasterizer::Rasterizer():
+		clip(0, 0, 0, 0),
+		rowBegin(0),
+		rowEnd(0),
+		cell{0, 0, 0},
+		cellY(0),
+		start(0, 0),
+		last(0, 0)
+{
+}
+
+void Rasterizer::reset(const Rect<int32_t>& clip)
+{
+	for(int32_t y = rowBegin; y < rowEnd; ++y)
+		rows[y].clear();
+	rowBegin = rowEnd = 0;
+	cell = {0, 0, 0};
+	cellY = clip.top;
+
+	this->clip = clip;
+	if(clip.isEmpty())
+		this->clip = Rect<int32_t>(0, 0, 0, 0);
+	if(rows.size() < static_cast<size_t>(this->clip.getHeight()))
+		rows.resize(this->clip.getHeight());
+	start = last = vec2f(0, 0);
+}
+
+void Rasterizer::flushCell()
+{
+	if(cell.cover == 0 && cell.area == 0)
+		return;
+
+	const int32_t row = cellY - clip.top;
+	assert(0 <= row && row < clip.getHeight());
+	if(row < 0 || row >= clip.getHeight())
+		return;
+
+	if(rowBegin >= rowEnd)
+	{
+		rowBegin = row;
+		rowEnd = row + 1;
+	}
+	else
+	{
+		rowBegin = std::min(rowBegin, row);
+		rowEnd = std::max(rowEnd, row + 1);
+	}
+	rows[row].push_back(cell);
+}
+
+inline void Rasterizer::setCell(int32_t x, int32_t y)
+{
+	if(cell.x == x && cellY == y)
+		return;
+
+	flushCell();
+	cell = {x, 0, 0};
+	cellY = y;
+}
+
+/**
+ * Edge within scanline ey, from (x1, y1) to (x2, y2), where y is subpixel offset in the scanline.
+ */
+void Rasterizer::renderScanline(int32_t ey, int32_t x1, int32_t y1, int32_t x2, int32_t y2)
+{
+	int32_t ex1 = x1 >> SUBPIXEL_SHIFT;
+	int32_t ex2 = x2 >> SUBPIXEL_SHIFT;
+	int32_t fx1 = x1 & SUBPIXEL_MASK;
+	int32_t fx2 = x2 & SUBPIXEL_MASK;
+
+	if(y1 == y2)  // horizontal edges don't cover anything
+		return;
+
+	if(ex1 == ex2)  // within one cell
+	{
+		setCell(ex1, ey);
+		cell.cover += y2 - y1;
+		cell.area += (fx1 + fx2) * (y2 - y1);
+		return;
+	}
+
+	// across cells, y is distributed in proportion to x.
+	int64_t p = static_cast<int64_t>(SUBPIXEL_SCALE - fx1) * (y2 - y1);
+	int32_t first = SUBPIXEL_SCALE;
+	int32_t increment = 1;
+	int64_t dx = static_cast<int64_t>(x2) - x1;
+	if(dx < 0)
+	{
+		p = static_cast<int64_t>(fx1) * (y2 - y1);
+		first = 0;
+		increment = -1;
+		dx = -dx;
+	}
+
+	int64_t delta = p / dx;
+	int64_t mod = p % dx;
+	if(mod < 0)
+	{
+		--delta;
+		mod += dx;
+	}
+
+	setCell(ex1, ey);
+	cell.cover += static_cast<int32_t>(delta);
+	cell.area += static_cast<int32_t>((fx1 + first) * delta);
+
+	ex1 += increment;
+	y1 += static_cast<int32_t>(delta);
+	if(ex1 != ex2)
+	{
+		p = static_cast<int64_t>(SUBPIXEL_SCALE) * (y2 - y1 + delta);
+		int64_t lift = p / dx;
+		int64_t rem = p % dx;
+		if(rem < 0)
+		{
+			--lift;
+			rem += dx;
+		}
+		mod -= dx;
+
+		while(ex1 != ex2)
+		{
+			delta = lift;
+			mod += rem;
+			if(mod >= 0)
+			{
+				mod -= dx;
+				++delta;
+			}
+
+			setCell(ex1, ey);
+			cell.cover += static_cast<int32_t>(delta);
+			cell.area += static_cast<int32_t>(SUBPIXEL_SCALE * delta);
+			y1 += static_cast<int32_t>(delta);
+			ex1 += increment;
+		}
+	}
+
+	delta = y2 - y1;
+	setCell(ex2, ey);
+	cell.cover += static_cast<int32_t>(delta);
+	cell.area += static_cast<int32_t>((fx2 + SUBPIXEL_SCALE - first) * delta);
+}
+
+/**
+ * Edge in 24.8 fixed point, within clip.
+ */
+void Rasterizer::renderLine(int32_t x1, int32_t y1, int32_t x2, int32_t y2)
+{
+	int32_t ey1 = y1 >> SUBPIXEL_SHIFT;
+	int32_t ey2 = y2 >> SUBPIXEL_SHIFT;
+	int32_t fy1 = y1 & SUBPIXEL_MASK;
+	int32_t fy2 = y2 & SUBPIXEL_MASK;
+
+	if(ey1 == ey2)
+	{
+		renderScanline(ey1, x1, fy1, x2, fy2);
+		return;
+	}
+
+	int64_t dx = static_cast<int64_t>(x2) - x1;
+	int64_t dy = static_cast<int64_t>(y2) - y1;
+	int32_t first = SUBPIXEL_SCALE;
+	int32_t increment = 1;
+
+	if(dx == 0)  // vertical edge, a cell per scanline
+	{
+		int32_t ex = x1 >> SUBPIXEL_SHIFT;
+		int32_t twoFx = (x1 - (ex << SUBPIXEL_SHIFT)) << 1;
+		if(dy < 0)
+		{
+			first = 0;
+			increment = -1;
+		}
+
+		int32_t delta = first - fy1;
+		setCell(ex, ey1);
+		cell.cover += delta;
+		cell.area += twoFx * delta;
+
+		ey1 += increment;
+		delta = first + first - SUBPIXEL_SCALE;
+		while(ey1 != ey2)
+		{
+			setCell(ex, ey1);
+			cell.cover += delta;
+			cell.area += twoFx * delta;
+			ey1 += increment;
+		}
+
+		delta = fy2 - SUBPIXEL_SCALE + first;
+		setCell(ex, ey1);
+		cell.cover += delta;
+		cell.area += twoFx * delta;
+		return;
+	}
+
+	// x is distributed in proportion to y across scanlines.
+	int64_t p = (SUBPIXEL_SCALE - fy1) * dx;
+	if(dy < 0)
+	{
+		p = fy1 * dx;
+		first = 0;
+		increment = -1;
+		dy = -dy;
+	}
+
+	int64_t delta = p / dy;
+	int64_t mod = p % dy;
+	if(mod < 0)
+	{
+		--delta;
+		mod += dy;
+	}
+
+	int32_t from = x1 + static_cast<int32_t>(delta);
+	renderScanline(ey1, x1, fy1, from, first);
+
+	ey1 += increment;
+	if(ey1 != ey2)
+	{
+		p = SUBPIXEL_SCALE * dx;
+		int64_t lift = p / dy;
+		int64_t rem = p % dy;
+		if(rem < 0)
+		{
+			--lift;
+			rem += dy;
+		}
+		mod -= dy;
+
+		while(ey1 != ey2)
+		{
+			delta = lift;
+			mod += rem;
+			if(mod >= 0)
+			{
+				mod -= dy;
+				++delta;
+			}
+
+			int32_t to = from + static_cast<int32_t>(delta);
+			renderScanline(ey1, from, SUBPIXEL_SCALE - first, to, first);
+			from = to;
+			ey1 += increment;
+		}
+	}
+
+	renderScanline(ey1, from, SUBPIXEL_SCALE - first, x2, fy2);
+}
+
+static inline int32_t toFixed(float value)
+{
+	return static_cast<int32_t>(std::lround(value * SUBPIXEL_SCALE));
+}
+
+/**
+ * Clip an edge to the clip rectangle. Parts above or below it cover nothing. Parts on its right
+ * cover only pixels further right. Parts on its left cover whole rows of it from its left side on,
+ * which a vertical edge along that side does equally.
+ */
+void Rasterizer::addLine(vec2f p0, vec2f p1)
+{
+	if(!std::isfinite(p0.x) || !std::isfinite(p0.y) || !std::isfinite(p1.x) || !std::isfinite(p1.y))
+		return;
+
+	const float top = static_cast<float>(clip.top), bottom = static_cast<float>(clip.bottom);
+	const float left = static_cast<float>(clip.left), right = static_cast<float>(clip.right);
+	if(p0.y == p1.y || (p0.y <= top && p1.y <= top) || (p0.y >= bottom && p1.y >= bottom))
+		return;
+
+	auto atY = [](const vec2f& a, const vec2f& b, float y)
+	{
+		return vec2f(a.x + (b.x - a.x) * (y - a.y) / (b.y - a.y), y);
+	};
+	const vec2f q0 = p0, q1 = p1;
+	if(p0.y < top)
+		p0 = atY(q0, q1, top);
+	else if(p0.y > bottom)
+		p0 = atY(q0, q1, bottom);
+	if(p1.y < top)
+		p1 = atY(q0, q1, top);
+	else if(p1.y > bottom)
+		p1 = atY(q0, q1, bottom);
+
+	if(p0.x >= right && p1.x >= right)
+		return;
+
+	// split where the edge crosses left and right sides.
+	float ts[4] = {0, 1, 1, 1};
+	int32_t count = 1;
+	if(p0.x != p1.x)
+		for(float x: {left, right})
+		{
+			float t = (x - p0.x) / (p1.x - p0.x);
+			if(0 < t && t < 1)
+				ts[count++] = t;
+		}
+	if(count == 3 && ts[1] > ts[2])
+		std::swap(ts[1], ts[2]);
+	ts[count] = 1;
+
+	for(int32_t i = 0; i < count; ++i)
+	{
+		vec2f a = p0 + (p1 - p0) * ts[i];
+		vec2f b = p0 + (p1 - p0) * ts[i + 1];
+		if(i == 0)
+			a = p0;
+		if(i + 1 == count)
+			b = p1;
+
+		const float middle = (a.x + b.x) * 0.5F;
+		if(middle >= right)
+			continue;
+		if(middle <= left)
+			a.x = b.x = left;
+		else
+		{
+			a.x = std::clamp(a.x, left, right);
+			b.x = std::clamp(b.x, left, right);
+		}
+		renderLine(toFixed(a.x), toFixed(a.y), toFixed(b.x), toFixed(b.y));
+	}
+}
+
+void Rasterizer::moveTo(const vec2f& point)
+{
+	close();
+	start = last = point;
+}
+
+void Rasterizer::lineTo(const vec2f& point)
+{
+	addLine(last, point);
+	last = point;
+}
+
+void Rasterizer::close()
+{
+	if(last != start)
+		addLine(last, start);
+	last = start;
+}
+
+void Rasterizer::addPolygon(const vec2f* points, size_t count)
+{
+	if(count < 3)
+		return;
+
+	moveTo(points[0]);
+	for(size_t i = 1; i < count; ++i)
+		lineTo(points[i]);
+	close();
+}
+
+namespace {
+
+/**
+ * Blend factors per coverage, d = min((d * mul + add) >> 8, 255) for each channel.
+ */
+struct Blender
+{
+	uint32_t channel;
+	uint16_t mul[256][4];
+	uint16_t add[256][4];
+
+	bool setup(Color::Format format, const vec4f& color, Paint::BlendMode mode)
+	{
+		const float a = std::clamp(color.a, 0.0F, 1.0F);
+		const float r = std::clamp(color.r, 0.0F, 1.0F) * a * 255;
+		const float g = std::clamp(color.g, 0.0F, 1.0F) * a * 255;
+		const float b = std::clamp(color.b, 0.0F, 1.0F) * a * 255;
+		const float luma = 0.2126F * r + 0.7152F * g + 0.0722F * b;
+		const float alpha = a * 255;
+
+		float source[4];
+		switch(format)
+		{
+		case Color::C1_U8:        channel = 1; source[0] = luma; break;
+		case Color::C2_U8:        channel = 2; source[0] = luma; source[1] = alpha; break;
+		case Color::C3_U8:        channel = 3; source[0] = r; source[1] = g; source[2] = b; break;
+		case Color::C4_U8:        channel = 4; source[0] = r; source[1] = g; source[2] = b; source[3] = alpha; break;
+		case Color::BGR888_U24:   channel = 3; source[0] = b; source[1] = g; source[2] = r; break;
+		case Color::BGRA8888_U32: channel = 4; source[0] = b; source[1] = g; source[2] = r; source[3] = alpha; break;
+		default:
+			return false;
+		}
+
+		for(int32_t coverage = 0; coverage < 256; ++coverage)
+		{
+			const float k = coverage / 255.0F;
+			for(uint32_t i = 0; i < channel; ++i)
+			{
+				const float s = source[i] * k;
+				float m = 1, n = 0;
+				switch(mode)
+				{
+				case Paint::BlendMode::SRC_OVER: m = 1 - a * k; n = s; break;
+				case Paint::BlendMode::SRC:      m = 1 - k;     n = s; break;
+				case Paint::BlendMode::CLEAR:    m = 1 - k;     n = 0; break;
+				case Paint::BlendMode::PLUS:     m = 1;         n = s; break;
+				case Paint::BlendMode::MODULATE: m = 1 - k + s / 255; n = 0; break;
+				}
+				mul[coverage][i] = static_cast<uint16_t>(std::lround(m * 256));
+				add[coverage][i] = static_cast<uint16_t>(std::lround(n * 256) + 128);  // rounding
+			}
+		}
+		return true;
+	}
+
+	void blendPixel(uint8_t* pixel, uint32_t coverage) const
+	{
+		for(uint32_t i = 0; i < channel; ++i)
+			pixel[i] = static_cast<uint8_t>(std::min<uint32_t>(pixel[i] * mul[coverage][i] + add[coverage][i], 0xFFFF) >> 8);
+	}
+
+	void blendSpan(uint8_t* pixels, size_t count, uint32_t coverage) const
+	{
+		const size_t size = count * channel;
+		size_t i = 0;
+#if RASTERIZER_SSE2
+		// 48 bytes hold whole pixels of 1, 2, 3 or 4 channels.
+		constexpr size_t BLOCK = 48;
+		if(size >= BLOCK)
+		{
+			alignas(16) uint16_t m[BLOCK], n[BLOCK];
+			for(size_t j = 0; j < BLOCK; ++j)
+			{
+				m[j] = mul[coverage][j % channel];
+				n[j] = add[coverage][j % channel];
+			}
+
+			__m128i vm[6], vn[6];
+			for(int32_t k = 0; k < 6; ++k)
+			{
+				vm[k] = _mm_load_si128(reinterpret_cast<const __m128i*>(m + 8 * k));
+				vn[k] = _mm_load_si128(reinterpret_cast<const __m128i*>(n + 8 * k));
+			}
+
+			const __m128i zero = _mm_setzero_si128();
+			for(; i + BLOCK <= size; i += BLOCK)
+				for(int32_t k = 0; k < 3; ++k)
+				{
+					__m128i* p = reinterpret_cast<__m128i*>(pixels + i + 16 * k);
+					__m128i v = _mm_loadu_si128(p);
+					__m128i lo = _mm_unpacklo_epi8(v, zero);
+					__m128i hi = _mm_unpackhi_epi8(v, zero);
+					lo = _mm_srli_epi16(_mm_adds_epu16(_mm_mullo_epi16(lo, vm[2 * k]), vn[2 * k]), 8);
+					hi = _mm_srli_epi16(_mm_adds_epu16(_mm_mullo_epi16(hi, vm[2 * k + 1]), vn[2 * k + 1]), 8);
+					_mm_storeu_si128(p, _mm_packus_epi16(lo, hi));
+				}
+		}
+#endif
+		for(; i < size; i += channel)
+			blendPixel(pixels + i, coverage);
+	}
+};
+
+inline uint32_t getCoverage(int32_t area, Rasterizer::FillRule rule, bool antiAlias)
+{
+	int32_t coverage = area >> (SUBPIXEL_SHIFT + 1);  // area of 2 * 256 * 256 is 256
+	if(coverage < 0)
+		coverage = -coverage;
+	if(rule == Rasterizer::FillRule::EVEN_ODD)
+	{
+		coverage &= 2 * SUBPIXEL_SCALE - 1;
+		if(coverage > SUBPIXEL_SCALE)
+			coverage = 2 * SUBPIXEL_SCALE - coverage;
+	}
+	if(coverage > 255)
+		coverage = 255;
+	if(!antiAlias)
+		coverage = coverage >= 128? 255: 0;
+	return static_cast<uint32_t>(coverage);
+}
+
+struct CellLess
+{
+	template <typename Cell>
+	bool operator ()(const Cell& lhs, const Cell& rhs) const { return lhs.x < rhs.x; }
+};
+
+}  // namespace
+
+bool Rasterizer::render(Image& image, const vec4f& color, Paint::BlendMode mode, FillRule rule, bool antiAlias)
+{
+	close();
+	flushCell();
+	cell = {0, 0, 0};
+
+	Blender blender;
+	if(!blender.setup(image.getColorFormat(), color, mode))
+	{
+		slog.w(TAG, "can't render to color format 0x%X", image.getColorFormat());
+		reset(clip);
+		return false;
+	}
+
+	const int32_t width = image.getWidth(), height = image.getHeight();
+	const size_t stride = static_cast<size_t>(width) * blender.channel;
+	uint8_t* data = image.getData();
+	const bool bottomUp = image.isBottomUp();
+	const int32_t left = std::max(clip.left, 0), right = std::min(clip.right, width);
+	const int32_t begin = std::max(rowBegin, -clip.top), end = std::min(rowEnd, height - clip.top);
+
+#pragma omp parallel for schedule(dynamic, 8)
+	for(int32_t row = begin; row < end; ++row)
+	{
+		std::vector<Cell>& cells = rows[row];
+		std::sort(cells.begin(), cells.end(), CellLess());
+
+		const int32_t y = clip.top + row;
+		uint8_t* line = data + stride * (bottomUp? height - 1 - y: y);
+		int32_t cover = 0;
+		for(size_t i = 0, size = cells.size(); i < size;)
+		{
+			const int32_t x = cells[i].x;
+			int32_t area = 0;
+			for(; i < size && cells[i].x == x; ++i)
+			{
+				area += cells[i].area;
+				cover += cells[i].cover;
+			}
+			if(x >= right)
+				break;
+
+			int32_t next = x;  // first pixel of the span after this cell
+			if(area != 0)
+			{
+				uint32_t coverage = getCoverage((cover << (SUBPIXEL_SHIFT + 1)) - area, rule, antiAlias);
+				if(coverage != 0 && x >= left)
+					blender.blendPixel(line + static_cast<size_t>(x) * blender.channel, coverage);
+				++next;
+			}
+
+			// span of uniform coverage up to the next cell, or the right side.
+			const int32_t spanEnd = std::min(i < size? cells[i].x: right, right);
+			next = std::max(next, left);
+			if(next < spanEnd && cover != 0)
+			{
+				uint32_t coverage = getCoverage(cover << (SUBPIXEL_SHIFT + 1), rule, antiAlias);
+				if(coverage != 0)
+					blender.blendSpan(line + static_cast<size_t>(next) * blender.channel, spanEnd - next, coverage);
+			}
+		}
+	}
+
+	reset(clip);
+	return true;
+}
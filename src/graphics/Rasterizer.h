@@ -0,0 +1,102 @@
+#ifndef PEA_GRAPHICS_RASTERIZER_H_
+#define PEA_GRAPHICS_RASTERIZER_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "graphics/Paint.h"
+#include "graphics/Rect.h"
+#include "math/vec2.h"
+#include "math/vec4.h"
+
+namespace pea {
+
+class Image;
+
+/**
+ * @class Rasterizer
+ * Scanline rasterizer of polygons with exact area coverage anti-aliasing, after FreeType's gray
+ * raster and AGG. Edges are walked in 24.8 fixed point and leave sparse cells of (x, cover, area)
+ * on the rows they cross, so that memory and time grow with the outline length instead of the
+ * area. Rows are swept into spans of partial and full coverage, and spans are blended into an 8
+ * bit image, 48 bytes at a time with SSE2. Bands of rows are swept and blended in parallel.
+ *
+ * @code
+ *   rasterizer.reset(clip);
+ *   rasterizer.moveTo(p0); rasterizer.lineTo(p1); rasterizer.lineTo(p2); rasterizer.close();
+ *   rasterizer.render(image, color, Paint::BlendMode::SRC_OVER, Rasterizer::FillRule::NON_ZERO, true);
+ * @endcode
+ */
+class Rasterizer
+{
+public:
+	enum class FillRule: uint8_t
+	{
+		NON_ZERO,
+		EVEN_ODD,
+	};
+
+private:
+	struct Cell
+	{
+		int32_t x;
+		int32_t cover;  ///< height of edges crossing the cell, 256 for one pixel
+		int32_t area;   ///< twice the area left of edges, 2 * 256 * 256 for one pixel
+	};
+
+	Rect<int32_t> clip;
+	std::vector<std::vector<Cell>> rows;  ///< cells of rows in clip, from clip.top on
+	int32_t rowBegin, rowEnd;  ///< rows with cells
+
+	Cell cell;  ///< cell being accumulated
+	int32_t cellY;
+
+	vec2f start;  ///< first point of contour
+	vec2f last;
+
+private:
+	void setCell(int32_t x, int32_t y);
+	void flushCell();
+	void renderScanline(int32_t ey, int32_t x1, int32_t y1, int32_t x2, int32_t y2);
+	void renderLine(int32_t x1, int32_t y1, int32_t x2, int32_t y2);
+	void addLine(vec2f p0, vec2f p1);
+
+public:
+	Rasterizer();
+
+	/**
+	 * Drop all edges, and limit later ones to clip.
+	 * @param[in] clip device pixels that can be drawn, right and bottom excluded.
+	 */
+	void reset(const Rect<int32_t>& clip);
+
+	/**
+	 * Start a contour, the current one gets closed. Points are in device pixels, x goes right and
+	 * y goes down, pixel (x, y) covers [x, x + 1) x [y, y + 1).
+	 */
+	void moveTo(const vec2f& point);
+	void lineTo(const vec2f& point);
+	void close();
+
+	/**
+	 * Add a closed polygon.
+	 */
+	void addPolygon(const vec2f* points, size_t count);
+
+	bool isEmpty() const;
+
+	/**
+	 * Close the contour, blend color into pixels by their coverage, and drop all edges.
+	 * @param[in] image     of C1_U8 (gray), C2_U8, C3_U8, C4_U8, BGR888_U24 or BGRA8888_U32 format.
+	 *                      Gray is the luma of color. Pixels with alpha are taken as premultiplied.
+	 * @param[in] color     straight RGBA within [0, 1].
+	 * @param[in] antiAlias false to take coverage of half or more as full, and less as none.
+	 * @return false if image format isn't supported.
+	 */
+	bool render(Image& image, const vec4f& color, Paint::BlendMode mode, FillRule rule, bool antiAlias);
+};
+
+inline bool Rasterizer::isEmpty() const { return rowBegin >= rowEnd && cell.cover == 0 && cell.area == 0; }
+
+}  // namespace pea
+#endif  // PEA_GRAPHICS_RASTERIZER_H_
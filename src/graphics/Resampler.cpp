@@ -0,0 +1,362 @@
+#include "graphics/Resampler.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+#include "pea/config.h"
+#if OpenMP_CXX_FOUND
+#include <omp.h>
+#endif
+
+#include "graphics/PixelConverter.h"
+#include "math/scalar.h"
+#include "util/cpu.h"
+#include "util/Log.h"
+
+
+static const char* TAG = "Resampler";
+
+using namespace pea;
+
+using Filter = Resampler::Filter;
+
+static constexpr double KAISER_ALPHA = 4.0;
+
+static double sinc(double x)
+{
+	if(std::abs(x) < 1E-9)
+		return 1.0;
+	x *= scalar<double>::PI;
+	return std::sin(x) / x;
+}
+
+// modified Bessel function of the first kind, order 0
+static double bessel0(double x)
+{
+	double sum = 1.0, term = 1.0;
+	const double y = x * x / 4;
+	for(int32_t k = 1; k < 64 && term > sum * 1E-12; ++k)
+	{
+		term *= y / (k * k);
+		sum += term;
+	}
+	return sum;
+}
+
+/**
+ * @param[in] x distance in pixels of the filter scale.
+ */
+static double evaluate(Filter filter, double x)
+{
+	const double t = std::abs(x);
+	switch(filter)
+	{
+	case Filter::BOX:
+		return -0.5 <= x && x < 0.5? 1.0: 0.0;  // half open, so that a pixel isn't counted twice.
+	case Filter::BILINEAR:
+		return t < 1.0? 1.0 - t: 0.0;
+	case Filter::BICUBIC:
+	{
+		constexpr double a = -0.5;
+		if(t < 1.0)
+			return ((a + 2) * t - (a + 3)) * t * t + 1;
+		if(t < 2.0)
+			return ((a * t - 5 * a) * t + 8 * a) * t - 4 * a;
+		return 0.0;
+	}
+	case Filter::LANCZOS3:
+		return t < 3.0? sinc(x) * sinc(x / 3): 0.0;
+	case Filter::KAISER:
+	{
+		if(t >= 3.0)
+			return 0.0;
+		const double u = x / 3;
+		return sinc(x) * bessel0(KAISER_ALPHA * std::sqrt(1 - u * u)) / bessel0(KAISER_ALPHA);
+	}
+	default:
+		assert(false);
+		return 0.0;
+	}
+}
+
+/**
+ * Weights of source pixels for each destination pixel. Source pixels out of range are folded onto
+ * the edge, so destination pixel i takes count[i] weights from source pixel first[i] on.
+ */
+struct WeightTable
+{
+	int32_t tapCount;
+	std::vector<int32_t> first;
+	std::vector<int32_t> count;
+	std::vector<float> weights;
+
+	WeightTable(Filter filter, uint32_t srcSize, uint32_t dstSize)
+	{
+		const double scale = static_cast<double>(srcSize) / dstSize;
+		const double filterScale = std::max(scale, 1.0);  // filter widens when shrinking only
+		const double radius = Resampler::getRadius(filter) * filterScale;
+		tapCount = static_cast<int32_t>(std::ceil(radius * 2)) + 1;
+		first.resize(dstSize);
+		count.resize(dstSize);
+		weights.assign(static_cast<size_t>(dstSize) * tapCount, 0.0f);
+
+		const int32_t last = static_cast<int32_t>(srcSize) - 1;
+		std::vector<double> w(tapCount);
+		for(uint32_t i = 0; i < dstSize; ++i)
+		{
+			const double center = (i + 0.5) * scale;
+			const int32_t start = static_cast<int32_t>(std::floor(center - radius));
+			const int32_t begin = std::min(std::max(start, 0), last);
+			const int32_t end = std::min(std::max(start + tapCount - 1, 0), last);
+			std::fill(w.begin(), w.end(), 0.0);
+			double sum = 0.0;
+			for(int32_t k = 0; k < tapCount; ++k)
+			{
+				double weight = evaluate(filter, (start + k + 0.5 - center) / filterScale);
+				w[std::min(std::max(start + k, 0), last) - begin] += weight;
+				sum += weight;
+			}
+
+			if(sum == 0.0)  // too narrow to reach any pixel center, take the nearest one.
+			{
+				w[std::min(std::max(static_cast<int32_t>(center), begin), end) - begin] = 1.0;
+				sum = 1.0;
+			}
+
+			first[i] = begin;
+			count[i] = end - begin + 1;
+			float* row = weights.data() + static_cast<size_t>(i) * tapCount;
+			for(int32_t k = 0; k < count[i]; ++k)
+				row[k] = static_cast<float>(w[k] / sum);
+		}
+	}
+
+	const float* getWeights(uint32_t i) const { return weights.data() + static_cast<size_t>(i) * tapCount; }
+};
+
+template<uint32_t N>
+static void filterRow(const float* src, float* dst, const WeightTable& table, uint32_t dstWidth)
+{
+	for(uint32_t x = 0; x < dstWidth; ++x, dst += N)
+	{
+		const float* w = table.getWeights(x);
+		const float* s = src + static_cast<size_t>(table.first[x]) * N;
+		float sum[N] = {};
+		for(int32_t k = 0; k < table.count[x]; ++k, s += N)
+			for(uint32_t c = 0; c < N; ++c)
+				sum[c] += w[k] * s[c];
+		for(uint32_t c = 0; c < N; ++c)
+			dst[c] = sum[c];
+	}
+}
+
+#if defined(__SSE2__) || defined(_M_X64)
+// RGBA pixel is exactly one register, two sums hide latency of addition.
+template<>
+void filterRow<4>(const float* src, float* dst, const WeightTable& table, uint32_t dstWidth)
+{
+	for(uint32_t x = 0; x < dstWidth; ++x, dst += 4)
+	{
+		const float* w = table.getWeights(x);
+		const float* s = src + static_cast<size_t>(table.first[x]) * 4;
+		const int32_t count = table.count[x];
+		__m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps();
+		int32_t k = 0;
+		for(; k + 1 < count; k += 2, s += 8)
+		{
+			sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_set1_ps(w[k]), _mm_loadu_ps(s)));
+			sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_set1_ps(w[k + 1]), _mm_loadu_ps(s + 4)));
+		}
+		if(k < count)
+			sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_set1_ps(w[k]), _mm_loadu_ps(s)));
+		_mm_storeu_ps(dst, _mm_add_ps(sum0, sum1));
+	}
+}
+#endif
+
+static void filterRow(const float* src, float* dst, const WeightTable& table, uint32_t dstWidth, uint32_t channelCount)
+{
+	switch(channelCount)
+	{
+	case 1: filterRow<1>(src, dst, table, dstWidth); break;
+	case 2: filterRow<2>(src, dst, table, dstWidth); break;
+	case 3: filterRow<3>(src, dst, table, dstWidth); break;
+	case 4: filterRow<4>(src, dst, table, dstWidth); break;
+	default: assert(false); break;
+	}
+}
+
+// same loop, vectorized by the compiler for each instruction set.
+static void accumulate(float* dst, const float* src, float weight, size_t count)
+{
+	for(size_t i = 0; i < count; ++i)
+		dst[i] += weight * src[i];
+}
+
+TARGET_AVX2
+static void accumulate_AVX2(float* dst, const float* src, float weight, size_t count)
+{
+	for(size_t i = 0; i < count; ++i)
+		dst[i] += weight * src[i];
+}
+
+/**
+ * Destination rows are split into one block per thread. A block filters the source rows it needs
+ * horizontally into a ring buffer, just before the vertical pass reads them, so that they are
+ * still in cache, and no intermediate image is allocated.
+ *
+ * @param[in] load  const float* (uint32_t y, float* buffer), a source row as float, it may be
+ *                  converted into buffer of srcWidth pixels.
+ * @param[in] store void (uint32_t y, const float* row), a filtered destination row.
+ */
+template<typename Load, typename Store>
+static void resample(uint32_t srcWidth, uint32_t srcHeight, uint32_t dstWidth, uint32_t dstHeight,
+		uint32_t channelCount, Filter filter, Load&& load, Store&& store)
+{
+	const WeightTable horizontal(filter, srcWidth, dstWidth);
+	const WeightTable vertical(filter, srcHeight, dstHeight);
+	const size_t rowLength = static_cast<size_t>(dstWidth) * channelCount;
+	const int32_t ringSize = vertical.tapCount;  // first row is non-decreasing, the window slides.
+	auto add = getCpuFeature().avx2? accumulate_AVX2: accumulate;
+
+#if OpenMP_CXX_FOUND
+	const int32_t blockCount = std::max(std::min(omp_get_max_threads(), static_cast<int32_t>(dstHeight)), 1);
+#else
+	const int32_t blockCount = 1;
+#endif
+	#pragma omp parallel for schedule(static, 1)
+	for(int32_t block = 0; block < blockCount; ++block)
+	{
+		std::vector<float> buffer(static_cast<size_t>(srcWidth) * channelCount);
+		std::vector<float> ring(rowLength * ringSize);
+		std::vector<int32_t> ringRow(ringSize, -1);  // source row each slot holds
+		std::vector<float> row(rowLength);
+
+		const uint32_t begin = static_cast<uint64_t>(dstHeight) * block / blockCount;
+		const uint32_t end = static_cast<uint64_t>(dstHeight) * (block + 1) / blockCount;
+		for(uint32_t y = begin; y < end; ++y)
+		{
+			const float* w = vertical.getWeights(y);
+			std::fill(row.begin(), row.end(), 0.0f);
+			for(int32_t k = 0; k < vertical.count[y]; ++k)
+			{
+				const int32_t sy = vertical.first[y] + k;
+				const int32_t slot = sy % ringSize;
+				float* filtered = ring.data() + slot * rowLength;
+				if(ringRow[slot] != sy)
+				{
+					const float* source = load(sy, buffer.data());
+					if(srcWidth == dstWidth)
+						std::memcpy(filtered, source, rowLength * sizeof(float));
+					else
+						filterRow(source, filtered, horizontal, dstWidth, channelCount);
+					ringRow[slot] = sy;
+				}
+				add(row.data(), filtered, w[k], rowLength);
+			}
+			store(y, row.data());
+		}
+	}
+}
+
+float Resampler::getRadius(Filter filter)
+{
+	switch(filter)
+	{
+	case Filter::BOX:      return 0.5f;
+	case Filter::BILINEAR: return 1.0f;
+	case Filter::BICUBIC:  return 2.0f;
+	case Filter::LANCZOS3: return 3.0f;
+	case Filter::KAISER:   return 3.0f;
+	default: assert(false); return 0.5f;
+	}
+}
+
+void Resampler::resample(const float* src, uint32_t srcWidth, uint32_t srcHeight,
+		float* dst, uint32_t dstWidth, uint32_t dstHeight, uint32_t channelCount, Filter filter)
+{
+	assert(src != nullptr && dst != nullptr && 1 <= channelCount && channelCount <= 4);
+	const size_t srcLength = static_cast<size_t>(srcWidth) * channelCount;
+	const size_t dstLength = static_cast<size_t>(dstWidth) * channelCount;
+	::resample(srcWidth, srcHeight, dstWidth, dstHeight, channelCount, filter,
+			[=](uint32_t y, float*) { return src + y * srcLength; },
+			[=](uint32_t y, const float* row) { std::memcpy(dst + y * dstLength, row, dstLength * sizeof(float)); });
+}
+
+bool Resampler::resample(Color::Format format,
+		const void* src, uint32_t srcWidth, uint32_t srcHeight, ptrdiff_t srcStride,
+		void* dst, uint32_t dstWidth, uint32_t dstHeight, ptrdiff_t dstStride,
+		Filter filter, uint32_t options/* = NONE */)
+{
+	// filter floats of the same channel count.
+	static const Color::Format FLOAT_FORMATS[4] = { Color::C1_F32, Color::C2_F32, Color::C3_F32, Color::C4_F32 };
+	const uint32_t channelCount = format != Color::UNKNOWN? Color::sizeofChannel(format): 0;
+	const Color::Format floatFormat = 1 <= channelCount && channelCount <= 4? FLOAT_FORMATS[channelCount - 1]: Color::UNKNOWN;
+	float probe[4] = {};  // converting no pixel tells whether PixelConverter knows the format.
+	if(floatFormat == Color::UNKNOWN || !PixelConverter::convert(format, probe, floatFormat, probe, 0) ||
+			srcWidth == 0 || srcHeight == 0 || dstWidth == 0 || dstHeight == 0)
+	{
+		slog.w(TAG, "can't resample %ux%u to %ux%u of format %#x", srcWidth, srcHeight,
+				dstWidth, dstHeight, static_cast<int>(format));
+		return false;
+	}
+	uint32_t decode = PixelConverter::NONE, encode = PixelConverter::NONE;
+	if(options & SRGB)
+	{
+		decode |= PixelConverter::SRGB_TO_LINEAR;
+		encode |= PixelConverter::LINEAR_TO_SRGB;
+	}
+	if(options & PREMULTIPLY_ALPHA)
+	{
+		decode |= PixelConverter::PREMULTIPLY;
+		encode |= PixelConverter::UNPREMULTIPLY;
+	}
+
+	const uint8_t* source = static_cast<const uint8_t*>(src);
+	uint8_t* destination = static_cast<uint8_t*>(dst);
+	const bool direct = format == floatFormat && decode == PixelConverter::NONE;
+	::resample(srcWidth, srcHeight, dstWidth, dstHeight, channelCount, filter,
+			[=](uint32_t y, float* buffer)
+			{
+				const uint8_t* row = source + static_cast<ptrdiff_t>(y) * srcStride;
+				if(direct)
+					return reinterpret_cast<const float*>(row);
+				PixelConverter::convert(format, row, floatFormat, buffer, srcWidth, decode);
+				return const_cast<const float*>(buffer);
+			},
+			[=](uint32_t y, const float* row)
+			{
+				PixelConverter::convert(floatFormat, row, format, destination + static_cast<ptrdiff_t>(y) * dstStride, dstWidth, encode);
+			});
+	return true;
+}
+
+bool Resampler::resample(const Image& src, Image& dst, Filter filter, uint32_t options/* = NONE */)
+{
+	if(!src.isValid() || !dst.isValid() || src.getColorFormat() != dst.getColorFormat())
+	{
+		slog.w(TAG, "source and destination images should be valid, of the same color format");
+		return false;
+	}
+
+	const Color::Format format = src.getColorFormat();
+	const ptrdiff_t pixelSize = Color::size(format);
+	const ptrdiff_t srcStride = src.getWidth() * pixelSize;
+	ptrdiff_t dstStride = dst.getWidth() * pixelSize;
+	uint8_t* destination = dst.getData();
+	if(src.isBottomUp() != dst.isBottomUp())
+	{
+		// write rows from the last one up.
+		destination += (dst.getHeight() - 1) * dstStride;
+		dstStride = -dstStride;
+	}
+	return resample(format, src.getData(), src.getWidth(), src.getHeight(), srcStride,
+			destination, dst.getWidth(), dst.getHeight(), dstStride, filter, options);
+}
@@ -0,0 +1,75 @@
+#ifndef PEA_GRAPHICS_RESAMPLER_H_
+#define PEA_GRAPHICS_RESAMPLER_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "graphics/Color.h"
+#include "graphics/Image.h"
+
+namespace pea {
+
+/**
+ * @class Resampler
+ * Resize images with a separable filter, horizontal pass then vertical pass. Weights of each
+ * destination column and row are computed once per call, edge pixels are repeated outside.
+ *
+ * Pixels are filtered as floats, any Color::Format PixelConverter knows is read and written
+ * through it, with its SIMD kernels for 8 bit formats. Rows are filtered in parallel, and the
+ * vertical pass, where most of the time goes, uses AVX2 when the CPU has it.
+ */
+class Resampler
+{
+public:
+	enum class Filter: uint8_t
+	{
+		BOX,       ///< nearest pixel when enlarging, average of covered pixels when shrinking
+		BILINEAR,  ///< triangle, radius 1
+		BICUBIC,   ///< Catmull-Rom spline, radius 2
+		LANCZOS3,  ///< Lanczos windowed sinc, radius 3
+		KAISER,    ///< Kaiser windowed sinc, radius 3, alpha 4
+	};
+
+	enum Option: uint32_t
+	{
+		NONE               = 0,
+		PREMULTIPLY_ALPHA  = 1 << 0,  ///< filter color weighted by alpha, so that transparent pixels don't bleed.
+		SRGB               = 1 << 1,  ///< filter color channels in linear space.
+	};
+
+public:
+	/**
+	 * @return radius of filter in pixels, at scale 1.
+	 */
+	static float getRadius(Filter filter);
+
+	/**
+	 * Resample float pixels, channels interleaved and rows without padding.
+	 * @param[in]  channelCount 1 to 4.
+	 */
+	static void resample(const float* src, uint32_t srcWidth, uint32_t srcHeight,
+			float* dst, uint32_t dstWidth, uint32_t dstHeight, uint32_t channelCount, Filter filter);
+
+	/**
+	 * Resample pixels of any uncompressed format.
+	 * @param[in] format    color format of both src and dst.
+	 * @param[in] srcStride byte offset between source rows, negative if they go upwards in memory.
+	 * @param[in] dstStride byte offset between destination rows, negative if they go upwards in memory.
+	 * @param[in] options   bitwise or of Option.
+	 * @return false if format is unknown.
+	 */
+	static bool resample(Color::Format format,
+			const void* src, uint32_t srcWidth, uint32_t srcHeight, ptrdiff_t srcStride,
+			void* dst, uint32_t dstWidth, uint32_t dstHeight, ptrdiff_t dstStride,
+			Filter filter, uint32_t options = NONE);
+
+	/**
+	 * Resample src to the size of dst. Rows are flipped if one image is bottom-up and the other is
+	 * not, so that the picture stays upright.
+	 * @return false if images are invalid, or their color formats differ.
+	 */
+	static bool resample(const Image& src, Image& dst, Filter filter, uint32_t options = NONE);
+};
+
+}  // namespace pea
+#endif  // PEA_GRAPHICS_RESAMPLER_H_
@@ -0,0 +1,196 @@
+#include "graphics/TextLayoutCache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+
+#include "graphics/Color.h"
+#include "util/unicode.h"
+
+using namespace pea;
+
+TextLayoutCache::TextLayoutCache(GlyphCache& cache, size_t capacity/* = 1024 */):
+		cache(cache),
+		capacity(std::max<size_t>(capacity, 1)),
+		epoch(0),
+		statistics{0, 0}
+{
+}
+
+uint32_t TextLayoutCache::packColor(const vec4f& color)
+{
+	uint32_t value = color_cast(color);
+	const uint8_t bytes[4] = { Color::red(value), Color::green(value), Color::blue(value), Color::alpha(value) };
+	std::memcpy(&value, bytes, sizeof(value));
+	return value;
+}
+
+uint64_t TextLayoutCache::hash(const std::string& text, uint32_t size, Typeface::Style style, float scaleX)
+{
+	uint32_t scaleBits;
+	std::memcpy(&scaleBits, &scaleX, sizeof(scaleBits));
+	uint64_t h = std::hash<std::string_view>()(std::string_view(text));
+	// mix the rest in like boost::hash_combine
+	for(uint64_t value: {static_cast<uint64_t>(size) | static_cast<uint64_t>(style) << 32, static_cast<uint64_t>(scaleBits)})
+		h ^= value + 0x9E3779B97F4A7C15ULL + (h << 6) + (h >> 2);
+	return h;
+}
+
+void TextLayoutCache::layout(const std::string& text, uint32_t size, Typeface::Style style, float scaleX,
+		std::vector<const GlyphCache::Glyph*>& glyphs, std::vector<float>& distances)
+{
+	// advances come from outlines and are known before glyphs are rendered, glyphs still being
+	// rendered leave their places blank.
+	glyphs.clear();
+	distances.clear();
+	float distance = 0;
+	char32_t last = 0;
+	for(const char *p = text.data(), *end = p + text.size(); p < end;)
+	{
+		char32_t codepoint = decodeUtf8(p, end);
+		if(codepoint < 0x20 || codepoint == 0x7F)  // \r\n\t will be ignored here.
+			continue;
+
+		if(last != 0)
+			distance += cache.getKerning(last, codepoint, size) * scaleX;
+		glyphs.push_back(cache.find(codepoint, size, style));
+		distances.push_back(distance);
+		distance += cache.getAdvance(codepoint, size) * scaleX;
+		last = codepoint;
+	}
+}
+
+bool TextLayoutCache::layout(Layout& layout)
+{
+	std::vector<float> distances;
+	this->layout(layout.text, layout.size, layout.style, layout.scaleX, layout.glyphs, distances);
+	layout.generation = cache.getGeneration();
+
+	const float textureScale = 1.0F / cache.getPageSize();
+	bool complete = true;
+	scratch.clear();
+	for(size_t i = 0; i < layout.glyphs.size(); ++i)
+	{
+		const GlyphCache::Glyph* glyph = layout.glyphs[i];
+		complete &= glyph != nullptr;
+		if(!glyph || glyph->rect.isEmpty())  // no need to draw space
+			continue;
+
+		const Rect<int32_t>& rect = glyph->rect;
+		float x0 = distances[i] + glyph->bearing.x * layout.scaleX;
+		float x1 = x0 + rect.getWidth() * layout.scaleX;
+		float y1 = static_cast<float>(glyph->bearing.y);
+		float y0 = y1 - rect.getHeight();
+		//  ^ y                ^  t
+		//  |  y1              |  t1
+		//  |  y0              |  t0
+		//  |  /x0  x1         |  /s0  s1
+		//  +-----------> x    +-----------> s
+		float s0 = rect.left   * textureScale;
+		float s1 = rect.right  * textureScale;
+		float t1 = rect.top    * textureScale;
+		float t0 = rect.bottom * textureScale;
+		scratch.push_back(Quad{glyph->page, {
+				vec4f(x0, y1, s0, t1), vec4f(x0, y0, s0, t0), vec4f(x1, y1, s1, t1),
+				vec4f(x1, y1, s1, t1), vec4f(x0, y0, s0, t0), vec4f(x1, y0, s1, t0)}});
+	}
+
+	// group quads by page, so that they're appended to a page with one copy.
+	std::stable_sort(scratch.begin(), scratch.end(), [](const Quad& a, const Quad& b) { return a.page < b.page; });
+	layout.ranges.clear();
+	layout.quads.clear();
+	for(const Quad& quad: scratch)
+	{
+		const uint32_t index = static_cast<uint32_t>(layout.quads.size());
+		if(layout.ranges.empty() || layout.ranges.back().page != quad.page)
+			layout.ranges.push_back(Range{quad.page, index, index});
+		layout.quads.insert(layout.quads.end(), quad.vertices, quad.vertices + 6);
+		layout.ranges.back().end = index + 6;
+	}
+	return complete;
+}
+
+void TextLayoutCache::bake(Layout& layout, const vec2f& position, uint32_t color)
+{
+	layout.position = position;
+	layout.color = color;
+	layout.vertices.resize(layout.quads.size());
+	for(size_t i = 0; i < layout.quads.size(); ++i)
+	{
+		const vec4f& quad = layout.quads[i];
+		layout.vertices[i] = Vertex{vec4f(quad.x + position.x, quad.y + position.y, quad.z, quad.w), color};
+	}
+}
+
+void TextLayoutCache::prune()
+{
+	// drop layouts not used since the last pruning, or keep more if most are in use.
+	for(auto it = layouts.begin(); it != layouts.end();)
+		if(it->second.epoch < epoch)
+			it = layouts.erase(it);
+		else
+			++it;
+
+	++epoch;
+	if(layouts.size() * 2 > capacity)
+		capacity *= 2;
+}
+
+bool TextLayoutCache::append(const std::string& text, uint32_t size, Typeface::Style style, float scaleX,
+		const vec2f& position, uint32_t color, std::vector<std::vector<Vertex>>& pages)
+{
+	const uint64_t key = hash(text, size, style, scaleX);
+	auto it = layouts.find(key);
+	bool found = it != layouts.end();
+	if(found)
+	{
+		const Layout& layout = it->second;
+		found = layout.generation == cache.getGeneration() && layout.size == size && layout.style == style &&
+				layout.scaleX == scaleX && layout.text == text;
+	}
+
+	Layout* layout;
+	bool complete = true;
+	if(found)
+	{
+		layout = &it->second;
+		for(const GlyphCache::Glyph* glyph: layout->glyphs)
+			cache.touch(glyph);
+		++statistics.hits;
+	}
+	else
+	{
+		if(layouts.size() >= capacity)
+			prune();
+
+		layout = &layouts[key];  // a colliding text takes the place.
+		layout->text = text;
+		layout->size = size;
+		layout->style = style;
+		layout->scaleX = scaleX;
+		complete = this->layout(*layout);
+		bake(*layout, position, color);
+		++statistics.misses;
+	}
+
+	layout->epoch = epoch;
+	if(layout->position != position || layout->color != color)
+		bake(*layout, position, color);
+	if(pages.size() < cache.getPageCount())
+		pages.resize(cache.getPageCount());
+	for(const Range& range: layout->ranges)
+	{
+		std::vector<Vertex>& vertices = pages[range.page];
+		vertices.insert(vertices.end(), layout->vertices.begin() + range.begin, layout->vertices.begin() + range.end);
+	}
+
+	// append what's ready, and lay it out again next time.
+	if(!complete)
+		layouts.erase(key);
+	return complete;
+}
+
+void TextLayoutCache::clear()
+{
+	layouts.clear();
+}
@@ -0,0 +1,131 @@
+#ifndef PEA_GRAPHICS_TEXT_LAYOUT_CACHE_H_
+#define PEA_GRAPHICS_TEXT_LAYOUT_CACHE_H_
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "graphics/GlyphCache.h"
+#include "graphics/Typeface.h"
+#include "math/vec2.h"
+#include "math/vec4.h"
+
+namespace pea {
+
+/**
+ * @class TextLayoutCache
+ * Glyph quads of texts laid out once and kept, keyed by (text, size, style, horizontal scale), so
+ * that labels drawn frame after frame cost a lookup and a copy of their vertices.
+ *
+ * A text is decoded from UTF-8, kerned, and its glyphs looked up in GlyphCache. Quads are kept
+ * relative to origin, and baked at the last position and color, which most labels keep. Texts
+ * with glyphs not rendered yet aren't kept, and are laid out again until all their glyphs show up.
+ * Layouts are dropped if the glyph cache evicts glyphs, or if they aren't used for a while.
+ */
+class TextLayoutCache
+{
+public:
+	/**
+	 * Vertex of glyph quad, in the coordinates of TextureFont, where y goes up.
+	 */
+	struct Vertex
+	{
+		vec4f vertex;    ///< vec2 position + vec2 texcoord
+		uint32_t color;  ///< RGBA bytes in memory order
+	};
+
+	struct Statistics
+	{
+		size_t hits;
+		size_t misses;
+	};
+
+private:
+	struct Range
+	{
+		uint32_t page;
+		uint32_t begin, end;  ///< vertices of page
+	};
+
+	struct Layout
+	{
+		std::string text;
+		uint32_t size;
+		Typeface::Style style;
+		float scaleX;
+
+		size_t generation;  ///< of glyph cache when laid out
+		uint64_t epoch;     ///< last prune() it's used after
+		std::vector<const GlyphCache::Glyph*> glyphs;
+		std::vector<Range> ranges;  ///< sorted by page
+		std::vector<vec4f> quads;   ///< vertices relative to origin
+		std::vector<Vertex> vertices;  ///< quads baked at position and color
+		vec2f position;
+		uint32_t color;
+	};
+
+	GlyphCache& cache;
+	std::unordered_map<uint64_t, Layout> layouts;
+	size_t capacity;  ///< layouts kept before pruning
+	uint64_t epoch;
+	Statistics statistics;
+
+	// scratch of layout()
+	struct Quad
+	{
+		uint32_t page;
+		vec4f vertices[6];
+	};
+	std::vector<Quad> scratch;
+
+private:
+	static uint64_t hash(const std::string& text, uint32_t size, Typeface::Style style, float scaleX);
+	bool layout(Layout& layout);
+	void bake(Layout& layout, const vec2f& position, uint32_t color);
+	void prune();
+
+public:
+	/**
+	 * @param[in] cache    glyphs of layouts, which outlives this.
+	 * @param[in] capacity layouts kept, those not used since the last pruning are dropped when there
+	 *                     are more.
+	 */
+	explicit TextLayoutCache(GlyphCache& cache, size_t capacity = 1024);
+
+	/**
+	 * Append quads of text into vertices of atlas pages, 6 vertices for each visible glyph.
+	 * @param[in]     text     UTF-8 text, control characters are ignored.
+	 * @param[in]     size     text size in pixels.
+	 * @param[in]     scaleX   horizontal scale.
+	 * @param[in]     position where the baseline starts.
+	 * @param[in]     color    RGBA bytes in memory order.
+	 * @param[in,out] pages    vertices of each atlas page, resized to page count.
+	 * @return false if some glyphs aren't ready and are left out.
+	 */
+	bool append(const std::string& text, uint32_t size, Typeface::Style style, float scaleX,
+			const vec2f& position, uint32_t color, std::vector<std::vector<Vertex>>& pages);
+
+	/**
+	 * Lay text out without keeping it.
+	 * @param[out] glyphs    glyphs of text, nullptr for the ones not ready.
+	 * @param[out] distances distances of glyph origins from the text start.
+	 */
+	void layout(const std::string& text, uint32_t size, Typeface::Style style, float scaleX,
+			std::vector<const GlyphCache::Glyph*>& glyphs, std::vector<float>& distances);
+
+	void clear();
+	size_t getSize() const;
+	const Statistics& getStatistics() const;
+
+	/**
+	 * @return RGBA bytes in memory order of color within [0, 1].
+	 */
+	static uint32_t packColor(const vec4f& color);
+};
+
+inline size_t TextLayoutCache::getSize() const { return layouts.size(); }
+inline const TextLayoutCache::Statistics& TextLayoutCache::getStatistics() const { return statistics; }
+
+}  // namespace pea
+#endif  // PEA_GRAPHICS_TEXT_LAYOUT_CACHE_H_
@@ -1,5 +1,16 @@
 #include "graphics/Typeface.h"
 
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include FT_OUTLINE_H
+
+#include <algorithm>
+
+#include "graphics/Path.h"
+#include "util/Log.h"
+
+static const char* TAG = "Typeface";
+
 using namespace pea;
 
 Typeface* Typeface::create(const std::string& familyName, Typeface::Style style)
@@ -7,3 +18,183 @@ Typeface* Typeface::create(const std::string& familyName, Typeface::Style style)
 	// TODO:
 	return nullptr;
 }
+
+Typeface* Typeface::createFromFile(const std::string& path)
+{
+	Typeface* typeface = new Typeface();
+	FT_Error error = FT_Init_FreeType(&typeface->library);
+	if(error != FT_Err_Ok)
+	{
+		slog.e(TAG, "FT_Error (0x%02X): Could not initialize FreeType library", error);
+		typeface->library = nullptr;
+		delete typeface;
+		return nullptr;
+	}
+
+	error = FT_New_Face(typeface->library, path.c_str(), 0/* face_index */, &typeface->face);
+	if(error != FT_Err_Ok || !FT_IS_SCALABLE(typeface->face))
+	{
+		slog.w(TAG, "FT_Error (0x%02X): Failed to load outline font %s", error, path.c_str());
+		delete typeface;
+		return nullptr;
+	}
+
+	uint8_t style = NORMAL;
+	if(typeface->face->style_flags & FT_STYLE_FLAG_BOLD)
+		style |= BOLD;
+	if(typeface->face->style_flags & FT_STYLE_FLAG_ITALIC)
+		style |= ITALIC;
+	typeface->style = static_cast<Style>(style);
+	return typeface;
+}
+
+Typeface::Typeface():
+		style(NORMAL),
+		weight(400),
+		library(nullptr),
+		face(nullptr)
+{
+}
+
+Typeface::~Typeface()
+{
+	if(face)
+		FT_Done_Face(face);
+	if(library)
+		FT_Done_FreeType(library);
+}
+
+namespace {
+
+struct Outline
+{
+	Path* path;
+	vec2f origin;
+	vec2f scale;
+	bool open;
+
+	vec2f map(const FT_Vector* v) const
+	{
+		return vec2f(origin.x + v->x * scale.x, origin.y - v->y * scale.y);
+	}
+};
+
+int moveTo(const FT_Vector* to, void* user)
+{
+	Outline* outline = static_cast<Outline*>(user);
+	if(outline->open)
+		outline->path->close();
+	outline->path->moveTo(outline->map(to));
+	outline->open = true;
+	return 0;
+}
+
+int lineTo(const FT_Vector* to, void* user)
+{
+	Outline* outline = static_cast<Outline*>(user);
+	outline->path->lineTo(outline->map(to));
+	return 0;
+}
+
+int conicTo(const FT_Vector* control, const FT_Vector* to, void* user)
+{
+	Outline* outline = static_cast<Outline*>(user);
+	outline->path->quadTo(outline->map(control), outline->map(to));
+	return 0;
+}
+
+int cubicTo(const FT_Vector* control1, const FT_Vector* control2, const FT_Vector* to, void* user)
+{
+	Outline* outline = static_cast<Outline*>(user);
+	outline->path->cubicTo(outline->map(control1), outline->map(control2), outline->map(to));
+	return 0;
+}
+
+}  // namespace
+
+float Typeface::getGlyphPath(char32_t codepoint, float size, float scaleX, const vec2f& origin, Path& path)
+{
+	if(!face)
+		return 0;
+
+	// unscaled outline in font units, no hinting, scaled in float so that any size is exact.
+	FT_UInt index = FT_Get_Char_Index(face, codepoint);
+	if(FT_Load_Glyph(face, index, FT_LOAD_NO_SCALE | FT_LOAD_NO_BITMAP) != FT_Err_Ok)
+		return 0;
+
+	const float scale = size / face->units_per_EM;
+	FT_GlyphSlot glyph = face->glyph;
+	if(glyph->format == FT_GLYPH_FORMAT_OUTLINE && glyph->outline.n_contours > 0)
+	{
+		FT_Outline_Funcs funcs = { moveTo, lineTo, conicTo, cubicTo, 0, 0 };
+		Outline outline = { &path, origin, vec2f(scale * scaleX, scale), false };
+		FT_Outline_Decompose(&glyph->outline, &funcs, &outline);
+		if(outline.open)
+			path.close();
+	}
+
+	return glyph->advance.x * scale * scaleX;
+}
+
+bool Typeface::getGlyphBitmap(char32_t codepoint, uint32_t size, Style style, Bitmap& bitmap)
+{
+	if(!face || FT_Set_Pixel_Sizes(face, 0, size) != FT_Err_Ok)
+		return false;
+
+	FT_UInt index = FT_Get_Char_Index(face, codepoint);
+	if(FT_Load_Glyph(face, index, FT_LOAD_DEFAULT | FT_LOAD_NO_BITMAP) != FT_Err_Ok)
+		return false;
+
+	FT_GlyphSlot glyph = face->glyph;
+	if(glyph->format == FT_GLYPH_FORMAT_OUTLINE)
+	{
+		// emboldening strength and slant are the ones of FT_GlyphSlot_Embolden and FT_GlyphSlot_Oblique.
+		if((style & BOLD) && !isBold())
+			FT_Outline_Embolden(&glyph->outline, FT_MulFix(face->units_per_EM, face->size->metrics.y_scale) / 24);
+		if((style & ITALIC) && !isItalic())
+		{
+			FT_Matrix shear = { 0x10000L, 0x0366AL, 0, 0x10000L };
+			FT_Outline_Transform(&glyph->outline, &shear);
+		}
+	}
+	if(FT_Render_Glyph(glyph, FT_RENDER_MODE_NORMAL) != FT_Err_Ok)
+		return false;
+
+	// positive pitch: bitmap goes top down; negative pitch: bitmap goes bottom up.
+	const FT_Bitmap& source = glyph->bitmap;
+	bitmap.width  = source.width;
+	bitmap.height = source.rows;
+	bitmap.left = glyph->bitmap_left;
+	bitmap.top  = glyph->bitmap_top;
+	bitmap.advance = glyph->advance.x / 64.0F;
+	bitmap.pixels.resize(bitmap.width * bitmap.height);
+	const uint8_t* row = source.buffer;
+	if(source.pitch < 0)
+		row -= source.pitch * static_cast<int32_t>(source.rows - 1);
+	for(uint32_t r = 0; r < bitmap.height; ++r, row += source.pitch)
+		std::copy(row, row + bitmap.width, bitmap.pixels.data() + r * bitmap.width);
+	return true;
+}
+
+float Typeface::getAdvance(char32_t codepoint, float size)
+{
+	if(!face)
+		return 0;
+
+	FT_UInt index = FT_Get_Char_Index(face, codepoint);
+	if(FT_Load_Glyph(face, index, FT_LOAD_NO_SCALE | FT_LOAD_NO_BITMAP) != FT_Err_Ok)
+		return 0;
+	return face->glyph->advance.x * size / face->units_per_EM;
+}
+
+float Typeface::getKerning(char32_t left, char32_t right, float size) const
+{
+	if(!face || !FT_HAS_KERNING(face))
+		return 0;
+
+	FT_Vector kerning;
+	if(FT_Get_Kerning(face, FT_Get_Char_Index(face, left), FT_Get_Char_Index(face, right),
+			FT_KERNING_UNSCALED, &kerning) != FT_Err_Ok)
+		return 0;
+	return kerning.x * size / face->units_per_EM;
+}
@@ -3,9 +3,22 @@
 
 #include <cinttypes>
 #include <string>
+#include <vector>
+
+#include "math/vec2.h"
+
+struct FT_LibraryRec_;
+struct FT_FaceRec_;
 
 namespace pea {
 
+class Path;
+
+/**
+ * A font face, whose glyph outlines are read by FreeType in font units, and scaled to any size as
+ * paths, so that text is drawn with the same rasterizer as shapes. Glyph loading goes through one
+ * FreeType slot, so a typeface is used by one thread at a time.
+ */
 class Typeface
 {
 public:
@@ -18,20 +31,73 @@ public:
 	};
 	static constexpr uint8_t STYLE_COUNT = 4;
 	
+	/**
+	 * 8 bit coverage of a rendered glyph, rows go top down.
+	 */
+	struct Bitmap
+	{
+		uint32_t width;
+		uint32_t height;
+		int32_t left;     ///< offset from origin to the left of bitmap
+		int32_t top;      ///< offset from baseline up to the top of bitmap
+		float advance;    ///< horizontal advance in pixels, hinted
+		std::vector<uint8_t> pixels;
+	};
+	
 private:
 	static constexpr uint32_t STYLE_MASK = 3;
 	Style style;
 	float weight;
 
+	FT_LibraryRec_* library;
+	FT_FaceRec_* face;
+
 public:
 	static Typeface* create(const std::string& familyName, Typeface::Style style);
 	
+	/**
+	 * @param[in] path font file, such as "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf".
+	 * @return nullptr if FreeType can't read the file.
+	 */
+	static Typeface* createFromFile(const std::string& path);
+	
 public:
 	Typeface();
 	virtual ~Typeface();
 	
+	Typeface(const Typeface& other) = delete;
+	Typeface& operator =(const Typeface& other) = delete;
+	
 	Style getStyle() const;
 	
+	/**
+	 * Append the outline of a glyph to path, in closed contours, y axis goes down.
+	 * @param[in] size   text size in pixels, i.e. the em size.
+	 * @param[in] scaleX horizontal scale of the glyph.
+	 * @param[in] origin where the glyph's baseline starts.
+	 * @return horizontal advance in pixels, 0 if the glyph can't be loaded.
+	 */
+	float getGlyphPath(char32_t codepoint, float size, float scaleX, const vec2f& origin, Path& path);
+	
+	/**
+	 * Render a glyph by FreeType with hinting, bold and italic styles are synthesized if this
+	 * typeface isn't of them.
+	 * @param[in]  size   text size in pixels.
+	 * @param[out] bitmap coverage of the glyph, empty for blank glyphs like space.
+	 * @return false if the glyph can't be loaded.
+	 */
+	bool getGlyphBitmap(char32_t codepoint, uint32_t size, Style style, Bitmap& bitmap);
+	
+	/**
+	 * @return horizontal advance in pixels of a glyph.
+	 */
+	float getAdvance(char32_t codepoint, float size);
+	
+	/**
+	 * @return horizontal kerning in pixels between two glyphs, 0 if the font has no kerning.
+	 */
+	float getKerning(char32_t left, char32_t right, float size) const;
+	
 	bool isBold() const;
 	bool isItalic() const;
 };
@@ -0,0 +1,133 @@
+#include "io/MappedFile.h"
+
+#include <utility>
+
+#if defined(_WIN32) || defined(_WIN64)
+#  define WIN32_LEAN_AND_MEAN
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+#include "util/Log.h"
+
+
+static const char* TAG = "MappedFile";
+
+using namespace pea;
+
+MappedFile::MappedFile():
+		data(nullptr),
+		size(0)
+#if defined(_WIN32) || defined(_WIN64)
+		, file(nullptr)
+		, mapping(nullptr)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept:
+		MappedFile()
+{
+	*this = std::move(other);
+}
+
+MappedFile& MappedFile::operator =(MappedFile&& other) noexcept
+{
+	if(this != &other)
+	{
+		close();
+		std::swap(data, other.data);
+		std::swap(size, other.size);
+#if defined(_WIN32) || defined(_WIN64)
+		std::swap(file, other.file);
+		std::swap(mapping, other.mapping);
+#endif
+	}
+	return *this;
+}
+
+bool MappedFile::open(const std::string& path)
+{
+	close();
+#if defined(_WIN32) || defined(_WIN64)
+	HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL, nullptr);
+	if(handle == INVALID_HANDLE_VALUE)
+	{
+		slog.w(TAG, "can't open file %s", path.c_str());
+		return false;
+	}
+
+	LARGE_INTEGER length;
+	if(!GetFileSizeEx(handle, &length) || length.QuadPart == 0)
+	{
+		CloseHandle(handle);
+		return false;
+	}
+
+	file = handle;
+	mapping = CreateFileMappingA(handle, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+	if(mapping != nullptr)
+		data = static_cast<uint8_t*>(MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0));
+	if(data == nullptr)
+	{
+		slog.w(TAG, "can't map file %s", path.c_str());
+		close();
+		return false;
+	}
+	size = static_cast<size_t>(length.QuadPart);
+#else
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if(fd < 0)
+	{
+		slog.w(TAG, "can't open file %s", path.c_str());
+		return false;
+	}
+
+	struct stat status;
+	if(fstat(fd, &status) != 0 || status.st_size <= 0)
+	{
+		::close(fd);
+		return false;
+	}
+
+	// the mapping keeps its own reference to the file.
+	void* address = mmap(nullptr, status.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if(address == MAP_FAILED)
+	{
+		slog.w(TAG, "can't map file %s", path.c_str());
+		return false;
+	}
+	data = static_cast<uint8_t*>(address);
+	size = static_cast<size_t>(status.st_size);
+#endif
+	return true;
+}
+
+void MappedFile::close()
+{
+#if defined(_WIN32) || defined(_WIN64)
+	if(data != nullptr)
+		UnmapViewOfFile(data);
+	if(mapping != nullptr)
+		CloseHandle(mapping);
+	if(file != nullptr)
+		CloseHandle(file);
+	mapping = file = nullptr;
+#else
+	if(data != nullptr)
+		munmap(data, size);
+#endif
+	data = nullptr;
+	size = 0;
+}
@@ -0,0 +1,57 @@
+#ifndef PEA_IO_MAPPED_FILE_H_
+#define PEA_IO_MAPPED_FILE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace pea {
+
+/**
+ * @class MappedFile
+ * A file mapped into memory, pages are read in by the OS when touched instead of being copied up
+ * front. The mapping is private copy-on-write: writing to it changes this process's pages only,
+ * never the file.
+ */
+class MappedFile
+{
+private:
+	uint8_t* data;
+	size_t size;
+#if defined(_WIN32) || defined(_WIN64)
+	void* file;     // HANDLE
+	void* mapping;  // HANDLE
+#endif
+
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile& other) = delete;
+	MappedFile& operator =(const MappedFile& other) = delete;
+
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator =(MappedFile&& other) noexcept;
+
+	/**
+	 * Map a whole file, a mapped file is closed first.
+	 * @return false if file can't be opened or mapped, or is empty.
+	 */
+	bool open(const std::string& path);
+
+	void close();
+
+	bool isOpen() const;
+
+	      uint8_t* getData();
+	const uint8_t* getData() const;
+	size_t getSize() const;
+};
+
+inline bool MappedFile::isOpen() const { return data != nullptr; }
+inline       uint8_t* MappedFile::getData()       { return data; }
+inline const uint8_t* MappedFile::getData() const { return data; }
+inline size_t MappedFile::getSize() const { return size; }
+
+}  // namespace pea
+#endif  // PEA_IO_MAPPED_FILE_H_
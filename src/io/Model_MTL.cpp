@@ -5,6 +5,7 @@
 
 #include "io/Model_OBJ.private.h"
 #include "io/FileSystem.h"
+#include "io/TextureLoader.h"
 #include "io/TypeUtility.h"
 #include "opengl/Texture.h"
 #include "util/compiler.h"
@@ -228,26 +229,18 @@ Model_MTL& Model_MTL::operator =(Model_MTL&& other)
 
 std::unordered_map<std::string, std::shared_ptr<Texture>> Model_MTL::loadTexture() const
 {
-	std::unordered_map<std::string, std::shared_ptr<Texture>> textureMap;
 	std::string dir = FileSystem::dirname(path) + FileSystem::SEPERATOR;
-	Texture::Parameter parameter;
+	TextureLoader loader;
+	std::vector<std::pair<std::string, Texture::Type>> names;
 	
-	auto addTexture = [&dir, &parameter, &textureMap](Texture::Type type, const std::string& textureName)
+	auto addTexture = [&dir, &loader, &names](Texture::Type type, const std::string& textureName)
 	{
 		if(textureName.empty())
 			return;
 		
-		std::shared_ptr<Texture> texture = std::make_shared<Texture>();
-		std::string path = dir + textureName;
-		if(textureMap.find(textureName) != textureMap.end())
-			return;
-		slog.v(TAG, "loadTexture() %s", path.c_str());
-		if(texture->load(path))
-		{
-			texture->setParameter(parameter);
-			texture->setType(type);
-			textureMap.emplace(textureName, texture);
-		}
+		size_t index = loader.add(dir + textureName);
+		if(index == names.size())
+			names.emplace_back(textureName, type);
 	};
 	
 	for(const std::pair<const std::string, std::shared_ptr<Material>>& pair: materials)
@@ -260,6 +253,20 @@ std::unordered_map<std::string, std::shared_ptr<Texture>> Model_MTL::loadTexture
 		addTexture(Texture::Type::SPECULAR, material->specular_texname);
 	}
 	
+	TextureLoader::TextureSink sink;
+	loader.finish(sink);
+	
+	std::unordered_map<std::string, std::shared_ptr<Texture>> textureMap;
+	for(size_t i = 0; i < names.size(); ++i)
+	{
+		const std::shared_ptr<Texture>& texture = sink.textures[i];
+		if(!texture)
+			continue;
+		
+		texture->setType(names[i].second);
+		textureMap.emplace(names[i].first, texture);
+	}
+	
 	return textureMap;
 }
 
@@ -84,6 +84,11 @@ public:
 	Model_MTL(Model_MTL&& other);
 	Model_MTL& operator = (Model_MTL&& other) = delete;
 	
+	/**
+	 * Load texture maps of all the materials. Images are decoded in parallel by TextureLoader, and
+	 * uploaded on the calling thread, which must own the OpenGL context.
+	 * @return textures keyed by texture file name, failed ones are left out.
+	 */
 	std::unordered_map<std::string, std::shared_ptr<Texture>> loadTexture() const;
 	
 	size_t getSize() const;
@@ -2,6 +2,8 @@
 
 #include <fstream>
 
+#include "io/FileSystem.h"
+#include "io/TextureLoader.h"
 #include "util/type_trait.h"
 
 namespace pea {
@@ -745,7 +747,8 @@ void from_json(const json& j, glTF& model)
 
 }  // namespace glTF2
 
-Model_glTF2::Model_glTF2(const std::string& path) noexcept(false)
+Model_glTF2::Model_glTF2(const std::string& path) noexcept(false):
+		path(path)
 {
 	std::ifstream file(path);
 	json j;
@@ -763,4 +766,33 @@ bool Model_glTF2::save(const std::string& path, uint32_t space/* = 4*/) const
 	return true;
 }
 
+std::vector<std::shared_ptr<Texture>> Model_glTF2::loadTexture() const
+{
+	const std::string dir = FileSystem::dirname(path) + FileSystem::SEPERATOR;
+	const size_t imageCount = model.images.size();
+	constexpr size_t NONE = static_cast<size_t>(-1);
+	std::vector<size_t> imageIndices(imageCount, NONE);
+	TextureLoader loader;
+	for(size_t i = 0; i < imageCount; ++i)
+	{
+		const std::string& uri = model.images[i].uri;
+		if(uri.empty() || uri.compare(0, 5, "data:") == 0)
+			continue;
+		imageIndices[i] = loader.add(dir + uri);
+	}
+	
+	TextureLoader::TextureSink sink;
+	loader.finish(sink);
+	
+	std::vector<std::shared_ptr<Texture>> textures(model.textures.size());
+	for(size_t i = 0; i < textures.size(); ++i)
+	{
+		const int32_t& source = model.textures[i].source;
+		if(source < 0 || static_cast<size_t>(source) >= imageCount || imageIndices[source] == NONE)
+			continue;
+		textures[i] = sink.textures[imageIndices[source]];
+	}
+	return textures;
+}
+
 }  // namespace pea
@@ -414,11 +414,22 @@ class Model_glTF2
 public:
 	glTF2::glTF model;
 	
+private:
+	std::string path;
+	
 public:
 	explicit Model_glTF2(const std::string& path) noexcept(false);
 	
 	bool save(const std::string& path, uint32_t space = 4) const;
 	
+	/**
+	 * Load images referred by textures, in parallel with TextureLoader. Only external image files
+	 * are supported, embedded data URIs and buffer views are skipped. Must be called on the thread
+	 * owning the OpenGL context.
+	 * @return a texture for each element of model.textures, nullptr if failed.
+	 */
+	std::vector<std::shared_ptr<Texture>> loadTexture() const;
+	
 };
 
 }  // namespace pea
@@ -0,0 +1,140 @@
+#include "io/TextureLoader.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+#include "graphics/ImageFactory.h"
+#include "util/Log.h"
+
+using namespace pea;
+
+static const char* TAG = "TextureLoader";
+
+using Clock = std::chrono::steady_clock;
+
+static double elapsed(const Clock::time_point& start)
+{
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+bool TextureLoader::TextureSink::upload(size_t index, const std::string& path, const std::shared_ptr<Image>& image)
+{
+	if(textures.size() <= index)
+		textures.resize(index + 1);
+	if(!image)
+		return false;
+
+	std::shared_ptr<Texture> texture = std::make_shared<Texture>();
+	if(!texture->load(*image))
+	{
+		slog.e(TAG, "failed to upload texture (%s)", path.c_str());
+		return false;
+	}
+
+	texture->setParameter(parameter);
+	textures[index] = texture;
+	return true;
+}
+
+TextureLoader::TextureLoader(uint32_t threadCount/* = 0 */):
+		threadCount(threadCount > 0? threadCount: std::max(std::thread::hardware_concurrency(), 1U)),
+		next(0),
+		uploadCount(0)
+{
+}
+
+TextureLoader::~TextureLoader()
+{
+	// Stop handing out paths, images already being decoded are dropped with the queue.
+	next.store(records.size());
+	join();
+}
+
+size_t TextureLoader::add(const std::string& path)
+{
+	assert(!queue);  // "add() after start()"
+	auto it = indices.find(path);
+	if(it != indices.end())
+		return it->second;
+
+	size_t index = records.size();
+	indices.emplace(path, index);
+	records.push_back(Record{path, 0.0, 0.0, false});
+	return index;
+}
+
+void TextureLoader::start()
+{
+	assert(!queue);
+	// every image has its own cell, so push never fails.
+	queue.reset(new LockFreeQueue<Item>(std::max<size_t>(records.size(), 1)));
+	size_t workerCount = std::min<size_t>(threadCount, records.size());
+	slog.d(TAG, "decode %zu images with %zu threads", records.size(), workerCount);
+	for(size_t i = 0; i < workerCount; ++i)
+		workers.emplace_back(&TextureLoader::decode, this);
+}
+
+void TextureLoader::decode()
+{
+	const size_t size = records.size();
+	for(size_t index = next.fetch_add(1); index < size; index = next.fetch_add(1))
+	{
+		// Each worker writes only the records it takes, the queue publishes them to the poller.
+		Record& record = records[index];
+		Clock::time_point start = Clock::now();
+		std::shared_ptr<Image> image = ImageFactory::decodeFile(record.path);
+		if(image && !image->isBottomUp())
+			image->flipVertical();
+		record.decodeTime = elapsed(start);
+
+		bool pushed = queue->push(Item{index, std::move(image)});
+		assert(pushed);
+		(void)pushed;
+	}
+}
+
+void TextureLoader::join()
+{
+	for(std::thread& worker: workers)
+		if(worker.joinable())
+			worker.join();
+	workers.clear();
+}
+
+size_t TextureLoader::poll(Sink& sink, size_t maxCount/* = SIZE_MAX */)
+{
+	assert(queue);  // "poll() before start()"
+	size_t count = 0;
+	Item item;
+	while(count < maxCount && queue->pop(item))
+	{
+		Record& record = records[item.index];
+		if(!item.image)
+			slog.e(TAG, "failed to load image (%s)", record.path.c_str());
+
+		Clock::time_point start = Clock::now();
+		record.success = sink.upload(item.index, record.path, item.image);
+		record.uploadTime = elapsed(start);
+		slog.v(TAG, "%s decode %.3fms, upload %.3fms", record.path.c_str(),
+				record.decodeTime * 1000, record.uploadTime * 1000);
+
+		item.image.reset();
+		++count;
+	}
+
+	uploadCount += count;
+	if(isDone())
+		join();
+	return count;
+}
+
+void TextureLoader::finish(Sink& sink)
+{
+	if(!queue)
+		start();
+
+	while(!isDone())
+		if(poll(sink) == 0)
+			std::this_thread::yield();
+}
@@ -0,0 +1,143 @@
+#ifndef PEA_IO_TEXTURE_LOADER_H_
+#define PEA_IO_TEXTURE_LOADER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "graphics/Image.h"
+#include "opengl/Texture.h"
+#include "util/LockFreeQueue.h"
+
+namespace pea {
+
+/**
+ * @class TextureLoader
+ * Decode texture images on a pool of worker threads, and hand them back to the thread owning the
+ * OpenGL context, which is the only one allowed to upload them.
+ *
+ * Add all the paths first, identical paths are loaded only once. After start(), workers take
+ * paths one by one and push decoded images into a lock-free queue. The GL thread calls poll()
+ * between frames to upload what is ready, or finish() to wait for all of them. Uploading goes
+ * through a Sink, so that loading can be tested without a GL context.
+ *
+ * Images are flipped vertically on the worker, like Texture::load(const std::string&) does.
+ */
+class TextureLoader final
+{
+public:
+	/**
+	 * Receives decoded images on the polling thread.
+	 */
+	class Sink
+	{
+	public:
+		virtual ~Sink() = default;
+
+		/**
+		 * @param[in] index index returned by TextureLoader::add().
+		 * @param[in] path  image path.
+		 * @param[in] image decoded image, nullptr if decoding failed.
+		 * @return true if uploaded successfully, otherwise false.
+		 */
+		virtual bool upload(size_t index, const std::string& path, const std::shared_ptr<Image>& image) = 0;
+	};
+
+	/**
+	 * Creates a Texture for each image. Must be used on the thread owning the OpenGL context.
+	 */
+	class TextureSink: public Sink
+	{
+	public:
+		Texture::Parameter parameter;
+		std::vector<std::shared_ptr<Texture>> textures;  ///< indexed as paths, nullptr if failed
+
+	public:
+		bool upload(size_t index, const std::string& path, const std::shared_ptr<Image>& image) override;
+	};
+
+	struct Record
+	{
+		std::string path;
+		double decodeTime;  ///< in seconds, on a worker thread
+		double uploadTime;  ///< in seconds, on the polling thread
+		bool success;
+	};
+
+private:
+	struct Item
+	{
+		size_t index;
+		std::shared_ptr<Image> image;
+	};
+
+	uint32_t threadCount;
+	std::vector<std::thread> workers;
+	std::unique_ptr<LockFreeQueue<Item>> queue;
+	std::atomic<size_t> next;  ///< next path to decode
+
+	std::unordered_map<std::string, size_t> indices;
+	std::vector<Record> records;
+	size_t uploadCount;
+
+private:
+	void decode();
+	void join();
+
+public:
+	/**
+	 * @param[in] threadCount worker count, 0 to use all the hardware threads.
+	 */
+	explicit TextureLoader(uint32_t threadCount = 0);
+	~TextureLoader();
+
+	TextureLoader(const TextureLoader&) = delete;
+	TextureLoader& operator =(const TextureLoader&) = delete;
+
+	/**
+	 * Queue an image file, can only be called before start().
+	 * @return index of the path, the same index for the same path.
+	 */
+	size_t add(const std::string& path);
+
+	/**
+	 * Start decoding on worker threads.
+	 */
+	void start();
+
+	/**
+	 * Upload the images decoded so far, without waiting for others.
+	 * @param[in] sink     upload sink.
+	 * @param[in] maxCount upload at most this many images in this call, to bound frame time.
+	 * @return count of images handed to sink.
+	 */
+	size_t poll(Sink& sink, size_t maxCount = SIZE_MAX);
+
+	/**
+	 * Upload all the images, waiting for workers if needed.
+	 */
+	void finish(Sink& sink);
+
+	/**
+	 * @return true if every image is handed to the sink.
+	 */
+	bool isDone() const;
+
+	size_t getSize() const;
+
+	/**
+	 * @return decode and upload timings, in the order of add().
+	 */
+	const std::vector<Record>& getRecords() const;
+};
+
+inline bool TextureLoader::isDone() const { return uploadCount == records.size(); }
+inline size_t TextureLoader::getSize() const { return records.size(); }
+inline const std::vector<TextureLoader::Record>& TextureLoader::getRecords() const { return records; }
+
+}  // namespace pea
+#endif  // PEA_IO_TEXTURE_LOADER_H_
@@ -32,6 +32,22 @@ T log2i(T x)
 #endif
 }
 
+/**
+ * Integrate f over [a, b] by 5 point Gauss-Legendre quadrature, which is exact for polynomials of
+ * degree 9 or less, e.g. it measures smooth curves in a few evaluations.
+ */
+template <typename F>
+float integrateGaussLegendre(const F& f, float a, float b)
+{
+	constexpr float x[5] = { 0.0F, -0.5384693101056831F, 0.5384693101056831F, -0.9061798459386640F, 0.9061798459386640F };
+	constexpr float w[5] = { 0.5688888888888889F, 0.4786286704993665F, 0.4786286704993665F, 0.2369268850561891F, 0.2369268850561891F };
+	const float half = (b - a) * 0.5F, middle = (a + b) * 0.5F;
+	float sum = 0;
+	for(int32_t i = 0; i < 5; ++i)
+		sum += w[i] * f(middle + half * x[i]);
+	return sum * half;
+}
+
 /**
  * use std::pow for float exponent, use pea::pow for integer exponent.
  */
@@ -223,6 +223,52 @@ public:
 		return !(q1 == q2);
 	}
 	
+	/**
+	 * Build a unit quaternion from the columns of a rotation matrix, which must be orthonormal.
+	 * see Ken Shoemake, Animating Rotation with Quaternion Curves.
+	 */
+	static quaternion<T> fromBasis(const vec3<T>& c0, const vec3<T>& c1, const vec3<T>& c2)
+	{
+		// R[row][column] = c[column][row]
+		const T trace = c0.x + c1.y + c2.z;
+		T _x, _y, _z, _w;
+		if(trace > 0)
+		{
+			T s = std::sqrt(trace + 1) * 2;
+			_w = s / 4;
+			_x = (c1.z - c2.y) / s;
+			_y = (c2.x - c0.z) / s;
+			_z = (c0.y - c1.x) / s;
+		}
+		else if(c0.x > c1.y && c0.x > c2.z)
+		{
+			T s = std::sqrt(1 + c0.x - c1.y - c2.z) * 2;
+			_w = (c1.z - c2.y) / s;
+			_x = s / 4;
+			_y = (c1.x + c0.y) / s;
+			_z = (c2.x + c0.z) / s;
+		}
+		else if(c1.y > c2.z)
+		{
+			T s = std::sqrt(1 + c1.y - c0.x - c2.z) * 2;
+			_w = (c2.x - c0.z) / s;
+			_x = (c1.x + c0.y) / s;
+			_y = s / 4;
+			_z = (c2.y + c1.z) / s;
+		}
+		else
+		{
+			T s = std::sqrt(1 + c2.z - c0.x - c1.y) * 2;
+			_w = (c0.y - c1.x) / s;
+			_x = (c2.x + c0.z) / s;
+			_y = (c2.y + c1.z) / s;
+			_z = s / 4;
+		}
+
+		quaternion<T> q(_x, _y, _z, _w);
+		return q.normalize();
+	}
+
 	/**
 	 * cast a quaternion to 3x3 matrix.
 	 * @param[out] a          Address of a mat3 matrix.
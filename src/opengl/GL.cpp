@@ -170,6 +170,11 @@ GLenum GL::pixelFormat(Color::Format format)
 	// not available in core profile. They have been replaced by the GL_RED texture format.
 //	return GL_LUMINANCE;
 //	return GL_LUMINANCE_ALPHA;
+	if(format == Color::BGR888_U24)
+		return GL_BGR;
+	if(format == Color::BGRA8888_U32)
+		return GL_BGRA;
+	
 	uint32_t c = Color::sizeofChannel(format) - 1;  // make it zero indexed
 	GLenum pixelFormats_f[4] = {GL_RED, GL_RG, GL_RGB, GL_RGBA};
 	return pixelFormats_f[c];
@@ -194,6 +199,8 @@ GLenum GL::dataType(Color::Format format)
 	case Color::C2_U8:
 	case Color::C3_U8:
 	case Color::C4_U8:
+	case Color::BGR888_U24:
+	case Color::BGRA8888_U32:
 		return GL_UNSIGNED_BYTE;
 		
 	case Color::C1_U16:
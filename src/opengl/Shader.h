@@ -80,6 +80,7 @@ public:
 		UNIFORM_FLT_FACTOR        = 11,
 		UNIFORM_FLT_LENGTH        = 11,
 		UNIFORM_FLT_RADIUS        = 11,
+		UNIFORM_FLT_RANGE         = 11,  // distance range of signed distance field
 		UNIFORM_FLT_RATIO         = 11,
 		UNIFORM_FLT_ETA           = 11,  // float ior;  // index of reflection
 		UNIFORM_FLT_SCALE         = 11,
@@ -179,6 +179,9 @@ static std::unordered_map<ShaderFactory::Index, const char*> createIndexNameMap(
 	;
 	map[ShaderFactory::FRAG_TEXTURE_FONT] =
 #include "./shader/texture_font.frag"
+	;
+	map[ShaderFactory::FRAG_TEXTURE_FONT_SDF] =
+#include "./shader/texture_font_sdf.frag"
 	;
 	map[ShaderFactory::FRAG_TEXTURE_CUBE] =
 #include "./shader/textureCube.frag"
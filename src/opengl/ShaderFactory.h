@@ -90,6 +90,7 @@ public:
 		FRAG_TEXTURE_RGBA_ALPHA,
 		FRAG_TEXTURE_DEPTH,
 		FRAG_TEXTURE_FONT,
+		FRAG_TEXTURE_FONT_SDF,  // float range, single or multichannel signed distance field
 		FRAG_TEXTURE_CUBE,
 		FRAG_TEXTURE_BLEND,
 		FRAG_TEXTURE_3D,  // sampler3D
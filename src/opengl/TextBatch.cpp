@@ -0,0 +1,182 @@
+#include "opengl/TextBatch.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "opengl/GL.h"
+#include "opengl/Program.h"
+#include "opengl/Shader.h"
+#include "scene/Camera.h"
+#include "util/Log.h"
+
+using namespace pea;
+
+static const char* TAG = "TextBatch";
+
+static constexpr int32_t textureUnit = 0;
+
+TextBatch::TextBatch(size_t maxGlyphCount/* = 16384 */):
+		capacity(std::max<size_t>(maxGlyphCount, 1) * 6),
+		region(0),
+		mapping(nullptr),
+		fences{},
+		vao(0),
+		vbo(0),
+		program(0)
+{
+	glGenVertexArrays(1, &vao);
+	glGenBuffers(1, &vbo);
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	
+	if(GL::checkExtension("GL_ARB_buffer_storage"))
+	{
+		// The GPU reads one region while we write the next, coherent mapping needs no flush.
+		constexpr GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		const GLsizeiptr size = REGION_COUNT * capacity * sizeof(Vertex);
+		glBufferStorage(GL_ARRAY_BUFFER, size, nullptr, flags);
+		mapping = static_cast<Vertex*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags));
+	}
+	if(!mapping)
+		slog.d(TAG, "persistent mapping is not supported, buffer is orphaned instead");
+	
+	TextureFont::setVertexFormat();
+	glBindVertexArray(0);
+	
+	program = TextureFont::createProgram();
+}
+
+TextBatch::~TextBatch()
+{
+	for(void*& fence: fences)
+		if(fence)
+			glDeleteSync(static_cast<GLsync>(fence));
+	
+	if(mapping)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+	}
+	glDeleteProgram(program);
+	glDeleteBuffers(1, &vbo);
+	glDeleteVertexArrays(1, &vao);
+}
+
+void TextBatch::setWindowSize(int32_t width, int32_t height)
+{
+	assert(width > 0 && height > 0);
+	projection = Camera::ortho(0.0F, width, 0.0F, height);
+}
+
+void TextBatch::drawText(TextureFont& font, const std::string& text, const vec2f& position, const Paint& paint)
+{
+	auto it = std::find_if(slots.begin(), slots.end(), [&font](const Slot& slot) { return slot.font == &font; });
+	if(it == slots.end())
+	{
+		// a frame of glyphs starts here, immediate draws of font until flush() won't evict them.
+		font.beginFrame();
+		slots.push_back(Slot{&font, true, {}});
+		it = slots.end() - 1;
+	}
+	else if(!it->used)
+	{
+		font.beginFrame();
+		it->used = true;
+	}
+	
+	font.appendText(text, position, paint, it->pages);
+}
+
+TextBatch::Vertex* TextBatch::acquire()
+{
+	if(!mapping)
+	{
+		// orphan the storage, the driver hands out a new one while the GPU reads the old.
+		glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(Vertex), nullptr, GL_STREAM_DRAW);
+		return nullptr;
+	}
+	
+	GLsync& fence = reinterpret_cast<GLsync&>(fences[region]);
+	if(fence)
+	{
+		// rarely waits, only if the GPU is REGION_COUNT - 1 frames behind.
+		GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		while(result == GL_TIMEOUT_EXPIRED)
+			result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);  // 1ms
+		if(result == GL_WAIT_FAILED)
+			slog.w(TAG, "failed to wait for region %u", region);
+		glDeleteSync(fence);
+		fence = nullptr;
+	}
+	return mapping + region * capacity;
+}
+
+void TextBatch::release()
+{
+	if(!mapping)
+		return;
+	
+	fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	region = (region + 1) % REGION_COUNT;
+}
+
+void TextBatch::flush()
+{
+	glUseProgram(program);
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	Program::setUniform(Shader::UNIFORM_TEX_TEXTURE0, textureUnit);
+	Program::setUniform(Shader::UNIFORM_MAT_PROJECTION, projection);
+	glActiveTexture(GL_TEXTURE0 + textureUnit);
+	
+	Vertex* base = nullptr;
+	bool acquired = false;
+	size_t offset = capacity;  // acquire a region on the first draw
+	for(Slot& slot: slots)
+	{
+		if(!slot.used)
+			continue;
+		
+		for(uint32_t page = 0; page < slot.pages.size(); ++page)
+		{
+			std::vector<Vertex>& vertices = slot.pages[page];
+			if(vertices.empty())
+				continue;
+			
+			glBindTexture(GL_TEXTURE_2D, slot.font->getTexture(page));
+			// vertices of a page larger than a region are drawn in several calls, both sizes are
+			// multiples of 6, so are the chunks.
+			for(size_t i = 0; i < vertices.size();)
+			{
+				if(offset == capacity)
+				{
+					if(acquired)
+						release();
+					base = acquire();
+					acquired = true;
+					offset = 0;
+				}
+				
+				const size_t count = std::min(vertices.size() - i, capacity - offset);
+				if(mapping)
+					std::memcpy(base + offset, vertices.data() + i, count * sizeof(Vertex));
+				else
+					glBufferSubData(GL_ARRAY_BUFFER, offset * sizeof(Vertex), count * sizeof(Vertex), vertices.data() + i);
+				
+				const size_t first = (mapping? region * capacity: 0) + offset;
+				glDrawArrays(GL_TRIANGLES, first, count);
+				offset += count;
+				i += count;
+			}
+			vertices.clear();
+		}
+		
+		// keep slot and its capacity for the next frame.
+		slot.used = false;
+	}
+	
+	if(acquired)
+		release();
+	glBindVertexArray(0);
+}
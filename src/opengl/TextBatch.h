@@ -0,0 +1,87 @@
+#ifndef PEA_OPENGL_TEXT_BATCH_H_
+#define PEA_OPENGL_TEXT_BATCH_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "graphics/Paint.h"
+#include "math/mat3.h"
+#include "math/vec2.h"
+#include "opengl/TextureFont.h"
+
+namespace pea {
+
+/**
+ * @class TextBatch
+ * Collect texts of a frame and draw them together, with one draw call for each atlas page of each
+ * font, instead of one upload and several draws per text.
+ *
+ * Vertices are streamed through a persistently mapped buffer of several regions, so that writing
+ * a frame doesn't wait for the GPU reading the previous ones. A fence guards each region. Without
+ * GL_ARB_buffer_storage, the buffer is orphaned and updated by glBufferSubData instead.
+ *
+ * @code
+ *   batch.drawText(font, "FPS 60", vec2f(8, 8), paint);
+ *   ...  // hundreds of labels
+ *   batch.flush();
+ * @endcode
+ */
+class TextBatch
+{
+public:
+	using Vertex = TextureFont::Vertex;
+
+private:
+	static constexpr uint32_t REGION_COUNT = 3;
+	
+	struct Slot
+	{
+		TextureFont* font;
+		bool used;  ///< in this frame
+		std::vector<std::vector<Vertex>> pages;  ///< vertices of each atlas page, kept for capacity
+	};
+	
+	std::vector<Slot> slots;  ///< fonts used so far
+	
+	size_t capacity;  ///< vertices of a region
+	uint32_t region;
+	Vertex* mapping;  ///< nullptr if buffer isn't mapped persistently
+	void* fences[REGION_COUNT];
+	
+	uint32_t vao;
+	uint32_t vbo;
+	uint32_t program;
+	mat3f projection;
+	
+private:
+	Vertex* acquire();
+	void release();
+	
+public:
+	/**
+	 * @param[in] maxGlyphCount glyphs drawn per flush without splitting draws, 6 vertices each.
+	 */
+	explicit TextBatch(size_t maxGlyphCount = 16384);
+	~TextBatch();
+	
+	TextBatch(const TextBatch& other) = delete;
+	TextBatch& operator =(const TextBatch& other) = delete;
+	
+	void setWindowSize(int32_t width, int32_t height);
+	
+	/**
+	 * Queue text to be drawn by flush(), with the line height of font at the time of this call.
+	 * @param[in] font     outlives this batch.
+	 * @param[in] position where the baseline starts.
+	 */
+	void drawText(TextureFont& font, const std::string& text, const vec2f& position, const Paint& paint);
+	
+	/**
+	 * Draw texts queued since the last flush, in order of fonts first used.
+	 */
+	void flush();
+};
+
+}  // namespace pea
+#endif  // PEA_OPENGL_TEXT_BATCH_H_
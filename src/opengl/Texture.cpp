@@ -1,5 +1,6 @@
 #include "opengl/Texture.h"
 
+#include <algorithm>
 #include <cinttypes>
 #include <cstring>
 
@@ -92,13 +93,15 @@ uint32_t Texture::getKey(uint32_t index) const
 
 bool Texture::load(const std::string& path)
 {
-	std::shared_ptr<Image> image = ImageFactory::decodeFile(path);
+	// uncompressed files are uploaded right from the mapping, bottom-up ones as they are.
+	std::shared_ptr<Image> image = ImageFactory::decodeFile(path, true);
 	if(!image)
 	{
 		slog.e(TAG, "failed to load image (%s)", path.c_str());
 		return false;
 	}
-	image->flipVertical();
+	if(!image->isBottomUp())
+		image->flipVertical();
 //	assert(image->getColorFormat() == Color::RGBA_8888);
 	return load(*image);
 }
@@ -113,6 +116,7 @@ bool Texture::load(const Image& image)
 	Color::Format colorFormat = image.getColorFormat();
 	GLenum format = GL::pixelFormat(colorFormat);
 	GLenum type   = GL::dataType(colorFormat);
+	GLint internalFormat = format == GL_BGR? GL_RGB: format == GL_BGRA? GL_RGBA: format;
 	
 	GLsizei width  = image.getWidth();
 	GLsizei height = image.getHeight();
@@ -136,9 +140,9 @@ bool Texture::load(const Image& image)
 	// should glTexParameteri come before or after glTexImage2D?
 	// https://community.khronos.org/t/gltexparameteri-before-glteximage2d/23056
 	if(target == GL_TEXTURE_2D || target == GL_TEXTURE_RECTANGLE)
-		glTexImage2D(target, level, format, width, height, border, format, type, pixels);
+		glTexImage2D(target, level, internalFormat, width, height, border, format, type, pixels);
 	else if(target == GL_TEXTURE_1D)
-		glTexImage1D(target, level, format, std::max(width, height), border, format, type, pixels);
+		glTexImage1D(target, level, internalFormat, std::max(width, height), border, format, type, pixels);
 //	else if(target == GL_TEXTURE_3D)
 //		glTexImage3D(target, level, format, width, height, depth, border, format, type, pixels);
 	else
@@ -182,6 +186,15 @@ bool Texture::loadLevel(uint32_t levelCount, int32_t width, int32_t height, Colo
 	return true;
 }
 
+bool Texture::load(const Mipmap& mipmap)
+{
+	if(mipmap.getLevelCount() == 0)
+		return false;
+	
+	return loadLevel(mipmap.getLevelCount(), mipmap.getWidth(), mipmap.getHeight(),
+			mipmap.getColorFormat(), mipmap.getData());
+}
+
 bool Texture::load(int32_t width, int32_t height, int32_t depth, Color::Format format, const void* data)
 {
 	assert(target == GL_TEXTURE_3D);
@@ -343,206 +356,130 @@ void Texture::attachBuffer(pea::Type type, uint32_t buffer)
 	glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
 }
 
-static const uint8_t KTX_MAGIC[] =
-{
-	0xAB, 'k', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'
-};
-
-struct KTX_Header
-{
-	uint8_t  identifier[12];
-	uint32_t endianness;
-	uint32_t glType;
-	uint32_t glTypeSize;
-	uint32_t glFormat;
-	uint32_t glInternalFormat;
-	uint32_t glBaseInternalFormat;
-	uint32_t pixelWidth;
-	uint32_t pixelHeight;
-	uint32_t pixelDepth;
-	uint32_t numberOfArrayElements;
-	uint32_t numberOfFaces;
-	uint32_t numberOfMipmapLevels;
-	uint32_t bytesOfKeyValueData;
-};
-
-static void swap32(uint32_t& qword)
-{
-	uint8_t* bytes = reinterpret_cast<uint8_t*>(&qword);
-	std::swap(bytes[0], bytes[3]);
-	std::swap(bytes[1], bytes[2]);
-}
-
-static uint32_t align(uint32_t value, uint32_t padding = 4)
+bool Texture::load(const KTX& ktx, bool generateMipmap/* = true */)
 {
-	uint32_t mask = padding - 1;
-	return (value + mask) & ~mask;
-}
-	
-bool Texture::loadKTX(const std::string& path)
-{
-	KTX_Header header;
-	
-	std::unique_ptr<FILE, decltype(&std::fclose)> file(std::fopen(path.c_str(), "rb"), &std::fclose);
-	if(!file)
-	{
-		slog.w(TAG, "can't open file %s for writing", path.c_str());
-		return false;
-	}
-	
-	FILE* fp = file.get();
-	if(std::fread(&header, sizeof(header), 1, fp) != 1)
-		return false;
-	
-	if(std::memcmp(header.identifier, KTX_MAGIC, sizeof(KTX_MAGIC)) != 0)
+	if(!ktx.isValid() || ktx.getGLInternalFormat() == 0)
 		return false;
-	
-	constexpr uint32_t KTX_LITTLE_ENDIAN = 0x04030201;
-	constexpr uint32_t KTX_BIG_ENDIAN    = 0x01020304;
-	if(header.endianness == KTX_LITTLE_ENDIAN)
-	{
-	}
-	else if(header.endianness == KTX_BIG_ENDIAN)
-	{
-		swap32(header.endianness);
-		swap32(header.glType);
-		swap32(header.glTypeSize);
-		swap32(header.glFormat);
-		swap32(header.glInternalFormat);
-		swap32(header.glBaseInternalFormat);
-		swap32(header.pixelWidth);
-		swap32(header.pixelHeight);
-		swap32(header.pixelDepth);
-		swap32(header.numberOfArrayElements);
-		swap32(header.numberOfFaces);
-		swap32(header.numberOfMipmapLevels);
-		swap32(header.bytesOfKeyValueData);
-	}
+
+	const uint32_t layerCount = std::max(ktx.getLayerCount(), 1U);
+	const uint32_t faceCount = ktx.getFaceCount();
+	if(ktx.is3D())
+		target = GL_TEXTURE_3D;
+	else if(ktx.isCube())
+		target = ktx.isArray()? GL_TEXTURE_CUBE_MAP_ARRAY: GL_TEXTURE_CUBE_MAP;
+	else if(ktx.getHeight() <= 1)
+		target = ktx.isArray()? GL_TEXTURE_1D_ARRAY: GL_TEXTURE_1D;
 	else
+		target = ktx.isArray()? GL_TEXTURE_2D_ARRAY: GL_TEXTURE_2D;
+
+	const GLenum internalFormat = ktx.getGLInternalFormat();
+	const GLenum format = ktx.getGLFormat();
+	const GLenum type = ktx.getGLType();
+	const bool compressed = ktx.isCompressed();
+	const GLsizei levelCount = ktx.getLevelCount();
+	const KTX::Level& base = ktx.getLevel(0);
+
+	// a single level of uncompressed pixels gets the rest of the chain generated.
+	GLsizei storageLevelCount = levelCount;
+	generateMipmap = generateMipmap && levelCount == 1 && !compressed;
+	if(generateMipmap)
 	{
-		slog.e(TAG, "unknown endianness %08X", header.endianness);
-		return false;
-	}
-	
-	GLenum target = GL_NONE;
-	if(header.pixelHeight == 0)
-	{
-		if(header.numberOfArrayElements == 0)
-			target = GL_TEXTURE_1D;
-		else
-			target = GL_TEXTURE_1D_ARRAY;
+		uint32_t size = base.width;
+		if(target != GL_TEXTURE_1D && target != GL_TEXTURE_1D_ARRAY)
+			size = std::max(size, base.height);
+		if(target == GL_TEXTURE_3D)
+			size = std::max(size, base.depth);
+		while(size >>= 1)
+			++storageLevelCount;
 	}
-	else if(header.pixelDepth == 0)
+
+	// pixels go from the mapping as they are, rows stay in the order the file has.
+	glBindTexture(target, name);
+	GLint unpackAlignment;
+	glGetIntegerv(GL_UNPACK_ALIGNMENT, &unpackAlignment);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, ktx.getRowAlignment());
+	switch(target)
 	{
-		if(header.numberOfArrayElements == 0)
-		{
-			if(header.numberOfFaces == 0)
-				target = GL_TEXTURE_2D;
-			else
-				target = GL_TEXTURE_CUBE_MAP;
-		}
-		else
-		{
-			if(header.numberOfFaces == 0)
-				target = GL_TEXTURE_2D_ARRAY;
-			else
-				target = GL_TEXTURE_CUBE_MAP_ARRAY;
-		}
+	case GL_TEXTURE_1D:       glTexStorage1D(target, storageLevelCount, internalFormat, base.width); break;
+	case GL_TEXTURE_1D_ARRAY: glTexStorage2D(target, storageLevelCount, internalFormat, base.width, layerCount); break;
+	case GL_TEXTURE_2D:
+	case GL_TEXTURE_CUBE_MAP: glTexStorage2D(target, storageLevelCount, internalFormat, base.width, base.height); break;
+	case GL_TEXTURE_3D:       glTexStorage3D(target, storageLevelCount, internalFormat, base.width, base.height, base.depth); break;
+	default:                  glTexStorage3D(target, storageLevelCount, internalFormat, base.width, base.height, layerCount * faceCount); break;
 	}
-	else
-		target = GL_TEXTURE_3D;
-	
-	if(target == GL_NONE ||
-			header.pixelWidth == 0 ||  // Texture has no width?
-			(header.pixelHeight == 0 && header.pixelDepth != 0))  // Texture has depth but no height?
-		return false;
-	
-	glBindTexture(target, name);
-
-	size_t dataStart = std::ftell(fp) + header.bytesOfKeyValueData;
-	std::fseek(fp, 0, SEEK_END);
-	size_t dataEnd = std::ftell(fp);
-	fseek(fp, dataStart, SEEK_SET);
 
-	const size_t length = dataEnd - dataStart;
-	std::vector<uint8_t> memory(length);
-	std::fread(memory.data(), 1, length, fp);
-	const uint8_t* data = memory.data();
-	
-	if(header.numberOfMipmapLevels == 0)
-		header.numberOfMipmapLevels = 1;
-
-	switch (target)
+	for(GLsizei level = 0; level < levelCount; ++level)
 	{
-	case GL_TEXTURE_1D:
-		glTexStorage1D(GL_TEXTURE_1D, header.numberOfMipmapLevels, header.glInternalFormat, header.pixelWidth);
-		glTexSubImage1D(GL_TEXTURE_1D, 0, 0, header.pixelWidth, header.glFormat, header.glInternalFormat, data);
-		break;
-	
-	case GL_TEXTURE_2D:
-		if(header.glType == GL_NONE)
-			glCompressedTexImage2D(GL_TEXTURE_2D, 0, header.glInternalFormat, header.pixelWidth, header.pixelHeight, 0, 420 * 380 / 2, data);
-		else
-		{
-			glTexStorage2D(GL_TEXTURE_2D, header.numberOfMipmapLevels, header.glInternalFormat, header.pixelWidth, header.pixelHeight);
-			
-			uint32_t channelCount = GL::sizeofChannel(header.glInternalFormat);
-			uint32_t height = header.pixelHeight;
-			uint32_t width = header.pixelWidth;
-			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-			for(uint32_t i = 0; i < header.numberOfMipmapLevels; ++i)
+		const KTX::Level& l = ktx.getLevel(level);
+		const GLsizei width = l.width, height = l.height, depth = l.depth, imageSize = l.imageSize;
+		for(uint32_t layer = 0; layer < layerCount; ++layer)
+			for(uint32_t face = 0; face < faceCount; ++face)
 			{
-				glTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, width, height, header.glFormat, header.glType, data);
-				data += height * header.glTypeSize * channelCount * width;
-				if(height > 1)
-					height >>= 1;
-				if(width > 1)
-					width >>= 1;
+				const void* pixels = ktx.getData(level, layer, face);
+				switch(target)
+				{
+				case GL_TEXTURE_1D:
+					if(compressed)
+						glCompressedTexSubImage1D(target, level, 0, width, internalFormat, imageSize, pixels);
+					else
+						glTexSubImage1D(target, level, 0, width, format, type, pixels);
+					break;
+				case GL_TEXTURE_1D_ARRAY:
+					if(compressed)
+						glCompressedTexSubImage2D(target, level, 0, layer, width, 1, internalFormat, imageSize, pixels);
+					else
+						glTexSubImage2D(target, level, 0, layer, width, 1, format, type, pixels);
+					break;
+				case GL_TEXTURE_2D:
+				case GL_TEXTURE_CUBE_MAP:
+				{
+					// cube faces are in GL_TEXTURE_CUBE_MAP_POSITIVE_X, NEGATIVE_X, ... order.
+					const GLenum image = target == GL_TEXTURE_2D? GL_TEXTURE_2D: GL_TEXTURE_CUBE_MAP_POSITIVE_X + face;
+					if(compressed)
+						glCompressedTexSubImage2D(image, level, 0, 0, width, height, internalFormat, imageSize, pixels);
+					else
+						glTexSubImage2D(image, level, 0, 0, width, height, format, type, pixels);
+					break;
+				}
+				case GL_TEXTURE_3D:
+					if(compressed)
+						glCompressedTexSubImage3D(target, level, 0, 0, 0, width, height, depth, internalFormat, imageSize, pixels);
+					else
+						glTexSubImage3D(target, level, 0, 0, 0, width, height, depth, format, type, pixels);
+					break;
+				default:
+				{
+					const GLint z = layer * faceCount + face;
+					if(compressed)
+						glCompressedTexSubImage3D(target, level, 0, 0, z, width, height, 1, internalFormat, imageSize, pixels);
+					else
+						glTexSubImage3D(target, level, 0, 0, z, width, height, 1, format, type, pixels);
+					break;
+				}
+				}
 			}
-			
-		}
-		break;
+	}
 
-	case GL_TEXTURE_3D:
-		glTexStorage3D(GL_TEXTURE_3D, header.numberOfMipmapLevels, header.glInternalFormat, header.pixelWidth, header.pixelHeight, header.pixelDepth);
-		glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, header.pixelWidth, header.pixelHeight, header.pixelDepth, header.glFormat, header.glType, data);
-		break;
-	
-	case GL_TEXTURE_1D_ARRAY:
-		glTexStorage2D(GL_TEXTURE_1D_ARRAY, header.numberOfMipmapLevels, header.glInternalFormat, header.pixelWidth, header.numberOfArrayElements);
-		glTexSubImage2D(GL_TEXTURE_1D_ARRAY, 0, 0, 0, header.pixelWidth, header.numberOfArrayElements, header.glFormat, header.glType, data);
-		break;
-	
-	case GL_TEXTURE_2D_ARRAY:
-		glTexStorage3D(GL_TEXTURE_2D_ARRAY, header.numberOfMipmapLevels, header.glInternalFormat, header.pixelWidth, header.pixelHeight, header.numberOfArrayElements);
-		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, header.pixelWidth, header.pixelHeight, header.numberOfArrayElements, header.glFormat, header.glType, data);
-		break;
+	glPixelStorei(GL_UNPACK_ALIGNMENT, unpackAlignment);
+	if(generateMipmap)
+		glGenerateMipmap(target);
+	glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, storageLevelCount - 1);
+	return true;
+}
 
-	case GL_TEXTURE_CUBE_MAP:
-		glTexStorage2D(GL_TEXTURE_CUBE_MAP, header.numberOfMipmapLevels, header.glInternalFormat, header.pixelWidth, header.pixelHeight);
-		{
-			uint32_t channelCount = GL::sizeofChannel(header.glInternalFormat);
-			uint32_t faceSize = align(header.glTypeSize * channelCount * header.pixelWidth, 4) * header.pixelHeight;
-			for(uint32_t i = 0; i < header.numberOfFaces; ++i)
-				glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, 0, 0, header.pixelWidth, header.pixelHeight, header.glFormat, header.glType, data + faceSize * i);
-	
-		}
-		break;
-	
-	case GL_TEXTURE_CUBE_MAP_ARRAY:
-		glTexStorage3D(GL_TEXTURE_CUBE_MAP_ARRAY, header.numberOfMipmapLevels, header.glInternalFormat, header.pixelWidth, header.pixelHeight, header.numberOfArrayElements);
-		glTexSubImage3D(GL_TEXTURE_CUBE_MAP_ARRAY, 0, 0, 0, 0, header.pixelWidth, header.pixelHeight, header.numberOfFaces * header.numberOfArrayElements, header.glFormat, header.glType, data);
-	break;
-	
-	default:
-		assert(false);  // should never happen.
+bool Texture::loadKTX(const std::string& path, bool* topDown/* = nullptr */, bool generateMipmap/* = true */)
+{
+	// pixels are uploaded right from the mapped file.
+	KTX ktx;
+	if(!ktx.open(path))
+	{
+		slog.w(TAG, "failed to load KTX file %s", path.c_str());
 		return false;
 	}
-	
-	if(header.numberOfMipmapLevels == 1)
-		glGenerateMipmap(target);
-
-	return true;
+	if(topDown != nullptr)
+		*topDown = !ktx.isCube() && !ktx.isBottomUp();
+	return load(ktx, generateMipmap);
 }
 
 void Texture::bind() const
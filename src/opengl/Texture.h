@@ -4,6 +4,8 @@
 #include <memory>
 
 #include "graphics/Image.h"
+#include "graphics/KTX.h"
+#include "graphics/Mipmap.h"
 #include "io/Type.h"
 #include "math/vec2.h"
 
@@ -168,6 +170,12 @@ public:
 	 */
 	bool loadLevel(uint32_t levelCount, int32_t width, int32_t height, Color::Format colorFormat, const void* data);
 	
+	/**
+	 * Load a mipmap chain generated on CPU, all levels at once.
+	 * @see loadLevel
+	 */
+	bool load(const Mipmap& mipmap);
+	
 	/**
 	 * Used to load 3D textures.
 	 */
@@ -199,10 +207,29 @@ public:
 	 */
 	void attachBuffer(pea::Type type, uint32_t buffer);
 	
+	/**
+	 * Upload all levels, layers and faces of a KTX texture with immutable storage. Target becomes
+	 * GL_TEXTURE_1D, GL_TEXTURE_2D, GL_TEXTURE_3D, GL_TEXTURE_CUBE_MAP or the array of the first
+	 * two or the last, as the texture tells; textures of height 1 are taken as 1D ones.
+	 *
+	 * Rows are uploaded in the order they're stored, with no copy. OpenGL takes the first row as
+	 * t = 0, so that 1D, 2D and 3D textures which aren't KTX::isBottomUp() are upside down, and
+	 * are sampled with t flipped.
+	 *
+	 * @param[in] generateMipmap if the texture has one level of uncompressed pixels, allocate the
+	 *                           full mipmap chain and generate it with glGenerateMipmap().
+	 */
+	bool load(const KTX& ktx, bool generateMipmap = true);
+
 	/**
 	 * KTX file format https://www.khronos.org/opengles/sdk/tools/KTX/file_format_spec/
+	 * KTX2 file format https://registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html
+	 * The file is mapped, pixels are uploaded from the mapped pages.
+	 * @param[out] topDown true if rows are uploaded upside down, texture coordinate t is to be
+	 *                     flipped then. Cube faces are top-down as OpenGL expects, so it's false.
+	 * @see load(const KTX&, bool)
 	 */
-	bool loadKTX(const std::string& path);
+	bool loadKTX(const std::string& path, bool* topDown = nullptr, bool generateMipmap = true);
 	
 	/**
 	 * Update texture data. It use gl*TexSubImage() to replace all or part of an existing texture
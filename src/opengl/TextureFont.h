@@ -2,9 +2,12 @@
 #define PEA_OPENGL_TEXTURE_FONT_H_
 
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "graphics/Paint.h"
 #include "graphics/Path.h"
+#include "graphics/TextLayoutCache.h"
 
 namespace pea {
 
@@ -41,12 +44,37 @@ namespace pea {
 				 |------------- advance_x ---------->|
 
 */
+
+/**
+ * @class TextureFont
+ * Draw UTF-8 text with glyphs of a texture atlas, which are rendered on demand by GlyphCache, and
+ * kerned by the font. Glyphs appear in the frame after they're first used, since they're rendered
+ * on a worker thread. Atlas pages are uploaded once, then only rectangles of new glyphs.
+ *
+ * Glyphs used in the current frame stay in the atlas. A frame starts with each drawText() until
+ * beginFrame() is called, then only with beginFrame(). TextBatch calls it, so that immediate draws
+ * of the same font in a frame don't evict glyphs the batch has queued.
+ */
 class TextureFont
 {
+public:
+	using Vertex = TextLayoutCache::Vertex;
+
 private:
 	class Impl;
 	std::unique_ptr<Impl> impl;
 	
+public:
+	/**
+	 * @return program drawing Vertex of glyph quads, with uniforms projection and texture0.
+	 */
+	static uint32_t createProgram();
+	
+	/**
+	 * Set attributes of Vertex to the array buffer bound, with the vertex array object bound.
+	 */
+	static void setVertexFormat();
+	
 public:
 	/**
 	 * @param[in] fontPath absolute path of a font, such as "/usr/share/fonts/truetype/freefont/FreeSans.ttf"
@@ -60,14 +88,38 @@ public:
 	void setWindowSize(int32_t width, int32_t height);
 
 	/**
-	 * @param[in] text
-	 * @param[in] position  bottom left position.
-	 * @param[in] color text color
-	 * @param[in] scale
+	 * @param[in] text      UTF-8 text, control characters are ignored.
+	 * @param[in] position  where the baseline starts.
+	 * @param[in] paint     text color, horizontal scale, and style of its typeface.
 	 */
 	void drawText(const std::string& text, const vec2f& position, const Paint& paint);
 	
 	void drawTextOnPath(const std::string& text, const Path& path, const Paint& paint);
+	
+	/**
+	 * Start a frame: glyphs used in earlier frames may be evicted from now on, and glyphs rendered
+	 * since the last upload are copied into atlas textures.
+	 */
+	void beginFrame();
+
+	/**
+	 * Copy glyphs rendered since the last call into atlas textures, drawText() calls it each time.
+	 * It starts a frame too, unless beginFrame() has ever been called.
+	 */
+	void upload();
+	
+	/**
+	 * Append glyph quads of text into vertices of atlas pages, with layouts cached.
+	 * @return false if some glyphs aren't rendered yet.
+	 * @see TextLayoutCache::append
+	 */
+	bool appendText(const std::string& text, const vec2f& position, const Paint& paint,
+			std::vector<std::vector<Vertex>>& pages);
+	
+	/**
+	 * @return texture of an atlas page, valid after upload().
+	 */
+	uint32_t getTexture(uint32_t page) const;
 };
 
 }  // namespace pea
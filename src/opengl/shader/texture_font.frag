@@ -1,8 +1,8 @@
 R""(
-layout(location = 4) uniform vec4 textColor;
 layout(location =16) uniform sampler2D texture0;
 
 in vec2 texcoord;
+in vec4 textColor;
 
 out vec4 fragColor;
 
@@ -2,8 +2,10 @@ R""(
 layout(location = 2) uniform mat3 projection;
 
 layout(location = 0) in vec4 vertex;
+layout(location = 1) in vec4 color;
 
 out vec2 texcoord;
+out vec4 textColor;
 
 void main()
 {
@@ -11,5 +13,6 @@ void main()
 //	gl_Position.xyw = position;
 	gl_Position = vec4(position.x, position.y, 0, position.z);
 	texcoord = vertex.zw;
+	textColor = color;
 }
 )""
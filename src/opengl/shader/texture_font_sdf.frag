@@ -0,0 +1,28 @@
+R""(
+layout(location =11) uniform float range;  // distance in texels between field values 0 and 1
+layout(location =16) uniform sampler2D texture0;
+
+in vec2 texcoord;
+in vec4 textColor;
+
+out vec4 fragColor;
+
+float median(float r, float g, float b)
+{
+	return max(min(r, g), min(max(r, g), b));
+}
+
+// Single channel fields are swizzled to (r, r, r), so that the median is r itself.
+void main()
+{
+	vec3 field = texture(texture0, texcoord).rgb;
+	float distance = median(field.r, field.g, field.b) - 0.5;
+	
+	// field range in screen pixels, anti-aliased over one pixel at any scale.
+	vec2 unitRange = vec2(range) / vec2(textureSize(texture0, 0));
+	vec2 screenTextureSize = vec2(1.0) / fwidth(texcoord);
+	float screenRange = max(0.5 * dot(unitRange, screenTextureSize), 1.0);
+	float alpha = clamp(screenRange * distance + 0.5, 0.0, 1.0);
+	fragColor = vec4(textColor.rgb, textColor.a * alpha);
+}
+)""
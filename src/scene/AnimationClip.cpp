@@ -0,0 +1,513 @@
+#include "scene/AnimationClip.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "pea/config.h"
+#if OpenMP_CXX_FOUND
+#include <omp.h>
+#endif
+
+#include "io/BioVisionHierarchy.h"
+#include "util/Log.h"
+
+using namespace pea;
+
+static const char* TAG = "AnimationClip";
+
+// smallest three components of a unit quaternion lie in [-1/sqrt(2), +1/sqrt(2)]
+static constexpr float QUATERNION_RANGE = 0.707106781186547524F;
+static constexpr float QUATERNION_SCALE = 32767.0F;  // 15 bits
+static constexpr float TRANSLATION_SCALE = 65535.0F;  // 16 bits
+
+// frame index of a key is stored in 16 bits
+static constexpr int32_t MAX_FRAME_COUNT = 65536;
+static constexpr int32_t MAX_ATTEMPT = 8;
+
+static quaternionf nlerp(const quaternionf& q0, const quaternionf& q1, float t)
+{
+	// q and -q are the same rotation, take the shorter arc.
+	const float s = dot(q0, q1) < 0? -t: t;
+	quaternionf q = (1 - t) * q0 + s * q1;
+	return q.normalize();
+}
+
+/**
+ * @return chord length that a point at distance radius from the joint moves, when rotated by q0
+ *         and by q1 respectively.
+ */
+static float rotationError(const quaternionf& q0, const quaternionf& q1, float radius)
+{
+	float cosine = std::abs(dot(q0, q1));
+	return 2 * radius * std::sqrt(std::max(0.0F, 1 - cosine * cosine));
+}
+
+static uint16_t quantize(float value, float min, float extent)
+{
+	if(extent <= 0)
+		return 0;
+	float x = pea::clamp((value - min) / extent, 0.0F, 1.0F);
+	return static_cast<uint16_t>(std::lround(x * TRANSLATION_SCALE));
+}
+
+static float dequantize(uint16_t value, float min, float extent)
+{
+	return min + value * (extent / TRANSLATION_SCALE);
+}
+
+static mat4f compose(const quaternionf& rotation, const vec3f& translation)
+{
+	// the same as BioVisionHierarchy, T * R
+	mat4f transform;
+	rotation.mat4_cast(transform.data());
+	transform[3] = vec4f(translation.x, translation.y, translation.z, 1.0F);
+	return transform;
+}
+
+static void decodeFrame(const BioVisionHierarchy& bvh, int32_t frame,
+		quaternionf* rotations, vec3f* translations)
+{
+	using Channel = BioVisionHierarchy::Channel;
+	static const vec3f AXES[3] = { vec3f(1, 0, 0), vec3f(0, 1, 0), vec3f(0, 0, 1) };
+
+	const float* values = bvh.values.data() + frame * bvh.valueCountPerFrame;
+	for(size_t j = 0, size = bvh.joints.size(); j < size; ++j)
+	{
+		const BioVisionHierarchy::Joint& joint = bvh.joints[j];
+		quaternionf rotation;
+		vec3f translation = joint.offset;
+		// channels Zrotation Xrotation Yrotation make R = Rz * Rx * Ry
+		for(const Channel& channel: joint.channels)
+		{
+			const float& value = *values++;
+			if(channel <= Channel::POSITION_Z)
+				translation[channel - Channel::POSITION_X] += value;
+			else
+				rotation *= quaternionf(AXES[channel - Channel::ROTATION_X], value);
+		}
+
+		rotations[j] = rotation;
+		translations[j] = translation;
+	}
+}
+
+static void computeGlobalPositions(const std::vector<int32_t>& parents,
+		const quaternionf* rotations, const vec3f* translations, mat4f* globals, vec3f* positions)
+{
+	for(size_t j = 0, size = parents.size(); j < size; ++j)
+	{
+		mat4f local = compose(rotations[j], translations[j]);
+		const int32_t& parent = parents[j];
+		assert(parent < static_cast<int32_t>(j));  // the order that BVH keeps.
+		globals[j] = parent >= 0? globals[parent] * local: local;
+
+		const vec4f& origin = globals[j][3];
+		positions[j] = vec3f(origin.x, origin.y, origin.z);
+	}
+}
+
+/**
+ * Greedy key frame reduction. A key is kept when the frames in between can no longer be
+ * interpolated from the previous key within tolerance.
+ *
+ * @param[in] raw       source value of each frame.
+ * @param[in] quantized value of each frame after quantization, that's what keys will hold.
+ * @return frame indices of the keys.
+ */
+template <typename T, typename Interpolate, typename Error>
+static std::vector<uint16_t> reduce(const std::vector<T>& raw, const std::vector<T>& quantized,
+		float tolerance, Interpolate interpolate, Error error)
+{
+	const int32_t size = static_cast<int32_t>(raw.size());
+	assert(size > 0 && quantized.size() == raw.size());
+
+	bool constant = true;
+	for(int32_t i = 0; i < size && constant; ++i)
+		constant = error(quantized[0], raw[i]) <= tolerance;
+	if(constant)
+		return std::vector<uint16_t>(1, 0);
+
+	std::vector<uint16_t> keys(1, 0);
+	int32_t start = 0, end = 2;
+	while(end < size)
+	{
+		bool fit = true;
+		const float span = static_cast<float>(end - start);
+		for(int32_t i = start + 1; i < end && fit; ++i)
+		{
+			T value = interpolate(quantized[start], quantized[end], (i - start) / span);
+			fit = error(value, raw[i]) <= tolerance;
+		}
+
+		if(fit)
+			++end;
+		else
+		{
+			start = end - 1;
+			keys.push_back(static_cast<uint16_t>(start));
+			end = start + 2;
+		}
+	}
+
+	// a single frame is one key, or locate() would divide by 0 between two keys at frame 0.
+	if(keys.back() != size - 1)
+		keys.push_back(static_cast<uint16_t>(size - 1));
+	return keys;
+}
+
+/**
+ * @param[in] frames key frame indices, in ascending order.
+ * @param[in] frame  fractional frame index.
+ * @param[out] alpha interpolation factor between the returned key and the next one.
+ * @return index of the key at or before frame.
+ */
+static size_t locate(const std::vector<uint16_t>& frames, float frame, float& alpha)
+{
+	const size_t size = frames.size();
+	if(size <= 1)
+	{
+		alpha = 0;
+		return 0;
+	}
+
+	auto it = std::upper_bound(frames.begin(), frames.end(), frame,
+			[](float f, uint16_t key) { return f < key; });
+	size_t next = std::clamp<size_t>(it - frames.begin(), 1, size - 1);
+	size_t index = next - 1;
+	alpha = (frame - frames[index]) / (frames[next] - frames[index]);
+	alpha = pea::clamp(alpha, 0.0F, 1.0F);
+	return index;
+}
+
+AnimationClip::AnimationClip():
+		frameCount(0),
+		frameTime(0),
+		rawSize(0)
+{
+}
+
+void AnimationClip::packQuaternion(const quaternionf& q, uint16_t packed[3])
+{
+	const float c[4] = { q.x, q.y, q.z, q.w };
+	uint16_t largest = 0;
+	for(uint16_t i = 1; i < 4; ++i)
+		if(std::abs(c[i]) > std::abs(c[largest]))
+			largest = i;
+
+	// q and -q are the same rotation, flip it so that the dropped component is positive.
+	const float sign = c[largest] < 0? -1.0F: 1.0F;
+	uint16_t v[3];
+	for(uint16_t i = 0, j = 0; i < 4; ++i)
+	{
+		if(i == largest)
+			continue;
+
+		float x = pea::clamp(c[i] * sign, -QUATERNION_RANGE, QUATERNION_RANGE);
+		x = (x + QUATERNION_RANGE) / (2 * QUATERNION_RANGE);
+		v[j++] = static_cast<uint16_t>(std::lround(x * QUATERNION_SCALE));
+	}
+
+	packed[0] = v[0] | ((largest & 0b10) << 14);
+	packed[1] = v[1] | ((largest & 0b01) << 15);
+	packed[2] = v[2];
+}
+
+quaternionf AnimationClip::unpackQuaternion(const uint16_t packed[3])
+{
+	const uint16_t largest = ((packed[0] >> 14) & 0b10) | (packed[1] >> 15);
+	constexpr float step = 2 * QUATERNION_RANGE / QUATERNION_SCALE;
+
+	float c[4];
+	float sum = 0;
+	for(uint16_t i = 0, j = 0; i < 4; ++i)
+	{
+		if(i == largest)
+			continue;
+
+		float x = (packed[j++] & 0x7FFF) * step - QUATERNION_RANGE;
+		c[i] = x;
+		sum += x * x;
+	}
+	c[largest] = std::sqrt(std::max(0.0F, 1 - sum));
+	return quaternionf(c[0], c[1], c[2], c[3]);
+}
+
+void AnimationClip::clear()
+{
+	names.clear();
+	parents.clear();
+	offsets.clear();
+	tracks.clear();
+	frameCount = 0;
+	frameTime = 0;
+	rawSize = 0;
+}
+
+bool AnimationClip::compress(const BioVisionHierarchy& bvh, float error/* = DEFAULT_ERROR */)
+{
+	assert(error > 0);
+	if(!bvh.hasHierarchyData() || !bvh.hasMotionData())
+	{
+		slog.w(TAG, "BVH has no hierarchy or motion data");
+		return false;
+	}
+
+	if(bvh.frameCount > MAX_FRAME_COUNT)
+	{
+		slog.e(TAG, "too many frames to compress. frameCount=%d, limit=%d", bvh.frameCount, MAX_FRAME_COUNT);
+		return false;
+	}
+
+	clear();
+	const int32_t jointCount = static_cast<int32_t>(bvh.joints.size());
+	frameCount = bvh.frameCount;
+	frameTime = bvh.frameTime;
+	assert(frameTime > 0);  // checked by hasMotionData()
+	rawSize = bvh.values.size() * sizeof(float);
+
+	names.reserve(jointCount);
+	parents.reserve(jointCount);
+	offsets.reserve(jointCount);
+	for(const BioVisionHierarchy::Joint& joint: bvh.joints)
+	{
+		names.push_back(joint.name);
+		parents.push_back(joint.parent);
+		offsets.push_back(joint.offset);
+	}
+
+	// frame major order for decoding, then transposed into one track per joint.
+	std::vector<quaternionf> frameRotations(frameCount * jointCount);
+	std::vector<vec3f> frameTranslations(frameCount * jointCount);
+	#pragma omp parallel for
+	for(int32_t f = 0; f < frameCount; ++f)
+		decodeFrame(bvh, f, &frameRotations[f * jointCount], &frameTranslations[f * jointCount]);
+
+	std::vector<std::vector<quaternionf>> rotations(jointCount, std::vector<quaternionf>(frameCount));
+	std::vector<std::vector<vec3f>> translations(jointCount, std::vector<vec3f>(frameCount));
+	#pragma omp parallel for
+	for(int32_t j = 0; j < jointCount; ++j)
+	{
+		for(int32_t f = 0; f < frameCount; ++f)
+		{
+			quaternionf q = frameRotations[f * jointCount + j];
+			// keep consecutive frames in the same hemisphere for interpolation.
+			if(f > 0 && dot(q, rotations[j][f - 1]) < 0)
+				q = -1.0F * q;
+			rotations[j][f] = q;
+			translations[j][f] = frameTranslations[f * jointCount + j];
+		}
+	}
+
+	// Rotation error is measured at the farthest descendant of a joint, a.k.a. its reach. Errors
+	// add up along a chain, so the budget is shared by the joints of the deepest chain.
+	std::vector<float> reaches(jointCount, 0.0F);
+	std::vector<int32_t> depths(jointCount, 1);
+	float minLength = std::numeric_limits<float>::max();
+	for(int32_t j = jointCount - 1; j >= 0; --j)
+	{
+		const float length = offsets[j].length();
+		if(length > 0)
+			minLength = std::min(minLength, length);
+
+		const int32_t& parent = parents[j];
+		if(parent >= 0)
+		{
+			reaches[parent] = std::max(reaches[parent], reaches[j] + length);
+			depths[parent] = std::max(depths[parent], depths[j] + 1);
+		}
+	}
+	if(minLength == std::numeric_limits<float>::max())
+		minLength = 1.0F;
+	for(float& reach: reaches)
+		reach = std::max(reach, minLength);
+
+	const int32_t maxDepth = *std::max_element(depths.begin(), depths.end());
+	float tolerance = error / maxDepth;
+	float measured = 0;
+	tracks.resize(jointCount);
+	for(int32_t attempt = 0; attempt < MAX_ATTEMPT; ++attempt)
+	{
+		#pragma omp parallel for
+		for(int32_t j = 0; j < jointCount; ++j)
+		{
+			Track& track = tracks[j];
+			const std::vector<quaternionf>& rawRotations = rotations[j];
+			const std::vector<vec3f>& rawTranslations = translations[j];
+
+			// rotation track
+			std::vector<uint16_t> packed(3 * frameCount);
+			std::vector<quaternionf> quantizedRotations(frameCount);
+			for(int32_t f = 0; f < frameCount; ++f)
+			{
+				packQuaternion(rawRotations[f], &packed[3 * f]);
+				quantizedRotations[f] = unpackQuaternion(&packed[3 * f]);
+			}
+
+			const float reach = reaches[j];
+			track.rotationFrames = reduce(rawRotations, quantizedRotations, tolerance, nlerp,
+					[reach](const quaternionf& q0, const quaternionf& q1) { return rotationError(q0, q1, reach); });
+
+			track.rotations.clear();
+			track.rotations.reserve(3 * track.rotationFrames.size());
+			for(const uint16_t& frame: track.rotationFrames)
+				track.rotations.insert(track.rotations.end(), &packed[3 * frame], &packed[3 * frame + 3]);
+
+			// translation track
+			vec3f min = rawTranslations[0], max = rawTranslations[0];
+			for(const vec3f& t: rawTranslations)
+				for(uint8_t c = 0; c < 3; ++c)
+				{
+					min[c] = std::min(min[c], t[c]);
+					max[c] = std::max(max[c], t[c]);
+				}
+			track.translationMin = min;
+			track.translationExtent = max - min;
+
+			const vec3f& extent = track.translationExtent;
+			std::vector<uint16_t> quantized(3 * frameCount);
+			std::vector<vec3f> quantizedTranslations(frameCount);
+			for(int32_t f = 0; f < frameCount; ++f)
+				for(uint8_t c = 0; c < 3; ++c)
+				{
+					uint16_t& q = quantized[3 * f + c];
+					q = quantize(rawTranslations[f][c], min[c], extent[c]);
+					quantizedTranslations[f][c] = dequantize(q, min[c], extent[c]);
+				}
+
+			track.translationFrames = reduce(rawTranslations, quantizedTranslations, tolerance,
+					[](const vec3f& t0, const vec3f& t1, float t) { return lerp(t0, t1, t); },
+					[](const vec3f& t0, const vec3f& t1) { return distance(t0, t1); });
+
+			track.translations.clear();
+			track.translations.reserve(3 * track.translationFrames.size());
+			for(const uint16_t& frame: track.translationFrames)
+				track.translations.insert(track.translations.end(), &quantized[3 * frame], &quantized[3 * frame + 3]);
+		}
+
+		measured = measureError(bvh);
+		if(measured <= error)
+			break;
+
+		tolerance /= 2;
+	}
+
+	if(measured > error)
+		slog.w(TAG, "error bound %f is out of reach, got %f", error, measured);
+
+	slog.v(TAG, "compressed %d joints x %d frames, %zu => %zu bytes, error=%f",
+			jointCount, frameCount, getRawSize(), getCompressedSize(), measured);
+	return true;
+}
+
+float AnimationClip::getFrame(float time) const
+{
+	if(!(frameTime > 0))
+		return 0.0F;
+	return pea::clamp(time / frameTime, 0.0F, static_cast<float>(frameCount - 1));
+}
+
+void AnimationClip::sampleTrack(const Track& track, float frame, quaternionf& rotation, vec3f& translation) const
+{
+	float alpha;
+	size_t index = locate(track.rotationFrames, frame, alpha);
+	rotation = unpackQuaternion(&track.rotations[3 * index]);
+	if(alpha > 0)
+		rotation = nlerp(rotation, unpackQuaternion(&track.rotations[3 * (index + 1)]), alpha);
+
+	const vec3f& min = track.translationMin;
+	const vec3f& extent = track.translationExtent;
+	index = locate(track.translationFrames, frame, alpha);
+	const uint16_t* key = &track.translations[3 * index];
+	for(uint8_t c = 0; c < 3; ++c)
+	{
+		translation[c] = dequantize(key[c], min[c], extent[c]);
+		if(alpha > 0)
+			translation[c] = lerp(translation[c], dequantize(key[c + 3], min[c], extent[c]), alpha);
+	}
+}
+
+void AnimationClip::sample(float time, quaternionf* rotations, vec3f* translations) const
+{
+	assert(!isEmpty());
+	const float frame = getFrame(time);
+	for(size_t j = 0, size = tracks.size(); j < size; ++j)
+		sampleTrack(tracks[j], frame, rotations[j], translations[j]);
+}
+
+void AnimationClip::sample(float time, std::vector<Bone>& bones, bool updateGlobal/* = true */) const
+{
+	assert(!isEmpty());
+	const size_t size = tracks.size();
+	if(bones.size() != size)
+	{
+		bones.resize(size);
+		for(size_t j = 0; j < size; ++j)
+		{
+			Bone& bone = bones[j];
+			bone.name = names[j];
+			bone.head = vec3f(0.0F);
+			bone.tail = offsets[j];
+			bone.parent = parents[j];
+		}
+	}
+
+	const float frame = getFrame(time);
+	for(size_t j = 0; j < size; ++j)
+	{
+		quaternionf rotation;
+		vec3f translation;
+		sampleTrack(tracks[j], frame, rotation, translation);
+
+		Bone& bone = bones[j];
+		bone.local = compose(rotation, translation);
+		if(updateGlobal)
+			bone.global = bone.parent >= 0? bones[bone.parent].global * bone.local: bone.local;
+	}
+}
+
+float AnimationClip::measureError(const BioVisionHierarchy& bvh) const
+{
+	assert(bvh.joints.size() == tracks.size() && bvh.frameCount == frameCount);
+	const size_t size = tracks.size();
+	float error = 0;
+
+	#pragma omp parallel for reduction(max: error)
+	for(int32_t f = 0; f < frameCount; ++f)
+	{
+		std::vector<quaternionf> rotations(size);
+		std::vector<vec3f> translations(size);
+		std::vector<mat4f> globals(size);
+		std::vector<vec3f> expected(size), actual(size);
+
+		decodeFrame(bvh, f, rotations.data(), translations.data());
+		computeGlobalPositions(parents, rotations.data(), translations.data(), globals.data(), expected.data());
+
+		for(size_t j = 0; j < size; ++j)
+			sampleTrack(tracks[j], static_cast<float>(f), rotations[j], translations[j]);
+		computeGlobalPositions(parents, rotations.data(), translations.data(), globals.data(), actual.data());
+
+		for(size_t j = 0; j < size; ++j)
+			error = std::max(error, distance(expected[j], actual[j]));
+	}
+
+	return error;
+}
+
+size_t AnimationClip::getCompressedSize() const
+{
+	size_t size = 0;
+	for(const Track& track: tracks)
+	{
+		size += (track.rotationFrames.size() + track.rotations.size()) * sizeof(uint16_t);
+		size += (track.translationFrames.size() + track.translations.size()) * sizeof(uint16_t);
+		size += sizeof(track.translationMin) + sizeof(track.translationExtent);
+	}
+	return size;
+}
+
+float AnimationClip::getCompressionRatio() const
+{
+	size_t size = getCompressedSize();
+	return size > 0? static_cast<float>(rawSize) / size: 0.0F;
+}
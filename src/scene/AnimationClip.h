@@ -0,0 +1,136 @@
+#ifndef PEA_SCENE_ANIMATION_CLIP_H_
+#define PEA_SCENE_ANIMATION_CLIP_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "math/quaternion.h"
+#include "math/vec3.h"
+#include "scene/Bone.h"
+
+namespace pea {
+
+class BioVisionHierarchy;
+
+/**
+ * @class AnimationClip
+ * Compressed skeletal motion, built from a BVH clip.
+ *
+ * Euler channels are converted to quaternions, then each joint's rotation and translation track is
+ * reduced to the key frames needed to stay within an error bound, where the error is measured as a
+ * distance at the bones, not as an angle. The remaining keys are quantized: rotations with the
+ * smallest three scheme in 48 bits, translations in 16 bits per component relative to the track's
+ * range.
+ *
+ * Sampling decodes the two keys around time t and interpolates them (nlerp for rotations, lerp for
+ * translations), so any time can be sampled without decoding the whole clip.
+ *
+ * @see Nicholas Frechette, Animation Compression Library, https://github.com/nfrechette/acl
+ */
+class AnimationClip
+{
+public:
+	/**
+	 * Default error bound, expressed in the unit of joint offsets. That's 1mm when offsets are in
+	 * centimeters. Note that quantization alone costs about 1E-4 of a chain's length, a much
+	 * smaller bound can't be reached by long chains.
+	 */
+	static constexpr float DEFAULT_ERROR = 0.1F;
+
+private:
+	struct Track
+	{
+		std::vector<uint16_t> rotationFrames;     ///< frame index of each rotation key
+		std::vector<uint16_t> rotations;          ///< 3 words (48 bits) per key, smallest three
+		std::vector<uint16_t> translationFrames;  ///< frame index of each translation key
+		std::vector<uint16_t> translations;       ///< 3 words per key, range reduced
+		vec3f translationMin;
+		vec3f translationExtent;
+	};
+
+	std::vector<std::string> names;
+	std::vector<int32_t> parents;
+	std::vector<vec3f> offsets;
+	std::vector<Track> tracks;
+
+	int32_t frameCount;
+	float frameTime;
+	size_t rawSize;  ///< size of the uncompressed motion data in bytes
+
+private:
+	/**
+	 * @return fractional frame index of time, clamped to [0, frameCount - 1], frame 0 for clips
+	 *         of no frame time.
+	 */
+	float getFrame(float time) const;
+
+	void sampleTrack(const Track& track, float frame, quaternionf& rotation, vec3f& translation) const;
+
+public:
+	AnimationClip();
+	~AnimationClip() = default;
+
+	/**
+	 * @param[in] bvh   BVH clip with both hierarchy and motion data. Rotation values are taken as
+	 *                  radians, call BioVisionHierarchy::scale() to convert degrees first.
+	 * @param[in] error Maximum distance between a joint sampled from the compressed clip and the
+	 *                  same joint of the source clip, on any frame.
+	 * @return true if compressed successfully, otherwise false.
+	 */
+	bool compress(const BioVisionHierarchy& bvh, float error = DEFAULT_ERROR);
+
+	void clear();
+
+	bool isEmpty() const;
+	int32_t getFrameCount() const;
+	float getFrameTime() const;
+	float getDuration() const;
+	size_t getJointCount() const;
+
+	/**
+	 * Sample the clip at a given time into bones, one bone per BVH joint.
+	 * @param[in]  time          Time in seconds, clamped to [0, duration].
+	 * @param[out] bones         Resized to joint count if needed. Bone::local is always written.
+	 * @param[in]  updateGlobal  Whether to compute Bone::global as well, which is parent's global
+	 *                           transform * local transform in column major.
+	 */
+	void sample(float time, std::vector<Bone>& bones, bool updateGlobal = true) const;
+
+	/**
+	 * Sample rotation and translation of every joint, without building matrices.
+	 */
+	void sample(float time, quaternionf* rotations, vec3f* translations) const;
+
+	/**
+	 * @return maximum distance in all frames between joints of the compressed clip and the ones of
+	 *         the source clip.
+	 */
+	float measureError(const BioVisionHierarchy& bvh) const;
+
+	size_t getRawSize() const;
+	size_t getCompressedSize() const;
+	float getCompressionRatio() const;
+
+	/**
+	 * Pack a unit quaternion into 48 bits. The largest component is dropped, as it can be rebuilt
+	 * from the other three, which are stored in 15 bits each. The 2 bit index of the dropped one
+	 * takes the top bit of the first two words.
+	 */
+	static void packQuaternion(const quaternionf& q, uint16_t packed[3]);
+	static quaternionf unpackQuaternion(const uint16_t packed[3]);
+};
+
+inline bool AnimationClip::isEmpty() const         { return tracks.empty(); }
+inline int32_t AnimationClip::getFrameCount() const { return frameCount;     }
+inline float AnimationClip::getFrameTime() const    { return frameTime;      }
+inline size_t AnimationClip::getJointCount() const  { return tracks.size();  }
+inline size_t AnimationClip::getRawSize() const     { return rawSize;        }
+
+inline float AnimationClip::getDuration() const
+{
+	return frameCount > 1? (frameCount - 1) * frameTime: 0.0F;
+}
+
+}  // namespace pea
+#endif  // PEA_SCENE_ANIMATION_CLIP_H_
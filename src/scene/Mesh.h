@@ -134,6 +134,12 @@ public:
 	
 	size_t getIndexSize() const;
 	
+	/**
+	 * @return vec3 positions, empty if vertices are kept as vec4.
+	 */
+	const std::vector<vec3f>& getPositions() const;
+	const std::vector<uint32_t>& getIndices() const;
+	
 	/**
 	 * calculate the AABB of the mesh
 	 * note that the AABB is in the local space, not the world space
@@ -214,6 +220,9 @@ public:
 
 inline Primitive Mesh::getPrimitive() const { return primitive; }
 
+inline const std::vector<vec3f>& Mesh::getPositions() const  { return positions; }
+inline const std::vector<uint32_t>& Mesh::getIndices() const { return indices;   }
+
 inline bool Mesh::hasFaceNormal() const { return !faceNormals.empty(); }
 inline bool Mesh::hasNormal() const     { return !normals.empty();     }
 
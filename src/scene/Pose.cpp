@@ -0,0 +1,209 @@
+#include "scene/Pose.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "pea/config.h"
+#if OpenMP_CXX_FOUND
+#include <omp.h>
+#endif
+
+using namespace pea;
+
+static mat4f compose(const vec3f& translation, const quaternionf& rotation, const vec3f& scale)
+{
+	mat4f transform;  // T * R * S
+	rotation.mat4_cast(transform.data());
+	transform.scale(scale);
+	transform[3] = vec4f(translation.x, translation.y, translation.z, 1.0F);
+	return transform;
+}
+
+static void updateBones(const Pose& pose, std::vector<Bone>& bones, bool updateGlobal)
+{
+	const size_t size = pose.size();
+	assert(bones.size() == size);
+	for(size_t i = 0; i < size; ++i)
+	{
+		Bone& bone = bones[i];
+		bone.local = compose(pose.translations[i], pose.rotations[i], pose.scales[i]);
+		if(!updateGlobal)
+			continue;
+
+		assert(bone.parent < static_cast<int32_t>(i));
+		bone.global = bone.parent >= 0? bones[bone.parent].global * bone.local: bone.local;
+	}
+}
+
+Pose::Pose(size_t boneCount)
+{
+	resize(boneCount);
+}
+
+void Pose::resize(size_t boneCount)
+{
+	translations.resize(boneCount, vec3f(0.0F));
+	rotations.resize(boneCount, quaternionf());
+	scales.resize(boneCount, vec3f(1.0F));
+}
+
+void Pose::setIdentity()
+{
+	std::fill(translations.begin(), translations.end(), vec3f(0.0F));
+	std::fill(rotations.begin(), rotations.end(), quaternionf());
+	std::fill(scales.begin(), scales.end(), vec3f(1.0F));
+}
+
+void Pose::fromBones(const std::vector<Bone>& bones)
+{
+	const size_t size = bones.size();
+	resize(size);
+	for(size_t i = 0; i < size; ++i)
+	{
+		const mat4f& m = bones[i].local;
+		vec3f c0(m[0].x, m[0].y, m[0].z);
+		vec3f c1(m[1].x, m[1].y, m[1].z);
+		vec3f c2(m[2].x, m[2].y, m[2].z);
+		vec3f scale(c0.length(), c1.length(), c2.length());
+
+		translations[i] = vec3f(m[3].x, m[3].y, m[3].z);
+		rotations[i] = quaternionf::fromBasis(c0 / scale.x, c1 / scale.y, c2 / scale.z);
+		scales[i] = scale;
+	}
+}
+
+void Pose::toBones(std::vector<Bone>& bones, bool updateGlobal/* = true */) const
+{
+	updateBones(*this, bones, updateGlobal);
+}
+
+void Pose::blend(size_t count, const Pose* const* poses, const float* weights,
+		const float* const* masks, Pose& result)
+{
+	assert(count > 0 && poses != nullptr && weights != nullptr);
+	const Pose& first = *poses[0];
+	const size_t size = first.size();
+	result.resize(size);
+	for(size_t k = 1; k < count; ++k)
+	{
+		assert(poses[k]->size() == size);
+		assert(poses[k] != &result);
+	}
+
+	for(size_t i = 0; i < size; ++i)
+	{
+		vec3f translation(0.0F), scale(0.0F);
+		quaternionf rotation(0.0F, 0.0F, 0.0F, 0.0F);
+		float sum = 0;
+		for(size_t k = 0; k < count; ++k)
+		{
+			float weight = weights[k];
+			if(masks != nullptr && masks[k] != nullptr)
+				weight *= masks[k][i];
+			if(weight <= 0)
+				continue;
+
+			const Pose& pose = *poses[k];
+			translation += weight * pose.translations[i];
+			scale += weight * pose.scales[i];
+			// accumulate in the hemisphere of the first pose, q and -q are the same rotation.
+			const quaternionf& q = pose.rotations[i];
+			rotation += (dot(q, first.rotations[i]) < 0? -weight: weight) * q;
+			sum += weight;
+		}
+
+		if(sum <= 0)
+		{
+			result.translations[i] = first.translations[i];
+			result.rotations[i] = first.rotations[i];
+			result.scales[i] = first.scales[i];
+			continue;
+		}
+
+		result.translations[i] = translation / sum;
+		result.rotations[i] = rotation.normalize();
+		result.scales[i] = scale / sum;
+	}
+}
+
+void Pose::blend(const Pose& p0, const Pose& p1, float t, Pose& result, const float* mask/* = nullptr */)
+{
+	const size_t size = p0.size();
+	assert(p1.size() == size);
+	result.resize(size);
+	for(size_t i = 0; i < size; ++i)
+	{
+		const float w = mask != nullptr? t * mask[i]: t;
+		const quaternionf& q0 = p0.rotations[i];
+		const quaternionf& q1 = p1.rotations[i];
+		quaternionf q = (1 - w) * q0 + (dot(q0, q1) < 0? -w: w) * q1;
+
+		result.translations[i] = lerp(p0.translations[i], p1.translations[i], w);
+		result.rotations[i] = q.normalize();
+		result.scales[i] = lerp(p0.scales[i], p1.scales[i], w);
+	}
+}
+
+void Pose::subtract(const Pose& pose, const Pose& reference, Pose& additive)
+{
+	const size_t size = pose.size();
+	assert(reference.size() == size);
+	additive.resize(size);
+	for(size_t i = 0; i < size; ++i)
+	{
+		const vec3f& s = reference.scales[i];
+		additive.translations[i] = pose.translations[i] - reference.translations[i];
+		additive.rotations[i] = pose.rotations[i] * reference.rotations[i].conjugate();
+		additive.scales[i] = pose.scales[i] * vec3f(1 / s.x, 1 / s.y, 1 / s.z);
+	}
+}
+
+void Pose::add(const Pose& base, const Pose& additive, float weight, Pose& result, const float* mask/* = nullptr */)
+{
+	const size_t size = base.size();
+	assert(additive.size() == size);
+	result.resize(size);
+	const quaternionf identity;
+	for(size_t i = 0; i < size; ++i)
+	{
+		const float w = mask != nullptr? weight * mask[i]: weight;
+		const quaternionf& q = additive.rotations[i];
+		quaternionf delta = (1 - w) * identity + (q.w < 0? -w: w) * q;
+		delta.normalize();
+
+		result.translations[i] = base.translations[i] + w * additive.translations[i];
+		result.rotations[i] = delta * base.rotations[i];
+		result.scales[i] = base.scales[i] * lerp(vec3f(1.0F), additive.scales[i], w);
+	}
+}
+
+void Pose::createMask(const std::vector<Bone>& bones, int32_t root, float weight, std::vector<float>& mask)
+{
+	const int32_t size = static_cast<int32_t>(bones.size());
+	assert(0 <= root && root < size);
+	mask.assign(size, 0.0F);
+	mask[root] = weight;
+
+	// parents precede their children, one pass is enough.
+	std::vector<bool> inside(size, false);
+	inside[root] = true;
+	for(int32_t i = root + 1; i < size; ++i)
+	{
+		const int32_t& parent = bones[i].parent;
+		if(parent >= 0 && inside[parent])
+		{
+			inside[i] = true;
+			mask[i] = weight;
+		}
+	}
+}
+
+void Pose::toBones(size_t count, const Pose* const* poses, std::vector<Bone>* const* skeletons)
+{
+	const int64_t size = static_cast<int64_t>(count);
+	// characters differ in bone count, let idle threads take the next one.
+	#pragma omp parallel for schedule(dynamic, 1)
+	for(int64_t i = 0; i < size; ++i)
+		updateBones(*poses[i], *skeletons[i], true);
+}
@@ -0,0 +1,103 @@
+#ifndef PEA_SCENE_POSE_H_
+#define PEA_SCENE_POSE_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "math/quaternion.h"
+#include "math/vec3.h"
+#include "scene/Bone.h"
+
+namespace pea {
+
+/**
+ * @class Pose
+ * Local transforms of a skeleton, kept in structure of arrays form: one array of translations, one
+ * of rotations and one of scales, indexed by bone. Blending works on these arrays directly, so no
+ * matrix is built until the pose is written back to bones.
+ *
+ * A bone mask is an array of per bone weights in [0, 1], a null mask means 1 for all the bones.
+ * Use createMask() to build a partial body mask from a subtree.
+ */
+class Pose
+{
+public:
+	std::vector<vec3f> translations;
+	std::vector<quaternionf> rotations;
+	std::vector<vec3f> scales;
+
+public:
+	Pose() = default;
+	explicit Pose(size_t boneCount);
+	~Pose() = default;
+
+	void resize(size_t boneCount);
+	size_t size() const;
+
+	/**
+	 * Reset all the bones to identity transform.
+	 */
+	void setIdentity();
+
+	/**
+	 * Decompose Bone::local of each bone. Local transforms must not have skew or shear.
+	 */
+	void fromBones(const std::vector<Bone>& bones);
+
+	/**
+	 * Write Bone::local of each bone, and Bone::global if updateGlobal is true. Global transform is
+	 * parent's global transform * local transform, so parents must precede their children.
+	 */
+	void toBones(std::vector<Bone>& bones, bool updateGlobal = true) const;
+
+	/**
+	 * N-way weighted blend. Per bone weights are weights[i] * masks[i][bone], and they are
+	 * normalized, so they don't need to sum to 1. A bone with zero total weight takes the first pose.
+	 *
+	 * @param[in]  count   pose count, at least 1.
+	 * @param[in]  poses   poses with the same size.
+	 * @param[in]  weights weight of each pose.
+	 * @param[in]  masks   nullptr, or a bone mask of each pose, which can be nullptr too.
+	 * @param[out] result  blended pose, can't be one of the inputs.
+	 */
+	static void blend(size_t count, const Pose* const* poses, const float* weights,
+			const float* const* masks, Pose& result);
+
+	/**
+	 * Crossfade from p0 to p1. Bones masked out stay at p0.
+	 * @param[in] t blend factor in [0, 1], 0 returns p0, 1 returns p1.
+	 */
+	static void blend(const Pose& p0, const Pose& p1, float t, Pose& result, const float* mask = nullptr);
+
+	/**
+	 * Build an additive layer as the difference from reference to pose, so that adding it back to
+	 * reference with weight 1 gives pose.
+	 */
+	static void subtract(const Pose& pose, const Pose& reference, Pose& additive);
+
+	/**
+	 * Apply an additive layer on top of base. result can be base.
+	 * @param[in] weight layer weight, 0 for no effect, 1 for full effect.
+	 */
+	static void add(const Pose& base, const Pose& additive, float weight, Pose& result, const float* mask = nullptr);
+
+	/**
+	 * @param[in] bones  skeleton.
+	 * @param[in] root   index of the subtree root, the subtree takes weight, others take 0.
+	 * @param[out] mask  resized to bone count.
+	 */
+	static void createMask(const std::vector<Bone>& bones, int32_t root, float weight, std::vector<float>& mask);
+
+	/**
+	 * Write many characters' poses to their bones, one job per character.
+	 * @param[in]  count     character count.
+	 * @param[in]  poses     local pose of each character.
+	 * @param[out] skeletons bones of each character.
+	 */
+	static void toBones(size_t count, const Pose* const* poses, std::vector<Bone>* const* skeletons);
+};
+
+inline size_t Pose::size() const { return rotations.size(); }
+
+}  // namespace pea
+#endif  // PEA_SCENE_POSE_H_
@@ -0,0 +1,467 @@
+#include "scene/Skinning.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "math/quaternion.h"
+#include "math/vec4.h"
+
+#include "pea/config.h"
+#if OpenMP_CXX_FOUND
+#include <omp.h>
+#endif
+
+#include "util/cpu.h"
+
+// AVX2 kernels are built on any x86 compiler, and chosen at runtime if the CPU has AVX2 and FMA.
+#if PEA_ARCH_X86
+#include <immintrin.h>
+#define SKINNING_AVX2 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SKINNING_SSE  1
+#endif
+
+using namespace pea;
+
+/**
+ * Vertices are skinned in blocks of this size, big enough to amortize scheduling, small enough to
+ * balance the load between threads.
+ */
+static constexpr size_t BLOCK_SIZE = 2048;
+
+/*
+ * Linear blend kernels use a padded palette, 4 columns of vec4f per bone, so that each column can
+ * be loaded with one aligned instruction. Dual quaternion kernels use 2 vec4f per bone, the real
+ * part and the dual part, both in x, y, z, w order.
+ */
+using Kernel = void (*)(const vec4f* table, const BoneInfluence* influences,
+		const vec3f* positions, const vec3f* normals, vec3f* skinnedPositions, vec3f* skinnedNormals,
+		size_t begin, size_t end);
+
+static void buildLinearTable(const mat3x4f* palette, size_t boneCount, std::vector<vec4f>& table)
+{
+	table.resize(boneCount * 4);
+	for(size_t i = 0; i < boneCount; ++i)
+	{
+		const mat3x4f& xform = palette[i];
+		for(size_t j = 0; j < 3; ++j)
+		{
+			const vec3f& column = xform.basis[j];
+			table[i * 4 + j] = vec4f(column.x, column.y, column.z, 0.0F);
+		}
+		table[i * 4 + 3] = vec4f(xform.origin.x, xform.origin.y, xform.origin.z, 0.0F);
+	}
+}
+
+static void buildDualQuaternionTable(const mat3x4f* palette, size_t boneCount, std::vector<vec4f>& table)
+{
+	table.resize(boneCount * 2);
+	for(size_t i = 0; i < boneCount; ++i)
+	{
+		const mat3x4f& xform = palette[i];
+		const quaternionf real = quaternionf::fromBasis(normalize(xform.basis[0]),
+				normalize(xform.basis[1]), normalize(xform.basis[2]));
+		const quaternionf dual = 0.5F * (quaternionf(0.0F, xform.origin) * real);
+		table[i * 2 + 0] = vec4f(real.x, real.y, real.z, real.w);
+		table[i * 2 + 1] = vec4f(dual.x, dual.y, dual.z, dual.w);
+	}
+}
+
+static void linearScalar(const vec4f* table, const BoneInfluence* influences,
+		const vec3f* positions, const vec3f* normals, vec3f* skinnedPositions, vec3f* skinnedNormals,
+		size_t begin, size_t end)
+{
+	for(size_t i = begin; i < end; ++i)
+	{
+		const BoneInfluence& influence = influences[i];
+		vec4f c0(0.0F), c1(0.0F), c2(0.0F), c3(0.0F);
+		for(size_t k = 0; k < 4; ++k)
+		{
+			const float& weight = influence.weights[k];
+			const vec4f* m = table + influence.indices[k] * 4;
+			c0 += weight * m[0];
+			c1 += weight * m[1];
+			c2 += weight * m[2];
+			c3 += weight * m[3];
+		}
+
+		const vec3f& p = positions[i];
+		vec4f q = c0 * p.x + c1 * p.y + c2 * p.z + c3;
+		skinnedPositions[i] = vec3f(q.x, q.y, q.z);
+		if(normals == nullptr)
+			continue;
+
+		const vec3f& n = normals[i];
+		q = c0 * n.x + c1 * n.y + c2 * n.z;
+		skinnedNormals[i] = normalize(vec3f(q.x, q.y, q.z));
+	}
+}
+
+static void dualQuaternionScalar(const vec4f* table, const BoneInfluence* influences,
+		const vec3f* positions, const vec3f* normals, vec3f* skinnedPositions, vec3f* skinnedNormals,
+		size_t begin, size_t end)
+{
+	for(size_t i = begin; i < end; ++i)
+	{
+		const BoneInfluence& influence = influences[i];
+		const vec4f& pivot = table[influence.indices[0] * 2];
+		vec4f real(0.0F), dual(0.0F);
+		for(size_t k = 0; k < 4; ++k)
+		{
+			const vec4f* dq = table + influence.indices[k] * 2;
+			// q and -q are the same rotation, blend in the hemisphere of the first bone.
+			const float weight = dot(dq[0], pivot) < 0? -influence.weights[k]: influence.weights[k];
+			real += weight * dq[0];
+			dual += weight * dq[1];
+		}
+
+		const float inverseLength = 1.0F / std::sqrt(dot(real, real));
+		real *= inverseLength;
+		dual *= inverseLength;
+		const vec3f v(real.x, real.y, real.z), e(dual.x, dual.y, dual.z);
+		const vec3f translation = 2.0F * (real.w * e - dual.w * v + cross(v, e));
+
+		const vec3f& p = positions[i];
+		skinnedPositions[i] = p + 2.0F * cross(v, cross(v, p) + real.w * p) + translation;
+		if(normals == nullptr)
+			continue;
+
+		const vec3f& n = normals[i];
+		skinnedNormals[i] = normalize(n + 2.0F * cross(v, cross(v, n) + real.w * n));
+	}
+}
+
+#if SKINNING_SSE
+static void linearSSE(const vec4f* table, const BoneInfluence* influences,
+		const vec3f* positions, const vec3f* normals, vec3f* skinnedPositions, vec3f* skinnedNormals,
+		size_t begin, size_t end)
+{
+	const float* base = reinterpret_cast<const float*>(table);
+	alignas(16) float result[4];
+	for(size_t i = begin; i < end; ++i)
+	{
+		const BoneInfluence& influence = influences[i];
+		__m128 c0 = _mm_setzero_ps(), c1 = _mm_setzero_ps(), c2 = _mm_setzero_ps(), c3 = _mm_setzero_ps();
+		for(size_t k = 0; k < 4; ++k)
+		{
+			const __m128 weight = _mm_set1_ps(influence.weights[k]);
+			const float* m = base + influence.indices[k] * 16;
+			c0 = _mm_add_ps(c0, _mm_mul_ps(weight, _mm_load_ps(m + 0)));
+			c1 = _mm_add_ps(c1, _mm_mul_ps(weight, _mm_load_ps(m + 4)));
+			c2 = _mm_add_ps(c2, _mm_mul_ps(weight, _mm_load_ps(m + 8)));
+			c3 = _mm_add_ps(c3, _mm_mul_ps(weight, _mm_load_ps(m + 12)));
+		}
+
+		const vec3f& p = positions[i];
+		__m128 q = _mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(p.x)), _mm_mul_ps(c1, _mm_set1_ps(p.y)));
+		q = _mm_add_ps(q, _mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(p.z)), c3));
+		_mm_store_ps(result, q);
+		skinnedPositions[i] = vec3f(result[0], result[1], result[2]);
+		if(normals == nullptr)
+			continue;
+
+		const vec3f& n = normals[i];
+		q = _mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(n.x)), _mm_mul_ps(c1, _mm_set1_ps(n.y)));
+		q = _mm_add_ps(q, _mm_mul_ps(c2, _mm_set1_ps(n.z)));
+		_mm_store_ps(result, q);
+		skinnedNormals[i] = normalize(vec3f(result[0], result[1], result[2]));
+	}
+}
+#endif  // SKINNING_SSE
+
+#if SKINNING_AVX2
+/*
+ * BoneInfluence is 6 words, indices 0 and 1 share word 0, indices 2 and 3 share word 1, weights
+ * take word 2 to 5.
+ */
+TARGET_AVX2 static inline __m256i gatherIndex(const int32_t* words, __m256i offsets, int32_t k)
+{
+	__m256i word = _mm256_i32gather_epi32(words + k / 2, offsets, 4);
+	if(k & 1)
+		return _mm256_srli_epi32(word, 16);
+	return _mm256_and_si256(word, _mm256_set1_epi32(0xFFFF));
+}
+
+TARGET_AVX2 static inline void storeVectors(const __m256& x, const __m256& y, const __m256& z, vec3f* vectors)
+{
+	alignas(32) float buffer[3][8];
+	_mm256_store_ps(buffer[0], x);
+	_mm256_store_ps(buffer[1], y);
+	_mm256_store_ps(buffer[2], z);
+	for(int32_t l = 0; l < 8; ++l)
+		vectors[l] = vec3f(buffer[0][l], buffer[1][l], buffer[2][l]);
+}
+
+TARGET_AVX2 static inline __m256 reciprocalLength(const __m256& x, const __m256& y, const __m256& z)
+{
+	__m256 squared = _mm256_fmadd_ps(x, x, _mm256_fmadd_ps(y, y, _mm256_mul_ps(z, z)));
+	return _mm256_div_ps(_mm256_set1_ps(1.0F), _mm256_sqrt_ps(squared));
+}
+
+/**
+ * Each bone takes 2 registers, columns 0 and 1 in one, columns 2 and 3 in the other, so blending
+ * a vertex is 8 loads and 8 FMAs. Gathering the matrices element by element is much slower.
+ */
+TARGET_AVX2 static void linearAVX2(const vec4f* table, const BoneInfluence* influences,
+		const vec3f* positions, const vec3f* normals, vec3f* skinnedPositions, vec3f* skinnedNormals,
+		size_t begin, size_t end)
+{
+	const float* base = reinterpret_cast<const float*>(table);
+	alignas(16) float result[4];
+	for(size_t i = begin; i < end; ++i)
+	{
+		const BoneInfluence& influence = influences[i];
+		__m256 c01 = _mm256_setzero_ps(), c23 = _mm256_setzero_ps();
+		for(size_t k = 0; k < 4; ++k)
+		{
+			const __m256 weight = _mm256_set1_ps(influence.weights[k]);
+			const float* m = base + influence.indices[k] * 16;
+			c01 = _mm256_fmadd_ps(weight, _mm256_loadu_ps(m + 0), c01);
+			c23 = _mm256_fmadd_ps(weight, _mm256_loadu_ps(m + 8), c23);
+		}
+
+		const vec3f& p = positions[i];
+		__m256 q = _mm256_fmadd_ps(c01, _mm256_setr_ps(p.x, p.x, p.x, p.x, p.y, p.y, p.y, p.y),
+				_mm256_mul_ps(c23, _mm256_setr_ps(p.z, p.z, p.z, p.z, 1, 1, 1, 1)));
+		_mm_store_ps(result, _mm_add_ps(_mm256_castps256_ps128(q), _mm256_extractf128_ps(q, 1)));
+		skinnedPositions[i] = vec3f(result[0], result[1], result[2]);
+		if(normals == nullptr)
+			continue;
+
+		const vec3f& n = normals[i];
+		q = _mm256_fmadd_ps(c01, _mm256_setr_ps(n.x, n.x, n.x, n.x, n.y, n.y, n.y, n.y),
+				_mm256_mul_ps(c23, _mm256_setr_ps(n.z, n.z, n.z, n.z, 0, 0, 0, 0)));
+		_mm_store_ps(result, _mm_add_ps(_mm256_castps256_ps128(q), _mm256_extractf128_ps(q, 1)));
+		skinnedNormals[i] = normalize(vec3f(result[0], result[1], result[2]));
+	}
+}
+
+/**
+ * a × b in structure of arrays form.
+ */
+TARGET_AVX2 static inline void cross(const __m256 a[3], const __m256 b[3], __m256 c[3])
+{
+	c[0] = _mm256_fmsub_ps(a[1], b[2], _mm256_mul_ps(a[2], b[1]));
+	c[1] = _mm256_fmsub_ps(a[2], b[0], _mm256_mul_ps(a[0], b[2]));
+	c[2] = _mm256_fmsub_ps(a[0], b[1], _mm256_mul_ps(a[1], b[0]));
+}
+
+/**
+ * v + 2 * r × (r × v + w * v), rotate v by unit quaternion (r, w).
+ */
+TARGET_AVX2 static inline void rotate(const __m256 r[3], const __m256& w, __m256 v[3])
+{
+	__m256 t[3], u[3];
+	cross(r, v, t);
+	for(int32_t j = 0; j < 3; ++j)
+		t[j] = _mm256_fmadd_ps(w, v[j], t[j]);
+	cross(r, t, u);
+	for(int32_t j = 0; j < 3; ++j)
+		v[j] = _mm256_fmadd_ps(_mm256_set1_ps(2.0F), u[j], v[j]);
+}
+
+/**
+ * 8 vertices per iteration in structure of arrays form, dual quaternions are gathered component by
+ * component.
+ */
+TARGET_AVX2 static void dualQuaternionAVX2(const vec4f* table, const BoneInfluence* influences,
+		const vec3f* positions, const vec3f* normals, vec3f* skinnedPositions, vec3f* skinnedNormals,
+		size_t begin, size_t end)
+{
+	const float* base = reinterpret_cast<const float*>(table);
+	const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	const __m256i influenceOffsets = _mm256_mullo_epi32(lane, _mm256_set1_epi32(6));
+	const __m256i vectorOffsets = _mm256_mullo_epi32(lane, _mm256_set1_epi32(3));
+	const __m256 signMask = _mm256_set1_ps(-0.0F);
+
+	size_t i = begin;
+	for(; i + 8 <= end; i += 8)
+	{
+		const int32_t* words = reinterpret_cast<const int32_t*>(influences + i);
+		const float* weights = reinterpret_cast<const float*>(words + 2);
+
+		// x, y, z, w of the blended real part and dual part
+		__m256 real[4], dual[4], pivot[4];
+		for(int32_t k = 0; k < 4; ++k)
+		{
+			const __m256i offsets = _mm256_slli_epi32(gatherIndex(words, influenceOffsets, k), 3);
+			__m256 weight = _mm256_i32gather_ps(weights + k, influenceOffsets, 4);
+			__m256 r[4];
+			for(int32_t j = 0; j < 4; ++j)
+				r[j] = _mm256_i32gather_ps(base + j, offsets, 4);
+
+			if(k == 0)
+			{
+				for(int32_t j = 0; j < 4; ++j)
+				{
+					pivot[j] = r[j];
+					real[j] = _mm256_mul_ps(weight, r[j]);
+					dual[j] = _mm256_mul_ps(weight, _mm256_i32gather_ps(base + 4 + j, offsets, 4));
+				}
+				continue;
+			}
+
+			__m256 d = _mm256_mul_ps(r[0], pivot[0]);
+			for(int32_t j = 1; j < 4; ++j)
+				d = _mm256_fmadd_ps(r[j], pivot[j], d);
+			weight = _mm256_xor_ps(weight, _mm256_and_ps(d, signMask));  // flip weight where d < 0
+			for(int32_t j = 0; j < 4; ++j)
+			{
+				real[j] = _mm256_fmadd_ps(weight, r[j], real[j]);
+				dual[j] = _mm256_fmadd_ps(weight, _mm256_i32gather_ps(base + 4 + j, offsets, 4), dual[j]);
+			}
+		}
+
+		__m256 squared = _mm256_mul_ps(real[3], real[3]);
+		for(int32_t j = 0; j < 3; ++j)
+			squared = _mm256_fmadd_ps(real[j], real[j], squared);
+		const __m256 scale = _mm256_div_ps(_mm256_set1_ps(1.0F), _mm256_sqrt_ps(squared));
+		for(int32_t j = 0; j < 4; ++j)
+		{
+			real[j] = _mm256_mul_ps(real[j], scale);
+			dual[j] = _mm256_mul_ps(dual[j], scale);
+		}
+
+		// translation = 2 * (w * e - dual.w * v + v × e)
+		__m256 translation[3];
+		cross(real, dual, translation);
+		for(int32_t j = 0; j < 3; ++j)
+		{
+			__m256 t = _mm256_fmsub_ps(real[3], dual[j], _mm256_mul_ps(dual[3], real[j]));
+			translation[j] = _mm256_mul_ps(_mm256_set1_ps(2.0F), _mm256_add_ps(translation[j], t));
+		}
+
+		const float* p = reinterpret_cast<const float*>(positions + i);
+		__m256 v[3];
+		for(int32_t j = 0; j < 3; ++j)
+			v[j] = _mm256_i32gather_ps(p + j, vectorOffsets, 4);
+		rotate(real, real[3], v);
+		storeVectors(_mm256_add_ps(v[0], translation[0]), _mm256_add_ps(v[1], translation[1]),
+				_mm256_add_ps(v[2], translation[2]), skinnedPositions + i);
+		if(normals == nullptr)
+			continue;
+
+		const float* n = reinterpret_cast<const float*>(normals + i);
+		for(int32_t j = 0; j < 3; ++j)
+			v[j] = _mm256_i32gather_ps(n + j, vectorOffsets, 4);
+		rotate(real, real[3], v);
+		const __m256 s = reciprocalLength(v[0], v[1], v[2]);
+		storeVectors(_mm256_mul_ps(v[0], s), _mm256_mul_ps(v[1], s), _mm256_mul_ps(v[2], s), skinnedNormals + i);
+	}
+
+	dualQuaternionScalar(table, influences, positions, normals, skinnedPositions, skinnedNormals, i, end);
+}
+#endif  // SKINNING_AVX2
+
+/**
+ * @return true if AVX2 kernels are built and the CPU runs them.
+ */
+static bool hasAVX2()
+{
+#if SKINNING_AVX2
+	const CpuFeature& cpu = getCpuFeature();
+	return cpu.avx2 && cpu.fma;
+#else
+	return false;
+#endif
+}
+
+void Skinning::computePalette(const std::vector<Bone>& bones, std::vector<mat3x4f>& palette)
+{
+	const size_t size = bones.size();
+	palette.resize(size);
+	for(size_t i = 0; i < size; ++i)
+	{
+		const mat4f m = bones[i].global * bones[i].rest;
+		mat3x4f& xform = palette[i];
+		for(size_t j = 0; j < 3; ++j)
+			xform.basis[j] = vec3f(m[j].x, m[j].y, m[j].z);
+		xform.origin = vec3f(m[3].x, m[3].y, m[3].z);
+	}
+}
+
+#ifndef NDEBUG
+static bool checkInfluences(const BoneInfluence* influences, size_t count, size_t boneCount)
+{
+	for(size_t i = 0; i < count; ++i)
+		for(size_t k = 0; k < 4; ++k)
+			if(influences[i].indices[k] >= boneCount)
+				return false;
+	return true;
+}
+#endif
+
+void Skinning::deform(Method method, const mat3x4f* palette, size_t boneCount,
+		const BoneInfluence* influences, const vec3f* positions, const vec3f* normals, size_t count,
+		vec3f* skinnedPositions, vec3f* skinnedNormals)
+{
+	assert(palette != nullptr && influences != nullptr && positions != nullptr && skinnedPositions != nullptr);
+	assert(normals == nullptr || skinnedNormals != nullptr);
+	assert(checkInfluences(influences, count, boneCount));
+
+	const bool avx2 = hasAVX2();
+	std::vector<vec4f> table;
+	Kernel kernel;
+	if(method == Method::DUAL_QUATERNION)
+	{
+		buildDualQuaternionTable(palette, boneCount, table);
+		kernel = dualQuaternionScalar;
+#if SKINNING_AVX2
+		if(avx2)
+			kernel = dualQuaternionAVX2;
+#endif
+	}
+	else
+	{
+		buildLinearTable(palette, boneCount, table);
+		kernel = linearScalar;
+#if SKINNING_SSE
+		kernel = linearSSE;
+#endif
+#if SKINNING_AVX2
+		if(avx2)
+			kernel = linearAVX2;
+#endif
+	}
+
+	const int64_t blockCount = static_cast<int64_t>((count + BLOCK_SIZE - 1) / BLOCK_SIZE);
+	#pragma omp parallel for schedule(static)
+	for(int64_t b = 0; b < blockCount; ++b)
+	{
+		size_t begin = static_cast<size_t>(b) * BLOCK_SIZE;
+		size_t end = std::min(begin + BLOCK_SIZE, count);
+		kernel(table.data(), influences, positions, normals, skinnedPositions, skinnedNormals, begin, end);
+	}
+}
+
+void Skinning::deformReference(Method method, const mat3x4f* palette, size_t boneCount,
+		const BoneInfluence* influences, const vec3f* positions, const vec3f* normals, size_t count,
+		vec3f* skinnedPositions, vec3f* skinnedNormals)
+{
+	assert(checkInfluences(influences, count, boneCount));
+	std::vector<vec4f> table;
+	if(method == Method::DUAL_QUATERNION)
+	{
+		buildDualQuaternionTable(palette, boneCount, table);
+		dualQuaternionScalar(table.data(), influences, positions, normals, skinnedPositions, skinnedNormals, 0, count);
+	}
+	else
+	{
+		buildLinearTable(palette, boneCount, table);
+		linearScalar(table.data(), influences, positions, normals, skinnedPositions, skinnedNormals, 0, count);
+	}
+}
+
+const char* Skinning::getInstructionSet()
+{
+	if(hasAVX2())
+		return "AVX2";
+#if SKINNING_SSE
+	return "SSE2";
+#else
+	return "scalar";
+#endif
+}
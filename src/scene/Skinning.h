@@ -0,0 +1,82 @@
+#ifndef PEA_SCENE_SKINNING_H_
+#define PEA_SCENE_SKINNING_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "math/mat3x4.h"
+#include "math/vec3.h"
+#include "scene/Bone.h"
+
+namespace pea {
+
+/**
+ * Up to four bones that move a vertex. Weights are expected to sum to 1, unused slots have zero
+ * weight, and their index can be any valid bone.
+ */
+struct BoneInfluence
+{
+	uint16_t indices[4];
+	float weights[4];
+};
+
+/**
+ * @class Skinning
+ * Deform vertices on CPU with a palette of skinning transforms, one per bone, which take a vertex
+ * from bind pose to current pose. It's the same work as the skinning vertex shaders, for the cases
+ * where the result is needed on CPU side, like picking, physics, or software rendering.
+ *
+ * Linear blend skinning is vectorized with AVX2 and FMA if the CPU has them, which is checked at
+ * runtime, or else with SSE. Dual quaternion skinning keeps volume at twisted joints, its AVX2
+ * kernel does 8 vertices at once with gathers. Vertices are split into ranges which are skinned
+ * in parallel.
+ *
+ * @see Ladislav Kavan et al. Skinning with Dual Quaternions, 2007.
+ */
+class Skinning
+{
+public:
+	enum class Method: uint8_t
+	{
+		LINEAR_BLEND,
+		DUAL_QUATERNION,  ///< palette transforms must be rigid, scale is dropped
+	};
+
+public:
+	/**
+	 * @param[in]  bones   skeleton with Bone::global updated, Bone::rest being the inverse bind pose.
+	 * @param[out] palette global * rest of each bone.
+	 */
+	static void computePalette(const std::vector<Bone>& bones, std::vector<mat3x4f>& palette);
+
+	/**
+	 * @param[in]  method     linear blend or dual quaternion.
+	 * @param[in]  palette    skinning transforms.
+	 * @param[in]  boneCount  palette size, every influence index must be less than it.
+	 * @param[in]  influences bone influences of each vertex.
+	 * @param[in]  positions  bind pose positions.
+	 * @param[in]  normals    bind pose normals, can be nullptr.
+	 * @param[in]  count      vertex count.
+	 * @param[out] skinnedPositions deformed positions, can't overlap positions.
+	 * @param[out] skinnedNormals   deformed normals, renormalized. Ignored if normals is nullptr.
+	 */
+	static void deform(Method method, const mat3x4f* palette, size_t boneCount,
+			const BoneInfluence* influences, const vec3f* positions, const vec3f* normals, size_t count,
+			vec3f* skinnedPositions, vec3f* skinnedNormals);
+
+	/**
+	 * Same as deform(), in plain scalar code on the calling thread. It's the baseline to validate
+	 * and measure the vectorized kernels against.
+	 */
+	static void deformReference(Method method, const mat3x4f* palette, size_t boneCount,
+			const BoneInfluence* influences, const vec3f* positions, const vec3f* normals, size_t count,
+			vec3f* skinnedPositions, vec3f* skinnedNormals);
+
+	/**
+	 * @return name of the instruction set deform() uses, "AVX2", "SSE2" or "scalar".
+	 */
+	static const char* getInstructionSet();
+};
+
+}  // namespace pea
+#endif  // PEA_SCENE_SKINNING_H_
@@ -0,0 +1,136 @@
+#ifndef PEA_UTIL_LOCK_FREE_QUEUE_H_
+#define PEA_UTIL_LOCK_FREE_QUEUE_H_
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace pea {
+
+/**
+ * @class LockFreeQueue
+ * Bounded multiple producer multiple consumer queue. Each cell carries a sequence number telling
+ * whether it's ready to be written or read in the current lap, so producers and consumers only
+ * contend on their own position counter with a compare-and-swap, and never block each other.
+ * push() returns false when the queue is full, pop() returns false when it's empty.
+ *
+ * @see Dmitry Vyukov, Bounded MPMC queue,
+ *      https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+ */
+template<typename T>
+class LockFreeQueue
+{
+private:
+	static constexpr size_t CACHE_LINE_SIZE = 64;
+
+	struct Cell
+	{
+		std::atomic<size_t> sequence;
+		T value;
+	};
+
+	const size_t mask;
+	std::unique_ptr<Cell[]> cells;
+
+	alignas(CACHE_LINE_SIZE) std::atomic<size_t> enqueuePosition;
+	alignas(CACHE_LINE_SIZE) std::atomic<size_t> dequeuePosition;
+
+private:
+	static size_t roundUpPowerOfTwo(size_t n);
+
+public:
+	/**
+	 * @param[in] capacity Maximum element count, rounded up to power of two.
+	 */
+	explicit LockFreeQueue(size_t capacity);
+	~LockFreeQueue() = default;
+
+	LockFreeQueue(const LockFreeQueue&) = delete;
+	LockFreeQueue& operator =(const LockFreeQueue&) = delete;
+
+	size_t capacity() const;
+
+	bool push(T value);
+	bool pop(T& value);
+};
+
+template<typename T>
+size_t LockFreeQueue<T>::roundUpPowerOfTwo(size_t n)
+{
+	size_t size = 2;
+	while(size < n)
+		size <<= 1;
+	return size;
+}
+
+template<typename T>
+LockFreeQueue<T>::LockFreeQueue(size_t capacity):
+		mask(roundUpPowerOfTwo(capacity) - 1),
+		cells(new Cell[mask + 1]),
+		enqueuePosition(0),
+		dequeuePosition(0)
+{
+	for(size_t i = 0; i <= mask; ++i)
+		cells[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+template<typename T>
+inline size_t LockFreeQueue<T>::capacity() const { return mask + 1; }
+
+template<typename T>
+bool LockFreeQueue<T>::push(T value)
+{
+	size_t position = enqueuePosition.load(std::memory_order_relaxed);
+	Cell* cell;
+	while(true)
+	{
+		cell = &cells[position & mask];
+		size_t sequence = cell->sequence.load(std::memory_order_acquire);
+		intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+		if(difference == 0)
+		{
+			if(enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				break;
+		}
+		else if(difference < 0)
+			return false;  // full
+		else
+			position = enqueuePosition.load(std::memory_order_relaxed);
+	}
+
+	cell->value = std::move(value);
+	cell->sequence.store(position + 1, std::memory_order_release);
+	return true;
+}
+
+template<typename T>
+bool LockFreeQueue<T>::pop(T& value)
+{
+	size_t position = dequeuePosition.load(std::memory_order_relaxed);
+	Cell* cell;
+	while(true)
+	{
+		cell = &cells[position & mask];
+		size_t sequence = cell->sequence.load(std::memory_order_acquire);
+		intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+		if(difference == 0)
+		{
+			if(dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				break;
+		}
+		else if(difference < 0)
+			return false;  // empty
+		else
+			position = dequeuePosition.load(std::memory_order_relaxed);
+	}
+
+	value = std::move(cell->value);
+	cell->sequence.store(position + mask + 1, std::memory_order_release);
+	return true;
+}
+
+}  // namespace pea
+#endif  // PEA_UTIL_LOCK_FREE_QUEUE_H_
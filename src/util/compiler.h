@@ -34,6 +34,15 @@ struct S{ char a; int b; };
 //#define IF_UNLIKELY(cond) if (!(cond)); else
 #endif
 
+// Forces inlining, e.g. of a generic kernel into a caller built for another target.
+#if defined(__GNUC__) || defined(__clang__)
+#  define ALWAYS_INLINE  inline __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#  define ALWAYS_INLINE  __forceinline
+#else
+#  define ALWAYS_INLINE  inline
+#endif
+
 
 // __func__ macro goes into C++11 standard
 // https://msdn.microsoft.com/en-us/library/b0084kay(v=vs.71).aspx
@@ -0,0 +1,77 @@
+#ifndef PEA_UTIL_CPU_H_
+#define PEA_UTIL_CPU_H_
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#  define PEA_ARCH_X86 1
+#else
+#  define PEA_ARCH_X86 0
+#endif
+
+#if PEA_ARCH_X86 && defined(_MSC_VER)
+#  include <intrin.h>
+#endif
+
+/*
+	Kernels built for an instruction set the library isn't compiled for. They must only be called
+	after checking CPU features at runtime. MSVC accepts any intrinsic without a flag.
+	TARGET_AVX2_NO_FMA leaves out FMA, which contracts a * b + c and rounds differently from SSE or
+	scalar code.
+*/
+#if PEA_ARCH_X86 && (defined(__GNUC__) || defined(__clang__))
+#  define TARGET_SSE4_1       __attribute__((target("sse4.1")))
+#  define TARGET_AVX2_NO_FMA  __attribute__((target("avx2")))
+#  define TARGET_AVX2         __attribute__((target("avx2,fma")))
+#else
+#  define TARGET_SSE4_1
+#  define TARGET_AVX2_NO_FMA
+#  define TARGET_AVX2
+#endif
+
+namespace pea {
+
+/**
+ * x86 features queried with CPUID once. All false on other architectures.
+ */
+struct CpuFeature
+{
+	bool sse4_1;
+	bool avx2;  ///< implies the OS saves YMM registers
+	bool fma;
+};
+
+/**
+ * @return features of the CPU running this process.
+ */
+inline const CpuFeature& getCpuFeature()
+{
+	static const CpuFeature feature = []()
+	{
+		CpuFeature feature = {false, false, false};
+#if PEA_ARCH_X86 && defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		const int maxLeaf = info[0];
+		__cpuid(info, 1);
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		const bool ymm = osxsave && (_xgetbv(0) & 0x6) == 0x6;
+		feature.sse4_1 = (info[2] & (1 << 19)) != 0;
+		feature.fma    = ymm && (info[2] & (1 << 12)) != 0;
+		if(maxLeaf >= 7)
+		{
+			__cpuidex(info, 7, 0);
+			feature.avx2 = ymm && (info[1] & (1 << 5)) != 0;
+		}
+#elif PEA_ARCH_X86 && (defined(__GNUC__) || defined(__clang__))
+		// checks OS support of AVX state too.
+		__builtin_cpu_init();
+		feature.sse4_1 = __builtin_cpu_supports("sse4.1");
+		feature.avx2   = __builtin_cpu_supports("avx2");
+		feature.fma    = __builtin_cpu_supports("fma");
+#endif
+		return feature;
+	}();
+	return feature;
+}
+
+}  // namespace pea
+#endif  // PEA_UTIL_CPU_H_
@@ -0,0 +1,76 @@
+#ifndef PEA_UTIL_UNICODE_H_
+#define PEA_UTIL_UNICODE_H_
+
+#include <cstdint>
+#include <string>
+
+namespace pea {
+
+static constexpr char32_t REPLACEMENT_CHARACTER = 0xFFFD;
+
+/**
+ * Decode one code point of UTF-8 text, and move to the next one.
+ * @param[in,out] text UTF-8 text, advanced by the bytes decoded.
+ * @param[in]     end  end of text.
+ * @return the code point, or U+FFFD for a malformed sequence, which consumes one byte.
+ */
+inline char32_t decodeUtf8(const char*& text, const char* end)
+{
+	const uint8_t* p = reinterpret_cast<const uint8_t*>(text);
+	const uint8_t lead = p[0];
+	++text;
+	if(lead < 0x80)
+		return lead;
+
+	size_t length;
+	char32_t codepoint, minimum;
+	if((lead & 0xE0) == 0xC0)
+	{
+		length = 2;
+		codepoint = lead & 0x1F;
+		minimum = 0x80;
+	}
+	else if((lead & 0xF0) == 0xE0)
+	{
+		length = 3;
+		codepoint = lead & 0x0F;
+		minimum = 0x800;
+	}
+	else if((lead & 0xF8) == 0xF0)
+	{
+		length = 4;
+		codepoint = lead & 0x07;
+		minimum = 0x10000;
+	}
+	else
+		return REPLACEMENT_CHARACTER;
+
+	if(static_cast<size_t>(end - reinterpret_cast<const char*>(p)) < length)
+		return REPLACEMENT_CHARACTER;
+
+	for(size_t i = 1; i < length; ++i)
+	{
+		if((p[i] & 0xC0) != 0x80)
+			return REPLACEMENT_CHARACTER;
+		codepoint = (codepoint << 6) | (p[i] & 0x3F);
+	}
+
+	// overlong forms, surrogates and out of range values are malformed.
+	if(codepoint < minimum || (0xD800 <= codepoint && codepoint <= 0xDFFF) || codepoint > 0x10FFFF)
+		return REPLACEMENT_CHARACTER;
+
+	text = reinterpret_cast<const char*>(p + length);
+	return codepoint;
+}
+
+inline std::u32string codecvt_utf8_utf32(const std::string& text)
+{
+	std::u32string utf32;
+	utf32.reserve(text.size());
+	for(const char *p = text.data(), *end = p + text.size(); p < end;)
+		utf32.push_back(decodeUtf8(p, end));
+	return utf32;
+}
+
+}  // namespace pea
+#endif  // PEA_UTIL_UNICODE_H_
@@ -1,5 +1,9 @@
 #include "test/catch.hpp"
 
+#include <chrono>
+
+#include "geometry/BezierCurve.h"
+#include "graphics/Paint.h"
 #include "graphics/Path.h"
 #include "util/Log.h"
 
@@ -113,4 +117,307 @@ TEST_CASE("circle", tag)
 	testCirclePath(vec2f(2, 2), 2, 4 * M_PI, 16);
 }
 
+TEST_CASE("arc length", tag)
+{
+	Path path;
+	path.moveTo(vec2f(0, 0)).lineTo(vec2f(3, 4)).arcTo(vec2f(3, 0), M_PI / 2);
+	CHECK(path.getLength() == Approx(5 + 4 * M_PI / 2));
+	
+	path.lineTo(vec2f(10, 0));  // from (-1, 0), cache is dropped
+	CHECK(path.getLength() == Approx(5 + 4 * M_PI / 2 + 11));
+	path.close();
+	CHECK(path.getLength() == Approx(5 + 4 * M_PI / 2 + 11 + 10));
+	CHECK(path.getTransform(-1) == vec4f(0, 0, 0.6F, 0.8F));
+	
+	// measure cubic curve against a dense polyline
+	Path curve;
+	const vec2f p0(0, 0), p1(1, 4), p2(5, -3), p3(6, 1);
+	curve.moveTo(p0).cubicTo(p1, p2, p3);
+	auto getPoint = [&](double t)
+	{
+		double s = 1 - t;
+		return vec2f(s * s * s * p0 + 3 * s * s * t * p1 + 3 * s * t * t * p2 + t * t * t * p3);
+	};
+	constexpr int32_t N = 100000;
+	double length = 0;
+	for(int32_t i = 0; i < N; ++i)
+		length += distance(getPoint(static_cast<double>(i) / N), getPoint(static_cast<double>(i + 1) / N));
+	CHECK(curve.getLength() == Approx(length).epsilon(1E-4));
+	
+	// uniform distances give equally spaced points, and batch equals single queries.
+	constexpr int32_t n = 64;
+	const float step = curve.getLength() / n;
+	std::vector<float> distances(n + 1);
+	for(int32_t i = 0; i <= n; ++i)
+		distances[i] = i * step;
+	std::vector<vec4f> transforms(n + 1);
+	curve.getTransforms(distances.data(), transforms.data(), n + 1);
+	for(int32_t i = 0; i <= n; ++i)
+	{
+		REQUIRE(transforms[i] == curve.getTransform(distances[i]));
+		vec2f tangent(transforms[i].z, transforms[i].w);
+		REQUIRE(tangent.length() == Approx(1));
+		if(i == 0)
+			continue;
+		vec2f a(transforms[i - 1].x, transforms[i - 1].y), b(transforms[i].x, transforms[i].y);
+		REQUIRE(distance(a, b) == Approx(step).epsilon(1E-2));
+	}
+	REQUIRE(vec2f(transforms[n].x, transforms[n].y) == p3);
+	
+	// descending distances are searched again
+	std::reverse(distances.begin(), distances.end());
+	std::vector<vec4f> reversed(n + 1);
+	curve.getTransforms(distances.data(), reversed.data(), n + 1);
+	for(int32_t i = 0; i <= n; ++i)
+		REQUIRE(reversed[i] == transforms[n - i]);
+	
+	// thousands of samples along a long path in one call
+	Path spiral;
+	spiral.moveTo(vec2f(0, 0));
+	for(int32_t i = 0; i < 100; ++i)
+		spiral.quadTo(vec2f(i + 0.5F, (i & 1)? -2: 2), vec2f(i + 1, 0));
+	const size_t count = 10000;
+	std::vector<float> samples(count);
+	for(size_t i = 0; i < count; ++i)
+		samples[i] = spiral.getLength() * i / count;
+	std::vector<vec4f> results(count);
+	auto start = std::chrono::steady_clock::now();
+	spiral.getTransforms(samples.data(), results.data(), count);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	slog.i(TAG, "sample %zu transforms along path of length %f: %.3f ms", count, spiral.getLength(), seconds * 1E3);
+}
+
+TEST_CASE("Bezier curve arc length", tag)
+{
+	const vec3f points[4] = { vec3f(0, 0, 0), vec3f(1, 4, 2), vec3f(5, -3, 1), vec3f(6, 1, 0) };
+	BezierCurve curve(16);
+	std::vector<float> lengths(curve.getSubdivision() + 1);
+	curve.measure(points, lengths.data());
+	
+	constexpr int32_t N = 100000;
+	double length = 0;
+	for(int32_t i = 0; i < N; ++i)
+		length += (BezierCurve::getPosition(points, static_cast<float>(i + 1) / N) - BezierCurve::getPosition(points, static_cast<float>(i) / N)).length();
+	CHECK(lengths.back() == Approx(length).epsilon(1E-4));
+	
+	constexpr int32_t n = 32;
+	const float step = lengths.back() / n;
+	std::vector<float> distances(n + 1);
+	for(int32_t i = 0; i <= n; ++i)
+		distances[i] = i * step;
+	std::vector<vec3f> positions(n + 1), tangents(n + 1);
+	curve.sample(points, lengths.data(), distances.data(), n + 1, positions.data(), tangents.data());
+	for(int32_t i = 0; i <= n; ++i)
+	{
+		REQUIRE(positions[i] == BezierCurve::getPosition(points, curve.getParameter(points, lengths.data(), distances[i])));
+		REQUIRE(tangents[i].length() == Approx(1));
+		if(i > 0)
+			REQUIRE((positions[i] - positions[i - 1]).length() == Approx(step).epsilon(1E-2));
+	}
+}
+
+
+
+static double getArea(const std::vector<vec2f>& triangles)
+{
+	double area = 0;
+	for(size_t i = 0; i + 2 < triangles.size(); i += 3)
+		area += std::abs(cross(triangles[i + 1] - triangles[i], triangles[i + 2] - triangles[i])) * 0.5;
+	return area;
+}
 
+TEST_CASE("flatten", tag)
+{
+	const vec2f p0(0, 0), p1(50, 100), p2(100, 0);
+	Path path;
+	path.moveTo(p0).quadTo(p1, p2);
+	
+	for(float tolerance: {1.0F, 0.25F, 0.01F})
+	{
+		const Path::Polyline& polyline = path.flatten(tolerance);
+		REQUIRE(polyline.contours.size() == 1);
+		REQUIRE_FALSE(polyline.contours[0].closed);
+		const std::vector<vec2f>& points = polyline.points;
+		CHECK(points.front() == p0);
+		CHECK(points.back() == p2);
+		
+		// distance of curve points to chords
+		float error = 0;
+		for(size_t i = 0; i + 1 < points.size(); ++i)
+		{
+			vec2f chord = points[i + 1] - points[i];
+			for(int32_t j = 0; j <= 16; ++j)
+			{
+				// parameter of the curve is linear in x here
+				float x = points[i].x + chord.x * j / 16;
+				float t = x / 100, s = 1 - t;
+				vec2f point = s * s * p0 + 2 * s * t * p1 + t * t * p2;
+				error = std::max(error, std::abs(cross(chord, point - points[i])) / chord.length());
+			}
+		}
+		CHECK(error <= tolerance);
+		CHECK(points.size() <= static_cast<size_t>(std::ceil(std::sqrt(0.25F * 200 / tolerance))) + 1);
+	}
+	
+	// cache is kept until path changes
+	const Path::Polyline* polyline = &path.flatten(0.5F);
+	const size_t count = polyline->points.size();
+	CHECK(path.flatten(0.5F).points.data() == polyline->points.data());
+	path.lineTo(vec2f(100, 100));
+	CHECK(path.flatten(0.5F).points.size() == count + 1);
+	
+	// contours
+	Path contours;
+	contours.moveTo(vec2f(0, 0)).lineTo(vec2f(1, 0)).lineTo(vec2f(1, 1)).close()
+			.lineTo(vec2f(0, 1)).moveTo(vec2f(5, 5)).cubicTo(vec2f(6, 6), vec2f(7, 4), vec2f(8, 5));
+	const Path::Polyline& result = contours.flatten(0.1F);
+	REQUIRE(result.contours.size() == 3);
+	CHECK(result.contours[0].closed);
+	CHECK(result.contours[0].end == 3);
+	CHECK_FALSE(result.contours[1].closed);
+	CHECK(result.points[3] == vec2f(0, 0));  // drawing after close starts from the contour start
+	CHECK(result.points[4] == vec2f(0, 1));
+	CHECK(result.points.back() == vec2f(8, 5));
+}
+
+TEST_CASE("fill triangles", tag)
+{
+	auto addSquare = [](Path& path, float left, float top, float size, bool clockwise)
+	{
+		path.moveTo(vec2f(left, top));
+		if(clockwise)
+			path.lineTo(vec2f(left + size, top)).lineTo(vec2f(left + size, top + size)).lineTo(vec2f(left, top + size));
+		else
+			path.lineTo(vec2f(left, top + size)).lineTo(vec2f(left + size, top + size)).lineTo(vec2f(left + size, top));
+		path.close();
+	};
+	
+	Path square;
+	addSquare(square, 0, 0, 4, true);
+	CHECK(getArea(square.getFillTriangles(0.1F)) == Approx(16));
+	
+	Path overlap;
+	addSquare(overlap, 0, 0, 32, true);
+	addSquare(overlap, 16, 16, 32, true);
+	CHECK(getArea(overlap.getFillTriangles(0.1F)) == Approx(2 * 32 * 32 - 16 * 16));
+	
+	Path hole;
+	addSquare(hole, 0, 0, 48, true);
+	addSquare(hole, 8, 8, 32, false);
+	CHECK(getArea(hole.getFillTriangles(0.1F)) == Approx(48 * 48 - 32 * 32));
+	
+	// self intersecting pentagram, the center has winding number 2
+	Path star;
+	const float radius = 10;
+	for(int32_t i = 0; i < 5; ++i)
+	{
+		float angle = static_cast<float>(M_PI / 2 + i * 4 * M_PI / 5);
+		vec2f point = radius * vec2f(std::cos(angle), std::sin(angle));
+		if(i == 0)
+			star.moveTo(point);
+		else
+			star.lineTo(point);
+	}
+	star.close();
+	// area of pentagram is 5 outer triangles and the inner pentagon
+	const double inner = radius * std::sin(M_PI / 10) / std::cos(M_PI / 5);
+	const double pentagon = 2.5 * inner * inner * std::sin(2 * M_PI / 5);
+	const double outerTriangle = 0.5 * (2 * inner * std::sin(M_PI / 5)) * (radius - inner * std::cos(M_PI / 5));
+	CHECK(getArea(star.getFillTriangles(0.1F)) == Approx(pentagon + 5 * outerTriangle));
+	
+	Path circle;
+	circle.moveTo(vec2f(radius, 0)).arcTo(vec2f(0, 0), 2 * M_PI).close();
+	CHECK(getArea(circle.getFillTriangles(0.001F)) == Approx(M_PI * radius * radius).epsilon(1E-3));
+}
+
+TEST_CASE("stroke", tag)
+{
+	const float length = 10, width = 2;
+	Path line;
+	line.moveTo(vec2f(0, 0)).lineTo(vec2f(length, 0));
+	
+	Paint paint;
+	paint.setStrokeWidth(width);
+	const float tolerance = 0.001F;
+	CHECK(getArea(line.getStrokeTriangles(paint, tolerance)) == Approx(length * width));
+	paint.setStrokeCap(Paint::Cap::SQUARE);
+	CHECK(getArea(line.getStrokeTriangles(paint, tolerance)) == Approx((length + width) * width));
+	paint.setStrokeCap(Paint::Cap::ROUND);
+	CHECK(getArea(line.getStrokeTriangles(paint, tolerance)) == Approx(length * width + M_PI).epsilon(1E-3));
+	
+	// closed square, outer corners differ by join
+	Path square;
+	square.moveTo(vec2f(0, 0)).lineTo(vec2f(length, 0)).lineTo(vec2f(length, length)).lineTo(vec2f(0, length)).close();
+	const float outer = length + width, inner = length - width;
+	paint.setStrokeJoin(Paint::Join::MITER);
+	CHECK(getArea(square.getStrokeTriangles(paint, tolerance)) == Approx(outer * outer - inner * inner));
+	paint.setStrokeJoin(Paint::Join::BEVEL);
+	CHECK(getArea(square.getStrokeTriangles(paint, tolerance)) == Approx(outer * outer - inner * inner - 4 * 0.5F));
+	paint.setStrokeJoin(Paint::Join::ROUND);
+	CHECK(getArea(square.getStrokeTriangles(paint, tolerance)) == Approx(outer * outer - inner * inner - 4 + M_PI).epsilon(1E-3));
+	
+	// sharp turn beyond miter limit is beveled
+	Path sharp;
+	sharp.moveTo(vec2f(0, 0)).lineTo(vec2f(length, 0)).lineTo(vec2f(0, 1));
+	paint.setStrokeCap(Paint::Cap::BUTT);
+	paint.setStrokeJoin(Paint::Join::MITER);
+	const Path::Polyline& outline = sharp.getStrokeOutline(paint, tolerance);
+	float right = 0;
+	for(const vec2f& point: outline.points)
+		right = std::max(right, point.x);
+	CHECK(right < length + width);
+	paint.setStrokeMiter(100);
+	right = 0;
+	for(const vec2f& point: sharp.getStrokeOutline(paint, tolerance).points)
+		right = std::max(right, point.x);
+	CHECK(right > length + width * 5);
+	
+	// ring of a circle, overlaps at inner joins are filled once
+	const float radius = 20;
+	Path circle;
+	circle.moveTo(vec2f(radius, 0)).arcTo(vec2f(0, 0), 2 * M_PI).close();
+	paint.setStrokeJoin(Paint::Join::ROUND);
+	CHECK(getArea(circle.getStrokeTriangles(paint, 0.01F)) == Approx(2 * M_PI * radius * width).epsilon(1E-3));
+}
+
+TEST_CASE("tessellation performance", tag)
+{
+	// a spiral of 20 turns in cubic curves, r = 4 + 2 * theta
+	Path path;
+	auto getPoint = [](float theta) { return (4 + 2 * theta) * vec2f(std::cos(theta), std::sin(theta)); };
+	auto getTangent = [](float theta)
+	{
+		vec2f direction(std::cos(theta), std::sin(theta));
+		return 2.0F * direction + (4 + 2 * theta) * vec2f(-direction.y, direction.x);
+	};
+	const float step = static_cast<float>(M_PI / 4);
+	path.moveTo(getPoint(0));
+	for(int32_t i = 0; i < 160; ++i)
+	{
+		float theta0 = i * step, theta1 = theta0 + step;
+		path.cubicTo(getPoint(theta0) + getTangent(theta0) * (step / 3),
+				getPoint(theta1) - getTangent(theta1) * (step / 3), getPoint(theta1));
+	}
+	Paint paint;
+	paint.setStrokeWidth(3);
+	paint.setStrokeJoin(Paint::Join::ROUND);
+	
+	// drawing through polylines, as Canvas does, triangulates nothing.
+	auto start = std::chrono::steady_clock::now();
+	path.getStrokeOutline(paint, 0.1F);
+	double outlined = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	
+	start = std::chrono::steady_clock::now();
+	size_t fill = path.getFillTriangles(0.1F).size() / 3;
+	size_t stroke = path.getStrokeTriangles(paint, 0.1F).size() / 3;
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	
+	start = std::chrono::steady_clock::now();
+	for(int32_t i = 0; i < 1000; ++i)
+		path.getStrokeTriangles(paint, 0.1F);
+	double cached = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	slog.i(TAG, "flatten and outline: %.2f ms, tessellate %zu points into %zu fill and %zu stroke triangles: "
+			"%.2f ms, cached: %.3f us", outlined * 1E3, path.flatten(0.1F).points.size(), fill, stroke,
+			seconds * 1E3, cached * 1E3);
+	CHECK(cached < seconds);
+}
@@ -0,0 +1,364 @@
+#include "test/catch.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <random>
+
+#include "io/BioVisionHierarchy.h"
+#include "scene/AnimationClip.h"
+#include "scene/Pose.h"
+#include "scene/Skinning.h"
+#include "util/Log.h"
+
+
+using namespace pea;
+
+static const char* tag = "[animation]";
+static const char* TAG = "animation";
+
+/**
+ * A chain of joints swinging with sine waves, root moves along X axis.
+ */
+static void createSwingClip(BioVisionHierarchy& bvh, int32_t jointCount, int32_t frameCount)
+{
+	using Channel = BioVisionHierarchy::Channel;
+	for(int32_t j = 0; j < jointCount; ++j)
+	{
+		BioVisionHierarchy::Joint joint;
+		joint.name = "joint" + std::to_string(j);
+		joint.offset = j > 0? vec3f(0, 10, 0): vec3f(0, 0, 0);
+		joint.parent = j - 1;
+		if(j == 0)
+			joint.channels = { Channel::POSITION_X, Channel::POSITION_Y, Channel::POSITION_Z };
+		joint.channels.insert(joint.channels.end(), { Channel::ROTATION_Z, Channel::ROTATION_X, Channel::ROTATION_Y });
+		bvh.joints.push_back(joint);
+		bvh.valueCountPerFrame += static_cast<int32_t>(joint.channels.size());
+	}
+
+	BioVisionHierarchy::Joint end;
+	end.offset = vec3f(0, 5, 0);
+	end.parent = jointCount - 1;
+	bvh.joints.push_back(end);
+
+	bvh.frameCount = frameCount;
+	bvh.frameTime = 1.0F / 30;
+	for(int32_t f = 0; f < frameCount; ++f)
+	{
+		float t = f * bvh.frameTime;
+		bvh.values.insert(bvh.values.end(), { 20 * t, 0, 0 });
+		for(int32_t j = 0; j < jointCount; ++j)
+		{
+			float phase = 0.5F * j;
+			bvh.values.push_back(0.6F * std::sin(2 * t + phase));
+			bvh.values.push_back(0.3F * std::sin(3 * t + phase));
+			bvh.values.push_back(0.1F);  // constant channel
+		}
+	}
+}
+
+TEST_CASE("quaternion smallest three", tag)
+{
+	const vec3f axes[] = { vec3f(1, 0, 0), vec3f(0, 1, 0), vec3f(0, 0, 1), normalize(vec3f(1, 2, 3)) };
+	for(const vec3f& axis: axes)
+		for(float angle = -3.0F; angle <= 3.0F; angle += 0.25F)
+		{
+			quaternionf q(axis, angle);
+			uint16_t packed[3];
+			AnimationClip::packQuaternion(q, packed);
+			quaternionf p = AnimationClip::unpackQuaternion(packed);
+			REQUIRE(std::abs(dot(p, q)) == Approx(1.0F).margin(1E-6));
+		}
+}
+
+TEST_CASE("AnimationClip error bound", tag)
+{
+	BioVisionHierarchy bvh;
+	createSwingClip(bvh, 6, 600);
+
+	const float errors[] = { 1.0F, AnimationClip::DEFAULT_ERROR };
+	for(const float& error: errors)
+	{
+		AnimationClip clip;
+		REQUIRE(clip.compress(bvh, error));
+		REQUIRE(clip.getJointCount() == bvh.joints.size());
+		REQUIRE(clip.measureError(bvh) <= error);
+		REQUIRE(clip.getCompressionRatio() > 1.0F);
+		slog.i(TAG, "error bound %f, %zu => %zu bytes, ratio %.2f", error,
+				clip.getRawSize(), clip.getCompressedSize(), clip.getCompressionRatio());
+	}
+}
+
+TEST_CASE("AnimationClip sample", tag)
+{
+	BioVisionHierarchy bvh;
+	createSwingClip(bvh, 6, 600);
+	AnimationClip clip;
+	REQUIRE(clip.compress(bvh));
+
+	std::vector<Bone> bones;
+	clip.sample(0.0F, bones);
+	REQUIRE(bones.size() == bvh.joints.size());
+	for(size_t j = 0; j < bones.size(); ++j)
+		REQUIRE(bones[j].parent == bvh.joints[j].parent);
+
+	constexpr int32_t N = 100000;
+	const float duration = clip.getDuration();
+	auto start = std::chrono::steady_clock::now();
+	for(int32_t i = 0; i < N; ++i)
+		clip.sample(duration * i / N, bones);
+	auto end = std::chrono::steady_clock::now();
+	double seconds = std::chrono::duration<double>(end - start).count();
+	slog.i(TAG, "sampled %.0f poses/s, %.0f joints/s", N / seconds, N * bones.size() / seconds);
+}
+
+TEST_CASE("AnimationClip interpolation", tag)
+{
+	BioVisionHierarchy bvh;
+	createSwingClip(bvh, 6, 600);
+	AnimationClip clip;
+	REQUIRE(clip.compress(bvh));
+
+	// source frame decoded the same way as the clip, rotation channels in order Z X Y.
+	const size_t jointCount = bvh.joints.size();
+	auto decode = [&bvh, jointCount](int32_t frame, quaternionf* rotations, vec3f* translations)
+	{
+		const float* values = bvh.values.data() + frame * bvh.valueCountPerFrame;
+		for(size_t j = 0; j < jointCount; ++j)
+		{
+			const BioVisionHierarchy::Joint& joint = bvh.joints[j];
+			rotations[j] = quaternionf();
+			translations[j] = joint.offset;
+			for(BioVisionHierarchy::Channel channel: joint.channels)
+			{
+				float value = *values++;
+				if(channel <= BioVisionHierarchy::Channel::POSITION_Z)
+					translations[j][channel - BioVisionHierarchy::Channel::POSITION_X] += value;
+				else
+				{
+					vec3f axis(0, 0, 0);
+					axis[channel - BioVisionHierarchy::Channel::ROTATION_X] = 1;
+					rotations[j] *= quaternionf(axis, value);
+				}
+			}
+		}
+	};
+
+	std::vector<quaternionf> rotations0(jointCount), rotations1(jointCount), rotations(jointCount);
+	std::vector<vec3f> translations0(jointCount), translations1(jointCount), translations(jointCount);
+	const float frameTime = clip.getFrameTime();
+	for(float frame: {0.25F, 10.5F, 99.9F, 321.125F, 598.75F})
+	{
+		const int32_t index = static_cast<int32_t>(frame);
+		const float alpha = frame - index;
+		decode(index, rotations0.data(), translations0.data());
+		decode(index + 1, rotations1.data(), translations1.data());
+		clip.sample(frame * frameTime, rotations.data(), translations.data());
+		for(size_t j = 0; j < jointCount; ++j)
+		{
+			const quaternionf& q0 = rotations0[j];
+			const float s = dot(q0, rotations1[j]) < 0? -alpha: alpha;
+			quaternionf expected = (1 - alpha) * q0 + s * rotations1[j];
+			expected.normalize();
+
+			// joints are 10 apart, so an angle of error / 10 moves a child by about error.
+			const float angle = 2 * std::acos(std::min(1.0F, std::abs(dot(expected, rotations[j]))));
+			CHECK(angle * 10 <= AnimationClip::DEFAULT_ERROR);
+			vec3f translation = translations0[j] + (translations1[j] - translations0[j]) * alpha;
+			CHECK((translation - translations[j]).length() <= AnimationClip::DEFAULT_ERROR);
+		}
+	}
+
+	// no frame time can't make a clip, and an empty clip has no duration.
+	bvh.frameTime = 0;
+	CHECK(!clip.compress(bvh));
+	clip.clear();
+	CHECK(clip.getDuration() == 0);
+}
+
+static bool equal(const Pose& p0, const Pose& p1)
+{
+	if(p0.size() != p1.size())
+		return false;
+
+	for(size_t i = 0; i < p0.size(); ++i)
+	{
+		if(p0.translations[i] != p1.translations[i] || p0.scales[i] != p1.scales[i])
+			return false;
+		if(std::abs(dot(p0.rotations[i], p1.rotations[i])) < 1 - 1E-5F)
+			return false;
+	}
+	return true;
+}
+
+TEST_CASE("Pose blend", tag)
+{
+	BioVisionHierarchy bvh;
+	createSwingClip(bvh, 6, 60);
+	AnimationClip clip;
+	REQUIRE(clip.compress(bvh));
+
+	std::vector<Bone> bones;
+	clip.sample(0.5F, bones);
+	Pose p0, p1;
+	p0.fromBones(bones);
+	clip.sample(1.5F, bones);
+	p1.fromBones(bones);
+
+	// decompose and compose back
+	std::vector<Bone> copy = bones;
+	p1.toBones(copy);
+	for(size_t i = 0; i < bones.size(); ++i)
+		REQUIRE(copy[i].global == bones[i].global);
+
+	const Pose* poses[] = { &p0, &p1 };
+	const float weights[] = { 3.0F, 0.0F };
+	Pose result;
+	Pose::blend(2, poses, weights, nullptr, result);
+	REQUIRE(equal(result, p0));
+
+	Pose::blend(p0, p1, 1.0F, result);
+	REQUIRE(equal(result, p1));
+
+	// upper body only, bones before the subtree stay at p0.
+	std::vector<float> mask;
+	Pose::createMask(bones, 3, 1.0F, mask);
+	Pose::blend(p0, p1, 1.0F, result, mask.data());
+	for(size_t i = 0; i < result.size(); ++i)
+	{
+		const Pose& expected = i < 3? p0: p1;
+		REQUIRE(result.translations[i] == expected.translations[i]);
+		REQUIRE(std::abs(dot(result.rotations[i], expected.rotations[i])) == Approx(1.0F));
+	}
+
+	Pose additive;
+	Pose::subtract(p1, p0, additive);
+	Pose::add(p0, additive, 1.0F, result);
+	REQUIRE(equal(result, p1));
+	Pose::add(p0, additive, 0.0F, result);
+	REQUIRE(equal(result, p0));
+}
+
+TEST_CASE("Pose characters", tag)
+{
+	BioVisionHierarchy bvh;
+	createSwingClip(bvh, 20, 60);
+	AnimationClip clip;
+	REQUIRE(clip.compress(bvh));
+
+	constexpr size_t N = 64;
+	std::vector<Pose> poses(N, Pose(clip.getJointCount()));
+	std::vector<std::vector<Bone>> skeletons(N);
+	std::vector<const Pose*> posePointers(N);
+	std::vector<std::vector<Bone>*> skeletonPointers(N);
+	for(size_t i = 0; i < N; ++i)
+	{
+		clip.sample(0.0F, skeletons[i]);
+		float time = clip.getDuration() * i / N;
+		clip.sample(time, poses[i].rotations.data(), poses[i].translations.data());
+		posePointers[i] = &poses[i];
+		skeletonPointers[i] = &skeletons[i];
+	}
+
+	Pose::toBones(N, posePointers.data(), skeletonPointers.data());
+	std::vector<Bone> bones;
+	for(size_t i = 0; i < N; ++i)
+	{
+		clip.sample(clip.getDuration() * i / N, bones);
+		for(size_t j = 0; j < bones.size(); ++j)
+			REQUIRE(skeletons[i][j].global == bones[j].global);
+	}
+}
+
+static void createSkin(size_t boneCount, size_t vertexCount, std::vector<mat3x4f>& palette,
+		std::vector<BoneInfluence>& influences, std::vector<vec3f>& positions, std::vector<vec3f>& normals)
+{
+	std::mt19937 engine(7);
+	std::uniform_real_distribution<float> distribution(-1.0F, 1.0F);
+	auto random = [&]() { return distribution(engine); };
+
+	palette.resize(boneCount);
+	for(mat3x4f& xform: palette)
+	{
+		quaternionf q(normalize(vec3f(random(), random(), random())), 3 * random());
+		q.mat3_cast(xform.basis.data());
+		xform.origin = vec3f(random(), random(), random()) * 10.0F;
+	}
+
+	influences.resize(vertexCount);
+	positions.resize(vertexCount);
+	normals.resize(vertexCount);
+	for(size_t i = 0; i < vertexCount; ++i)
+	{
+		BoneInfluence& influence = influences[i];
+		float sum = 0;
+		for(size_t k = 0; k < 4; ++k)
+		{
+			influence.indices[k] = static_cast<uint16_t>(engine() % boneCount);
+			influence.weights[k] = k < 3? random() + 1: 0.0F;  // the last slot is unused
+			sum += influence.weights[k];
+		}
+		for(float& weight: influence.weights)
+			weight /= sum;
+
+		positions[i] = vec3f(random(), random(), random()) * 5.0F;
+		normals[i] = normalize(vec3f(random(), random(), random()));
+	}
+}
+
+TEST_CASE("Skinning", tag)
+{
+	constexpr size_t BONE_COUNT = 64, VERTEX_COUNT = 100003;
+	std::vector<mat3x4f> palette;
+	std::vector<BoneInfluence> influences;
+	std::vector<vec3f> positions, normals;
+	createSkin(BONE_COUNT, VERTEX_COUNT, palette, influences, positions, normals);
+
+	std::vector<vec3f> expectedPositions(VERTEX_COUNT), expectedNormals(VERTEX_COUNT);
+	std::vector<vec3f> skinnedPositions(VERTEX_COUNT), skinnedNormals(VERTEX_COUNT);
+	const Skinning::Method methods[] = { Skinning::Method::LINEAR_BLEND, Skinning::Method::DUAL_QUATERNION };
+	const char* names[] = { "linear blend", "dual quaternion" };
+	for(size_t m = 0; m < 2; ++m)
+	{
+		Skinning::deformReference(methods[m], palette.data(), BONE_COUNT, influences.data(),
+				positions.data(), normals.data(), VERTEX_COUNT, expectedPositions.data(), expectedNormals.data());
+		Skinning::deform(methods[m], palette.data(), BONE_COUNT, influences.data(),
+				positions.data(), normals.data(), VERTEX_COUNT, skinnedPositions.data(), skinnedNormals.data());
+		for(size_t i = 0; i < VERTEX_COUNT; ++i)
+		{
+			REQUIRE((skinnedPositions[i] - expectedPositions[i]).length() < 1E-4F);
+			REQUIRE((skinnedNormals[i] - expectedNormals[i]).length() < 1E-5F);
+		}
+
+		constexpr int32_t N = 20;
+		auto start = std::chrono::steady_clock::now();
+		for(int32_t n = 0; n < N; ++n)
+			Skinning::deformReference(methods[m], palette.data(), BONE_COUNT, influences.data(),
+					positions.data(), normals.data(), VERTEX_COUNT, expectedPositions.data(), expectedNormals.data());
+		auto middle = std::chrono::steady_clock::now();
+		for(int32_t n = 0; n < N; ++n)
+			Skinning::deform(methods[m], palette.data(), BONE_COUNT, influences.data(),
+					positions.data(), normals.data(), VERTEX_COUNT, skinnedPositions.data(), skinnedNormals.data());
+		auto end = std::chrono::steady_clock::now();
+		double reference = std::chrono::duration<double>(middle - start).count();
+		double seconds = std::chrono::duration<double>(end - middle).count();
+		slog.i(TAG, "%s skinning, scalar %.1fM vertices/s, %s %.1fM vertices/s", names[m],
+				N * VERTEX_COUNT / reference * 1E-6, Skinning::getInstructionSet(), N * VERTEX_COUNT / seconds * 1E-6);
+	}
+
+	// rigid vertices, both methods give the bone's transform.
+	for(BoneInfluence& influence: influences)
+	{
+		influence.weights[0] = 1.0F;
+		influence.weights[1] = influence.weights[2] = influence.weights[3] = 0.0F;
+	}
+	Skinning::deform(Skinning::Method::LINEAR_BLEND, palette.data(), BONE_COUNT, influences.data(),
+			positions.data(), nullptr, VERTEX_COUNT, expectedPositions.data(), nullptr);
+	Skinning::deform(Skinning::Method::DUAL_QUATERNION, palette.data(), BONE_COUNT, influences.data(),
+			positions.data(), nullptr, VERTEX_COUNT, skinnedPositions.data(), nullptr);
+	for(size_t i = 0; i < VERTEX_COUNT; ++i)
+	{
+		vec3f expected = palette[influences[i].indices[0]] * positions[i];
+		REQUIRE((expectedPositions[i] - expected).length() < 1E-4F);
+		REQUIRE((skinnedPositions[i] - expected).length() < 1E-4F);
+	}
+}
@@ -1,14 +1,35 @@
 #include "test/catch.hpp"
 
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <functional>
 #include <sstream>
 
 #include "pea/config.h"
+#include "graphics/AtlasPacker.h"
+#include "graphics/Canvas.h"
+#include "graphics/DisplayList.h"
+#include "graphics/DistanceField.h"
+#include "graphics/GlyphCache.h"
 #include "graphics/ImageFactory.h"
 #include "graphics/Image_BMP.h"
+#include "graphics/Image_DXT.h"
 #include "graphics/Image_JPG.h"
 #include "graphics/Image_PNG.h"
 #include "graphics/Image_TGA.h"
+#include "graphics/KTX.h"
+#include "graphics/MappedImage.h"
+#include "graphics/Mipmap.h"
+#include "graphics/Paint.h"
+#include "graphics/Path.h"
+#include "graphics/PixelConverter.h"
+#include "graphics/Resampler.h"
+#include "graphics/TextLayoutCache.h"
+#include "graphics/Typeface.h"
 #include "io/FileSystem.h"
+#include "io/TextureLoader.h"
 #include "util/Log.h"
 #include "util/utility.h"
 
@@ -48,6 +69,100 @@ TEST_CASE("Color", tag)
 	REQUIRE(Color::size(Format::C4_F32) == 4 * sizeof(float));
 }
 
+TEST_CASE("Color spans", tag)
+{
+	// span conversions are bitwise identical to scalar ones, odd count leaves a tail.
+	constexpr size_t N = 100003;
+	uint32_t seed = 7;
+	auto random = [&seed]()
+	{
+		seed = seed * 1664525U + 1013904223U;
+		return static_cast<float>(seed >> 8) / (1 << 24);  // [0, 1)
+	};
+	const float specials[] = {0.0f, -0.0f, 1.0f, 0.5f, 1.0f / 3, 2.0f / 3, 1.0f / 6, 5.0f / 6, 0.0031308f, 0.04045f};
+
+	std::vector<vec3f> triples(N);
+	std::vector<vec4f> colors(N);
+	std::vector<float> channels(N);
+	for(size_t i = 0; i < N; ++i)
+	{
+		// gray, and colors with equal channels take other branches.
+		const float* special = specials + i % (sizeof(specials) / sizeof(specials[0]));
+		switch(i % 5)
+		{
+		case 0:  triples[i] = vec3f(*special, *special, *special); break;
+		case 1:  triples[i] = vec3f(random(), *special, *special); break;
+		case 2:  triples[i] = vec3f(*special, random(), random()); break;
+		default: triples[i] = vec3f(random(), random(), random()); break;
+		}
+		colors[i] = vec4f(triples[i].x, triples[i].y, triples[i].z, random());
+		channels[i] = i % 7 == 0? *special: random();
+	}
+	channels[N - 1] = -1.0f;
+	channels[N - 2] = 2.0f;
+
+	std::vector<vec3f> spanned(N);
+	hsv2rgb(triples.data(), spanned.data(), N);
+	for(size_t i = 0; i < N; ++i)
+	{
+		vec3f expected = hsv2rgb(triples[i]);
+		REQUIRE(std::memcmp(&spanned[i], &expected, sizeof(expected)) == 0);
+	}
+
+	rgb2hsv(triples.data(), spanned.data(), N);
+	for(size_t i = 0; i < N; ++i)
+	{
+		vec3f expected = rgb2hsv(triples[i]);
+		REQUIRE(std::memcmp(&spanned[i], &expected, sizeof(expected)) == 0);
+		// round trip
+		vec3f rgb = hsv2rgb(expected);
+		for(uint8_t c = 0; c < 3; ++c)
+			REQUIRE(rgb[c] == Approx(triples[i][c]).margin(1E-5));
+	}
+
+	std::vector<uint32_t> packed(N);
+	std::vector<vec4f> unpacked(N);
+	color_cast(colors.data(), packed.data(), N);
+	for(size_t i = 0; i < N; ++i)
+		REQUIRE(packed[i] == color_cast(colors[i]));
+	color_cast(packed.data(), unpacked.data(), N);
+	for(size_t i = 0; i < N; ++i)
+	{
+		vec4f expected = color_cast(packed[i]);
+		REQUIRE(std::memcmp(&unpacked[i], &expected, sizeof(expected)) == 0);
+	}
+
+	std::vector<uint8_t> srgb(N);
+	std::vector<float> linear(N);
+	linear2srgb(channels.data(), srgb.data(), N);
+	for(size_t i = 0; i < N - 2; ++i)
+		REQUIRE(srgb[i] == static_cast<uint8_t>(linear2srgb(channels[i]) * 255.999f));
+	CHECK(srgb[N - 1] == 0);
+	CHECK(srgb[N - 2] == 255);
+	srgb2linear(srgb.data(), linear.data(), N);
+	for(size_t i = 0; i < N; ++i)
+	{
+		float expected = srgb2linear(srgb[i] / 255.0f);
+		REQUIRE(std::memcmp(&linear[i], &expected, sizeof(expected)) == 0);
+	}
+
+	auto measure = [](const std::function<void()>& function)
+	{
+		auto start = std::chrono::steady_clock::now();
+		function();
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1E3;
+	};
+	double scalar = measure([&]() { for(size_t i = 0; i < N; ++i) spanned[i] = hsv2rgb(triples[i]); });
+	double span = measure([&]() { hsv2rgb(triples.data(), spanned.data(), N); });
+	slog.i(TAG, "hsv2rgb of %zu colors, %.3f ms one by one, %.3f ms in span", N, scalar, span);
+	scalar = measure([&]() { for(size_t i = 0; i < N; ++i) packed[i] = color_cast(colors[i]); });
+	span = measure([&]() { color_cast(colors.data(), packed.data(), N); });
+	slog.i(TAG, "color_cast of %zu colors, %.3f ms one by one, %.3f ms in span", N, scalar, span);
+	scalar = measure([&]() { for(size_t i = 0; i < N; ++i) srgb[i] = static_cast<uint8_t>(linear2srgb(channels[i]) * 255.999f); });
+	span = measure([&]() { linear2srgb(channels.data(), srgb.data(), N); });
+	slog.i(TAG, "linear2srgb of %zu channels, %.3f ms one by one, %.3f ms in span", N, scalar, span);
+}
+
 TEST_CASE("Image even", tag)
 {
 	constexpr uint32_t width = 2, height = 2;
@@ -137,6 +252,92 @@ TEST_CASE("Image odd", tag)
 			REQUIRE(image.getPixel(x, y) == Color::from_G8(pixels_v[y * width + x]));
 }
 
+TEST_CASE("Image transform", tag)
+{
+	using Format = Color::Format;
+	using Transform = Image::Transform;
+	const Transform transforms[] =
+	{
+		Transform::NONE, Transform::FLIP_H, Transform::FLIP_V, Transform::TRANSPOSE, Transform::TRANSVERSE,
+		Transform::ROTATE_90, Transform::ROTATE_180, Transform::ROTATE_270,
+	};
+
+	// 0 1 2       2 5
+	// 3 4 5  ->   1 4  counter clockwise
+	//             0 3
+	Image_PNG small(3, 2, Format::C1_U8);
+	for(uint8_t i = 0; i < 6; ++i)
+		small.getData()[i] = i;
+	small.transform(Transform::ROTATE_90);
+	REQUIRE(small.getWidth() == 2);
+	REQUIRE(small.getHeight() == 3);
+	const uint8_t rotated[] = { 2, 5, 1, 4, 0, 3 };
+	REQUIRE(std::memcmp(small.getData(), rotated, sizeof(rotated)) == 0);
+
+	// where source pixel (x, y) lands, in a w x h destination.
+	auto map = [](Transform transform, uint32_t x, uint32_t y, uint32_t width, uint32_t height)
+	{
+		switch(transform)
+		{
+		case Transform::FLIP_H:     return std::make_pair(width - 1 - x, y);
+		case Transform::FLIP_V:     return std::make_pair(x, height - 1 - y);
+		case Transform::ROTATE_180: return std::make_pair(width - 1 - x, height - 1 - y);
+		case Transform::TRANSPOSE:  return std::make_pair(y, x);
+		case Transform::TRANSVERSE: return std::make_pair(height - 1 - y, width - 1 - x);
+		case Transform::ROTATE_90:  return std::make_pair(y, width - 1 - x);
+		case Transform::ROTATE_270: return std::make_pair(height - 1 - y, x);
+		default:                    return std::make_pair(x, y);
+		}
+	};
+
+	const uint32_t sizes[][2] = { {1, 1}, {37, 70}, {70, 37}, {64, 64}, {67, 67}, {5, 129} };
+	for(Format format: { Format::C1_U8, Format::RGB565_U16, Format::C3_U8, Format::C4_U8,
+			Format::C3_U16, Format::C2_F32, Format::C3_F32, Format::C4_F32 })
+		for(const auto& size: sizes)
+		{
+			const uint32_t width = size[0], height = size[1];
+			const size_t pixelSize = Color::size(format);
+			std::vector<uint8_t> source(width * height * pixelSize);
+			for(size_t i = 0; i < source.size(); ++i)
+				source[i] = static_cast<uint8_t>(i * 13 + (i >> 8));
+
+			for(Transform transform: transforms)
+			{
+				const bool swap = Image::swapAxes(transform);
+				const uint32_t w = swap? height: width;
+				std::vector<uint8_t> expected(source.size()), result(source.size());
+				for(uint32_t y = 0; y < height; ++y)
+					for(uint32_t x = 0; x < width; ++x)
+					{
+						auto p = map(transform, x, y, width, height);
+						std::memcpy(&expected[(p.second * w + p.first) * pixelSize], &source[(y * width + x) * pixelSize], pixelSize);
+					}
+
+				REQUIRE(Image::transform(transform, format, source.data(), width, height, result.data()));
+				REQUIRE(result == expected);
+
+				Image_PNG image(width, height, format);
+				std::memcpy(image.getData(), source.data(), source.size());
+				image.transform(transform);
+				REQUIRE(image.getWidth() == static_cast<int32_t>(w));
+				REQUIRE(std::memcmp(image.getData(), expected.data(), expected.size()) == 0);
+			}
+		}
+
+	// megapixels per second, rotating a 4096x3072 photo.
+	constexpr uint32_t width = 4096, height = 3072;
+	Image_PNG photo(width, height, Format::C4_U8);
+	photo.fillCheckerboard(8);
+	std::vector<uint8_t> rotation(width * height * 4);
+	for(Transform transform: { Transform::FLIP_H, Transform::ROTATE_180, Transform::ROTATE_90, Transform::TRANSPOSE })
+	{
+		auto start = std::chrono::steady_clock::now();
+		Image::transform(transform, Format::C4_U8, photo.getData(), width, height, rotation.data());
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		slog.i(TAG, "transform %d: %.0f MP/s", static_cast<int>(transform), width * height / seconds * 1E-6);
+	}
+}
+
 TEST_CASE("Image_BMP", tag)
 {
 	Image_BMP image(1280, 720, Color::C4_U8);
@@ -157,6 +358,212 @@ TEST_CASE("Image_PNG", tag)
 	bool flag = image.save(filename);
 	REQUIRE(flag);
 	slog.i(TAG, "save PNG image %s", filename.c_str());
+
+	// decode a block of rows at a time, into a buffer with padded rows.
+	constexpr uint32_t width = 613, height = 487, blockHeight = 16;
+	Image_PNG noise(width, height, Color::C3_U8);
+	uint8_t* pixels = noise.getData();
+	uint32_t seed = 1;
+	for(size_t i = 0; i < width * height * 3; ++i)
+	{
+		seed = seed * 1664525U + 1013904223U;
+		pixels[i] = static_cast<uint8_t>(seed >> 24);
+	}
+	filename = "noise.rgb.png";
+	REQUIRE(noise.save(filename));
+
+	Image_PNG::Decoder decoder;
+	REQUIRE(!decoder.open("not_exist.png"));
+	REQUIRE(decoder.open(filename));
+	REQUIRE(decoder.getWidth() == width);
+	REQUIRE(decoder.getHeight() == height);
+	REQUIRE(decoder.getColorFormat() == Color::C3_U8);
+	REQUIRE(decoder.getRowStride() == width * 3);
+	REQUIRE(!decoder.isInterlaced());
+
+	const size_t stride = width * 3 + 5;
+	std::vector<uint8_t> block(stride * blockHeight);
+	while(decoder.getRow() < height)
+	{
+		const uint32_t y = decoder.getRow();
+		const uint32_t count = decoder.read(block.data(), stride, blockHeight);
+		REQUIRE(count == std::min(blockHeight, height - y));
+		for(uint32_t i = 0; i < count; ++i)
+			REQUIRE(std::memcmp(block.data() + stride * i, pixels + width * 3 * (y + i), width * 3) == 0);
+	}
+	REQUIRE(decoder.read(block.data(), stride, blockHeight) == 0U);
+
+	std::shared_ptr<Image_PNG> decoded = Image_PNG::decodeFile(filename);
+	REQUIRE(decoded->isValid());
+	REQUIRE(std::memcmp(decoded->getData(), pixels, width * height * 3) == 0);
+
+	std::string bytes = FileSystem::load(filename);
+	decoded = Image_PNG::decodeByteArray(reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size());
+	REQUIRE(decoded->isValid());
+	REQUIRE(decoded->getWidth() == static_cast<int32_t>(width));
+	REQUIRE(std::memcmp(decoded->getData(), pixels, width * height * 3) == 0);
+
+	// truncated data decodes some rows, then stops.
+	REQUIRE(decoder.open(reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size() / 2));
+	REQUIRE(decoder.read(block.data(), stride, blockHeight) == blockHeight);
+	uint32_t total = blockHeight;
+	while(uint32_t count = decoder.read(block.data(), stride, blockHeight))
+		total += count;
+	REQUIRE(total < height);
+}
+
+TEST_CASE("Image_PNG encoder", tag)
+{
+	constexpr uint32_t width = 131, height = 97;
+	uint32_t seed = 3;
+	auto random = [&seed]()
+	{
+		seed = seed * 1664525U + 1013904223U;
+		return static_cast<uint8_t>(seed >> 24);
+	};
+
+	// smooth gradient with noise, so that every filter gets picked.
+	const std::pair<Color::Format, Color::Format> formats[] =  // saved, decoded
+	{
+		{ Color::C1_U8,  Color::C1_U8 },
+		{ Color::C2_U8,  Color::C2_U8 },
+		{ Color::C3_U8,  Color::C3_U8 },
+		{ Color::C4_U8,  Color::C4_U8 },
+		{ Color::C3_U16, Color::C3_U8 },
+		{ Color::C4_U16, Color::C4_U8 },
+	};
+	for(const auto& [format, decodedFormat]: formats)
+	{
+		Image_PNG image(width, height, format);
+		const size_t size = static_cast<size_t>(width) * height * Color::size(format);
+		uint8_t* data = image.getData();
+		for(size_t i = 0; i < size; ++i)
+			data[i] = static_cast<uint8_t>(i / 7 + (i % 3) * 40 + (random() & 0x07));
+		const bool wide = format != decodedFormat;
+
+		Image_PNG::Parameter parameter;
+		for(int32_t filter = 0; filter <= static_cast<int32_t>(Image_PNG::Filter::ADAPTIVE); ++filter)
+			for(uint32_t stripeSize: { 1U, 4096U, 1U << 20 })
+			{
+				parameter.filter = static_cast<Image_PNG::Filter>(filter);
+				parameter.stripeSize = stripeSize;
+				parameter.level = filter % 2 == 0? 1: 9;
+				const std::string filename = "encoder.png";
+				REQUIRE(image.save(filename, parameter));
+
+				std::shared_ptr<Image_PNG> decoded = Image_PNG::decodeFile(filename);
+				REQUIRE(decoded->isValid());
+				REQUIRE(decoded->getColorFormat() == decodedFormat);
+				const uint8_t* pixels = decoded->getData();
+				if(!wide)
+					CHECK(std::memcmp(pixels, data, size) == 0);
+				else
+				{
+					// scaled to 8 bits, i.e. high byte rounded.
+					bool same = true;
+					for(size_t i = 0; i < size / 2; ++i)
+					{
+						const uint16_t value = reinterpret_cast<const uint16_t*>(data)[i];
+						same &= std::abs(pixels[i] - (value >> 8)) <= 1;
+					}
+					CHECK(same);
+				}
+			}
+	}
+
+	CHECK_FALSE(Image_PNG(4, 4, Color::C4_F32).save("float.png"));
+
+	SECTION("performance")
+	{
+		constexpr uint32_t size = 1024;
+		Image_PNG large(size, size, Color::C4_U8);
+		uint8_t* data = large.getData();
+		for(uint32_t y = 0; y < size; ++y)
+			for(uint32_t x = 0; x < size * 4; ++x)
+				data[y * size * 4 + x] = static_cast<uint8_t>((x / 4 + y) / 3 + (x % 4) * 50 + (random() & 0x03));
+
+		for(int32_t level: { 1, 6 })
+		{
+			Image_PNG::Parameter parameter;
+			parameter.level = level;
+			auto start = std::chrono::steady_clock::now();
+			REQUIRE(large.save("large.png", parameter));
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			slog.i(TAG, "save %ux%u PNG at level %d: %.1f ms, %zu bytes", size, size, level, seconds * 1E3,
+					FileSystem::load(std::string("large.png")).size());
+		}
+	}
+}
+
+TEST_CASE("MappedImage", tag)
+{
+	constexpr uint32_t width = 320, height = 200;
+	std::vector<uint8_t> pixels(width * height * 4);
+	uint32_t seed = 3;
+	for(uint8_t& c: pixels)
+	{
+		seed = seed * 1664525U + 1013904223U;
+		c = static_cast<uint8_t>(seed >> 24);
+	}
+
+	// TGA files are saved top-down, pixels are BGR.
+	std::string filename = "noise.bgr.tga";
+	Image_TGA tga(width, height, Color::BGR888_U24, pixels.data(), false);
+	REQUIRE(tga.save(filename));
+	std::shared_ptr<Image> image = ImageFactory::decodeFile(filename, true);
+	REQUIRE(dynamic_cast<MappedImage*>(image.get()) != nullptr);
+	REQUIRE(image->getImageFormat() == Image::Format::TGA);
+	REQUIRE(image->getWidth() == static_cast<int32_t>(width));
+	REQUIRE(image->getHeight() == static_cast<int32_t>(height));
+	REQUIRE(image->getColorFormat() == Color::BGR888_U24);
+	REQUIRE(!image->isBottomUp());
+	REQUIRE(std::memcmp(image->getData(), pixels.data(), width * height * 3) == 0);
+
+	// writes go to private pages, not to the file.
+	image->getData()[0] ^= 0xFF;
+	std::shared_ptr<Image> other = Image_TGA::mapFile(filename);
+	REQUIRE(other);
+	REQUIRE(other->getData()[0] == pixels[0]);
+
+	// a copy is saved top down, in RGB.
+	image->getData()[0] ^= 0xFF;
+	REQUIRE(image->save("noise.rgb.png"));
+	std::shared_ptr<Image> png = ImageFactory::decodeFile("noise.rgb.png");
+	REQUIRE(png->getColorFormat() == Color::C3_U8);
+	const uint8_t* bgr = pixels.data();
+	REQUIRE(png->getData()[0] == bgr[2]);
+	REQUIRE(png->getData()[1] == bgr[1]);
+	REQUIRE(png->getData()[2] == bgr[0]);
+
+	// BMP of 32 bits, saved top down.
+	filename = "noise.bgra.bmp";
+	Image_BMP bmp(width, height, Color::C4_U8, pixels.data(), false);
+	REQUIRE(bmp.save(filename));
+	image = ImageFactory::decodeFile(filename, true);
+	REQUIRE(dynamic_cast<MappedImage*>(image.get()) != nullptr);
+	REQUIRE(image->getImageFormat() == Image::Format::BMP);
+	REQUIRE(image->getColorFormat() == Color::BGRA8888_U32);
+	REQUIRE(!image->isBottomUp());
+	REQUIRE(std::memcmp(image->getData(), pixels.data(), width * height * 4) == 0);
+
+	// other formats fall back to decoding.
+	image = ImageFactory::decodeFile("noise.rgb.png", true);
+	REQUIRE(dynamic_cast<Image_PNG*>(image.get()) != nullptr);
+	REQUIRE(Image_TGA::mapFile("noise.rgb.png") == nullptr);
+	REQUIRE(Image_BMP::mapFile("not_exist.bmp") == nullptr);
+
+	// mapping a large file is about opening it, pixels are paged in when read.
+	constexpr uint32_t size = 4096;
+	Image_TGA large(size, size, Color::C4_U8, new uint8_t[size * size * 4], true);
+	large.fillCheckerboard(64);
+	filename = "large.tga";
+	REQUIRE(large.save(filename));
+	auto start = std::chrono::steady_clock::now();
+	image = ImageFactory::decodeFile(filename, true);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	REQUIRE(image->isValid());
+	slog.i(TAG, "map %ux%u TGA: %.3f ms", size, size, seconds * 1E3);
+	std::remove(filename.c_str());
 }
 
 #if JPEG_FOUND
@@ -259,6 +666,138 @@ TEST_CASE("Image_TGA", tag)
 */
 }
 
+TEST_CASE("Image_TGA RLE", tag)
+{
+	uint32_t seed = 7;
+	auto random = [&seed]()
+	{
+		seed = seed * 1664525U + 1013904223U;
+		return seed >> 8;
+	};
+
+	// plain greedy encoder, one pixel at a time.
+	auto encode = [](const uint8_t* pixels, size_t count, uint32_t bytes)
+	{
+		auto same = [&](size_t i) { return std::memcmp(pixels + i * bytes, pixels + (i + 1) * bytes, bytes) == 0; };
+		std::vector<uint8_t> packets;
+		for(size_t i = 0; i < count;)
+		{
+			size_t n = 1;
+			while(i + n < count && n < 128 && same(i + n - 1))
+				++n;
+			if(n > 1)
+			{
+				packets.push_back(static_cast<uint8_t>(0x80 | (n - 1)));
+				packets.insert(packets.end(), pixels + i * bytes, pixels + (i + 1) * bytes);
+			}
+			else
+			{
+				while(i + n < count && n < 128 && !(i + n + 1 < count && same(i + n)))
+					++n;
+				packets.push_back(static_cast<uint8_t>(n - 1));
+				packets.insert(packets.end(), pixels + i * bytes, pixels + (i + n) * bytes);
+			}
+			i += n;
+		}
+		return packets;
+	};
+
+	for(uint32_t bytes = 1; bytes <= 4; ++bytes)
+		for(size_t count: { 1, 2, 16, 17, 33, 129, 300, 1000 })
+		{
+			// runs of random lengths, some longer than a packet.
+			std::vector<uint8_t> pixels(count * bytes);
+			for(size_t i = 0; i < count;)
+			{
+				const uint32_t value = random();
+				size_t run = (random() % 4 == 0)? random() % 300 + 1: 1;
+				for(; run > 0 && i < count; --run, ++i)
+					std::memcpy(pixels.data() + i * bytes, &value, bytes);
+			}
+
+			std::vector<uint8_t> packets(Image_TGA::getRLEBound(count, bytes));
+			const size_t size = Image_TGA::encodeRLE(pixels.data(), count, bytes, packets.data());
+			packets.resize(size);
+			REQUIRE(packets == encode(pixels.data(), count, bytes));
+
+			std::vector<uint8_t> decoded(count * bytes);
+			REQUIRE(Image_TGA::decodeRLE(packets.data(), size, bytes, decoded.data(), count) == size);
+			REQUIRE(decoded == pixels);
+			CHECK(Image_TGA::decodeRLE(packets.data(), size - 1, bytes, decoded.data(), count) == 0);
+			CHECK(Image_TGA::decodeRLE(packets.data(), size, bytes, decoded.data(), count - 1) == 0);
+		}
+
+	// both saved files decode to the image that was saved, BGR(A) in files and RGB(A) in memory.
+	constexpr uint32_t width = 203, height = 157;
+	for(Color::Format format: { Color::C1_U8, Color::C2_U8, Color::C3_U8, Color::C4_U8 })
+	{
+		const uint32_t bytes = Color::size(format);
+		const size_t rowSize = width * bytes;
+		Image_TGA image(width, height, format, new uint8_t[rowSize * height], true);
+		uint8_t* data = image.getData();
+		for(size_t i = 0; i < rowSize * height; ++i)
+			data[i] = static_cast<uint8_t>((i / bytes / 9) * 31 + (random() % 8 == 0? random(): 0));
+
+		REQUIRE(image.save("raw.tga"));
+		REQUIRE(image.save("rle.tga", true));
+		std::shared_ptr<Image_TGA> raw = Image_TGA::decodeFile("raw.tga");
+		std::shared_ptr<Image_TGA> rle = Image_TGA::decodeFile("rle.tga");
+		REQUIRE(raw);
+		REQUIRE(rle);
+		REQUIRE(rle->getColorFormat() == format);
+		REQUIRE(std::memcmp(raw->getData(), data, rowSize * height) == 0);
+		REQUIRE(std::memcmp(rle->getData(), data, rowSize * height) == 0);
+
+		std::string bytesOfFile = FileSystem::load(std::string("raw.tga"));
+		const uint8_t* file = reinterpret_cast<const uint8_t*>(bytesOfFile.data());
+		const uint8_t* first = file + sizeof(Image_TGA::Header);
+		CHECK((reinterpret_cast<const Image_TGA::Header*>(file)->descriptor & Image_TGA::DESC_TOP_TO_BOTTOM) != 0);
+		if(bytes >= 3)
+			CHECK((first[0] == data[2] && first[1] == data[1] && first[2] == data[0]));
+		else
+			CHECK(std::memcmp(first, data, bytes) == 0);
+
+		bytesOfFile = FileSystem::load(std::string("rle.tga"));
+		file = reinterpret_cast<const uint8_t*>(bytesOfFile.data());
+		REQUIRE(Image_TGA::probe(file, bytesOfFile.size()));
+		CHECK_FALSE(Image_TGA::decodeByteArray(file, sizeof(Image_TGA::Header) + 10));
+	}
+	std::remove("raw.tga");
+	std::remove("rle.tga");
+
+	SECTION("performance")
+	{
+		constexpr uint32_t size = 2048;
+		const size_t length = static_cast<size_t>(size) * size * 4;
+		Image_TGA image(size, size, Color::C4_U8, new uint8_t[length], true);
+		image.fillCheckerboard(16);
+		uint8_t* data = image.getData();
+		for(size_t i = 0; i < length; i += 4 * 61)  // some noise to break runs
+			data[i] = static_cast<uint8_t>(random());
+
+		std::vector<uint8_t> packets(Image_TGA::getRLEBound(size, 4) * size);
+		auto start = std::chrono::steady_clock::now();
+		size_t packetSize = 0;
+		for(uint32_t y = 0; y < size; ++y)
+			packetSize += Image_TGA::encodeRLE(data + y * size * 4, size, 4, packets.data() + packetSize);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		slog.i(TAG, "RLE encode %ux%u RGBA to %zu bytes: %.0f MB/s", size, size, packetSize, length / seconds * 1E-6);
+
+		std::vector<uint8_t> decoded(length);
+		start = std::chrono::steady_clock::now();
+		REQUIRE(Image_TGA::decodeRLE(packets.data(), packetSize, 4, decoded.data(), size * size) == packetSize);
+		seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		slog.i(TAG, "RLE decode %ux%u RGBA: %.0f MB/s", size, size, length / seconds * 1E-6);
+		REQUIRE(std::memcmp(decoded.data(), data, length) == 0);
+
+		start = std::chrono::steady_clock::now();
+		REQUIRE(image.save("large.rle.tga", true));
+		seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		slog.i(TAG, "save %ux%u RLE TGA: %.1f ms", size, size, seconds * 1E3);
+		std::remove("large.rle.tga");
+	}
+}
+
 TEST_CASE("ColorF", tag)
 {
 	vec4f white(1.0, 1.0, 1.0, 1.0);
@@ -273,3 +812,1657 @@ TEST_CASE("ColorF", tag)
 	vec4f gray(0.5, 0.5, 0.5, 1.0);
 	REQUIRE(ColorF::getColor(gray) == 0xFF7F7F7F);
 }
+
+/**
+ * Checks what reaches the GL thread without a GL context.
+ */
+class MockSink: public TextureLoader::Sink
+{
+public:
+	std::vector<int32_t> counts;
+	std::vector<uint32_t> widths;
+	std::thread::id thread;
+
+	bool upload(size_t index, const std::string& path, const std::shared_ptr<Image>& image) override
+	{
+		(void)path;
+		REQUIRE(std::this_thread::get_id() == thread);
+		counts.at(index) += 1;
+		widths.at(index) = image? image->getWidth(): 0;
+		return image != nullptr;
+	}
+};
+
+TEST_CASE("TextureLoader", tag)
+{
+	constexpr int32_t N = 16;
+	std::vector<std::string> filenames;
+	for(int32_t i = 0; i < N; ++i)
+	{
+		Image_BMP image(64 + i, 32, Color::C4_U8);
+		image.fillCheckerboard(8);
+		filenames.push_back("checkerboard" + std::to_string(i) + ".bmp");
+		REQUIRE(image.save(filenames.back()));
+	}
+
+	TextureLoader loader(4);
+	for(int32_t i = 0; i < N; ++i)
+	{
+		REQUIRE(loader.add(filenames[i]) == static_cast<size_t>(i));
+		REQUIRE(loader.add(filenames[i]) == static_cast<size_t>(i));  // deduplicated
+	}
+	REQUIRE(loader.add("missing.bmp") == N);
+	REQUIRE(loader.getSize() == N + 1);
+
+	MockSink sink;
+	sink.counts.resize(N + 1, 0);
+	sink.widths.resize(N + 1, 0);
+	sink.thread = std::this_thread::get_id();
+	loader.start();
+	loader.poll(sink, 1);
+	loader.finish(sink);
+	REQUIRE(loader.isDone());
+
+	const std::vector<TextureLoader::Record>& records = loader.getRecords();
+	for(int32_t i = 0; i <= N; ++i)
+	{
+		REQUIRE(sink.counts[i] == 1);
+		REQUIRE(records[i].success == (i < N));
+		if(i < N)
+			REQUIRE(sink.widths[i] == static_cast<uint32_t>(64 + i));
+		slog.i(TAG, "%s decode %.3fms upload %.3fms", records[i].path.c_str(),
+				records[i].decodeTime * 1000, records[i].uploadTime * 1000);
+	}
+}
+
+/**
+ * Peak signal-to-noise ratio in dB of RGBA images, over the first channelCount channels.
+ */
+static double computePSNR(const uint8_t* a, const uint8_t* b, size_t pixelCount, int32_t channelCount)
+{
+	double sum = 0;
+	for(size_t i = 0; i < pixelCount; ++i)
+		for(int32_t c = 0; c < channelCount; ++c)
+		{
+			double d = static_cast<double>(a[i * 4 + c]) - b[i * 4 + c];
+			sum += d * d;
+		}
+	double mse = sum / (pixelCount * channelCount);
+	return mse > 0? 10 * std::log10(255.0 * 255.0 / mse): 100.0;
+}
+
+TEST_CASE("Image_DXT", tag)
+{
+	// smooth gradients with some noise, width and height not multiple of 4.
+	constexpr int32_t width = 509, height = 383;
+	Image_DXT image(width, height, Color::C4_U8);
+	uint8_t* pixels = image.getData();
+	uint32_t seed = 1;
+	for(int32_t y = 0; y < height; ++y)
+		for(int32_t x = 0; x < width; ++x)
+		{
+			seed = seed * 1664525U + 1013904223U;
+			uint8_t* p = pixels + (y * width + x) * 4;
+			p[0] = x * 255 / width;
+			p[1] = y * 255 / height;
+			p[2] = static_cast<uint8_t>(128 + 100 * std::sin(x * 0.05) * std::cos(y * 0.07)) ^ ((seed >> 24) & 7);
+			p[3] = (x + y) * 255 / (width + height);
+		}
+
+	const size_t pixelCount = width * height;
+	std::vector<uint8_t> decoded(pixelCount * 4);
+	const Image_DXT::Quality qualities[] = { Image_DXT::Quality::RANGE_FIT, Image_DXT::Quality::CLUSTER_FIT };
+	const char* names[] = { "range fit", "cluster fit" };
+	double psnr[2];
+	for(int32_t q = 0; q < 2; ++q)
+	{
+		auto start = std::chrono::steady_clock::now();
+		std::vector<uint8_t> blocks = Image_DXT::convertImageToDXT1(pixels, width, height, 4, qualities[q]);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		REQUIRE(blocks.size() == static_cast<size_t>((width + 3) / 4 * ((height + 3) / 4) * 8));
+
+		Image_DXT::convertDXT1ToImage(blocks.data(), width, height, decoded.data());
+		psnr[q] = computePSNR(pixels, decoded.data(), pixelCount, 3);
+		slog.i(TAG, "DXT1 %s PSNR %.2fdB, %.1fM pixels/s", names[q], psnr[q], pixelCount / seconds * 1E-6);
+		REQUIRE(psnr[q] > 30.0);
+	}
+	REQUIRE(psnr[1] >= psnr[0]);
+
+	std::vector<uint8_t> blocks = Image_DXT::convertImageToDXT5(pixels, width, height, 4);
+	Image_DXT::convertDXT5ToImage(blocks.data(), width, height, decoded.data());
+	double alphaPSNR = 0;
+	{
+		std::vector<uint8_t> alpha0(pixelCount * 4), alpha1(pixelCount * 4);
+		for(size_t i = 0; i < pixelCount; ++i)
+		{
+			alpha0[i * 4] = pixels[i * 4 + 3];
+			alpha1[i * 4] = decoded[i * 4 + 3];
+		}
+		alphaPSNR = computePSNR(alpha0.data(), alpha1.data(), pixelCount, 1);
+	}
+	slog.i(TAG, "DXT5 color PSNR %.2fdB, alpha PSNR %.2fdB",
+			computePSNR(pixels, decoded.data(), pixelCount, 3), alphaPSNR);
+	REQUIRE(alphaPSNR > 40.0);
+
+	// .dds round trip gives the same pixels as decoding in memory.
+	const std::string filename = "gradient.dds";
+	REQUIRE(image.save(filename));
+	REQUIRE(ImageFactory::probe(filename) == Image::Format::DDS);
+	std::shared_ptr<Image> loaded = ImageFactory::decodeFile(filename);
+	REQUIRE(loaded);
+	REQUIRE(loaded->getWidth() == width);
+	REQUIRE(loaded->getHeight() == height);
+	REQUIRE(std::memcmp(loaded->getData(), decoded.data(), decoded.size()) == 0);
+}
+
+TEST_CASE("PixelConverter", tag)
+{
+	using Format = Color::Format;
+	using InstructionSet = PixelConverter::InstructionSet;
+	const Format formats[] =
+	{
+		Format::C1_U8, Format::C1_I16, Format::C1_U16, Format::C1_F16, Format::C1_I32, Format::C1_U32, Format::C1_F32,
+		Format::C2_U8, Format::C2_I16, Format::C2_U16, Format::C2_F16, Format::C2_I32, Format::C2_U32, Format::C2_F32,
+		Format::C3_U8, Format::C3_I16, Format::C3_U16, Format::C3_F16, Format::C3_I32, Format::C3_U32, Format::C3_F32,
+		Format::C4_U8, Format::C4_I16, Format::C4_U16, Format::C4_F16, Format::C4_I32, Format::C4_U32, Format::C4_F32,
+		Format::RGBA5551_U16, Format::RGBA4444_U16, Format::RGB565_U16, Format::RGBA1010102_U32,
+		Format::BGR888_U24, Format::BGRA8888_U32,
+	};
+
+	// opaque black and white survive any pair of formats.
+	const uint32_t colors[] = { 0xFF000000, 0xFFFFFFFF };
+	for(Format from: formats)
+		for(Format to: formats)
+		{
+			uint8_t a[2 * 16], b[2 * 16];
+			uint32_t result[2];
+			REQUIRE(PixelConverter::convert(Format::C4_U8, colors, from, a, 2));
+			REQUIRE(PixelConverter::convert(from, a, to, b, 2));
+			REQUIRE(PixelConverter::convert(to, b, Format::C4_U8, result, 2));
+			REQUIRE(result[0] == colors[0]);
+			REQUIRE(result[1] == colors[1]);
+		}
+
+	// formats with at least 8 bits per channel keep RGBA8888 exactly.
+	constexpr size_t count = 1021;  // leaves tails after vector loops
+	std::vector<uint8_t> pixels(count * 4);
+	uint32_t seed = 7;
+	for(uint8_t& c: pixels)
+	{
+		seed = seed * 1664525U + 1013904223U;
+		c = static_cast<uint8_t>(seed >> 24);
+	}
+	for(Format format: { Format::C4_U16, Format::C4_F16, Format::C4_U32, Format::C4_F32, Format::BGRA8888_U32 })
+	{
+		std::vector<uint8_t> converted(count * Color::size(format)), restored(count * 4);
+		PixelConverter::convert(Format::C4_U8, pixels.data(), format, converted.data(), count);
+		PixelConverter::convert(format, converted.data(), Format::C4_U8, restored.data(), count);
+		REQUIRE(restored == pixels);
+	}
+
+	// 16 bit packed formats round trip too.
+	for(Format format: { Format::RGB565_U16, Format::RGBA5551_U16, Format::RGBA4444_U16 })
+	{
+		std::vector<uint8_t> packed(count * 2), expanded(count * 4), repacked(count * 2);
+		for(size_t i = 0; i < count; ++i)
+		{
+			uint16_t x = static_cast<uint16_t>(i * 64 + i);
+			std::memcpy(&packed[i * 2], &x, 2);
+		}
+		PixelConverter::convert(format, packed.data(), Format::C4_U8, expanded.data(), count);
+		PixelConverter::convert(Format::C4_U8, expanded.data(), format, repacked.data(), count);
+		REQUIRE(repacked == packed);
+	}
+
+	const uint8_t straight[] = { 255, 128, 0, 128,  10, 20, 30, 0 };
+	uint8_t premultiplied[8], unpremultiplied[8];
+	PixelConverter::convert(Format::C4_U8, straight, Format::C4_U8, premultiplied, 2, PixelConverter::PREMULTIPLY);
+	REQUIRE(premultiplied[0] == 128);
+	REQUIRE(premultiplied[1] == 64);
+	REQUIRE(premultiplied[3] == 128);
+	REQUIRE(premultiplied[4] == 0);
+	PixelConverter::convert(Format::C4_U8, premultiplied, Format::C4_U8, unpremultiplied, 2, PixelConverter::UNPREMULTIPLY);
+	REQUIRE(unpremultiplied[0] == 255);
+	REQUIRE(unpremultiplied[1] == 128);
+	REQUIRE(unpremultiplied[4] == 0);
+
+	const uint32_t color = 0x80BC8000;  // R=0, G=128, B=188, A=128
+	float linear[4];
+	PixelConverter::convert(Format::C4_U8, &color, Format::C4_F32, linear, 1, PixelConverter::SRGB_TO_LINEAR);
+	REQUIRE(linear[0] == 0.0f);
+	REQUIRE(linear[1] == Approx(0.2158605f));
+	REQUIRE(linear[3] == Approx(128 / 255.0f));
+	uint32_t srgb;
+	PixelConverter::convert(Format::C4_F32, linear, Format::C4_U8, &srgb, 1, PixelConverter::LINEAR_TO_SRGB);
+	REQUIRE(srgb == color);
+
+	// every kernel gives the same bits as the scalar one.
+	struct Conversion
+	{
+		const char* name;
+		Format from, to;
+		uint32_t options;
+	};
+	const Conversion conversions[] =
+	{
+		{ "RGB888 -> RGBA8888",   Format::C3_U8,        Format::C4_U8,        PixelConverter::NONE },
+		{ "RGBA8888 -> RGB888",   Format::C4_U8,        Format::C3_U8,        PixelConverter::NONE },
+		{ "RGBA8888 -> BGRA8888", Format::C4_U8,        Format::BGRA8888_U32, PixelConverter::NONE },
+		{ "RGB888 -> BGR888",     Format::C3_U8,        Format::BGR888_U24,   PixelConverter::NONE },
+		{ "RGB565 -> RGBA8888",   Format::RGB565_U16,   Format::C4_U8,        PixelConverter::NONE },
+		{ "RGBA5551 -> RGBA8888", Format::RGBA5551_U16, Format::C4_U8,        PixelConverter::NONE },
+		{ "premultiply",          Format::C4_U8,        Format::C4_U8,        PixelConverter::PREMULTIPLY },
+		{ "unpremultiply",        Format::C4_U8,        Format::C4_U8,        PixelConverter::UNPREMULTIPLY },
+		{ "RGBA8888 -> RGBA F32", Format::C4_U8,        Format::C4_F32,       PixelConverter::NONE },
+		{ "RGBA F32 -> RGBA8888", Format::C4_F32,       Format::C4_U8,        PixelConverter::NONE },
+		{ "sRGB8 -> linear F32",  Format::C4_U8,        Format::C4_F32,       PixelConverter::SRGB_TO_LINEAR },
+		{ "RGBA8888 -> RGBA F16", Format::C4_U8,        Format::C4_F16,       PixelConverter::NONE },
+	};
+
+	const InstructionSet best = PixelConverter::getInstructionSet();
+	std::vector<uint8_t> source(count * 16), expected(count * 16), result(count * 16);
+	for(const Conversion& conversion: conversions)
+	{
+		// random bytes, or random floats a bit out of [0, 1] range.
+		for(size_t i = 0; i < count * 4; ++i)
+		{
+			seed = seed * 1664525U + 1013904223U;
+			if(conversion.from == Format::C4_F32)
+				reinterpret_cast<float*>(source.data())[i] = (seed >> 8) * (1.2f / 16777216) - 0.1f;
+			else
+				source[i] = static_cast<uint8_t>(seed >> 24);
+		}
+
+		PixelConverter::setInstructionSet(InstructionSet::SCALAR);
+		PixelConverter::convert(conversion.from, source.data(), conversion.to, expected.data(), count, conversion.options);
+		for(InstructionSet set: { InstructionSet::SSE4_1, InstructionSet::AVX2 })
+		{
+			PixelConverter::setInstructionSet(set);
+			std::fill(result.begin(), result.end(), 0);
+			PixelConverter::convert(conversion.from, source.data(), conversion.to, result.data(), count, conversion.options);
+			REQUIRE(std::memcmp(result.data(), expected.data(), count * Color::size(conversion.to)) == 0);
+		}
+	}
+
+	// gigapixels per second of each conversion, on a 2048x1024 image.
+	constexpr uint32_t width = 2048, height = 1024;
+	std::vector<uint8_t> src(width * height * 16), dst(width * height * 16);
+	for(size_t i = 0; i < src.size(); ++i)
+		src[i] = static_cast<uint8_t>(i * 7 + (i >> 8));
+	for(const Conversion& conversion: conversions)
+		for(InstructionSet set: { InstructionSet::SCALAR, InstructionSet::SSE4_1, InstructionSet::AVX2 })
+		{
+			PixelConverter::setInstructionSet(set);
+			if(PixelConverter::getInstructionSet() != set)
+				continue;
+
+			const size_t srcStride = width * Color::size(conversion.from);
+			const size_t dstStride = width * Color::size(conversion.to);
+			auto start = std::chrono::steady_clock::now();
+			constexpr int32_t repeat = 4;
+			for(int32_t i = 0; i < repeat; ++i)
+				PixelConverter::blit(conversion.from, src.data(), srcStride, conversion.to, dst.data(), dstStride,
+						width, height, conversion.options);
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			slog.i(TAG, "%-22s %-6s %.2f GP/s", conversion.name, PixelConverter::getName(set),
+					repeat * static_cast<double>(width) * height / seconds * 1E-9);
+		}
+	PixelConverter::setInstructionSet(best);
+
+	// fill spans and rects, then check with getPixel.
+	for(Format format: { Format::C3_U8, Format::RGB565_U16, Format::C4_U8 })
+	{
+		Image_BMP image(37, 5, format);
+		image.fillColor(0xFF0000FF);
+		REQUIRE(image.getPixel(0, 0) == image.getPixel(36, 4));
+		REQUIRE(Color::red(image.getPixel(17, 3)) >= 0xF8);
+		REQUIRE(Color::green(image.getPixel(17, 3)) == 0);
+
+		image.fillCheckerboard(4, 0xFF000000, 0xFFFFFFFF);
+		const uint32_t white = image.getPixel(0, 0), black = image.getPixel(4, 0);
+		REQUIRE(white != black);
+		for(uint32_t y = 0; y < 5; ++y)
+			for(uint32_t x = 0; x < 37; ++x)
+				REQUIRE(image.getPixel(x, y) == ((x / 4 + y / 4) % 2 != 0? black: white));
+	}
+
+	std::vector<uint16_t> rect(8 * 3, 0);
+	PixelConverter::fill(Format::RGB565_U16, rect.data() + 1, 8 * sizeof(uint16_t), 6, 3, 0xFF00FF00);
+	for(size_t y = 0; y < 3; ++y)
+		for(size_t x = 0; x < 8; ++x)
+			REQUIRE(rect[y * 8 + x] == (x >= 1 && x < 7? 0x07E0: 0));
+}
+
+TEST_CASE("Mipmap", tag)
+{
+	using Format = Color::Format;
+	using Filter = Mipmap::Filter;
+	REQUIRE(Mipmap::getLevelCount(1, 1) == 1U);
+	REQUIRE(Mipmap::getLevelCount(64, 16) == 7U);
+	REQUIRE(Mipmap::getLevelCount(37, 5) == 6U);
+
+	Mipmap mipmap;
+	Image_BMP image(37, 5, Format::C4_U8);
+	image.fillColor(0xFF336699);
+	for(Filter filter: { Filter::BOX, Filter::KAISER, Filter::LANCZOS })
+	{
+		Mipmap::Parameter parameter;
+		parameter.filter = filter;
+		REQUIRE(mipmap.generate(image, parameter));
+		REQUIRE(mipmap.getLevelCount() == 6U);
+		const uint32_t sizes[][2] = { {37, 5}, {18, 2}, {9, 1}, {4, 1}, {2, 1}, {1, 1} };
+		size_t offset = 0;
+		for(uint32_t i = 0; i < mipmap.getLevelCount(); ++i)
+		{
+			const Mipmap::Level& level = mipmap.getLevel(i);
+			REQUIRE(level.width == sizes[i][0]);
+			REQUIRE(level.height == sizes[i][1]);
+			REQUIRE(level.offset == offset);
+			offset += level.width * level.height * 4;
+
+			// constant color stays constant with any filter.
+			const uint32_t* pixels = reinterpret_cast<const uint32_t*>(mipmap.getData(i));
+			for(uint32_t j = 0; j < level.width * level.height; ++j)
+				REQUIRE(pixels[j] == 0xFF336699);
+		}
+		REQUIRE(mipmap.getSize() == offset);
+	}
+
+	// black and white average to sRGB 188 rather than 128, as they do on screen.
+	image.fillCheckerboard(1, 0xFF000000, 0xFFFFFFFF);
+	Mipmap::Parameter parameter;
+	parameter.filter = Filter::BOX;
+	REQUIRE(mipmap.generate(image, parameter));
+	REQUIRE(mipmap.getData(1)[4 * 5] == 188);
+	parameter.srgb = false;
+	REQUIRE(mipmap.generate(image, parameter));
+	REQUIRE(mipmap.getData(1)[4 * 5] == 128);
+
+	// a circle cut out keeps its alpha tested coverage.
+	constexpr uint32_t size = 256;
+	Image_BMP cutout(size, size, Format::C4_U8);
+	for(uint32_t y = 0; y < size; ++y)
+		for(uint32_t x = 0; x < size; ++x)
+		{
+			float dx = x + 0.5f - size / 2, dy = y + 0.5f - size / 2;
+			float alpha = std::sqrt(dx * dx + dy * dy) < size / 3? 1.0f: 0.0f;
+			if((x / 8 + y / 8) % 2 == 0)  // leaves like holes
+				alpha *= 0.6f;
+			cutout.setPixel(x, y, 0x00FFFFFF | static_cast<uint32_t>(alpha * 255) << 24);
+		}
+	auto coverage = [&mipmap](uint32_t level)
+	{
+		const Mipmap::Level& l = mipmap.getLevel(level);
+		const uint8_t* pixels = mipmap.getData(level);
+		uint32_t n = 0;
+		for(uint32_t i = 0; i < l.width * l.height; ++i)
+			n += pixels[i * 4 + 3] > 0.7f * 255;
+		return static_cast<float>(n) / (l.width * l.height);
+	};
+	parameter = Mipmap::Parameter();
+	REQUIRE(mipmap.generate(cutout, parameter));
+	const float reference = coverage(0);
+	const float filtered = coverage(4);
+	parameter.alphaCutoff = 0.7f;
+	REQUIRE(mipmap.generate(cutout, parameter));
+	REQUIRE(coverage(0) == reference);
+	for(uint32_t level = 1; level <= 4; ++level)
+		REQUIRE(coverage(level) == Approx(reference).epsilon(0.1));
+	REQUIRE(std::abs(coverage(4) - reference) < std::abs(filtered - reference));
+
+	Image_BMP large(2048, 2048, Format::C4_U8);
+	large.fillCheckerboard(16, 0xFF204080, 0xFFF0E0D0);
+	for(Filter filter: { Filter::BOX, Filter::KAISER, Filter::LANCZOS })
+	{
+		parameter = Mipmap::Parameter();
+		parameter.filter = filter;
+		auto start = std::chrono::steady_clock::now();
+		mipmap.generate(large, parameter);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		slog.i(TAG, "mipmap 2048x2048 filter %d: %.1f ms", static_cast<int>(filter), seconds * 1E3);
+	}
+}
+
+TEST_CASE("Resampler", tag)
+{
+	using Filter = Resampler::Filter;
+	const Filter filters[] = { Filter::BOX, Filter::BILINEAR, Filter::BICUBIC, Filter::LANCZOS3, Filter::KAISER };
+
+	SECTION("constant color is kept")
+	{
+		const Color::Format formats[] = { Color::C4_U8, Color::C3_U8, Color::C1_F32, Color::RGB565_U16 };
+		const uint32_t sizes[][2] = { {37, 23}, {5, 3}, {101, 67}, {1, 1} };
+		for(Color::Format format: formats)
+		for(Filter filter: filters)
+		for(const auto& size: sizes)
+		{
+			const size_t pixelSize = Color::size(format);
+			std::vector<uint8_t> src(37 * 23 * pixelSize), dst(size[0] * size[1] * pixelSize), expect(dst.size());
+			PixelConverter::fill(format, src.data(), 37 * 23, 0x80C04020);
+			PixelConverter::fill(format, expect.data(), size[0] * size[1], 0x80C04020);
+			REQUIRE(Resampler::resample(format, src.data(), 37, 23, 37 * pixelSize,
+					dst.data(), size[0], size[1], size[0] * pixelSize, filter, Resampler::PREMULTIPLY_ALPHA));
+			if(!Color::isFloatType(format))
+				CHECK(dst == expect);
+			else
+				for(size_t i = 0; i < dst.size(); i += sizeof(float))
+					CHECK(*reinterpret_cast<float*>(&dst[i]) == Approx(*reinterpret_cast<float*>(&expect[i])));
+		}
+	}
+
+	SECTION("same size copies")
+	{
+		std::vector<uint8_t> src(17 * 9 * 4), dst(src.size());
+		for(size_t i = 0; i < src.size(); ++i)
+			src[i] = static_cast<uint8_t>(i * 37);
+		for(Filter filter: filters)
+		{
+			REQUIRE(Resampler::resample(Color::C4_U8, src.data(), 17, 9, 17 * 4, dst.data(), 17, 9, 17 * 4, filter));
+			CHECK(dst == src);
+		}
+	}
+
+	SECTION("bilinear")
+	{
+		const float src[2] = { 0.0f, 1.0f };
+		float dst[4];
+		Resampler::resample(src, 2, 1, dst, 4, 1, 1, Filter::BILINEAR);
+		CHECK(dst[0] == Approx(0.00f));
+		CHECK(dst[1] == Approx(0.25f));
+		CHECK(dst[2] == Approx(0.75f));
+		CHECK(dst[3] == Approx(1.00f));
+
+		float half[1];
+		Resampler::resample(src, 2, 1, half, 1, 1, 1, Filter::BOX);
+		CHECK(half[0] == Approx(0.5f));
+	}
+
+	SECTION("premultiplied alpha")
+	{
+		// transparent red next to opaque green, red shouldn't bleed into the average.
+		const uint32_t src[2] = { 0x000000FF, 0xFF00FF00 };
+		uint32_t dst[1];
+		REQUIRE(Resampler::resample(Color::C4_U8, src, 2, 1, sizeof(src), dst, 1, 1, sizeof(dst),
+				Filter::BOX, Resampler::PREMULTIPLY_ALPHA));
+		CHECK(Color::red(dst[0]) == 0);
+		CHECK(Color::green(dst[0]) == 0xFF);
+		CHECK(Color::alpha(dst[0]) == 0x80);
+
+		REQUIRE(Resampler::resample(Color::C4_U8, src, 2, 1, sizeof(src), dst, 1, 1, sizeof(dst), Filter::BOX));
+		CHECK(Color::red(dst[0]) == 0x80);
+	}
+
+	SECTION("row order")
+	{
+		// a view of a bottom-up TGA, whose row y from the top is filled with y * 16 + x.
+		constexpr uint32_t width = 4, height = 3, rowSize = width * 4;
+		std::vector<uint8_t> file(18 + rowSize * height);
+		file[2] = 2;  // uncompressed true color
+		file[12] = width;
+		file[14] = height;
+		file[16] = 32;
+		file[17] = 8;  // alpha bits, rows from bottom to top
+		for(uint32_t y = 0; y < height; ++y)
+			for(uint32_t x = 0; x < rowSize; ++x)
+				file[18 + (height - 1 - y) * rowSize + x] = static_cast<uint8_t>(y * 16 + x);
+		const std::string filename = "rows.tga";
+		std::ofstream(filename, std::ios::binary).write(reinterpret_cast<const char*>(file.data()), file.size());
+
+		std::shared_ptr<Image> src = ImageFactory::decodeFile(filename, true);
+		REQUIRE(dynamic_cast<MappedImage*>(src.get()) != nullptr);
+		REQUIRE(src->isBottomUp());
+		Image_TGA dst(width, height, src->getColorFormat(), new uint8_t[rowSize * height], true);
+		REQUIRE(Resampler::resample(*src, dst, Filter::BOX));
+		for(uint32_t y = 0; y < height; ++y)
+			for(uint32_t x = 0; x < rowSize; ++x)
+				CHECK(dst.getData()[y * rowSize + x] == y * 16 + x);
+		std::remove(filename.c_str());
+	}
+
+	SECTION("invalid")
+	{
+		uint8_t pixels[16];
+		CHECK_FALSE(Resampler::resample(Color::UNKNOWN, pixels, 2, 2, 8, pixels, 1, 1, 4, Filter::BOX));
+		CHECK_FALSE(Resampler::resample(Color::C4_U8, pixels, 0, 2, 8, pixels, 1, 1, 4, Filter::BOX));
+	}
+
+	SECTION("performance")
+	{
+		auto benchmark = [](uint32_t srcWidth, uint32_t srcHeight, uint32_t dstWidth, uint32_t dstHeight, Filter filter)
+		{
+			std::vector<uint32_t> src(static_cast<size_t>(srcWidth) * srcHeight), dst(static_cast<size_t>(dstWidth) * dstHeight);
+			for(size_t i = 0; i < src.size(); ++i)
+				src[i] = static_cast<uint32_t>(i * 2654435761U);
+			auto start = std::chrono::steady_clock::now();
+			Resampler::resample(Color::C4_U8, src.data(), srcWidth, srcHeight, srcWidth * 4,
+					dst.data(), dstWidth, dstHeight, dstWidth * 4, filter, Resampler::PREMULTIPLY_ALPHA);
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			slog.i(TAG, "resample %ux%u to %ux%u filter %d: %.1f ms, %.0f MP/s", srcWidth, srcHeight,
+					dstWidth, dstHeight, static_cast<int>(filter), seconds * 1E3, dst.size() / seconds * 1E-6);
+		};
+		benchmark(4096, 4096, 1024, 1024, Filter::LANCZOS3);
+		benchmark(1920, 1080, 3840, 2160, Filter::BICUBIC);
+	}
+}
+
+TEST_CASE("AtlasPacker", tag)
+{
+	using Region = AtlasPacker::Region;
+	const AtlasPacker::Method methods[] = { AtlasPacker::Method::SKYLINE, AtlasPacker::Method::MAX_RECTS };
+
+	auto random = [seed = 1U]() mutable { seed = seed * 1664525U + 1013904223U; return seed >> 8; };
+	std::vector<vec2u> sizes(2000);
+	for(vec2u& size: sizes)
+		size = vec2u(1 + random() % 48, 1 + random() % 48);
+
+	SECTION("no overlap")
+	{
+		constexpr uint32_t SIZE = 512, PADDING = 2;
+		for(AtlasPacker::Method method: methods)
+		{
+			AtlasPacker packer(SIZE, SIZE, PADDING, method);
+			std::vector<Region> regions(sizes.size());
+			REQUIRE(packer.pack(sizes.data(), sizes.size(), regions.data()));
+			REQUIRE(packer.getPageCount() > 1);
+
+			// every pixel belongs to one cell at most, padding included.
+			std::vector<uint8_t> used(static_cast<size_t>(packer.getPageCount()) * SIZE * SIZE, 0);
+			bool overlap = false, outside = false;
+			for(size_t i = 0; i < sizes.size(); ++i)
+			{
+				const Rect<int32_t>& rect = regions[i].rect;
+				CHECK(rect.getWidth() == static_cast<int32_t>(sizes[i].x));
+				CHECK(rect.getHeight() == static_cast<int32_t>(sizes[i].y));
+				outside |= rect.left < static_cast<int32_t>(PADDING) || rect.top < static_cast<int32_t>(PADDING) ||
+						rect.right + PADDING > SIZE || rect.bottom + PADDING > SIZE;
+				uint8_t* page = used.data() + static_cast<size_t>(regions[i].page) * SIZE * SIZE;
+				for(int32_t y = rect.top - PADDING; y < rect.bottom + static_cast<int32_t>(PADDING); ++y)
+				for(int32_t x = rect.left - PADDING; x < rect.right + static_cast<int32_t>(PADDING); ++x)
+					overlap |= page[y * SIZE + x]++ != 0;
+			}
+			CHECK_FALSE(outside);
+			CHECK_FALSE(overlap);
+
+			// all pages but the last are fairly full.
+			for(uint32_t page = 0; page + 1 < packer.getPageCount(); ++page)
+				CHECK(packer.getOccupancy(page) > 0.8F);
+		}
+	}
+
+	SECTION("incremental insertion")
+	{
+		AtlasPacker packer(64, 64, 1, AtlasPacker::Method::SKYLINE, 1);
+		Region a, b, c;
+		REQUIRE(packer.insert(30, 20, a));
+		REQUIRE(packer.insert(30, 20, b));
+		CHECK(a.rect == Rect<int32_t>(1, 1, 31, 21));
+		CHECK(b.rect == Rect<int32_t>(33, 1, 63, 21));
+		CHECK(packer.getExtent(0) == vec2u(64, 22));
+
+		REQUIRE(packer.insert(0, 5, c));  // empty ones take no room
+		CHECK(c.rect.isEmpty());
+
+		CHECK_FALSE(packer.insert(63, 10, c));  // wider than page with padding
+		REQUIRE(packer.insert(62, 40, c));
+		CHECK(c.rect == Rect<int32_t>(1, 23, 63, 63));
+		CHECK_FALSE(packer.insert(1, 1, c));  // the only page is full
+
+		Rect<float> uv = packer.getTextureRect(a);
+		CHECK(uv.left == Approx(1 / 64.0F));
+		CHECK(uv.bottom == Approx(21 / 64.0F));
+	}
+
+	SECTION("images with bleed")
+	{
+		Image_PNG red(2, 2, Color::C4_U8), green(3, 1, Color::C4_U8);
+		PixelConverter::fill(Color::C4_U8, red.getData(), 4, 0xFF0000FF);
+		PixelConverter::fill(Color::C4_U8, green.getData(), 3, 0xFF00FF00);
+		uint32_t* pixels = reinterpret_cast<uint32_t*>(red.getData());
+		pixels[3] = 0xFFFF0000;  // bottom right pixel blue
+
+		AtlasPacker packer(16, 8, 2);
+		std::vector<Region> regions;
+		std::vector<std::shared_ptr<Image>> pages = packer.pack({&red, &green}, regions);
+		REQUIRE(pages.size() == 1);
+		const Image& page = *pages[0];
+		auto at = [&page](int32_t x, int32_t y) { return reinterpret_cast<const uint32_t*>(page.getData())[y * page.getWidth() + x]; };
+
+		const Rect<int32_t>& r = regions[0].rect;
+		CHECK(r.getWidth() == 2);
+		CHECK(at(r.left, r.top) == 0xFF0000FF);
+		CHECK(at(r.left - 2, r.top - 2) == 0xFF0000FF);  // corners are extended too.
+		CHECK(at(r.right + 1, r.bottom + 1) == 0xFFFF0000);
+		CHECK(at(r.right + 1, r.top) == 0xFF0000FF);
+
+		const Rect<int32_t>& g = regions[1].rect;
+		CHECK(at(g.left - 1, g.top - 1) == 0xFF00FF00);
+		CHECK(at(g.right, g.bottom + 1) == 0xFF00FF00);
+
+		Image_PNG gray(1, 1, Color::C1_U8);
+		CHECK(packer.pack({&red, &gray}, regions).empty());
+
+		// images go to pages of their own, not to the one above.
+		pages = packer.pack({&green}, regions);
+		REQUIRE(pages.size() == 1);
+		CHECK(regions[0].page == 1);
+		CHECK(packer.getPageCount() == 2);
+	}
+
+	SECTION("all or none")
+	{
+		AtlasPacker packer(16, 16, 0, AtlasPacker::Method::SKYLINE, 2);
+		Region a;
+		REQUIRE(packer.insert(8, 8, a));
+
+		// the second page is opened, then the last rectangle fits nowhere.
+		const vec2u more[] = { vec2u(16, 16), vec2u(8, 4), vec2u(16, 16) };
+		Region regions[3];
+		CHECK_FALSE(packer.pack(more, 3, regions));
+		CHECK(packer.getPageCount() == 1);
+		CHECK(packer.getOccupancy(0) == Approx(0.25F));
+		for(const Region& region: regions)
+			CHECK(region.rect.isEmpty());
+
+		Image_PNG large(16, 16, Color::C4_U8), small(8, 8, Color::C4_U8);
+		std::vector<Region> imageRegions;
+		CHECK(packer.pack({&large, &large}, imageRegions).empty());
+		CHECK(packer.getPageCount() == 1);
+
+		REQUIRE(packer.insert(8, 8, a));
+		CHECK(a.rect == Rect<int32_t>(8, 0, 16, 8));
+		REQUIRE(packer.pack({&small}, imageRegions).size() == 1);
+		CHECK(imageRegions[0].page == 1);
+	}
+
+	SECTION("performance")
+	{
+		std::vector<vec2u> many(10000);
+		for(vec2u& size: many)
+			size = vec2u(4 + random() % 60, 4 + random() % 60);
+		std::vector<Region> regions(many.size());
+		for(AtlasPacker::Method method: methods)
+		{
+			const size_t count = method == AtlasPacker::Method::SKYLINE? many.size(): many.size() / 5;
+			AtlasPacker packer(2048, 2048, 1, method);
+			auto start = std::chrono::steady_clock::now();
+			REQUIRE(packer.pack(many.data(), count, regions.data()));
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			slog.i(TAG, "pack %zu rectangles with method %d: %.2f ms, %u pages, occupancy %.3f", count,
+					static_cast<int>(method), seconds * 1E3, packer.getPageCount(), packer.getOccupancy(0));
+		}
+	}
+}
+
+TEST_CASE("KTX", tag)
+{
+	auto noise = [](uint32_t width, uint32_t height, Color::Format format, uint32_t seed)
+	{
+		auto image = std::make_shared<Image_PNG>(width, height, format);
+		uint8_t* data = image->getData();
+		for(size_t i = 0, size = static_cast<size_t>(width) * height * Color::size(format); i < size; ++i)
+		{
+			seed = seed * 1664525U + 1013904223U;
+			data[i] = static_cast<uint8_t>(seed >> 24);
+		}
+		return image;
+	};
+	auto same = [](const Image& a, const Image& b)
+	{
+		return a.getWidth() == b.getWidth() && a.getHeight() == b.getHeight() && a.getColorFormat() == b.getColorFormat() &&
+				std::memcmp(a.getData(), b.getData(), a.getWidth() * a.getHeight() * Color::size(a.getColorFormat())) == 0;
+	};
+	const KTX::Version versions[] = { KTX::Version::KTX1, KTX::Version::KTX2 };
+	const char* paths[] = { "noise.ktx", "noise.ktx2" };
+
+	SECTION("mip chain")
+	{
+		std::shared_ptr<Image> image = noise(37, 23, Color::C3_U8, 5);
+		Mipmap mipmap;
+		REQUIRE(mipmap.generate(*image));
+
+		KTX ktx;
+		REQUIRE(ktx.create(Color::C3_U8, KTX::Compression::NONE, 37, 23, mipmap.getLevelCount(), 0, 1, true));
+		REQUIRE(ktx.setMipmap(mipmap));
+		for(int32_t i = 0; i < 2; ++i)
+		{
+			REQUIRE(ktx.save(paths[i], versions[i]));
+			KTX file;
+			REQUIRE(file.open(paths[i]));
+			CHECK(file.getRowAlignment() == (i == 0? 4U: 1U));
+			CHECK(file.isSrgb());
+			CHECK_FALSE(file.isBottomUp());
+			REQUIRE(file.getLevelCount() == mipmap.getLevelCount());
+			for(uint32_t level = 0; level < mipmap.getLevelCount(); ++level)
+			{
+				const Mipmap::Level& l = mipmap.getLevel(level);
+				CHECK(file.getLevel(level).width == l.width);
+				CHECK(file.getLevel(level).height == l.height);
+				std::shared_ptr<Image> decoded = file.decode(level);
+				REQUIRE(decoded);
+				CHECK(std::memcmp(decoded->getData(), mipmap.getData(level), l.size) == 0);
+			}
+		}
+	}
+
+	SECTION("block compression")
+	{
+		std::shared_ptr<Image> image = noise(64, 48, Color::C4_U8, 7);
+		for(KTX::Compression compression: { KTX::Compression::BC1, KTX::Compression::BC3 })
+		{
+			KTX ktx;
+			REQUIRE(ktx.create(Color::C4_U8, compression, 64, 48, 3));
+			REQUIRE(ktx.setImage(*image));
+			CHECK(ktx.getLevel(0).imageSize == 16 * 12 * (compression == KTX::Compression::BC1? 8U: 16U));
+			CHECK(ktx.getLevel(2).imageSize == 4 * 3 * (compression == KTX::Compression::BC1? 8U: 16U));
+			CHECK(ktx.getGLFormat() == 0);
+
+			std::vector<uint8_t> rgba(64 * 48 * 4);
+			if(compression == KTX::Compression::BC1)
+				Image_DXT::convertDXT1ToImage(ktx.getData(0), 64, 48, rgba.data());
+			else
+				Image_DXT::convertDXT5ToImage(ktx.getData(0), 64, 48, rgba.data());
+
+			for(int32_t i = 0; i < 2; ++i)
+			{
+				REQUIRE(ktx.save(paths[i], versions[i]));
+				KTX file;
+				REQUIRE(file.open(paths[i]));
+				REQUIRE(file.getCompression() == compression);
+				CHECK(file.getGLInternalFormat() == ktx.getGLInternalFormat());
+				CHECK(std::memcmp(file.getData(0), ktx.getData(0), ktx.getLevel(0).imageSize) == 0);
+				std::shared_ptr<Image> decoded = file.decode(0);
+				CHECK(std::memcmp(decoded->getData(), rgba.data(), rgba.size()) == 0);
+			}
+		}
+	}
+
+	SECTION("cube array")
+	{
+		// 5 pixels of RGB take 15 bytes, rows are padded in KTX1.
+		KTX ktx;
+		REQUIRE(ktx.create(Color::C3_U8, KTX::Compression::NONE, 5, 5, 2, 2, 6));
+		CHECK_FALSE(ktx.create(Color::C3_U8, KTX::Compression::NONE, 5, 4, 1, 0, 6));  // faces are square.
+		REQUIRE(ktx.create(Color::C3_U8, KTX::Compression::NONE, 5, 5, 2, 2, 6));
+		std::vector<std::shared_ptr<Image>> faces;
+		for(uint32_t layer = 0; layer < 2; ++layer)
+			for(uint32_t face = 0; face < 6; ++face)
+			{
+				faces.push_back(noise(5, 5, Color::C3_U8, layer * 6 + face));
+				REQUIRE(ktx.setImage(*faces.back(), 0, layer, face));
+			}
+
+		for(int32_t i = 0; i < 2; ++i)
+		{
+			REQUIRE(ktx.save(paths[i], versions[i]));
+			KTX file;
+			REQUIRE(file.open(paths[i]));
+			REQUIRE(file.isCube());
+			REQUIRE(file.isArray());
+			REQUIRE(file.getLayerCount() == 2);
+			for(uint32_t layer = 0; layer < 2; ++layer)
+				for(uint32_t face = 0; face < 6; ++face)
+					CHECK(same(*file.decode(0, layer, face), *faces[layer * 6 + face]));
+		}
+
+		// a cube without layers has its imageSize be the one of a face in KTX1.
+		REQUIRE(ktx.create(Color::C3_U8, KTX::Compression::NONE, 5, 5, 1, 0, 6));
+		for(uint32_t face = 0; face < 6; ++face)
+			REQUIRE(ktx.setImage(*faces[face], 0, 0, face));
+		REQUIRE(ktx.save(paths[0], KTX::Version::KTX1));
+		KTX file;
+		REQUIRE(file.open(paths[0]));
+		CHECK(same(*file.decode(0, 0, 5), *faces[5]));
+	}
+
+	SECTION("orientation")
+	{
+		std::shared_ptr<Image> image = noise(8, 6, Color::C4_U8, 11);
+		KTX ktx;
+		REQUIRE(ktx.create(Color::C4_U8, KTX::Compression::NONE, 8, 6));
+		ktx.setBottomUp(true);
+		REQUIRE(ktx.setImage(*image));
+		CHECK(std::memcmp(ktx.getData(0), image->getData() + 5 * 8 * 4, 8 * 4) == 0);  // bottom row first
+		CHECK(same(*ktx.decode(), *image));
+
+		for(int32_t i = 0; i < 2; ++i)
+		{
+			REQUIRE(ktx.save(paths[i], versions[i]));
+			KTX file;
+			REQUIRE(file.open(paths[i]));
+			CHECK(file.isBottomUp());
+			CHECK(same(*file.decode(), *image));
+		}
+	}
+
+	SECTION("1D and 3D")
+	{
+		// KTX1 header of RGB8 pixels, then imageSize and images of each level, rows padded to 4 bytes.
+		auto header = [](uint32_t width, uint32_t height, uint32_t depth, uint32_t layerCount, uint32_t faceCount,
+				uint32_t levelCount)
+		{
+			const uint32_t words[13] = { 0x04030201, 0x1401, 1, 0x1907, 0x8051, 0x1907,
+					width, height, depth, layerCount, faceCount, levelCount, 0 };
+			std::vector<uint8_t> bytes(KTX::MAGIC_KTX1, KTX::MAGIC_KTX1 + sizeof(KTX::MAGIC_KTX1));
+			const uint8_t* begin = reinterpret_cast<const uint8_t*>(words);
+			bytes.insert(bytes.end(), begin, begin + sizeof(words));
+			return bytes;
+		};
+		auto appendLevel = [](std::vector<uint8_t>& bytes, uint32_t imageSize)
+		{
+			const uint8_t* begin = reinterpret_cast<const uint8_t*>(&imageSize);
+			bytes.insert(bytes.end(), begin, begin + 4);
+			bytes.resize(bytes.size() + imageSize, 0);
+			return bytes.data() + bytes.size() - imageSize;
+		};
+
+		// 3x2x4 volume of 2 levels, voxel (x, y, z) has its channels be z * 16 + y * 4 + x.
+		std::vector<uint8_t> bytes = header(3, 2, 4, 0, 1, 2);
+		uint8_t* voxels = appendLevel(bytes, 12 * 2 * 4);
+		for(uint32_t z = 0; z < 4; ++z)
+			for(uint32_t y = 0; y < 2; ++y)
+				for(uint32_t x = 0; x < 3; ++x)
+					std::memset(voxels + z * 24 + y * 12 + x * 3, z * 16 + y * 4 + x, 3);
+		appendLevel(bytes, 4 * 1 * 2);
+
+		KTX ktx;
+		REQUIRE(ktx.decodeByteArray(bytes.data(), bytes.size()));
+		CHECK(ktx.is3D());
+		CHECK(ktx.getDepth() == 4);
+		CHECK(ktx.getLevel(0).imageSize == 12 * 2 * 4);
+		CHECK(ktx.getLevel(1).width == 1);
+		CHECK(ktx.getLevel(1).height == 1);
+		CHECK(ktx.getLevel(1).depth == 2);
+		CHECK(ktx.decode() == nullptr);
+
+		REQUIRE(ktx.save(paths[1]));
+		KTX file;
+		REQUIRE(file.open(paths[1]));
+		CHECK(file.getDepth() == 4);
+		CHECK(file.getLevel(0).imageSize == 9 * 2 * 4);
+		bool same = true;
+		for(uint32_t z = 0; z < 4; ++z)
+			for(uint32_t y = 0; y < 2; ++y)
+				for(uint32_t x = 0; x < 3; ++x)
+					same &= std::memcmp(file.getData(0) + z * 18 + y * 9 + x * 3, voxels + z * 24 + y * 12 + x * 3, 3) == 0;
+		CHECK(same);
+
+		// 3D cube maps and arrays of 3D textures don't exist.
+		bytes = header(2, 2, 2, 0, 6, 1);
+		appendLevel(bytes, 8 * 2 * 2);
+		CHECK_FALSE(ktx.decodeByteArray(bytes.data(), bytes.size()));
+		bytes = header(2, 2, 2, 3, 1, 1);
+		appendLevel(bytes, 8 * 2 * 2 * 3);
+		CHECK_FALSE(ktx.decodeByteArray(bytes.data(), bytes.size()));
+
+		// 1D texture of 0 height, 5 pixels of 15 bytes are padded to 16.
+		bytes = header(5, 0, 0, 0, 1, 3);
+		appendLevel(bytes, 16);
+		appendLevel(bytes, 8);
+		appendLevel(bytes, 4);
+		REQUIRE(ktx.decodeByteArray(bytes.data(), bytes.size()));
+		CHECK_FALSE(ktx.is3D());
+		CHECK(ktx.getHeight() == 1);
+		CHECK(ktx.getLevel(2).width == 1);
+		CHECK(ktx.getLevel(0).imageSize == 16);
+	}
+
+	SECTION("invalid")
+	{
+		KTX ktx;
+		CHECK_FALSE(ktx.create(Color::C4_I16, KTX::Compression::NONE, 4, 4));
+		CHECK_FALSE(ktx.create(Color::C1_U8, KTX::Compression::BC1, 4, 4));
+		CHECK_FALSE(ktx.create(Color::C4_U8, KTX::Compression::NONE, 4, 4, 4));  // 3 levels at most
+
+		REQUIRE(ktx.create(Color::C4_U8, KTX::Compression::NONE, 16, 16, 5));
+		REQUIRE(ktx.save(paths[1]));
+		std::string bytes = FileSystem::load(std::string(paths[1]));
+		const uint8_t* data = reinterpret_cast<const uint8_t*>(bytes.data());
+		REQUIRE(KTX::probe(data, bytes.size()));
+		CHECK(ktx.decodeByteArray(data, bytes.size()));
+		CHECK_FALSE(ktx.decodeByteArray(data, bytes.size() - 1));
+		CHECK_FALSE(ktx.isValid());
+	}
+
+	SECTION("performance")
+	{
+		constexpr uint32_t size = 2048;
+		std::shared_ptr<Image> image = noise(size, size, Color::C4_U8, 13);
+		KTX ktx;
+		REQUIRE(ktx.create(Color::C4_U8, KTX::Compression::NONE, size, size, Mipmap::getLevelCount(size, size)));
+		for(uint32_t level = 0; level < ktx.getLevelCount(); ++level)
+			std::memset(ktx.getData(level), level, ktx.getLevel(level).imageSize);
+		REQUIRE(ktx.save(paths[1]));
+
+		auto start = std::chrono::steady_clock::now();
+		KTX file;
+		REQUIRE(file.open(paths[1]));
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		CHECK(file.getData(11)[0] == 11);
+		slog.i(TAG, "open %ux%u KTX2 of %u levels: %.3f ms", size, size, file.getLevelCount(), seconds * 1E3);
+
+		start = std::chrono::steady_clock::now();
+		KTX compressed;
+		REQUIRE(compressed.create(Color::C4_U8, KTX::Compression::BC3, size, size));
+		REQUIRE(compressed.setImage(*image));
+		seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		slog.i(TAG, "compress %ux%u to BC3: %.1f ms", size, size, seconds * 1E3);
+	}
+}
+
+TEST_CASE("Canvas", tag)
+{
+	constexpr int32_t size = 64;
+	Canvas canvas(std::make_unique<Image_PNG>(size, size, Color::C4_U8));
+	Image& bitmap = canvas.getBitmap();
+	auto pixel = [&bitmap](int32_t x, int32_t y) { return bitmap.getData() + (y * size + x) * 4; };
+	auto alphaSum = [&bitmap]()
+	{
+		uint64_t sum = 0;
+		for(int32_t i = 0; i < size * size; ++i)
+			sum += bitmap.getData()[i * 4 + 3];
+		return sum / 255.0;
+	};
+	auto clear = [&bitmap]() { std::memset(bitmap.getData(), 0, size * size * 4); };
+	clear();
+
+	Paint paint;
+	paint.setColor(vec4f(1, 0, 0, 1));
+	paint.setAntiAlias(true);
+
+	SECTION("rect")
+	{
+		canvas.drawRect(Rect<float>(8, 8, 24, 16), paint);
+		CHECK(pixel(8, 8)[0] == 255);
+		CHECK(pixel(8, 8)[3] == 255);
+		CHECK(pixel(23, 15)[3] == 255);
+		CHECK(pixel(7, 8)[3] == 0);
+		CHECK(pixel(24, 8)[3] == 0);
+		CHECK(pixel(8, 16)[3] == 0);
+		CHECK(alphaSum() == Approx(16 * 8));
+
+		// half covered edge pixels
+		clear();
+		canvas.drawRect(Rect<float>(8.5F, 8, 24, 16.5F), paint);
+		CHECK(std::abs(pixel(8, 10)[3] - 128) <= 1);
+		CHECK(std::abs(pixel(10, 16)[3] - 128) <= 1);
+		CHECK(std::abs(pixel(8, 16)[3] - 64) <= 1);
+		CHECK(alphaSum() == Approx(15.5 * 8.5).epsilon(0.01));
+
+		// aliased
+		clear();
+		paint.setAntiAlias(false);
+		canvas.drawRect(Rect<float>(8.4F, 8, 24, 16.6F), paint);
+		CHECK(pixel(8, 10)[3] == 255);
+		CHECK(pixel(10, 16)[3] == 255);
+		CHECK(pixel(8, 16)[3] == 0);
+	}
+
+	SECTION("fill rule")
+	{
+		// two overlapping squares of the same direction
+		Path path;
+		path.moveTo(vec2f(8, 8)).lineTo(vec2f(40, 8)).lineTo(vec2f(40, 40)).lineTo(vec2f(8, 40)).close();
+		path.moveTo(vec2f(24, 24)).lineTo(vec2f(56, 24)).lineTo(vec2f(56, 56)).lineTo(vec2f(24, 56)).close();
+		canvas.drawPath(path, paint);
+		CHECK(pixel(30, 30)[3] == 255);
+		CHECK(alphaSum() == Approx(2 * 32 * 32 - 16 * 16));
+
+		// a hole of opposite direction
+		clear();
+		Path hole;
+		hole.moveTo(vec2f(8, 8)).lineTo(vec2f(56, 8)).lineTo(vec2f(56, 56)).lineTo(vec2f(8, 56)).close();
+		hole.moveTo(vec2f(16, 16)).lineTo(vec2f(16, 48)).lineTo(vec2f(48, 48)).lineTo(vec2f(48, 16)).close();
+		canvas.drawPath(hole, paint);
+		CHECK(pixel(30, 30)[3] == 0);
+		CHECK(alphaSum() == Approx(48 * 48 - 32 * 32));
+	}
+
+	SECTION("blend mode")
+	{
+		canvas.drawColor(vec4f(0, 0, 1, 1));
+		CHECK(pixel(0, 0)[2] == 255);
+		CHECK(pixel(63, 63)[3] == 255);
+
+		paint.setColor(vec4f(1, 0, 0, 0.5F));
+		canvas.drawRect(Rect<float>(0, 0, 8, 8), paint);
+		uint8_t* p = pixel(4, 4);
+		CHECK(std::abs(p[0] - 128) <= 1);
+		CHECK(p[1] == 0);
+		CHECK(std::abs(p[2] - 128) <= 1);
+		CHECK(p[3] == 255);
+
+		paint.setBlendMode(Paint::BlendMode::SRC);
+		canvas.drawRect(Rect<float>(8, 0, 16, 8), paint);
+		p = pixel(12, 4);
+		CHECK(std::abs(p[0] - 128) <= 1);
+		CHECK(p[2] == 0);
+		CHECK(std::abs(p[3] - 128) <= 1);
+
+		paint.setBlendMode(Paint::BlendMode::CLEAR);
+		canvas.drawRect(Rect<float>(16, 0, 24, 8), paint);
+		CHECK(pixel(20, 4)[2] == 0);
+		CHECK(pixel(20, 4)[3] == 0);
+
+		paint.setBlendMode(Paint::BlendMode::PLUS);
+		paint.setColor(vec4f(1, 1, 1, 1));
+		canvas.drawRect(Rect<float>(24, 0, 32, 8), paint);
+		CHECK(pixel(28, 4)[0] == 255);
+		CHECK(pixel(28, 4)[2] == 255);
+
+		paint.setBlendMode(Paint::BlendMode::MODULATE);
+		paint.setColor(vec4f(0.5F, 0.5F, 0.5F, 1));
+		canvas.drawRect(Rect<float>(32, 0, 40, 8), paint);
+		CHECK(std::abs(pixel(36, 4)[2] - 128) <= 1);
+		CHECK(pixel(36, 4)[0] == 0);
+	}
+
+	SECTION("clip and transform")
+	{
+		canvas.clipRect(Rect<int32_t>(0, 0, 32, 32));
+		canvas.drawColor(vec4f(1, 1, 1, 1));
+		CHECK(alphaSum() == Approx(32 * 32));
+		CHECK(pixel(32, 0)[3] == 0);
+
+		clear();
+		canvas.translate(16, 16);
+		canvas.scale(2, 2);
+		canvas.drawRect(Rect<float>(0, 0, 4, 4), paint);  // (16, 16) to (24, 24)
+		CHECK(pixel(16, 16)[3] == 255);
+		CHECK(pixel(15, 16)[3] == 0);
+		CHECK(alphaSum() == Approx(8 * 8));
+
+		// half of it is clipped
+		clear();
+		canvas.drawRect(Rect<float>(4, 4, 12, 12), paint);  // (24, 24) to (40, 40)
+		CHECK(alphaSum() == Approx(8 * 8));
+	}
+
+	SECTION("circle")
+	{
+		constexpr float radius = 20;
+		canvas.drawCircle(32.3F, 31.7F, radius, paint);
+		CHECK(alphaSum() == Approx(M_PI * radius * radius).epsilon(0.005));
+		CHECK(pixel(32, 32)[3] == 255);
+		CHECK(pixel(2, 2)[3] == 0);
+
+		clear();
+		paint.setStyle(Paint::Style::STROKE);
+		paint.setStrokeWidth(4);
+		canvas.drawCircle(32, 32, radius, paint);
+		CHECK(pixel(32, 32)[3] == 0);
+		CHECK(pixel(52, 32)[3] == 255);
+		CHECK(pixel(32, 56)[3] == 0);
+		CHECK(alphaSum() == Approx(2 * M_PI * radius * 4).epsilon(0.01));
+
+		clear();
+		Path path;
+		path.moveTo(vec2f(0, 0)).quadTo(vec2f(64, 0), vec2f(64, 64)).close();
+		paint.setStyle(Paint::Style::FILL);
+		canvas.drawPath(path, paint);
+		CHECK(alphaSum() == Approx(64 * 64 / 3.0).epsilon(0.005));  // 2/3 of the triangle
+	}
+
+	SECTION("line")
+	{
+		paint.setStrokeWidth(2);
+		canvas.drawLine(vec2f(8, 8), vec2f(56, 56), paint);
+		CHECK(pixel(32, 32)[3] == 255);
+		CHECK(pixel(32, 40)[3] == 0);
+		CHECK(alphaSum() == Approx(48 * std::sqrt(2.0) * 2).epsilon(0.01));
+	}
+
+	SECTION("text")
+	{
+		std::unique_ptr<Typeface> typeface(Typeface::createFromFile("/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf"));
+		if(!typeface)
+		{
+			slog.w(TAG, "skip text without DejaVu fonts");
+			return;
+		}
+
+		paint.setTypeface(typeface.get());
+		paint.setTextSize(24);
+		canvas.drawText("Hi\xC3\xA9", vec2f(2, 40), paint);
+		double sum = alphaSum();
+		CHECK(sum > 100);
+		CHECK(pixel(5, 30)[3] == 255);  // stem of H
+		for(int32_t x = 0; x < size; ++x)
+			CHECK(pixel(x, 50)[3] == 0);  // below baseline
+	}
+
+	SECTION("performance")
+	{
+		constexpr int32_t SIZE = 2048;
+		Canvas large(std::make_unique<Image_PNG>(SIZE, SIZE, Color::C4_U8));
+		std::memset(large.getBitmap().getData(), 0, SIZE * SIZE * 4);
+		paint.setColor(vec4f(0.2F, 0.4F, 0.8F, 0.5F));
+
+		auto start = std::chrono::steady_clock::now();
+		for(int32_t i = 0; i < 16; ++i)
+			large.drawCircle(SIZE / 2, SIZE / 2, SIZE / 2 - i * 16, paint);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		slog.i(TAG, "fill 16 circles on %dx%d canvas: %.2f ms, %.0f Mpixel/s", SIZE, SIZE, seconds * 1E3,
+				16 * M_PI * SIZE * SIZE / 4 * 0.9 / seconds * 1E-6);
+	}
+}
+
+TEST_CASE("DisplayList", tag)
+{
+	// a dashboard of static tiles, with a gauge and a counter that change every frame
+	constexpr int32_t size = 256;
+	std::unique_ptr<Typeface> typeface(Typeface::createFromFile("/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf"));
+	auto drawFrame = [&typeface](Canvas& canvas, int32_t counter)
+	{
+		Paint paint;
+		paint.setAntiAlias(true);
+		canvas.drawColor(vec4f(0.1F, 0.1F, 0.1F, 1));
+		for(int32_t i = 0; i < 16; ++i)
+		{
+			const float x = (i % 4) * 64.0F, y = (i / 4) * 64.0F;
+			paint.setStyle(Paint::Style::FILL);
+			paint.setColor(vec4f(0.2F + i * 0.05F, 0.4F, 0.6F, 1));
+			canvas.drawRoundRect(Rect<float>(x + 4, y + 4, x + 60, y + 60), 6, paint);
+			paint.setStyle(Paint::Style::STROKE);
+			paint.setStrokeWidth(2);
+			paint.setColor(vec4f(1, 1, 1, 0.5F));
+			canvas.drawCircle(x + 32, y + 32, 16, paint);
+			canvas.drawLine(vec2f(x + 8, y + 56), vec2f(x + 56, y + 40), paint);
+		}
+
+		Path path;
+		path.moveTo(vec2f(8, 8)).lineTo(vec2f(248, 120)).lineTo(vec2f(8, 248)).close();
+		paint.setStyle(Paint::Style::FILL);
+		paint.setColor(vec4f(1, 0.5F, 0, 0.25F));
+		canvas.drawPath(path, paint);
+
+		// gauge in the tile at (1, 2), rotated
+		canvas.translate(96, 160);
+		canvas.rotate(counter * 0.1F);
+		paint.setColor(vec4f(1, 0, 0, 1));
+		canvas.drawRect(Rect<float>(-1, -2, 20, 2), paint);
+		canvas.setTransform(mat3f(1.0F));
+
+		if(typeface)
+		{
+			paint.setTypeface(typeface.get());
+			paint.setTextSize(14);
+			paint.setColor(vec4f(1, 1, 1, 1));
+			canvas.drawText(std::to_string(counter), vec2f(200, 240), paint);
+		}
+	};
+
+	auto compare = [](const Image& a, const Image& b)
+	{
+		int32_t difference = 0;
+		for(int32_t i = 0; i < size * size * 4; ++i)
+			difference = std::max(difference, std::abs(a.getData()[i] - b.getData()[i]));
+		return difference;
+	};
+
+	Canvas canvas(std::make_unique<Image_PNG>(size, size, Color::C4_U8));
+	Canvas expected(std::make_unique<Image_PNG>(size, size, Color::C4_U8));
+	std::memset(canvas.getBitmap().getData(), 0, size * size * 4);
+	std::memset(expected.getBitmap().getData(), 0, size * size * 4);
+
+	DisplayList lists[2];
+	canvas.beginRecording(lists[0]);
+	drawFrame(canvas, 0);
+	canvas.endRecording();
+	CHECK(!canvas.isRecording());
+	CHECK(lists[0].getCommandCount() >= 50);
+	for(int32_t i = 0; i < size * size * 4; ++i)
+		REQUIRE(canvas.getBitmap().getData()[i] == 0);  // nothing is drawn while recording
+
+	std::vector<Rect<int32_t>> rects = lists[0].replay(canvas, nullptr);
+	REQUIRE(rects.size() == 1);
+	CHECK(rects[0] == Rect<int32_t>(0, 0, size, size));
+	drawFrame(expected, 0);
+	CHECK(compare(canvas.getBitmap(), expected.getBitmap()) == 0);
+
+	// the same frame again
+	canvas.beginRecording(lists[1]);
+	drawFrame(canvas, 0);
+	canvas.endRecording();
+	CHECK(lists[1].diff(lists[0]).empty());
+
+	for(int32_t frame = 1; frame <= 12; ++frame)
+	{
+		DisplayList& list = lists[frame & 1];
+		canvas.beginRecording(list);
+		drawFrame(canvas, frame);
+		canvas.endRecording();
+		rects = list.replay(canvas, &lists[~frame & 1]);
+		REQUIRE(!rects.empty());
+		int64_t area = 0;
+		for(const Rect<int32_t>& rect: rects)
+		{
+			CHECK((rect.left >= 0 && rect.top >= 0 && rect.right <= size && rect.bottom <= size));
+			area += static_cast<int64_t>(rect.getWidth()) * rect.getHeight();
+		}
+		CHECK(area * 10 < size * size);
+
+		// edges clipped to dirty rectangles are rounded a bit differently.
+		drawFrame(expected, frame);
+		CHECK(compare(canvas.getBitmap(), expected.getBitmap()) <= 1);
+	}
+
+	// the clip and matrix of canvas are kept by replay
+	canvas.translate(3, 4);
+	canvas.clipRect(Rect<int32_t>(0, 0, 100, 100));
+	lists[0].replay(canvas, Rect<int32_t>(0, 0, 16, 16));
+	CHECK(canvas.getClip() == Rect<int32_t>(3, 4, 103, 104));
+	CHECK(canvas.getTransform().a[6] == 3);
+
+	SECTION("performance")
+	{
+		Canvas other(std::make_unique<Image_PNG>(size, size, Color::C4_U8));
+		constexpr int32_t FRAME_COUNT = 64;
+		auto start = std::chrono::steady_clock::now();
+		for(int32_t frame = 0; frame < FRAME_COUNT; ++frame)
+			drawFrame(other, frame);
+		double immediate = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		start = std::chrono::steady_clock::now();
+		for(int32_t frame = 0; frame < FRAME_COUNT; ++frame)
+		{
+			DisplayList& list = lists[frame & 1];
+			other.beginRecording(list);
+			drawFrame(other, frame);
+			other.endRecording();
+			list.replay(other, frame > 0? &lists[~frame & 1]: nullptr);
+		}
+		double recorded = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		slog.i(TAG, "%d frames of %d commands: %.3f ms immediate, %.3f ms recorded with dirty rectangles",
+				FRAME_COUNT, static_cast<int32_t>(lists[0].getCommandCount()), immediate * 1E3, recorded * 1E3);
+	}
+}
+
+TEST_CASE("GlyphCache", tag)
+{
+	const std::string fontPath = "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf";
+	std::unique_ptr<Typeface> typeface(Typeface::createFromFile(fontPath));
+	if(!typeface)
+	{
+		slog.w(TAG, "skip glyph cache without DejaVu fonts");
+		return;
+	}
+
+	// pixels of glyph on its page are the ones rendered by FreeType.
+	auto matches = [&typeface](const GlyphCache& cache, const GlyphCache::Glyph& glyph,
+			char32_t codepoint, uint32_t size, Typeface::Style style)
+	{
+		Typeface::Bitmap bitmap;
+		REQUIRE(typeface->getGlyphBitmap(codepoint, size, style, bitmap));
+		if(glyph.rect.getWidth() != static_cast<int32_t>(bitmap.width) || glyph.rect.getHeight() != static_cast<int32_t>(bitmap.height))
+			return false;
+		const Image& page = cache.getPage(glyph.page);
+		for(uint32_t r = 0; r < bitmap.height; ++r)
+			if(std::memcmp(page.getData() + (glyph.rect.top + r) * page.getWidth() + glyph.rect.left,
+					bitmap.pixels.data() + r * bitmap.width, bitmap.width) != 0)
+				return false;
+		return true;
+	};
+
+	SECTION("on demand")
+	{
+		GlyphCache cache(fontPath, 256, 1);
+		REQUIRE(cache.isValid());
+		const char32_t text[] = U"A\u00E9\u0416 ";  // A, e acute, Cyrillic Zhe and space
+		for(char32_t codepoint: text)
+			if(codepoint != 0)
+				CHECK(cache.find(codepoint, 24, Typeface::NORMAL) == nullptr);
+		CHECK(cache.find('A', 24, Typeface::BOLD) == nullptr);
+		cache.finish();
+		CHECK(cache.getStatistics().misses == 5);
+
+		for(char32_t codepoint: U"A\u00E9\u0416")
+		{
+			if(codepoint == 0)
+				continue;
+			const GlyphCache::Glyph* glyph = cache.find(codepoint, 24, Typeface::NORMAL);
+			REQUIRE(glyph != nullptr);
+			CHECK(!glyph->rect.isEmpty());
+			CHECK(glyph->advance > 0);
+			CHECK(matches(cache, *glyph, codepoint, 24, Typeface::NORMAL));
+		}
+		const GlyphCache::Glyph* space = cache.find(' ', 24, Typeface::NORMAL);
+		REQUIRE(space != nullptr);
+		CHECK(space->rect.isEmpty());
+		CHECK(cache.getGlyphCount() == 4);
+
+		// synthesized bold is wider than normal
+		const GlyphCache::Glyph* bold = cache.find('A', 24, Typeface::BOLD);
+		REQUIRE(bold != nullptr);
+		CHECK(bold->rect.getWidth() > cache.find('A', 24, Typeface::NORMAL)->rect.getWidth());
+
+		// glyphs placed one after another in a shelf make one dirty rectangle.
+		std::vector<Rect<int32_t>> dirtyRects = cache.takeDirtyRects(0);
+		CHECK(dirtyRects.size() <= cache.getGlyphCount());
+		for(char32_t codepoint: U"A\u00E9\u0416")
+		{
+			if(codepoint == 0)
+				continue;
+			const Rect<int32_t>& rect = cache.find(codepoint, 24, Typeface::NORMAL)->rect;
+			auto contains = [&rect](const Rect<int32_t>& dirty)
+			{
+				return dirty.left <= rect.left && rect.right <= dirty.right && dirty.top <= rect.top && rect.bottom <= dirty.bottom;
+			};
+			CHECK(std::any_of(dirtyRects.begin(), dirtyRects.end(), contains));
+		}
+		CHECK(cache.takeDirtyRects(0).empty());
+
+		GlyphCache digits(fontPath, 256, 1);
+		for(char32_t c = '0'; c <= '9'; ++c)
+			digits.find(c, 24, Typeface::NORMAL);
+		digits.finish();
+		CHECK(digits.takeDirtyRects(0).size() == 1);
+
+		CHECK(cache.getAdvance('A', 24) == Approx(typeface->getAdvance('A', 24)));
+		CHECK(cache.getKerning('A', 'V', 24) <= 0);
+	}
+
+	SECTION("eviction")
+	{
+		// 10k distinct glyphs go through two small pages, 20 new ones in each frame, while 62
+		// letters and digits are used in every frame.
+		GlyphCache cache(fontPath, 256, 2);
+		const uint32_t size = 16;
+		std::vector<char32_t> hot;
+		for(char32_t c = '0'; c <= 'z'; ++c)
+			if(std::isalnum(static_cast<int>(c)))
+				hot.push_back(c);
+
+		constexpr int32_t FRAME_COUNT = 500, NEW_COUNT = 20;
+		size_t missingHot = 0, dirtyArea = 0;
+		double seconds = 0;
+		for(int32_t frame = 0; frame < FRAME_COUNT; ++frame)
+		{
+			auto start = std::chrono::steady_clock::now();
+			for(char32_t c: hot)
+				if(cache.find(c, size, Typeface::NORMAL) == nullptr && frame > 0)
+					++missingHot;
+			for(int32_t i = 0; i < NEW_COUNT; ++i)
+				cache.find(0x4E00 + frame * NEW_COUNT + i, size, Typeface::NORMAL);  // CJK ideographs
+			seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+			cache.finish();  // so that every glyph is ready in the next frame
+			start = std::chrono::steady_clock::now();
+			cache.update();
+			for(uint32_t page = 0; page < cache.getPageCount(); ++page)
+				for(const Rect<int32_t>& rect: cache.takeDirtyRects(page))
+					dirtyArea += rect.getWidth() * rect.getHeight();
+			seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
+
+		const GlyphCache::Statistics& statistics = cache.getStatistics();
+		CHECK(missingHot == 0);
+		CHECK(statistics.misses == hot.size() + FRAME_COUNT * NEW_COUNT);
+		CHECK(statistics.evictions > 0);
+		CHECK(statistics.failures == 0);
+		CHECK(cache.getPageCount() == 2);
+		// uploads are about the glyphs, not the pages.
+		CHECK(dirtyArea < statistics.misses * (size + 2) * (size + 2) * 2);
+
+		// glyphs in use are intact, none overlaps another.
+		std::vector<const GlyphCache::Glyph*> glyphs;
+		for(char32_t c: hot)
+		{
+			glyphs.push_back(cache.find(c, size, Typeface::NORMAL));
+			REQUIRE(glyphs.back() != nullptr);
+			CHECK(matches(cache, *glyphs.back(), c, size, Typeface::NORMAL));
+		}
+		for(int32_t i = 0; i < NEW_COUNT; ++i)
+		{
+			char32_t c = 0x4E00 + (FRAME_COUNT - 1) * NEW_COUNT + i;
+			glyphs.push_back(cache.find(c, size, Typeface::NORMAL));
+			REQUIRE(glyphs.back() != nullptr);
+			CHECK(matches(cache, *glyphs.back(), c, size, Typeface::NORMAL));
+		}
+		for(size_t i = 0; i < glyphs.size(); ++i)
+			for(size_t j = i + 1; j < glyphs.size(); ++j)
+			{
+				const Rect<int32_t>& a = glyphs[i]->rect;
+				const Rect<int32_t>& b = glyphs[j]->rect;
+				bool overlap = glyphs[i]->page == glyphs[j]->page && !a.isEmpty() && !b.isEmpty() &&
+						a.left < b.right && b.left < a.right && a.top < b.bottom && b.top < a.bottom;
+				REQUIRE(!overlap);
+			}
+
+		slog.i(TAG, "%zu glyphs through %u pages, %zu hits, %zu evictions, %.2f us per frame on the drawing thread",
+				statistics.misses, cache.getPageCount(), statistics.hits, statistics.evictions, seconds / FRAME_COUNT * 1E6);
+
+		// updates in the middle of a frame keep its glyphs, new ones fail once pages are full.
+		const size_t failures = statistics.failures;
+		for(char32_t c = 0xAC00; statistics.failures == failures && c < 0xAC00 + 4096; ++c)
+		{
+			cache.find(c, size, Typeface::NORMAL);
+			cache.finish();
+			cache.update(false);
+		}
+		CHECK(statistics.failures > failures);
+		for(size_t i = 0; i < hot.size(); ++i)
+			CHECK(cache.find(hot[i], size, Typeface::NORMAL) == glyphs[i]);
+	}
+}
+
+TEST_CASE("TextLayoutCache", tag)
+{
+	const std::string fontPath = "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf";
+	GlyphCache cache(fontPath, 256, 1);
+	if(!cache.isValid())
+	{
+		slog.w(TAG, "skip text layout cache without DejaVu fonts");
+		return;
+	}
+
+	using Vertex = TextLayoutCache::Vertex;
+	TextLayoutCache layouts(cache);
+	const uint32_t red = TextLayoutCache::packColor(vec4f(1, 0, 0, 1));
+	CHECK(reinterpret_cast<const uint8_t*>(&red)[0] == 255);
+	CHECK(reinterpret_cast<const uint8_t*>(&red)[1] == 0);
+	CHECK(reinterpret_cast<const uint8_t*>(&red)[3] == 255);
+
+	auto append = [&layouts](const std::string& text, const vec2f& position, uint32_t color)
+	{
+		std::vector<std::vector<Vertex>> pages;
+		bool complete = layouts.append(text, 16, Typeface::NORMAL, 1.0F, position, color, pages);
+		return std::make_pair(complete, pages);
+	};
+	auto equals = [](const std::vector<Vertex>& a, const std::vector<Vertex>& b)
+	{
+		return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(Vertex)) == 0;
+	};
+
+	// glyphs not rendered yet are left out, and the text isn't kept.
+	CHECK(!append("Hello, world", vec2f(0, 0), red).first);
+	CHECK(layouts.getSize() == 0);
+	cache.finish();
+
+	auto first = append("Hello, world", vec2f(10, 20), red);
+	REQUIRE(first.first);
+	REQUIRE(first.second.size() == 1);
+	CHECK(first.second[0].size() == 11 * 6);  // space takes no quad
+	CHECK(layouts.getSize() == 1);
+	size_t misses = layouts.getStatistics().misses;
+
+	auto second = append("Hello, world", vec2f(10, 20), red);
+	CHECK(layouts.getStatistics().misses == misses);
+	CHECK(layouts.getStatistics().hits == 1);
+	CHECK(equals(first.second[0], second.second[0]));
+
+	// moved text keeps its shape.
+	auto moved = append("Hello, world", vec2f(15, 20), red);
+	REQUIRE(moved.second[0].size() == first.second[0].size());
+	for(size_t i = 0; i < moved.second[0].size(); ++i)
+	{
+		CHECK(moved.second[0][i].vertex.x == Approx(first.second[0][i].vertex.x + 5));
+		CHECK(moved.second[0][i].vertex.y == first.second[0][i].vertex.y);
+	}
+	CHECK(layouts.getStatistics().misses == misses);
+
+	// the same layout as laying out without cache.
+	std::vector<const GlyphCache::Glyph*> glyphs;
+	std::vector<float> distances;
+	layouts.layout("Hello, world", 16, Typeface::NORMAL, 1.0F, glyphs, distances);
+	REQUIRE(glyphs.size() == 12);
+	CHECK(first.second[0][0].vertex.x == Approx(10 + distances[0] + glyphs[0]->bearing.x));
+
+	// evicted glyphs make layouts laid out again.
+	size_t generation = cache.getGeneration();
+	for(char32_t c = 0x4E00; cache.getGeneration() == generation && c < 0x4E00 + 4096; ++c)
+	{
+		cache.find(c, 24, Typeface::NORMAL);
+		cache.finish();
+		cache.update();
+	}
+	REQUIRE(cache.getGeneration() != generation);
+	append("Hello, world", vec2f(10, 20), red);
+	cache.finish();
+	CHECK(append("Hello, world", vec2f(10, 20), red).first);
+	CHECK(layouts.getStatistics().misses > misses);
+
+	// hundreds of labels drawn frame after frame, most of them unchanged.
+	constexpr int32_t LABEL_COUNT = 500, FRAME_COUNT = 100;
+	std::vector<std::vector<Vertex>> pages;
+	for(int32_t i = 0; i < LABEL_COUNT; ++i)
+		layouts.append("label " + std::to_string(i), 16, Typeface::NORMAL, 1.0F, vec2f(0, i * 16), red, pages);
+	cache.finish();
+	std::vector<std::string> labels;
+	for(int32_t i = 0; i < LABEL_COUNT; ++i)
+		labels.push_back("label " + std::to_string(i));
+	
+	const TextLayoutCache::Statistics before = layouts.getStatistics();
+	auto start = std::chrono::steady_clock::now();
+	size_t vertexCount = 0;
+	for(int32_t frame = 0; frame < FRAME_COUNT; ++frame)
+	{
+		cache.update();
+		for(std::vector<Vertex>& vertices: pages)
+			vertices.clear();
+		for(int32_t i = 0; i < LABEL_COUNT; ++i)
+			layouts.append(labels[i], 16, Typeface::NORMAL, 1.0F, vec2f(0, i * 16), red, pages);
+		vertexCount += pages[0].size();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	const TextLayoutCache::Statistics& after = layouts.getStatistics();
+	CHECK(after.misses - before.misses <= static_cast<size_t>(LABEL_COUNT));
+	CHECK(after.hits - before.hits >= static_cast<size_t>(LABEL_COUNT * (FRAME_COUNT - 1)));
+	slog.i(TAG, "%d labels, %zu vertices per frame, %.2f us per frame", LABEL_COUNT, vertexCount / FRAME_COUNT, seconds / FRAME_COUNT * 1E6);
+}
+
+TEST_CASE("DistanceField", tag)
+{
+	using Method = DistanceField::Method;
+	constexpr uint32_t SIZE = 32;
+	constexpr float RANGE = 8;
+	auto decode = [](uint8_t value) { return (value / 255.0F - 0.5F) * RANGE; };
+
+	SECTION("circle")
+	{
+		// distances of a circle are known everywhere.
+		Path circle;
+		circle.moveTo(vec2f(26, 16)).arcTo(vec2f(16, 16), 2 * M_PI).close();
+		std::vector<uint8_t> exact(SIZE * SIZE), ssedt(SIZE * SIZE), msdf(SIZE * SIZE * 3);
+		DistanceField::generate(circle, Method::EXACT, RANGE, SIZE, SIZE, exact.data());
+		DistanceField::generate(circle, Method::SSEDT, RANGE, SIZE, SIZE, ssedt.data());
+		DistanceField::generate(circle, Method::MULTICHANNEL, RANGE, SIZE, SIZE, msdf.data());
+
+		const float step = RANGE / 255;
+		for(uint32_t y = 0; y < SIZE; ++y)
+			for(uint32_t x = 0; x < SIZE; ++x)
+			{
+				const size_t i = y * SIZE + x;
+				float distance = 10 - (vec2f(x + 0.5F, y + 0.5F) - vec2f(16, 16)).length();
+				distance = std::clamp(distance, -RANGE / 2, RANGE / 2);
+				REQUIRE(decode(exact[i]) == Approx(distance).margin(step + 0.05F));
+				REQUIRE(decode(ssedt[i]) == Approx(distance).margin(1.0F));
+				// a smooth contour takes all channels
+				REQUIRE(msdf[i * 3] == exact[i]);
+				REQUIRE(msdf[i * 3 + 1] == exact[i]);
+				REQUIRE(msdf[i * 3 + 2] == exact[i]);
+			}
+	}
+
+	SECTION("corner")
+	{
+		// near a corner of a square, one channel rounds it off, the median of three keeps it sharp.
+		Path square;
+		square.addRect(Rect<float>(8, 8, 24, 24), Path::Direction::CW);
+		std::vector<uint8_t> exact(SIZE * SIZE), msdf(SIZE * SIZE * 3);
+		DistanceField::generate(square, Method::EXACT, RANGE, SIZE, SIZE, exact.data());
+		DistanceField::generate(square, Method::MULTICHANNEL, RANGE, SIZE, SIZE, msdf.data());
+
+		auto median = [&msdf](size_t i)
+		{
+			const uint8_t* p = msdf.data() + i * 3;
+			return std::max(std::min(p[0], p[1]), std::min(std::max(p[0], p[1]), p[2]));
+		};
+		const float step = RANGE / 255;
+		const size_t corner = 6 * SIZE + 6;  // (6.5, 6.5) is 1.5 away from both sides
+		CHECK(decode(exact[corner]) == Approx(-1.5F * std::sqrt(2.0F)).margin(step));
+		CHECK(decode(median(corner)) == Approx(-1.5F).margin(step));
+		for(uint32_t y = 0; y < SIZE; ++y)
+			for(uint32_t x = 0; x < SIZE; ++x)
+			{
+				// the median tells inside from outside, as the true distance does.
+				const size_t i = y * SIZE + x;
+				const bool inside = 8 < x + 0.5F && x + 0.5F < 24 && 8 < y + 0.5F && y + 0.5F < 24;
+				REQUIRE((median(i) > 128) == inside);
+				REQUIRE((exact[i] > 128) == inside);
+			}
+	}
+
+	SECTION("transform")
+	{
+		// a single pixel is half a pixel thick.
+		std::vector<uint8_t> coverage(SIZE * SIZE, 0), field(SIZE * SIZE);
+		coverage[16 * SIZE + 16] = 255;
+		DistanceField::transform(coverage.data(), SIZE, SIZE, RANGE, field.data());
+		CHECK(decode(field[16 * SIZE + 16]) == Approx(0.5F).margin(0.02F));
+		CHECK(decode(field[16 * SIZE + 18]) == Approx(-1.5F).margin(0.02F));
+		CHECK(decode(field[19 * SIZE + 20]) == Approx(-4.5F + 0.5F).margin(0.02F));
+	}
+
+	SECTION("glyphs")
+	{
+		const std::string fontPath = "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf";
+		std::unique_ptr<Typeface> typeface(Typeface::createFromFile(fontPath));
+		if(!typeface)
+		{
+			slog.w(TAG, "skip distance field glyphs without DejaVu fonts");
+			return;
+		}
+
+		std::vector<char32_t> codepoints;
+		for(char32_t c = 0x20; c < 0x7F; ++c)
+			codepoints.push_back(c);
+		auto start = std::chrono::steady_clock::now();
+		std::vector<DistanceField::Glyph> glyphs = DistanceField::generate(*typeface, codepoints, 32, 4, Method::MULTICHANNEL);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		REQUIRE(glyphs.size() == codepoints.size());
+		CHECK(glyphs[0].image == nullptr);  // space
+		CHECK(glyphs[0].advance > 0);
+
+		// fields line up with the glyphs FreeType renders, padded by half of range.
+		size_t area = 0;
+		for(const DistanceField::Glyph& glyph: glyphs)
+		{
+			if(!glyph.image)
+				continue;
+			REQUIRE(glyph.image->getColorFormat() == Color::Format::C3_U8);
+			area += glyph.image->getWidth() * glyph.image->getHeight();
+			Typeface::Bitmap bitmap;
+			REQUIRE(typeface->getGlyphBitmap(glyph.codepoint, 32, Typeface::NORMAL, bitmap));
+			CHECK(std::abs(glyph.bearing.x + 2 - bitmap.left) <= 1);
+			CHECK(std::abs(glyph.bearing.y - 2 - bitmap.top) <= 1);
+		}
+
+		// 'I' is a bar, so inside is in the middle of it, and outside at the borders.
+		const DistanceField::Glyph& I = glyphs['I' - 0x20];
+		const Image& image = *I.image;
+		const uint8_t* center = image.getData() + (image.getHeight() / 2 * image.getWidth() + image.getWidth() / 2) * 3;
+		CHECK(center[0] > 128);
+		CHECK(image.getData()[0] < 128);
+		slog.i(TAG, "%zu glyphs of %zu pixels in %.2f ms", glyphs.size(), area, seconds * 1E3);
+	}
+}
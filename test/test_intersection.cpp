@@ -1,10 +1,18 @@
 #include "test/catch.hpp"
 
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+#include "geometry/BoundingVolumeHierarchy.h"
 #include "geometry/RayCast.h"
+#include "geometry/Teapot.h"
+#include "util/Log.h"
 
 using namespace pea;
 
 static const char* tag = "[collision]";  // used by Catch2
+static const char* TAG = "collision";   // used by log
 
 TEST_CASE("sphere", tag)
 {
@@ -190,3 +198,362 @@ TEST_CASE("BoundingBox", tag)
 	REQUIRE(hitInfo.normal == vec3f(0, 0, -1));
 	REQUIRE(!hitInfo.inside);
 }
+
+TEST_CASE("BoundingVolumeHierarchy", tag)
+{
+	uint32_t seed = 1;
+	auto random = [&seed](float min, float max)
+	{
+		seed = seed * 1664525U + 1013904223U;
+		return min + (max - min) * static_cast<float>(seed >> 8) / (1U << 24);
+	};
+	auto randomDirection = [&random]()
+	{
+		vec3f direction;
+		do
+			direction = vec3f(random(-1, 1), random(-1, 1), random(-1, 1));
+		while(direction.length2() > 1 || direction.length2() < 1E-4F);
+		return normalize(direction);
+	};
+
+	// small triangles scattered in a unit cube
+	auto createSoup = [&random](size_t count, std::vector<vec3f>& positions, std::vector<uint32_t>& indices)
+	{
+		positions.clear();
+		indices.clear();
+		for(size_t i = 0; i < count; ++i)
+		{
+			vec3f center(random(0, 1), random(0, 1), random(0, 1));
+			for(int32_t j = 0; j < 3; ++j)
+			{
+				indices.push_back(static_cast<uint32_t>(positions.size()));
+				positions.push_back(center + vec3f(random(-0.03F, 0.03F), random(-0.03F, 0.03F), random(-0.03F, 0.03F)));
+			}
+		}
+	};
+
+	// nearest hit of testing every triangle
+	auto castRays = [](const Ray& ray, const std::vector<vec3f>& positions, const std::vector<uint32_t>& indices,
+			float& nearest, uint32_t& triangle)
+	{
+		const vec3f& origin = ray.getOrigin();
+		const vec3f& direction = ray.getDirection();
+		nearest = std::numeric_limits<float>::infinity();
+		triangle = std::numeric_limits<uint32_t>::max();
+		for(size_t i = 0; i < indices.size(); i += 3)
+		{
+			const vec3f& v0 = positions[indices[i]];
+			vec3f edge1 = positions[indices[i + 1]] - v0, edge2 = positions[indices[i + 2]] - v0;
+			vec3f p = cross(direction, edge2);
+			float determinant = dot(edge1, p);
+			if(determinant == 0)
+				continue;
+			vec3f s = origin - v0;
+			float u = dot(s, p) / determinant;
+			vec3f q = cross(s, edge1);
+			float v = dot(direction, q) / determinant;
+			float t = dot(edge2, q) / determinant;
+			if(u >= 0 && v >= 0 && u + v <= 1 && t > 0 && t < nearest)
+			{
+				nearest = t;
+				triangle = static_cast<uint32_t>(i / 3);
+			}
+		}
+		return triangle != std::numeric_limits<uint32_t>::max();
+	};
+
+	BoundingVolumeHierarchy bvh;
+	BoundingVolumeHierarchy::Hit hit;
+	Ray ray(vec3f(0, 0, 0), vec3f(0, 0, 1));
+	REQUIRE(!bvh.intersect(ray, hit));
+	REQUIRE(!bvh.occluded(ray));
+	REQUIRE(bvh.getDepth() == 0);
+	REQUIRE(bvh.intersect(&ray, 1, &hit) == 0);
+	REQUIRE(hit.triangle == BoundingVolumeHierarchy::MISS);
+
+	SECTION("sphere")
+	{
+		// UV sphere of radius 1, counter clockwise seen from outside
+		constexpr int32_t SLICES = 64, STACKS = 32;
+		std::vector<vec3f> positions;
+		std::vector<uint32_t> indices;
+		for(int32_t i = 0; i <= STACKS; ++i)
+			for(int32_t j = 0; j <= SLICES; ++j)
+			{
+				float theta = static_cast<float>(M_PI) * i / STACKS, phi = 2 * static_cast<float>(M_PI) * j / SLICES;
+				positions.push_back(vec3f(std::sin(theta) * std::cos(phi), std::sin(theta) * std::sin(phi), std::cos(theta)));
+			}
+		for(int32_t i = 0; i < STACKS; ++i)
+			for(int32_t j = 0; j < SLICES; ++j)
+			{
+				uint32_t a = i * (SLICES + 1) + j, b = a + SLICES + 1;
+				for(uint32_t index: {a, b, a + 1, a + 1, b, b + 1})
+					indices.push_back(index);
+			}
+		bvh.build(positions.data(), indices.data(), indices.size() / 3);
+		CHECK(bvh.getTriangleCount() == indices.size() / 3);
+		CHECK(bvh.getNodeCount() < indices.size() / 3 * 2);
+		BoundingBox box = bvh.getBoundingBox();
+		CHECK(box.getLowerBound().x == Approx(-1).margin(1E-6));
+		CHECK(box.getUpperBound().z == Approx(1).margin(1E-6));
+
+		HitInfo hitInfo;
+		for(int32_t i = 0; i < 100; ++i)
+		{
+			vec3f direction = randomDirection();
+			ray = Ray(direction * -3, direction);
+			REQUIRE(castRay(ray, bvh, hitInfo));
+			CHECK(hitInfo.coordinate == Approx(2).margin(0.01));
+			CHECK(!hitInfo.inside);
+			CHECK(dot(hitInfo.normal, direction) < -0.99F);
+
+			ray = Ray(vec3f(0, 0, 0), direction);
+			REQUIRE(castRay(ray, bvh, hitInfo));
+			CHECK(hitInfo.coordinate == Approx(1).margin(0.01));
+			CHECK(hitInfo.inside);
+			CHECK(dot(hitInfo.normal, direction) < -0.99F);
+			CHECK(bvh.occluded(ray, 1.1F));
+			CHECK(!bvh.occluded(ray, 0.9F));
+		}
+
+		ray = Ray(vec3f(2, 0, 0), vec3f(1, 0, 0));
+		CHECK(!castRay(ray, bvh, hitInfo));
+	}
+
+	SECTION("soup")
+	{
+		std::vector<vec3f> positions;
+		std::vector<uint32_t> indices;
+		createSoup(20000, positions, indices);
+		bvh.build(positions.data(), indices.data(), indices.size() / 3);
+		CHECK(bvh.getDepth() < 64);
+
+		auto compare = [&]()
+		{
+			int32_t hitCount = 0;
+			for(int32_t i = 0; i < 1000; ++i)
+			{
+				ray = Ray(vec3f(random(-0.5F, 1.5F), random(-0.5F, 1.5F), random(-0.5F, 1.5F)), randomDirection());
+				float nearest;
+				uint32_t triangle;
+				bool expected = castRays(ray, positions, indices, nearest, triangle);
+				bool actual = bvh.intersect(ray, hit);
+				REQUIRE(actual == expected);
+				if(!expected)
+					continue;
+
+				++hitCount;
+				CHECK(hit.triangle == triangle);
+				CHECK(hit.distance == Approx(nearest));
+				vec3f point = ray.at(hit.distance);
+				const vec3f& v0 = positions[indices[triangle * 3]];
+				vec3f interpolated = v0 + (positions[indices[triangle * 3 + 1]] - v0) * hit.u +
+						(positions[indices[triangle * 3 + 2]] - v0) * hit.v;
+				CHECK((point - interpolated).length() < 1E-4F);
+				CHECK(bvh.occluded(ray, nearest * 1.001F));
+				CHECK(!bvh.occluded(ray, nearest * 0.999F));
+				CHECK(bvh.intersect(ray, hit, nearest * 0.999F) == false);
+			}
+			CHECK(hitCount > 100);
+		};
+		compare();
+
+		// deform and refit, then compare again
+		for(vec3f& position: positions)
+			position += vec3f(0.1F * std::sin(position.y * 6), 0.1F * std::cos(position.z * 4), 0);
+		bvh.refit(positions.data(), indices.data());
+		compare();
+	}
+
+	SECTION("degenerate")
+	{
+		// coincident triangles can't be split by SAH, nor by bins.
+		std::vector<vec3f> positions = {vec3f(0, 0, 0), vec3f(1, 0, 0), vec3f(0, 1, 0)};
+		std::vector<uint32_t> indices;
+		for(int32_t i = 0; i < 1000; ++i)
+			indices.insert(indices.end(), {0, 1, 2});
+		bvh.build(positions.data(), indices.data(), 1000, 1);
+		CHECK(bvh.getDepth() < 64);
+		ray = Ray(vec3f(0.25F, 0.25F, 1), vec3f(0, 0, -1));
+		REQUIRE(bvh.intersect(ray, hit));
+		CHECK(hit.distance == 1);
+		CHECK(hit.triangle < 1000);
+		CHECK(hit.normal == vec3f(0, 0, 1));
+	}
+
+	SECTION("packet")
+	{
+		std::vector<vec3f> positions;
+		std::vector<uint32_t> indices;
+		createSoup(20000, positions, indices);
+		bvh.build(positions.data(), indices.data(), indices.size() / 3);
+
+		// coherent rays from a corner, then random ones, and the last packet is partly filled.
+		std::vector<Ray> rays;
+		for(int32_t i = 0; i < 1000; ++i)
+		{
+			vec3f target(random(0.4F, 0.6F), random(0.4F, 0.6F), random(0.4F, 0.6F));
+			rays.push_back(i < 500? Ray::from(vec3f(-1, -1, -1), target):
+					Ray(vec3f(random(-0.5F, 1.5F), random(-0.5F, 1.5F), random(-0.5F, 1.5F)), randomDirection()));
+		}
+		rays.push_back(Ray(vec3f(2, 2, 2), vec3f(1, 0, 0)));
+
+		std::vector<BoundingVolumeHierarchy::Hit> hits(rays.size());
+		std::vector<uint8_t> occluded(rays.size());
+		size_t hitCount = bvh.intersect(rays.data(), rays.size(), hits.data());
+		size_t occludedCount = bvh.occluded(rays.data(), rays.size(), occluded.data(), 0.5F);
+		size_t expectedHitCount = 0, expectedOccludedCount = 0;
+		for(size_t i = 0; i < rays.size(); ++i)
+		{
+			bool expected = bvh.intersect(rays[i], hit);
+			REQUIRE((hits[i].triangle != BoundingVolumeHierarchy::MISS) == expected);
+			if(expected)
+			{
+				++expectedHitCount;
+				CHECK(hits[i].triangle == hit.triangle);
+				CHECK(hits[i].distance == Approx(hit.distance));
+				CHECK(hits[i].u == Approx(hit.u).margin(1E-5));
+				CHECK(hits[i].v == Approx(hit.v).margin(1E-5));
+				CHECK(hits[i].normal == hit.normal);
+			}
+			else
+				CHECK(hits[i].distance == std::numeric_limits<float>::infinity());
+
+			expected = bvh.occluded(rays[i], 0.5F);
+			CHECK(occluded[i] == expected);
+			expectedOccludedCount += expected;
+		}
+		CHECK(hitCount == expectedHitCount);
+		CHECK(occludedCount == expectedOccludedCount);
+		CHECK(hitCount > 500);
+		CHECK(occludedCount > 0);
+		CHECK(occludedCount < hitCount);
+
+		// fewer rays than a packet
+		CHECK(bvh.intersect(rays.data(), 3, hits.data()) == (hits[0].triangle != BoundingVolumeHierarchy::MISS) +
+				(hits[1].triangle != BoundingVolumeHierarchy::MISS) + (hits[2].triangle != BoundingVolumeHierarchy::MISS));
+	}
+
+	SECTION("packet performance")
+	{
+		// Utah teapot of 256K triangles filling the view of a camera above it, rays of 4x4 pixels
+		// in a packet.
+		Teapot teapot(64);
+		std::vector<vec3f> positions = teapot.getVertexData();
+		std::vector<uint32_t> indices = teapot.getIndexData(Primitive::TRIANGLES);
+		bvh.build(positions.data(), indices.data(), indices.size() / 3);
+
+		constexpr int32_t SIZE = 512;
+		const vec3f eye(0, -6, 3.5F), center(0.2F, 0, 1.5F);
+		const vec3f forward = normalize(center - eye);
+		const vec3f right = normalize(cross(forward, vec3f(0, 0, 1)));
+		const vec3f up = cross(right, forward);
+		std::vector<Ray> rays;
+		for(int32_t y = 0; y < SIZE; y += 4)
+			for(int32_t x = 0; x < SIZE; x += 4)
+				for(int32_t i = 0; i < 16; ++i)
+				{
+					float sx = (x + i % 4 + 0.5F) / SIZE * 2 - 1, sy = 1 - (y + i / 4 + 0.5F) / SIZE * 2;
+					rays.push_back(Ray(eye, normalize(forward + (right * sx + up * sy) * 0.5F)));
+				}
+
+		auto measure = [](const char* name, size_t rayCount, auto&& single, auto&& packet)
+		{
+			auto start = std::chrono::steady_clock::now();
+			size_t expected = single();
+			double singleTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			start = std::chrono::steady_clock::now();
+			size_t actual = packet();
+			double packetTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			CHECK(actual == expected);
+			slog.i(TAG, "%s of %zu rays: %.2f Mrays/s one by one, %.2f Mrays/s in packets with %s, %.2fx", name, rayCount,
+					rayCount / singleTime * 1E-6, rayCount / packetTime * 1E-6,
+					BoundingVolumeHierarchy::getInstructionSet(), singleTime / packetTime);
+		};
+
+		std::vector<BoundingVolumeHierarchy::Hit> hits(rays.size());
+		measure("primary", rays.size(), [&]()
+		{
+			size_t count = 0;
+			for(const Ray& ray: rays)
+				count += bvh.intersect(ray, hit);
+			return count;
+		}, [&]()
+		{
+			return bvh.intersect(rays.data(), rays.size(), hits.data());
+		});
+
+		// shadow rays toward a directional light, and ambient occlusion rays of 16 directions
+		// around some of the points hit.
+		const vec3f light = normalize(vec3f(1, -1, 2));
+		std::vector<Ray> shadowRays, occlusionRays;
+		for(size_t i = 0; i < rays.size(); ++i)
+		{
+			if(hits[i].triangle == BoundingVolumeHierarchy::MISS)
+				continue;
+
+			vec3f normal = dot(hits[i].normal, rays[i].getDirection()) > 0? -hits[i].normal: hits[i].normal;
+			vec3f point = rays[i].at(hits[i].distance) + normal * 1E-3F;
+			shadowRays.push_back(Ray(point, light));
+			if(i % 16 != 0)
+				continue;
+			for(int32_t j = 0; j < 16; ++j)
+			{
+				vec3f direction = randomDirection();
+				occlusionRays.push_back(Ray(point, dot(direction, normal) < 0? -direction: direction));
+			}
+		}
+		REQUIRE(!shadowRays.empty());
+
+		std::vector<uint8_t> occluded(std::max(shadowRays.size(), occlusionRays.size()));
+		auto measureOcclusion = [&](const char* name, const std::vector<Ray>& testRays, float maxDistance)
+		{
+			measure(name, testRays.size(), [&]()
+			{
+				size_t count = 0;
+				for(const Ray& ray: testRays)
+					count += bvh.occluded(ray, maxDistance);
+				return count;
+			}, [&]()
+			{
+				return bvh.occluded(testRays.data(), testRays.size(), occluded.data(), maxDistance);
+			});
+		};
+		measureOcclusion("shadow", shadowRays, std::numeric_limits<float>::infinity());
+		measureOcclusion("ambient occlusion", occlusionRays, 0.5F);
+	}
+
+	SECTION("performance")
+	{
+		std::vector<vec3f> positions;
+		std::vector<uint32_t> indices;
+		constexpr size_t TRIANGLE_COUNT = 1000000;
+		createSoup(TRIANGLE_COUNT, positions, indices);
+		auto start = std::chrono::steady_clock::now();
+		bvh.build(positions.data(), indices.data(), TRIANGLE_COUNT);
+		double building = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		start = std::chrono::steady_clock::now();
+		bvh.refit(positions.data(), indices.data());
+		double refitting = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		constexpr int32_t RAY_COUNT = 100000;
+		int32_t hitCount = 0;
+		start = std::chrono::steady_clock::now();
+		for(int32_t i = 0; i < RAY_COUNT; ++i)
+		{
+			ray = Ray(vec3f(random(0, 1), random(0, 1), random(0, 1)), randomDirection());
+			hitCount += bvh.intersect(ray, hit);
+		}
+		double casting = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		float nearest;
+		uint32_t triangle;
+		start = std::chrono::steady_clock::now();
+		castRays(ray, positions, indices, nearest, triangle);
+		double testing = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		CHECK(hitCount > RAY_COUNT / 2);
+		slog.i(TAG, "BVH of %zu triangles: build %.1f ms, refit %.1f ms, depth %u, %.2f Mrays/s, %.0fx faster than testing every triangle",
+				TRIANGLE_COUNT, building * 1E3, refitting * 1E3, bvh.getDepth(), RAY_COUNT / casting * 1E-6, testing / (casting / RAY_COUNT));
+	}
+}